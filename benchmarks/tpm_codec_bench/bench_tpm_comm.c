@@ -0,0 +1,345 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "azure_utpm_c/tpm_codec.h"
+#include "azure_utpm_c/Marshal_fp.h"
+#include "bench_tpm_comm.h"
+
+static const TPMS_RSA_PARMS bench_rsa_params = {
+    { TPM_ALG_AES, 128, TPM_ALG_CFB },      // TPMT_SYM_DEF_OBJECT  symmetric
+    { TPM_ALG_NULL },                       // TPMT_RSA_SCHEME      scheme
+    2048,                                   // TPMI_RSA_KEY_BITS    keyBits
+    0                                       // UINT32               exponent
+};
+
+typedef struct BENCH_RESPONSE_TAG
+{
+    uint32_t length;
+    unsigned char bytes[MAX_RESPONSE_BUFFER];
+} BENCH_RESPONSE;
+
+typedef struct TPM_COMM_INFO_TAG
+{
+    BENCH_RESPONSE hmac_resp;
+    BENCH_RESPONSE read_public_resp;
+    BENCH_RESPONSE get_cap_resp;
+    BENCH_RESPONSE success_resp;
+
+    const BENCH_RESPONSE* pending_resp;
+} TPM_COMM_INFO;
+
+static UINT64 g_bytes_transferred;
+
+void bench_get_public(TPM2B_PUBLIC* pub)
+{
+    UINT32 index;
+
+    memset(pub, 0, sizeof(TPM2B_PUBLIC));
+    pub->publicArea.type = TPM_ALG_RSA;
+    pub->publicArea.nameAlg = TPM_ALG_SHA256;
+    pub->publicArea.objectAttributes = ToTpmaObject(
+        Restricted | Decrypt | FixedTPM | FixedParent | NoDA | UserWithAuth | SensitiveDataOrigin);
+    pub->publicArea.parameters.rsaDetail = bench_rsa_params;
+    pub->publicArea.unique.rsa.t.size = 2048 / 8;
+    for (index = 0; index < pub->publicArea.unique.rsa.t.size; index++)
+    {
+        pub->publicArea.unique.rsa.t.buffer[index] = (BYTE)(index * 7 + 1);
+    }
+}
+
+void bench_get_capability_data(TPMS_CAPABILITY_DATA* capData)
+{
+    UINT32 index;
+
+    memset(capData, 0, sizeof(TPMS_CAPABILITY_DATA));
+    capData->capability = TPM_CAP_TPM_PROPERTIES;
+    capData->data.tpmProperties.count = BENCH_PROPERTY_COUNT;
+    for (index = 0; index < BENCH_PROPERTY_COUNT; index++)
+    {
+        capData->data.tpmProperties.tpmProperty[index].property = PT_FIXED + index;
+        capData->data.tpmProperties.tpmProperty[index].value = index == TPM_PT_INPUT_BUFFER - PT_FIXED
+            ? MAX_DIGEST_BUFFER : 0x100 + index;
+    }
+}
+
+UINT64 bench_tpm_comm_get_bytes(void)
+{
+    return g_bytes_transferred;
+}
+
+void bench_tpm_comm_reset_counters(void)
+{
+    g_bytes_transferred = 0;
+}
+
+// Marshals the response header and returns the write position of the
+// parameters. The total size is filled in by finish_response.
+static BYTE* begin_response(BENCH_RESPONSE* resp, TPM_ST tag, INT32* capacity)
+{
+    BYTE* pos = resp->bytes;
+    UINT32 size = 0;
+    TPM_RC rc = TPM_RC_SUCCESS;
+
+    *capacity = sizeof(resp->bytes);
+    (void)TPM_ST_Marshal(&tag, &pos, capacity);
+    (void)UINT32_Marshal(&size, &pos, capacity);
+    (void)TPM_RC_Marshal(&rc, &pos, capacity);
+    return pos;
+}
+
+static void finish_response(BENCH_RESPONSE* resp, BYTE* end)
+{
+    BYTE* pSize = resp->bytes + sizeof(TPM_ST);
+
+    resp->length = (uint32_t)(end - resp->bytes);
+    (void)UINT32_Marshal(&resp->length, &pSize, NULL);
+}
+
+static void build_hmac_response(BENCH_RESPONSE* resp)
+{
+    INT32 capacity;
+    BYTE* pos = begin_response(resp, TPM_ST_SESSIONS, &capacity);
+    BYTE* pParamSize = pos;
+    UINT32 paramSize = 0;
+    TPM2B_DIGEST hmac;
+    TPMS_AUTH_RESPONSE sessOut;
+
+    memset(&hmac, 0xA5, sizeof(hmac));
+    hmac.t.size = BENCH_HMAC_SIZE;
+    memset(&sessOut, 0, sizeof(sessOut));
+    sessOut.sessionAttributes.continueSession = SET;
+
+    (void)UINT32_Marshal(&paramSize, &pos, &capacity);
+    paramSize = TPM2B_DIGEST_Marshal(&hmac, &pos, &capacity);
+    (void)UINT32_Marshal(&paramSize, &pParamSize, NULL);
+    (void)TPMS_AUTH_RESPONSE_Marshal(&sessOut, &pos, &capacity);
+    finish_response(resp, pos);
+}
+
+static void build_read_public_response(BENCH_RESPONSE* resp)
+{
+    INT32 capacity;
+    BYTE* pos = begin_response(resp, TPM_ST_NO_SESSIONS, &capacity);
+    TPM2B_PUBLIC pub;
+    TPM2B_NAME name;
+
+    bench_get_public(&pub);
+    memset(&name, 0x3C, sizeof(name));
+    name.t.size = sizeof(TPM_ALG_ID) + BENCH_HMAC_SIZE;
+
+    (void)TPM2B_PUBLIC_Marshal(&pub, &pos, &capacity);
+    (void)TPM2B_NAME_Marshal(&name, &pos, &capacity);
+    (void)TPM2B_NAME_Marshal(&name, &pos, &capacity);
+    finish_response(resp, pos);
+}
+
+static void build_get_capability_response(BENCH_RESPONSE* resp)
+{
+    INT32 capacity;
+    BYTE* pos = begin_response(resp, TPM_ST_NO_SESSIONS, &capacity);
+    TPMI_YES_NO moreData = NO;
+    TPMS_CAPABILITY_DATA capData;
+
+    bench_get_capability_data(&capData);
+    (void)TPMI_YES_NO_Marshal(&moreData, &pos, &capacity);
+    (void)TPMS_CAPABILITY_DATA_Marshal(&capData, &pos, &capacity);
+    finish_response(resp, pos);
+}
+
+static bool get_command_code(const unsigned char* cmd_bytes, uint32_t bytes_len, TPM_CC* cmd_code)
+{
+    bool result;
+    if (bytes_len < STD_RESPONSE_HEADER)
+    {
+        result = false;
+    }
+    else
+    {
+        BYTE* pos = (BYTE*)cmd_bytes + sizeof(TPM_ST) + sizeof(UINT32);
+        INT32 size = sizeof(TPM_CC);
+        result = TPM_CC_Unmarshal(cmd_code, &pos, &size) == TPM_RC_SUCCESS;
+    }
+    return result;
+}
+
+static const BENCH_RESPONSE* select_response(TPM_COMM_INFO* comm_info, TPM_CC cmd_code)
+{
+    const BENCH_RESPONSE* result;
+    switch (cmd_code)
+    {
+        case TPM_CC_HMAC:
+            result = &comm_info->hmac_resp;
+            break;
+        case TPM_CC_ReadPublic:
+            result = &comm_info->read_public_resp;
+            break;
+        case TPM_CC_GetCapability:
+            result = &comm_info->get_cap_resp;
+            break;
+        default:
+            result = &comm_info->success_resp;
+            break;
+    }
+    return result;
+}
+
+static int copy_response(const BENCH_RESPONSE* resp, unsigned char* response, uint32_t* resp_len)
+{
+    int result;
+    if (*resp_len < resp->length)
+    {
+        LogError("Response buffer too small %u, needed %u", *resp_len, resp->length);
+        result = __FAILURE__;
+    }
+    else
+    {
+        memcpy(response, resp->bytes, resp->length);
+        *resp_len = resp->length;
+        g_bytes_transferred += resp->length;
+        result = 0;
+    }
+    return result;
+}
+
+TPM_COMM_HANDLE tpm_comm_create(const char* endpoint)
+{
+    TPM_COMM_INFO* result;
+    (void)endpoint;
+    if ((result = malloc(sizeof(TPM_COMM_INFO))) == NULL)
+    {
+        LogError("Failure: malloc tpm_comm_info.");
+    }
+    else
+    {
+        INT32 capacity;
+        memset(result, 0, sizeof(TPM_COMM_INFO));
+        build_hmac_response(&result->hmac_resp);
+        build_read_public_response(&result->read_public_resp);
+        build_get_capability_response(&result->get_cap_resp);
+        finish_response(&result->success_resp, begin_response(&result->success_resp, TPM_ST_NO_SESSIONS, &capacity));
+    }
+    return result;
+}
+
+void tpm_comm_destroy(TPM_COMM_HANDLE handle)
+{
+    free(handle);
+}
+
+TPM_COMM_TYPE tpm_comm_get_type(TPM_COMM_HANDLE handle)
+{
+    (void)handle;
+    // Behaves like a kernel device
+    return TPM_COMM_TYPE_LINUX;
+}
+
+bool tpm_comm_needs_startup(TPM_COMM_HANDLE handle)
+{
+    (void)handle;
+    // No TPM2_Startup is issued
+    return false;
+}
+
+int tpm_comm_set_persistent_platform(bool enable)
+{
+    (void)enable;
+    return 0;
+}
+
+int tpm_comm_submit_command(TPM_COMM_HANDLE handle, const unsigned char* cmd_bytes, uint32_t bytes_len, unsigned char* response, uint32_t* resp_len)
+{
+    int result;
+    TPM_CC cmd_code;
+    if (handle == NULL || cmd_bytes == NULL || response == NULL || resp_len == NULL)
+    {
+        LogError("Invalid argument specified handle: %p, cmd_bytes: %p, response: %p, resp_len: %p.", handle, cmd_bytes, response, resp_len);
+        result = __FAILURE__;
+    }
+    else if (!get_command_code(cmd_bytes, bytes_len, &cmd_code))
+    {
+        LogError("Malformed command of %u bytes", bytes_len);
+        result = __FAILURE__;
+    }
+    else
+    {
+        g_bytes_transferred += bytes_len;
+        result = copy_response(select_response(handle, cmd_code), response, resp_len);
+    }
+    return result;
+}
+
+int tpm_comm_submit_async(TPM_COMM_HANDLE handle, const unsigned char* cmd_bytes, uint32_t bytes_len)
+{
+    int result;
+    TPM_CC cmd_code;
+    if (handle == NULL || cmd_bytes == NULL)
+    {
+        LogError("Invalid argument specified handle: %p, cmd_bytes: %p.", handle, cmd_bytes);
+        result = __FAILURE__;
+    }
+    else if (handle->pending_resp != NULL)
+    {
+        LogError("A command is already pending");
+        result = __FAILURE__;
+    }
+    else if (!get_command_code(cmd_bytes, bytes_len, &cmd_code))
+    {
+        LogError("Malformed command of %u bytes", bytes_len);
+        result = __FAILURE__;
+    }
+    else
+    {
+        g_bytes_transferred += bytes_len;
+        handle->pending_resp = select_response(handle, cmd_code);
+        result = 0;
+    }
+    return result;
+}
+
+TPM_COMM_POLL_RESULT tpm_comm_poll_complete(TPM_COMM_HANDLE handle, unsigned char* response, uint32_t* resp_len)
+{
+    TPM_COMM_POLL_RESULT result;
+    if (handle == NULL || response == NULL || resp_len == NULL || handle->pending_resp == NULL)
+    {
+        LogError("Invalid argument specified handle: %p, response: %p, resp_len: %p.", handle, response, resp_len);
+        result = TPM_COMM_POLL_ERROR;
+    }
+    else
+    {
+        result = copy_response(handle->pending_resp, response, resp_len) == 0 ? TPM_COMM_POLL_COMPLETE : TPM_COMM_POLL_ERROR;
+        handle->pending_resp = NULL;
+    }
+    return result;
+}
+
+int tpm_comm_get_wait_fd(TPM_COMM_HANDLE handle)
+{
+    (void)handle;
+    // Responses are always ready, there is nothing to wait on
+    return -1;
+}
+
+int tpm_comm_set_timeout(TPM_COMM_HANDLE handle, uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+    return handle == NULL ? __FAILURE__ : 0;
+}
+
+int tpm_comm_wait_any(TPM_COMM_HANDLE* handles, size_t count, uint32_t timeout_ms, bool* ready)
+{
+    int result = 0;
+    size_t index;
+    (void)timeout_ms;
+    for (index = 0; index < count; index++)
+    {
+        ready[index] = handles[index]->pending_resp != NULL;
+        result += ready[index] ? 1 : 0;
+    }
+    return result;
+}
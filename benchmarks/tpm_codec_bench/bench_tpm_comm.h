@@ -0,0 +1,30 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef BENCH_TPM_COMM_H
+#define BENCH_TPM_COMM_H
+
+#include "azure_utpm_c/tpm_codec.h"
+
+// Canned in-memory implementation of tpm_comm.h used by the codec benchmarks.
+// Every command is answered immediately from a response built once at
+// creation time, so the measured cost is the cost of the codec alone.
+
+// Number of TPM_PT_FIXED properties returned by the canned GetCapability
+#define BENCH_PROPERTY_COUNT    TSS_FIXED_PROPERTY_COUNT
+
+// Size of the HMAC returned by the canned HMAC command (SHA256)
+#define BENCH_HMAC_SIZE         32
+
+// Fills 'pub' with the RSA 2048 storage key returned by the canned ReadPublic
+extern void bench_get_public(TPM2B_PUBLIC* pub);
+
+// Fills 'capData' with the properties returned by the canned GetCapability
+extern void bench_get_capability_data(TPMS_CAPABILITY_DATA* capData);
+
+// Number of command and response bytes passed through tpm_comm since the last
+// call to bench_tpm_comm_reset_counters
+extern UINT64 bench_tpm_comm_get_bytes(void);
+extern void bench_tpm_comm_reset_counters(void);
+
+#endif // BENCH_TPM_COMM_H
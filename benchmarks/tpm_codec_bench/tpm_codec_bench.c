@@ -0,0 +1,316 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#define _POSIX_C_SOURCE 200112L
+#include <time.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "azure_utpm_c/tpm_codec.h"
+#include "azure_utpm_c/Marshal_fp.h"
+#include "bench_tpm_comm.h"
+
+// Loops the hot marshaling paths of the library, and the complete build,
+// dispatch and parse cycle of a few commands against the canned tpm_comm
+// backend, and reports the time and the number of bytes moved per operation.
+//
+// Usage: tpm_codec_bench [iterations] [filter]
+
+#define DEFAULT_ITERATIONS      200000
+#define BENCH_DATA_SIZE         64
+
+typedef struct BENCH_CONTEXT_TAG
+{
+    TSS_DEVICE tpm_device;
+    TSS_SESSION session;
+
+    TPM2B_PUBLIC pub;
+    TPMS_CAPABILITY_DATA cap_data;
+
+    // Marshaled forms of the above, used by the unmarshal benchmarks
+    BYTE pub_bytes[sizeof(TPM2B_PUBLIC)];
+    INT32 pub_size;
+    BYTE cap_bytes[sizeof(TPMS_CAPABILITY_DATA)];
+    INT32 cap_size;
+    BYTE auth_bytes[sizeof(TPMS_AUTH_COMMAND)];
+    INT32 auth_size;
+
+    BYTE data[BENCH_DATA_SIZE];
+    BYTE scratch[MAX_COMMAND_BUFFER];
+} BENCH_CONTEXT;
+
+// Runs one operation and returns the number of bytes it produced or consumed,
+// or 0 on failure
+typedef UINT32(*BENCH_FUNC)(BENCH_CONTEXT* ctx);
+
+typedef struct BENCH_ENTRY_TAG
+{
+    const char* name;
+    BENCH_FUNC func;
+
+    // The operation goes through tpm_comm, whose traffic is added to the
+    // reported bytes
+    bool uses_comm;
+} BENCH_ENTRY;
+
+static TPM2B_AUTH NullAuth = { 0 };
+static const TPM_HANDLE BENCH_KEY_HANDLE = HR_PERSISTENT | 0x00000100;
+
+static UINT64 get_time_ns(void)
+{
+#ifdef WIN32
+    static LARGE_INTEGER frequency = { 0 };
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0)
+    {
+        (void)QueryPerformanceFrequency(&frequency);
+    }
+    (void)QueryPerformanceCounter(&counter);
+    return (UINT64)(counter.QuadPart / frequency.QuadPart) * 1000000000ULL
+        + (UINT64)(counter.QuadPart % frequency.QuadPart) * 1000000000ULL / (UINT64)frequency.QuadPart;
+#else
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return (UINT64)now.tv_sec * 1000000000ULL + (UINT64)now.tv_nsec;
+#endif
+}
+
+static UINT32 bench_public_marshal(BENCH_CONTEXT* ctx)
+{
+    BYTE* pos = ctx->scratch;
+    INT32 size = sizeof(ctx->scratch);
+    return TPM2B_PUBLIC_Marshal(&ctx->pub, &pos, &size);
+}
+
+static UINT32 bench_public_unmarshal(BENCH_CONTEXT* ctx)
+{
+    TPM2B_PUBLIC pub;
+    BYTE* pos = ctx->pub_bytes;
+    INT32 size = ctx->pub_size;
+    return TPM2B_PUBLIC_Unmarshal(&pub, &pos, &size, TRUE) == TPM_RC_SUCCESS ? (UINT32)ctx->pub_size : 0;
+}
+
+static UINT32 bench_cap_data_marshal(BENCH_CONTEXT* ctx)
+{
+    BYTE* pos = ctx->scratch;
+    INT32 size = sizeof(ctx->scratch);
+    return TPMS_CAPABILITY_DATA_Marshal(&ctx->cap_data, &pos, &size);
+}
+
+static UINT32 bench_cap_data_unmarshal(BENCH_CONTEXT* ctx)
+{
+    TPMS_CAPABILITY_DATA capData;
+    BYTE* pos = ctx->cap_bytes;
+    INT32 size = ctx->cap_size;
+    return TPMS_CAPABILITY_DATA_Unmarshal(&capData, &pos, &size) == TPM_RC_SUCCESS ? (UINT32)ctx->cap_size : 0;
+}
+
+static UINT32 bench_auth_command_marshal(BENCH_CONTEXT* ctx)
+{
+    BYTE* pos = ctx->scratch;
+    INT32 size = sizeof(ctx->scratch);
+    return TPMS_AUTH_COMMAND_Marshal(&ctx->session.SessIn, &pos, &size);
+}
+
+static UINT32 bench_auth_command_unmarshal(BENCH_CONTEXT* ctx)
+{
+    TPMS_AUTH_COMMAND sessIn;
+    BYTE* pos = ctx->auth_bytes;
+    INT32 size = ctx->auth_size;
+    return TPMS_AUTH_COMMAND_Unmarshal(&sessIn, &pos, &size) == TPM_RC_SUCCESS ? (UINT32)ctx->auth_size : 0;
+}
+
+static UINT32 bench_build_command(BENCH_CONTEXT* ctx)
+{
+    TPM_HANDLE handle = BENCH_KEY_HANDLE;
+    TSS_SESSION* sessions = &ctx->session;
+    return TSS_BuildCommand(TPM_CC_HMAC, &handle, 1, &sessions, 1, ctx->data, sizeof(ctx->data),
+                            ctx->scratch, sizeof(ctx->scratch));
+}
+
+static UINT32 bench_hmac(BENCH_CONTEXT* ctx)
+{
+    TPM2B_DIGEST hmac;
+    return TSS_HMAC(&ctx->tpm_device, &ctx->session, BENCH_KEY_HANDLE, ctx->data, sizeof(ctx->data), &hmac) == TPM_RC_SUCCESS
+        ? hmac.t.size : 0;
+}
+
+static UINT32 bench_hmac_view(BENCH_CONTEXT* ctx)
+{
+    TSS_2B_VIEW hmac;
+    // Nothing is copied out of the response buffer
+    return TSS_HMAC_View(&ctx->tpm_device, &ctx->session, BENCH_KEY_HANDLE, ctx->data, sizeof(ctx->data), &hmac) == TPM_RC_SUCCESS
+        ? 1 : 0;
+}
+
+static UINT32 bench_read_public(BENCH_CONTEXT* ctx)
+{
+    TPM2B_PUBLIC pub;
+    TPM2B_NAME name;
+    TPM2B_NAME qualifiedName;
+    return TPM2_ReadPublic(&ctx->tpm_device, BENCH_KEY_HANDLE, &pub, &name, &qualifiedName) == TPM_RC_SUCCESS
+        ? (UINT32)(pub.size + name.t.size + qualifiedName.t.size) : 0;
+}
+
+static UINT32 bench_read_public_view(BENCH_CONTEXT* ctx)
+{
+    TSS_2B_VIEW pub;
+    TSS_2B_VIEW name;
+    TSS_2B_VIEW qualifiedName;
+    return TPM2_ReadPublic_View(&ctx->tpm_device, BENCH_KEY_HANDLE, &pub, &name, &qualifiedName) == TPM_RC_SUCCESS
+        ? 1 : 0;
+}
+
+static UINT32 bench_get_capability(BENCH_CONTEXT* ctx)
+{
+    TPMI_YES_NO moreData;
+    TPMS_CAPABILITY_DATA capData;
+    return TPM2_GetCapability(&ctx->tpm_device, TPM_CAP_TPM_PROPERTIES, PT_FIXED, BENCH_PROPERTY_COUNT, &moreData, &capData) == TPM_RC_SUCCESS
+        ? (UINT32)ctx->cap_size : 0;
+}
+
+static const BENCH_ENTRY g_bench_entries[] =
+{
+    { "TPM2B_PUBLIC_Marshal",           bench_public_marshal,           false },
+    { "TPM2B_PUBLIC_Unmarshal",         bench_public_unmarshal,         false },
+    { "TPMS_CAPABILITY_DATA_Marshal",   bench_cap_data_marshal,         false },
+    { "TPMS_CAPABILITY_DATA_Unmarshal", bench_cap_data_unmarshal,       false },
+    { "TPMS_AUTH_COMMAND_Marshal",      bench_auth_command_marshal,     false },
+    { "TPMS_AUTH_COMMAND_Unmarshal",    bench_auth_command_unmarshal,   false },
+    { "TSS_BuildCommand(HMAC)",         bench_build_command,            false },
+    { "TSS_HMAC",                       bench_hmac,                     true },
+    { "TSS_HMAC_View",                  bench_hmac_view,                true },
+    { "TPM2_ReadPublic",                bench_read_public,              true },
+    { "TPM2_ReadPublic_View",           bench_read_public_view,         true },
+    { "TPM2_GetCapability",             bench_get_capability,           true }
+};
+
+static bool initialize_context(BENCH_CONTEXT* ctx)
+{
+    bool result;
+    BYTE* pos;
+    INT32 size;
+
+    memset(ctx, 0, sizeof(BENCH_CONTEXT));
+    memset(ctx->data, 0x5A, sizeof(ctx->data));
+    bench_get_public(&ctx->pub);
+    bench_get_capability_data(&ctx->cap_data);
+
+    if (TSS_CreatePwAuthSession(&NullAuth, &ctx->session) != TPM_RC_SUCCESS)
+    {
+        (void)printf("Failure creating the password session\r\n");
+        result = false;
+    }
+    else if (Initialize_TPM_Codec(&ctx->tpm_device) != TPM_RC_SUCCESS)
+    {
+        (void)printf("Failure initializing TPM codec\r\n");
+        result = false;
+    }
+    else
+    {
+        pos = ctx->pub_bytes;
+        size = sizeof(ctx->pub_bytes);
+        ctx->pub_size = TPM2B_PUBLIC_Marshal(&ctx->pub, &pos, &size);
+
+        pos = ctx->cap_bytes;
+        size = sizeof(ctx->cap_bytes);
+        ctx->cap_size = TPMS_CAPABILITY_DATA_Marshal(&ctx->cap_data, &pos, &size);
+
+        pos = ctx->auth_bytes;
+        size = sizeof(ctx->auth_bytes);
+        ctx->auth_size = TPMS_AUTH_COMMAND_Marshal(&ctx->session.SessIn, &pos, &size);
+
+        result = true;
+    }
+    return result;
+}
+
+static int run_bench(BENCH_CONTEXT* ctx, const BENCH_ENTRY* entry, UINT32 iterations)
+{
+    int result = 0;
+    UINT64 bytes = 0;
+    UINT64 start;
+    UINT64 elapsed;
+    UINT32 index;
+
+    // Warm up the caches and catch a failing operation before timing it
+    if (entry->func(ctx) == 0)
+    {
+        (void)printf("%-32s FAILED\r\n", entry->name);
+        result = __FAILURE__;
+    }
+    else
+    {
+        bench_tpm_comm_reset_counters();
+        start = get_time_ns();
+        for (index = 0; index < iterations; index++)
+        {
+            bytes += entry->func(ctx);
+        }
+        elapsed = get_time_ns() - start;
+        if (entry->uses_comm)
+        {
+            bytes += bench_tpm_comm_get_bytes();
+        }
+
+        (void)printf("%-32s %10u %12.1f %12.1f\r\n", entry->name, iterations,
+            (double)elapsed / iterations, (double)bytes / iterations);
+    }
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    int result = 0;
+    UINT32 iterations = DEFAULT_ITERATIONS;
+    const char* filter = NULL;
+    BENCH_CONTEXT* ctx;
+
+    if (argc > 1 && (iterations = (UINT32)strtoul(argv[1], NULL, 10)) == 0)
+    {
+        (void)printf("Usage: %s [iterations] [filter]\r\n", argv[0]);
+        result = __LINE__;
+    }
+    // The context holds the whole command and response buffers, so keep it off the stack
+    else if ((ctx = (BENCH_CONTEXT*)malloc(sizeof(BENCH_CONTEXT))) == NULL)
+    {
+        (void)printf("Failure allocating the benchmark context\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        if (argc > 2)
+        {
+            filter = argv[2];
+        }
+
+        if (!initialize_context(ctx))
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            size_t index;
+            (void)printf("%-32s %10s %12s %12s\r\n", "operation", "iterations", "ns/op", "bytes/op");
+            for (index = 0; index < sizeof(g_bench_entries) / sizeof(g_bench_entries[0]); index++)
+            {
+                if (filter == NULL || strstr(g_bench_entries[index].name, filter) != NULL)
+                {
+                    if (run_bench(ctx, &g_bench_entries[index], iterations) != 0)
+                    {
+                        result = __LINE__;
+                    }
+                }
+            }
+            Deinit_TPM_Codec(&ctx->tpm_device);
+        }
+        free(ctx);
+    }
+    return result;
+}
@@ -30,6 +30,8 @@
 #   ifdef INLINE_FUNCTIONS
 #    define INLINE   static __inline 
 #   endif
+// Always in-line, regardless of INLINE_FUNCTIONS
+#   define STATIC_INLINE static __inline
 
 // Avoid compiler warning for in line of stdio (or not)
 //#define _NO_CRT_STDIO_INLINE
@@ -77,6 +79,7 @@ __pragma(warning(pop))
 #   ifdef INLINE_FUNCTIONS
 #   define INLINE static inline
 #endif
+#   define STATIC_INLINE static inline
 
 #if defined(__GNUC__)
 #   define NORETURN                     __attribute__((noreturn))
@@ -308,10 +308,17 @@ dbgDumpMemBlock(const char* label, BYTE* buf, int size)
 #define  NUM_POLICY_PCR_GROUP           1
 #define  NUM_AUTHVALUE_PCR_GROUP        1
 #define  MAX_CONTEXT_SIZE               2474
+#ifdef SMALL_FOOTPRINT
+#define  MAX_DIGEST_BUFFER              512
+#define  MAX_NV_INDEX_SIZE              2048
+#define  MAX_NV_BUFFER_SIZE             512
+#define  MAX_CAP_BUFFER                 512
+#else
 #define  MAX_DIGEST_BUFFER              1024
 #define  MAX_NV_INDEX_SIZE              2048
 #define  MAX_NV_BUFFER_SIZE             1024
 #define  MAX_CAP_BUFFER                 1024
+#endif // SMALL_FOOTPRINT
 #define  NV_MEMORY_SIZE                 16384
 #define  MIN_COUNTER_INDICES            8
 #define  NUM_STATIC_PCR                 16
@@ -0,0 +1,111 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef    _MARSHAL_TABLE_FP_H
+#define    _MARSHAL_TABLE_FP_H
+
+#include <stddef.h>
+
+#include "azure_utpm_c/Tpm.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Table driven (un)marshaling of the structures that are made of integers,
+// sized buffers and lists. Each structure is described by a constant table of
+// its members that one engine walks, checking the input size once for every
+// run of fixed size members instead of once for every member.
+//
+// When TABLE_DRIVEN_MARSHAL is defined the <type>_Unmarshal/<type>_Marshal
+// functions of the described types are implemented with these tables instead
+// of the generated code in Marshal.c.
+
+// Kinds of structure members
+#define TSS_MF_INT      1   // Integer of 'width' bytes, validated by 'check' if set
+#define TSS_MF_TAG      2   // UINT16 tag, one of the one or two values in 'limit'
+#define TSS_MF_COUNT    3   // UINT32 count of the next TSS_MF_ARRAY, at most 'limit'
+#define TSS_MF_ARRAY    4   // Array of 'width' byte integers, or of 'desc' structures
+#define TSS_MF_2B       5   // UINT16 size followed by at most 'limit' bytes
+#define TSS_MF_STRUCT   6   // Nested structure described by 'desc'
+
+// Packs the two values accepted by a TSS_MF_TAG member
+#define TSS_MF_TAGS(first, second)  ((UINT32)(first) | ((UINT32)(second) << 16))
+
+// Unmarshals and validates a member with the generated TPMI_*_Unmarshal function
+typedef TPM_RC(*TSS_MARSHAL_CHECK)(void* target, BYTE** buffer, INT32* size);
+
+struct TSS_MARSHAL_DESC_TAG;
+
+typedef struct TSS_MARSHAL_FIELD_TAG
+{
+    BYTE        kind;
+    BYTE        width;
+    UINT16      offset;
+    // Returned when the member is over 'limit' or is not one of the tags
+    TPM_RC      error;
+    UINT32      limit;
+    const struct TSS_MARSHAL_DESC_TAG* desc;
+    TSS_MARSHAL_CHECK check;
+} TSS_MARSHAL_FIELD;
+
+typedef struct TSS_MARSHAL_DESC_TAG
+{
+    const TSS_MARSHAL_FIELD* fields;
+    UINT16      fieldCount;
+    // sizeof the structure, the stride of the arrays of it
+    UINT16      size;
+} TSS_MARSHAL_DESC;
+
+TPM_RC
+TableUnmarshal(const TSS_MARSHAL_DESC* desc, void* target, BYTE** buffer, INT32* size);
+
+UINT16
+TableMarshal(const TSS_MARSHAL_DESC* desc, void* source, BYTE** buffer, INT32* size);
+
+// The described structures
+extern const TSS_MARSHAL_DESC TSS_MD_TPM2B_DIGEST;
+extern const TSS_MARSHAL_DESC TSS_MD_TPM2B_DATA;
+extern const TSS_MARSHAL_DESC TSS_MD_TPM2B_EVENT;
+extern const TSS_MARSHAL_DESC TSS_MD_TPM2B_MAX_BUFFER;
+extern const TSS_MARSHAL_DESC TSS_MD_TPM2B_MAX_NV_BUFFER;
+extern const TSS_MARSHAL_DESC TSS_MD_TPM2B_IV;
+extern const TSS_MARSHAL_DESC TSS_MD_TPM2B_NAME;
+extern const TSS_MARSHAL_DESC TSS_MD_TPM2B_ATTEST;
+extern const TSS_MARSHAL_DESC TSS_MD_TPM2B_SYM_KEY;
+extern const TSS_MARSHAL_DESC TSS_MD_TPM2B_LABEL;
+extern const TSS_MARSHAL_DESC TSS_MD_TPM2B_DERIVE;
+extern const TSS_MARSHAL_DESC TSS_MD_TPM2B_SENSITIVE_DATA;
+#if ALG_RSA
+extern const TSS_MARSHAL_DESC TSS_MD_TPM2B_PUBLIC_KEY_RSA;
+extern const TSS_MARSHAL_DESC TSS_MD_TPM2B_PRIVATE_KEY_RSA;
+#endif // ALG_RSA
+extern const TSS_MARSHAL_DESC TSS_MD_TPM2B_ECC_PARAMETER;
+extern const TSS_MARSHAL_DESC TSS_MD_TPM2B_ENCRYPTED_SECRET;
+extern const TSS_MARSHAL_DESC TSS_MD_TPM2B_TEMPLATE;
+extern const TSS_MARSHAL_DESC TSS_MD_TPM2B_PRIVATE_VENDOR_SPECIFIC;
+extern const TSS_MARSHAL_DESC TSS_MD_TPM2B_PRIVATE;
+extern const TSS_MARSHAL_DESC TSS_MD_TPM2B_ID_OBJECT;
+extern const TSS_MARSHAL_DESC TSS_MD_TPM2B_CONTEXT_SENSITIVE;
+extern const TSS_MARSHAL_DESC TSS_MD_TPM2B_CONTEXT_DATA;
+extern const TSS_MARSHAL_DESC TSS_MD_TPMT_TK_CREATION;
+extern const TSS_MARSHAL_DESC TSS_MD_TPMT_TK_VERIFIED;
+extern const TSS_MARSHAL_DESC TSS_MD_TPMT_TK_AUTH;
+extern const TSS_MARSHAL_DESC TSS_MD_TPMT_TK_HASHCHECK;
+extern const TSS_MARSHAL_DESC TSS_MD_TPMS_ALG_PROPERTY;
+extern const TSS_MARSHAL_DESC TSS_MD_TPMS_TAGGED_PROPERTY;
+extern const TSS_MARSHAL_DESC TSS_MD_TPML_CC;
+extern const TSS_MARSHAL_DESC TSS_MD_TPML_ALG;
+extern const TSS_MARSHAL_DESC TSS_MD_TPML_HANDLE;
+extern const TSS_MARSHAL_DESC TSS_MD_TPML_ALG_PROPERTY;
+extern const TSS_MARSHAL_DESC TSS_MD_TPML_TAGGED_TPM_PROPERTY;
+extern const TSS_MARSHAL_DESC TSS_MD_TPMS_CLOCK_INFO;
+extern const TSS_MARSHAL_DESC TSS_MD_TPMS_TIME_INFO;
+extern const TSS_MARSHAL_DESC TSS_MD_TPMS_CONTEXT;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _MARSHAL_TABLE_FP_H
@@ -1642,10 +1642,8 @@ TPM2B_CONTEXT_DATA_Marshal(TPM2B_CONTEXT_DATA *source, BYTE** buffer, INT32 *siz
 
 
 // Table 2:210 - Definition of TPMS_CONTEXT Structure (StructureTable)
-TPM_RC
-TPMS_CONTEXT_Unmarshal(TPMS_CONTEXT *target, BYTE** buffer, INT32 *size);
-UINT16
-TPMS_CONTEXT_Marshal(TPMS_CONTEXT *source, BYTE** buffer, INT32 *size);
+MOCKABLE_FUNCTION(, TPM_RC, TPMS_CONTEXT_Unmarshal, TPMS_CONTEXT*, target, BYTE**, buffer, INT32*, size);
+MOCKABLE_FUNCTION(, UINT16, TPMS_CONTEXT_Marshal, TPMS_CONTEXT*, source, BYTE**, buffer, INT32*, size);
 
 
 // Table 2:212 - Definition of TPMS_CREATION_DATA Structure  (StructureTable)
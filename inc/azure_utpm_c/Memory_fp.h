@@ -73,11 +73,7 @@ MemoryEqual2B(
 // intended to make sure that the destination would not be overrun. The
 // problem is that, in use, all that was happening was that the value of
 // size was used for dSize so there was no benefit in the extra parameter.
-void MemorySet(
-    void            *dest,
-    int              value,
-    size_t           size
-    );
+MOCKABLE_FUNCTION(, void, MemorySet, void*, dest, int, value, size_t, size);
 
 //*** MemoryPad2B()
 // Function to pad a TPM2B with zeros and adjust the size.
@@ -16,6 +16,27 @@
 //#  define INLINE_FUNCTIONS
 #endif
 
+// Define FAST_BYTE_SWAP to have the integer (un)marshaling use the byte swap
+// intrinsics of the compiler on memcpy'd values instead of calling the byte at
+// a time functions in Memory.c. Only used when AUTO_ALIGN is NO.
+#ifndef FAST_BYTE_SWAP
+//#  define FAST_BYTE_SWAP
+#endif
+
+// Define TABLE_DRIVEN_MARSHAL to (un)marshal the structures described in
+// MarshalTable.c by walking their descriptor tables rather than with the
+// generated per-type code in Marshal.c.
+#ifndef TABLE_DRIVEN_MARSHAL
+//#  define TABLE_DRIVEN_MARSHAL
+#endif
+
+// Define SMALL_FOOTPRINT for devices with little RAM. It shrinks the TPM2B
+// buffers and capability lists in Implementation.h, and the command context of
+// the TSS (see tpm_codec.h) uses a single buffer for the command and response.
+#ifndef SMALL_FOOTPRINT
+//#  define SMALL_FOOTPRINT
+#endif
+
 // Don't move this include ahead of the INLINE_FUNCTIONS definition.
 #include "CompilerDependencies.h"
 
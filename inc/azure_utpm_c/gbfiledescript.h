@@ -22,6 +22,8 @@ extern "C"
 
 #ifdef WIN32
 #define F_OK    1
+#else
+#include <poll.h>
 #endif
 
 #if defined(GB_DEBUG_FILEDESCRIPT)
@@ -31,12 +33,18 @@ MOCKABLE_FUNCTION(, ssize_t, gbfiledesc_read, int, fd, void*, buf, size_t, len);
 MOCKABLE_FUNCTION(, int, gbfiledesc_access, const char*, s, int, mode);
 MOCKABLE_FUNCTION(, int, gbfiledesc_close, int, fd);
 MOCKABLE_FUNCTION(, int, gbfiledesc_open, const char*, path, int, flags);
+#ifndef WIN32
+MOCKABLE_FUNCTION(, int, gbfiledesc_poll, struct pollfd*, fds, nfds_t, nfds, int, timeout);
+#endif
 
 #define open  gbfiledesc_open
 #define write gbfiledesc_write
 #define read gbfiledesc_read
 #define access gbfiledesc_access
 #define close gbfiledesc_close
+#ifndef WIN32
+#define poll gbfiledesc_poll
+#endif
 
 #endif /* GB_DEBUG_FILEDESCRIPT */
 
@@ -20,7 +20,62 @@
 #define FROM_BIG_ENDIAN_UINT64(i)   (i)
 #endif
 
-#if   AUTO_ALIGN == NO 
+#if   AUTO_ALIGN == NO && defined FAST_BYTE_SWAP
+
+// The aggregation macros for machines that do not allow unaligned access, using
+// the byte swap intrinsics. The memcpy of a constant size is turned into a
+// single (unaligned safe) load or store by the compiler.
+#include <string.h>
+
+STATIC_INLINE uint16_t FastByteArrayToUint16(const uint8_t* b)
+{
+    uint16_t i;
+    memcpy(&i, b, sizeof(i));
+    return FROM_BIG_ENDIAN_UINT16(i);
+}
+
+STATIC_INLINE uint32_t FastByteArrayToUint32(const uint8_t* b)
+{
+    uint32_t i;
+    memcpy(&i, b, sizeof(i));
+    return FROM_BIG_ENDIAN_UINT32(i);
+}
+
+STATIC_INLINE uint64_t FastByteArrayToUint64(const uint8_t* b)
+{
+    uint64_t i;
+    memcpy(&i, b, sizeof(i));
+    return FROM_BIG_ENDIAN_UINT64(i);
+}
+
+STATIC_INLINE void FastUint16ToByteArray(uint16_t i, uint8_t* b)
+{
+    i = TO_BIG_ENDIAN_UINT16(i);
+    memcpy(b, &i, sizeof(i));
+}
+
+STATIC_INLINE void FastUint32ToByteArray(uint32_t i, uint8_t* b)
+{
+    i = TO_BIG_ENDIAN_UINT32(i);
+    memcpy(b, &i, sizeof(i));
+}
+
+STATIC_INLINE void FastUint64ToByteArray(uint64_t i, uint8_t* b)
+{
+    i = TO_BIG_ENDIAN_UINT64(i);
+    memcpy(b, &i, sizeof(i));
+}
+
+#define BYTE_ARRAY_TO_UINT8(b)  (uint8_t)((b)[0])
+#define BYTE_ARRAY_TO_UINT16(b) FastByteArrayToUint16((const uint8_t *)(b))
+#define BYTE_ARRAY_TO_UINT32(b) FastByteArrayToUint32((const uint8_t *)(b))
+#define BYTE_ARRAY_TO_UINT64(b) FastByteArrayToUint64((const uint8_t *)(b))
+#define UINT8_TO_BYTE_ARRAY(i, b) ((b)[0] = (uint8_t)(i))
+#define UINT16_TO_BYTE_ARRAY(i, b)  FastUint16ToByteArray((uint16_t)(i), (uint8_t *)(b))
+#define UINT32_TO_BYTE_ARRAY(i, b)  FastUint32ToByteArray((uint32_t)(i), (uint8_t *)(b))
+#define UINT64_TO_BYTE_ARRAY(i, b)  FastUint64ToByteArray((uint64_t)(i), (uint8_t *)(b))
+
+#elif AUTO_ALIGN == NO 
 
 // The aggregation macros for machines that do not allow unaligned access or for
 // little-endian machines.
@@ -13,6 +13,7 @@ extern "C" {
 
 #include "Tpm.h"
 #include "tpm_comm.h"
+#include "tpm_transcript.h"
 #include "azure_c_shared_utility/umock_c_prod.h"
 
 // TSS status codes
@@ -52,6 +53,374 @@ typedef enum
 }
 TSS_TPM_CONN_INFO;
 
+// The buffers can be sized to the TPM_PT_MAX_COMMAND_SIZE and
+// TPM_PT_MAX_RESPONSE_SIZE of the target TPM by defining MAX_COMMAND_BUFFER.
+// With SMALL_FOOTPRINT the default only fits the shrunk TPM2B buffers. Saved
+// contexts may not fit into it, so it has to be raised for the resource manager.
+#ifndef MAX_COMMAND_BUFFER
+#ifdef SMALL_FOOTPRINT
+#define MAX_COMMAND_BUFFER      1024
+#else
+#define MAX_COMMAND_BUFFER      4096
+#endif // SMALL_FOOTPRINT
+#endif // MAX_COMMAND_BUFFER
+#define MAX_RESPONSE_BUFFER     MAX_COMMAND_BUFFER
+
+// Room for the largest TPM2B_MAX_BUFFER command, e.g. TPM2_HMAC with two
+// sessions, is needed in the command buffer
+#if MAX_COMMAND_BUFFER < MAX_DIGEST_BUFFER + 256
+#error "MAX_COMMAND_BUFFER is too small for MAX_DIGEST_BUFFER"
+#endif
+
+// Marshaling state of a single TPM command. Every TSS_DEVICE owns one, so
+// independent devices can be driven concurrently from different threads.
+// A single TSS_DEVICE must not be used by several threads at the same time.
+typedef struct
+{
+    // IN: Code of the command being built
+    TPM_CC      CmdCode;
+
+    // IN: Size of the parameters marshaled after the command header (bytes)
+    UINT32      ParamSize;
+
+    // IN: Number of handles in the handle area of the command
+    UINT32      NumHandles;
+
+    // OUT: Comamnd buffer size (bytes)
+    UINT32      CmdSize;
+
+    // OUT: Total size of the response buffer (bytes)
+    UINT32      RespSize;
+
+#ifdef SMALL_FOOTPRINT
+    // The command is sent before the response is received into the same
+    // memory. The resource manager works on its own copy of the command.
+    union
+    {
+#endif // SMALL_FOOTPRINT
+    // OUT: Comamnd buffer (in TPM representation). The header, handles and
+    //      authorization area are marshaled first, and the parameters are
+    //      marshaled in place right after them.
+    BYTE        CmdBuffer[MAX_COMMAND_BUFFER];
+
+    // OUT: Response buffer data
+    BYTE        RespBuffer[MAX_RESPONSE_BUFFER];
+#ifdef SMALL_FOOTPRINT
+    };
+#endif // SMALL_FOOTPRINT
+
+    // OUT: Number of bytes left not unmarshaled in the response buffer
+    //      (params and sessions)
+    UINT32      RespBytesLeft;
+
+    // OUT: Pointer to the not unmarshaled part of the response buffer
+    BYTE       *RespBufPtr;
+
+    // OUT: Unmarshaled handle returned by the command
+    TPM_HANDLE  RetHandle;
+
+    // OUT: Unmarshaled size of response parameters in the response buffer (bytes)
+    UINT32      RespParamSize;
+
+    // OUT: Number of times the command was resent, see TSS_RETRY_POLICY
+    UINT32      Retries;
+
+    // Timestamps (ns) of the start of building the command, and of sending it
+    // to and receiving the response from the TPM. Only taken while
+    // instrumentation is enabled on the device.
+    UINT64      StartTime;
+    UINT64      SendTime;
+    UINT64      RecvTime;
+
+    // Allocation count of gballoc and stack address at the start of building
+    // the command, and stack used from there down to the transport (bytes).
+    // Only measured in the builds with TSS_MEMORY_METRICS.
+    size_t      StartAllocations;
+    size_t      StackBase;
+    UINT32      StackDepth;
+} TSS_CMD_CONTEXT;
+
+// Read-only view of the payload of a TPM2B structure inside the response
+// buffer of a TSS_DEVICE. Nothing is copied when a view is unmarshaled, so the
+// view is only valid until the next command is executed on the same device.
+typedef struct
+{
+    // Number of bytes in the payload
+    UINT16      Size;
+
+    // First byte of the payload in TSS_CMD_CONTEXT::RespBuffer
+    const BYTE *Buffer;
+} TSS_2B_VIEW;
+
+// Room for the command header, up to three handles and two password sessions
+#define TSS_CMD_TEMPLATE_MAX_HEADER     (STD_RESPONSE_HEADER + 3 * sizeof(TPM_HANDLE) \
+                                         + sizeof(UINT32) + 2 * sizeof(TPMS_AUTH_COMMAND))
+
+// A command whose header, handles and authorization area were marshaled once
+// by TSS_CompileCommand. Executing it only copies Header into the command
+// buffer of the device, appends the parameters and writes the command size.
+// Only password sessions can be compiled in, since the authorization area of
+// any other session changes with every command.
+typedef struct
+{
+    TPM_CC      CmdCode;
+    UINT32      NumHandles;
+
+    // Number of bytes in Header. The command size field in it is left zero.
+    UINT32      HeaderSize;
+    BYTE        Header[TSS_CMD_TEMPLATE_MAX_HEADER];
+} TSS_CMD_TEMPLATE;
+
+// Number of properties in the TPM_PT_FIXED group known to this library
+#define TSS_FIXED_PROPERTY_COUNT    (TPM_PT_MAX_CAP_BUFFER - PT_FIXED + 1)
+
+// Values of the TPM_PT_FIXED properties. They do not change while the TPM is
+// running, so they are read once and then served without any TPM traffic.
+typedef struct
+{
+    // TRUE once the cache has been filled from the TPM
+    BOOL        Valid;
+
+    // Bit N is set when the TPM reported the property (PT_FIXED + N)
+    UINT64      Present;
+
+    // Property values indexed by (property - PT_FIXED)
+    UINT32      Value[TSS_FIXED_PROPERTY_COUNT];
+} TSS_PROPERTY_CACHE;
+
+// Maximum number of persistent handles tracked by a device
+#define TSS_MAX_PERSISTENT_HANDLES  32
+
+// Persistent objects present in the TPM. The set is read once by
+// Initialize_TPM_Codec and then kept up to date by TPM2_EvictControl, so that
+// callers can tell whether a persistent key exists without asking the TPM.
+typedef struct
+{
+    // TRUE once the set has been read from the TPM, and as long as it holds
+    // every persistent handle
+    BOOL        Valid;
+
+    UINT32      Count;
+    TPM_HANDLE  Handles[TSS_MAX_PERSISTENT_HANDLES];
+} TSS_HANDLE_SET;
+
+// Maximum number of public areas held by a TSS_PUBLIC_CACHE
+#define TSS_PUBLIC_CACHE_MAX_ENTRIES    8
+
+// Number of TPM properties identifying the TPM a cache was filled from
+#define TSS_PUBLIC_CACHE_ID_SIZE        4
+
+typedef struct
+{
+    TPM_HANDLE      Handle;
+    TPM2B_PUBLIC    Public;
+    TPM2B_NAME      Name;
+} TSS_PUBLIC_CACHE_ENTRY;
+
+// Public areas and names of persistent objects, so that keys which never
+// change (EK, SRK, identity key) are not read back from the TPM by every
+// process. Owned by the caller, and normally loaded from and saved to a file
+// with tpm_public_cache_load() and tpm_public_cache_save().
+typedef struct
+{
+    // Manufacturer, vendor string and firmware version of the TPM the
+    // entries were read from
+    UINT32                  Identity[TSS_PUBLIC_CACHE_ID_SIZE];
+
+    // TRUE when entries were added or removed since the cache was loaded
+    BOOL                    Dirty;
+
+    UINT32                  Count;
+    TSS_PUBLIC_CACHE_ENTRY  Entries[TSS_PUBLIC_CACHE_MAX_ENTRIES];
+} TSS_PUBLIC_CACHE;
+
+// Persistent handle of the identity key SignData and SignDataBatch sign with
+#define DPS_ID_KEY_HANDLE           (HR_PERSISTENT | 0x00000100)
+
+// User-space resource manager shared by several devices, see tpm_resource_mgr.h
+typedef struct TSS_RESOURCE_MGR_TAG* TSS_RESOURCE_MGR_HANDLE;
+typedef struct TSS_RM_WAITER_TAG* TSS_RM_WAITER_HANDLE;
+
+// TSS extensions of the TPM 2.0 command interafce
+typedef struct
+{
+    TPMS_AUTH_COMMAND   SessIn;
+    TPMS_AUTH_RESPONSE  SessOut;
+}
+TSS_SESSION;
+
+// Maximum number of sessions kept open by a device
+#define TSS_SESSION_POOL_SIZE       4
+
+typedef struct
+{
+    TSS_SESSION     Session;
+    TPM_SE          SessionType;
+    TPMI_ALG_HASH   AuthHash;
+
+    // TRUE when the slot holds a session started by the pool
+    BOOL            Loaded;
+
+    // TRUE while handed out by TSS_AcquireSession
+    BOOL            InUse;
+
+    // TRUE when the TPM may have flushed the session, which is then started
+    // again before it is handed out
+    BOOL            Stale;
+} TSS_POOLED_SESSION;
+
+// Authorization sessions reused across operations, so that a session is
+// started once instead of for every operation
+typedef struct
+{
+    // Number of sessions the pool may hold, computed on first use from
+    // TPM_PT_HR_LOADED_MIN. Zero until then.
+    UINT32              Limit;
+
+    TSS_POOLED_SESSION  Sessions[TSS_SESSION_POOL_SIZE];
+} TSS_SESSION_POOL;
+
+// Where TSS_Hash and TSS_HashSequence compute their digests. Neither returns a
+// ticket, so a digest computed on the host (see tpm_host_hash.h) is as good as
+// one computed by the TPM.
+typedef enum
+{
+    // On the host when the data does not fit into a single TPM2_Hash, which
+    // would otherwise take a hash sequence with a round trip per chunk
+    TSS_HASH_AUTO = 0,
+    // Always on the TPM
+    TSS_HASH_TPM,
+    // On the host whenever it implements the algorithm
+    TSS_HASH_HOST
+} TSS_HASH_POLICY;
+
+// Size of the entropy pool of a device, and the level below which
+// TSS_RefillEntropyPool tops it up
+#define TSS_ENTROPY_POOL_SIZE       256
+#define TSS_ENTROPY_POOL_LOW_WATER  64
+
+// Optional second source of random bytes, e.g. the OS CSPRNG. Fills 'buffer'
+// and returns 0, or a non-zero value on failure.
+typedef int (*TSS_ENTROPY_SOURCE)(void* context, BYTE* buffer, UINT32 size);
+
+// Random bytes prefetched from the TPM with TPM2_GetRandom, so that nonces do
+// not cost a round trip each
+typedef struct
+{
+    // Unused bytes are Bytes[0 .. Available - 1]
+    BYTE                Bytes[TSS_ENTROPY_POOL_SIZE];
+    UINT32              Available;
+
+    // When set, the output of the source is XORed into every refill
+    TSS_ENTROPY_SOURCE  MixSource;
+    void               *MixContext;
+} TSS_ENTROPY_POOL;
+
+// Range of the command codes accepted by the TSS
+#define TSS_CMD_CODE_FIRST          0x0000011f
+#define TSS_CMD_CODE_LAST           0x00000193
+#define TSS_CMD_CODE_COUNT          (TSS_CMD_CODE_LAST - TSS_CMD_CODE_FIRST + 1)
+
+// Classes of the response codes counted by TSS_CMD_STATS
+typedef enum
+{
+    TSS_RC_CLASS_SUCCESS,
+
+    // Format-one errors, associated with a handle, session or parameter
+    TSS_RC_CLASS_FMT1_ERROR,
+
+    // Format-zero (version 1) errors
+    TSS_RC_CLASS_ERROR,
+
+    // Warnings, e.g. TPM_RC_RETRY or TPM_RC_OBJECT_MEMORY
+    TSS_RC_CLASS_WARNING,
+
+    // TPM 1.2, vendor defined and TSS communication medium codes
+    TSS_RC_CLASS_OTHER,
+
+    // No valid response was received from the TPM
+    TSS_RC_CLASS_TRANSPORT,
+
+    TSS_RC_CLASS_COUNT
+}
+TSS_RC_CLASS;
+
+// Description of a command executed by a TSS_DEVICE, passed to the trace callback
+typedef struct
+{
+    TPM_CC          CmdCode;
+
+    // Size of the command and of the response (bytes)
+    UINT32          CmdSize;
+    UINT32          RespSize;
+
+    // Raw response code of the TPM, or TPM_RC_NOT_USED if no valid response
+    // was received
+    TPM_RC          ResponseCode;
+    TSS_RC_CLASS    ResponseClass;
+
+    // Time spent marshaling the command, and waiting for the TPM (ns). The
+    // latter includes the retries and the delays before them.
+    UINT64          MarshalTime;
+    UINT64          TransportTime;
+
+    // Number of times the command was resent, see TSS_RETRY_POLICY
+    UINT32          Retries;
+
+    // Number of heap allocations made through gballoc while the command was
+    // executed, heap in use once it completed (bytes), and stack used by the
+    // codec between the command function and the transport (bytes). Only
+    // measured in the builds with TSS_MEMORY_METRICS (use_memory_metrics),
+    // which require gballoc_init to have been called, and 0 otherwise. The
+    // allocation count is process wide, so it includes the allocations of the
+    // other threads.
+    UINT32          Allocations;
+    UINT64          HeapInUse;
+    UINT32          StackDepth;
+} TSS_CMD_TRACE;
+
+// Called by the device after every command it dispatched, on the thread that
+// executed the command
+typedef void (*TSS_CMD_TRACE_CALLBACK)(void* context, const TSS_CMD_TRACE* trace);
+
+// Counters accumulated for a single command code
+typedef struct
+{
+    UINT64      Count;
+    UINT64      BytesOut;
+    UINT64      BytesIn;
+    UINT64      MarshalTime;
+    UINT64      TransportTime;
+    UINT64      Retries;
+    UINT64      ResponseClasses[TSS_RC_CLASS_COUNT];
+
+    // See TSS_CMD_TRACE. The high-water marks are the largest values seen.
+    UINT64      Allocations;
+    UINT64      MaxHeapInUse;
+    UINT32      MaxStackDepth;
+} TSS_CMD_STATS_ENTRY;
+
+// Per command code counters, indexed by (command code - TSS_CMD_CODE_FIRST).
+// Owned by the caller, and updated without locking by the device it is
+// attached to.
+typedef struct
+{
+    TSS_CMD_STATS_ENTRY Commands[TSS_CMD_CODE_COUNT];
+} TSS_CMD_STATS;
+
+// Resending of the commands the TPM did not execute because it was busy, i.e.
+// that got TPM_RC_RETRY, TPM_RC_YIELDED, TPM_RC_TESTING or TPM_RC_NV_RATE.
+// The n-th retry waits for a random time between half and all of
+// min(InitialDelayMs * 2^n, MaxDelayMs), so that the clients told to retry at
+// the same time do not all come back together. The warning is returned once
+// MaxRetries is reached. Disabled (all zeros) unless set otherwise.
+typedef struct
+{
+    UINT32      MaxRetries;
+    UINT32      InitialDelayMs;
+    UINT32      MaxDelayMs;
+} TSS_RETRY_POLICY;
+
 typedef struct
 {
     // A set of TSS_TPM_CONN_INFO flags
@@ -65,23 +434,109 @@ typedef struct
     TPM_RC              LastRawResponse;
 
     const char* comms_endpoint;
-}
-TSS_DEVICE;
 
-// TSS extensions of the TPM 2.0 command interafce
-typedef struct
-{
-    TPMS_AUTH_COMMAND   SessIn;
-    TPMS_AUTH_RESPONSE  SessOut;
+    // Optional resource manager the commands are routed through instead of
+    // tpm_comm_handle. Set before calling Initialize_TPM_Codec.
+    TSS_RESOURCE_MGR_HANDLE ResourceMgr;
+
+    // Signalled by the worker thread of ResourceMgr when a command of the
+    // device completes. Set by Initialize_TPM_Codec, see tpm_rm_attach_client.
+    TSS_RM_WAITER_HANDLE RmWaiter;
+
+    // When TRUE, Initialize_TPM_Codec does not contact the TPM, see
+    // TSS_CompleteStartup. Set before calling Initialize_TPM_Codec.
+    BOOL                DeferStartup;
+
+    // TRUE while the start up deferred by DeferStartup has not been done
+    BOOL                StartupPending;
+
+    // Command and response buffers used by the commands issued via this device
+    TSS_CMD_CONTEXT     CmdCtx;
+
+    // Fixed TPM properties, filled by Initialize_TPM_Codec (or on demand)
+    TSS_PROPERTY_CACHE  PropCache;
+
+    // Persistent handles present in the TPM, filled by Initialize_TPM_Codec
+    // (or TSS_CompleteStartup)
+    TSS_HANDLE_SET      PersistentHandles;
+
+    // Optional cache of persistent public areas, see TSS_SetPublicCache
+    TSS_PUBLIC_CACHE   *PublicCache;
+
+    // Sessions handed out by TSS_AcquireSession
+    TSS_SESSION_POOL    SessionPool;
+
+    // Random bytes served by TSS_GetRandomBytes
+    TSS_ENTROPY_POOL    EntropyPool;
+
+    // TSS_HASH_AUTO unless set otherwise
+    TSS_HASH_POLICY     HashPolicy;
+
+    // No retries unless set otherwise, see TSS_SetRetryPolicy
+    TSS_RETRY_POLICY    RetryPolicy;
+
+    // Optional instrumentation. Nothing is measured while both are NULL.
+    TSS_CMD_TRACE_CALLBACK  TraceCallback;
+    void                   *TraceContext;
+    TSS_CMD_STATS          *CmdStats;
+
+    // Optional transcript receiving every command and response, see
+    // TSS_SetTranscript
+    TPM_TRANSCRIPT_HANDLE   Transcript;
 }
-TSS_SESSION;
+TSS_DEVICE;
 
 MOCKABLE_FUNCTION(, TPM_RC, TSS_CreatePwAuthSession, TPM2B_AUTH*, authValue, TSS_SESSION*, session);
 
 MOCKABLE_FUNCTION(, TPM_RC, TSS_StartAuthSession, TSS_DEVICE*, tpm, TPM_SE, sessionType, TPMI_ALG_HASH, authHash, TPMA_SESSION, sessAttrs, TSS_SESSION*, session);
 
+// Hands out a session of the given type from the pool of the device, starting
+// one only if no idle session matches. Policy sessions are reset with
+// TPM2_PolicyRestart. The session has continueSession set, and must be given
+// back with TSS_ReleaseSession.
+MOCKABLE_FUNCTION(, TPM_RC, TSS_AcquireSession, TSS_DEVICE*, tpm, TPM_SE, sessionType, TPMI_ALG_HASH, authHash, TSS_SESSION**, session);
+
+// Returns a session to the pool. 'lastResult' is the result of the last
+// command that used the session; if it shows the TPM no longer has the session
+// loaded, the session is started again on its next use.
+MOCKABLE_FUNCTION(, void, TSS_ReleaseSession, TSS_DEVICE*, tpm, TSS_SESSION*, session, TPM_RC, lastResult);
+
+// Flushes all the sessions held by the pool of the device
+MOCKABLE_FUNCTION(, void, TSS_FlushSessionPool, TSS_DEVICE*, tpm);
+
+// Fills 'buffer' from the entropy pool of the device, refilling the pool from
+// the TPM when it runs dry. Used for the nonces of the sessions started by
+// the codec.
+MOCKABLE_FUNCTION(, TPM_RC, TSS_GetRandomBytes, TSS_DEVICE*, tpm, BYTE*, buffer, UINT32, size);
+
+// Tops up the entropy pool of the device if it is below
+// TSS_ENTROPY_POOL_LOW_WATER. Meant to be called while the device is idle, so
+// that TSS_GetRandomBytes is served from memory.
+MOCKABLE_FUNCTION(, TPM_RC, TSS_RefillEntropyPool, TSS_DEVICE*, tpm);
+
 MOCKABLE_FUNCTION(, UINT32, SignData, TSS_DEVICE*, tpm, TSS_SESSION*, sess, BYTE*, tokenData, UINT32, tokenSize, BYTE*, signatureBuffer, UINT32, sigBufSize);
 
+// A single entry of a SignDataBatch request
+typedef struct
+{
+    // IN: Data to sign
+    BYTE       *Data;
+    UINT32      DataSize;
+
+    // IN: Buffer receiving the signature and its capacity (bytes)
+    BYTE       *Signature;
+    UINT32      SignatureCapacity;
+
+    // OUT: Signature size as SignData() would return it
+    UINT32      SignatureSize;
+
+    // OUT: Raw response code of the last TPM command executed for this entry
+    TPM_RC      RawResponse;
+}
+TSS_SIGN_DATA_ITEM;
+
+MOCKABLE_FUNCTION(, UINT32, SignDataBatch, TSS_DEVICE*, tpm, TSS_SESSION*, sess, TSS_SIGN_DATA_ITEM*, items, UINT32, itemCount);
+
 MOCKABLE_FUNCTION(, TPM_RC, TPM2_SequenceUpdate, TSS_DEVICE*, tpm, TSS_SESSION*, session, TPMI_DH_OBJECT, sequenceHandle, TPM2B_MAX_BUFFER*, buffer);
 
 MOCKABLE_FUNCTION(, TPM_RC, TPM2_Sign, TSS_DEVICE*, tpm, TSS_SESSION*, session, TPMI_DH_OBJECT, keyHandle, TPM2B_DIGEST*, digest, TPMT_SIG_SCHEME*, inScheme, TPMT_TK_HASHCHECK*, validation, TPMT_SIGNATURE*, signature);
@@ -94,18 +549,106 @@ MOCKABLE_FUNCTION(, TPM_RC, TSS_Create, TSS_DEVICE*, tpm, TSS_SESSION*, sess, TP
 
 MOCKABLE_FUNCTION(, UINT32, TSS_GetTpmProperty, TSS_DEVICE*, tpm, TPM_PT, prop);
 
+MOCKABLE_FUNCTION(, TPM_RC, TSS_RefreshPropertyCache, TSS_DEVICE*, tpm);
+
+MOCKABLE_FUNCTION(, void, TSS_InvalidatePropertyCache, TSS_DEVICE*, tpm);
+
+// Reads the set of persistent handles present in the TPM
+MOCKABLE_FUNCTION(, TPM_RC, TSS_RefreshPersistentHandles, TSS_DEVICE*, tpm);
+
+// Tells whether an object is persisted at the given handle, without any TPM
+// traffic. Fails if the set of persistent handles is not available, in which
+// case the caller has to ask the TPM (e.g. with TPM2_ReadPublic).
+MOCKABLE_FUNCTION(, TPM_RC, TSS_IsPersistentHandlePresent, TSS_DEVICE*, tpm, TPM_HANDLE, handle, BOOL*, present);
+
+// Attaches a cache of persistent public areas used by TSS_ReadPublicCached
+// and TSS_CreatePersistentKey, and kept up to date by TPM2_EvictControl.
+// Passing NULL detaches it.
+MOCKABLE_FUNCTION(, void, TSS_SetPublicCache, TSS_DEVICE*, tpm, TSS_PUBLIC_CACHE*, cache);
+
+// Same as TPM2_ReadPublic for a persistent object, but served from the public
+// cache attached to the device when possible. Objects read from the TPM are
+// added to the cache.
+MOCKABLE_FUNCTION(, TPM_RC, TSS_ReadPublicCached, TSS_DEVICE*, tpm, TPM_HANDLE, handle, TPM2B_PUBLIC*, outPublic, TPM2B_NAME*, name);
+
+// Computes the name of the object with the public area 'publicArea' on the
+// host, i.e. its nameAlg followed by the nameAlg digest of the marshaled
+// TPMT_PUBLIC, as TPM2_ReadPublic would return it. Fails with TPM_RC_HASH if
+// the nameAlg cannot be computed on the host (see tpm_host_hash_is_supported).
+MOCKABLE_FUNCTION(, TPM_RC, TSS_ComputeObjectName, TPM2B_PUBLIC*, publicArea, TPM2B_NAME*, name);
+
+// Registers a callback invoked after every command dispatched by the device.
+// Passing NULL disables it.
+MOCKABLE_FUNCTION(, void, TSS_SetTraceCallback, TSS_DEVICE*, tpm, TSS_CMD_TRACE_CALLBACK, callback, void*, context);
+
+// Attaches counters updated after every command dispatched by the device.
+// Passing NULL detaches them.
+MOCKABLE_FUNCTION(, void, TSS_SetCommandStats, TSS_DEVICE*, tpm, TSS_CMD_STATS*, stats);
+
+// Records every command dispatched by the device and its response, with the
+// transport latency, to a transcript created with tpm_transcript_create, so
+// that the traffic can be played back later without a TPM. Attach it before
+// Initialize_TPM_Codec to capture the start up commands as well. The device
+// does not own the transcript. Passing NULL stops the recording.
+MOCKABLE_FUNCTION(, void, TSS_SetTranscript, TSS_DEVICE*, tpm, TPM_TRANSCRIPT_HANDLE, transcript);
+
+// Returns the counters of the given command code, or NULL if it is not a
+// command code known to the TSS
+MOCKABLE_FUNCTION(, const TSS_CMD_STATS_ENTRY*, TSS_GetCommandStats, const TSS_CMD_STATS*, stats, TPM_CC, cmdCode);
+
 MOCKABLE_FUNCTION(, TPM_HANDLE, TSS_CreatePersistentKey, TSS_DEVICE*, tpm_device, TPM_HANDLE, request_handle, TSS_SESSION*, sess, TPMI_DH_OBJECT, hierarchy, TPM2B_PUBLIC*, inPub, TPM2B_PUBLIC*, outPub);
 
-TPM_RC TSS_Hash(
-    TSS_DEVICE             *tpm,                // IN/OUT
-    BYTE                   *data,               // IN
-    UINT32                  dataSize,           // IN
-    TPMI_ALG_HASH           hashAlg,            // IN
-    TPM2B_DIGEST           *outHash             // OUT
-);
+// Identity key sent by a provisioning service, wrapped for the endorsement key
+// and the storage root key of the TPM
+typedef struct
+{
+    // Persistent endorsement key and storage root key, e.g. created with
+    // TSS_CreatePersistentKey, and the handle the identity key is persisted at
+    TPM_HANDLE              EkHandle;
+    TPM_HANDLE              SrkHandle;
+    TPM_HANDLE              IdKeyHandle;
+
+    // Credential protected by the endorsement key, carrying the key of the
+    // inner wrapper of the duplicate (TPM2_ActivateCredential)
+    TPM2B_ID_OBJECT        *CredentialBlob;
+    TPM2B_ENCRYPTED_SECRET *EncryptedSecret;
+
+    // Duplicate of the identity key (TPM2_Import)
+    TPM2B_PUBLIC           *IdKeyPublic;
+    TPM2B_PRIVATE          *DuplicateBlob;
+    TPM2B_ENCRYPTED_SECRET *EncryptedSeed;
+    // Algorithm of the inner wrapper, AES-128 in CFB mode if NULL
+    TPMT_SYM_DEF_OBJECT    *SymmetricAlg;
+}
+TSS_PROVISION_PARAMS;
+
+// Installs the identity key at params->IdKeyHandle, replacing the key found
+// there: activates the credential with a pooled policy session of the
+// endorsement key, imports the duplicate under the storage root key, loads it
+// and persists it. 'sess' is the password session authorizing the storage root
+// key and the owner hierarchy. The loaded copy of the key is flushed whether
+// or not the provisioning succeeds.
+MOCKABLE_FUNCTION(, TPM_RC, TSS_ProvisionIdentityKey, TSS_DEVICE*, tpm, TSS_SESSION*, sess, TSS_PROVISION_PARAMS*, params);
+
+MOCKABLE_FUNCTION(, TPM_RC, TSS_Hash, TSS_DEVICE*, tpm, BYTE*, data, UINT32, dataSize, TPMI_ALG_HASH, hashAlg, TPM2B_DIGEST*, outHash);
 
 MOCKABLE_FUNCTION(, TPM_RC, TSS_HMAC, TSS_DEVICE*, tpm, TSS_SESSION*, session, TPMI_DH_OBJECT, handle, BYTE*, data, UINT32, dataSize, TPM2B_DIGEST*, outHMAC);
 
+// Same as TSS_HMAC, but returns a view of the HMAC in the response buffer
+MOCKABLE_FUNCTION(, TPM_RC, TSS_HMAC_View, TSS_DEVICE*, tpm, TSS_SESSION*, session, TPMI_DH_OBJECT, handle, BYTE*, data, UINT32, dataSize, TSS_2B_VIEW*, outHMAC);
+
+// Marshals the header, handles and authorization area of a command into
+// 'cmdTemplate'. All of 'sessions' must be password sessions.
+MOCKABLE_FUNCTION(, TPM_RC, TSS_CompileCommand, TPM_CC, cmdCode, TPM_HANDLE*, handles, INT32, numHandles, TSS_SESSION**, sessions, INT32, numSessions, TSS_CMD_TEMPLATE*, cmdTemplate);
+
+// Executes a compiled command with the given marshaled parameters. The
+// response parameters are left in tpm->CmdCtx to be unmarshaled by the caller.
+MOCKABLE_FUNCTION(, TPM_RC, TSS_DispatchCompiled, TSS_DEVICE*, tpm, const TSS_CMD_TEMPLATE*, cmdTemplate, BYTE*, params, UINT32, paramsSize);
+
+// Same as TSS_HMAC_View, with the handle and session compiled into a
+// TPM2_HMAC template
+MOCKABLE_FUNCTION(, TPM_RC, TSS_HMAC_Compiled, TSS_DEVICE*, tpm, const TSS_CMD_TEMPLATE*, cmdTemplate, BYTE*, data, UINT32, dataSize, TSS_2B_VIEW*, outHMAC);
+
 TPM_RC TSS_SequenceComplete(
     TSS_DEVICE             *tpm,                // IN/OUT
     TSS_SESSION            *session,            // IN/OUT
@@ -123,6 +666,15 @@ TPM_RC TSS_SequenceUpdate(
     UINT32                  dataSize            // IN
 );
 
+// Computes the HMAC of an arbitrarily large buffer with an HMAC sequence. The
+// data is sent in chunks of TPM_PT_INPUT_BUFFER bytes directly from 'data',
+// one TPM2_SequenceUpdate after the other.
+MOCKABLE_FUNCTION(, TPM_RC, TSS_HmacSequence, TSS_DEVICE*, tpm, TSS_SESSION*, session, TPMI_DH_OBJECT, handle, TPMI_ALG_HASH, hashAlg, BYTE*, data, UINT32, dataSize, TPM2B_DIGEST*, result);
+
+// Same as TSS_HmacSequence() for a plain hash sequence. 'session' authorizes
+// the sequence object, whose auth value is empty.
+MOCKABLE_FUNCTION(, TPM_RC, TSS_HashSequence, TSS_DEVICE*, tpm, TSS_SESSION*, session, TPMI_ALG_HASH, hashAlg, BYTE*, data, UINT32, dataSize, TPM2B_DIGEST*, result);
+
 TPM_RC TSS_Sign(
     TSS_DEVICE             *tpm,                // IN/OUT
     TSS_SESSION            *session,            // IN/OUT
@@ -156,9 +708,36 @@ MOCKABLE_FUNCTION(, TPM_RC, Initialize_TPM_Codec, TSS_DEVICE*, tpm);
 
 MOCKABLE_FUNCTION(, void, Deinit_TPM_Codec, TSS_DEVICE*, tpm);
 
+// Completes the start up of a device initialized with DeferStartup: connects
+// to the TPM, starts it if it was just powered on, flushes the sessions left
+// by previous runs, and reads the fixed properties and the persistent handles.
+// Does nothing if the device is already started. May be called on a worker
+// thread right after Initialize_TPM_Codec to take the start up off the boot
+// path, provided that the device is not used until it returns. Otherwise the
+// first command of the device does the start up, without reading the
+// properties and handles, which are then read on demand. A failed start up
+// stays pending, and is retried by the next command.
+MOCKABLE_FUNCTION(, TPM_RC, TSS_CompleteStartup, TSS_DEVICE*, tpm);
+
+// Priority class of the commands of the device, e.g. HIGH for short latency
+// critical commands and LOW for bulk work such as key creation (see
+// tpm_comm_set_priority). Not available for clients of a resource manager,
+// which runs the commands in arrival order.
+MOCKABLE_FUNCTION(, TPM_RC, TSS_SetCommandPriority, TSS_DEVICE*, tpm, TPM_COMM_PRIORITY, priority);
+
+// Sets how the commands the TPM asks to retry are resent. Passing NULL disables
+// the retries. Not available with SMALL_FOOTPRINT, where the response
+// overwrites the command.
+MOCKABLE_FUNCTION(, TPM_RC, TSS_SetRetryPolicy, TSS_DEVICE*, tpm, const TSS_RETRY_POLICY*, policy);
+
 // TPM 2.0 command interafce
 MOCKABLE_FUNCTION(, TPM_RC, TPM2_ActivateCredential, TSS_DEVICE*, tpm, TSS_SESSION*, activateSess, TSS_SESSION*, keySess, TPMI_DH_OBJECT, activateHandle, TPMI_DH_OBJECT, keyHandle, TPM2B_ID_OBJECT*, credentialBlob, TPM2B_ENCRYPTED_SECRET*, secret, TPM2B_DIGEST*, certInfo);
 
+// Saves the context of a loaded object. The object stays loaded.
+MOCKABLE_FUNCTION(, TPM_RC, TPM2_ContextSave, TSS_DEVICE*, tpm, TPMI_DH_CONTEXT, saveHandle, TPMS_CONTEXT*, context);
+
+MOCKABLE_FUNCTION(, TPM_RC, TPM2_ContextLoad, TSS_DEVICE*, tpm, TPMS_CONTEXT*, context, TPMI_DH_CONTEXT*, loadedHandle);
+
 TPM_RC TPM2_Create(
     TSS_DEVICE               *tpm,              // IN/OUT
     TSS_SESSION              *session,          // IN/OUT
@@ -195,15 +774,10 @@ MOCKABLE_FUNCTION(, TPM_RC, TPM2_EvictControl, TSS_DEVICE*, tpm, TSS_SESSION*, s
 
 MOCKABLE_FUNCTION(, TPM_RC, TPM2_FlushContext, TSS_DEVICE*, tpm, TPMI_DH_CONTEXT, flushHandle);
 
-TPM_RC
-TPM2_GetCapability(
-    TSS_DEVICE             *tpm,                // IN/OUT
-    TPM_CAP                 capability,         // IN
-    UINT32                  property,           // IN
-    UINT32                  propertyCount,      // IN
-    TPMI_YES_NO            *moreData,           // OUT
-    TPMS_CAPABILITY_DATA   *capabilityData      // OUT
-);
+MOCKABLE_FUNCTION(, TPM_RC, TPM2_GetCapability, TSS_DEVICE*, tpm, TPM_CAP, capability, UINT32, property, UINT32, propertyCount, TPMI_YES_NO*, moreData, TPMS_CAPABILITY_DATA*, capabilityData);
+
+// The TPM may return fewer bytes than requested, at most sizeof(TPMU_HA)
+MOCKABLE_FUNCTION(, TPM_RC, TPM2_GetRandom, TSS_DEVICE*, tpm, UINT16, bytesRequested, TPM2B_DIGEST*, randomBytes);
 
 TPM_RC
 TPM2_Hash(
@@ -239,6 +813,8 @@ MOCKABLE_FUNCTION(, TPM_RC, TPM2_Import, TSS_DEVICE*, tpm, TSS_SESSION*, session
 
 MOCKABLE_FUNCTION(, TPM_RC, TPM2_Load, TSS_DEVICE*, tpm, TSS_SESSION*, session, TPMI_DH_OBJECT, parentHandle, TPM2B_PRIVATE*, inPrivate, TPM2B_PUBLIC*, inPublic, TPM_HANDLE*, objectHandle, TPM2B_NAME*, name);
 
+MOCKABLE_FUNCTION(, TPM_RC, TPM2_PolicyRestart, TSS_DEVICE*, tpm, TPMI_SH_POLICY, sessionHandle);
+
 TPM_RC
 TPM2_PolicySecret(
     TSS_DEVICE             *tpm,                // IN/OUT
@@ -255,6 +831,10 @@ TPM2_PolicySecret(
 
 MOCKABLE_FUNCTION(, TPM_RC, TPM2_ReadPublic, TSS_DEVICE*, tpm, TPMI_DH_OBJECT, objectHandle, TPM2B_PUBLIC*, outPublic, TPM2B_NAME*, name, TPM2B_NAME*, qualifiedName);
 
+// Same as TPM2_ReadPublic, but returns views of the marshaled TPMT_PUBLIC and
+// of the names in the response buffer instead of unmarshaling them
+MOCKABLE_FUNCTION(, TPM_RC, TPM2_ReadPublic_View, TSS_DEVICE*, tpm, TPMI_DH_OBJECT, objectHandle, TSS_2B_VIEW*, outPublic, TSS_2B_VIEW*, name, TSS_2B_VIEW*, qualifiedName);
+
 TPM_RC
 TPM2_StartAuthSession(
     TSS_DEVICE               *tpm,              // IN/OUT
@@ -308,6 +888,7 @@ TSS_GetDigestSize(
     TPM_ALG_ID  hashAlg     // IN: hash algorithm to look up
 );
 
+// Not suitable for anything security relevant, use TSS_GetRandomBytes
 void TSS_RandomBytes(
     BYTE    *buf,           // OUT: buffer to fill with random bytes
     int      bufSize        // Number of random bytes to generate
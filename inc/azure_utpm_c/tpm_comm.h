@@ -11,6 +11,7 @@ extern "C" {
 #else
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 #endif /* __cplusplus */
 
 #include "azure_c_shared_utility/umock_c_prod.h"
@@ -18,18 +19,94 @@ extern "C" {
 #define TPM_COMM_TYPE_VALUES    \
     TPM_COMM_TYPE_EMULATOR,     \
     TPM_COMM_TYPE_WINDOW,       \
-    TPM_COMM_TYPE_LINUX
+    TPM_COMM_TYPE_LINUX,        \
+    TPM_COMM_TYPE_REPLAY,       \
+    TPM_COMM_TYPE_BROKER
 
 DEFINE_ENUM(TPM_COMM_TYPE, TPM_COMM_TYPE_VALUES);
 
+#define TPM_COMM_POLL_RESULT_VALUES \
+    TPM_COMM_POLL_COMPLETE,         \
+    TPM_COMM_POLL_PENDING,          \
+    TPM_COMM_POLL_ERROR
+
+DEFINE_ENUM(TPM_COMM_POLL_RESULT, TPM_COMM_POLL_RESULT_VALUES);
+
+#define TPM_COMM_PRIORITY_VALUES    \
+    TPM_COMM_PRIORITY_LOW,          \
+    TPM_COMM_PRIORITY_NORMAL,       \
+    TPM_COMM_PRIORITY_HIGH
+
+DEFINE_ENUM(TPM_COMM_PRIORITY, TPM_COMM_PRIORITY_VALUES);
+
 typedef struct TPM_COMM_INFO_TAG* TPM_COMM_HANDLE;
 
 MOCKABLE_FUNCTION(, TPM_COMM_HANDLE, tpm_comm_create, const char*, endpoint);
 MOCKABLE_FUNCTION(, void, tpm_comm_destroy, TPM_COMM_HANDLE, handle);
 
 MOCKABLE_FUNCTION(, TPM_COMM_TYPE, tpm_comm_get_type, TPM_COMM_HANDLE, handle);
+
+// Returns true if tpm_comm_create powered the TPM on, so that TPM2_Startup must
+// be sent before any other command
+MOCKABLE_FUNCTION(, bool, tpm_comm_needs_startup, TPM_COMM_HANDLE, handle);
+
+// Process wide, disabled by default. When enabled, the simulator transport
+// keeps its connection to the platform port of the simulator open, and the
+// handles created later for the same simulator skip power on and TPM2_Startup
+// while that connection is alive. Refused connections are retried with an
+// exponential backoff. Disabling closes the kept connection. The Linux and
+// Windows TPMs stay powered on anyway, so these transports ignore the setting.
+MOCKABLE_FUNCTION(, int, tpm_comm_set_persistent_platform, bool, enable);
+
+// Returns true if the transport manages the TPM resources itself (kernel or
+// user mode resource manager, TBS), so that transient objects and sessions of
+// different connections do not compete for the TPM slots
+MOCKABLE_FUNCTION(, bool, tpm_comm_is_resource_managed, TPM_COMM_HANDLE, handle);
+
+// Priority class of the commands submitted through the handle, NORMAL by
+// default. When several connections wait for the TPM, the commands of a higher
+// class are sent first; a running command is never interrupted. On Windows the
+// class is passed to TBS, on Linux it orders the commands of the handles of
+// the process that opened the same TPM device. The simulator runs commands in
+// submission order.
+MOCKABLE_FUNCTION(, int, tpm_comm_set_priority, TPM_COMM_HANDLE, handle, TPM_COMM_PRIORITY, priority);
+
 MOCKABLE_FUNCTION(, int, tpm_comm_submit_command, TPM_COMM_HANDLE, handle, const unsigned char*, cmd_bytes, uint32_t, bytes_len, unsigned char*, response, uint32_t*, resp_len);
 
+// Split form of tpm_comm_submit_command. tpm_comm_submit_async only sends the
+// command, and tpm_comm_poll_complete returns TPM_COMM_POLL_PENDING until the
+// response is available. Only one command can be outstanding per handle, and
+// tpm_comm_submit_command must not be called while one is.
+MOCKABLE_FUNCTION(, int, tpm_comm_submit_async, TPM_COMM_HANDLE, handle, const unsigned char*, cmd_bytes, uint32_t, bytes_len);
+MOCKABLE_FUNCTION(, TPM_COMM_POLL_RESULT, tpm_comm_poll_complete, TPM_COMM_HANDLE, handle, unsigned char*, response, uint32_t*, resp_len);
+
+// Descriptor that becomes readable once the outstanding command has completed,
+// for use with select/poll/epoll. Returns -1 if the transport has none, as the
+// TBS, which runs the command on a thread of the pool; tpm_comm_wait_any still
+// waits for it.
+MOCKABLE_FUNCTION(, int, tpm_comm_get_wait_fd, TPM_COMM_HANDLE, handle);
+
+// Time the Linux transport waits by default for the TPM to accept a command
+// and to answer it
+#define TPM_COMM_DEFAULT_TIMEOUT_MS     120000
+
+// Sets how long tpm_comm_submit_command waits for the TPM to accept the
+// command and return the response before failing, 0 waits forever. The Linux
+// transport uses TPM_COMM_DEFAULT_TIMEOUT_MS by default, the simulator waits
+// forever unless a timeout is set, and the TBS applies its own timeouts.
+MOCKABLE_FUNCTION(, int, tpm_comm_set_timeout, TPM_COMM_HANDLE, handle, uint32_t, timeout_ms);
+
+// Largest number of handles tpm_comm_wait_any accepts
+#define TPM_COMM_WAIT_MAX_HANDLES       16
+
+// Services several connections from one thread. Waits at most timeout_ms
+// (0 waits forever) until the asynchronous command of at least one of 'handles'
+// has completed, and sets ready[i] for each handle whose response can be
+// received with tpm_comm_poll_complete without waiting. Handles without an
+// outstanding command are never ready. Returns the number of ready handles,
+// 0 on timeout, or -1 on failure.
+MOCKABLE_FUNCTION(, int, tpm_comm_wait_any, TPM_COMM_HANDLE*, handles, size_t, count, uint32_t, timeout_ms, bool*, ready);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
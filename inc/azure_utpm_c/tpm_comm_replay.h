@@ -0,0 +1,32 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TPM_COMM_REPLAY_H
+#define TPM_COMM_REPLAY_H
+
+#ifdef __cplusplus
+extern "C" {
+#else
+#include <stdbool.h>
+#endif /* __cplusplus */
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_utpm_c/tpm_comm.h"
+
+// The replay transport (built with use_replay_transport) implements tpm_comm
+// by playing back a transcript recorded with TSS_SetTranscript, given as the
+// endpoint "file:<path>". Every command must have the command code of the next
+// recorded one, and receives the recorded response. Commands whose other bytes
+// differ, such as the ones carrying fresh nonces, are counted and reported
+// when the handle is destroyed.
+
+// By default the responses are returned at once. With 'recorded' set, each
+// response is returned only after the latency recorded for it, so that the
+// timing of the original TPM is reproduced.
+MOCKABLE_FUNCTION(, int, tpm_comm_replay_set_latency, TPM_COMM_HANDLE, handle, bool, recorded);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif // TPM_COMM_REPLAY_H
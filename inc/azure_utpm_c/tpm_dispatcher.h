@@ -0,0 +1,63 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TPM_DISPATCHER_H
+#define TPM_DISPATCHER_H
+
+#ifdef __cplusplus
+#include <cstddef>
+extern "C" {
+#else
+#include <stddef.h>
+#endif /* __cplusplus */
+
+#include "azure_utpm_c/tpm_codec.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+// Spreads operations that do not depend on the state of a particular TPM over
+// several TPMs (or simulator instances), one TSS_DEVICE per TPM. Every
+// operation goes to the device with the least outstanding requests, and waits
+// there until the operations queued before it are done, so the dispatcher can
+// be used from any number of threads.
+//
+// Keys used through the dispatcher must be present at the same persistent
+// handle in every TPM.
+
+typedef struct TSS_DISPATCHER_TAG* TSS_DISPATCHER_HANDLE;
+
+// Maximum number of endpoints of a dispatcher
+#define TSS_DISPATCHER_MAX_DEVICES      16
+
+// Separator of the endpoints in the list given to tpm_dispatcher_create
+#define TSS_DISPATCHER_ENDPOINT_SEPARATOR   ','
+
+// Opens a device for every endpoint of the comma separated list 'endpoints'.
+// Each endpoint (see tpm_endpoint.h) is used as the comms_endpoint of its
+// device; an empty one, or a NULL list, stands for the default endpoint of the
+// transport.
+MOCKABLE_FUNCTION(, TSS_DISPATCHER_HANDLE, tpm_dispatcher_create, const char*, endpoints);
+
+// Closes all the devices. No operation may be in progress.
+MOCKABLE_FUNCTION(, void, tpm_dispatcher_destroy, TSS_DISPATCHER_HANDLE, handle);
+
+MOCKABLE_FUNCTION(, size_t, tpm_dispatcher_get_device_count, TSS_DISPATCHER_HANDLE, handle);
+
+// Hands out the least loaded device for exclusive use, for operations not
+// covered below. Must be given back with tpm_dispatcher_release_device.
+MOCKABLE_FUNCTION(, TSS_DEVICE*, tpm_dispatcher_acquire_device, TSS_DISPATCHER_HANDLE, handle);
+MOCKABLE_FUNCTION(, void, tpm_dispatcher_release_device, TSS_DISPATCHER_HANDLE, handle, TSS_DEVICE*, device);
+
+// Fills 'buffer' with 'size' bytes from the random number generator of one TPM
+MOCKABLE_FUNCTION(, TPM_RC, tpm_dispatcher_get_random, TSS_DISPATCHER_HANDLE, handle, BYTE*, buffer, UINT32, size);
+
+MOCKABLE_FUNCTION(, TPM_RC, tpm_dispatcher_hash, TSS_DISPATCHER_HANDLE, handle, BYTE*, data, UINT32, dataSize, TPMI_ALG_HASH, hashAlg, TPM2B_DIGEST*, outHash);
+
+// HMAC with the replicated key 'keyHandle'. Only password sessions can be
+// used, as they are not bound to a TPM.
+MOCKABLE_FUNCTION(, TPM_RC, tpm_dispatcher_hmac, TSS_DISPATCHER_HANDLE, handle, TSS_SESSION*, session, TPMI_DH_OBJECT, keyHandle, BYTE*, data, UINT32, dataSize, TPM2B_DIGEST*, outHMAC);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif // TPM_DISPATCHER_H
@@ -0,0 +1,57 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TPM_ENDPOINT_H
+#define TPM_ENDPOINT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+// Endpoint strings given to tpm_comm_create (the comms_endpoint of a device):
+//
+//   NULL or ""             the default TPM of the transport
+//   dev:<path>             a TPM character device, e.g. dev:/dev/tpmrm1
+//   tcp:<host>[:<port>]    a simulator or user mode TRM over TCP
+//   unix:<path>            a simulator or user mode TRM over a unix domain
+//                          socket, unix://<path> is accepted as well
+//   <host>[:<port>]        same as tcp:
+//   file:<path>            a transcript played back by the replay transport
+//   shm:<name>             the TPM broker of that name, see
+//                          tpm_shm_broker.h
+//
+// Each transport only serves some of the types, and substitutes its own
+// defaults for an omitted host or port.
+
+#define TPM_ENDPOINT_TYPE_VALUES    \
+    TPM_ENDPOINT_DEFAULT,           \
+    TPM_ENDPOINT_DEVICE,            \
+    TPM_ENDPOINT_TCP,               \
+    TPM_ENDPOINT_UNIX,              \
+    TPM_ENDPOINT_FILE,              \
+    TPM_ENDPOINT_SHM
+
+DEFINE_ENUM(TPM_ENDPOINT_TYPE, TPM_ENDPOINT_TYPE_VALUES);
+
+// Longest address, including its terminating zero
+#define TPM_ENDPOINT_MAX_ADDRESS    128
+
+typedef struct TPM_ENDPOINT_TAG
+{
+    TPM_ENDPOINT_TYPE type;
+    // Device or transcript path, host ("" if omitted), unix socket in the
+    // "unix://<path>" form taken by tpm_socket_create, or segment name
+    char address[TPM_ENDPOINT_MAX_ADDRESS];
+    // TCP port, 0 if omitted
+    unsigned short port;
+} TPM_ENDPOINT;
+
+MOCKABLE_FUNCTION(, int, tpm_endpoint_parse, const char*, endpoint, TPM_ENDPOINT*, parsed);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif // TPM_ENDPOINT_H
@@ -0,0 +1,30 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TPM_HOST_HASH_H
+#define TPM_HOST_HASH_H
+
+#ifdef __cplusplus
+extern "C" {
+#else
+#include <stdbool.h>
+#endif /* __cplusplus */
+
+#include "azure_utpm_c/Tpm.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+// Digests computed on the host, with the SHA implementation of the shared
+// utility library, for the cases where the TPM does not have to produce a
+// ticket for the digest (see TSS_HASH_POLICY).
+
+// Returns true if 'hashAlg' can be computed on the host, i.e. it is one of the
+// SHA-1 and SHA-2 algorithms enabled in Implementation.h
+MOCKABLE_FUNCTION(, bool, tpm_host_hash_is_supported, TPMI_ALG_HASH, hashAlg);
+
+MOCKABLE_FUNCTION(, TPM_RC, tpm_host_hash, TPMI_ALG_HASH, hashAlg, const BYTE*, data, UINT32, dataSize, TPM2B_DIGEST*, outHash);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif // TPM_HOST_HASH_H
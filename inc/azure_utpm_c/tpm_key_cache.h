@@ -0,0 +1,81 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TPM_KEY_CACHE_H
+#define TPM_KEY_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "azure_utpm_c/tpm_codec.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+// Maximum number of keys tracked by a TSS_KEY_CACHE
+#define TSS_KEY_CACHE_SIZE      8
+
+typedef struct
+{
+    // TRUE when the slot holds a key
+    BOOL            Used;
+
+    // Caller defined identifier of the key
+    UINT32          KeyId;
+
+    // Handle of the key while it is loaded in the TPM, or 0
+    TPM_HANDLE      Handle;
+
+    // TRUE when Context holds a saved context of the key, which can be loaded
+    // again after the key was flushed
+    BOOL            Saved;
+    TPMS_CONTEXT    Context;
+
+    // Value of TSS_KEY_CACHE::Tick when the key was last used
+    UINT32          LastUse;
+} TSS_KEY_CACHE_ENTRY;
+
+// Transient keys that are expensive to re-create (primary keys, loaded
+// children). At most Limit keys are loaded in the TPM at a time; the least
+// recently used one is saved with TPM2_ContextSave and flushed to make room,
+// and loaded back with TPM2_ContextLoad when needed again.
+// A zero-initialized cache is empty. It must only be used with one TSS_DEVICE.
+typedef struct
+{
+    // Number of keys kept loaded, computed on first use from
+    // TPM_PT_HR_TRANSIENT_MIN. Zero until then.
+    UINT32              Limit;
+
+    UINT32              Tick;
+    TSS_KEY_CACHE_ENTRY Entries[TSS_KEY_CACHE_SIZE];
+} TSS_KEY_CACHE;
+
+// Hands the transient object 'handle' over to the cache under 'keyId'. The cache
+// flushes it when it needs the room, or when the key is removed.
+MOCKABLE_FUNCTION(, TPM_RC, tpm_key_cache_add, TSS_DEVICE*, tpm, TSS_KEY_CACHE*, cache, UINT32, keyId, TPM_HANDLE, handle);
+
+// Returns the handle of the key 'keyId', loading its saved context if needed.
+// Fails with TPM_RC_HANDLE if the key is not in the cache, in which case the
+// caller creates it and adds it. The handle is only valid until the next call
+// made with the same cache.
+MOCKABLE_FUNCTION(, TPM_RC, tpm_key_cache_get, TSS_DEVICE*, tpm, TSS_KEY_CACHE*, cache, UINT32, keyId, TPM_HANDLE*, handle);
+
+// Flushes the key 'keyId' if it is loaded and forgets it
+MOCKABLE_FUNCTION(, void, tpm_key_cache_remove, TSS_DEVICE*, tpm, TSS_KEY_CACHE*, cache, UINT32, keyId);
+
+// Flushes all the loaded keys and empties the cache
+MOCKABLE_FUNCTION(, void, tpm_key_cache_clear, TSS_DEVICE*, tpm, TSS_KEY_CACHE*, cache);
+
+// Reads saved key contexts from the file at 'path'. A missing or malformed file
+// leaves the cache empty. Contexts the TPM does not accept anymore are dropped
+// by tpm_key_cache_get.
+MOCKABLE_FUNCTION(, int, tpm_key_cache_load, TSS_KEY_CACHE*, cache, const char*, path);
+
+// Saves the context of every key of the cache to the file at 'path'. Loaded
+// keys stay loaded.
+MOCKABLE_FUNCTION(, int, tpm_key_cache_save, TSS_DEVICE*, tpm, TSS_KEY_CACHE*, cache, const char*, path);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif // TPM_KEY_CACHE_H
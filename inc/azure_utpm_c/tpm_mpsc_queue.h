@@ -0,0 +1,54 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TPM_MPSC_QUEUE_H
+#define TPM_MPSC_QUEUE_H
+
+#ifdef __cplusplus
+#include <cstddef>
+extern "C" {
+#else
+#include <stddef.h>
+#include <stdbool.h>
+#endif /* __cplusplus */
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+// Intrusive FIFO queue that any number of threads push to without locking,
+// drained by a single consumer thread. The nodes are embedded in the queued
+// items and owned by the pushing thread until they are popped, so neither
+// operation allocates.
+
+typedef struct TSS_MPSC_NODE_TAG
+{
+    struct TSS_MPSC_NODE_TAG* volatile next;
+} TSS_MPSC_NODE;
+
+typedef struct TSS_MPSC_QUEUE_TAG
+{
+    // Last pushed node, swapped by the producers
+    TSS_MPSC_NODE* volatile head;
+    // Next node to pop, only used by the consumer
+    TSS_MPSC_NODE* tail;
+    TSS_MPSC_NODE stub;
+    // Nodes pushed and not popped yet, counting the pushes in progress
+    volatile long count;
+} TSS_MPSC_QUEUE;
+
+MOCKABLE_FUNCTION(, void, tpm_mpsc_init, TSS_MPSC_QUEUE*, queue);
+
+// Returns true if the queue was empty, in which case the consumer may be
+// waiting and has to be woken
+MOCKABLE_FUNCTION(, bool, tpm_mpsc_push, TSS_MPSC_QUEUE*, queue, TSS_MPSC_NODE*, node);
+
+// Consumer only. Returns NULL if the queue is empty, or if the next node is
+// still being pushed, which tpm_mpsc_is_empty tells apart.
+MOCKABLE_FUNCTION(, TSS_MPSC_NODE*, tpm_mpsc_pop, TSS_MPSC_QUEUE*, queue);
+
+MOCKABLE_FUNCTION(, bool, tpm_mpsc_is_empty, TSS_MPSC_QUEUE*, queue);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif // TPM_MPSC_QUEUE_H
@@ -0,0 +1,27 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TPM_PUBLIC_CACHE_H
+#define TPM_PUBLIC_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "azure_utpm_c/tpm_codec.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+// Fills 'cache' from the file at 'path'. The file is ignored when it is missing,
+// malformed or was written for a TPM with a different identity, in which case
+// the cache starts empty. Entries whose handle is known not to be present in
+// the TPM are dropped. Fails only if the identity of the TPM cannot be read.
+MOCKABLE_FUNCTION(, int, tpm_public_cache_load, TSS_DEVICE*, tpm, TSS_PUBLIC_CACHE*, cache, const char*, path);
+
+// Writes 'cache' to the file at 'path' if it changed since it was loaded
+MOCKABLE_FUNCTION(, int, tpm_public_cache_save, TSS_PUBLIC_CACHE*, cache, const char*, path);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif // TPM_PUBLIC_CACHE_H
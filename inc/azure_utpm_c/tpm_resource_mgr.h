@@ -0,0 +1,95 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TPM_RESOURCE_MGR_H
+#define TPM_RESOURCE_MGR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "azure_utpm_c/tpm_codec.h"
+#include "azure_utpm_c/tpm_mpsc_queue.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+// User-space resource manager for transports without one, e.g. the raw
+// /dev/tpm0 device (see tpm_comm_is_resource_managed).
+//
+// The manager owns the connection to the TPM. Any number of TSS_DEVICEs become
+// its clients by setting TSS_DEVICE::ResourceMgr before Initialize_TPM_Codec,
+// and can then be used from different threads, as the commands are executed
+// one at a time. Transient objects of the clients get virtual handles, and are
+// saved with TPM2_ContextSave and flushed whenever the TPM runs out of object
+// slots; sessions keep their handles and are saved in the same way. Both are
+// loaded back when a command references them. A client only sees the objects
+// and sessions it created.
+
+// Maximum number of transient objects and of sessions of all the clients
+#define TSS_RM_MAX_OBJECTS      32
+#define TSS_RM_MAX_SESSIONS     16
+
+struct TSS_RM_REQUEST_TAG;
+
+// Called on the worker thread once the request has been executed
+typedef void (*TSS_RM_COMPLETION_CALLBACK)(void* context, struct TSS_RM_REQUEST_TAG* request);
+
+// Command queued with tpm_rm_submit_async. Owned by the caller and must stay
+// valid until its callback was invoked.
+typedef struct TSS_RM_REQUEST_TAG
+{
+    TSS_MPSC_NODE node;
+
+    TSS_DEVICE* client;
+    UINT32 numHandles;
+    BYTE* cmdBuffer;
+    UINT32 cmdSize;
+    BYTE* respBuffer;
+    // IN: capacity of respBuffer, OUT: size of the response
+    UINT32* respSize;
+
+    TSS_RM_COMPLETION_CALLBACK callback;
+    void* context;
+
+    // Set before the callback is invoked
+    TSS_STATUS status;
+} TSS_RM_REQUEST;
+
+// Connects to the TPM at 'endpoint' and flushes the transient objects and
+// sessions left loaded by previous runs
+MOCKABLE_FUNCTION(, TSS_RESOURCE_MGR_HANDLE, tpm_rm_create, const char*, endpoint);
+
+// Flushes the objects and sessions of all the clients and closes the
+// connection. No client may use the manager anymore.
+MOCKABLE_FUNCTION(, void, tpm_rm_destroy, TSS_RESOURCE_MGR_HANDLE, handle);
+
+// Starts a thread that executes the commands of all the clients, so that the
+// TPM is kept busy while the clients marshal their next commands. The commands
+// are handed to the thread through a lock-free queue, in submission order.
+// Must be called before the manager is used by any client; the thread is
+// stopped by tpm_rm_destroy.
+MOCKABLE_FUNCTION(, int, tpm_rm_start_worker, TSS_RESOURCE_MGR_HANDLE, handle);
+
+// Queues 'request' for the worker thread and returns at once. Fails if the
+// worker was not started.
+MOCKABLE_FUNCTION(, TSS_STATUS, tpm_rm_submit_async, TSS_RESOURCE_MGR_HANDLE, handle, TSS_RM_REQUEST*, request);
+
+// Makes 'client' a client of the manager, and creates the waiter it blocks on
+// while the worker thread executes its commands (TSS_DEVICE::RmWaiter). Called
+// by Initialize_TPM_Codec. The waiter is freed by tpm_rm_release_client.
+MOCKABLE_FUNCTION(, int, tpm_rm_attach_client, TSS_RESOURCE_MGR_HANDLE, handle, TSS_DEVICE*, client);
+
+// Executes a command built by 'client', translating the virtual handles of its
+// handle area and of the returned handle. Called by the codec for the devices
+// attached to the manager. With the worker started, the command is queued and
+// the call waits for its completion, which requires 'client' to be attached.
+MOCKABLE_FUNCTION(, TSS_STATUS, tpm_rm_submit_command, TSS_RESOURCE_MGR_HANDLE, handle, TSS_DEVICE*, client, UINT32, numHandles, BYTE*, cmdBuffer, UINT32, cmdSize, BYTE*, respBuffer, UINT32*, respSize);
+
+// Flushes the objects and sessions of 'client' and frees its waiter. Called by
+// Deinit_TPM_Codec.
+MOCKABLE_FUNCTION(, void, tpm_rm_release_client, TSS_RESOURCE_MGR_HANDLE, handle, TSS_DEVICE*, client);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif // TPM_RESOURCE_MGR_H
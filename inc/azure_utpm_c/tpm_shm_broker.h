@@ -0,0 +1,108 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TPM_SHM_BROKER_H
+#define TPM_SHM_BROKER_H
+
+#ifdef __cplusplus
+#include <cstdint>
+extern "C" {
+#else
+#include <stdint.h>
+#include <stdbool.h>
+#endif /* __cplusplus */
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_utpm_c/tpm_comm.h"
+
+// Broker sharing one TPM connection between processes (Linux only). The
+// broker process owns the connection and listens on the abstract unix socket
+// "utpm_shm/<name>". The shared memory transport (built with use_shm_transport)
+// implements tpm_comm on top of it, for the endpoint "shm:<name>": every client
+// handle connects to the socket, and receives from the broker a shared memory
+// segment of its own. A command is written to the segment, the client rings
+// the doorbell by writing a byte to its connection, and the response is
+// written back to the same segment. Commands are executed one at a time, the
+// higher priority ones first, and in turn among the clients of the same
+// priority.
+//
+// The broker only serves the processes running as its user, in its group, or
+// as root, as the kernel reports them for the connection. A segment is
+// anonymous and sealed to its size: it is mapped by the broker and by the
+// client it was passed to only, so clients cannot see or alter the commands of
+// each other.
+//
+// The broker does not manage the TPM resources, so with a TPM without a
+// resource manager the clients still compete for its object and session
+// slots, as they would if they opened the device themselves.
+//
+// The layout below is shared by the broker and its clients, which must be
+// built from the same version of the library.
+
+#define TPM_SHM_MAGIC               0x4d485354
+#define TPM_SHM_VERSION             2
+
+// Maximum number of client handles connected at the same time
+#define TPM_SHM_MAX_CLIENTS         16
+
+// Largest command or response exchanged through a slot (bytes)
+#define TPM_SHM_BUFFER_SIZE         4096
+
+// Longest broker name, including its terminating zero
+#define TPM_SHM_MAX_NAME            64
+
+// Exchange of one client handle. A client has at most one command in its
+// slot, which it owns while cmd_seq equals resp_seq.
+typedef struct TPM_SHM_SLOT_TAG
+{
+    // A TPM_COMM_PRIORITY
+    volatile uint32_t   priority;
+    // Incremented by the client once a command is in 'cmd', and set to it by
+    // the broker once the response is in 'resp'. The client waits on
+    // resp_seq with a futex.
+    volatile uint32_t   cmd_seq;
+    volatile uint32_t   resp_seq;
+    uint32_t            cmd_len;
+    // 0 if the broker failed to execute the command
+    uint32_t            resp_len;
+    unsigned char       cmd[TPM_SHM_BUFFER_SIZE];
+    unsigned char       resp[TPM_SHM_BUFFER_SIZE];
+} TPM_SHM_SLOT;
+
+// Segment of one client handle, created by the broker when the client connects
+typedef struct TPM_SHM_SEGMENT_TAG
+{
+    uint32_t            magic;
+    uint32_t            version;
+    // Set once the segment is ready to use, cleared when the broker exits
+    volatile int32_t    broker_pid;
+    // The TPM of the broker was just powered on. Set for the first client
+    // handle only, which reports it with tpm_comm_needs_startup.
+    uint32_t            needs_startup;
+    // Whether the TPM connection of the broker is resource managed
+    uint32_t            resource_managed;
+    TPM_SHM_SLOT        slot;
+} TPM_SHM_SEGMENT;
+
+typedef struct TPM_SHM_BROKER_TAG* TPM_SHM_BROKER_HANDLE;
+
+// Connects to the TPM at 'endpoint' (see tpm_endpoint.h) and listens for the
+// clients of 'name'. Fails if another broker serves the name. The name must
+// not contain '/'.
+MOCKABLE_FUNCTION(, TPM_SHM_BROKER_HANDLE, tpm_shm_broker_create, const char*, name, const char*, endpoint);
+
+// Disconnects the clients and closes the TPM connection. The commands of the
+// connected clients fail from then on.
+MOCKABLE_FUNCTION(, void, tpm_shm_broker_destroy, TPM_SHM_BROKER_HANDLE, handle);
+
+// Executes the commands waiting in the slots, waiting at most 'timeout_ms'
+// (0 waits forever) for one if there is none, while accepting the clients
+// that connect and dropping the ones that disconnect. Called in a loop by the
+// broker process. Returns the number of commands executed, or -1 on failure.
+MOCKABLE_FUNCTION(, int, tpm_shm_broker_serve, TPM_SHM_BROKER_HANDLE, handle, uint32_t, timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif // TPM_SHM_BROKER_H
@@ -0,0 +1,96 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TPM_SHM_SYS_H
+#define TPM_SHM_SYS_H
+
+#ifdef __cplusplus
+#include <cstdint>
+extern "C" {
+#else
+#include <stdint.h>
+#include <stdbool.h>
+#endif /* __cplusplus */
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_utpm_c/tpm_shm_broker.h"
+
+// System services used by the TPM broker and the shared memory transport
+// (Linux only). A broker 'name' is the one of tpm_shm_broker_create.
+
+// Word of the segment a futex waits on
+typedef volatile uint32_t TPM_SHM_WORD;
+
+// Identity of a process
+typedef struct TPM_SHM_CREDENTIALS_TAG
+{
+    int32_t pid;
+    uint32_t uid;
+    uint32_t gid;
+} TPM_SHM_CREDENTIALS;
+
+// Listens on the socket of the broker 'name'. -1 on failure, among which
+// another broker listening on it.
+MOCKABLE_FUNCTION(, int, tpm_shm_sys_listen, const char*, name);
+
+// Accepts a connection waiting on 'listen_socket', and fills 'peer' with the
+// credentials the kernel recorded for the connecting process. -1 on failure.
+MOCKABLE_FUNCTION(, int, tpm_shm_sys_accept, int, listen_socket, TPM_SHM_CREDENTIALS*, peer);
+
+// Connects to the broker 'name'. -1 on failure.
+MOCKABLE_FUNCTION(, int, tpm_shm_sys_connect, const char*, name);
+
+// Creates and maps a zero filled segment, which has no name and cannot be
+// resized. Its descriptor is returned in 'fd', to pass with
+// tpm_shm_sys_send_segment. NULL on failure.
+MOCKABLE_FUNCTION(, TPM_SHM_SEGMENT*, tpm_shm_sys_create, int*, fd);
+
+// Passes the segment descriptor 'fd' over the connection 's'
+MOCKABLE_FUNCTION(, int, tpm_shm_sys_send_segment, int, s, int, fd);
+
+// Maps the segment passed over the connection 's'. NULL if the peer closed
+// the connection instead, or if the segment does not have the size of a
+// TPM_SHM_SEGMENT.
+MOCKABLE_FUNCTION(, TPM_SHM_SEGMENT*, tpm_shm_sys_receive_segment, int, s);
+
+MOCKABLE_FUNCTION(, void, tpm_shm_sys_unmap, TPM_SHM_SEGMENT*, segment);
+
+// Writes a doorbell byte to the connection 's'
+MOCKABLE_FUNCTION(, int, tpm_shm_sys_ring, int, s);
+
+// Reads the doorbell bytes waiting on the connection 's'. Non zero once the
+// peer has closed the connection, or on failure.
+MOCKABLE_FUNCTION(, int, tpm_shm_sys_drain, int, s);
+
+// Waits at most 'timeout_ms' (0 waits forever) until at least one of
+// 'sockets' is readable or closed, and sets readable[i] for each one that
+// is. Returns the number of readable sockets, 0 on timeout or interruption,
+// or -1 on failure.
+MOCKABLE_FUNCTION(, int, tpm_shm_sys_poll, int*, sockets, size_t, count, uint32_t, timeout_ms, bool*, readable);
+
+// Closes a socket or a segment descriptor
+MOCKABLE_FUNCTION(, void, tpm_shm_sys_close, int, fd);
+
+// Returns at once if 'word' does not hold 'value' anymore, after at most
+// 'timeout_ms' (0 waits forever) otherwise, and may return spuriously
+MOCKABLE_FUNCTION(, void, tpm_shm_sys_wait, TPM_SHM_WORD*, word, uint32_t, value, uint32_t, timeout_ms);
+
+// tpm_shm_sys_wait for the first of 'words' whose entry of 'values' it does
+// not hold anymore. Kernels without futex_waitv (before Linux 5.16) only wait
+// on words[0], and for a millisecond at most when there are several words.
+MOCKABLE_FUNCTION(, void, tpm_shm_sys_wait_any, TPM_SHM_WORD**, words, const uint32_t*, values, size_t, count, uint32_t, timeout_ms);
+
+// Wakes all the processes waiting on 'word'
+MOCKABLE_FUNCTION(, void, tpm_shm_sys_wake, TPM_SHM_WORD*, word);
+
+// Whether the process 'pid' exists, including when it runs as another user
+MOCKABLE_FUNCTION(, bool, tpm_shm_sys_is_alive, int32_t, pid);
+
+// Credentials of the calling process, with its effective user and group
+MOCKABLE_FUNCTION(, void, tpm_shm_sys_get_credentials, TPM_SHM_CREDENTIALS*, credentials);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif // TPM_SHM_SYS_H
@@ -0,0 +1,72 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TPM_SIGN_COALESCER_H
+#define TPM_SIGN_COALESCER_H
+
+#ifdef __cplusplus
+#include <cstdint>
+extern "C" {
+#else
+#include <stdint.h>
+#endif /* __cplusplus */
+
+#include "azure_utpm_c/tpm_codec.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+// Front end of SignData shared by any number of threads, each with its own
+// TSS_DEVICE. Requests to sign the same data (compared by their SHA-256
+// digest, computed on the host) while a TPM HMAC is already computing it wait
+// for that HMAC instead of issuing their own, and all of them get its result.
+// Optionally, successful signatures are also served for a short while after
+// they were computed.
+//
+// Requests only share a signature when they are for the same TPM (same
+// identity properties, endpoint and resource manager) and the same
+// authorization: the password session with the same password, or else the
+// very same session of the same device.
+//
+// The signatures are only reused while the identity key stays the same, so
+// tpm_sign_coalescer_clear must be called when DPS_ID_KEY_HANDLE is replaced.
+
+typedef struct TSS_SIGN_COALESCER_TAG* TSS_SIGN_COALESCER_HANDLE;
+
+// Maximum number of distinct payloads tracked at a time. Requests for other
+// payloads while all the slots are in use are signed without coalescing.
+#define TSS_SIGN_COALESCER_SIZE     16
+
+typedef struct
+{
+    // Requests that issued a TPM HMAC
+    uint64_t    Signed;
+    // Requests that waited for the HMAC issued by another one
+    uint64_t    Coalesced;
+    // Requests served from the signatures kept for 'ttl_ms'
+    uint64_t    Cached;
+}
+TSS_SIGN_COALESCER_STATS;
+
+// Successful signatures are kept for 'ttl_ms' milliseconds after they were
+// computed. With 0 the only requests sharing a signature are the ones made
+// while it was being computed.
+MOCKABLE_FUNCTION(, TSS_SIGN_COALESCER_HANDLE, tpm_sign_coalescer_create, uint32_t, ttl_ms);
+
+// No request may be in progress
+MOCKABLE_FUNCTION(, void, tpm_sign_coalescer_destroy, TSS_SIGN_COALESCER_HANDLE, handle);
+
+// Same as SignData. A request that gets the signature of another one also gets
+// its failure, in which case tpm->LastRawResponse is set to the response code
+// of the TPM command that failed.
+MOCKABLE_FUNCTION(, UINT32, tpm_sign_coalescer_sign, TSS_SIGN_COALESCER_HANDLE, handle, TSS_DEVICE*, tpm, TSS_SESSION*, sess, BYTE*, tokenData, UINT32, tokenSize, BYTE*, signatureBuffer, UINT32, sigBufSize);
+
+// Forgets the kept signatures. The ones being computed are still handed to the
+// requests waiting for them.
+MOCKABLE_FUNCTION(, void, tpm_sign_coalescer_clear, TSS_SIGN_COALESCER_HANDLE, handle);
+
+MOCKABLE_FUNCTION(, int, tpm_sign_coalescer_get_stats, TSS_SIGN_COALESCER_HANDLE, handle, TSS_SIGN_COALESCER_STATS*, stats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif // TPM_SIGN_COALESCER_H
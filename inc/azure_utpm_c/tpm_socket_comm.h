@@ -11,18 +11,48 @@ extern "C" {
 #else
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 #endif /* __cplusplus */
 
 #include "azure_c_shared_utility/umock_c_prod.h"
 
 typedef struct TPM_SOCKET_INFO_TAG* TPM_SOCKET_HANDLE;
 
+// One piece of a message sent with tpm_socket_send_gather
+typedef struct TPM_SOCKET_BUFFER_TAG
+{
+    const unsigned char* bytes;
+    uint32_t length;
+} TPM_SOCKET_BUFFER;
+
+// Addresses of the form "unix://<path>" connect a unix domain stream socket
+// instead of a TCP one, and ignore the port. Not available on Windows.
+#define TPM_SOCKET_UNIX_PREFIX      "unix://"
+
 MOCKABLE_FUNCTION(, TPM_SOCKET_HANDLE, tpm_socket_create, const char*, address, unsigned short, port);
 MOCKABLE_FUNCTION(, void, tpm_socket_destroy, TPM_SOCKET_HANDLE, handle);
 
 MOCKABLE_FUNCTION(, int, tpm_socket_read, TPM_SOCKET_HANDLE, handle, unsigned char*, tpm_bytes, uint32_t, bytes_len);
 MOCKABLE_FUNCTION(, int, tpm_socket_send, TPM_SOCKET_HANDLE, handle, const unsigned char*, cmd_val, uint32_t, byte_len);
 
+// Sends all the buffers, in order, with a single system call where possible
+MOCKABLE_FUNCTION(, int, tpm_socket_send_gather, TPM_SOCKET_HANDLE, handle, const TPM_SOCKET_BUFFER*, buffers, size_t, count);
+
+// Sets is_readable to true if tpm_socket_read would find data without blocking,
+// waiting at most timeout_ms for it to arrive
+MOCKABLE_FUNCTION(, int, tpm_socket_wait_readable, TPM_SOCKET_HANDLE, handle, uint32_t, timeout_ms, bool*, is_readable);
+
+// Largest number of sockets tpm_socket_wait_any accepts, and its timeout_ms
+// for a wait without time limit
+#define TPM_SOCKET_WAIT_MAX_HANDLES 16
+#define TPM_SOCKET_WAIT_FOREVER     UINT32_MAX
+
+// Waits at most timeout_ms until at least one of 'handles' is readable, and
+// sets readable[i] for each one tpm_socket_read would find data on without
+// blocking. Returns the number of readable sockets, 0 on timeout, -1 on failure.
+MOCKABLE_FUNCTION(, int, tpm_socket_wait_any, TPM_SOCKET_HANDLE*, handles, size_t, count, uint32_t, timeout_ms, bool*, readable);
+MOCKABLE_FUNCTION(, int, tpm_socket_get_fd, TPM_SOCKET_HANDLE, handle);
+
 
 #ifdef __cplusplus
 }
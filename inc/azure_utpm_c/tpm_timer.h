@@ -0,0 +1,24 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TPM_TIMER_H
+#define TPM_TIMER_H
+
+#ifdef __cplusplus
+#include <cstdint>
+extern "C" {
+#else
+#include <stdint.h>
+#endif /* __cplusplus */
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+// Monotonic time in nanoseconds from an arbitrary starting point. Only the
+// difference between two values is meaningful.
+MOCKABLE_FUNCTION(, uint64_t, tpm_timer_get_ns);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif // TPM_TIMER_H
@@ -0,0 +1,70 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TPM_TRANSCRIPT_H
+#define TPM_TRANSCRIPT_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+extern "C" {
+#else
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#endif /* __cplusplus */
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+// Binary log of the command/response pairs exchanged with a TPM, recorded by
+// the codec (see TSS_SetTranscript) and played back by the replay transport.
+// The file holds a magic followed by one record per command, all the integers
+// in big endian:
+//
+//  record: command size, command, response size, latency in ns, response
+//
+// A response size of 0 records a command the transport failed to deliver.
+
+// Largest command or response a record may hold
+#define TPM_TRANSCRIPT_MAX_MESSAGE      4096
+
+typedef struct TPM_TRANSCRIPT_TAG* TPM_TRANSCRIPT_HANDLE;
+
+typedef struct TPM_TRANSCRIPT_ENTRY_TAG
+{
+    const unsigned char* cmd_bytes;
+    uint32_t cmd_len;
+    const unsigned char* resp_bytes;
+    uint32_t resp_len;
+    // Time the transport took to return the response
+    uint64_t latency_ns;
+} TPM_TRANSCRIPT_ENTRY;
+
+// Creates (or truncates) the file at 'path' for recording
+MOCKABLE_FUNCTION(, TPM_TRANSCRIPT_HANDLE, tpm_transcript_create, const char*, path);
+
+// Loads the whole transcript at 'path' for playback. Fails if the file is not
+// a transcript or its last record is truncated.
+MOCKABLE_FUNCTION(, TPM_TRANSCRIPT_HANDLE, tpm_transcript_open, const char*, path);
+
+MOCKABLE_FUNCTION(, void, tpm_transcript_close, TPM_TRANSCRIPT_HANDLE, handle);
+
+// The command is written before it is sent, so that the buffer it is in can
+// be reused for the response. Each command must be followed by its response.
+MOCKABLE_FUNCTION(, int, tpm_transcript_write_command, TPM_TRANSCRIPT_HANDLE, handle, const unsigned char*, cmd_bytes, uint32_t, cmd_len);
+MOCKABLE_FUNCTION(, int, tpm_transcript_write_response, TPM_TRANSCRIPT_HANDLE, handle, const unsigned char*, resp_bytes, uint32_t, resp_len, uint64_t, latency_ns);
+
+// Returns the next record of a transcript opened for playback, pointing into
+// memory owned by the handle. tpm_transcript_next consumes it and
+// tpm_transcript_peek does not. Both return false once all were consumed.
+MOCKABLE_FUNCTION(, bool, tpm_transcript_next, TPM_TRANSCRIPT_HANDLE, handle, TPM_TRANSCRIPT_ENTRY*, entry);
+MOCKABLE_FUNCTION(, bool, tpm_transcript_peek, TPM_TRANSCRIPT_HANDLE, handle, TPM_TRANSCRIPT_ENTRY*, entry);
+
+// Starts the playback over from the first record
+MOCKABLE_FUNCTION(, void, tpm_transcript_rewind, TPM_TRANSCRIPT_HANDLE, handle);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif // TPM_TRANSCRIPT_H
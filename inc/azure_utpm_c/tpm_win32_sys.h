@@ -0,0 +1,56 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TPM_WIN32_SYS_H
+#define TPM_WIN32_SYS_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+extern "C" {
+#else
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#endif /* __cplusplus */
+
+#include <windows.h>
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+// System services the TBS transport uses to run its asynchronous commands
+// (Windows only)
+
+// Timeout of tpm_win32_sys_wait_any that never expires
+#define TPM_WIN32_WAIT_FOREVER      UINT32_MAX
+
+typedef void(*TPM_WIN32_WORK_FUNC)(void* context);
+
+// Work item of the process thread pool. 'done' is set once 'run' has returned.
+typedef struct TPM_WIN32_WORK_TAG
+{
+    TPM_WIN32_WORK_FUNC run;
+    void* context;
+    HANDLE done;
+} TPM_WIN32_WORK;
+
+// Manual reset event, initially not set. NULL on failure.
+MOCKABLE_FUNCTION(, HANDLE, tpm_win32_sys_create_event);
+
+MOCKABLE_FUNCTION(, void, tpm_win32_sys_close_event, HANDLE, event);
+
+MOCKABLE_FUNCTION(, void, tpm_win32_sys_reset_event, HANDLE, event);
+
+// Runs work->run on a thread of the thread pool. 'work' must stay valid until
+// work->done is set. Returns false if the work could not be queued.
+MOCKABLE_FUNCTION(, bool, tpm_win32_sys_queue_work, TPM_WIN32_WORK*, work);
+
+// Waits at most timeout_ms (0 only checks) until at least one of 'events' is
+// set, and sets signaled[i] for each one that is. Returns the number of set
+// events, 0 on timeout, or -1 on failure.
+MOCKABLE_FUNCTION(, int, tpm_win32_sys_wait_any, HANDLE*, events, size_t, count, uint32_t, timeout_ms, bool*, signaled);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif // TPM_WIN32_SYS_H
@@ -0,0 +1,595 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#define _POSIX_C_SOURCE 200112L
+#include <time.h>
+#endif
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/platform.h"
+#include "azure_c_shared_utility/threadapi.h"
+
+#include "azure_utpm_c/tpm_codec.h"
+#include "azure_utpm_c/tpm_resource_mgr.h"
+#include "azure_utpm_c/Marshal_fp.h"
+
+// Runs the selected workloads against the TPM reached through the linked
+// tpm_comm backend and reports the latency percentiles and the throughput of
+// every command.
+//
+// Each thread drives its own TSS_DEVICE. When several endpoints are given the
+// threads are spread over them round robin, so several TPMs (or several
+// connections to the same resource manager) are exercised concurrently. With
+// -r all the threads share the in-library resource manager connected to the
+// first endpoint instead, as needed with the raw /dev/tpm0 device, and with
+// -q the manager executes the commands on its worker thread.
+//
+// The sign and hmacseq workloads use the HMAC key persisted at
+// BENCH_ID_KEY_HANDLE, the handle used by SignData. The primary and loadflush
+// workloads only need owner authorization with an empty password.
+
+#define DEFAULT_ITERATIONS      100
+#define DEFAULT_THREAD_COUNT    1
+#define DEFAULT_DATA_SIZE       32
+#define MAX_THREAD_COUNT        64
+#define MAX_ENDPOINT_COUNT      8
+#define MAX_BENCH_DATA_SIZE     4096
+
+#define BENCH_WORKLOAD_SIGN         0x01
+#define BENCH_WORKLOAD_HMAC_SEQ     0x02
+#define BENCH_WORKLOAD_PRIMARY      0x04
+#define BENCH_WORKLOAD_LOAD_FLUSH   0x08
+
+typedef enum BENCH_OP_TAG
+{
+    BENCH_OP_SIGN_DATA,
+    BENCH_OP_HMAC_SEQUENCE,
+    BENCH_OP_CREATE_PRIMARY,
+    BENCH_OP_LOAD,
+    BENCH_OP_FLUSH_CONTEXT,
+    BENCH_OP_COUNT
+} BENCH_OP;
+
+typedef struct BENCH_OP_INFO_TAG
+{
+    const char* name;
+    TPM_CC cmd_code;
+} BENCH_OP_INFO;
+
+// Indexed by BENCH_OP
+static const BENCH_OP_INFO g_op_info[BENCH_OP_COUNT] =
+{
+    { "SignData",       TPM_CC_HMAC },
+    { "HmacSequence",   TPM_CC_HMAC_Start },
+    { "CreatePrimary",  TPM_CC_CreatePrimary },
+    { "Load",           TPM_CC_Load },
+    { "FlushContext",   TPM_CC_FlushContext }
+};
+
+typedef struct BENCH_CONFIG_TAG
+{
+    UINT32 workloads;
+    UINT32 iterations;
+    UINT32 thread_count;
+    UINT32 data_size;
+    const char* endpoints[MAX_ENDPOINT_COUNT];
+    UINT32 endpoint_count;
+    bool use_resource_mgr;
+    bool use_rm_worker;
+} BENCH_CONFIG;
+
+typedef struct BENCH_STATS_TAG
+{
+    // Latency of every successful operation (ns)
+    UINT64* samples;
+    size_t count;
+    size_t capacity;
+    size_t failures;
+} BENCH_STATS;
+
+typedef struct BENCH_THREAD_TAG
+{
+    const BENCH_CONFIG* config;
+    const char* endpoint;
+    THREAD_HANDLE thread_handle;
+    TSS_DEVICE tpm_device;
+    BENCH_STATS stats[BENCH_OP_COUNT];
+    BYTE data[MAX_BENCH_DATA_SIZE];
+} BENCH_THREAD;
+
+static const UINT32 BENCH_ID_KEY_HANDLE = HR_PERSISTENT | 0x00000100;
+
+static TPM2B_AUTH NullAuth = { 0 };
+
+static TPMS_RSA_PARMS  RsaStorageParams = {
+    { TPM_ALG_AES, 128, TPM_ALG_CFB },      // TPMT_SYM_DEF_OBJECT  symmetric
+    { TPM_ALG_NULL },                       // TPMT_RSA_SCHEME      scheme
+    2048,                                   // TPMI_RSA_KEY_BITS    keyBits
+    0                                       // UINT32               exponent
+};
+
+static void get_srk_template(TPM2B_PUBLIC* srk_template)
+{
+    memset(srk_template, 0, sizeof(TPM2B_PUBLIC));
+    srk_template->publicArea.type = TPM_ALG_RSA;
+    srk_template->publicArea.nameAlg = TPM_ALG_SHA256;
+    srk_template->publicArea.objectAttributes = ToTpmaObject(
+        Restricted | Decrypt | FixedTPM | FixedParent | NoDA | UserWithAuth | SensitiveDataOrigin);
+    srk_template->publicArea.parameters.rsaDetail = RsaStorageParams;
+}
+
+// HMAC key loaded by the loadflush workload. It is cheap to create, so the
+// measured time is dominated by TPM2_Load itself.
+static void get_hmac_key_template(TPM2B_PUBLIC* key_template)
+{
+    memset(key_template, 0, sizeof(TPM2B_PUBLIC));
+    key_template->publicArea.type = TPM_ALG_KEYEDHASH;
+    key_template->publicArea.nameAlg = TPM_ALG_SHA256;
+    key_template->publicArea.objectAttributes = ToTpmaObject(
+        Sign | FixedTPM | FixedParent | NoDA | UserWithAuth | SensitiveDataOrigin);
+    key_template->publicArea.parameters.keyedHashDetail.scheme.scheme = TPM_ALG_HMAC;
+    key_template->publicArea.parameters.keyedHashDetail.scheme.details.hmac.hashAlg = TPM_ALG_SHA256;
+}
+
+static UINT64 get_time_ns(void)
+{
+#ifdef WIN32
+    static LARGE_INTEGER frequency = { 0 };
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0)
+    {
+        (void)QueryPerformanceFrequency(&frequency);
+    }
+    (void)QueryPerformanceCounter(&counter);
+    return (UINT64)(counter.QuadPart / frequency.QuadPart) * 1000000000ULL
+        + (UINT64)(counter.QuadPart % frequency.QuadPart) * 1000000000ULL / (UINT64)frequency.QuadPart;
+#else
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return (UINT64)now.tv_sec * 1000000000ULL + (UINT64)now.tv_nsec;
+#endif
+}
+
+static void record_sample(BENCH_STATS* stats, UINT64 start, bool succeeded)
+{
+    UINT64 elapsed = get_time_ns() - start;
+    if (!succeeded)
+    {
+        stats->failures++;
+    }
+    else if (stats->count < stats->capacity)
+    {
+        stats->samples[stats->count++] = elapsed;
+    }
+}
+
+static void run_sign_data(BENCH_THREAD* bench_thread, TSS_SESSION* session)
+{
+    BYTE signature[1024];
+    UINT64 start = get_time_ns();
+    UINT32 sign_len = SignData(&bench_thread->tpm_device, session, bench_thread->data,
+        bench_thread->config->data_size, signature, (UINT32)sizeof(signature));
+    record_sample(&bench_thread->stats[BENCH_OP_SIGN_DATA], start, sign_len != 0);
+}
+
+static void run_hmac_sequence(BENCH_THREAD* bench_thread, TSS_SESSION* session)
+{
+    TPM2B_DIGEST hmac;
+    UINT64 start = get_time_ns();
+    TPM_RC rc = TSS_HmacSequence(&bench_thread->tpm_device, session, BENCH_ID_KEY_HANDLE, TPM_ALG_SHA256,
+        bench_thread->data, bench_thread->config->data_size, &hmac);
+    record_sample(&bench_thread->stats[BENCH_OP_HMAC_SEQUENCE], start, rc == TPM_RC_SUCCESS);
+}
+
+static void run_flush_context(BENCH_THREAD* bench_thread, TPM_HANDLE handle)
+{
+    UINT64 start = get_time_ns();
+    TPM_RC rc = TPM2_FlushContext(&bench_thread->tpm_device, handle);
+    record_sample(&bench_thread->stats[BENCH_OP_FLUSH_CONTEXT], start, rc == TPM_RC_SUCCESS);
+}
+
+static void run_create_primary(BENCH_THREAD* bench_thread, TSS_SESSION* session, TPM2B_PUBLIC* srk_template)
+{
+    TPM_HANDLE handle;
+    TPM2B_PUBLIC srk_pub;
+    UINT64 start = get_time_ns();
+    TPM_RC rc = TSS_CreatePrimary(&bench_thread->tpm_device, session, TPM_RH_OWNER, srk_template, &handle, &srk_pub);
+    record_sample(&bench_thread->stats[BENCH_OP_CREATE_PRIMARY], start, rc == TPM_RC_SUCCESS);
+    if (rc == TPM_RC_SUCCESS)
+    {
+        run_flush_context(bench_thread, handle);
+    }
+}
+
+static void run_load_flush(BENCH_THREAD* bench_thread, TSS_SESSION* session, TPM_HANDLE parent, TPM2B_PRIVATE* key_priv, TPM2B_PUBLIC* key_pub)
+{
+    TPM_HANDLE handle;
+    TPM2B_NAME name;
+    UINT64 start = get_time_ns();
+    TPM_RC rc = TPM2_Load(&bench_thread->tpm_device, session, parent, key_priv, key_pub, &handle, &name);
+    record_sample(&bench_thread->stats[BENCH_OP_LOAD], start, rc == TPM_RC_SUCCESS);
+    if (rc == TPM_RC_SUCCESS)
+    {
+        run_flush_context(bench_thread, handle);
+    }
+}
+
+static int bench_thread_worker(void* context)
+{
+    int result;
+    BENCH_THREAD* bench_thread = (BENCH_THREAD*)context;
+    const BENCH_CONFIG* config = bench_thread->config;
+    TSS_SESSION session;
+    TPM2B_PUBLIC srk_template;
+    TPM_HANDLE parent = TPM_RH_UNASSIGNED;
+    TPM2B_PUBLIC parent_pub;
+    TPM2B_PUBLIC key_pub;
+    TPM2B_PRIVATE key_priv;
+    TPM2B_SENSITIVE_CREATE key_sens;
+
+    get_srk_template(&srk_template);
+    memset(&key_sens, 0, sizeof(key_sens));
+    bench_thread->tpm_device.comms_endpoint = bench_thread->endpoint;
+
+    if (TSS_CreatePwAuthSession(&NullAuth, &session) != TPM_RC_SUCCESS)
+    {
+        (void)printf("Failure creating the password session\r\n");
+        result = __FAILURE__;
+    }
+    else if (Initialize_TPM_Codec(&bench_thread->tpm_device) != TPM_RC_SUCCESS)
+    {
+        (void)printf("Failure initializing TPM codec for endpoint %s\r\n", bench_thread->endpoint ? bench_thread->endpoint : "(default)");
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+
+        // The loadflush workload needs a parent and a key blob, which are
+        // created once per thread and are not part of the measurements
+        if (config->workloads & BENCH_WORKLOAD_LOAD_FLUSH)
+        {
+            get_hmac_key_template(&key_pub);
+            if (TSS_CreatePrimary(&bench_thread->tpm_device, &session, TPM_RH_OWNER, &srk_template, &parent, &parent_pub) != TPM_RC_SUCCESS)
+            {
+                (void)printf("Failure creating the parent of the loadflush key\r\n");
+                result = __FAILURE__;
+            }
+            else if (TSS_Create(&bench_thread->tpm_device, &session, parent, &key_sens, &key_pub, &key_priv, &key_pub) != TPM_RC_SUCCESS)
+            {
+                (void)printf("Failure creating the loadflush key\r\n");
+                result = __FAILURE__;
+            }
+        }
+
+        if (result == 0)
+        {
+            UINT32 index;
+            for (index = 0; index < config->iterations; index++)
+            {
+                if (config->workloads & BENCH_WORKLOAD_SIGN)
+                {
+                    run_sign_data(bench_thread, &session);
+                }
+                if (config->workloads & BENCH_WORKLOAD_HMAC_SEQ)
+                {
+                    run_hmac_sequence(bench_thread, &session);
+                }
+                if (config->workloads & BENCH_WORKLOAD_PRIMARY)
+                {
+                    run_create_primary(bench_thread, &session, &srk_template);
+                }
+                if (config->workloads & BENCH_WORKLOAD_LOAD_FLUSH)
+                {
+                    run_load_flush(bench_thread, &session, parent, &key_priv, &key_pub);
+                }
+            }
+        }
+
+        if (parent != TPM_RH_UNASSIGNED)
+        {
+            (void)TPM2_FlushContext(&bench_thread->tpm_device, parent);
+        }
+        Deinit_TPM_Codec(&bench_thread->tpm_device);
+    }
+    return result;
+}
+
+static int compare_samples(const void* left, const void* right)
+{
+    UINT64 left_value = *(const UINT64*)left;
+    UINT64 right_value = *(const UINT64*)right;
+    return left_value < right_value ? -1 : (left_value > right_value ? 1 : 0);
+}
+
+static double get_percentile_us(const UINT64* sorted, size_t count, double percentile)
+{
+    size_t index = (size_t)(percentile * (double)(count - 1) + 0.5);
+    return (double)sorted[index] / 1000.0;
+}
+
+static void report_results(const BENCH_CONFIG* config, BENCH_THREAD* threads, UINT64 elapsed_ns)
+{
+    size_t op;
+    double elapsed_sec = (double)elapsed_ns / 1000000000.0;
+
+    (void)printf("%u thread(s), %u endpoint(s), %u iteration(s) per thread, %u data byte(s), %.3f s\r\n\r\n",
+        config->thread_count, config->endpoint_count == 0 ? 1 : config->endpoint_count,
+        config->iterations, config->data_size, elapsed_sec);
+    (void)printf("%-14s %-10s %8s %8s %10s %10s %10s %10s\r\n",
+        "operation", "command", "count", "failed", "ops/sec", "p50 us", "p99 us", "p999 us");
+
+    for (op = 0; op < BENCH_OP_COUNT; op++)
+    {
+        size_t count = 0;
+        size_t failures = 0;
+        UINT32 index;
+        UINT64* merged;
+
+        for (index = 0; index < config->thread_count; index++)
+        {
+            count += threads[index].stats[op].count;
+            failures += threads[index].stats[op].failures;
+        }
+
+        if (count == 0 && failures == 0)
+        {
+            // Not part of the selected workloads
+        }
+        else if (count == 0)
+        {
+            (void)printf("%-14s 0x%08x %8u %8u\r\n", g_op_info[op].name, (unsigned int)g_op_info[op].cmd_code, 0, (unsigned int)failures);
+        }
+        else if ((merged = (UINT64*)malloc(count * sizeof(UINT64))) == NULL)
+        {
+            (void)printf("Failure allocating the samples of %s\r\n", g_op_info[op].name);
+        }
+        else
+        {
+            size_t offset = 0;
+            for (index = 0; index < config->thread_count; index++)
+            {
+                memcpy(merged + offset, threads[index].stats[op].samples, threads[index].stats[op].count * sizeof(UINT64));
+                offset += threads[index].stats[op].count;
+            }
+            qsort(merged, count, sizeof(UINT64), compare_samples);
+
+            (void)printf("%-14s 0x%08x %8u %8u %10.1f %10.1f %10.1f %10.1f\r\n",
+                g_op_info[op].name, (unsigned int)g_op_info[op].cmd_code, (unsigned int)count, (unsigned int)failures,
+                elapsed_sec > 0 ? (double)count / elapsed_sec : 0.0,
+                get_percentile_us(merged, count, 0.50),
+                get_percentile_us(merged, count, 0.99),
+                get_percentile_us(merged, count, 0.999));
+            free(merged);
+        }
+    }
+}
+
+static bool parse_workloads(const char* value, UINT32* workloads)
+{
+    bool result = true;
+    const char* pos = value;
+
+    *workloads = 0;
+    while (result && *pos != '\0')
+    {
+        size_t len = strcspn(pos, ",");
+        if (len == 4 && strncmp(pos, "sign", len) == 0)
+        {
+            *workloads |= BENCH_WORKLOAD_SIGN;
+        }
+        else if (len == 7 && strncmp(pos, "hmacseq", len) == 0)
+        {
+            *workloads |= BENCH_WORKLOAD_HMAC_SEQ;
+        }
+        else if (len == 7 && strncmp(pos, "primary", len) == 0)
+        {
+            *workloads |= BENCH_WORKLOAD_PRIMARY;
+        }
+        else if (len == 9 && strncmp(pos, "loadflush", len) == 0)
+        {
+            *workloads |= BENCH_WORKLOAD_LOAD_FLUSH;
+        }
+        else
+        {
+            result = false;
+        }
+        pos += len;
+        if (*pos == ',')
+        {
+            pos++;
+        }
+    }
+    return result && *workloads != 0;
+}
+
+static bool parse_uint(const char* value, UINT32 min_value, UINT32 max_value, UINT32* target)
+{
+    char* end;
+    unsigned long parsed = strtoul(value, &end, 10);
+    bool result = *value != '\0' && *end == '\0' && parsed >= min_value && parsed <= max_value;
+    if (result)
+    {
+        *target = (UINT32)parsed;
+    }
+    return result;
+}
+
+static bool parse_arguments(int argc, char* argv[], BENCH_CONFIG* config)
+{
+    bool result = true;
+    int index;
+
+    memset(config, 0, sizeof(BENCH_CONFIG));
+    config->workloads = BENCH_WORKLOAD_SIGN;
+    config->iterations = DEFAULT_ITERATIONS;
+    config->thread_count = DEFAULT_THREAD_COUNT;
+    config->data_size = DEFAULT_DATA_SIZE;
+
+    for (index = 1; result && index < argc; index++)
+    {
+        const char* value = index + 1 < argc ? argv[index + 1] : NULL;
+        if (strcmp(argv[index], "-r") == 0 || strcmp(argv[index], "-q") == 0)
+        {
+            // The only options without a value
+            config->use_resource_mgr = true;
+            config->use_rm_worker = config->use_rm_worker || argv[index][1] == 'q';
+            continue;
+        }
+        else if (value == NULL)
+        {
+            result = false;
+        }
+        else if (strcmp(argv[index], "-w") == 0)
+        {
+            result = parse_workloads(value, &config->workloads);
+        }
+        else if (strcmp(argv[index], "-n") == 0)
+        {
+            result = parse_uint(value, 1, 10000000, &config->iterations);
+        }
+        else if (strcmp(argv[index], "-t") == 0)
+        {
+            result = parse_uint(value, 1, MAX_THREAD_COUNT, &config->thread_count);
+        }
+        else if (strcmp(argv[index], "-s") == 0)
+        {
+            result = parse_uint(value, 1, MAX_BENCH_DATA_SIZE, &config->data_size);
+        }
+        else if (strcmp(argv[index], "-e") == 0 && config->endpoint_count < MAX_ENDPOINT_COUNT)
+        {
+            config->endpoints[config->endpoint_count++] = value;
+        }
+        else
+        {
+            result = false;
+        }
+        index++;
+    }
+    return result;
+}
+
+static void print_usage(const char* name)
+{
+    (void)printf("Usage: %s [-w workloads] [-n iterations] [-t threads] [-s data_size] [-r | -q] [-e endpoint]...\r\n", name);
+    (void)printf("  -w  comma separated list of sign, hmacseq, primary, loadflush (default sign)\r\n");
+    (void)printf("  -n  iterations of every workload per thread (default %d)\r\n", DEFAULT_ITERATIONS);
+    (void)printf("  -t  number of threads, each with its own device (max %d, default %d)\r\n", MAX_THREAD_COUNT, DEFAULT_THREAD_COUNT);
+    (void)printf("  -s  size of the data signed by sign and hmacseq (max %d, default %d)\r\n", MAX_BENCH_DATA_SIZE, DEFAULT_DATA_SIZE);
+    (void)printf("  -r  route the threads through one in-library resource manager\r\n");
+    (void)printf("  -q  same as -r, with the commands executed by the worker thread of the manager\r\n");
+    (void)printf("  -e  tpm_comm endpoint, may be repeated to spread the threads (max %d)\r\n", MAX_ENDPOINT_COUNT);
+}
+
+int main(int argc, char* argv[])
+{
+    int result;
+    BENCH_CONFIG config;
+    BENCH_THREAD* threads;
+    TSS_RESOURCE_MGR_HANDLE resource_mgr = NULL;
+
+    if (!parse_arguments(argc, argv, &config))
+    {
+        print_usage(argv[0]);
+        result = __LINE__;
+    }
+    else if (platform_init() != 0)
+    {
+        (void)printf("platform_init failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        // Every thread owns a whole TSS_DEVICE, so keep them off the stack
+        if (config.use_resource_mgr &&
+            (resource_mgr = tpm_rm_create(config.endpoint_count == 0 ? NULL : config.endpoints[0])) == NULL)
+        {
+            (void)printf("Failure creating the resource manager\r\n");
+            result = __LINE__;
+        }
+        else if (config.use_rm_worker && tpm_rm_start_worker(resource_mgr) != 0)
+        {
+            (void)printf("Failure starting the resource manager worker\r\n");
+            tpm_rm_destroy(resource_mgr);
+            result = __LINE__;
+        }
+        else if ((threads = (BENCH_THREAD*)calloc(config.thread_count, sizeof(BENCH_THREAD))) == NULL)
+        {
+            (void)printf("Failure allocating the threads\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            UINT32 index;
+            UINT32 started = 0;
+            size_t op;
+            UINT64 start;
+
+            result = 0;
+            for (index = 0; index < config.thread_count && result == 0; index++)
+            {
+                BENCH_THREAD* bench_thread = &threads[index];
+                bench_thread->config = &config;
+                bench_thread->endpoint = config.endpoint_count == 0 ? NULL : config.endpoints[index % config.endpoint_count];
+                bench_thread->tpm_device.ResourceMgr = resource_mgr;
+                memset(bench_thread->data, (int)index + 1, sizeof(bench_thread->data));
+                for (op = 0; op < BENCH_OP_COUNT; op++)
+                {
+                    bench_thread->stats[op].capacity = config.iterations;
+                    if ((bench_thread->stats[op].samples = (UINT64*)malloc(config.iterations * sizeof(UINT64))) == NULL)
+                    {
+                        (void)printf("Failure allocating the samples\r\n");
+                        result = __LINE__;
+                    }
+                }
+            }
+
+            start = get_time_ns();
+            for (index = 0; index < config.thread_count && result == 0; index++)
+            {
+                if (ThreadAPI_Create(&threads[index].thread_handle, bench_thread_worker, &threads[index]) != THREADAPI_OK)
+                {
+                    (void)printf("Failure creating thread %u\r\n", index);
+                    result = __LINE__;
+                }
+                else
+                {
+                    started++;
+                }
+            }
+
+            for (index = 0; index < started; index++)
+            {
+                int thread_result;
+                if (ThreadAPI_Join(threads[index].thread_handle, &thread_result) != THREADAPI_OK || thread_result != 0)
+                {
+                    result = __LINE__;
+                }
+            }
+
+            if (started == config.thread_count)
+            {
+                report_results(&config, threads, get_time_ns() - start);
+            }
+
+            for (index = 0; index < config.thread_count; index++)
+            {
+                for (op = 0; op < BENCH_OP_COUNT; op++)
+                {
+                    free(threads[index].stats[op].samples);
+                }
+            }
+            free(threads);
+        }
+        tpm_rm_destroy(resource_mgr);
+        platform_deinit();
+    }
+    return result;
+}
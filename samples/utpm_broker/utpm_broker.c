@@ -0,0 +1,119 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#include "azure_c_shared_utility/platform.h"
+
+#include "azure_utpm_c/tpm_shm_broker.h"
+
+// Serves the TPM reached through the linked tpm_comm backend to the processes
+// built with use_shm_transport, which connect with the endpoint
+// "shm:<name>". Runs until interrupted.
+
+#define DEFAULT_BROKER_NAME    "utpm_broker"
+
+// Longest time the signals wait to be noticed
+#define SERVE_INTERVAL_MS       100
+
+static volatile sig_atomic_t g_stop_requested;
+
+static void on_stop_signal(int signal_number)
+{
+    (void)signal_number;
+    g_stop_requested = 1;
+}
+
+static bool parse_arguments(int argc, char* argv[], const char** name, const char** endpoint)
+{
+    bool result = true;
+    int index;
+
+    *name = DEFAULT_BROKER_NAME;
+    *endpoint = NULL;
+    for (index = 1; result && index < argc; index++)
+    {
+        const char* value = index + 1 < argc ? argv[index + 1] : NULL;
+        if (value == NULL)
+        {
+            result = false;
+        }
+        else if (strcmp(argv[index], "-n") == 0)
+        {
+            *name = value;
+            index++;
+        }
+        else if (strcmp(argv[index], "-e") == 0)
+        {
+            *endpoint = value;
+            index++;
+        }
+        else
+        {
+            result = false;
+        }
+    }
+    return result;
+}
+
+static void print_usage(const char* name)
+{
+    (void)printf("Usage: %s [-n name] [-e endpoint]\r\n", name);
+    (void)printf("  -n  name of the broker, the clients use shm:<name> (default %s)\r\n", DEFAULT_BROKER_NAME);
+    (void)printf("  -e  tpm_comm endpoint of the TPM (default endpoint of the transport)\r\n");
+}
+
+int main(int argc, char* argv[])
+{
+    int result;
+    const char* name;
+    const char* endpoint;
+
+    if (!parse_arguments(argc, argv, &name, &endpoint))
+    {
+        print_usage(argv[0]);
+        result = __LINE__;
+    }
+    else if (platform_init() != 0)
+    {
+        (void)printf("platform_init failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        TPM_SHM_BROKER_HANDLE broker;
+        struct sigaction stop_action;
+
+        memset(&stop_action, 0, sizeof(stop_action));
+        stop_action.sa_handler = on_stop_signal;
+        (void)sigaction(SIGINT, &stop_action, NULL);
+        (void)sigaction(SIGTERM, &stop_action, NULL);
+
+        if ((broker = tpm_shm_broker_create(name, endpoint)) == NULL)
+        {
+            (void)printf("Failure creating the broker\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            (void)printf("Serving the TPM on shm:%s\r\n", name);
+            result = 0;
+            while (!g_stop_requested && result == 0)
+            {
+                if (tpm_shm_broker_serve(broker, SERVE_INTERVAL_MS) < 0)
+                {
+                    (void)printf("Failure serving the clients\r\n");
+                    result = __LINE__;
+                }
+            }
+            tpm_shm_broker_destroy(broker);
+        }
+        platform_deinit();
+    }
+    return result;
+}
@@ -9,12 +9,16 @@
 #include "azure_c_shared_utility/platform.h"
 
 #include "azure_utpm_c/tpm_codec.h"
+#include "azure_utpm_c/tpm_public_cache.h"
+#include "azure_utpm_c/tpm_endpoint.h"
+#include "azure_utpm_c/tpm_transcript.h"
 #include "azure_utpm_c/Marshal_fp.h"
 
 static TPM2B_AUTH NullAuth = { 0 };
 static TSS_SESSION NullPwSession;
 static const UINT32 TPM_20_SRK_HANDLE = HR_PERSISTENT | 0x00000001;
 static const UINT32 TPM_20_EK_HANDLE = HR_PERSISTENT | 0x00010001;
+static const char* const PUBLIC_CACHE_FILE = "utpm_public_cache.bin";
 
 static TPMS_RSA_PARMS  RsaStorageParams = {
     { TPM_ALG_AES, 128, TPM_ALG_CFB },      // TPMT_SYM_DEF_OBJECT  symmetric
@@ -68,6 +72,15 @@ typedef struct TPM_SAMPLE_INFO_TAG
     TPM2B_PUBLIC ek_pub;
     TPM2B_PUBLIC srk_pub;
 
+    // Public areas of the EK and SRK kept across runs. Not used while a
+    // transcript is recorded or played back, so that every run sends the
+    // same commands.
+    TSS_PUBLIC_CACHE public_cache;
+    bool use_public_cache;
+
+    // Set when the commands are recorded
+    TPM_TRANSCRIPT_HANDLE transcript;
+
     TPM_HANDLE tpm_handle;
 
 } TPM_SAMPLE_INFO;
@@ -80,46 +93,17 @@ typedef struct HTTP_SAMPLE_INFO_TAG
 static int load_key(TPM_SAMPLE_INFO* tpm_info, TPM_HANDLE request_handle, TPMI_DH_OBJECT hierarchy, TPM2B_PUBLIC* inPub, TPM2B_PUBLIC* outPub)
 {
     int result;
-    TPM_RC tpm_result;
-    TPM2B_NAME name;
-    TPM2B_NAME qName;
 
-    tpm_result = TPM2_ReadPublic(&tpm_info->tpm_device, request_handle, outPub, &name, &qName);
-    if (tpm_result == TPM_RC_SUCCESS)
-    {
-        tpm_info->tpm_handle = request_handle;
-        result = 0;
-    }
-    else if (tpm_result != TPM_RC_HANDLE)
+    // A key created here goes into the public cache with a name computed on
+    // the host, so it is not read back from the TPM
+    if ((tpm_info->tpm_handle = TSS_CreatePersistentKey(&tpm_info->tpm_device, request_handle, &NullPwSession, hierarchy, inPub, outPub)) == 0)
     {
-        (void)printf("Failed calling TPM2_ReadPublic 0%x", tpm_result);
+        (void)printf("Failed loading key 0x%x\r\n", request_handle);
         result = __FAILURE__;
     }
     else
     {
-        if (TSS_CreatePrimary(&tpm_info->tpm_device, &NullPwSession, hierarchy, inPub, &tpm_info->tpm_handle, outPub) != TPM_RC_SUCCESS)
-        {
-            (void)printf("Failed calling TSS_CreatePrimary");
-            result = __FAILURE__;
-        }
-        else
-        {
-            if (TPM2_EvictControl(&tpm_info->tpm_device, &NullPwSession, TPM_RH_OWNER, tpm_info->tpm_handle, request_handle) != TPM_RC_SUCCESS)
-            {
-                (void)printf("Failed calling TSS_CreatePrimary");
-                result = __FAILURE__;
-            }
-            else if (TPM2_FlushContext(&tpm_info->tpm_device, tpm_info->tpm_handle) != TPM_RC_SUCCESS)
-            {
-                (void)printf("Failed calling TSS_CreatePrimary");
-                result = __FAILURE__;
-            }
-            else
-            {
-                tpm_info->tpm_handle = request_handle;
-                result = 0;
-            }
-        }
+        result = 0;
     }
     return result;
 }
@@ -137,19 +121,39 @@ static bool initialize_tpm(TPM_SAMPLE_INFO* tpm_info)
         (void)printf("Failure initializing TPM codec\r\n");
         result = false;
     }
-    else if (load_key(tpm_info, TPM_20_EK_HANDLE, TPM_RH_ENDORSEMENT, GetEkTemplate(), &tpm_info->ek_pub) != 0)
+    else if (tpm_info->use_public_cache &&
+        tpm_public_cache_load(&tpm_info->tpm_device, &tpm_info->public_cache, PUBLIC_CACHE_FILE) != 0)
     {
-        (void)printf("Failure loading endorsement key\r\n");
-        result = false;
-    }
-    else if (load_key(tpm_info, TPM_20_SRK_HANDLE, TPM_RH_OWNER, GetSrkTemplate(), &tpm_info->srk_pub) != 0)
-    {
-        (void)printf("Failure loading endorsement key\r\n");
+        (void)printf("Failure loading public cache\r\n");
         result = false;
     }
     else
     {
-        result = true;
+        if (tpm_info->use_public_cache)
+        {
+            TSS_SetPublicCache(&tpm_info->tpm_device, &tpm_info->public_cache);
+        }
+
+        if (load_key(tpm_info, TPM_20_EK_HANDLE, TPM_RH_ENDORSEMENT, GetEkTemplate(), &tpm_info->ek_pub) != 0)
+        {
+            (void)printf("Failure loading endorsement key\r\n");
+            result = false;
+        }
+        else if (load_key(tpm_info, TPM_20_SRK_HANDLE, TPM_RH_OWNER, GetSrkTemplate(), &tpm_info->srk_pub) != 0)
+        {
+            (void)printf("Failure loading endorsement key\r\n");
+            result = false;
+        }
+        else
+        {
+            // Next runs read both keys from the file rather than the TPM
+            if (tpm_info->use_public_cache &&
+                tpm_public_cache_save(&tpm_info->public_cache, PUBLIC_CACHE_FILE) != 0)
+            {
+                (void)printf("Failure saving public cache\r\n");
+            }
+            result = true;
+        }
     }
 
     return result;
@@ -189,14 +193,50 @@ static void write_sign_data(TPM_SAMPLE_INFO* tpm_info, const char* data)
     }
 }
 
-static void retrieve_random_bytes()
+static void retrieve_random_bytes(TSS_DEVICE* tpm_device)
 {
     BYTE random_bytes[32];
-    TSS_RandomBytes(random_bytes, 32);
-    print_bytes("Random bytes: ", random_bytes, 32);
+    if (TSS_GetRandomBytes(tpm_device, random_bytes, 32) != TPM_RC_SUCCESS)
+    {
+        (void)printf("Failure getting random bytes\r\n");
+    }
+    else
+    {
+        print_bytes("Random bytes: ", random_bytes, 32);
+    }
+}
+
+// Arguments: [endpoint [transcript]]. The commands are sent to the TPM at
+// 'endpoint', and recorded to the file 'transcript' if given. A library built
+// with use_replay_transport plays such a recording back with the endpoint
+// file:<transcript>.
+static bool parse_arguments(TPM_SAMPLE_INFO* tpm_info, int argc, char* argv[])
+{
+    bool result;
+    TPM_ENDPOINT endpoint;
+
+    tpm_info->tpm_device.comms_endpoint = argc > 1 ? argv[1] : NULL;
+    if (tpm_endpoint_parse(tpm_info->tpm_device.comms_endpoint, &endpoint) != 0)
+    {
+        (void)printf("Invalid endpoint %s\r\n", argv[1]);
+        result = false;
+    }
+    else if (argc > 2 && (tpm_info->transcript = tpm_transcript_create(argv[2])) == NULL)
+    {
+        (void)printf("Failure creating transcript %s\r\n", argv[2]);
+        result = false;
+    }
+    else
+    {
+        tpm_info->use_public_cache = endpoint.type != TPM_ENDPOINT_FILE && tpm_info->transcript == NULL;
+        // Attached before the codec is initialized to capture TPM2_Startup
+        TSS_SetTranscript(&tpm_info->tpm_device, tpm_info->transcript);
+        result = true;
+    }
+    return result;
 }
 
-int main(void)
+int main(int argc, char* argv[])
 {
     int result;
 
@@ -206,6 +246,10 @@ int main(void)
         (void)printf("platform_init failed\r\n");
         result = __LINE__;
     }
+    else if (!parse_arguments(&tpm_info, argc, argv))
+    {
+        result = __LINE__;
+    }
     else if (initialize_tpm(&tpm_info) )
     { 
         read_key_info(&tpm_info.ek_pub, "Endorsement Key: ");
@@ -213,7 +257,7 @@ int main(void)
 
         write_sign_data(&tpm_info, "Data to be signed by tpm");
 
-        retrieve_random_bytes();
+        retrieve_random_bytes(&tpm_info.tpm_device);
 
         Deinit_TPM_Codec(&tpm_info.tpm_device);
 
@@ -224,6 +268,7 @@ int main(void)
         result = __LINE__;
     }
 
+    tpm_transcript_close(tpm_info.transcript);
     platform_deinit();
 
     (void)getchar();
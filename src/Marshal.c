@@ -1436,6 +1436,7 @@ TPMT_HA_Marshal(TPMT_HA *source, BYTE **buffer, INT32 *size)
 
 
 // Table 2:73 - Definition of TPM2B_DIGEST Structure (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPM2B_DIGEST_Unmarshal(TPM2B_DIGEST *target, BYTE **buffer, INT32 *size)
 {
@@ -1460,9 +1461,11 @@ TPM2B_DIGEST_Marshal(TPM2B_DIGEST *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + BYTE_Array_Marshal((BYTE *)(source->t.buffer), buffer, size, (INT32)(source->t.size)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:74 - Definition of TPM2B_DATA Structure (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPM2B_DATA_Unmarshal(TPM2B_DATA *target, BYTE **buffer, INT32 *size)
 {
@@ -1487,6 +1490,7 @@ TPM2B_DATA_Marshal(TPM2B_DATA *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + BYTE_Array_Marshal((BYTE *)(source->t.buffer), buffer, size, (INT32)(source->t.size)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:75 - Definition of Types for TPM2B_NONCE (TypesTable)
@@ -1508,6 +1512,7 @@ TPM2B_DATA_Marshal(TPM2B_DATA *source, BYTE **buffer, INT32 *size)
 
 
 // Table 2:78 - Definition of TPM2B_EVENT Structure (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPM2B_EVENT_Unmarshal(TPM2B_EVENT *target, BYTE **buffer, INT32 *size)
 {
@@ -1532,9 +1537,11 @@ TPM2B_EVENT_Marshal(TPM2B_EVENT *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + BYTE_Array_Marshal((BYTE *)(source->t.buffer), buffer, size, (INT32)(source->t.size)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:79 - Definition of TPM2B_MAX_BUFFER Structure (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPM2B_MAX_BUFFER_Unmarshal(TPM2B_MAX_BUFFER *target, BYTE **buffer, INT32 *size)
 {
@@ -1559,9 +1566,11 @@ TPM2B_MAX_BUFFER_Marshal(TPM2B_MAX_BUFFER *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + BYTE_Array_Marshal((BYTE *)(source->t.buffer), buffer, size, (INT32)(source->t.size)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:80 - Definition of TPM2B_MAX_NV_BUFFER Structure (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPM2B_MAX_NV_BUFFER_Unmarshal(TPM2B_MAX_NV_BUFFER *target, BYTE **buffer, INT32 *size)
 {
@@ -1586,6 +1595,7 @@ TPM2B_MAX_NV_BUFFER_Marshal(TPM2B_MAX_NV_BUFFER *source, BYTE **buffer, INT32 *s
     result = (UINT16)(result + BYTE_Array_Marshal((BYTE *)(source->t.buffer), buffer, size, (INT32)(source->t.size)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:81 - Definition of Types for TPM2B_TIMEOUT (TypesTable)
@@ -1595,6 +1605,7 @@ TPM2B_MAX_NV_BUFFER_Marshal(TPM2B_MAX_NV_BUFFER *source, BYTE **buffer, INT32 *s
 
 
 // Table 2:82 - Definition of TPM2B_IV Structure  (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPM2B_IV_Unmarshal(TPM2B_IV *target, BYTE **buffer, INT32 *size)
 {
@@ -1619,12 +1630,14 @@ TPM2B_IV_Marshal(TPM2B_IV *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + BYTE_Array_Marshal((BYTE *)(source->t.buffer), buffer, size, (INT32)(source->t.size)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:83 - Definition of TPMU_NAME Union  (UnionTable)
 
 
 // Table 2:84 - Definition of TPM2B_NAME Structure (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPM2B_NAME_Unmarshal(TPM2B_NAME *target, BYTE **buffer, INT32 *size)
 {
@@ -1649,6 +1662,7 @@ TPM2B_NAME_Marshal(TPM2B_NAME *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + BYTE_Array_Marshal((BYTE *)(source->t.name), buffer, size, (INT32)(source->t.size)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:85 - Definition of TPMS_PCR_SELECT Structure (StructureTable)
@@ -1708,6 +1722,7 @@ TPMS_PCR_SELECTION_Marshal(TPMS_PCR_SELECTION *source, BYTE **buffer, INT32 *siz
 
 
 // Table 2:89 - Definition of TPMT_TK_CREATION Structure (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPMT_TK_CREATION_Unmarshal(TPMT_TK_CREATION *target, BYTE **buffer, INT32 *size)
 {
@@ -1733,9 +1748,11 @@ TPMT_TK_CREATION_Marshal(TPMT_TK_CREATION *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + TPM2B_DIGEST_Marshal((TPM2B_DIGEST *)&(source->digest), buffer, size));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:90 - Definition of TPMT_TK_VERIFIED Structure (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPMT_TK_VERIFIED_Unmarshal(TPMT_TK_VERIFIED *target, BYTE **buffer, INT32 *size)
 {
@@ -1761,9 +1778,11 @@ TPMT_TK_VERIFIED_Marshal(TPMT_TK_VERIFIED *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + TPM2B_DIGEST_Marshal((TPM2B_DIGEST *)&(source->digest), buffer, size));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:91 - Definition of TPMT_TK_AUTH Structure (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPMT_TK_AUTH_Unmarshal(TPMT_TK_AUTH *target, BYTE **buffer, INT32 *size)
 {
@@ -1790,9 +1809,11 @@ TPMT_TK_AUTH_Marshal(TPMT_TK_AUTH *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + TPM2B_DIGEST_Marshal((TPM2B_DIGEST *)&(source->digest), buffer, size));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:92 - Definition of TPMT_TK_HASHCHECK Structure (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPMT_TK_HASHCHECK_Unmarshal(TPMT_TK_HASHCHECK *target, BYTE **buffer, INT32 *size)
 {
@@ -1818,9 +1839,11 @@ TPMT_TK_HASHCHECK_Marshal(TPMT_TK_HASHCHECK *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + TPM2B_DIGEST_Marshal((TPM2B_DIGEST *)&(source->digest), buffer, size));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:93 - Definition of TPMS_ALG_PROPERTY Structure  (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPMS_ALG_PROPERTY_Unmarshal(TPMS_ALG_PROPERTY *target, BYTE **buffer, INT32 *size)
 {
@@ -1840,9 +1863,11 @@ TPMS_ALG_PROPERTY_Marshal(TPMS_ALG_PROPERTY *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + TPMA_ALGORITHM_Marshal((TPMA_ALGORITHM *)&(source->algProperties), buffer, size));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:94 - Definition of TPMS_TAGGED_PROPERTY Structure  (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPMS_TAGGED_PROPERTY_Unmarshal(TPMS_TAGGED_PROPERTY *target, BYTE **buffer, INT32 *size)
 {
@@ -1862,6 +1887,7 @@ TPMS_TAGGED_PROPERTY_Marshal(TPMS_TAGGED_PROPERTY *source, BYTE **buffer, INT32
     result = (UINT16)(result + UINT32_Marshal((UINT32 *)&(source->value), buffer, size));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:95 - Definition of TPMS_TAGGED_PCR_SELECT Structure  (StructureTable)
@@ -1917,6 +1943,7 @@ TPMS_TAGGED_POLICY_Marshal(TPMS_TAGGED_POLICY *source, BYTE **buffer, INT32 *siz
 
 
 // Table 2:97 - Definition of TPML_CC Structure (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPML_CC_Unmarshal(TPML_CC *target, BYTE **buffer, INT32 *size)
 {
@@ -1938,6 +1965,7 @@ TPML_CC_Marshal(TPML_CC *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + TPM_CC_Array_Marshal((TPM_CC *)(source->commandCodes), buffer, size, (INT32)(source->count)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:98 - Definition of TPML_CCA Structure  (StructureTable)
@@ -1965,6 +1993,7 @@ TPML_CCA_Marshal(TPML_CCA *source, BYTE **buffer, INT32 *size)
 
 
 // Table 2:99 - Definition of TPML_ALG Structure (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPML_ALG_Unmarshal(TPML_ALG *target, BYTE **buffer, INT32 *size)
 {
@@ -1986,9 +2015,11 @@ TPML_ALG_Marshal(TPML_ALG *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + TPM_ALG_ID_Array_Marshal((TPM_ALG_ID *)(source->algorithms), buffer, size, (INT32)(source->count)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:100 - Definition of TPML_HANDLE Structure  (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPML_HANDLE_Unmarshal(TPML_HANDLE *target, BYTE **buffer, INT32 *size)
 {
@@ -2010,6 +2041,7 @@ TPML_HANDLE_Marshal(TPML_HANDLE *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + TPM_HANDLE_Array_Marshal((TPM_HANDLE *)(source->handle), buffer, size, (INT32)(source->count)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:101 - Definition of TPML_DIGEST Structure (StructureTable)
@@ -2087,6 +2119,7 @@ TPML_PCR_SELECTION_Marshal(TPML_PCR_SELECTION *source, BYTE **buffer, INT32 *siz
 
 
 // Table 2:104 - Definition of TPML_ALG_PROPERTY Structure  (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPML_ALG_PROPERTY_Unmarshal(TPML_ALG_PROPERTY *target, BYTE **buffer, INT32 *size)
 {
@@ -2108,9 +2141,11 @@ TPML_ALG_PROPERTY_Marshal(TPML_ALG_PROPERTY *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + TPMS_ALG_PROPERTY_Array_Marshal((TPMS_ALG_PROPERTY *)(source->algProperties), buffer, size, (INT32)(source->count)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:105 - Definition of TPML_TAGGED_TPM_PROPERTY Structure  (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPML_TAGGED_TPM_PROPERTY_Unmarshal(TPML_TAGGED_TPM_PROPERTY *target, BYTE **buffer, INT32 *size)
 {
@@ -2132,6 +2167,7 @@ TPML_TAGGED_TPM_PROPERTY_Marshal(TPML_TAGGED_TPM_PROPERTY *source, BYTE **buffer
     result = (UINT16)(result + TPMS_TAGGED_PROPERTY_Array_Marshal((TPMS_TAGGED_PROPERTY *)(source->tpmProperty), buffer, size, (INT32)(source->count)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:106 - Definition of TPML_TAGGED_PCR_PROPERTY Structure  (StructureTable)
@@ -2294,6 +2330,7 @@ TPMS_CAPABILITY_DATA_Marshal(TPMS_CAPABILITY_DATA *source, BYTE **buffer, INT32
 
 
 // Table 2:111 - Definition of TPMS_CLOCK_INFO Structure (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPMS_CLOCK_INFO_Unmarshal(TPMS_CLOCK_INFO *target, BYTE **buffer, INT32 *size)
 {
@@ -2321,9 +2358,11 @@ TPMS_CLOCK_INFO_Marshal(TPMS_CLOCK_INFO *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + TPMI_YES_NO_Marshal((TPMI_YES_NO *)&(source->safe), buffer, size));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:112 - Definition of TPMS_TIME_INFO Structure (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPMS_TIME_INFO_Unmarshal(TPMS_TIME_INFO *target, BYTE **buffer, INT32 *size)
 {
@@ -2343,6 +2382,7 @@ TPMS_TIME_INFO_Marshal(TPMS_TIME_INFO *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + TPMS_CLOCK_INFO_Marshal((TPMS_CLOCK_INFO *)&(source->clockInfo), buffer, size));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:113 - Definition of TPMS_TIME_ATTEST_INFO Structure  (StructureTable)
@@ -2605,6 +2645,7 @@ TPMS_ATTEST_Marshal(TPMS_ATTEST *source, BYTE **buffer, INT32 *size)
 
 
 // Table 2:123 - Definition of TPM2B_ATTEST Structure  (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPM2B_ATTEST_Unmarshal(TPM2B_ATTEST *target, BYTE **buffer, INT32 *size)
 {
@@ -2629,6 +2670,7 @@ TPM2B_ATTEST_Marshal(TPM2B_ATTEST *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + BYTE_Array_Marshal((BYTE *)(source->t.attestationData), buffer, size, (INT32)(source->t.size)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:124 - Definition of TPMS_AUTH_COMMAND Structure  (StructureTable)
@@ -2954,6 +2996,7 @@ TPMT_SYM_DEF_OBJECT_Marshal(TPMT_SYM_DEF_OBJECT *source, BYTE **buffer, INT32 *s
 
 
 // Table 2:132 - Definition of TPM2B_SYM_KEY Structure (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPM2B_SYM_KEY_Unmarshal(TPM2B_SYM_KEY *target, BYTE **buffer, INT32 *size)
 {
@@ -2978,6 +3021,7 @@ TPM2B_SYM_KEY_Marshal(TPM2B_SYM_KEY *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + BYTE_Array_Marshal((BYTE *)(source->t.buffer), buffer, size, (INT32)(source->t.size)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:133 - Definition of TPMS_SYMCIPHER_PARMS Structure (StructureTable)
@@ -2986,6 +3030,7 @@ TPM2B_SYM_KEY_Marshal(TPM2B_SYM_KEY *source, BYTE **buffer, INT32 *size)
 
 
 // Table 2:134 - Definition of TPM2B_LABEL Structure (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPM2B_LABEL_Unmarshal(TPM2B_LABEL *target, BYTE **buffer, INT32 *size)
 {
@@ -3010,6 +3055,7 @@ TPM2B_LABEL_Marshal(TPM2B_LABEL *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + BYTE_Array_Marshal((BYTE *)(source->t.buffer), buffer, size, (INT32)(source->t.size)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:135 - Definition of TPMS_DERIVE Structure (StructureTable)
@@ -3035,6 +3081,7 @@ TPMS_DERIVE_Marshal(TPMS_DERIVE *source, BYTE **buffer, INT32 *size)
 
 
 // Table 2:136 - Definition of TPM2B_DERIVE Structure (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPM2B_DERIVE_Unmarshal(TPM2B_DERIVE *target, BYTE **buffer, INT32 *size)
 {
@@ -3059,12 +3106,14 @@ TPM2B_DERIVE_Marshal(TPM2B_DERIVE *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + BYTE_Array_Marshal((BYTE *)(source->t.buffer), buffer, size, (INT32)(source->t.size)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:137 - Definition of TPMU_SENSITIVE_CREATE Union  (UnionTable)
 
 
 // Table 2:138 - Definition of TPM2B_SENSITIVE_DATA Structure (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPM2B_SENSITIVE_DATA_Unmarshal(TPM2B_SENSITIVE_DATA *target, BYTE **buffer, INT32 *size)
 {
@@ -3089,6 +3138,7 @@ TPM2B_SENSITIVE_DATA_Marshal(TPM2B_SENSITIVE_DATA *source, BYTE **buffer, INT32
     result = (UINT16)(result + BYTE_Array_Marshal((BYTE *)(source->t.buffer), buffer, size, (INT32)(source->t.size)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:139 - Definition of TPMS_SENSITIVE_CREATE Structure  (StructureTable)
@@ -3853,6 +3903,7 @@ TPMT_RSA_DECRYPT_Marshal(TPMT_RSA_DECRYPT *source, BYTE **buffer, INT32 *size)
 
 // Table 2:164 - Definition of TPM2B_PUBLIC_KEY_RSA Structure (StructureTable)
 #if         ALG_RSA
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPM2B_PUBLIC_KEY_RSA_Unmarshal(TPM2B_PUBLIC_KEY_RSA *target, BYTE **buffer, INT32 *size)
 {
@@ -3877,6 +3928,7 @@ TPM2B_PUBLIC_KEY_RSA_Marshal(TPM2B_PUBLIC_KEY_RSA *source, BYTE **buffer, INT32
     result = (UINT16)(result + BYTE_Array_Marshal((BYTE *)(source->t.buffer), buffer, size, (INT32)(source->t.size)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 #endif // ALG_RSA
 
@@ -3906,6 +3958,7 @@ TPMI_RSA_KEY_BITS_Unmarshal(TPMI_RSA_KEY_BITS *target, BYTE **buffer, INT32 *siz
 
 // Table 2:166 - Definition of TPM2B_PRIVATE_KEY_RSA Structure (StructureTable)
 #if         ALG_RSA
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPM2B_PRIVATE_KEY_RSA_Unmarshal(TPM2B_PRIVATE_KEY_RSA *target, BYTE **buffer, INT32 *size)
 {
@@ -3930,11 +3983,13 @@ TPM2B_PRIVATE_KEY_RSA_Marshal(TPM2B_PRIVATE_KEY_RSA *source, BYTE **buffer, INT3
     result = (UINT16)(result + BYTE_Array_Marshal((BYTE *)(source->t.buffer), buffer, size, (INT32)(source->t.size)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 #endif // ALG_RSA
 
 
 // Table 2:167 - Definition of TPM2B_ECC_PARAMETER Structure (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPM2B_ECC_PARAMETER_Unmarshal(TPM2B_ECC_PARAMETER *target, BYTE **buffer, INT32 *size)
 {
@@ -3959,6 +4014,7 @@ TPM2B_ECC_PARAMETER_Marshal(TPM2B_ECC_PARAMETER *source, BYTE **buffer, INT32 *s
     result = (UINT16)(result + BYTE_Array_Marshal((BYTE *)(source->t.buffer), buffer, size, (INT32)(source->t.size)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:168 - Definition of TPMS_ECC_POINT Structure (StructureTable)
@@ -4443,6 +4499,7 @@ TPMU_ENCRYPTED_SECRET_Marshal(TPMU_ENCRYPTED_SECRET *source, BYTE **buffer, INT3
 
 
 // Table 2:181 - Definition of TPM2B_ENCRYPTED_SECRET Structure (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPM2B_ENCRYPTED_SECRET_Unmarshal(TPM2B_ENCRYPTED_SECRET *target, BYTE **buffer, INT32 *size)
 {
@@ -4467,6 +4524,7 @@ TPM2B_ENCRYPTED_SECRET_Marshal(TPM2B_ENCRYPTED_SECRET *source, BYTE **buffer, IN
     result = (UINT16)(result + BYTE_Array_Marshal((BYTE *)(source->t.secret), buffer, size, (INT32)(source->t.size)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:182 - Definition of TPMI_ALG_PUBLIC Type (TypeTable)
@@ -4789,6 +4847,7 @@ TPM2B_PUBLIC_Marshal(TPM2B_PUBLIC *source, BYTE **buffer, INT32 *size)
 
 
 // Table 2:192 - Definition of TPM2B_TEMPLATE Structure (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPM2B_TEMPLATE_Unmarshal(TPM2B_TEMPLATE *target, BYTE **buffer, INT32 *size)
 {
@@ -4813,9 +4872,11 @@ TPM2B_TEMPLATE_Marshal(TPM2B_TEMPLATE *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + BYTE_Array_Marshal((BYTE *)(source->t.buffer), buffer, size, (INT32)(source->t.size)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:193 - Definition of TPM2B_PRIVATE_VENDOR_SPECIFIC Structure (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPM2B_PRIVATE_VENDOR_SPECIFIC_Unmarshal(TPM2B_PRIVATE_VENDOR_SPECIFIC *target, BYTE **buffer, INT32 *size)
 {
@@ -4840,6 +4901,7 @@ TPM2B_PRIVATE_VENDOR_SPECIFIC_Marshal(TPM2B_PRIVATE_VENDOR_SPECIFIC *source, BYT
     result = (UINT16)(result + BYTE_Array_Marshal((BYTE *)(source->t.buffer), buffer, size, (INT32)(source->t.size)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:194 - Definition of TPMU_SENSITIVE_COMPOSITE Union  (UnionTable)
@@ -4984,6 +5046,7 @@ _PRIVATE_Marshal(_PRIVATE *source, BYTE **buffer, INT32 *size)
 
 
 // Table 2:198 - Definition of TPM2B_PRIVATE Structure  (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPM2B_PRIVATE_Unmarshal(TPM2B_PRIVATE *target, BYTE **buffer, INT32 *size)
 {
@@ -5008,6 +5071,7 @@ TPM2B_PRIVATE_Marshal(TPM2B_PRIVATE *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + BYTE_Array_Marshal((BYTE *)(source->t.buffer), buffer, size, (INT32)(source->t.size)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:199 - Definition of TPMS_ID_OBJECT Structure  (StructureTable)
@@ -5033,6 +5097,7 @@ TPMS_ID_OBJECT_Marshal(TPMS_ID_OBJECT *source, BYTE **buffer, INT32 *size)
 
 
 // Table 2:200 - Definition of TPM2B_ID_OBJECT Structure  (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPM2B_ID_OBJECT_Unmarshal(TPM2B_ID_OBJECT *target, BYTE **buffer, INT32 *size)
 {
@@ -5057,6 +5122,7 @@ TPM2B_ID_OBJECT_Marshal(TPM2B_ID_OBJECT *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + BYTE_Array_Marshal((BYTE *)(source->t.credential), buffer, size, (INT32)(source->t.size)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:201 - Definition of TPM_NV_INDEX Bits  (BitsTable)
@@ -5176,6 +5242,7 @@ TPM2B_NV_PUBLIC_Marshal(TPM2B_NV_PUBLIC *source, BYTE **buffer, INT32 *size)
 
 
 // Table 2:207 - Definition of TPM2B_CONTEXT_SENSITIVE Structure  (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPM2B_CONTEXT_SENSITIVE_Unmarshal(TPM2B_CONTEXT_SENSITIVE *target, BYTE **buffer, INT32 *size)
 {
@@ -5200,6 +5267,7 @@ TPM2B_CONTEXT_SENSITIVE_Marshal(TPM2B_CONTEXT_SENSITIVE *source, BYTE **buffer,
     result = (UINT16)(result + BYTE_Array_Marshal((BYTE *)(source->t.buffer), buffer, size, (INT32)(source->t.size)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:208 - Definition of TPMS_CONTEXT_DATA Structure  (StructureTable)
@@ -5225,6 +5293,7 @@ TPMS_CONTEXT_DATA_Marshal(TPMS_CONTEXT_DATA *source, BYTE **buffer, INT32 *size)
 
 
 // Table 2:209 - Definition of TPM2B_CONTEXT_DATA Structure  (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPM2B_CONTEXT_DATA_Unmarshal(TPM2B_CONTEXT_DATA *target, BYTE **buffer, INT32 *size)
 {
@@ -5249,9 +5318,11 @@ TPM2B_CONTEXT_DATA_Marshal(TPM2B_CONTEXT_DATA *source, BYTE **buffer, INT32 *siz
     result = (UINT16)(result + BYTE_Array_Marshal((BYTE *)(source->t.buffer), buffer, size, (INT32)(source->t.size)));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:210 - Definition of TPMS_CONTEXT Structure (StructureTable)
+#ifndef TABLE_DRIVEN_MARSHAL
 TPM_RC
 TPMS_CONTEXT_Unmarshal(TPMS_CONTEXT *target, BYTE **buffer, INT32 *size)
 {
@@ -5279,6 +5350,7 @@ TPMS_CONTEXT_Marshal(TPMS_CONTEXT *source, BYTE **buffer, INT32 *size)
     result = (UINT16)(result + TPM2B_CONTEXT_DATA_Marshal((TPM2B_CONTEXT_DATA *)&(source->contextBlob), buffer, size));
     return result;
 }
+#endif // TABLE_DRIVEN_MARSHAL
 
 
 // Table 2:212 - Definition of TPMS_CREATION_DATA Structure  (StructureTable)
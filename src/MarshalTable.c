@@ -0,0 +1,545 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stddef.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "azure_utpm_c/Tpm.h"
+
+#include "azure_utpm_c/Marshal_fp.h"
+#include "azure_utpm_c/MarshalTable_fp.h"
+#include "azure_utpm_c/Memory_fp.h"
+
+#define TSS_MD(type) \
+    { type##_Fields, (UINT16)(sizeof(type##_Fields) / sizeof(type##_Fields[0])), (UINT16)sizeof(type) }
+
+#define TSS_MEMBER_SIZE(type, member)   (BYTE)sizeof(((type *)0)->member)
+
+#define TSS_MF_INT_FIELD(type, member, checkFn) \
+    { TSS_MF_INT, TSS_MEMBER_SIZE(type, member), (UINT16)offsetof(type, member), TPM_RC_SUCCESS, 0, NULL, checkFn }
+#define TSS_MF_TAG_FIELD(type, member, tags) \
+    { TSS_MF_TAG, TSS_MEMBER_SIZE(type, member), (UINT16)offsetof(type, member), TPM_RC_TAG, tags, NULL, NULL }
+#define TSS_MF_COUNT_FIELD(type, member, max, rc) \
+    { TSS_MF_COUNT, TSS_MEMBER_SIZE(type, member), (UINT16)offsetof(type, member), rc, max, NULL, NULL }
+// Integer elements are described by their width, structures by their descriptor
+#define TSS_MF_ARRAY_FIELD(type, member, elementDesc) \
+    { TSS_MF_ARRAY, TSS_MEMBER_SIZE(type, member[0]), (UINT16)offsetof(type, member), TPM_RC_SUCCESS, 0, elementDesc, NULL }
+#define TSS_MF_STRUCT_FIELD(type, member, memberDesc) \
+    { TSS_MF_STRUCT, 0, (UINT16)offsetof(type, member), TPM_RC_SUCCESS, 0, &memberDesc, NULL }
+
+// A TPM2B is a single field; 'width' is the distance from the size to the data
+#define TSS_TPM2B_DESC(type, data, max) \
+    static const TSS_MARSHAL_FIELD type##_Fields[] = \
+    { \
+        { TSS_MF_2B, (BYTE)(offsetof(type, t.data) - offsetof(type, t.size)), (UINT16)offsetof(type, t.size), TPM_RC_SIZE, (UINT32)(max), NULL, NULL } \
+    }; \
+    const TSS_MARSHAL_DESC TSS_MD_##type = TSS_MD(type)
+
+// Members whose values are restricted are unmarshaled with the generated code
+static TPM_RC check_TPMA_ALGORITHM(void* target, BYTE** buffer, INT32* size)
+{
+    return TPMA_ALGORITHM_Unmarshal((TPMA_ALGORITHM*)target, buffer, size);
+}
+
+static TPM_RC check_TPMI_YES_NO(void* target, BYTE** buffer, INT32* size)
+{
+    return TPMI_YES_NO_Unmarshal((TPMI_YES_NO*)target, buffer, size);
+}
+
+static TPM_RC check_TPMI_DH_CONTEXT(void* target, BYTE** buffer, INT32* size)
+{
+    return TPMI_DH_CONTEXT_Unmarshal((TPMI_DH_CONTEXT*)target, buffer, size);
+}
+
+static TPM_RC check_TPMI_RH_HIERARCHY_NULL(void* target, BYTE** buffer, INT32* size)
+{
+    return TPMI_RH_HIERARCHY_Unmarshal((TPMI_RH_HIERARCHY*)target, buffer, size, 1);
+}
+
+TSS_TPM2B_DESC(TPM2B_DIGEST, buffer, sizeof(TPMU_HA));
+TSS_TPM2B_DESC(TPM2B_DATA, buffer, sizeof(TPMT_HA));
+TSS_TPM2B_DESC(TPM2B_EVENT, buffer, 1024);
+TSS_TPM2B_DESC(TPM2B_MAX_BUFFER, buffer, MAX_DIGEST_BUFFER);
+TSS_TPM2B_DESC(TPM2B_MAX_NV_BUFFER, buffer, MAX_NV_BUFFER_SIZE);
+TSS_TPM2B_DESC(TPM2B_IV, buffer, MAX_SYM_BLOCK_SIZE);
+TSS_TPM2B_DESC(TPM2B_NAME, name, sizeof(TPMU_NAME));
+TSS_TPM2B_DESC(TPM2B_ATTEST, attestationData, sizeof(TPMS_ATTEST));
+TSS_TPM2B_DESC(TPM2B_SYM_KEY, buffer, MAX_SYM_KEY_BYTES);
+TSS_TPM2B_DESC(TPM2B_LABEL, buffer, LABEL_MAX_BUFFER);
+TSS_TPM2B_DESC(TPM2B_DERIVE, buffer, sizeof(TPMS_DERIVE));
+TSS_TPM2B_DESC(TPM2B_SENSITIVE_DATA, buffer, sizeof(TPMU_SENSITIVE_CREATE));
+#if ALG_RSA
+TSS_TPM2B_DESC(TPM2B_PUBLIC_KEY_RSA, buffer, MAX_RSA_KEY_BYTES);
+TSS_TPM2B_DESC(TPM2B_PRIVATE_KEY_RSA, buffer, MAX_RSA_KEY_BYTES/2);
+#endif // ALG_RSA
+TSS_TPM2B_DESC(TPM2B_ECC_PARAMETER, buffer, MAX_ECC_KEY_BYTES);
+TSS_TPM2B_DESC(TPM2B_ENCRYPTED_SECRET, secret, sizeof(TPMU_ENCRYPTED_SECRET));
+TSS_TPM2B_DESC(TPM2B_TEMPLATE, buffer, sizeof(TPMT_PUBLIC));
+TSS_TPM2B_DESC(TPM2B_PRIVATE_VENDOR_SPECIFIC, buffer, PRIVATE_VENDOR_SPECIFIC_BYTES);
+TSS_TPM2B_DESC(TPM2B_PRIVATE, buffer, sizeof(_PRIVATE));
+TSS_TPM2B_DESC(TPM2B_ID_OBJECT, credential, sizeof(TPMS_ID_OBJECT));
+TSS_TPM2B_DESC(TPM2B_CONTEXT_SENSITIVE, buffer, MAX_CONTEXT_SIZE);
+TSS_TPM2B_DESC(TPM2B_CONTEXT_DATA, buffer, sizeof(TPMS_CONTEXT_DATA));
+
+static const TSS_MARSHAL_FIELD TPMT_TK_CREATION_Fields[] =
+{
+    TSS_MF_TAG_FIELD(TPMT_TK_CREATION, tag, TSS_MF_TAGS(TPM_ST_CREATION, 0)),
+    TSS_MF_INT_FIELD(TPMT_TK_CREATION, hierarchy, check_TPMI_RH_HIERARCHY_NULL),
+    TSS_MF_STRUCT_FIELD(TPMT_TK_CREATION, digest, TSS_MD_TPM2B_DIGEST)
+};
+const TSS_MARSHAL_DESC TSS_MD_TPMT_TK_CREATION = TSS_MD(TPMT_TK_CREATION);
+
+static const TSS_MARSHAL_FIELD TPMT_TK_VERIFIED_Fields[] =
+{
+    TSS_MF_TAG_FIELD(TPMT_TK_VERIFIED, tag, TSS_MF_TAGS(TPM_ST_VERIFIED, 0)),
+    TSS_MF_INT_FIELD(TPMT_TK_VERIFIED, hierarchy, check_TPMI_RH_HIERARCHY_NULL),
+    TSS_MF_STRUCT_FIELD(TPMT_TK_VERIFIED, digest, TSS_MD_TPM2B_DIGEST)
+};
+const TSS_MARSHAL_DESC TSS_MD_TPMT_TK_VERIFIED = TSS_MD(TPMT_TK_VERIFIED);
+
+static const TSS_MARSHAL_FIELD TPMT_TK_AUTH_Fields[] =
+{
+    TSS_MF_TAG_FIELD(TPMT_TK_AUTH, tag, TSS_MF_TAGS(TPM_ST_AUTH_SIGNED, TPM_ST_AUTH_SECRET)),
+    TSS_MF_INT_FIELD(TPMT_TK_AUTH, hierarchy, check_TPMI_RH_HIERARCHY_NULL),
+    TSS_MF_STRUCT_FIELD(TPMT_TK_AUTH, digest, TSS_MD_TPM2B_DIGEST)
+};
+const TSS_MARSHAL_DESC TSS_MD_TPMT_TK_AUTH = TSS_MD(TPMT_TK_AUTH);
+
+static const TSS_MARSHAL_FIELD TPMT_TK_HASHCHECK_Fields[] =
+{
+    TSS_MF_TAG_FIELD(TPMT_TK_HASHCHECK, tag, TSS_MF_TAGS(TPM_ST_HASHCHECK, 0)),
+    TSS_MF_INT_FIELD(TPMT_TK_HASHCHECK, hierarchy, check_TPMI_RH_HIERARCHY_NULL),
+    TSS_MF_STRUCT_FIELD(TPMT_TK_HASHCHECK, digest, TSS_MD_TPM2B_DIGEST)
+};
+const TSS_MARSHAL_DESC TSS_MD_TPMT_TK_HASHCHECK = TSS_MD(TPMT_TK_HASHCHECK);
+
+static const TSS_MARSHAL_FIELD TPMS_ALG_PROPERTY_Fields[] =
+{
+    TSS_MF_INT_FIELD(TPMS_ALG_PROPERTY, alg, NULL),
+    TSS_MF_INT_FIELD(TPMS_ALG_PROPERTY, algProperties, check_TPMA_ALGORITHM)
+};
+const TSS_MARSHAL_DESC TSS_MD_TPMS_ALG_PROPERTY = TSS_MD(TPMS_ALG_PROPERTY);
+
+static const TSS_MARSHAL_FIELD TPMS_TAGGED_PROPERTY_Fields[] =
+{
+    TSS_MF_INT_FIELD(TPMS_TAGGED_PROPERTY, property, NULL),
+    TSS_MF_INT_FIELD(TPMS_TAGGED_PROPERTY, value, NULL)
+};
+const TSS_MARSHAL_DESC TSS_MD_TPMS_TAGGED_PROPERTY = TSS_MD(TPMS_TAGGED_PROPERTY);
+
+static const TSS_MARSHAL_FIELD TPML_CC_Fields[] =
+{
+    TSS_MF_COUNT_FIELD(TPML_CC, count, MAX_CAP_CC, TPM_RC_SIZE),
+    TSS_MF_ARRAY_FIELD(TPML_CC, commandCodes, NULL)
+};
+const TSS_MARSHAL_DESC TSS_MD_TPML_CC = TSS_MD(TPML_CC);
+
+static const TSS_MARSHAL_FIELD TPML_ALG_Fields[] =
+{
+    TSS_MF_COUNT_FIELD(TPML_ALG, count, MAX_ALG_LIST_SIZE, TPM_RC_SIZE),
+    TSS_MF_ARRAY_FIELD(TPML_ALG, algorithms, NULL)
+};
+const TSS_MARSHAL_DESC TSS_MD_TPML_ALG = TSS_MD(TPML_ALG);
+
+static const TSS_MARSHAL_FIELD TPML_HANDLE_Fields[] =
+{
+    TSS_MF_COUNT_FIELD(TPML_HANDLE, count, MAX_CAP_HANDLES, TPM_RC_SIZE),
+    TSS_MF_ARRAY_FIELD(TPML_HANDLE, handle, NULL)
+};
+const TSS_MARSHAL_DESC TSS_MD_TPML_HANDLE = TSS_MD(TPML_HANDLE);
+
+static const TSS_MARSHAL_FIELD TPML_ALG_PROPERTY_Fields[] =
+{
+    TSS_MF_COUNT_FIELD(TPML_ALG_PROPERTY, count, MAX_CAP_ALGS, TPM_RC_VALUE),
+    TSS_MF_ARRAY_FIELD(TPML_ALG_PROPERTY, algProperties, &TSS_MD_TPMS_ALG_PROPERTY)
+};
+const TSS_MARSHAL_DESC TSS_MD_TPML_ALG_PROPERTY = TSS_MD(TPML_ALG_PROPERTY);
+
+static const TSS_MARSHAL_FIELD TPML_TAGGED_TPM_PROPERTY_Fields[] =
+{
+    TSS_MF_COUNT_FIELD(TPML_TAGGED_TPM_PROPERTY, count, MAX_TPM_PROPERTIES, TPM_RC_VALUE),
+    TSS_MF_ARRAY_FIELD(TPML_TAGGED_TPM_PROPERTY, tpmProperty, &TSS_MD_TPMS_TAGGED_PROPERTY)
+};
+const TSS_MARSHAL_DESC TSS_MD_TPML_TAGGED_TPM_PROPERTY = TSS_MD(TPML_TAGGED_TPM_PROPERTY);
+
+static const TSS_MARSHAL_FIELD TPMS_CLOCK_INFO_Fields[] =
+{
+    TSS_MF_INT_FIELD(TPMS_CLOCK_INFO, clock, NULL),
+    TSS_MF_INT_FIELD(TPMS_CLOCK_INFO, resetCount, NULL),
+    TSS_MF_INT_FIELD(TPMS_CLOCK_INFO, restartCount, NULL),
+    TSS_MF_INT_FIELD(TPMS_CLOCK_INFO, safe, check_TPMI_YES_NO)
+};
+const TSS_MARSHAL_DESC TSS_MD_TPMS_CLOCK_INFO = TSS_MD(TPMS_CLOCK_INFO);
+
+static const TSS_MARSHAL_FIELD TPMS_TIME_INFO_Fields[] =
+{
+    TSS_MF_INT_FIELD(TPMS_TIME_INFO, time, NULL),
+    TSS_MF_STRUCT_FIELD(TPMS_TIME_INFO, clockInfo, TSS_MD_TPMS_CLOCK_INFO)
+};
+const TSS_MARSHAL_DESC TSS_MD_TPMS_TIME_INFO = TSS_MD(TPMS_TIME_INFO);
+
+static const TSS_MARSHAL_FIELD TPMS_CONTEXT_Fields[] =
+{
+    TSS_MF_INT_FIELD(TPMS_CONTEXT, sequence, NULL),
+    TSS_MF_INT_FIELD(TPMS_CONTEXT, savedHandle, check_TPMI_DH_CONTEXT),
+    TSS_MF_INT_FIELD(TPMS_CONTEXT, hierarchy, check_TPMI_RH_HIERARCHY_NULL),
+    TSS_MF_STRUCT_FIELD(TPMS_CONTEXT, contextBlob, TSS_MD_TPM2B_CONTEXT_DATA)
+};
+const TSS_MARSHAL_DESC TSS_MD_TPMS_CONTEXT = TSS_MD(TPMS_CONTEXT);
+
+// Members that are copied without a check, so that a run of them needs a single
+// size check. Checked integers are only fixed size when marshaling.
+static BOOL IsFixedSize(const TSS_MARSHAL_FIELD* field, BOOL marshal)
+{
+    return field->kind == TSS_MF_TAG || field->kind == TSS_MF_COUNT ||
+        (field->kind == TSS_MF_INT && (marshal || field->check == NULL));
+}
+
+static void ReadInteger(BYTE* member, BYTE width, const BYTE* buffer)
+{
+    switch (width)
+    {
+        case 1:
+            *member = BYTE_ARRAY_TO_UINT8(buffer);
+            break;
+        case 2:
+            *(UINT16*)member = BYTE_ARRAY_TO_UINT16(buffer);
+            break;
+        case 4:
+            *(UINT32*)member = BYTE_ARRAY_TO_UINT32(buffer);
+            break;
+        default:
+            *(UINT64*)member = BYTE_ARRAY_TO_UINT64(buffer);
+            break;
+    }
+}
+
+static void WriteInteger(BYTE* buffer, BYTE width, const BYTE* member)
+{
+    switch (width)
+    {
+        case 1:
+            UINT8_TO_BYTE_ARRAY(*member, buffer);
+            break;
+        case 2:
+            UINT16_TO_BYTE_ARRAY(*(const UINT16*)member, buffer);
+            break;
+        case 4:
+            UINT32_TO_BYTE_ARRAY(*(const UINT32*)member, buffer);
+            break;
+        default:
+            UINT64_TO_BYTE_ARRAY(*(const UINT64*)member, buffer);
+            break;
+    }
+}
+
+// Follows the generated code: the output is only written when there is room
+// for it, but the size is always accounted for
+static BOOL Reserve(BYTE** buffer, INT32* size, INT32 length)
+{
+    return buffer != NULL && (size == NULL || (*size -= length) >= 0);
+}
+
+// Unmarshals the run of fixed size members starting at *index
+static TPM_RC UnmarshalFixed(const TSS_MARSHAL_DESC* desc, UINT16* index, BYTE* target, BYTE** buffer, INT32* size, UINT32* count)
+{
+    TPM_RC result = TPM_RC_SUCCESS;
+    INT32 length = 0;
+    UINT16 end;
+
+    for (end = *index; end < desc->fieldCount && IsFixedSize(&desc->fields[end], FALSE); end++)
+    {
+        length += desc->fields[end].width;
+    }
+
+    if ((*size -= length) < 0)
+    {
+        result = TPM_RC_INSUFFICIENT;
+    }
+    else
+    {
+        for (; *index < end && result == TPM_RC_SUCCESS; (*index)++)
+        {
+            const TSS_MARSHAL_FIELD* field = &desc->fields[*index];
+            BYTE* member = target + field->offset;
+
+            ReadInteger(member, field->width, *buffer);
+            *buffer += field->width;
+            if (field->kind == TSS_MF_TAG)
+            {
+                UINT16 tag = *(UINT16*)member;
+                if (tag != (UINT16)field->limit && (field->limit >> 16 == 0 || tag != (UINT16)(field->limit >> 16)))
+                {
+                    result = field->error;
+                }
+            }
+            else if (field->kind == TSS_MF_COUNT)
+            {
+                if ((*count = *(UINT32*)member) > field->limit)
+                {
+                    result = field->error;
+                }
+            }
+        }
+    }
+    return result;
+}
+
+static TPM_RC Unmarshal2B(const TSS_MARSHAL_FIELD* field, BYTE* member, BYTE** buffer, INT32* size)
+{
+    TPM_RC result;
+    if ((*size -= (INT32)sizeof(UINT16)) < 0)
+    {
+        result = TPM_RC_INSUFFICIENT;
+    }
+    else
+    {
+        UINT16 length = BYTE_ARRAY_TO_UINT16(*buffer);
+        *buffer += sizeof(UINT16);
+        *(UINT16*)member = length;
+        if (length > field->limit)
+        {
+            result = field->error;
+        }
+        else if (*size < length)
+        {
+            result = TPM_RC_INSUFFICIENT;
+        }
+        else
+        {
+            memcpy(member + field->width, *buffer, length);
+            *buffer += length;
+            *size -= length;
+            result = TPM_RC_SUCCESS;
+        }
+    }
+    return result;
+}
+
+static TPM_RC UnmarshalArray(const TSS_MARSHAL_FIELD* field, BYTE* member, UINT32 count, BYTE** buffer, INT32* size)
+{
+    TPM_RC result = TPM_RC_SUCCESS;
+    UINT32 index;
+    if (field->desc != NULL)
+    {
+        for (index = 0; index < count && result == TPM_RC_SUCCESS; index++)
+        {
+            result = TableUnmarshal(field->desc, member + index * field->desc->size, buffer, size);
+        }
+    }
+    // The count was checked against the capacity of the array, a single size
+    // check covers all of the integers
+    else if ((*size -= (INT32)(count * field->width)) < 0)
+    {
+        result = TPM_RC_INSUFFICIENT;
+    }
+    else
+    {
+        for (index = 0; index < count; index++)
+        {
+            ReadInteger(member + index * field->width, field->width, *buffer);
+            *buffer += field->width;
+        }
+    }
+    return result;
+}
+
+TPM_RC
+TableUnmarshal(const TSS_MARSHAL_DESC* desc, void* target, BYTE** buffer, INT32* size)
+{
+    TPM_RC result;
+    if (desc == NULL || target == NULL || buffer == NULL || size == NULL)
+    {
+        LogError("Invalid parameter desc: %p, target: %p, buffer: %p, size: %p", desc, target, buffer, size);
+        result = TPM_RC_INSUFFICIENT;
+    }
+    else
+    {
+        // Number of elements of the next array
+        UINT32 count = 0;
+        UINT16 index = 0;
+
+        result = TPM_RC_SUCCESS;
+        while (index < desc->fieldCount && result == TPM_RC_SUCCESS)
+        {
+            const TSS_MARSHAL_FIELD* field = &desc->fields[index];
+            BYTE* member = (BYTE*)target + field->offset;
+
+            if (IsFixedSize(field, FALSE))
+            {
+                result = UnmarshalFixed(desc, &index, (BYTE*)target, buffer, size, &count);
+            }
+            else
+            {
+                switch (field->kind)
+                {
+                    case TSS_MF_INT:
+                        result = field->check(member, buffer, size);
+                        break;
+                    case TSS_MF_2B:
+                        result = Unmarshal2B(field, member, buffer, size);
+                        break;
+                    case TSS_MF_ARRAY:
+                        result = UnmarshalArray(field, member, count, buffer, size);
+                        break;
+                    default:
+                        result = TableUnmarshal(field->desc, member, buffer, size);
+                        break;
+                }
+                index++;
+            }
+        }
+    }
+    return result;
+}
+
+UINT16
+TableMarshal(const TSS_MARSHAL_DESC* desc, void* source, BYTE** buffer, INT32* size)
+{
+    UINT16 result = 0;
+    if (desc == NULL || source == NULL)
+    {
+        LogError("Invalid parameter desc: %p, source: %p", desc, source);
+    }
+    else
+    {
+        UINT32 count = 0;
+        UINT16 index = 0;
+        while (index < desc->fieldCount)
+        {
+            const TSS_MARSHAL_FIELD* field = &desc->fields[index];
+
+            if (IsFixedSize(field, TRUE))
+            {
+                INT32 length = 0;
+                UINT16 end;
+                BOOL write;
+
+                for (end = index; end < desc->fieldCount && IsFixedSize(&desc->fields[end], TRUE); end++)
+                {
+                    length += desc->fields[end].width;
+                }
+
+                write = Reserve(buffer, size, length);
+                for (; index < end; index++)
+                {
+                    const BYTE* member = (const BYTE*)source + desc->fields[index].offset;
+                    if (desc->fields[index].kind == TSS_MF_COUNT)
+                    {
+                        count = *(const UINT32*)member;
+                    }
+                    if (write)
+                    {
+                        WriteInteger(*buffer, desc->fields[index].width, member);
+                        *buffer += desc->fields[index].width;
+                    }
+                }
+                result = (UINT16)(result + length);
+            }
+            else
+            {
+                BYTE* member = (BYTE*)source + field->offset;
+                if (field->kind == TSS_MF_2B)
+                {
+                    UINT16 length = *(UINT16*)member;
+                    if (Reserve(buffer, size, sizeof(UINT16)))
+                    {
+                        UINT16_TO_BYTE_ARRAY(length, *buffer);
+                        *buffer += sizeof(UINT16);
+                    }
+                    // An empty buffer ends the structure
+                    if (length != 0 && Reserve(buffer, size, length))
+                    {
+                        memcpy(*buffer, member + field->width, length);
+                        *buffer += length;
+                    }
+                    result = (UINT16)(result + sizeof(UINT16) + length);
+                }
+                else if (field->kind == TSS_MF_ARRAY && field->desc == NULL)
+                {
+                    INT32 length = (INT32)(count * field->width);
+                    if (Reserve(buffer, size, length))
+                    {
+                        UINT32 element;
+                        for (element = 0; element < count; element++)
+                        {
+                            WriteInteger(*buffer, field->width, member + element * field->width);
+                            *buffer += field->width;
+                        }
+                    }
+                    result = (UINT16)(result + length);
+                }
+                else if (field->kind == TSS_MF_ARRAY)
+                {
+                    UINT32 element;
+                    for (element = 0; element < count; element++)
+                    {
+                        result = (UINT16)(result + TableMarshal(field->desc, member + element * field->desc->size, buffer, size));
+                    }
+                }
+                else
+                {
+                    result = (UINT16)(result + TableMarshal(field->desc, member, buffer, size));
+                }
+                index++;
+            }
+        }
+    }
+    return result;
+}
+
+#ifdef TABLE_DRIVEN_MARSHAL
+// The entry points of the described types, in place of the generated ones
+#define TABLE_MARSHAL_FUNCTIONS(type) \
+    TPM_RC \
+    type##_Unmarshal(type *target, BYTE **buffer, INT32 *size) \
+    { \
+        return TableUnmarshal(&TSS_MD_##type, target, buffer, size); \
+    } \
+    UINT16 \
+    type##_Marshal(type *source, BYTE **buffer, INT32 *size) \
+    { \
+        return TableMarshal(&TSS_MD_##type, source, buffer, size); \
+    }
+
+TABLE_MARSHAL_FUNCTIONS(TPM2B_DIGEST)
+TABLE_MARSHAL_FUNCTIONS(TPM2B_DATA)
+TABLE_MARSHAL_FUNCTIONS(TPM2B_EVENT)
+TABLE_MARSHAL_FUNCTIONS(TPM2B_MAX_BUFFER)
+TABLE_MARSHAL_FUNCTIONS(TPM2B_MAX_NV_BUFFER)
+TABLE_MARSHAL_FUNCTIONS(TPM2B_IV)
+TABLE_MARSHAL_FUNCTIONS(TPM2B_NAME)
+TABLE_MARSHAL_FUNCTIONS(TPM2B_ATTEST)
+TABLE_MARSHAL_FUNCTIONS(TPM2B_SYM_KEY)
+TABLE_MARSHAL_FUNCTIONS(TPM2B_LABEL)
+TABLE_MARSHAL_FUNCTIONS(TPM2B_DERIVE)
+TABLE_MARSHAL_FUNCTIONS(TPM2B_SENSITIVE_DATA)
+#if ALG_RSA
+TABLE_MARSHAL_FUNCTIONS(TPM2B_PUBLIC_KEY_RSA)
+TABLE_MARSHAL_FUNCTIONS(TPM2B_PRIVATE_KEY_RSA)
+#endif // ALG_RSA
+TABLE_MARSHAL_FUNCTIONS(TPM2B_ECC_PARAMETER)
+TABLE_MARSHAL_FUNCTIONS(TPM2B_ENCRYPTED_SECRET)
+TABLE_MARSHAL_FUNCTIONS(TPM2B_TEMPLATE)
+TABLE_MARSHAL_FUNCTIONS(TPM2B_PRIVATE_VENDOR_SPECIFIC)
+TABLE_MARSHAL_FUNCTIONS(TPM2B_PRIVATE)
+TABLE_MARSHAL_FUNCTIONS(TPM2B_ID_OBJECT)
+TABLE_MARSHAL_FUNCTIONS(TPM2B_CONTEXT_SENSITIVE)
+TABLE_MARSHAL_FUNCTIONS(TPM2B_CONTEXT_DATA)
+TABLE_MARSHAL_FUNCTIONS(TPMT_TK_CREATION)
+TABLE_MARSHAL_FUNCTIONS(TPMT_TK_VERIFIED)
+TABLE_MARSHAL_FUNCTIONS(TPMT_TK_AUTH)
+TABLE_MARSHAL_FUNCTIONS(TPMT_TK_HASHCHECK)
+TABLE_MARSHAL_FUNCTIONS(TPMS_ALG_PROPERTY)
+TABLE_MARSHAL_FUNCTIONS(TPMS_TAGGED_PROPERTY)
+TABLE_MARSHAL_FUNCTIONS(TPML_CC)
+TABLE_MARSHAL_FUNCTIONS(TPML_ALG)
+TABLE_MARSHAL_FUNCTIONS(TPML_HANDLE)
+TABLE_MARSHAL_FUNCTIONS(TPML_ALG_PROPERTY)
+TABLE_MARSHAL_FUNCTIONS(TPML_TAGGED_TPM_PROPERTY)
+TABLE_MARSHAL_FUNCTIONS(TPMS_CLOCK_INFO)
+TABLE_MARSHAL_FUNCTIONS(TPMS_TIME_INFO)
+TABLE_MARSHAL_FUNCTIONS(TPMS_CONTEXT)
+#endif // TABLE_DRIVEN_MARSHAL
@@ -13,6 +13,7 @@
 #include <sys/stat.h> 
 #include <fcntl.h>
 #include <unistd.h>
+#include <poll.h>
 #endif
 #include "azure_utpm_c/gbfiledescript.h"
 
@@ -71,3 +72,10 @@ int gbfiledesc_open(const char* path, int flags)
     return open(path, flags);
 #endif
 }
+
+#ifndef WIN32
+int gbfiledesc_poll(struct pollfd* fds, nfds_t nfds, int timeout)
+{
+    return poll(fds, nfds, timeout);
+}
+#endif
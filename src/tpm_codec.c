@@ -7,8 +7,12 @@
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/buffer_.h"
+#include "azure_c_shared_utility/threadapi.h"
 
 #include "azure_utpm_c/tpm_codec.h"
+#include "azure_utpm_c/tpm_timer.h"
+#include "azure_utpm_c/tpm_resource_mgr.h"
+#include "azure_utpm_c/tpm_host_hash.h"
 
 #include <stdio.h>
 #include <stdarg.h>
@@ -17,87 +21,146 @@
 #include "azure_utpm_c/Memory_fp.h"
 #include "azure_utpm_c/Marshal_fp.h"
 
-#define MAX_COMMAND_BUFFER      4096
-#define MAX_RESPONSE_BUFFER     MAX_COMMAND_BUFFER
 #define USE_HMAC_SEQ            0
 #define TSS_BAD_PROPERTY        ((UINT32)-1)
+#define TSS_RC_VENDOR           0x400   // Format-zero 'V' bit, set for vendor defined codes
 
 // Forward Declarations
 static UINT16              NullSize = 0;
 static TPMT_SYM_DEF        NullSymDef = { TPM_ALG_NULL , {0}, { TPM_ALG_NULL } };
 static TPMT_SYM_DEF_OBJECT NullSymDefObject = { TPM_ALG_NULL, {0}, {TPM_ALG_NULL} };
+static TPMT_SYM_DEF_OBJECT Aes128SymDefObject = { TPM_ALG_AES, {128}, {TPM_ALG_CFB} };
 static TPMT_SIG_SCHEME     NullSigScheme = { TPM_ALG_NULL, { {TPM_ALG_NULL} } };
 static TPMT_TK_HASHCHECK   NullHashTk = { TPM_ST_HASHCHECK, TPM_RH_NULL, {{0}} };
-static const UINT32 DPS_ID_KEY_HANDLE = HR_PERSISTENT | 0x00000100;
 
 typedef const char* (*ErrCodeMsgFnPtr)(UINT32 msgID);
 
 static const char* TSS_StatusValueName(UINT32 rc);
-
-typedef struct
-{
-    // IN: Size of parameters buffer (bytes)
-    UINT32      ParamSize;
-
-    // IN: Parameters buffer (in TPM representation)
-    BYTE        ParamBuffer[MAX_COMMAND_BUFFER];
-
-    // OUT: Comamnd buffer size (bytes)
-    UINT32      CmdSize;
-
-    // OUT: Comamnd buffer (in TPM representation)
-    BYTE        CmdBuffer[MAX_COMMAND_BUFFER];
-
-    // OUT: Total size of the response buffer (bytes)
-    UINT32      RespSize;
-
-    // OUT: Response buffer data
-    BYTE        RespBuffer[MAX_RESPONSE_BUFFER];
-
-    // OUT: Number of bytes left not unmarshaled in the response buffer
-    //      (params and sessions)
-    UINT32      RespBytesLeft;
-
-    // OUT: Pointer to the not unmarshaled part of the response buffer
-    BYTE       *RespBufPtr;
-
-    // OUT: Unmarshaled handle returned by the command
-    TPM_HANDLE  RetHandle;
-
-    // OUT: Unmarshaled size of response parameters in the response buffer (bytes)
-    UINT32      RespParamSize;
-} TSS_CMD_CONTEXT;
+static TPM_RC RunSequence(TSS_DEVICE* tpm, TSS_SESSION* session, TPMI_DH_OBJECT sequenceHandle,
+                          BYTE* data, UINT32 dataSize, UINT32 chunkSize, TPM2B_DIGEST* result);
+static UINT32 GetSequenceChunkSize(TSS_DEVICE* tpm);
+static TPM_RC HashBytes(TSS_DEVICE* tpm, BYTE* data, UINT32 dataSize, TPMI_ALG_HASH hashAlg, TPM2B_DIGEST* outHash);
+static TPM_RC TSS_2B_VIEW_Unmarshal(TSS_2B_VIEW* target, BYTE** buffer, INT32* size, UINT16 maxSize);
+static void TSS_RecordCommand(TSS_DEVICE* tpm, TSS_CMD_CONTEXT* cmdCtx);
+static void UpdatePersistentHandles(TSS_DEVICE* tpm, TPMI_DH_OBJECT objectHandle, TPMI_DH_PERSISTENT persistentHandle);
+static void AddPublicCacheEntry(TSS_DEVICE* tpm, TPM_HANDLE handle, const TPM2B_PUBLIC* publicArea, const TPM2B_NAME* name);
+static void ClearSessionPool(TSS_SESSION_POOL* pool);
+static TPM_RC CompleteStartup(TSS_DEVICE* tpm, BOOL warmUp);
+
+// Instrumentation is off unless a trace callback, stats or a transcript are
+// attached, in which case a few timestamps are taken for every command
+#define TSS_IS_INSTRUMENTED(tpm)    ((tpm)->TraceCallback != NULL || (tpm)->CmdStats != NULL || (tpm)->Transcript != NULL)
+
+#ifdef SMALL_FOOTPRINT
+// The command is gone once the response is received
+#define TSS_MAY_RETRY(tpm, retries) FALSE
+#else
+#define TSS_MAY_RETRY(tpm, retries) ((retries) < (tpm)->RetryPolicy.MaxRetries)
+#endif // SMALL_FOOTPRINT
+
+#ifdef TSS_MEMORY_METRICS
+// The address of a local of the command function marks the top of the stack
+// used by the command
+#define TSS_START_MEMORY_METRICS(cmdCtx)                                    \
+    {                                                                       \
+        BYTE stackMark;                                                     \
+        (cmdCtx)->StackBase = (size_t)&stackMark;                           \
+        (cmdCtx)->StackDepth = 0;                                           \
+        (cmdCtx)->StartAllocations = gballoc_getAllocationCount();          \
+    }
+#else
+#define TSS_START_MEMORY_METRICS(cmdCtx)
+#endif // TSS_MEMORY_METRICS
 
 TPM_RC
 TSS_DispatchCmd(
     TSS_DEVICE      *tpm,           // IN
+    TSS_CMD_CONTEXT *cmdCtx         // IN/OUT: On input contains the command with marshaled parameters
+                                    //     On output contains complete command and response buffers
+);
+
+static TPM_RC
+TSS_BuildCommandHeader(
     TPM_CC           cmdCode,       // IN: Command code
     TPM_HANDLE      *handles,       // IN (opt): Array of handles used by the command
     INT32            numHandles,    // IN: Number of handles in 'handles'
     TSS_SESSION    **sessions,      // IN (opt): Array of sessions
     INT32            numSessions,   // IN: Number of sessions in 'sessions'
-    TSS_CMD_CONTEXT *cmdCtx         // IN/OUT: On input contains initialized parameter buffer
-                                    //     On output contains complete command and response buffers
+    BYTE            *cmdBuffer,     // OUT: Command buffer receiving the header
+    INT32            bufCapacity,   // IN: Capacity of 'cmdBuffer' in bytes
+    UINT32          *headerSize     // OUT: Number of bytes marshaled into 'cmdBuffer'
 );
 
-static TSS_CMD_CONTEXT  CmdCtx;
-
-#define BEGIN_CMD()  \
+// The command context lives in the TSS_DEVICE, so commands issued through
+// different devices (e.g. one per worker thread) never share buffers.
+// The command header, handles and authorization area are marshaled into
+// CmdBuffer first, and the parameters are then marshaled right after them.
+#define BEGIN_CMD(cmdName, pHandles, numHandles, pSessions, numSessions) \
     TPM_RC           cmdResult = TPM_RC_SUCCESS;                            \
-    TSS_CMD_CONTEXT *cmdCtx = &CmdCtx;                                      \
-    INT32            sizeParamBuf = sizeof(cmdCtx->ParamBuffer);            \
-    BYTE            *paramBuf = cmdCtx->ParamBuffer;                        \
+    TSS_CMD_CONTEXT *cmdCtx;                                                \
+    INT32            sizeParamBuf;                                          \
+    BYTE            *paramBuf;                                              \
+    if (tpm == NULL)                                                        \
+    {                                                                       \
+        LogError("Invalid TSS_DEVICE specified");                           \
+        return TPM_RC_FAILURE;                                              \
+    }                                                                       \
+    if (tpm->StartupPending && CompleteStartup(tpm, FALSE) != TPM_RC_SUCCESS) \
+    {                                                                       \
+        return TPM_RC_FAILURE;                                              \
+    }                                                                       \
+    cmdCtx = &tpm->CmdCtx;                                                  \
+    cmdCtx->CmdCode = TPM_CC_##cmdName;                                     \
+    cmdCtx->ParamSize = 0;                                                  \
+    cmdCtx->NumHandles = numHandles;                                        \
+    cmdCtx->StartTime = TSS_IS_INSTRUMENTED(tpm) ? tpm_timer_get_ns() : 0;  \
+    TSS_START_MEMORY_METRICS(cmdCtx);                                       \
+    if (TSS_BuildCommandHeader(TPM_CC_##cmdName, pHandles, numHandles,      \
+                               pSessions, numSessions, cmdCtx->CmdBuffer,   \
+                               sizeof(cmdCtx->CmdBuffer), &cmdCtx->CmdSize) \
+        != TPM_RC_SUCCESS)                                                  \
+    {                                                                       \
+        LogError("Failure building the " #cmdName " command header");       \
+        return TPM_RC_FAILURE;                                              \
+    }                                                                       \
+    sizeParamBuf = (INT32)(sizeof(cmdCtx->CmdBuffer) - cmdCtx->CmdSize);    \
+    paramBuf = cmdCtx->CmdBuffer + cmdCtx->CmdSize;                         \
     (void)sizeParamBuf;                                                     \
-    (void)paramBuf;                                                         \
-    cmdCtx->ParamSize = 0
+    (void)paramBuf
+
+// Same as BEGIN_CMD for a command compiled by TSS_CompileCommand. The header,
+// handles and authorization area are copied from the template as they are.
+#define BEGIN_COMPILED_CMD(pTemplate) \
+    TPM_RC           cmdResult = TPM_RC_SUCCESS;                            \
+    TSS_CMD_CONTEXT *cmdCtx;                                                \
+    BYTE            *paramBuf;                                              \
+    if (tpm == NULL)                                                        \
+    {                                                                       \
+        LogError("Invalid TSS_DEVICE specified");                           \
+        return TPM_RC_FAILURE;                                              \
+    }                                                                       \
+    if (tpm->StartupPending && CompleteStartup(tpm, FALSE) != TPM_RC_SUCCESS) \
+    {                                                                       \
+        return TPM_RC_FAILURE;                                              \
+    }                                                                       \
+    cmdCtx = &tpm->CmdCtx;                                                  \
+    cmdCtx->CmdCode = (pTemplate)->CmdCode;                                 \
+    cmdCtx->ParamSize = 0;                                                  \
+    cmdCtx->NumHandles = (pTemplate)->NumHandles;                           \
+    cmdCtx->StartTime = TSS_IS_INSTRUMENTED(tpm) ? tpm_timer_get_ns() : 0;  \
+    TSS_START_MEMORY_METRICS(cmdCtx);                                       \
+    MemoryCopy(cmdCtx->CmdBuffer, (pTemplate)->Header, (pTemplate)->HeaderSize); \
+    cmdCtx->CmdSize = (pTemplate)->HeaderSize;                              \
+    paramBuf = cmdCtx->CmdBuffer + cmdCtx->CmdSize;                         \
+    (void)paramBuf
 
 #define END_CMD()  \
     return cmdResult
 
-#define DISPATCH_CMD(cmdName, pHandles, numHandles, pSessions, numSessions) \
-    cmdResult = TSS_DispatchCmd(tpm, TPM_CC_##cmdName,                          \
-                                pHandles, numHandles, pSessions, numSessions,   \
-                                cmdCtx);                                        \
+#define DISPATCH_CMD() \
+    cmdResult = TSS_DispatchCmd(tpm, cmdCtx);                                   \
+    if (TSS_IS_INSTRUMENTED(tpm))                                               \
+        TSS_RecordCommand(tpm, cmdCtx);                                         \
     if (cmdResult != TPM_RC_SUCCESS)                                            \
         return cmdResult;
 
@@ -120,6 +183,24 @@ static TSS_CMD_CONTEXT  CmdCtx;
     else                                \
         TSS_MARSHAL(UINT16, &NullSize)
 
+// Marshals a TPM2B directly from the caller's memory, so that no intermediate
+// TPM2B_MAX_BUFFER copy is needed
+#define TSS_MARSHAL_BYTES2B(pData, dataSize) \
+{                                                                               \
+    UINT16 size2B = (UINT16)(dataSize);                                         \
+    TSS_MARSHAL(UINT16, &size2B);                                               \
+    if (size2B != 0)                                                            \
+        cmdCtx->ParamSize += BYTE_Array_Marshal(pData, &paramBuf, &sizeParamBuf, size2B); \
+}
+
+// Writes a UINT16 in TPM byte order straight into the command buffer, for the
+// compiled commands that skip the marshaling code
+#define TSS_PUT_UINT16(pBuf, value) \
+{                                                                           \
+    (pBuf)[0] = (BYTE)((value) >> 8);                                       \
+    (pBuf)[1] = (BYTE)(value);                                              \
+}
+
 #define TSS_UNMARSHAL(Type, pValue) \
 {                                                                                   \
     if (   Type##_Unmarshal(pValue, &cmdCtx->RespBufPtr, (INT32*)&cmdCtx->RespBytesLeft)    \
@@ -142,6 +223,14 @@ static TSS_CMD_CONTEXT  CmdCtx;
         return TPM_RC_INSUFFICIENT;                                                     \
 }
 
+// Does not copy anything out of the response buffer, see TSS_2B_VIEW
+#define TSS_UNMARSHAL_VIEW(pView, maxSize) \
+{                                                                                           \
+    if (   TSS_2B_VIEW_Unmarshal(pView, &cmdCtx->RespBufPtr, (INT32*)&cmdCtx->RespBytesLeft, maxSize) \
+        != TPM_RC_SUCCESS)                                                                  \
+        return TPM_RC_INSUFFICIENT;                                                         \
+}
+
 #define TSS_COPY2B(dst2b, src2b) \
     MemoryCopy2B(&(dst2b).b, &(src2b).b, sizeof((dst2b).t.buffer))
 
@@ -157,6 +246,51 @@ static TSS_CMD_CONTEXT  CmdCtx;
 #define CHECK_CMD_RESULT(rc, errMsg) \
     CHECK_CMD_RESULT1(rc, errMsg, "")
 
+static bool GetCachedTpmProperty(TSS_DEVICE* tpm, TPM_PT property, UINT32* value)
+{
+    bool result;
+    if (tpm == NULL || !tpm->PropCache.Valid ||
+        property < PT_FIXED || property >= PT_FIXED + TSS_FIXED_PROPERTY_COUNT ||
+        (tpm->PropCache.Present & ((UINT64)1 << (property - PT_FIXED))) == 0)
+    {
+        result = false;
+    }
+    else
+    {
+        *value = tpm->PropCache.Value[property - PT_FIXED];
+        result = true;
+    }
+    return result;
+}
+
+static TPM_RC TSS_2B_VIEW_Unmarshal(TSS_2B_VIEW* target, BYTE** buffer, INT32* size, UINT16 maxSize)
+{
+    TPM_RC result;
+    UINT16 payloadSize = 0;
+    if ((result = UINT16_Unmarshal(&payloadSize, buffer, size)) != TPM_RC_SUCCESS)
+    {
+        LogError("Failed to unmarshal the size of a TPM2B");
+    }
+    else if (payloadSize > maxSize)
+    {
+        LogError("TPM2B size %u exceeds the maximum of %u", payloadSize, maxSize);
+        result = TPM_RC_SIZE;
+    }
+    else if (*size < (INT32)payloadSize)
+    {
+        LogError("TPM2B size %u exceeds the %d bytes left in the response", payloadSize, *size);
+        result = TPM_RC_INSUFFICIENT;
+    }
+    else
+    {
+        target->Size = payloadSize;
+        target->Buffer = *buffer;
+        *buffer += payloadSize;
+        *size -= payloadSize;
+    }
+    return result;
+}
+
 static bool IsCommMediumError(UINT32 code)
 {
     // TBS or TPMSim protocol error
@@ -205,9 +339,18 @@ TPM_HANDLE TSS_CreatePersistentKey(TSS_DEVICE* tpm_device, TPM_HANDLE request_ha
     TPM_HANDLE result;
     TPM_RC tpm_result;
     TPM2B_NAME name;
-    TPM2B_NAME qName;
+    BOOL present;
+
+    if (TSS_IsPersistentHandlePresent(tpm_device, request_handle, &present) == TPM_RC_SUCCESS && !present)
+    {
+        // Known to be missing, no need to ask the TPM
+        tpm_result = TPM_RC_HANDLE;
+    }
+    else
+    {
+        tpm_result = TSS_ReadPublicCached(tpm_device, request_handle, outPub, &name);
+    }
 
-    tpm_result = TPM2_ReadPublic(tpm_device, request_handle, outPub, &name, &qName);
     if (tpm_result == TPM_RC_SUCCESS)
     {
         result = request_handle;
@@ -238,6 +381,12 @@ TPM_HANDLE TSS_CreatePersistentKey(TSS_DEVICE* tpm_device, TPM_HANDLE request_ha
             }
             else
             {
+                // The name does not need a TPM2_ReadPublic, so the next
+                // lookup of the key is served from the cache
+                if (tpm_device->PublicCache != NULL && TSS_ComputeObjectName(outPub, &name) == TPM_RC_SUCCESS)
+                {
+                    AddPublicCacheEntry(tpm_device, request_handle, outPub, &name);
+                }
                 result = request_handle;
             }
         }
@@ -245,449 +394,1950 @@ TPM_HANDLE TSS_CreatePersistentKey(TSS_DEVICE* tpm_device, TPM_HANDLE request_ha
     return result;
 }
 
-TPM_RC Initialize_TPM_Codec(TSS_DEVICE* tpm)
+// Recovers the key of the inner wrapper of the duplicate from the credential,
+// which only the endorsement key can activate
+static TPM_RC ActivateInnerWrapKey(TSS_DEVICE* tpm, TSS_SESSION* sess, TSS_PROVISION_PARAMS* params, TPM2B_DIGEST* innerWrapKey)
 {
     TPM_RC result;
-    if (tpm == NULL)
+    TSS_SESSION* ekSess;
+
+    // Pooled, so that provisioning several keys reuses the session
+    if ((result = TSS_AcquireSession(tpm, TPM_SE_POLICY, TPM_ALG_SHA256, &ekSess)) != TPM_RC_SUCCESS)
     {
-        LogError("Invalid parameter tpm is NULL");
-        result = TPM_RC_FAILURE;
+        LogError("Failed acquiring the endorsement key session %s", TSS_StatusValueName(result));
+    }
+    else
+    {
+        if ((result = TSS_PolicySecret(tpm, sess, TPM_RH_ENDORSEMENT, ekSess, NULL, 0)) != TPM_RC_SUCCESS)
+        {
+            LogError("Failed calling TSS_PolicySecret %s", TSS_StatusValueName(result));
+        }
+        else if ((result = TPM2_ActivateCredential(tpm, sess, ekSess, params->SrkHandle, params->EkHandle,
+            params->CredentialBlob, params->EncryptedSecret, innerWrapKey)) != TPM_RC_SUCCESS)
+        {
+            LogError("Failed calling TPM2_ActivateCredential %s", TSS_StatusValueName(result));
+        }
+        TSS_ReleaseSession(tpm, ekSess, result);
+    }
+    return result;
+}
+
+// Evicts the persistent object at 'handle', if any
+static TPM_RC EvictPersistentObject(TSS_DEVICE* tpm, TSS_SESSION* sess, TPM_HANDLE handle)
+{
+    TPM_RC result;
+    BOOL present;
+
+    if (TSS_IsPersistentHandlePresent(tpm, handle, &present) == TPM_RC_SUCCESS && !present)
+    {
+        result = TPM_RC_SUCCESS;
     }
-    else if ( (tpm->tpm_comm_handle = tpm_comm_create(tpm->comms_endpoint)) == NULL)
+    else if ((result = TPM2_EvictControl(tpm, sess, TPM_RH_OWNER, handle, handle)) == TPM_RC_HANDLE)
     {
-        LogError("creating tpm_comm object");
+        // Nothing was persisted at the handle
+        result = TPM_RC_SUCCESS;
+    }
+    else if (result != TPM_RC_SUCCESS)
+    {
+        LogError("Failed evicting the object at 0x%x %s", handle, TSS_StatusValueName(result));
+    }
+    return result;
+}
+
+TPM_RC TSS_ProvisionIdentityKey(TSS_DEVICE* tpm, TSS_SESSION* sess, TSS_PROVISION_PARAMS* params)
+{
+    TPM_RC result;
+    if (tpm == NULL || sess == NULL || params == NULL || params->CredentialBlob == NULL || params->EncryptedSecret == NULL ||
+        params->IdKeyPublic == NULL || params->DuplicateBlob == NULL || params->EncryptedSeed == NULL)
+    {
+        LogError("Invalid parameter specified tpm: %p, sess: %p, params: %p", tpm, sess, params);
         result = TPM_RC_FAILURE;
     }
     else
     {
-        TPM_COMM_TYPE comm_type = tpm_comm_get_type(tpm->tpm_comm_handle);
-        if (comm_type == TPM_COMM_TYPE_EMULATOR)
+        TPM2B_DIGEST innerWrapKey;
+        TPM2B_PRIVATE idKeyPrivate;
+        TPM2B_NAME idKeyName;
+        TPM_HANDLE loadedKey = 0;
+
+        if ((result = ActivateInnerWrapKey(tpm, sess, params, &innerWrapKey)) != TPM_RC_SUCCESS)
         {
-            result = TPM2_Startup(tpm, TPM_SU_CLEAR);
-            if (result != TPM_RC_SUCCESS && result != TPM_RC_INITIALIZE)
-            {
-                LogError("calling TPM2_Startup %s", TSS_StatusValueName(result) );
-                tpm_comm_destroy(tpm->tpm_comm_handle);
-            }
-            else
-            {
-                result = TPM_RC_SUCCESS;
-            }
+            // Logged by ActivateInnerWrapKey
+        }
+        else if ((result = TPM2_Import(tpm, sess, params->SrkHandle, (TPM2B_DATA*)&innerWrapKey, params->IdKeyPublic,
+            params->DuplicateBlob, params->EncryptedSeed, params->SymmetricAlg != NULL ? params->SymmetricAlg : &Aes128SymDefObject,
+            &idKeyPrivate)) != TPM_RC_SUCCESS)
+        {
+            LogError("Failed calling TPM2_Import %s", TSS_StatusValueName(result));
+        }
+        else if ((result = TPM2_Load(tpm, sess, params->SrkHandle, &idKeyPrivate, params->IdKeyPublic, &loadedKey, &idKeyName)) != TPM_RC_SUCCESS)
+        {
+            LogError("Failed calling TPM2_Load %s", TSS_StatusValueName(result));
+            loadedKey = 0;
+        }
+        else if ((result = EvictPersistentObject(tpm, sess, params->IdKeyHandle)) != TPM_RC_SUCCESS)
+        {
+            // Logged by EvictPersistentObject
+        }
+        else if ((result = TPM2_EvictControl(tpm, sess, TPM_RH_OWNER, loadedKey, params->IdKeyHandle)) != TPM_RC_SUCCESS)
+        {
+            LogError("Failed calling TPM2_EvictControl %s", TSS_StatusValueName(result));
         }
         else
         {
-            result = TPM_RC_SUCCESS;
+            // TPM2_Load returned the name, so the key is cached without a
+            // TPM2_ReadPublic
+            AddPublicCacheEntry(tpm, params->IdKeyHandle, params->IdKeyPublic, &idKeyName);
+        }
+
+        // The persistent copy, if any, does not need the loaded one
+        if (loadedKey != 0 && TPM2_FlushContext(tpm, loadedKey) != TPM_RC_SUCCESS)
+        {
+            LogError("Failed flushing the loaded identity key 0x%x", loadedKey);
         }
-        // Clear out from previous runs
-        (void)TPM2_FlushContext(tpm, HR_POLICY_SESSION);
-        (void)TPM2_FlushContext(tpm, HR_POLICY_SESSION | 1);
-        (void)TPM2_FlushContext(tpm, HR_POLICY_SESSION | 2);
     }
     return result;
 }
 
-void Deinit_TPM_Codec(TSS_DEVICE* tpm)
+// Reads the handles present in the TPM in the range of 'firstHandle'. At most
+// 'maxCount' of them are stored in 'handles', and 'complete' is set to FALSE
+// if the TPM reported more.
+static TPM_RC GetHandles(TSS_DEVICE* tpm, TPM_HANDLE firstHandle, TPM_HANDLE* handles, UINT32 maxCount,
+                         UINT32* count, BOOL* complete)
 {
-    if (tpm != NULL)
+    TPM_RC result = TPM_RC_SUCCESS;
+    TPMI_YES_NO more = YES;
+    TPMS_CAPABILITY_DATA capData = { 0 };
+    TPM_HANDLE nextHandle = firstHandle;
+
+    *count = 0;
+    *complete = TRUE;
+    while (result == TPM_RC_SUCCESS && more == YES)
     {
-        tpm_comm_destroy(tpm->tpm_comm_handle);
+        UINT32 index;
+
+        result = TPM2_GetCapability(tpm, TPM_CAP_HANDLES, nextHandle, MAX_CAP_HANDLES, &more, &capData);
+        if (result != TPM_RC_SUCCESS || capData.capability != TPM_CAP_HANDLES)
+        {
+            LogError("Get Capability failure %s", TSS_StatusValueName(result));
+            result = result == TPM_RC_SUCCESS ? TPM_RC_FAILURE : result;
+        }
+        else
+        {
+            for (index = 0; index < capData.data.handles.count; index++)
+            {
+                TPM_HANDLE handle = capData.data.handles.handle[index];
+                if (*count < maxCount)
+                {
+                    handles[(*count)++] = handle;
+                }
+                else
+                {
+                    *complete = FALSE;
+                }
+                // Keep the handle type of the range being enumerated, some
+                // TPMs report loaded policy sessions with their own type
+                nextHandle = (firstHandle & ~HR_HANDLE_MASK) | ((handle + 1) & HR_HANDLE_MASK);
+            }
+
+            if (capData.data.handles.count == 0)
+            {
+                break;
+            }
+        }
     }
+    return result;
 }
 
-// In case of success returns the size of the signature. If the signature size is
-// greater than sigBufCapacity, then the signature is not copied into signatureBuffer.
-// If any of the TPM commands fails, returns 0, and tpm->LastRawResponse contains
-// the response code from the failed command.
-//
-// NOTE: For now only HMAC signing is supported.
-//
-UINT32 SignData(TSS_DEVICE* tpm, TSS_SESSION* sess, BYTE* tokenData, UINT32 tokenSize, BYTE* signatureBuffer, UINT32 sigBufSize)
+// Flushes the sessions left loaded by previous runs
+static void FlushLoadedSessions(TSS_DEVICE* tpm)
 {
-    UINT32 result;
-    TPM_RC          rc;
-    TPM2B_DIGEST    digest;
-    TPM_ALG_ID      idKeyHashAlg = ALG_SHA256_VALUE;
-    UINT32          sigSize = TSS_GetDigestSize(idKeyHashAlg); //32
-    UINT32          MaxInputBuffer = 0;
+    TPM_HANDLE sessions[MAX_ACTIVE_SESSIONS];
+    UINT32 count;
+    UINT32 index;
+    BOOL complete;
 
-    if (sigBufSize < sigSize)
+    if (GetHandles(tpm, HR_HMAC_SESSION, sessions, MAX_ACTIVE_SESSIONS, &count, &complete) != TPM_RC_SUCCESS)
     {
-        LogError("Signature buffer size (%uz) is less than required size (%uz)", sigBufSize, sigSize);
-        result = sigSize;
+        LogError("Unable to enumerate the loaded sessions");
     }
     else
     {
-        sigBufSize = 0;
-        MaxInputBuffer = TSS_GetTpmProperty(tpm, TPM_PT_INPUT_BUFFER); // 1024
-        if (tokenSize > MaxInputBuffer) // 68
+        for (index = 0; index < count; index++)
         {
-            TPMI_DH_OBJECT  hSeq = TPM_RH_NULL;
-            BYTE           *curPos = tokenData;
-            UINT32          bytesLeft = tokenSize;
+            (void)TPM2_FlushContext(tpm, sessions[index]);
+        }
+    }
+}
 
-            rc = TPM2_HMAC_Start(tpm, sess, DPS_ID_KEY_HANDLE, NULL, idKeyHashAlg, &hSeq);
-            if (rc != TPM_RC_SUCCESS)
+// Connects to the TPM, starts it if it was just powered on, and flushes the
+// sessions left loaded by previous runs. With 'warmUp' the fixed properties and
+// the persistent handles are read as well, otherwise they are read on demand.
+static TPM_RC StartDevice(TSS_DEVICE* tpm, BOOL warmUp)
+{
+    TPM_RC result;
+    if (tpm->ResourceMgr == NULL && (tpm->tpm_comm_handle = tpm_comm_create(tpm->comms_endpoint)) == NULL)
+    {
+        LogError("creating tpm_comm object");
+        result = TPM_RC_FAILURE;
+    }
+    else
+    {
+        // A resource manager started the TPM when it connected to it
+        if (tpm->ResourceMgr == NULL && tpm_comm_needs_startup(tpm->tpm_comm_handle))
+        {
+            result = TPM2_Startup(tpm, TPM_SU_CLEAR);
+            if (result != TPM_RC_SUCCESS && result != TPM_RC_INITIALIZE)
             {
-                LogError("Failed to start HMAC sequence %s", TSS_StatusValueName(rc) );
-                result = 0;
+                LogError("calling TPM2_Startup %s", TSS_StatusValueName(result) );
+                tpm_comm_destroy(tpm->tpm_comm_handle);
+                tpm->tpm_comm_handle = NULL;
             }
             else
             {
-                bool seq_complete = true;
-                // Above condition 'if (tokenSize > MaxInputBuffer)' ensures that the first
-                // iteration is always valid.
-                do
-                {
-                    rc = TSS_SequenceUpdate(tpm, sess, hSeq, curPos, MaxInputBuffer);
-                    if (rc != TPM_RC_SUCCESS)
-                    {
-                        LogError("Failed to update HMAC sequence %s", TSS_StatusValueName(rc));
-                        seq_complete = false;
-                        break;
-                    }
-
-                    bytesLeft -= MaxInputBuffer;
-                    curPos += MaxInputBuffer;
-                } while (bytesLeft > MaxInputBuffer);
-
-                if (seq_complete)
-                {
-                    rc = TSS_SequenceComplete(tpm, sess, hSeq, curPos, bytesLeft, &digest);
-                    if (rc != TPM_RC_SUCCESS)
-                    {
-                        LogError("Failed to complete HMAC sequence %s", TSS_StatusValueName(rc));
-                        result = 0;
-                    }
-                    else
-                    {
-                        MemoryCopy(signatureBuffer, digest.t.buffer, sigSize);
-                        sigBufSize = sigSize;
-                        result = sigBufSize;
-                    }
-                }
-                else
-                {
-                    result = 0;
-                }
+                result = TPM_RC_SUCCESS;
             }
         }
         else
         {
-            rc = TSS_HMAC(tpm, sess, DPS_ID_KEY_HANDLE, tokenData, tokenSize, &digest);
-            if (rc != TPM_RC_SUCCESS)
+            result = TPM_RC_SUCCESS;
+        }
+
+        if (result == TPM_RC_SUCCESS)
+        {
+            if (warmUp && TSS_RefreshPropertyCache(tpm) != TPM_RC_SUCCESS)
             {
-                LogError("Hashing token data failed %s", TSS_StatusValueName(rc));
-                result = 0;
+                // Not fatal, the properties will be queried on demand
+                LogInfo("Unable to cache the fixed TPM properties");
             }
-            else
+
+            // Clear out from previous runs. Behind a resource manager the
+            // loaded sessions belong to the other clients.
+            if (tpm->ResourceMgr == NULL)
             {
-                MemoryCopy(signatureBuffer, digest.t.buffer, sigSize);
-                sigBufSize = sigSize;
-                result = sigBufSize;
+                FlushLoadedSessions(tpm);
+            }
+            ClearSessionPool(&tpm->SessionPool);
+
+            if (warmUp && TSS_RefreshPersistentHandles(tpm) != TPM_RC_SUCCESS)
+            {
+                // Not fatal, the callers will ask the TPM about their handles
+                LogInfo("Unable to read the persistent handles");
             }
         }
     }
     return result;
 }
 
-TPM_RC TPM2_HMAC(
-    TSS_DEVICE             *tpm,                // IN/OUT
-    TSS_SESSION            *session,            // IN/OUT
-    TPMI_DH_OBJECT          handle,             // IN
-    TPM2B_MAX_BUFFER       *buffer,             // IN
-    TPMI_ALG_HASH           hashAlg,            // IN
-    TPM2B_DIGEST           *outHMAC             // OUT
-)
+// Runs the start up left pending by Initialize_TPM_Codec, if any. It stays
+// pending if it fails, so that the next command tries again.
+static TPM_RC CompleteStartup(TSS_DEVICE* tpm, BOOL warmUp)
 {
     TPM_RC result;
-    if (tpm == NULL || session == NULL || buffer == NULL || outHMAC == NULL)
+    if (!tpm->StartupPending)
     {
-        LogError("Invalid parameter specified tpm: %p, session: %p, buffer: %p, outHMAC: %p", tpm, session, buffer, outHMAC);
-        result = TPM_RC_FAILURE;
+        result = TPM_RC_SUCCESS;
     }
     else
     {
-        result = TPM_RC_SUCCESS;
-        BEGIN_CMD();
-        TSS_MARSHAL_OPT2B(TPM2B_MAX_BUFFER, buffer);
-        TSS_MARSHAL(TPMI_ALG_HASH, &hashAlg);
-        DISPATCH_CMD(HMAC, &handle, 1, &session, 1);
-        TSS_UNMARSHAL(TPM2B_DIGEST, outHMAC);
-        END_CMD();
+        // Cleared first, as the start up commands go through the device itself
+        tpm->StartupPending = FALSE;
+        if ((result = StartDevice(tpm, warmUp)) != TPM_RC_SUCCESS)
+        {
+            LogError("Failure starting the TPM device %s", TSS_StatusValueName(result));
+            tpm->StartupPending = TRUE;
+        }
     }
     return result;
 }
 
-TPM_RC TSS_HMAC(
-    TSS_DEVICE             *tpm,                // IN/OUT
-    TSS_SESSION            *session,            // IN/OUT
-    TPMI_DH_OBJECT          handle,             // IN
-    BYTE                   *data,               // IN
-    UINT32                  dataSize,           // IN
-    TPM2B_DIGEST           *outHMAC             // OUT
-)
+TPM_RC Initialize_TPM_Codec(TSS_DEVICE* tpm)
 {
     TPM_RC result;
-    if (dataSize > MAX_DIGEST_BUFFER)
+    if (tpm == NULL)
     {
-        LogError("Invalid data size specified %u", dataSize);
-        result = TPM_RC_SIZE;
+        LogError("Invalid parameter tpm is NULL");
+        result = TPM_RC_FAILURE;
     }
-    else if (tpm == NULL || session == NULL || data == NULL || outHMAC == NULL)
+    else if (tpm->ResourceMgr != NULL && tpm_rm_attach_client(tpm->ResourceMgr, tpm) != 0)
     {
-        LogError("Invalid parameter specified tpm: %p, session: %p, data: %p, outHMAC: %p", tpm, session, data, outHMAC);
+        LogError("Failure attaching to the resource manager");
         result = TPM_RC_FAILURE;
     }
+    else if (tpm->DeferStartup)
+    {
+        // Nothing is sent to the TPM until TSS_CompleteStartup or the first
+        // command of the device
+        ClearSessionPool(&tpm->SessionPool);
+        tpm->StartupPending = TRUE;
+        result = TPM_RC_SUCCESS;
+    }
     else
     {
-        TPM2B_MAX_BUFFER    dataBuf;
-        dataBuf.b.size = (UINT16)dataSize;
-        MemoryCopy(dataBuf.t.buffer, data, dataSize);
-        result = TPM2_HMAC(tpm, session, handle, &dataBuf, TPM_ALG_NULL, outHMAC);
+        tpm->StartupPending = FALSE;
+        if ((result = StartDevice(tpm, TRUE)) != TPM_RC_SUCCESS && tpm->ResourceMgr != NULL)
+        {
+            tpm_rm_release_client(tpm->ResourceMgr, tpm);
+        }
     }
     return result;
 }
 
-TPM_RC
-TSS_Hash(
-    TSS_DEVICE             *tpm,                // IN/OUT
-    BYTE                   *data,               // IN
-    UINT32                  dataSize,           // IN
-    TPMI_ALG_HASH           hashAlg,            // IN
-    TPM2B_DIGEST           *outHash             // OUT
-)
+TPM_RC TSS_CompleteStartup(TSS_DEVICE* tpm)
 {
-    TPM2B_MAX_BUFFER    dataBuf;// = { (UINT16)dataSize };
-    dataBuf.t.size = (UINT16)dataSize;
-
-    if (dataSize > MAX_DIGEST_BUFFER)
-        return TPM_RC_SIZE;
-    MemoryCopy(dataBuf.t.buffer, data, dataSize);
-
-    return TPM2_Hash(tpm, &dataBuf, hashAlg, TPM_RH_NULL, outHash, NULL);
+    TPM_RC result;
+    if (tpm == NULL)
+    {
+        LogError("Invalid parameter tpm is NULL");
+        result = TPM_RC_FAILURE;
+    }
+    else
+    {
+        result = CompleteStartup(tpm, TRUE);
+    }
+    return result;
 }
 
-TPM_RC
-TSS_PolicySecret(
-    TSS_DEVICE             *tpm,                // IN/OUT
-    TSS_SESSION            *session,            // IN/OUT
-    TPMI_DH_ENTITY          authHandle,         // IN
-    TSS_SESSION            *policySession,      // IN
-    TPM2B_NONCE            *nonceTPM,           // IN
-    INT32                   expiration          // IN
-)
+void Deinit_TPM_Codec(TSS_DEVICE* tpm)
+{
+    if (tpm != NULL)
+    {
+        TSS_FlushSessionPool(tpm);
+        if (tpm->ResourceMgr != NULL)
+        {
+            tpm_rm_release_client(tpm->ResourceMgr, tpm);
+        }
+        else
+        {
+            tpm_comm_destroy(tpm->tpm_comm_handle);
+        }
+    }
+}
+
+TPM_RC TSS_SetCommandPriority(TSS_DEVICE* tpm, TPM_COMM_PRIORITY priority)
 {
     TPM_RC result;
-    TPM2B_TIMEOUT   timeout;
-    if (session == NULL || policySession == NULL)
+    if (tpm == NULL)
     {
-        LogError("Invalid parameter specified policySession: %p session: %p", policySession, session);
+        LogError("Invalid parameter tpm is NULL");
+        result = TPM_RC_FAILURE;
+    }
+    else if (CompleteStartup(tpm, FALSE) != TPM_RC_SUCCESS)
+    {
+        // Logged by CompleteStartup
+        result = TPM_RC_FAILURE;
+    }
+    else if (tpm->tpm_comm_handle == NULL)
+    {
+        LogError("The device has no connection of its own");
+        result = TPM_RC_FAILURE;
+    }
+    else if (tpm_comm_set_priority(tpm->tpm_comm_handle, priority) != 0)
+    {
+        LogError("Failure setting the command priority");
         result = TPM_RC_FAILURE;
     }
     else
     {
-        result = TPM2_PolicySecret(tpm, session, authHandle, policySession->SessIn.sessionHandle, nonceTPM, NULL, NULL, expiration, &timeout, NULL);
+        result = TPM_RC_SUCCESS;
     }
     return result;
 }
 
-TPM_RC
-TPM2_SequenceComplete(
-    TSS_DEVICE             *tpm,                // IN/OUT
-    TSS_SESSION            *session,            // IN/OUT
-    TPMI_DH_OBJECT          sequenceHandle,     // IN
-    TPM2B_MAX_BUFFER       *buffer,             // IN
-    TPMI_RH_HIERARCHY       hierarchy,          // IN [opt]
-    TPM2B_DIGEST           *result,             // OUT
-    TPMT_TK_HASHCHECK      *validation          // OUT [opt]
-)
+TPM_RC TSS_SetRetryPolicy(TSS_DEVICE* tpm, const TSS_RETRY_POLICY* policy)
 {
-    BEGIN_CMD();
-    TSS_MARSHAL_OPT2B(TPM2B_MAX_BUFFER, buffer);
-    TSS_MARSHAL(TPMI_RH_HIERARCHY, &hierarchy);
-    DISPATCH_CMD(SequenceComplete, &sequenceHandle, 1, &session, 1);
-    TSS_UNMARSHAL(TPM2B_DIGEST, result);
-    TSS_UNMARSHAL_OPT(TPMT_TK_HASHCHECK, validation);
-    END_CMD();
+    TPM_RC result;
+    if (tpm == NULL)
+    {
+        LogError("Invalid parameter tpm is NULL");
+        result = TPM_RC_FAILURE;
+    }
+    else if (policy == NULL)
+    {
+        TSS_RETRY_POLICY noRetries = { 0 };
+        tpm->RetryPolicy = noRetries;
+        result = TPM_RC_SUCCESS;
+    }
+#ifdef SMALL_FOOTPRINT
+    else if (policy->MaxRetries != 0)
+    {
+        LogError("Commands cannot be resent with SMALL_FOOTPRINT");
+        result = TPM_RC_FAILURE;
+    }
+#endif // SMALL_FOOTPRINT
+    else if (policy->InitialDelayMs > policy->MaxDelayMs)
+    {
+        LogError("Invalid retry policy, the initial delay (%u ms) exceeds the maximum delay (%u ms)", policy->InitialDelayMs, policy->MaxDelayMs);
+        result = TPM_RC_FAILURE;
+    }
+    else
+    {
+        tpm->RetryPolicy = *policy;
+        result = TPM_RC_SUCCESS;
+    }
+    return result;
 }
 
-TPM_RC
-TPM2_SequenceUpdate(
-    TSS_DEVICE             *tpm,                // IN/OUT
-    TSS_SESSION            *session,            // IN/OUT
-    TPMI_DH_OBJECT          sequenceHandle,     // IN
-    TPM2B_MAX_BUFFER       *buffer              // IN
-)
+// Signs the data with DPS_ID_KEY_HANDLE, using a HMAC sequence if the data does
+// not fit into the TPM input buffer. Returns the size of the signature, or 0 if
+// any of the TPM commands fails.
+// 'hmacTemplate' (opt) is a TPM2_HMAC command compiled for DPS_ID_KEY_HANDLE and 'sess'
+static UINT32 SignDataWithIdKey(TSS_DEVICE* tpm, TSS_SESSION* sess, const TSS_CMD_TEMPLATE* hmacTemplate,
+                                UINT32 maxInputBuffer, BYTE* tokenData, UINT32 tokenSize, BYTE* signatureBuffer)
 {
-    BEGIN_CMD();
-    TSS_MARSHAL_OPT2B(TPM2B_MAX_BUFFER, buffer);
-    DISPATCH_CMD(SequenceUpdate, &sequenceHandle, 1, &session, 1);
-    END_CMD();
+    UINT32          result;
+    TPM_RC          rc;
+    TPM2B_DIGEST    digest;
+    TPM_ALG_ID      idKeyHashAlg = ALG_SHA256_VALUE;
+    UINT32          sigSize = TSS_GetDigestSize(idKeyHashAlg);
+
+    if (tokenSize > maxInputBuffer)
+    {
+        TPMI_DH_OBJECT  hSeq = TPM_RH_NULL;
+
+        rc = TPM2_HMAC_Start(tpm, sess, DPS_ID_KEY_HANDLE, NULL, idKeyHashAlg, &hSeq);
+        if (rc != TPM_RC_SUCCESS)
+        {
+            LogError("Failed to start HMAC sequence %s", TSS_StatusValueName(rc) );
+            result = 0;
+        }
+        else if ((rc = RunSequence(tpm, sess, hSeq, tokenData, tokenSize, maxInputBuffer, &digest)) != TPM_RC_SUCCESS)
+        {
+            LogError("Failed to compute HMAC sequence %s", TSS_StatusValueName(rc));
+            result = 0;
+        }
+        else
+        {
+            MemoryCopy(signatureBuffer, digest.t.buffer, sigSize);
+            result = sigSize;
+        }
+    }
+    else
+    {
+        TSS_2B_VIEW hmacView;
+
+        if (hmacTemplate != NULL)
+        {
+            rc = TSS_HMAC_Compiled(tpm, hmacTemplate, tokenData, tokenSize, &hmacView);
+        }
+        else
+        {
+            rc = TSS_HMAC_View(tpm, sess, DPS_ID_KEY_HANDLE, tokenData, tokenSize, &hmacView);
+        }
+        if (rc != TPM_RC_SUCCESS)
+        {
+            LogError("Hashing token data failed %s", TSS_StatusValueName(rc));
+            result = 0;
+        }
+        else if (hmacView.Size != sigSize)
+        {
+            LogError("Unexpected HMAC size %u, expected %u", hmacView.Size, sigSize);
+            result = 0;
+        }
+        else
+        {
+            MemoryCopy(signatureBuffer, hmacView.Buffer, sigSize);
+            result = sigSize;
+        }
+    }
+    return result;
 }
 
-TPM_RC
-TPM2_Sign(
+// In case of success returns the size of the signature. If the signature size is
+// greater than sigBufCapacity, then the signature is not copied into signatureBuffer.
+// If any of the TPM commands fails, returns 0, and tpm->LastRawResponse contains
+// the response code from the failed command.
+//
+// NOTE: For now only HMAC signing is supported.
+//
+UINT32 SignData(TSS_DEVICE* tpm, TSS_SESSION* sess, BYTE* tokenData, UINT32 tokenSize, BYTE* signatureBuffer, UINT32 sigBufSize)
+{
+    UINT32 result;
+    UINT32          sigSize = TSS_GetDigestSize(ALG_SHA256_VALUE); //32
+
+    if (sigBufSize < sigSize)
+    {
+        LogError("Signature buffer size (%uz) is less than required size (%uz)", sigBufSize, sigSize);
+        result = sigSize;
+    }
+    else
+    {
+        UINT32 MaxInputBuffer = GetSequenceChunkSize(tpm); // 1024
+        result = SignDataWithIdKey(tpm, sess, NULL, MaxInputBuffer, tokenData, tokenSize, signatureBuffer);
+    }
+    return result;
+}
+
+// Signs every item with DPS_ID_KEY_HANDLE using the same session. The TPM input
+// buffer size is looked up once for the whole batch. For each item SignatureSize
+// is set the same way SignData() computes its return value, and RawResponse
+// receives tpm->LastRawResponse of the last command executed for that item.
+// Returns the number of items that were successfully signed.
+UINT32 SignDataBatch(TSS_DEVICE* tpm, TSS_SESSION* sess, TSS_SIGN_DATA_ITEM* items, UINT32 itemCount)
+{
+    UINT32 result;
+    if (tpm == NULL || sess == NULL || items == NULL)
+    {
+        LogError("Invalid parameter specified tpm: %p, sess: %p, items: %p", tpm, sess, items);
+        result = 0;
+    }
+    else
+    {
+        UINT32 sigSize = TSS_GetDigestSize(ALG_SHA256_VALUE);
+        UINT32 maxInputBuffer = GetSequenceChunkSize(tpm);
+        UINT32 index;
+        TPM_HANDLE idKeyHandle = DPS_ID_KEY_HANDLE;
+        TSS_CMD_TEMPLATE hmacTemplate;
+        BOOL useTemplate;
+
+        // With a password session every item is signed with the same
+        // TPM2_HMAC header, so it is only marshaled once
+        useTemplate = sess->SessIn.sessionHandle == TPM_RS_PW
+            && TSS_CompileCommand(TPM_CC_HMAC, &idKeyHandle, 1, &sess, 1, &hmacTemplate) == TPM_RC_SUCCESS;
+
+        result = 0;
+        for (index = 0; index < itemCount; index++)
+        {
+            TSS_SIGN_DATA_ITEM* item = &items[index];
+            if (item->Data == NULL || item->Signature == NULL)
+            {
+                LogError("Invalid batch item %u data: %p, signature: %p", index, item->Data, item->Signature);
+                item->SignatureSize = 0;
+                item->RawResponse = TPM_RC_FAILURE;
+            }
+            else if (item->SignatureCapacity < sigSize)
+            {
+                LogError("Signature buffer size (%u) of batch item %u is less than required size (%u)", item->SignatureCapacity, index, sigSize);
+                item->SignatureSize = sigSize;
+                item->RawResponse = TPM_RC_SIZE;
+            }
+            else
+            {
+                tpm->LastRawResponse = TPM_RC_SUCCESS;
+                item->SignatureSize = SignDataWithIdKey(tpm, sess, useTemplate ? &hmacTemplate : NULL, maxInputBuffer,
+                                                        item->Data, item->DataSize, item->Signature);
+                item->RawResponse = tpm->LastRawResponse;
+                if (item->SignatureSize != 0)
+                {
+                    result++;
+                }
+            }
+        }
+    }
+    return result;
+}
+
+TPM_RC TPM2_HMAC(
     TSS_DEVICE             *tpm,                // IN/OUT
     TSS_SESSION            *session,            // IN/OUT
-    TPMI_DH_OBJECT          keyHandle,          // IN
-    TPM2B_DIGEST           *digest,             // IN
-    TPMT_SIG_SCHEME        *inScheme,           // IN [opt]
-    TPMT_TK_HASHCHECK      *validation,         // IN [opt]
-    TPMT_SIGNATURE         *signature           // OUT
+    TPMI_DH_OBJECT          handle,             // IN
+    TPM2B_MAX_BUFFER       *buffer,             // IN
+    TPMI_ALG_HASH           hashAlg,            // IN
+    TPM2B_DIGEST           *outHMAC             // OUT
 )
 {
-    BEGIN_CMD();
-    TSS_MARSHAL_OPT2B(TPM2B_DIGEST, digest);
-    TSS_MARSHAL(TPMT_SIG_SCHEME, inScheme ? inScheme : &NullSigScheme);
-    TSS_MARSHAL(TPMT_TK_HASHCHECK, validation ? validation : &NullHashTk);
-    DISPATCH_CMD(Sign, &keyHandle, 1, &session, 1);
-    TSS_UNMARSHAL_FLAGGED(TPMT_SIGNATURE, signature);
-    END_CMD();
+    TPM_RC result;
+    if (tpm == NULL || session == NULL || buffer == NULL || outHMAC == NULL)
+    {
+        LogError("Invalid parameter specified tpm: %p, session: %p, buffer: %p, outHMAC: %p", tpm, session, buffer, outHMAC);
+        result = TPM_RC_FAILURE;
+    }
+    else
+    {
+        result = TPM_RC_SUCCESS;
+        BEGIN_CMD(HMAC, &handle, 1, &session, 1);
+        TSS_MARSHAL_OPT2B(TPM2B_MAX_BUFFER, buffer);
+        TSS_MARSHAL(TPMI_ALG_HASH, &hashAlg);
+        DISPATCH_CMD();
+        TSS_UNMARSHAL(TPM2B_DIGEST, outHMAC);
+        END_CMD();
+    }
+    return result;
 }
 
-TPM_RC
-TSS_SequenceComplete(
+TPM_RC TSS_HMAC(
     TSS_DEVICE             *tpm,                // IN/OUT
     TSS_SESSION            *session,            // IN/OUT
-    TPMI_DH_OBJECT          sequenceHandle,     // IN
+    TPMI_DH_OBJECT          handle,             // IN
     BYTE                   *data,               // IN
     UINT32                  dataSize,           // IN
-    TPM2B_DIGEST           *result              // OUT
+    TPM2B_DIGEST           *outHMAC             // OUT
 )
 {
-    TPM2B_MAX_BUFFER    dataBuf;// = { (UINT16)dataSize };
-    dataBuf.t.size = (UINT16)dataSize;
-
-    if (dataSize > MAX_DIGEST_BUFFER)
-        return TPM_RC_SIZE;
-    MemoryCopy(dataBuf.t.buffer, data, dataSize);
-
-    return TPM2_SequenceComplete(tpm, session, sequenceHandle, &dataBuf, TPM_RH_NULL,
-        result, NULL);
+    TPM_RC result;
+    TSS_2B_VIEW hmacView;
+    if (outHMAC == NULL)
+    {
+        LogError("Invalid parameter specified outHMAC: %p", outHMAC);
+        result = TPM_RC_FAILURE;
+    }
+    else if ((result = TSS_HMAC_View(tpm, session, handle, data, dataSize, &hmacView)) == TPM_RC_SUCCESS)
+    {
+        outHMAC->t.size = hmacView.Size;
+        MemoryCopy(outHMAC->t.buffer, hmacView.Buffer, hmacView.Size);
+    }
+    return result;
 }
 
-TPM_RC
-TSS_SequenceUpdate(
+TPM_RC TSS_HMAC_View(
     TSS_DEVICE             *tpm,                // IN/OUT
     TSS_SESSION            *session,            // IN/OUT
-    TPMI_DH_OBJECT          sequenceHandle,     // IN
+    TPMI_DH_OBJECT          handle,             // IN
     BYTE                   *data,               // IN
-    UINT32                  dataSize            // IN
+    UINT32                  dataSize,           // IN
+    TSS_2B_VIEW            *outHMAC             // OUT
 )
 {
-    TPM2B_MAX_BUFFER    dataBuf;// = { (UINT16)dataSize };
-    dataBuf.t.size = (UINT16)dataSize;
-
+    TPM_RC result;
+    UINT32 maxInputBuffer;
     if (dataSize > MAX_DIGEST_BUFFER)
-        return TPM_RC_SIZE;
-    MemoryCopy(dataBuf.t.buffer, data, dataSize);
+    {
+        LogError("Invalid data size specified %u", dataSize);
+        result = TPM_RC_SIZE;
+    }
+    else if (tpm == NULL || session == NULL || data == NULL || outHMAC == NULL)
+    {
+        LogError("Invalid parameter specified tpm: %p, session: %p, data: %p, outHMAC: %p", tpm, session, data, outHMAC);
+        result = TPM_RC_FAILURE;
+    }
+    else if (GetCachedTpmProperty(tpm, TPM_PT_INPUT_BUFFER, &maxInputBuffer) && dataSize > maxInputBuffer)
+    {
+        LogError("Data size %u exceeds the TPM input buffer size %u", dataSize, maxInputBuffer);
+        result = TPM_RC_SIZE;
+    }
+    else
+    {
+        TPMI_ALG_HASH hashAlg = TPM_ALG_NULL;
 
-    return TPM2_SequenceUpdate(tpm, session, sequenceHandle, &dataBuf);
+        result = TPM_RC_SUCCESS;
+        BEGIN_CMD(HMAC, &handle, 1, &session, 1);
+        TSS_MARSHAL_BYTES2B(data, dataSize);
+        TSS_MARSHAL(TPMI_ALG_HASH, &hashAlg);
+        DISPATCH_CMD();
+        TSS_UNMARSHAL_VIEW(outHMAC, sizeof(TPMU_HA));
+        END_CMD();
+    }
+    return result;
 }
 
-TPM_RC
-TSS_Sign(
-    TSS_DEVICE             *tpm,                // IN/OUT
-    TSS_SESSION            *session,            // IN/OUT
-    TPMI_DH_OBJECT          keyHandle,          // IN
-    TPM2B_DIGEST           *digest,             // IN
-    TPMT_SIGNATURE         *signature           // OUT
+static BOOL AllPasswordSessions(TSS_SESSION** sessions, INT32 numSessions)
+{
+    BOOL result = TRUE;
+    INT32 index;
+    for (index = 0; index < numSessions && result; index++)
+    {
+        result = sessions[index] != NULL && sessions[index]->SessIn.sessionHandle == TPM_RS_PW;
+    }
+    return result;
+}
+
+TPM_RC TSS_CompileCommand(
+    TPM_CC                  cmdCode,            // IN
+    TPM_HANDLE             *handles,            // IN (opt)
+    INT32                   numHandles,         // IN
+    TSS_SESSION           **sessions,           // IN (opt)
+    INT32                   numSessions,        // IN
+    TSS_CMD_TEMPLATE       *cmdTemplate         // OUT
 )
 {
-    return TPM2_Sign(tpm, session, keyHandle, digest, NULL, NULL, signature);
+    TPM_RC result;
+    if (cmdTemplate == NULL || (sessions == NULL && numSessions != 0))
+    {
+        LogError("Invalid parameter specified cmdTemplate: %p, sessions: %p", cmdTemplate, sessions);
+        result = TPM_RC_FAILURE;
+    }
+    else if (numHandles < 0 || numHandles > 3 || numSessions < 0 || numSessions > 2)
+    {
+        LogError("Invalid number of handles %d or sessions %d", numHandles, numSessions);
+        result = TPM_RC_FAILURE;
+    }
+    else if (!AllPasswordSessions(sessions, numSessions))
+    {
+        LogError("Only password sessions can be compiled into a command");
+        result = TPM_RC_AUTH_TYPE;
+    }
+    else if (TSS_BuildCommandHeader(cmdCode, handles, numHandles, sessions, numSessions,
+                                    cmdTemplate->Header, sizeof(cmdTemplate->Header),
+                                    &cmdTemplate->HeaderSize) != TPM_RC_SUCCESS)
+    {
+        LogError("Failure building the header of command 0x%x", cmdCode);
+        result = TPM_RC_FAILURE;
+    }
+    else if (cmdTemplate->HeaderSize > sizeof(cmdTemplate->Header))
+    {
+        LogError("Command header size %u exceeds the template size", cmdTemplate->HeaderSize);
+        result = TPM_RC_SIZE;
+    }
+    else
+    {
+        cmdTemplate->CmdCode = cmdCode;
+        cmdTemplate->NumHandles = (UINT32)numHandles;
+        result = TPM_RC_SUCCESS;
+    }
+    return result;
+}
+
+TPM_RC TSS_DispatchCompiled(
+    TSS_DEVICE             *tpm,                // IN/OUT
+    const TSS_CMD_TEMPLATE *cmdTemplate,        // IN
+    BYTE                   *params,             // IN (opt)
+    UINT32                  paramsSize          // IN
+)
+{
+    TPM_RC result;
+    if (tpm == NULL || cmdTemplate == NULL || (params == NULL && paramsSize != 0))
+    {
+        LogError("Invalid parameter specified tpm: %p, cmdTemplate: %p, params: %p", tpm, cmdTemplate, params);
+        result = TPM_RC_FAILURE;
+    }
+    else if (paramsSize > MAX_COMMAND_BUFFER - cmdTemplate->HeaderSize)
+    {
+        LogError("Invalid parameters size specified %u", paramsSize);
+        result = TPM_RC_SIZE;
+    }
+    else
+    {
+        result = TPM_RC_SUCCESS;
+        BEGIN_COMPILED_CMD(cmdTemplate);
+        if (paramsSize != 0)
+        {
+            MemoryCopy(paramBuf, params, paramsSize);
+        }
+        cmdCtx->ParamSize = paramsSize;
+        DISPATCH_CMD();
+        END_CMD();
+    }
+    return result;
+}
+
+TPM_RC TSS_HMAC_Compiled(
+    TSS_DEVICE             *tpm,                // IN/OUT
+    const TSS_CMD_TEMPLATE *cmdTemplate,        // IN
+    BYTE                   *data,               // IN
+    UINT32                  dataSize,           // IN
+    TSS_2B_VIEW            *outHMAC             // OUT
+)
+{
+    TPM_RC result;
+    UINT32 maxInputBuffer;
+    if (dataSize > MAX_DIGEST_BUFFER)
+    {
+        LogError("Invalid data size specified %u", dataSize);
+        result = TPM_RC_SIZE;
+    }
+    else if (tpm == NULL || cmdTemplate == NULL || data == NULL || outHMAC == NULL)
+    {
+        LogError("Invalid parameter specified tpm: %p, cmdTemplate: %p, data: %p, outHMAC: %p", tpm, cmdTemplate, data, outHMAC);
+        result = TPM_RC_FAILURE;
+    }
+    else if (cmdTemplate->CmdCode != TPM_CC_HMAC || cmdTemplate->NumHandles != 1)
+    {
+        LogError("Template of command 0x%x is not a TPM2_HMAC template", cmdTemplate->CmdCode);
+        result = TPM_RC_FAILURE;
+    }
+    else if (GetCachedTpmProperty(tpm, TPM_PT_INPUT_BUFFER, &maxInputBuffer) && dataSize > maxInputBuffer)
+    {
+        LogError("Data size %u exceeds the TPM input buffer size %u", dataSize, maxInputBuffer);
+        result = TPM_RC_SIZE;
+    }
+    else
+    {
+        result = TPM_RC_SUCCESS;
+        BEGIN_COMPILED_CMD(cmdTemplate);
+        // TPM2B_MAX_BUFFER buffer followed by TPMI_ALG_HASH hashAlg
+        TSS_PUT_UINT16(paramBuf, dataSize);
+        MemoryCopy(paramBuf + sizeof(UINT16), data, dataSize);
+        TSS_PUT_UINT16(paramBuf + sizeof(UINT16) + dataSize, TPM_ALG_NULL);
+        cmdCtx->ParamSize = sizeof(UINT16) + dataSize + sizeof(TPMI_ALG_HASH);
+        DISPATCH_CMD();
+        TSS_UNMARSHAL_VIEW(outHMAC, sizeof(TPMU_HA));
+        END_CMD();
+    }
+    return result;
+}
+
+// Applies the hash policy of the device, see TSS_HASH_POLICY
+static BOOL UseHostHash(TSS_DEVICE* tpm, TPMI_ALG_HASH hashAlg, UINT32 dataSize)
+{
+    BOOL result;
+    if (tpm->HashPolicy == TSS_HASH_TPM || !tpm_host_hash_is_supported(hashAlg))
+    {
+        result = FALSE;
+    }
+    else
+    {
+        result = tpm->HashPolicy == TSS_HASH_HOST || dataSize > MAX_DIGEST_BUFFER;
+    }
+    return result;
+}
+
+TPM_RC
+TSS_Hash(
+    TSS_DEVICE             *tpm,                // IN/OUT
+    BYTE                   *data,               // IN
+    UINT32                  dataSize,           // IN
+    TPMI_ALG_HASH           hashAlg,            // IN
+    TPM2B_DIGEST           *outHash             // OUT
+)
+{
+    TPM_RC result;
+    if (tpm == NULL || (data == NULL && dataSize != 0) || outHash == NULL)
+    {
+        LogError("Invalid parameter specified tpm: %p, data: %p, outHash: %p", tpm, data, outHash);
+        result = TPM_RC_FAILURE;
+    }
+    else if (UseHostHash(tpm, hashAlg, dataSize))
+    {
+        result = tpm_host_hash(hashAlg, data, dataSize, outHash);
+    }
+    else if (dataSize > MAX_DIGEST_BUFFER)
+    {
+        LogError("Data size %u exceeds the TPM digest buffer", dataSize);
+        result = TPM_RC_SIZE;
+    }
+    else
+    {
+        result = HashBytes(tpm, data, dataSize, hashAlg, outHash);
+    }
+    return result;
+}
+
+// TPM2_Hash marshaling the data straight from the caller's buffer, so that no
+// TPM2B_MAX_BUFFER is needed on the stack
+static TPM_RC HashBytes(TSS_DEVICE* tpm, BYTE* data, UINT32 dataSize, TPMI_ALG_HASH hashAlg, TPM2B_DIGEST* outHash)
+{
+    TPMI_RH_HIERARCHY hierarchy = TPM_RH_NULL;
+
+    BEGIN_CMD(Hash, NULL, 0, NULL, 0);
+    TSS_MARSHAL_BYTES2B(data, dataSize);
+    TSS_MARSHAL(TPMI_ALG_HASH, &hashAlg);
+    TSS_MARSHAL(TPMI_RH_HIERARCHY, &hierarchy);
+    DISPATCH_CMD();
+    TSS_UNMARSHAL(TPM2B_DIGEST, outHash);
+    END_CMD();
+}
+
+TPM_RC
+TSS_PolicySecret(
+    TSS_DEVICE             *tpm,                // IN/OUT
+    TSS_SESSION            *session,            // IN/OUT
+    TPMI_DH_ENTITY          authHandle,         // IN
+    TSS_SESSION            *policySession,      // IN
+    TPM2B_NONCE            *nonceTPM,           // IN
+    INT32                   expiration          // IN
+)
+{
+    TPM_RC result;
+    TPM2B_TIMEOUT   timeout;
+    if (session == NULL || policySession == NULL)
+    {
+        LogError("Invalid parameter specified policySession: %p session: %p", policySession, session);
+        result = TPM_RC_FAILURE;
+    }
+    else
+    {
+        result = TPM2_PolicySecret(tpm, session, authHandle, policySession->SessIn.sessionHandle, nonceTPM, NULL, NULL, expiration, &timeout, NULL);
+    }
+    return result;
+}
+
+TPM_RC
+TPM2_SequenceComplete(
+    TSS_DEVICE             *tpm,                // IN/OUT
+    TSS_SESSION            *session,            // IN/OUT
+    TPMI_DH_OBJECT          sequenceHandle,     // IN
+    TPM2B_MAX_BUFFER       *buffer,             // IN
+    TPMI_RH_HIERARCHY       hierarchy,          // IN [opt]
+    TPM2B_DIGEST           *result,             // OUT
+    TPMT_TK_HASHCHECK      *validation          // OUT [opt]
+)
+{
+    BEGIN_CMD(SequenceComplete, &sequenceHandle, 1, &session, 1);
+    TSS_MARSHAL_OPT2B(TPM2B_MAX_BUFFER, buffer);
+    TSS_MARSHAL(TPMI_RH_HIERARCHY, &hierarchy);
+    DISPATCH_CMD();
+    TSS_UNMARSHAL(TPM2B_DIGEST, result);
+    TSS_UNMARSHAL_OPT(TPMT_TK_HASHCHECK, validation);
+    END_CMD();
+}
+
+TPM_RC
+TPM2_SequenceUpdate(
+    TSS_DEVICE             *tpm,                // IN/OUT
+    TSS_SESSION            *session,            // IN/OUT
+    TPMI_DH_OBJECT          sequenceHandle,     // IN
+    TPM2B_MAX_BUFFER       *buffer              // IN
+)
+{
+    BEGIN_CMD(SequenceUpdate, &sequenceHandle, 1, &session, 1);
+    TSS_MARSHAL_OPT2B(TPM2B_MAX_BUFFER, buffer);
+    DISPATCH_CMD();
+    END_CMD();
+}
+
+TPM_RC
+TPM2_Sign(
+    TSS_DEVICE             *tpm,                // IN/OUT
+    TSS_SESSION            *session,            // IN/OUT
+    TPMI_DH_OBJECT          keyHandle,          // IN
+    TPM2B_DIGEST           *digest,             // IN
+    TPMT_SIG_SCHEME        *inScheme,           // IN [opt]
+    TPMT_TK_HASHCHECK      *validation,         // IN [opt]
+    TPMT_SIGNATURE         *signature           // OUT
+)
+{
+    BEGIN_CMD(Sign, &keyHandle, 1, &session, 1);
+    TSS_MARSHAL_OPT2B(TPM2B_DIGEST, digest);
+    TSS_MARSHAL(TPMT_SIG_SCHEME, inScheme ? inScheme : &NullSigScheme);
+    TSS_MARSHAL(TPMT_TK_HASHCHECK, validation ? validation : &NullHashTk);
+    DISPATCH_CMD();
+    TSS_UNMARSHAL_FLAGGED(TPMT_SIGNATURE, signature);
+    END_CMD();
+}
+
+TPM_RC
+TSS_SequenceComplete(
+    TSS_DEVICE             *tpm,                // IN/OUT
+    TSS_SESSION            *session,            // IN/OUT
+    TPMI_DH_OBJECT          sequenceHandle,     // IN
+    BYTE                   *data,               // IN
+    UINT32                  dataSize,           // IN
+    TPM2B_DIGEST           *result              // OUT
+)
+{
+    TPMI_RH_HIERARCHY   hierarchy = TPM_RH_NULL;
+    TPMT_TK_HASHCHECK  *validation = NULL;
+
+    if (dataSize > MAX_DIGEST_BUFFER)
+        return TPM_RC_SIZE;
+
+    BEGIN_CMD(SequenceComplete, &sequenceHandle, 1, &session, 1);
+    TSS_MARSHAL_BYTES2B(data, dataSize);
+    TSS_MARSHAL(TPMI_RH_HIERARCHY, &hierarchy);
+    DISPATCH_CMD();
+    TSS_UNMARSHAL(TPM2B_DIGEST, result);
+    TSS_UNMARSHAL_OPT(TPMT_TK_HASHCHECK, validation);
+    END_CMD();
+}
+
+TPM_RC
+TSS_SequenceUpdate(
+    TSS_DEVICE             *tpm,                // IN/OUT
+    TSS_SESSION            *session,            // IN/OUT
+    TPMI_DH_OBJECT          sequenceHandle,     // IN
+    BYTE                   *data,               // IN
+    UINT32                  dataSize            // IN
+)
+{
+    if (dataSize > MAX_DIGEST_BUFFER)
+        return TPM_RC_SIZE;
+
+    BEGIN_CMD(SequenceUpdate, &sequenceHandle, 1, &session, 1);
+    TSS_MARSHAL_BYTES2B(data, dataSize);
+    DISPATCH_CMD();
+    END_CMD();
+}
+
+// Returns the largest chunk that can be passed to a single SequenceUpdate
+static UINT32 GetSequenceChunkSize(TSS_DEVICE* tpm)
+{
+    UINT32 result = TSS_GetTpmProperty(tpm, TPM_PT_INPUT_BUFFER);
+    if (result == 0 || result > MAX_DIGEST_BUFFER)
+    {
+        result = MAX_DIGEST_BUFFER;
+    }
+    return result;
+}
+
+// Feeds the data into an already started hash or HMAC sequence in chunks of at
+// most chunkSize bytes taken straight from the caller's buffer, and completes
+// it. The sequence object is flushed if any of the commands fails.
+// The updates are not pipelined, although tpm_comm_submit_async could send one
+// while the next is marshaled: all of them share the command buffer of the
+// device, a retried update must be resent as is, and the authorization of the
+// next update depends on the nonce the TPM returns for an HMAC session. The
+// marshaling of a chunk is a single copy, small next to the TPM executing it.
+static TPM_RC RunSequence(TSS_DEVICE* tpm, TSS_SESSION* session, TPMI_DH_OBJECT sequenceHandle,
+                          BYTE* data, UINT32 dataSize, UINT32 chunkSize, TPM2B_DIGEST* result)
+{
+    TPM_RC  rc = TPM_RC_SUCCESS;
+    BYTE   *curPos = data;
+    UINT32  bytesLeft = dataSize;
+
+    while (bytesLeft > chunkSize)
+    {
+        rc = TSS_SequenceUpdate(tpm, session, sequenceHandle, curPos, chunkSize);
+        if (rc != TPM_RC_SUCCESS)
+        {
+            LogError("Failed to update sequence %s", TSS_StatusValueName(rc));
+            break;
+        }
+        bytesLeft -= chunkSize;
+        curPos += chunkSize;
+    }
+
+    if (rc == TPM_RC_SUCCESS)
+    {
+        rc = TSS_SequenceComplete(tpm, session, sequenceHandle, curPos, bytesLeft, result);
+        if (rc != TPM_RC_SUCCESS)
+        {
+            LogError("Failed to complete sequence %s", TSS_StatusValueName(rc));
+        }
+    }
+
+    if (rc != TPM_RC_SUCCESS)
+    {
+        (void)TPM2_FlushContext(tpm, sequenceHandle);
+    }
+    return rc;
+}
+
+TPM_RC
+TSS_HmacSequence(
+    TSS_DEVICE             *tpm,                // IN/OUT
+    TSS_SESSION            *session,            // IN/OUT
+    TPMI_DH_OBJECT          handle,             // IN
+    TPMI_ALG_HASH           hashAlg,            // IN
+    BYTE                   *data,               // IN
+    UINT32                  dataSize,           // IN
+    TPM2B_DIGEST           *result              // OUT
+)
+{
+    TPM_RC rc;
+    if (tpm == NULL || session == NULL || (data == NULL && dataSize != 0) || result == NULL)
+    {
+        LogError("Invalid parameter specified tpm: %p, session: %p, data: %p, result: %p", tpm, session, data, result);
+        rc = TPM_RC_FAILURE;
+    }
+    else
+    {
+        TPMI_DH_OBJECT hSeq = TPM_RH_NULL;
+        UINT32 chunkSize = GetSequenceChunkSize(tpm);
+
+        rc = TPM2_HMAC_Start(tpm, session, handle, NULL, hashAlg, &hSeq);
+        if (rc != TPM_RC_SUCCESS)
+        {
+            LogError("Failed to start HMAC sequence %s", TSS_StatusValueName(rc));
+        }
+        else
+        {
+            rc = RunSequence(tpm, session, hSeq, data, dataSize, chunkSize, result);
+        }
+    }
+    return rc;
+}
+
+TPM_RC
+TSS_HashSequence(
+    TSS_DEVICE             *tpm,                // IN/OUT
+    TSS_SESSION            *session,            // IN/OUT
+    TPMI_ALG_HASH           hashAlg,            // IN
+    BYTE                   *data,               // IN
+    UINT32                  dataSize,           // IN
+    TPM2B_DIGEST           *result              // OUT
+)
+{
+    TPM_RC rc;
+    if (tpm == NULL || session == NULL || (data == NULL && dataSize != 0) || result == NULL)
+    {
+        LogError("Invalid parameter specified tpm: %p, session: %p, data: %p, result: %p", tpm, session, data, result);
+        rc = TPM_RC_FAILURE;
+    }
+    else if (UseHostHash(tpm, hashAlg, dataSize))
+    {
+        rc = tpm_host_hash(hashAlg, data, dataSize, result);
+    }
+    else
+    {
+        TPMI_DH_OBJECT hSeq = TPM_RH_NULL;
+        UINT32 chunkSize = GetSequenceChunkSize(tpm);
+
+        rc = TPM2_HashSequenceStart(tpm, NULL, hashAlg, &hSeq);
+        if (rc != TPM_RC_SUCCESS)
+        {
+            LogError("Failed to start hash sequence %s", TSS_StatusValueName(rc));
+        }
+        else
+        {
+            rc = RunSequence(tpm, session, hSeq, data, dataSize, chunkSize, result);
+        }
+    }
+    return rc;
+}
+
+TPM_RC
+TSS_Sign(
+    TSS_DEVICE             *tpm,                // IN/OUT
+    TSS_SESSION            *session,            // IN/OUT
+    TPMI_DH_OBJECT          keyHandle,          // IN
+    TPM2B_DIGEST           *digest,             // IN
+    TPMT_SIGNATURE         *signature           // OUT
+)
+{
+    return TPM2_Sign(tpm, session, keyHandle, digest, NULL, NULL, signature);
+}
+
+// TSS extensions of the TPM 2.0 command interafce
+TPM_RC
+TSS_StartAuthSession(
+    TSS_DEVICE             *tpm,                // IN/OUT
+    TPM_SE                  sessionType,        // IN
+    TPMI_ALG_HASH           authHash,           // IN
+    TPMA_SESSION            sessAttrs,          // IN
+    TSS_SESSION            *session             // OUT
+)
+{
+    TPM_RC result;
+    TPM2B_NONCE nonceCaller;
+    UINT16 digestSize = TSS_GetDigestSize(authHash);
+    nonceCaller.t.size = digestSize;
+
+    if (tpm == NULL || session == NULL)
+    {
+        LogError("Invalid parameter specified tpm: %p session: %p", tpm, session);
+        result = TPM_RC_FAILURE;
+    }
+    else if ((result = TSS_GetRandomBytes(tpm, nonceCaller.t.buffer, digestSize)) != TPM_RC_SUCCESS)
+    {
+        LogError("Failure generating the caller nonce");
+    }
+    else
+    {
+        result = TPM2_StartAuthSession(tpm, TPM_RH_NULL, TPM_RH_NULL, &nonceCaller, NULL,
+            sessionType, NULL, authHash, &session->SessIn.sessionHandle, &session->SessOut.nonce);
+        if (result == TPM_RC_SUCCESS)
+        {
+            TSS_COPY2B(session->SessIn.nonce, nonceCaller);
+            session->SessIn.sessionAttributes = sessAttrs;
+            session->SessOut.sessionAttributes = sessAttrs;
+        }
+        else
+        {
+            LogError("TPM2_StartAuthSession 0x%x: %s", result, TSS_StatusValueName(result));
+        }
+    }
+    return result;
+}
+
+// Tells whether a command failed because the TPM does not have the session
+// (or policy session handle) it referenced loaded anymore
+static BOOL IsSessionLost(TPM_RC rc)
+{
+    return (rc >= TPM_RC_REFERENCE_H0 && rc <= TPM_RC_REFERENCE_H0 + 6) ||
+           (rc >= TPM_RC_REFERENCE_S0 && rc <= TPM_RC_REFERENCE_S0 + 6) ||
+           rc == TPM_RC_HANDLE;
+}
+
+static void ClearSessionPool(TSS_SESSION_POOL* pool)
+{
+    UINT32 index;
+    for (index = 0; index < TSS_SESSION_POOL_SIZE; index++)
+    {
+        pool->Sessions[index].Loaded = FALSE;
+        pool->Sessions[index].InUse = FALSE;
+        pool->Sessions[index].Stale = FALSE;
+    }
+    pool->Limit = 0;
+}
+
+static UINT32 GetSessionPoolLimit(TSS_DEVICE* tpm)
+{
+    // Only this many objects and sessions are guaranteed to fit into the TPM
+    // at the same time. Keep room for at least one object.
+    UINT32 result = TSS_GetTpmProperty(tpm, TPM_PT_HR_LOADED_MIN);
+    if (result == TSS_BAD_PROPERTY || result < 2)
+    {
+        result = 1;
+    }
+    else if (--result > TSS_SESSION_POOL_SIZE)
+    {
+        result = TSS_SESSION_POOL_SIZE;
+    }
+    return result;
+}
+
+// Starts the session of a pool slot, replacing whatever session it held
+static TPM_RC StartPooledSession(TSS_DEVICE* tpm, TSS_POOLED_SESSION* entry)
+{
+    TPM_RC result;
+    TPMA_SESSION sessAttrs = { 0 };
+
+    if (entry->Loaded)
+    {
+        // Best effort, the TPM may have flushed it already
+        (void)TPM2_FlushContext(tpm, entry->Session.SessIn.sessionHandle);
+        entry->Loaded = FALSE;
+    }
+
+    sessAttrs.continueSession = SET;
+    if ((result = TSS_StartAuthSession(tpm, entry->SessionType, entry->AuthHash, sessAttrs, &entry->Session)) == TPM_RC_SUCCESS)
+    {
+        entry->Loaded = TRUE;
+        entry->Stale = FALSE;
+    }
+    return result;
+}
+
+// Brings an idle pooled session back to the state of a freshly started one
+static TPM_RC ResetPooledSession(TSS_DEVICE* tpm, TSS_POOLED_SESSION* entry)
+{
+    TPM_RC result;
+    if (entry->Stale)
+    {
+        result = StartPooledSession(tpm, entry);
+    }
+    else if (entry->SessionType == TPM_SE_HMAC)
+    {
+        result = TPM_RC_SUCCESS;
+    }
+    else if ((result = TPM2_PolicyRestart(tpm, entry->Session.SessIn.sessionHandle)) != TPM_RC_SUCCESS &&
+        IsSessionLost(result))
+    {
+        entry->Loaded = FALSE;
+        result = StartPooledSession(tpm, entry);
+    }
+    return result;
+}
+
+TPM_RC TSS_AcquireSession(TSS_DEVICE* tpm, TPM_SE sessionType, TPMI_ALG_HASH authHash, TSS_SESSION** session)
+{
+    TPM_RC result;
+    if (tpm == NULL || session == NULL)
+    {
+        LogError("Invalid parameter specified tpm: %p session: %p", tpm, session);
+        result = TPM_RC_FAILURE;
+    }
+    else
+    {
+        TSS_SESSION_POOL* pool = &tpm->SessionPool;
+        TSS_POOLED_SESSION* entry = NULL;
+        TSS_POOLED_SESSION* freeSlot = NULL;
+        TSS_POOLED_SESSION* idleSlot = NULL;
+        UINT32 loaded = 0;
+        UINT32 index;
+
+        if (pool->Limit == 0)
+        {
+            pool->Limit = GetSessionPoolLimit(tpm);
+        }
+
+        for (index = 0; index < TSS_SESSION_POOL_SIZE; index++)
+        {
+            TSS_POOLED_SESSION* current = &pool->Sessions[index];
+            if (!current->Loaded)
+            {
+                freeSlot = freeSlot != NULL ? freeSlot : current;
+            }
+            else
+            {
+                loaded++;
+                if (!current->InUse)
+                {
+                    if (current->SessionType == sessionType && current->AuthHash == authHash)
+                    {
+                        entry = current;
+                        break;
+                    }
+                    idleSlot = current;
+                }
+            }
+        }
+
+        if (entry != NULL)
+        {
+            result = ResetPooledSession(tpm, entry);
+        }
+        else
+        {
+            // Start a new session, reusing the slot of an idle session of
+            // another kind if the pool is full
+            entry = loaded < pool->Limit ? freeSlot : idleSlot;
+            if (entry == NULL)
+            {
+                LogError("All %u pooled sessions are in use", pool->Limit);
+                result = TPM_RC_SESSION_MEMORY;
+            }
+            else
+            {
+                entry->SessionType = sessionType;
+                entry->AuthHash = authHash;
+                result = StartPooledSession(tpm, entry);
+            }
+        }
+
+        if (result == TPM_RC_SUCCESS)
+        {
+            entry->InUse = TRUE;
+            entry->Session.SessIn.sessionAttributes.continueSession = SET;
+            entry->Session.SessIn.hmac.t.size = 0;
+            *session = &entry->Session;
+        }
+        else if (entry != NULL)
+        {
+            LogError("Failure preparing pooled session 0x%x: %s", result, TSS_StatusValueName(result));
+        }
+    }
+    return result;
+}
+
+void TSS_ReleaseSession(TSS_DEVICE* tpm, TSS_SESSION* session, TPM_RC lastResult)
+{
+    UINT32 index;
+    if (tpm == NULL || session == NULL)
+    {
+        LogError("Invalid parameter specified tpm: %p session: %p", tpm, session);
+    }
+    else
+    {
+        for (index = 0; index < TSS_SESSION_POOL_SIZE; index++)
+        {
+            if (&tpm->SessionPool.Sessions[index].Session == session)
+            {
+                break;
+            }
+        }
+
+        if (index == TSS_SESSION_POOL_SIZE || !tpm->SessionPool.Sessions[index].InUse)
+        {
+            LogError("Session %p was not acquired from the pool", session);
+        }
+        else
+        {
+            TSS_POOLED_SESSION* entry = &tpm->SessionPool.Sessions[index];
+            entry->InUse = FALSE;
+            if (session->SessIn.sessionAttributes.continueSession == CLEAR)
+            {
+                // The TPM flushed the session after its last use
+                entry->Loaded = FALSE;
+            }
+            else if (IsSessionLost(lastResult))
+            {
+                entry->Stale = TRUE;
+            }
+        }
+    }
+}
+
+void TSS_FlushSessionPool(TSS_DEVICE* tpm)
+{
+    UINT32 index;
+    if (tpm == NULL)
+    {
+        LogError("Invalid parameter tpm is NULL");
+    }
+    else
+    {
+        for (index = 0; index < TSS_SESSION_POOL_SIZE; index++)
+        {
+            if (tpm->SessionPool.Sessions[index].Loaded)
+            {
+                (void)TPM2_FlushContext(tpm, tpm->SessionPool.Sessions[index].Session.SessIn.sessionHandle);
+            }
+        }
+        ClearSessionPool(&tpm->SessionPool);
+    }
+}
+
+// Fills the unused part of the pool, first from the TPM and then mixing in the
+// optional second source
+static TPM_RC FillEntropyPool(TSS_DEVICE* tpm)
+{
+    TPM_RC result = TPM_RC_SUCCESS;
+    TSS_ENTROPY_POOL* pool = &tpm->EntropyPool;
+    UINT32 filled = pool->Available;
+
+    while (filled < TSS_ENTROPY_POOL_SIZE)
+    {
+        TPM2B_DIGEST random;
+        UINT32 missing = TSS_ENTROPY_POOL_SIZE - filled;
+        if ((result = TPM2_GetRandom(tpm, (UINT16)MIN(missing, sizeof(random.t.buffer)), &random)) != TPM_RC_SUCCESS)
+        {
+            LogError("Failure getting random bytes: 0x%x", result);
+            break;
+        }
+        else if (random.t.size == 0 || random.t.size > missing)
+        {
+            LogError("Unexpected number of random bytes %u", random.t.size);
+            result = TPM_RC_FAILURE;
+            break;
+        }
+        else
+        {
+            MemoryCopy(pool->Bytes + filled, random.t.buffer, random.t.size);
+            filled += random.t.size;
+        }
+    }
+
+    if (result == TPM_RC_SUCCESS && pool->MixSource != NULL)
+    {
+        BYTE mix[TSS_ENTROPY_POOL_SIZE];
+        UINT32 index;
+        if (pool->MixSource(pool->MixContext, mix, filled - pool->Available) != 0)
+        {
+            LogError("Failure getting random bytes from the mix source");
+            result = TPM_RC_FAILURE;
+        }
+        else
+        {
+            for (index = pool->Available; index < filled; index++)
+            {
+                pool->Bytes[index] ^= mix[index - pool->Available];
+            }
+        }
+        MemorySet(mix, 0, sizeof(mix));
+    }
+
+    if (result == TPM_RC_SUCCESS)
+    {
+        pool->Available = filled;
+    }
+    else
+    {
+        MemorySet(pool->Bytes + pool->Available, 0, filled - pool->Available);
+    }
+    return result;
+}
+
+TPM_RC TSS_GetRandomBytes(TSS_DEVICE* tpm, BYTE* buffer, UINT32 size)
+{
+    TPM_RC result;
+    if (tpm == NULL || (buffer == NULL && size != 0))
+    {
+        LogError("Invalid parameter tpm: %p, buffer: %p", tpm, buffer);
+        result = TPM_RC_FAILURE;
+    }
+    else
+    {
+        TSS_ENTROPY_POOL* pool = &tpm->EntropyPool;
+        result = TPM_RC_SUCCESS;
+        while (size > 0)
+        {
+            UINT32 count;
+            if (pool->Available == 0 && (result = FillEntropyPool(tpm)) != TPM_RC_SUCCESS)
+            {
+                break;
+            }
+            // Served bytes are wiped, so that they cannot be handed out twice
+            count = MIN(size, pool->Available);
+            pool->Available -= count;
+            MemoryCopy(buffer, pool->Bytes + pool->Available, count);
+            MemorySet(pool->Bytes + pool->Available, 0, count);
+            buffer += count;
+            size -= count;
+        }
+    }
+    return result;
+}
+
+TPM_RC TSS_RefillEntropyPool(TSS_DEVICE* tpm)
+{
+    TPM_RC result;
+    if (tpm == NULL)
+    {
+        LogError("Invalid parameter tpm is NULL");
+        result = TPM_RC_FAILURE;
+    }
+    else if (tpm->EntropyPool.Available >= TSS_ENTROPY_POOL_LOW_WATER)
+    {
+        result = TPM_RC_SUCCESS;
+    }
+    else
+    {
+        result = FillEntropyPool(tpm);
+    }
+    return result;
+}
+
+//
+// TSS extensions of the TPM 2.0 command interafce
+//
+
+TPM_RC TSS_CreatePwAuthSession(TPM2B_AUTH* authValue, TSS_SESSION* session)
+{
+    TPM_RC result;
+    if (authValue == NULL || session == NULL)
+    {
+        LogError("Invalid parameter specified authValue: %p, session: %p", authValue, session);
+        result = TPM_RC_FAILURE;
+    }
+    else
+    {
+        session->SessIn.sessionHandle = TPM_RS_PW;
+        session->SessIn.nonce.t.size = 0;
+        session->SessIn.sessionAttributes.continueSession = SET;
+        TSS_COPY2B(session->SessIn.hmac, *authValue);
+        session->SessOut.sessionAttributes.continueSession = SET;
+        result = TPM_RC_SUCCESS;
+    }
+    return result;
+}
+
+TPM_RC TSS_RefreshPropertyCache(TSS_DEVICE* tpm)
+{
+    TPM_RC result;
+    if (tpm == NULL)
+    {
+        LogError("Invalid parameter tpm is NULL");
+        result = TPM_RC_FAILURE;
+    }
+    else
+    {
+        TPMI_YES_NO             more = YES;
+        TPMS_CAPABILITY_DATA    capData = { 0 };
+        TPM_PT                  nextProp = PT_FIXED;
+
+        tpm->PropCache.Valid = FALSE;
+        tpm->PropCache.Present = 0;
+        result = TPM_RC_SUCCESS;
+
+        // Normally the whole group is returned at once, but the TPM is allowed
+        // to truncate the list, so keep asking until the group is exhausted
+        while (more == YES && nextProp < PT_FIXED + TSS_FIXED_PROPERTY_COUNT)
+        {
+            UINT32 index;
+            TPM_PT lastProp = nextProp;
+
+            result = TPM2_GetCapability(tpm, TPM_CAP_TPM_PROPERTIES, nextProp,
+                                        PT_FIXED + TSS_FIXED_PROPERTY_COUNT - nextProp, &more, &capData);
+            if (result != TPM_RC_SUCCESS || capData.capability != TPM_CAP_TPM_PROPERTIES)
+            {
+                LogError("Get Capability failure %s", TSS_StatusValueName(result));
+                result = result == TPM_RC_SUCCESS ? TPM_RC_FAILURE : result;
+                break;
+            }
+
+            for (index = 0; index < capData.data.tpmProperties.count; index++)
+            {
+                TPMS_TAGGED_PROPERTY* prop = &capData.data.tpmProperties.tpmProperty[index];
+                if (prop->property >= PT_FIXED && prop->property < PT_FIXED + TSS_FIXED_PROPERTY_COUNT)
+                {
+                    tpm->PropCache.Value[prop->property - PT_FIXED] = prop->value;
+                    tpm->PropCache.Present |= (UINT64)1 << (prop->property - PT_FIXED);
+                    lastProp = prop->property;
+                }
+            }
+
+            if (capData.data.tpmProperties.count == 0 || lastProp < nextProp)
+            {
+                break;
+            }
+            nextProp = lastProp + 1;
+        }
+
+        if (result == TPM_RC_SUCCESS)
+        {
+            tpm->PropCache.Valid = TRUE;
+        }
+    }
+    return result;
+}
+
+void TSS_InvalidatePropertyCache(TSS_DEVICE* tpm)
+{
+    if (tpm != NULL)
+    {
+        tpm->PropCache.Valid = FALSE;
+        tpm->PropCache.Present = 0;
+    }
+}
+
+TPM_RC TSS_RefreshPersistentHandles(TSS_DEVICE* tpm)
+{
+    TPM_RC result;
+    if (tpm == NULL)
+    {
+        LogError("Invalid parameter tpm is NULL");
+        result = TPM_RC_FAILURE;
+    }
+    else
+    {
+        TSS_HANDLE_SET* handleSet = &tpm->PersistentHandles;
+        BOOL complete;
+
+        handleSet->Valid = FALSE;
+        result = GetHandles(tpm, HR_PERSISTENT, handleSet->Handles, TSS_MAX_PERSISTENT_HANDLES, &handleSet->Count, &complete);
+        if (result == TPM_RC_SUCCESS)
+        {
+            // An incomplete set can not tell that a handle is missing
+            handleSet->Valid = complete;
+        }
+    }
+    return result;
+}
+
+TPM_RC TSS_IsPersistentHandlePresent(TSS_DEVICE* tpm, TPM_HANDLE handle, BOOL* present)
+{
+    TPM_RC result;
+    if (tpm == NULL || present == NULL)
+    {
+        LogError("Invalid parameter tpm: %p, present: %p", tpm, present);
+        result = TPM_RC_FAILURE;
+    }
+    else if (!tpm->PersistentHandles.Valid)
+    {
+        result = TPM_RC_FAILURE;
+    }
+    else
+    {
+        UINT32 index;
+
+        *present = FALSE;
+        for (index = 0; index < tpm->PersistentHandles.Count; index++)
+        {
+            if (tpm->PersistentHandles.Handles[index] == handle)
+            {
+                *present = TRUE;
+                break;
+            }
+        }
+        result = TPM_RC_SUCCESS;
+    }
+    return result;
+}
+
+static TSS_PUBLIC_CACHE_ENTRY* FindPublicCacheEntry(TSS_PUBLIC_CACHE* cache, TPM_HANDLE handle)
+{
+    TSS_PUBLIC_CACHE_ENTRY* result = NULL;
+    UINT32 index;
+    for (index = 0; index < cache->Count; index++)
+    {
+        if (cache->Entries[index].Handle == handle)
+        {
+            result = &cache->Entries[index];
+            break;
+        }
+    }
+    return result;
+}
+
+static void AddPublicCacheEntry(TSS_DEVICE* tpm, TPM_HANDLE handle, const TPM2B_PUBLIC* publicArea, const TPM2B_NAME* name)
+{
+    if (tpm->PublicCache != NULL && (handle >> HR_SHIFT) == TPM_HT_PERSISTENT &&
+        tpm->PublicCache->Count < TSS_PUBLIC_CACHE_MAX_ENTRIES)
+    {
+        TSS_PUBLIC_CACHE_ENTRY* entry = &tpm->PublicCache->Entries[tpm->PublicCache->Count++];
+        entry->Handle = handle;
+        entry->Public = *publicArea;
+        entry->Name = *name;
+        tpm->PublicCache->Dirty = TRUE;
+    }
+}
+
+static void RemovePublicCacheEntry(TSS_PUBLIC_CACHE* cache, TPM_HANDLE handle)
+{
+    TSS_PUBLIC_CACHE_ENTRY* entry = FindPublicCacheEntry(cache, handle);
+    if (entry != NULL)
+    {
+        *entry = cache->Entries[--cache->Count];
+        cache->Dirty = TRUE;
+    }
+}
+
+// Applies a successful TPM2_EvictControl to the set of persistent handles and
+// to the public cache
+static void UpdatePersistentHandles(TSS_DEVICE* tpm, TPMI_DH_OBJECT objectHandle, TPMI_DH_PERSISTENT persistentHandle)
+{
+    TSS_HANDLE_SET* handleSet = &tpm->PersistentHandles;
+    UINT32 index;
+
+    if (tpm->PublicCache != NULL)
+    {
+        // Whatever was cached for the handle does not describe its new object
+        RemovePublicCacheEntry(tpm->PublicCache, persistentHandle);
+    }
+
+    if (handleSet->Valid)
+    {
+        for (index = 0; index < handleSet->Count; index++)
+        {
+            if (handleSet->Handles[index] == persistentHandle)
+            {
+                break;
+            }
+        }
+
+        if ((objectHandle >> HR_SHIFT) == TPM_HT_PERSISTENT)
+        {
+            // The persistent object was evicted
+            if (index < handleSet->Count)
+            {
+                handleSet->Handles[index] = handleSet->Handles[--handleSet->Count];
+            }
+        }
+        else if (index == handleSet->Count)
+        {
+            if (handleSet->Count < TSS_MAX_PERSISTENT_HANDLES)
+            {
+                handleSet->Handles[handleSet->Count++] = persistentHandle;
+            }
+            else
+            {
+                handleSet->Valid = FALSE;
+            }
+        }
+    }
+}
+
+void TSS_SetPublicCache(TSS_DEVICE* tpm, TSS_PUBLIC_CACHE* cache)
+{
+    if (tpm == NULL)
+    {
+        LogError("Invalid parameter tpm is NULL");
+    }
+    else
+    {
+        tpm->PublicCache = cache;
+    }
+}
+
+TPM_RC TSS_ReadPublicCached(TSS_DEVICE* tpm, TPM_HANDLE handle, TPM2B_PUBLIC* outPublic, TPM2B_NAME* name)
+{
+    TPM_RC result;
+    TSS_PUBLIC_CACHE_ENTRY* entry;
+    TPM2B_NAME qualifiedName;
+    BOOL present;
+
+    if (tpm == NULL || outPublic == NULL || name == NULL)
+    {
+        LogError("Invalid parameter tpm: %p, outPublic: %p, name: %p", tpm, outPublic, name);
+        result = TPM_RC_FAILURE;
+    }
+    else if (tpm->PublicCache != NULL &&
+        (entry = FindPublicCacheEntry(tpm->PublicCache, handle)) != NULL)
+    {
+        if (TSS_IsPersistentHandlePresent(tpm, handle, &present) == TPM_RC_SUCCESS && !present)
+        {
+            // The object was evicted by somebody else
+            RemovePublicCacheEntry(tpm->PublicCache, handle);
+            result = TPM_RC_HANDLE;
+        }
+        else
+        {
+            *outPublic = entry->Public;
+            *name = entry->Name;
+            result = TPM_RC_SUCCESS;
+        }
+    }
+    else if ((result = TPM2_ReadPublic(tpm, handle, outPublic, name, &qualifiedName)) == TPM_RC_SUCCESS)
+    {
+        AddPublicCacheEntry(tpm, handle, outPublic, name);
+    }
+    return result;
 }
 
-// TSS extensions of the TPM 2.0 command interafce
-TPM_RC
-TSS_StartAuthSession(
-    TSS_DEVICE             *tpm,                // IN/OUT
-    TPM_SE                  sessionType,        // IN
-    TPMI_ALG_HASH           authHash,           // IN
-    TPMA_SESSION            sessAttrs,          // IN
-    TSS_SESSION            *session             // OUT
-)
+TPM_RC TSS_ComputeObjectName(TPM2B_PUBLIC* publicArea, TPM2B_NAME* name)
 {
     TPM_RC result;
-    TPM2B_NONCE nonceCaller;
-    UINT16 digestSize = TSS_GetDigestSize(authHash);
-    nonceCaller.t.size = digestSize;
-    TSS_RandomBytes(nonceCaller.t.buffer, digestSize);
+    BYTE marshaled[sizeof(TPMT_PUBLIC)];
+    BYTE* pos = marshaled;
+    INT32 space = (INT32)sizeof(marshaled);
+    TPMI_ALG_HASH nameAlg;
+    TPM2B_DIGEST digest;
 
-    if (tpm == NULL || session == NULL)
+    if (publicArea == NULL || name == NULL)
     {
-        LogError("Invalid parameter specified tpm: %p session: %p", tpm, session);
+        LogError("Invalid parameter publicArea: %p, name: %p", publicArea, name);
         result = TPM_RC_FAILURE;
     }
+    else if (!tpm_host_hash_is_supported(nameAlg = publicArea->publicArea.nameAlg))
+    {
+        LogError("Name algorithm 0x%x cannot be computed on the host", nameAlg);
+        result = TPM_RC_HASH;
+    }
     else
     {
-        result = TPM2_StartAuthSession(tpm, TPM_RH_NULL, TPM_RH_NULL, &nonceCaller, NULL,
-            sessionType, NULL, authHash, &session->SessIn.sessionHandle, &session->SessOut.nonce);
-        if (result == TPM_RC_SUCCESS)
+        UINT16 marshaledSize = TPMT_PUBLIC_Marshal(&publicArea->publicArea, &pos, &space);
+        if ((result = tpm_host_hash(nameAlg, marshaled, marshaledSize, &digest)) != TPM_RC_SUCCESS)
         {
-            TSS_COPY2B(session->SessIn.nonce, nonceCaller);
-            session->SessIn.sessionAttributes = sessAttrs;
-            session->SessOut.sessionAttributes = sessAttrs;
+            LogError("Failure hashing the public area %s", TSS_StatusValueName(result));
         }
         else
         {
-            LogError("TPM2_StartAuthSession 0x%x: %s", result, TSS_StatusValueName(result));
+            // The algorithm identifier is big-endian, as on the wire
+            name->t.name[0] = (BYTE)(nameAlg >> 8);
+            name->t.name[1] = (BYTE)nameAlg;
+            MemoryCopy(name->t.name + sizeof(TPMI_ALG_HASH), digest.t.buffer, digest.t.size);
+            name->t.size = (UINT16)(sizeof(TPMI_ALG_HASH) + digest.t.size);
         }
     }
     return result;
 }
 
-//
-// TSS extensions of the TPM 2.0 command interafce
-//
+void TSS_SetTraceCallback(TSS_DEVICE* tpm, TSS_CMD_TRACE_CALLBACK callback, void* context)
+{
+    if (tpm == NULL)
+    {
+        LogError("Invalid parameter tpm is NULL");
+    }
+    else
+    {
+        tpm->TraceCallback = callback;
+        tpm->TraceContext = callback != NULL ? context : NULL;
+    }
+}
 
-TPM_RC TSS_CreatePwAuthSession(TPM2B_AUTH* authValue, TSS_SESSION* session)
+void TSS_SetCommandStats(TSS_DEVICE* tpm, TSS_CMD_STATS* stats)
 {
-    TPM_RC result;
-    if (authValue == NULL || session == NULL)
+    if (tpm == NULL)
     {
-        LogError("Invalid parameter specified authValue: %p, session: %p", authValue, session);
-        result = TPM_RC_FAILURE;
+        LogError("Invalid parameter tpm is NULL");
     }
     else
     {
-        session->SessIn.sessionHandle = TPM_RS_PW;
-        session->SessIn.nonce.t.size = 0;
-        session->SessIn.sessionAttributes.continueSession = SET;
-        TSS_COPY2B(session->SessIn.hmac, *authValue);
-        session->SessOut.sessionAttributes.continueSession = SET;
-        result = TPM_RC_SUCCESS;
+        tpm->CmdStats = stats;
+    }
+}
+
+void TSS_SetTranscript(TSS_DEVICE* tpm, TPM_TRANSCRIPT_HANDLE transcript)
+{
+    if (tpm == NULL)
+    {
+        LogError("Invalid parameter tpm is NULL");
+    }
+    else
+    {
+        tpm->Transcript = transcript;
+    }
+}
+
+const TSS_CMD_STATS_ENTRY* TSS_GetCommandStats(const TSS_CMD_STATS* stats, TPM_CC cmdCode)
+{
+    const TSS_CMD_STATS_ENTRY* result;
+    if (stats == NULL || cmdCode < TSS_CMD_CODE_FIRST || cmdCode > TSS_CMD_CODE_LAST)
+    {
+        LogError("Invalid parameter stats: %p, cmdCode: 0x%x", stats, cmdCode);
+        result = NULL;
+    }
+    else
+    {
+        result = &stats->Commands[cmdCode - TSS_CMD_CODE_FIRST];
+    }
+    return result;
+}
+
+static TSS_RC_CLASS GetResponseClass(TPM_RC rawResponse)
+{
+    TSS_RC_CLASS result;
+    if (rawResponse == TPM_RC_SUCCESS)
+    {
+        result = TSS_RC_CLASS_SUCCESS;
+    }
+    else if (rawResponse == TPM_RC_NOT_USED)
+    {
+        result = TSS_RC_CLASS_TRANSPORT;
+    }
+    else if (rawResponse & RC_FMT1)
+    {
+        result = TSS_RC_CLASS_FMT1_ERROR;
+    }
+    else if (IsCommMediumError(rawResponse) || (rawResponse & RC_VER1) == 0 || (rawResponse & TSS_RC_VENDOR))
+    {
+        // TPM 1.2 or vendor defined codes
+        result = TSS_RC_CLASS_OTHER;
+    }
+    else if ((rawResponse & RC_WARN) == RC_WARN)
+    {
+        result = TSS_RC_CLASS_WARNING;
+    }
+    else
+    {
+        result = TSS_RC_CLASS_ERROR;
     }
     return result;
 }
 
+// Reports the command just dispatched by the device to the attached trace
+// callback and stats
+static void TSS_RecordCommand(TSS_DEVICE* tpm, TSS_CMD_CONTEXT* cmdCtx)
+{
+    TSS_CMD_TRACE trace;
+
+    trace.CmdCode = cmdCtx->CmdCode;
+    trace.CmdSize = cmdCtx->CmdSize;
+    trace.RespSize = cmdCtx->RespSize;
+    trace.ResponseCode = tpm->LastRawResponse;
+    trace.ResponseClass = GetResponseClass(tpm->LastRawResponse);
+    trace.MarshalTime = cmdCtx->SendTime - cmdCtx->StartTime;
+    trace.TransportTime = cmdCtx->RecvTime - cmdCtx->SendTime;
+    trace.Retries = cmdCtx->Retries;
+#ifdef TSS_MEMORY_METRICS
+    trace.Allocations = (UINT32)(gballoc_getAllocationCount() - cmdCtx->StartAllocations);
+    trace.HeapInUse = gballoc_getCurrentMemoryUsed();
+    trace.StackDepth = cmdCtx->StackDepth;
+#else
+    trace.Allocations = 0;
+    trace.HeapInUse = 0;
+    trace.StackDepth = 0;
+#endif // TSS_MEMORY_METRICS
+
+    if (tpm->CmdStats != NULL && trace.CmdCode >= TSS_CMD_CODE_FIRST && trace.CmdCode <= TSS_CMD_CODE_LAST)
+    {
+        TSS_CMD_STATS_ENTRY* entry = &tpm->CmdStats->Commands[trace.CmdCode - TSS_CMD_CODE_FIRST];
+        entry->Count++;
+        entry->BytesOut += trace.CmdSize;
+        entry->BytesIn += trace.RespSize;
+        entry->MarshalTime += trace.MarshalTime;
+        entry->TransportTime += trace.TransportTime;
+        entry->Retries += trace.Retries;
+        entry->ResponseClasses[trace.ResponseClass]++;
+        entry->Allocations += trace.Allocations;
+        if (trace.HeapInUse > entry->MaxHeapInUse)
+        {
+            entry->MaxHeapInUse = trace.HeapInUse;
+        }
+        if (trace.StackDepth > entry->MaxStackDepth)
+        {
+            entry->MaxStackDepth = trace.StackDepth;
+        }
+    }
+
+    if (tpm->TraceCallback != NULL)
+    {
+        tpm->TraceCallback(tpm->TraceContext, &trace);
+    }
+}
+
 UINT32 TSS_GetTpmProperty(TSS_DEVICE* tpm, TPM_PT property)
 {
     UINT32 result;
-    TPMI_YES_NO                 more = NO;
-    TPMS_CAPABILITY_DATA        capData;
-    TPML_TAGGED_TPM_PROPERTY   *pProps = NULL;
 
-    TPM_RC TSS_LastResponseCode = TPM2_GetCapability(tpm, TPM_CAP_TPM_PROPERTIES, property, 1, &more, &capData);
-    if (TSS_LastResponseCode != TPM_RC_SUCCESS || capData.capability != TPM_CAP_TPM_PROPERTIES)
+    if (GetCachedTpmProperty(tpm, property, &result))
     {
-        LogError("Get Capability failure");
-        result = TSS_BAD_PROPERTY;
+        // Served from the property cache
     }
-    else if (capData.data.tpmProperties.count != 1)
+    else if (tpm != NULL && !tpm->PropCache.Valid && property >= PT_FIXED && property < PT_VAR &&
+        TSS_RefreshPropertyCache(tpm) == TPM_RC_SUCCESS && GetCachedTpmProperty(tpm, property, &result))
     {
-        LogError("Capability data count does not equal 1");
-        result = TSS_BAD_PROPERTY;
+        // The cache was (re)filled on demand
     }
     else
     {
-        pProps = &capData.data.tpmProperties;
-        if (pProps->tpmProperty[0].property != property)
+        TPMI_YES_NO                 more = NO;
+        TPMS_CAPABILITY_DATA        capData;
+        TPML_TAGGED_TPM_PROPERTY   *pProps = NULL;
+
+        TPM_RC TSS_LastResponseCode = TPM2_GetCapability(tpm, TPM_CAP_TPM_PROPERTIES, property, 1, &more, &capData);
+        if (TSS_LastResponseCode != TPM_RC_SUCCESS || capData.capability != TPM_CAP_TPM_PROPERTIES)
         {
+            LogError("Get Capability failure");
+            result = TSS_BAD_PROPERTY;
+        }
+        else if (capData.data.tpmProperties.count != 1)
+        {
+            LogError("Capability data count does not equal 1");
             result = TSS_BAD_PROPERTY;
         }
         else
         {
-            result = pProps->tpmProperty[0].value;
+            pProps = &capData.data.tpmProperties;
+            if (pProps->tpmProperty[0].property != property)
+            {
+                result = TSS_BAD_PROPERTY;
+            }
+            else
+            {
+                result = pProps->tpmProperty[0].value;
+            }
         }
     }
     return result;
@@ -739,14 +2389,41 @@ TPM2_ActivateCredential(
     sessions[0] = activateSess;
     sessions[1] = keySess;
 
-    BEGIN_CMD();
+    BEGIN_CMD(ActivateCredential, handles, 2, sessions, 2);
     TSS_MARSHAL(TPM2B_ID_OBJECT, credentialBlob);
     TSS_MARSHAL(TPM2B_ENCRYPTED_SECRET, secret);
-    DISPATCH_CMD(ActivateCredential, handles, 2, sessions, 2);
+    DISPATCH_CMD();
     TSS_UNMARSHAL(TPM2B_DIGEST, certInfo);
     END_CMD();
 }
 
+TPM_RC
+TPM2_ContextLoad(
+    TSS_DEVICE             *tpm,                // IN/OUT
+    TPMS_CONTEXT           *context,            // IN
+    TPMI_DH_CONTEXT        *loadedHandle        // OUT
+)
+{
+    BEGIN_CMD(ContextLoad, NULL, 0, NULL, 0);
+    TSS_MARSHAL(TPMS_CONTEXT, context);
+    DISPATCH_CMD();
+    *loadedHandle = cmdCtx->RetHandle;
+    END_CMD();
+}
+
+TPM_RC
+TPM2_ContextSave(
+    TSS_DEVICE             *tpm,                // IN/OUT
+    TPMI_DH_CONTEXT         saveHandle,         // IN
+    TPMS_CONTEXT           *context             // OUT
+)
+{
+    BEGIN_CMD(ContextSave, &saveHandle, 1, NULL, 0);
+    DISPATCH_CMD();
+    TSS_UNMARSHAL(TPMS_CONTEXT, context);
+    END_CMD();
+}
+
 TPM_RC
 TPM2_Create(
     TSS_DEVICE               *tpm,              // IN/OUT
@@ -763,12 +2440,12 @@ TPM2_Create(
     TPMT_TK_CREATION         *creationTicket    // OUT
 )
 {
-    BEGIN_CMD();
+    BEGIN_CMD(Create, &parentHandle, 1, &session, 1);
     TSS_MARSHAL(TPM2B_SENSITIVE_CREATE, inSensitive);
     TSS_MARSHAL(TPM2B_PUBLIC, inPublic);
     TSS_MARSHAL(TPM2B_DATA, outsideInfo);
     TSS_MARSHAL(TPML_PCR_SELECTION, creationPCR);
-    DISPATCH_CMD(Create, &parentHandle, 1, &session, 1);
+    DISPATCH_CMD();
     TSS_UNMARSHAL(TPM2B_PRIVATE, outPrivate);
     TSS_UNMARSHAL_FLAGGED(TPM2B_PUBLIC, outPublic);
     TSS_UNMARSHAL_OPT(TPM2B_CREATION_DATA, creationData);
@@ -793,12 +2470,12 @@ TPM2_CreatePrimary(
     TPMT_TK_CREATION         *creationTicket    // OUT
 )
 {
-    BEGIN_CMD();
+    BEGIN_CMD(CreatePrimary, &primaryHandle, 1, &session, 1);
     TSS_MARSHAL(TPM2B_SENSITIVE_CREATE, inSensitive);
     TSS_MARSHAL(TPM2B_PUBLIC, inPublic);
     TSS_MARSHAL(TPM2B_DATA, outsideInfo);
     TSS_MARSHAL(TPML_PCR_SELECTION, creationPCR);
-    DISPATCH_CMD(CreatePrimary, &primaryHandle, 1, &session, 1);
+    DISPATCH_CMD();
     *objectHandle = cmdCtx->RetHandle;
     TSS_UNMARSHAL_FLAGGED(TPM2B_PUBLIC, outPublic);
     TSS_UNMARSHAL_OPT(TPM2B_CREATION_DATA, creationData);
@@ -820,12 +2497,12 @@ TPM2_EncryptDecrypt(
     TPM2B_IV               *ivOut               // OUT [opt]
 )
 {
-    BEGIN_CMD();
+    BEGIN_CMD(EncryptDecrypt, &keyHandle, 1, &session, 1);
     TSS_MARSHAL(TPMI_YES_NO, &decrypt);
     TSS_MARSHAL(TPM_ALG_ID, &cipherMode);
     TSS_MARSHAL_OPT2B(TPM2B_IV, ivIn);
     TSS_MARSHAL(TPM2B_MAX_BUFFER, inData);
-    DISPATCH_CMD(EncryptDecrypt, &keyHandle, 1, &session, 1);
+    DISPATCH_CMD();
     TSS_UNMARSHAL(TPM2B_MAX_BUFFER, outData);
     TSS_UNMARSHAL_OPT(TPM2B_IV, ivOut);
     END_CMD();
@@ -844,9 +2521,10 @@ TPM2_EvictControl(
     handles[0] = auth;
     handles[1] = objectHandle;
 
-    BEGIN_CMD();
+    BEGIN_CMD(EvictControl, handles, 2, &session, 1);
     TSS_MARSHAL(TPMI_DH_PERSISTENT, &persistentHandle);
-    DISPATCH_CMD(EvictControl, handles, 2, &session, 1);
+    DISPATCH_CMD();
+    UpdatePersistentHandles(tpm, objectHandle, persistentHandle);
     END_CMD();
 }
 
@@ -856,8 +2534,8 @@ TPM2_FlushContext(
     TPMI_DH_CONTEXT         flushHandle         // IN
 )
 {
-    BEGIN_CMD();
-    DISPATCH_CMD(FlushContext, &flushHandle, 1, NULL, 0);
+    BEGIN_CMD(FlushContext, &flushHandle, 1, NULL, 0);
+    DISPATCH_CMD();
     END_CMD();
 }
 
@@ -871,16 +2549,30 @@ TPM2_GetCapability(
     TPMS_CAPABILITY_DATA   *capabilityData      // OUT
 )
 {
-    BEGIN_CMD();
+    BEGIN_CMD(GetCapability, NULL, 0, NULL, 0);
     TSS_MARSHAL(TPM_CAP, &capability);
     TSS_MARSHAL(UINT32, &property);
     TSS_MARSHAL(UINT32, &propertyCount);
-    DISPATCH_CMD(GetCapability, NULL, 0, NULL, 0);
+    DISPATCH_CMD();
     TSS_UNMARSHAL(TPMI_YES_NO, moreData);
     TSS_UNMARSHAL(TPMS_CAPABILITY_DATA, capabilityData);
     END_CMD();
 }
 
+TPM_RC
+TPM2_GetRandom(
+    TSS_DEVICE             *tpm,                // IN/OUT
+    UINT16                  bytesRequested,     // IN
+    TPM2B_DIGEST           *randomBytes         // OUT
+)
+{
+    BEGIN_CMD(GetRandom, NULL, 0, NULL, 0);
+    TSS_MARSHAL(UINT16, &bytesRequested);
+    DISPATCH_CMD();
+    TSS_UNMARSHAL(TPM2B_DIGEST, randomBytes);
+    END_CMD();
+}
+
 TPM_RC
 TPM2_Hash(
     TSS_DEVICE             *tpm,                // IN/OUT
@@ -891,11 +2583,11 @@ TPM2_Hash(
     TPMT_TK_HASHCHECK      *validation          // OUT [opt]
 )
 {
-    BEGIN_CMD();
+    BEGIN_CMD(Hash, NULL, 0, NULL, 0);
     TSS_MARSHAL_OPT2B(TPM2B_MAX_BUFFER, data);
     TSS_MARSHAL(TPMI_ALG_HASH, &hashAlg);
     TSS_MARSHAL(TPMI_RH_HIERARCHY, &hierarchy);
-    DISPATCH_CMD(Hash, NULL, 0, NULL, 0);
+    DISPATCH_CMD();
     TSS_UNMARSHAL(TPM2B_DIGEST, outHash);
     TSS_UNMARSHAL_OPT(TPMT_TK_HASHCHECK, validation);
     END_CMD();
@@ -909,10 +2601,10 @@ TPM2_HashSequenceStart(
     TPMI_DH_OBJECT         *sequenceHandle      // OUT
 )
 {
-    BEGIN_CMD();
+    BEGIN_CMD(HashSequenceStart, NULL, 0, NULL, 0);
     TSS_MARSHAL_OPT2B(TPM2B_AUTH, auth);
     TSS_MARSHAL(TPMI_ALG_HASH, &hashAlg);
-    DISPATCH_CMD(HashSequenceStart, NULL, 0, NULL, 0);
+    DISPATCH_CMD();
     *sequenceHandle = cmdCtx->RetHandle;
     END_CMD();
 }
@@ -927,10 +2619,10 @@ TPM2_HMAC_Start(
     TPMI_DH_OBJECT         *sequenceHandle      // OUT
 )
 {
-    BEGIN_CMD();
+    BEGIN_CMD(HMAC_Start, &handle, 1, &session, 1);
     TSS_MARSHAL_OPT2B(TPM2B_AUTH, auth);
     TSS_MARSHAL(TPMI_ALG_HASH, &hashAlg);
-    DISPATCH_CMD(HMAC_Start, &handle, 1, &session, 1);
+    DISPATCH_CMD();
     *sequenceHandle = cmdCtx->RetHandle;
     END_CMD();
 }
@@ -948,13 +2640,13 @@ TPM2_Import(
     TPM2B_PRIVATE          *outPrivate          // OUT
 )
 {
-    BEGIN_CMD();
+    BEGIN_CMD(Import, &parentHandle, 1, &session, 1);
     TSS_MARSHAL_OPT2B(TPM2B_DATA, encryptionKey);
     TSS_MARSHAL(TPM2B_PUBLIC, objectPublic);
     TSS_MARSHAL(TPM2B_PRIVATE, duplicate);
     TSS_MARSHAL_OPT2B(TPM2B_ENCRYPTED_SECRET, inSymSeed);
     TSS_MARSHAL(TPMT_SYM_DEF_OBJECT, symmetricAlg ? symmetricAlg : &NullSymDefObject);
-    DISPATCH_CMD(Import, &parentHandle, 1, &session, 1);
+    DISPATCH_CMD();
     TSS_UNMARSHAL(TPM2B_PRIVATE, outPrivate);
     END_CMD();
 }
@@ -970,15 +2662,26 @@ TPM2_Load(
     TPM2B_NAME             *name                // OUT
 )
 {
-    BEGIN_CMD();
+    BEGIN_CMD(Load, &parentHandle, 1, &session, 1);
     TSS_MARSHAL_OPT2B(TPM2B_PRIVATE, inPrivate);
     TSS_MARSHAL(TPM2B_PUBLIC, inPublic);
-    DISPATCH_CMD(Load, &parentHandle, 1, &session, 1);
+    DISPATCH_CMD();
     *objectHandle = cmdCtx->RetHandle;
     TSS_UNMARSHAL_OPT(TPM2B_NAME, name);
     END_CMD();
 }
 
+TPM_RC
+TPM2_PolicyRestart(
+    TSS_DEVICE             *tpm,                // IN/OUT
+    TPMI_SH_POLICY          sessionHandle       // IN
+)
+{
+    BEGIN_CMD(PolicyRestart, &sessionHandle, 1, NULL, 0);
+    DISPATCH_CMD();
+    END_CMD();
+}
+
 TPM_RC
 TPM2_PolicySecret(
     TSS_DEVICE             *tpm,                // IN/OUT
@@ -997,12 +2700,12 @@ TPM2_PolicySecret(
     handles[0] = authHandle;
     handles[1] = policySession;
 
-    BEGIN_CMD();
+    BEGIN_CMD(PolicySecret, handles, 2, &session, 1);
     TSS_MARSHAL_OPT2B(TPM2B_NONCE, nonceTPM);
     TSS_MARSHAL_OPT2B(TPM2B_DIGEST, cpHashA);
     TSS_MARSHAL_OPT2B(TPM2B_NONCE, policyRef);
     TSS_MARSHAL(INT32, &expiration);
-    DISPATCH_CMD(PolicySecret, handles, 2, &session, 1);
+    DISPATCH_CMD();
     TSS_UNMARSHAL(TPM2B_TIMEOUT, timeout);
     TSS_UNMARSHAL_OPT(TPMT_TK_AUTH, policyTicket);
     END_CMD();
@@ -1024,8 +2727,8 @@ TPM2_ReadPublic(
     }
     else
     {
-        BEGIN_CMD();
-        DISPATCH_CMD(ReadPublic, &objectHandle, 1, NULL, 0);
+        BEGIN_CMD(ReadPublic, &objectHandle, 1, NULL, 0);
+        DISPATCH_CMD();
         TSS_UNMARSHAL_FLAGGED(TPM2B_PUBLIC, outPublic);
         TSS_UNMARSHAL(TPM2B_NAME, name);
         TSS_UNMARSHAL(TPM2B_NAME, qualifiedName);
@@ -1033,15 +2736,137 @@ TPM2_ReadPublic(
     }
 }
 
+TPM_RC
+TPM2_ReadPublic_View(
+    TSS_DEVICE         *tpm,                    // IN/OUT
+    TPMI_DH_OBJECT      objectHandle,           // IN
+    TSS_2B_VIEW        *outPublic,              // OUT
+    TSS_2B_VIEW        *name,                   // OUT
+    TSS_2B_VIEW        *qualifiedName           // OUT
+)
+{
+    if (outPublic == NULL || name == NULL || qualifiedName == NULL)
+    {
+        LogError("Invalid parameter outPublic: %p, name: %p, qualifiedName: %p", outPublic, name, qualifiedName);
+        return TPM_RC_FAILURE;
+    }
+    else
+    {
+        BEGIN_CMD(ReadPublic, &objectHandle, 1, NULL, 0);
+        DISPATCH_CMD();
+        TSS_UNMARSHAL_VIEW(outPublic, sizeof(TPMT_PUBLIC));
+        TSS_UNMARSHAL_VIEW(name, sizeof(TPMU_NAME));
+        TSS_UNMARSHAL_VIEW(qualifiedName, sizeof(TPMU_NAME));
+        END_CMD();
+    }
+}
+
+// Sends the command either to the TPM, or to the resource manager the device
+// is attached to, which needs to know where the handle area ends
+static TSS_STATUS SubmitCommand(TSS_DEVICE* tpm, TSS_CMD_CONTEXT* cmdCtx)
+{
+    TSS_STATUS result;
+    if (tpm->ResourceMgr != NULL)
+    {
+        result = tpm_rm_submit_command(tpm->ResourceMgr, tpm, cmdCtx->NumHandles, cmdCtx->CmdBuffer,
+                                       cmdCtx->CmdSize, cmdCtx->RespBuffer, &cmdCtx->RespSize);
+    }
+    else
+    {
+        result = TSS_SendCommand(tpm, cmdCtx->CmdBuffer, cmdCtx->CmdSize, cmdCtx->RespBuffer, (INT32*)&cmdCtx->RespSize);
+    }
+    return result;
+}
+
+// Sends the command once, recording it when instrumentation is enabled. The
+// send time of a resent command stays the one of its first attempt.
+static TSS_STATUS TransmitCommand(TSS_DEVICE* tpm, TSS_CMD_CONTEXT* cmdCtx)
+{
+    TSS_STATUS result;
+
+#ifdef TSS_MEMORY_METRICS
+    if (cmdCtx->Retries == 0)
+    {
+        BYTE stackMark;
+        size_t stackTop = (size_t)&stackMark;
+        cmdCtx->StackDepth = (UINT32)(stackTop < cmdCtx->StackBase ? cmdCtx->StackBase - stackTop : stackTop - cmdCtx->StackBase);
+    }
+#endif // TSS_MEMORY_METRICS
+
+    cmdCtx->RespSize = sizeof(cmdCtx->RespBuffer);
+    if (TSS_IS_INSTRUMENTED(tpm))
+    {
+        UINT64 sendTime;
+
+        // The command may share its buffer with the response, so it is
+        // recorded before being sent
+        if (tpm->Transcript != NULL && tpm_transcript_write_command(tpm->Transcript, cmdCtx->CmdBuffer, cmdCtx->CmdSize) != 0)
+        {
+            LogError("Failure recording the command, the transcript is detached");
+            tpm->Transcript = NULL;
+        }
+        sendTime = tpm_timer_get_ns();
+        if (cmdCtx->Retries == 0)
+        {
+            cmdCtx->SendTime = sendTime;
+        }
+        result = SubmitCommand(tpm, cmdCtx);
+        cmdCtx->RecvTime = tpm_timer_get_ns();
+        if (tpm->Transcript != NULL &&
+            tpm_transcript_write_response(tpm->Transcript, cmdCtx->RespBuffer, result == TSS_SUCCESS ? cmdCtx->RespSize : 0,
+                                          cmdCtx->RecvTime - sendTime) != 0)
+        {
+            LogError("Failure recording the response, the transcript is detached");
+            tpm->Transcript = NULL;
+        }
+    }
+    else
+    {
+        result = SubmitCommand(tpm, cmdCtx);
+    }
+    return result;
+}
+
+// Whether the TPM did not execute the command only because it was busy. The
+// response code is read from the header before the response is unmarshaled.
+static BOOL IsRetryableResponse(const TSS_CMD_CONTEXT* cmdCtx)
+{
+    BOOL result;
+    if (cmdCtx->RespSize < STD_RESPONSE_HEADER)
+    {
+        result = FALSE;
+    }
+    else
+    {
+        const BYTE* pRespCode = cmdCtx->RespBuffer + sizeof(TPM_ST) + sizeof(UINT32);
+        TPM_RC respCode = ((TPM_RC)pRespCode[0] << 24) | ((TPM_RC)pRespCode[1] << 16) | ((TPM_RC)pRespCode[2] << 8) | pRespCode[3];
+        result = respCode == TPM_RC_RETRY || respCode == TPM_RC_YIELDED || respCode == TPM_RC_TESTING || respCode == TPM_RC_NV_RATE;
+    }
+    return result;
+}
+
+// Sleeps before the retry number 'retries' (starting at 0), see TSS_RETRY_POLICY
+static void WaitBeforeRetry(const TSS_RETRY_POLICY* policy, UINT32 retries)
+{
+    UINT32 delayMs = policy->InitialDelayMs;
+    UINT32 index;
+
+    for (index = 0; index < retries && delayMs < policy->MaxDelayMs; index++)
+    {
+        delayMs = delayMs > policy->MaxDelayMs / 2 ? policy->MaxDelayMs : delayMs * 2;
+    }
+    if (delayMs != 0)
+    {
+        // The timer is only used as a cheap source of jitter
+        delayMs = delayMs / 2 + (UINT32)(tpm_timer_get_ns() % (delayMs - delayMs / 2 + 1));
+    }
+    ThreadAPI_Sleep(delayMs);
+}
+
 TPM_RC
 TSS_DispatchCmd(
     TSS_DEVICE      *tpm,           // IN
-    TPM_CC           cmdCode,       // IN: Command code
-    TPM_HANDLE      *handles,       // IN (opt): Array of handles used by the command
-    INT32            numHandles,    // IN: Number of handles in 'handles'
-    TSS_SESSION    **sessions,      // IN (opt): Array of sessions
-    INT32            numSessions,   // IN: Number of sessions in 'sessions'
-    TSS_CMD_CONTEXT *cmdCtx         // IN/OUT: On input contains initialized parameter buffer
+    TSS_CMD_CONTEXT *cmdCtx         // IN/OUT: On input contains the command with marshaled parameters
                                     //     On output contains complete command and response buffers
 )
 {
@@ -1049,6 +2874,7 @@ TSS_DispatchCmd(
     TSS_STATUS  res;
     TPM_ST      tag;
     UINT32      expectedSize = 0;
+    TPM_CC      cmdCode;
 
     if (tpm == NULL || cmdCtx == NULL)
     {
@@ -1057,18 +2883,32 @@ TSS_DispatchCmd(
     }
     else
     {
+        BYTE   *pCmdSize = cmdCtx->CmdBuffer + sizeof(TPMI_ST_COMMAND_TAG);
+
+        cmdCode = cmdCtx->CmdCode;
         cmdCtx->RespBufPtr = cmdCtx->RespBuffer;
         cmdCtx->RespParamSize = 0;
         cmdCtx->RetHandle = TPM_RH_UNASSIGNED;
 
-        cmdCtx->CmdSize = TSS_BuildCommand(cmdCode, handles, numHandles, sessions, numSessions,
-            cmdCtx->ParamBuffer, cmdCtx->ParamSize, cmdCtx->CmdBuffer, sizeof(cmdCtx->CmdBuffer));
+        // The parameters were marshaled in place after the header, so only
+        // the total command size needs to be filled in
+        cmdCtx->CmdSize += cmdCtx->ParamSize;
+        UINT32_Marshal((UINT32*)&cmdCtx->CmdSize, &pCmdSize, NULL);
+
+        tpm->LastRawResponse = TPM_RC_NOT_USED;
+        cmdCtx->Retries = 0;
+        res = TransmitCommand(tpm, cmdCtx);
+        while (res == TSS_SUCCESS && TSS_MAY_RETRY(tpm, cmdCtx->Retries) && IsRetryableResponse(cmdCtx))
+        {
+            WaitBeforeRetry(&tpm->RetryPolicy, cmdCtx->Retries);
+            cmdCtx->Retries++;
+            res = TransmitCommand(tpm, cmdCtx);
+        }
 
-        cmdCtx->RespSize = sizeof(cmdCtx->RespBuffer);
-        res = TSS_SendCommand(tpm, cmdCtx->CmdBuffer, cmdCtx->CmdSize, cmdCtx->RespBuffer, (INT32*)&cmdCtx->RespSize);
         if (res != TSS_SUCCESS)
         {
             LogError("Sending command to tpm %d.", res);
+            cmdCtx->RespSize = 0;
             result = TPM_RC_COMMAND_CODE;
         }
         else
@@ -1076,7 +2916,6 @@ TSS_DispatchCmd(
             result = TPM_RC_SUCCESS;
 
             cmdCtx->RespBytesLeft = cmdCtx->RespSize;
-            tpm->LastRawResponse = TPM_RC_NOT_USED;
 
             TSS_UNMARSHAL(TPMI_ST_COMMAND_TAG, &tag);
             TSS_UNMARSHAL(UINT32, &expectedSize);
@@ -1143,6 +2982,11 @@ TSS_SendCommand(
         LogError("Invalid tpm_comm_handle specified.");
         result = TSS_E_INVALID_PARAM;
     }
+    else if (CompleteStartup(tpm, FALSE) != TPM_RC_SUCCESS)
+    {
+        // Logged by CompleteStartup
+        result = TSS_E_TPM_TRANSACTION;
+    }
     else if (tpm->tpm_comm_handle == NULL)
     {
         LogError("Invalid tpm_comm_handle specified.");
@@ -1178,31 +3022,28 @@ TPMA_OBJECT ToTpmaObject(UINT32 attrs)
 
 // Returns the size of marhaled data  in 'commandBuffer' in bytes or 0 in case of
 // failure (invalid parameters).
-UINT32
-TSS_BuildCommand(
+static TPM_RC
+TSS_BuildCommandHeader(
     TPM_CC           cmdCode,       // IN: Command code
     TPM_HANDLE      *handles,       // IN (opt): Array of handles used by the command
     INT32            numHandles,    // IN: Number of handles in 'handles'
     TSS_SESSION    **sessions,      // IN (opt): Array of sessions
     INT32            numSessions,   // IN: Number of sessions in 'sessions'
-    BYTE            *params,        // IN (opt): Marshaled command parameters
-    INT32            paramsSize,    // IN: Size of 'params' in bytes
-    BYTE            *cmdBuffer,     // OUT: Command buffer ready for sending to TPM
-    INT32            bufCapacity    // IN: Capacity of 'cmdBuffer' in bytes
+    BYTE            *cmdBuffer,     // OUT: Command buffer receiving the header
+    INT32            bufCapacity,   // IN: Capacity of 'cmdBuffer' in bytes
+    UINT32          *headerSize     // OUT: Number of bytes marshaled into 'cmdBuffer'
 )
 {
     UINT32  cmdSize = 0;
-    BYTE   *pCmdSize = NULL;
     TPM_ST  tag = sessions ? TPM_ST_SESSIONS : TPM_ST_NO_SESSIONS;
 
-    if ((cmdCode < 0x0000011f || cmdCode > 0x00000193)
+    if ((cmdCode < TSS_CMD_CODE_FIRST || cmdCode > TSS_CMD_CODE_LAST)
         || (!handles && numHandles)
         || (!sessions && numSessions)
-        || (!params && paramsSize)
         || (bufCapacity < 0)
         || (!cmdBuffer || (((UINT32)bufCapacity) < STD_RESPONSE_HEADER)))
     {
-        return 0;
+        return TPM_RC_FAILURE;
     }
 
     //
@@ -1211,9 +3052,8 @@ TSS_BuildCommand(
 
     cmdSize += TPMI_ST_COMMAND_TAG_Marshal(&tag, &cmdBuffer, &bufCapacity);
 
-    // Do not know the final size of the command buffer yet.
-    // Remeber the place to marshal it, and reserve space in the command buffer.
-    pCmdSize = cmdBuffer;
+    // Do not know the final size of the command buffer yet, so reserve space
+    // for it. It is filled in once all the parameters are marshaled.
     cmdSize += UINT32_Marshal((UINT32*)&cmdSize, &cmdBuffer, &bufCapacity);
 
     cmdSize += TPM_CC_Marshal(&cmdCode, &cmdBuffer, &bufCapacity);
@@ -1225,8 +3065,6 @@ TSS_BuildCommand(
     {
         cmdSize += TPM_HANDLE_Marshal(handles + i, &cmdBuffer, &bufCapacity);
     }
-    // cmdSize = 14
-    // bufCapacity - 4082
 
     //
     // Marshal sessions, if any
@@ -1235,28 +3073,50 @@ TSS_BuildCommand(
     {
         // Do not know the size of the authorization area yet.
         // Remeber the place to marshal it, and marshal a placeholder value for now.
-        BYTE   *pAuthSize = cmdBuffer; //t-sdks-
+        BYTE   *pAuthSize = cmdBuffer;
         UINT32  authSize = 0;
 
-        // cmdSize - 14
         cmdSize += UINT32_Marshal((UINT32*)&authSize, &cmdBuffer, &bufCapacity);
-        // cmdSize - 18
 
         // Marshal the sessions
         for (int i = 0; i < numSessions; i++)
         {
             authSize += TPMS_AUTH_COMMAND_Marshal(&sessions[i]->SessIn, &cmdBuffer, &bufCapacity);
         }
-        // CmdBuffer - zure-devices.net/devices/jebrandoDevice/n1491340412
 
         // Update total marshaled size
-        // 18 += 9;
         cmdSize += authSize;
-        // 27
 
         // And marshal auth area size into the reserved space
         UINT32_Marshal((UINT32*)&authSize, &pAuthSize, NULL);
-        // zure-devices.net/devices/jebrandoDevice
+    }
+
+    *headerSize = cmdSize;
+    return TPM_RC_SUCCESS;
+}
+
+UINT32
+TSS_BuildCommand(
+    TPM_CC           cmdCode,       // IN: Command code
+    TPM_HANDLE      *handles,       // IN (opt): Array of handles used by the command
+    INT32            numHandles,    // IN: Number of handles in 'handles'
+    TSS_SESSION    **sessions,      // IN (opt): Array of sessions
+    INT32            numSessions,   // IN: Number of sessions in 'sessions'
+    BYTE            *params,        // IN (opt): Marshaled command parameters
+    INT32            paramsSize,    // IN: Size of 'params' in bytes
+    BYTE            *cmdBuffer,     // OUT: Command buffer ready for sending to TPM
+    INT32            bufCapacity    // IN: Capacity of 'cmdBuffer' in bytes
+)
+{
+    UINT32  cmdSize = 0;
+    BYTE   *pCmdSize = cmdBuffer + sizeof(TPMI_ST_COMMAND_TAG);
+
+    if ((!params && paramsSize)
+        || TSS_BuildCommandHeader(cmdCode, handles, numHandles, sessions, numSessions,
+                                  cmdBuffer, bufCapacity, &cmdSize) != TPM_RC_SUCCESS
+        || (INT32)cmdSize > bufCapacity - paramsSize)
+    {
+        return 0;
     }
 
     //
@@ -1264,8 +3124,9 @@ TSS_BuildCommand(
     //
     if (params && paramsSize)
     {
-        // 27
-        cmdSize += BYTE_Array_Marshal(params, &cmdBuffer, &bufCapacity, paramsSize);
+        BYTE   *pParams = cmdBuffer + cmdSize;
+        bufCapacity -= cmdSize;
+        cmdSize += BYTE_Array_Marshal(params, &pParams, &bufCapacity, paramsSize);
     }
 
     // Finally marshal total command size into the reserved space
@@ -1591,13 +3452,13 @@ TPM2_StartAuthSession(
     handles[0] = tpmKey;
     handles[1] = bind;
 
-    BEGIN_CMD();
+    BEGIN_CMD(StartAuthSession, handles, 2, NULL, 0);
     TSS_MARSHAL(TPM2B_NONCE, nonceCaller);
     TSS_MARSHAL_OPT2B(TPM2B_ENCRYPTED_SECRET, encryptedSalt);
     TSS_MARSHAL(TPM_SE, &sessionType);
     TSS_MARSHAL(TPMT_SYM_DEF, symmetric ? symmetric : &NullSymDef);
     TSS_MARSHAL(TPMI_ALG_HASH, &authHash);
-    DISPATCH_CMD(StartAuthSession, handles, 2, NULL, 0);
+    DISPATCH_CMD();
     *sessionHandle = cmdCtx->RetHandle;
     TSS_UNMARSHAL(TPM2B_NONCE, nonceTPM);
     END_CMD();
@@ -1609,9 +3470,9 @@ TPM2_Startup(
     TPM_SU          startupType         // IN
 )
 {
-    BEGIN_CMD();
+    BEGIN_CMD(Startup, NULL, 0, NULL, 0);
     TSS_MARSHAL(TPM_SU, &startupType);
-    DISPATCH_CMD(Startup, NULL, 0, NULL, 0);
+    DISPATCH_CMD();
     END_CMD();
 }
 
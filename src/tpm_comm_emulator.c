@@ -4,14 +4,17 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 #include "azure_c_shared_utility/umock_c_prod.h"
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/socketio.h"
 #include "azure_c_shared_utility/tickcounter.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/threadapi.h"
 
 #include "azure_utpm_c/tpm_comm.h"
+#include "azure_utpm_c/tpm_endpoint.h"
 #include "azure_utpm_c/tpm_socket_comm.h"
 
 #ifdef WIN32
@@ -20,8 +23,13 @@
     #include <arpa/inet.h>
 #endif
 
+// Default command port. The platform port always follows the command port,
+// so an endpoint of the form "address:port" selects both.
 #define TPM_SIMULATOR_PORT              2321
-#define TPM_SIMULATOR_PLATFORM_PORT     2322
+
+// A simulator listening on the unix socket "unix://<path>" has its platform
+// socket at <path> followed by this suffix
+#define TPM_SIMULATOR_PLATFORM_SUFFIX   ".platform"
 
 #define REMOTE_SIGNAL_POWER_ON_CMD      1
 #define REMOTE_SEND_COMMAND             8
@@ -30,6 +38,15 @@
 #define REMOTE_SESSION_END_CMD          20
 #define MAX_DATA_RECV                   1024
 
+// Room for the largest TPM response, used to drop the late response of a
+// command that timed out
+#define LATE_RESPONSE_BUFFER_SIZE       4096
+
+// Connection attempts made while the platform connection is kept, and the
+// delay before the first retry, which doubles on every further retry
+#define SIMULATOR_CONNECT_ATTEMPTS      5
+#define SIMULATOR_CONNECT_BACKOFF_MS    10
+
 static const char* TPM_SIMULATOR_ADDRESS = "127.0.0.1";
 
 typedef struct TPM_COMM_INFO_TAG
@@ -38,8 +55,29 @@ typedef struct TPM_COMM_INFO_TAG
     unsigned char* recv_bytes;
     size_t recv_length;
     char* socket_ip;
+    unsigned short socket_port;
+    bool cmd_pending;
+    // Milliseconds to wait for a response, 0 for ever
+    uint32_t timeout_value;
+    // The last command timed out, and the simulator still sends its response.
+    // It is read and dropped before the next command is sent.
+    bool response_owed;
+    // Set when a late response could not be dropped, as the connection is
+    // then out of step with the simulator. Such a handle has to be recreated.
+    bool broken;
+    // The simulator was powered on for this handle and expects TPM2_Startup
+    bool powered_on;
 } TPM_COMM_INFO;
 
+// Platform connection kept across handles by tpm_comm_set_persistent_platform.
+// The simulator stays powered on while it runs and drops the connection when
+// it stops, so a live connection means no power on or startup is needed.
+// Like the simulator itself, it serves one handle at a time.
+static bool g_keep_platform;
+static TPM_SOCKET_HANDLE g_platform_conn;
+static char* g_platform_ip;
+static unsigned short g_platform_port;
+
 enum TpmSimCommands
 {
     Remote_SignalPowerOn = 1,
@@ -93,72 +131,195 @@ static void close_simulator(TPM_COMM_INFO* tpm_comm_info)
     (void)send_sync_cmd(tpm_comm_info, REMOTE_SESSION_END_CMD);
 }
 
-static int power_on_simulator(TPM_COMM_INFO* tpm_comm_info)
+static TPM_SOCKET_HANDLE connect_simulator(const char* address, unsigned short port)
 {
-    int result;
-    TPM_SOCKET_HANDLE platform_conn;
+    TPM_SOCKET_HANDLE result;
+    unsigned int backoff_ms = SIMULATOR_CONNECT_BACKOFF_MS;
+    size_t attempt = 1;
 
-    if ((platform_conn = tpm_socket_create(tpm_comm_info->socket_ip, TPM_SIMULATOR_PLATFORM_PORT) ) == NULL)
+    // A restarting simulator refuses connections for a moment
+    while ((result = tpm_socket_create(address, port)) == NULL && g_keep_platform && attempt < SIMULATOR_CONNECT_ATTEMPTS)
     {
-        LogError("Failure: connecting to tpm simulator platform interface.");
-        result = __FAILURE__;
+        ThreadAPI_Sleep(backoff_ms);
+        backoff_ms *= 2;
+        attempt++;
+    }
+    return result;
+}
+
+static void release_platform(void)
+{
+    if (g_platform_conn != NULL)
+    {
+        tpm_socket_destroy(g_platform_conn);
+        g_platform_conn = NULL;
+    }
+    free(g_platform_ip);
+    g_platform_ip = NULL;
+}
+
+// Returns true if the kept platform connection is to the simulator of
+// tpm_comm_info and is still open. The simulator never sends anything
+// unsolicited, so a readable connection has been closed by it.
+static bool is_platform_alive(TPM_COMM_INFO* tpm_comm_info)
+{
+    bool result;
+    bool is_readable = false;
+    if (g_platform_conn == NULL)
+    {
+        result = false;
+    }
+    else if (g_platform_port != tpm_comm_info->socket_port + 1 || strcmp(g_platform_ip, tpm_comm_info->socket_ip) != 0 ||
+        tpm_socket_wait_readable(g_platform_conn, 0, &is_readable) != 0 || is_readable)
+    {
+        release_platform();
+        result = false;
+    }
+    else
+    {
+        result = true;
+    }
+    return result;
+}
+
+static void keep_platform(TPM_COMM_INFO* tpm_comm_info, TPM_SOCKET_HANDLE platform_conn)
+{
+    if (mallocAndStrcpy_s(&g_platform_ip, tpm_comm_info->socket_ip) != 0)
+    {
+        // Not fatal, the next handle powers the simulator on again
+        LogError("Failure: copying simulator address");
+        tpm_socket_destroy(platform_conn);
     }
     else
     {
-        uint32_t power_on_cmd = htonl(REMOTE_SIGNAL_POWER_ON_CMD);
-        uint32_t signal_nv_cmd = htonl(REMOTE_SIGNAL_NV_ON_CMD);
+        g_platform_conn = platform_conn;
+        g_platform_port = tpm_comm_info->socket_port + 1;
+    }
+}
+
+static int signal_power_on(TPM_SOCKET_HANDLE platform_conn)
+{
+    int result;
+    uint32_t power_on_cmd = htonl(REMOTE_SIGNAL_POWER_ON_CMD);
+    uint32_t signal_nv_cmd = htonl(REMOTE_SIGNAL_NV_ON_CMD);
 
-        if (tpm_socket_send(platform_conn, (const unsigned char*)&power_on_cmd, sizeof(power_on_cmd) ) != 0)
+    if (tpm_socket_send(platform_conn, (const unsigned char*)&power_on_cmd, sizeof(power_on_cmd) ) != 0)
+    {
+        LogError("Failure sending remote handshake.");
+        result = __FAILURE__;
+    }
+    else 
+    {
+        uint32_t ack_value;
+        if (tpm_socket_read(platform_conn, (unsigned char*)&ack_value, sizeof(uint32_t)) != 0)
         {
             LogError("Failure sending remote handshake.");
             result = __FAILURE__;
         }
-        else 
+        else
         {
-            uint32_t ack_value;
-            if (tpm_socket_read(platform_conn, (unsigned char*)&ack_value, sizeof(uint32_t)) != 0)
+            if (htonl(ack_value) != 0)
             {
-                LogError("Failure sending remote handshake.");
+                LogError("Failure reading cmd sync.");
                 result = __FAILURE__;
             }
             else
             {
-                if (htonl(ack_value) != 0)
+                if (tpm_socket_send(platform_conn, (const unsigned char*)&signal_nv_cmd, sizeof(signal_nv_cmd) ) != 0)
                 {
-                    LogError("Failure reading cmd sync.");
+                    LogError("Failure sending remote handshake.");
                     result = __FAILURE__;
                 }
                 else
                 {
-                    if (tpm_socket_send(platform_conn, (const unsigned char*)&signal_nv_cmd, sizeof(signal_nv_cmd) ) != 0)
+                    if (tpm_socket_read(platform_conn, (unsigned char*)&ack_value, sizeof(uint32_t)) != 0)
                     {
                         LogError("Failure sending remote handshake.");
                         result = __FAILURE__;
                     }
                     else
                     {
-                        if (tpm_socket_read(platform_conn, (unsigned char*)&ack_value, sizeof(uint32_t)) != 0)
+                        if (htonl(ack_value) != 0)
                         {
-                            LogError("Failure sending remote handshake.");
+                            LogError("Failure reading cmd sync.");
                             result = __FAILURE__;
                         }
                         else
                         {
-                            if (htonl(ack_value) != 0)
-                            {
-                                LogError("Failure reading cmd sync.");
-                                result = __FAILURE__;
-                            }
-                            else
-                            {
-                                result = 0;
-                            }
+                            result = 0;
                         }
                     }
                 }
             }
         }
+    }
+    return result;
+}
+
+static bool is_unix_endpoint(const char* endpoint)
+{
+    return strncmp(endpoint, TPM_SOCKET_UNIX_PREFIX, sizeof(TPM_SOCKET_UNIX_PREFIX) - 1) == 0;
+}
+
+static TPM_SOCKET_HANDLE connect_platform(TPM_COMM_INFO* tpm_comm_info)
+{
+    TPM_SOCKET_HANDLE result;
+    if (is_unix_endpoint(tpm_comm_info->socket_ip))
+    {
+        size_t path_len = strlen(tpm_comm_info->socket_ip);
+        char* platform_path;
+        if ((platform_path = malloc(path_len + sizeof(TPM_SIMULATOR_PLATFORM_SUFFIX))) == NULL)
+        {
+            LogError("Failure: allocating platform socket path");
+            result = NULL;
+        }
+        else
+        {
+            memcpy(platform_path, tpm_comm_info->socket_ip, path_len);
+            memcpy(platform_path + path_len, TPM_SIMULATOR_PLATFORM_SUFFIX, sizeof(TPM_SIMULATOR_PLATFORM_SUFFIX));
+            result = connect_simulator(platform_path, 0);
+            free(platform_path);
+        }
+    }
+    else
+    {
+        result = connect_simulator(tpm_comm_info->socket_ip, tpm_comm_info->socket_port + 1);
+    }
+    return result;
+}
+
+static int power_on_simulator(TPM_COMM_INFO* tpm_comm_info)
+{
+    int result;
+    TPM_SOCKET_HANDLE platform_conn;
+
+    if (g_keep_platform && is_platform_alive(tpm_comm_info))
+    {
+        // Still powered on and started by an earlier handle
+        result = 0;
+    }
+    else if ((platform_conn = connect_platform(tpm_comm_info)) == NULL)
+    {
+        LogError("Failure: connecting to tpm simulator platform interface.");
+        result = __FAILURE__;
+    }
+    else if (signal_power_on(platform_conn) != 0)
+    {
         tpm_socket_destroy(platform_conn);
+        result = __FAILURE__;
+    }
+    else
+    {
+        tpm_comm_info->powered_on = true;
+        if (g_keep_platform)
+        {
+            keep_platform(tpm_comm_info, platform_conn);
+        }
+        else
+        {
+            tpm_socket_destroy(platform_conn);
+        }
+        result = 0;
     }
     return result;
 }
@@ -215,9 +376,49 @@ static int execute_simulator_setup(TPM_COMM_INFO* tpm_comm_info)
     return result;
 }
 
+// Resolves the simulator endpoint, so that several simulators can run on the
+// same host. The default is the local simulator on the default ports.
+static int get_simulator_endpoint(TPM_COMM_INFO* tpm_comm_info, const char* endpoint, TPM_ENDPOINT* sim_endpoint)
+{
+    int result;
+    if (tpm_endpoint_parse(endpoint, sim_endpoint) != 0)
+    {
+        LogError("Invalid simulator endpoint %s", endpoint);
+        result = __FAILURE__;
+    }
+    else if (sim_endpoint->type == TPM_ENDPOINT_DEVICE || sim_endpoint->type == TPM_ENDPOINT_FILE || sim_endpoint->type == TPM_ENDPOINT_SHM)
+    {
+        LogError("The simulator cannot be reached through %s", sim_endpoint->address);
+        result = __FAILURE__;
+    }
+    else if (sim_endpoint->port == 0xFFFF)
+    {
+        LogError("Invalid simulator port in endpoint %s, the platform port must follow it", endpoint);
+        result = __FAILURE__;
+    }
+    else
+    {
+        if (sim_endpoint->type != TPM_ENDPOINT_UNIX)
+        {
+            if (sim_endpoint->address[0] == '\0')
+            {
+                (void)strcpy(sim_endpoint->address, TPM_SIMULATOR_ADDRESS);
+            }
+            if (sim_endpoint->port == 0)
+            {
+                sim_endpoint->port = TPM_SIMULATOR_PORT;
+            }
+        }
+        tpm_comm_info->socket_port = sim_endpoint->port;
+        result = 0;
+    }
+    return result;
+}
+
 TPM_COMM_HANDLE tpm_comm_create(const char* endpoint)
 {
     TPM_COMM_INFO* result;
+    TPM_ENDPOINT sim_endpoint;
     if ((result = malloc(sizeof(TPM_COMM_INFO))) == NULL)
     {
         LogError("Failure: malloc tpm communication info.");
@@ -225,22 +426,18 @@ TPM_COMM_HANDLE tpm_comm_create(const char* endpoint)
     else
     {
         memset(result, 0, sizeof(TPM_COMM_INFO));
-        int cpy_res;
-        if (endpoint != NULL)
+        if (get_simulator_endpoint(result, endpoint, &sim_endpoint) != 0)
         {
-            cpy_res = mallocAndStrcpy_s(&result->socket_ip, endpoint);
-        }
-        else
-        {
-            cpy_res = mallocAndStrcpy_s(&result->socket_ip, TPM_SIMULATOR_ADDRESS);
+            free(result);
+            result = NULL;
         }
-        if (cpy_res != 0)
+        else if (mallocAndStrcpy_s(&result->socket_ip, sim_endpoint.address) != 0)
         {
             LogError("Failure: to copy endpoint");
             free(result);
             result = NULL;
         }
-        else if ((result->socket_conn = tpm_socket_create(result->socket_ip, TPM_SIMULATOR_PORT)) == NULL)
+        else if ((result->socket_conn = connect_simulator(result->socket_ip, result->socket_port)) == NULL)
         {
             LogError("Failure: connecting to tpm simulator.");
             free(result->socket_ip);
@@ -276,73 +473,347 @@ TPM_COMM_TYPE tpm_comm_get_type(TPM_COMM_HANDLE handle)
     return TPM_COMM_TYPE_EMULATOR;
 }
 
-int tpm_comm_submit_command(TPM_COMM_HANDLE handle, const unsigned char* cmd_bytes, uint32_t bytes_len, unsigned char* response, uint32_t* resp_len)
+bool tpm_comm_needs_startup(TPM_COMM_HANDLE handle)
+{
+    return handle != NULL && handle->powered_on;
+}
+
+int tpm_comm_set_persistent_platform(bool enable)
+{
+    g_keep_platform = enable;
+    if (!enable)
+    {
+        release_platform();
+    }
+    return 0;
+}
+
+bool tpm_comm_is_resource_managed(TPM_COMM_HANDLE handle)
+{
+    (void)handle;
+    // The simulator exposes the raw TPM
+    return false;
+}
+
+int tpm_comm_set_priority(TPM_COMM_HANDLE handle, TPM_COMM_PRIORITY priority)
 {
     int result;
-    if (handle == NULL || cmd_bytes == NULL || response == NULL || resp_len == NULL)
+    if (handle == NULL || priority > TPM_COMM_PRIORITY_HIGH)
     {
-        LogError("Invalid argument specified handle: %p, cmd_bytes: %p, response: %p, resp_len: %p.", handle, cmd_bytes, response, resp_len);
+        LogError("Invalid argument specified handle: %p, priority: %d", handle, (int)priority);
         result = __FAILURE__;
     }
     else
     {
-        // Send to TPM 
-        unsigned char locality = 0;
-        if (send_sync_cmd(handle, Remote_SendCommand) != 0)
-        {
-            LogError("Failure preparing sending Remote Command");
-            result = __FAILURE__;
-        }
-        else if (send_sync_bytes(handle, (const unsigned char*)&locality, 1) != 0)
+        // The simulator serves a single connection, so there is nothing to order
+        result = 0;
+    }
+    return result;
+}
+
+static int send_tpm_command(TPM_COMM_INFO* handle, const unsigned char* cmd_bytes, uint32_t bytes_len)
+{
+    int result;
+    unsigned char locality = 0;
+    uint32_t net_send_cmd = htonl(Remote_SendCommand);
+    uint32_t net_bytes_len = htonl(bytes_len);
+    TPM_SOCKET_BUFFER frame[4];
+
+    // The whole frame goes out in one send so it isn't split into small segments
+    frame[0].bytes = (const unsigned char*)&net_send_cmd;
+    frame[0].length = sizeof(net_send_cmd);
+    frame[1].bytes = &locality;
+    frame[1].length = 1;
+    frame[2].bytes = (const unsigned char*)&net_bytes_len;
+    frame[2].length = sizeof(net_bytes_len);
+    frame[3].bytes = cmd_bytes;
+    frame[3].length = bytes_len;
+    if (tpm_socket_send_gather(handle->socket_conn, frame, sizeof(frame) / sizeof(frame[0])) != 0)
+    {
+        LogError("Failure writing command to tpm");
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+static int read_tpm_response(TPM_COMM_INFO* handle, unsigned char* response, uint32_t* resp_len)
+{
+    int result;
+    uint32_t length_byte;
+
+    if (read_sync_cmd(handle, &length_byte) != 0)
+    {
+        LogError("Failure reading length data from tpm");
+        result = __FAILURE__;
+    }
+    else if (length_byte > *resp_len)
+    {
+        LogError("Bytes read are greater then bytes expected len_bytes:%u expected: %u", length_byte, *resp_len);
+        result = __FAILURE__;
+    }
+    else
+    {
+        *resp_len = length_byte;
+        if (read_sync_bytes(handle, response, &length_byte) != 0)
         {
-            LogError("Failure setting locality to TPM");
+            LogError("Failure reading bytes");
             result = __FAILURE__;
         }
-        else if (send_sync_cmd(handle, bytes_len) != 0)
+        else
         {
-            LogError("Failure writing command bit to tpm");
-            result = __FAILURE__;
+            // check the Ack
+            uint32_t ack_cmd;
+            if (read_sync_cmd(handle, &ack_cmd) != 0 || ack_cmd != 0)
+            {
+                LogError("Failure reading tpm ack");
+                result = __FAILURE__;
+            }
+            else
+            {
+                result = 0;
+            }
         }
-        else if (send_sync_bytes(handle, cmd_bytes, bytes_len))
+    }
+    return result;
+}
+
+static int wait_for_response(TPM_COMM_INFO* handle)
+{
+    int result;
+    bool is_readable = false;
+    if (tpm_socket_wait_readable(handle->socket_conn, handle->timeout_value, &is_readable) != 0)
+    {
+        LogError("Failure waiting for the tpm response");
+        result = __FAILURE__;
+    }
+    else if (!is_readable)
+    {
+        LogError("Timed out after %u ms waiting for the tpm", handle->timeout_value);
+        handle->response_owed = true;
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+// Reads the response of the command that timed out, with the same timeout
+static int drop_late_response(TPM_COMM_INFO* handle)
+{
+    int result;
+    unsigned char late_response[LATE_RESPONSE_BUFFER_SIZE];
+    uint32_t late_len = sizeof(late_response);
+
+    handle->response_owed = false;
+    if ((handle->timeout_value != 0 && wait_for_response(handle) != 0) ||
+        read_tpm_response(handle, late_response, &late_len) != 0)
+    {
+        if (!handle->response_owed)
         {
-            LogError("Failure writing data to tpm");
-            result = __FAILURE__;
+            LogError("Failure reading the late response, the tpm connection is out of step");
+            handle->broken = true;
         }
-        else
-        {
-            uint32_t length_byte;
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+// Sends the command once the connection carries no other response
+static int send_command(TPM_COMM_INFO* handle, const unsigned char* cmd_bytes, uint32_t bytes_len)
+{
+    int result;
+    if (handle->broken)
+    {
+        LogError("The tpm connection is out of step and has to be recreated");
+        result = __FAILURE__;
+    }
+    else if (handle->response_owed && drop_late_response(handle) != 0)
+    {
+        LogError("The response of the command that timed out is still outstanding");
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = send_tpm_command(handle, cmd_bytes, bytes_len);
+    }
+    return result;
+}
+
+int tpm_comm_submit_command(TPM_COMM_HANDLE handle, const unsigned char* cmd_bytes, uint32_t bytes_len, unsigned char* response, uint32_t* resp_len)
+{
+    int result;
+    if (handle == NULL || cmd_bytes == NULL || response == NULL || resp_len == NULL)
+    {
+        LogError("Invalid argument specified handle: %p, cmd_bytes: %p, response: %p, resp_len: %p.", handle, cmd_bytes, response, resp_len);
+        result = __FAILURE__;
+    }
+    else if (handle->cmd_pending)
+    {
+        LogError("Failure: an asynchronous command is outstanding");
+        result = __FAILURE__;
+    }
+    else if (send_command(handle, cmd_bytes, bytes_len) != 0)
+    {
+        LogError("Failure sending command to tpm");
+        result = __FAILURE__;
+    }
+    else if (handle->timeout_value != 0 && wait_for_response(handle) != 0)
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = read_tpm_response(handle, response, resp_len);
+    }
+    return result;
+}
 
-            if (read_sync_cmd(handle, &length_byte) != 0)
+int tpm_comm_submit_async(TPM_COMM_HANDLE handle, const unsigned char* cmd_bytes, uint32_t bytes_len)
+{
+    int result;
+    if (handle == NULL || cmd_bytes == NULL)
+    {
+        LogError("Invalid argument specified handle: %p, cmd_bytes: %p.", handle, cmd_bytes);
+        result = __FAILURE__;
+    }
+    else if (handle->cmd_pending)
+    {
+        LogError("Failure: an asynchronous command is already outstanding");
+        result = __FAILURE__;
+    }
+    else if (send_command(handle, cmd_bytes, bytes_len) != 0)
+    {
+        LogError("Failure sending command to tpm");
+        result = __FAILURE__;
+    }
+    else
+    {
+        handle->cmd_pending = true;
+        result = 0;
+    }
+    return result;
+}
+
+TPM_COMM_POLL_RESULT tpm_comm_poll_complete(TPM_COMM_HANDLE handle, unsigned char* response, uint32_t* resp_len)
+{
+    TPM_COMM_POLL_RESULT result;
+    bool is_readable = false;
+    if (handle == NULL || response == NULL || resp_len == NULL)
+    {
+        LogError("Invalid argument specified handle: %p, response: %p, resp_len: %p.", handle, response, resp_len);
+        result = TPM_COMM_POLL_ERROR;
+    }
+    else if (!handle->cmd_pending)
+    {
+        LogError("Failure: no asynchronous command is outstanding");
+        result = TPM_COMM_POLL_ERROR;
+    }
+    else if (tpm_socket_wait_readable(handle->socket_conn, 0, &is_readable) != 0)
+    {
+        LogError("Failure checking for tpm response");
+        handle->cmd_pending = false;
+        result = TPM_COMM_POLL_ERROR;
+    }
+    else if (!is_readable)
+    {
+        result = TPM_COMM_POLL_PENDING;
+    }
+    else
+    {
+        // The simulator writes the whole response at once, so once its first
+        // bytes have arrived the rest can be read without a long wait
+        handle->cmd_pending = false;
+        result = read_tpm_response(handle, response, resp_len) == 0 ? TPM_COMM_POLL_COMPLETE : TPM_COMM_POLL_ERROR;
+    }
+    return result;
+}
+
+int tpm_comm_get_wait_fd(TPM_COMM_HANDLE handle)
+{
+    int result;
+    if (handle == NULL)
+    {
+        LogError("Invalid argument specified handle: NULL");
+        result = -1;
+    }
+    else
+    {
+        result = tpm_socket_get_fd(handle->socket_conn);
+    }
+    return result;
+}
+
+int tpm_comm_set_timeout(TPM_COMM_HANDLE handle, uint32_t timeout_ms)
+{
+    int result;
+    if (handle == NULL)
+    {
+        LogError("Invalid argument specified handle: NULL");
+        result = __FAILURE__;
+    }
+    else
+    {
+        handle->timeout_value = timeout_ms;
+        result = 0;
+    }
+    return result;
+}
+
+int tpm_comm_wait_any(TPM_COMM_HANDLE* handles, size_t count, uint32_t timeout_ms, bool* ready)
+{
+    int result;
+    if (handles == NULL || ready == NULL || count == 0 || count > TPM_COMM_WAIT_MAX_HANDLES)
+    {
+        LogError("Invalid argument specified handles: %p, count: %zu, ready: %p", handles, count, ready);
+        result = -1;
+    }
+    else
+    {
+        TPM_SOCKET_HANDLE sockets[TPM_COMM_WAIT_MAX_HANDLES];
+        size_t socket_index[TPM_COMM_WAIT_MAX_HANDLES];
+        bool readable[TPM_COMM_WAIT_MAX_HANDLES];
+        size_t socket_count = 0;
+        size_t index;
+
+        result = 0;
+        for (index = 0; index < count && result == 0; index++)
+        {
+            ready[index] = false;
+            if (handles[index] == NULL)
             {
-                LogError("Failure reading length data from tpm");
-                result = __FAILURE__;
+                LogError("Invalid handle at index %zu", index);
+                result = -1;
             }
-            else if (length_byte > *resp_len)
+            else if (handles[index]->cmd_pending)
             {
-                LogError("Bytes read are greater then bytes expected len_bytes:%u expected: %u", length_byte, *resp_len);
-                result = __FAILURE__;
+                sockets[socket_count] = handles[index]->socket_conn;
+                socket_index[socket_count] = index;
+                socket_count++;
+            }
+        }
+
+        if (result == 0 && socket_count > 0)
+        {
+            if ((result = tpm_socket_wait_any(sockets, socket_count, timeout_ms == 0 ? TPM_SOCKET_WAIT_FOREVER : timeout_ms, readable)) < 0)
+            {
+                LogError("Failure waiting for the tpm responses");
+                result = -1;
             }
             else
             {
-                *resp_len = length_byte;
-                if (read_sync_bytes(handle, response, &length_byte) != 0)
+                for (index = 0; index < socket_count; index++)
                 {
-                    LogError("Failure reading bytes");
-                    result = __FAILURE__;
-                }
-                else
-                {
-                    // check the Ack
-                    uint32_t ack_cmd;
-                    if (read_sync_cmd(handle, &ack_cmd) != 0 || ack_cmd != 0)
-                    {
-                        LogError("Failure reading tpm ack");
-                        result = __FAILURE__;
-                    }
-                    else
-                    {
-                        result = 0;
-                    }
+                    ready[socket_index[index]] = readable[index];
                 }
             }
         }
@@ -10,6 +10,10 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <string.h>
+#ifndef WIN32
+#include <poll.h>
+#include <pthread.h>
+#endif
 
 #include "azure_c_shared_utility/umock_c_prod.h"
 #include "azure_c_shared_utility/gballoc.h"
@@ -24,7 +28,9 @@
 #endif
 
 #include "azure_utpm_c/tpm_comm.h"
+#include "azure_utpm_c/tpm_endpoint.h"
 #include "azure_utpm_c/tpm_socket_comm.h"
+#include "azure_utpm_c/tpm_timer.h"
 
 static const char* const TPM_DEVICE_NAME = "/dev/tpm0";
 static const char* const TPM_RM_DEVICE_NAME = "/dev/tpmrm0";
@@ -38,8 +44,15 @@ static const char* const TPM_NEW_USERMODE_RESOURCE_MGR_ARM = "/usr/lib/arm-linux
 
 #define MIN_TPM_RESPONSE_LENGTH     10
 
+// Room for the largest TPM response, used to drop the late response of a
+// command that timed out
+#define LATE_RESPONSE_BUFFER_SIZE   4096
+
 #define TPM_UM_RM_PORT              2323
 
+// Number of TPM devices whose commands are ordered by priority at the same time
+#define TPM_COMM_MAX_QUEUES         8
+
 #define REMOTE_SEND_COMMAND         8
 #define REMOTE_SESSION_END_CMD      20
 
@@ -55,8 +68,24 @@ typedef enum
 
 typedef struct TPM_COMM_INFO_TAG
 {
+    // Milliseconds the command may wait to be accepted and answered, 0 for ever
     uint32_t            timeout_value;
+    // Time the current command started waiting, 0 until it had to
+    uint64_t            wait_start;
     TPM_CONN_INFO       conn_info;
+    bool                cmd_pending;
+    // The last command timed out waiting for its response, which the TPM
+    // still sends. It is read and dropped before the next command is sent, so
+    // that it is not taken for the response of that command.
+    bool                response_owed;
+    // Set when a late response could not be dropped, as the connection is
+    // then out of step with the TPM. Such a handle has to be recreated.
+    bool                broken;
+    TPM_COMM_PRIORITY   priority;
+    // Queue of the device the handle opened, NULL for a TRM connection
+    struct TPM_COMM_QUEUE_TAG* queue;
+    // Set while the handle has the turn in its queue
+    bool                in_queue;
     union 
     {
         int                 tpm_device;
@@ -64,10 +93,208 @@ typedef struct TPM_COMM_INFO_TAG
     } dev_info;
 } TPM_COMM_INFO;
 
+// The handles of the process opened on the same TPM device send their
+// commands one at a time, in order of priority. The TPM runs a single command
+// at a time anyway, so this only decides which of the waiting commands reaches
+// it next. A synchronous command keeps its turn until its response was read,
+// an asynchronous one only until it was sent, so that a thread can have
+// commands outstanding on several handles. Handles of a TRM connection are
+// ordered by the TRM.
+typedef struct TPM_COMM_QUEUE_TAG
+{
+    // Device the handles of the queue opened, "" while the entry is unused
+    char device_path[TPM_ENDPOINT_MAX_ADDRESS];
+    size_t handle_count;
+    bool busy;
+    size_t waiting[TPM_COMM_PRIORITY_HIGH + 1];
+} TPM_COMM_QUEUE;
+
+// One lock for all the queues, which is only held while a queue is updated
+static pthread_mutex_t g_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_queue_cond = PTHREAD_COND_INITIALIZER;
+static TPM_COMM_QUEUE g_queues[TPM_COMM_MAX_QUEUES];
+
+// Finds the queue of 'device_path', or takes a free entry for it. The handle
+// is left without a queue if all the entries are taken.
+static void join_device_queue(TPM_COMM_INFO* handle, const char* device_path)
+{
+    if (strlen(device_path) >= TPM_ENDPOINT_MAX_ADDRESS || pthread_mutex_lock(&g_queue_lock) != 0)
+    {
+        LogInfo("The commands of %s are not ordered by priority", device_path);
+    }
+    else
+    {
+        TPM_COMM_QUEUE* free_queue = NULL;
+        size_t index;
+        for (index = 0; index < TPM_COMM_MAX_QUEUES && handle->queue == NULL; index++)
+        {
+            if (g_queues[index].handle_count == 0)
+            {
+                free_queue = free_queue == NULL ? &g_queues[index] : free_queue;
+            }
+            else if (strcmp(g_queues[index].device_path, device_path) == 0)
+            {
+                handle->queue = &g_queues[index];
+            }
+        }
+        if (handle->queue == NULL && free_queue != NULL)
+        {
+            memset(free_queue, 0, sizeof(TPM_COMM_QUEUE));
+            (void)strcpy(free_queue->device_path, device_path);
+            handle->queue = free_queue;
+        }
+
+        if (handle->queue == NULL)
+        {
+            LogInfo("Too many TPM devices open, the commands of %s are not ordered by priority", device_path);
+        }
+        else
+        {
+            handle->queue->handle_count++;
+        }
+        (void)pthread_mutex_unlock(&g_queue_lock);
+    }
+}
+
+static void leave_device_queue(TPM_COMM_INFO* handle)
+{
+    if (handle->queue != NULL && pthread_mutex_lock(&g_queue_lock) == 0)
+    {
+        if (--handle->queue->handle_count == 0)
+        {
+            handle->queue->device_path[0] = '\0';
+        }
+        handle->queue = NULL;
+        (void)pthread_mutex_unlock(&g_queue_lock);
+    }
+}
+
+static bool is_higher_priority_waiting(const TPM_COMM_QUEUE* queue, TPM_COMM_PRIORITY priority)
+{
+    bool result = false;
+    size_t index;
+    for (index = (size_t)priority + 1; index <= TPM_COMM_PRIORITY_HIGH; index++)
+    {
+        if (queue->waiting[index] != 0)
+        {
+            result = true;
+        }
+    }
+    return result;
+}
+
+static int enter_queue(TPM_COMM_INFO* handle)
+{
+    int result;
+    TPM_COMM_QUEUE* queue = handle->queue;
+    if (queue == NULL)
+    {
+        result = 0;
+    }
+    else if (pthread_mutex_lock(&g_queue_lock) != 0)
+    {
+        LogError("Failure acquiring command queue lock");
+        result = __FAILURE__;
+    }
+    else
+    {
+        queue->waiting[handle->priority]++;
+        while (queue->busy || is_higher_priority_waiting(queue, handle->priority))
+        {
+            (void)pthread_cond_wait(&g_queue_cond, &g_queue_lock);
+        }
+        queue->waiting[handle->priority]--;
+        queue->busy = true;
+        handle->in_queue = true;
+        (void)pthread_mutex_unlock(&g_queue_lock);
+        result = 0;
+    }
+    return result;
+}
+
+static void leave_queue(TPM_COMM_INFO* handle)
+{
+    if (handle->in_queue && pthread_mutex_lock(&g_queue_lock) == 0)
+    {
+        handle->queue->busy = false;
+        handle->in_queue = false;
+        (void)pthread_cond_broadcast(&g_queue_cond);
+        (void)pthread_mutex_unlock(&g_queue_lock);
+    }
+}
+
+// Polls until one of 'fds' is ready, timeout_ms (0 for ever) expires
+// (returns 0) or poll fails (returns -1). The timeout counts from *wait_start,
+// which is set on the first wait, and interrupted waits are resumed.
+static int poll_with_timeout(struct pollfd* fds, nfds_t count, uint32_t timeout_ms, uint64_t* wait_start)
+{
+    int result;
+    do
+    {
+        int wait_ms = -1;
+        if (timeout_ms != 0)
+        {
+            uint64_t elapsed_ms;
+            if (*wait_start == 0)
+            {
+                *wait_start = tpm_timer_get_ns();
+            }
+            elapsed_ms = (tpm_timer_get_ns() - *wait_start) / 1000000;
+            wait_ms = elapsed_ms >= timeout_ms ? 0 : (int)(timeout_ms - elapsed_ms);
+        }
+        result = poll(fds, count, wait_ms);
+    } while (result < 0 && errno == EINTR);
+
+    if (result < 0)
+    {
+        LogError("Failure polling tpm device: %d:%s.", errno, strerror(errno));
+    }
+    return result;
+}
+
+// Waits for the device opened O_NONBLOCK to report 'events'
+static int wait_for_device(TPM_COMM_INFO* tpm_info, short events)
+{
+    int result;
+    struct pollfd poll_info;
+    int poll_res;
+
+    poll_info.fd = tpm_info->dev_info.tpm_device;
+    poll_info.events = events;
+    poll_info.revents = 0;
+    if ((poll_res = poll_with_timeout(&poll_info, 1, tpm_info->timeout_value, &tpm_info->wait_start)) < 0)
+    {
+        result = __FAILURE__;
+    }
+    else if (poll_res == 0)
+    {
+        LogError("Timed out after %u ms waiting for the tpm", tpm_info->timeout_value);
+        tpm_info->response_owed = tpm_info->response_owed || (events & POLLIN) != 0;
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+static bool is_would_block(int err)
+{
+    return err == EAGAIN || err == EWOULDBLOCK;
+}
+
 static int write_data_to_tpm(TPM_COMM_INFO* tpm_info, const unsigned char* tpm_bytes, uint32_t bytes_len)
 {
     int result;
-    int resp_len = write(tpm_info->dev_info.tpm_device, tpm_bytes, bytes_len);
+    int resp_len;
+
+    // The driver takes the whole command at once, or none of it while busy
+    while ((resp_len = write(tpm_info->dev_info.tpm_device, tpm_bytes, bytes_len)) < 0 && is_would_block(errno) &&
+        wait_for_device(tpm_info, POLLOUT) == 0)
+    {
+    }
+
     if (resp_len != (int)bytes_len)
     {
         LogError("Failure writing data to tpm: %d:%s.", errno, strerror(errno));
@@ -83,7 +310,14 @@ static int write_data_to_tpm(TPM_COMM_INFO* tpm_info, const unsigned char* tpm_b
 static int read_data_from_tpm(TPM_COMM_INFO* tpm_info, unsigned char* tpm_bytes, uint32_t* bytes_len)
 {
     int result;
-    int len_read = read(tpm_info->dev_info.tpm_device, tpm_bytes, *bytes_len);
+    int len_read;
+
+    // The response is returned by a single read once the command completes
+    while ((len_read = read(tpm_info->dev_info.tpm_device, tpm_bytes, *bytes_len)) < 0 && is_would_block(errno) &&
+        wait_for_device(tpm_info, POLLIN) == 0)
+    {
+    }
+
     if (len_read < MIN_TPM_RESPONSE_LENGTH)
     {
         LogError("Failure reading data from tpm: len: %d - %d:%s.", len_read, errno, strerror(errno));
@@ -164,28 +398,90 @@ static int tpm_usermode_resmgr_connect(TPM_COMM_INFO* handle)
     return result;
 }
 
-static int send_old_um_trm_data(TPM_COMM_HANDLE handle)
+// The kernel resource managers are the tpmrm<N> devices
+static bool is_resource_manager_device(const char* device_path)
+{
+    const char* device_name = strrchr(device_path, '/');
+    device_name = device_name == NULL ? device_path : device_name + 1;
+    return strncmp(device_name, "tpmrm", 5) == 0;
+}
+
+static int connect_default(TPM_COMM_INFO* handle)
 {
     int result;
-    unsigned char debugMsgLevel = 0, commandSent = 1;
-    if ((handle->conn_info & TCI_OLD_UM_TRM) == 0)
+    // The device is non-blocking, so that waits for it honour the timeout.
+    // First check if kernel mode TPM Resource Manager is available
+    if ((handle->dev_info.tpm_device = open(TPM_RM_DEVICE_NAME, O_RDWR | O_NONBLOCK)) >= 0)
     {
-        // This is not an old TRM. No additional data are expected. 
+        handle->conn_info = TCI_SYS_DEV | TCI_TRM;
+        join_device_queue(handle, TPM_RM_DEVICE_NAME);
         result = 0;
     }
-    else if (send_sync_bytes(handle, (const unsigned char*)&debugMsgLevel, 1) != 0)
+    // If not, connect to the raw TPM device
+    else if ((handle->dev_info.tpm_device = open(TPM_DEVICE_NAME, O_RDWR | O_NONBLOCK)) >= 0)
     {
-        LogError("Failure setting debugMsgLevel to TRM");
-        result = __FAILURE__;
+        handle->conn_info = TCI_SYS_DEV;
+        join_device_queue(handle, TPM_DEVICE_NAME);
+        result = 0;
     }
-    else if (send_sync_bytes(handle, (const unsigned char*)&commandSent, 1) != 0)
+    // If the system TPM device is unavalable, try connecting to the user mode TPM resource manager
+    else
     {
-        LogError("Failure setting commandSent status to TRM");
-        result = __FAILURE__;
+        result = tpm_usermode_resmgr_connect(handle);
+    }
+    return result;
+}
+
+// An explicit endpoint is used as specified, without looking for another TPM
+static int connect_endpoint(TPM_COMM_INFO* handle, const TPM_ENDPOINT* comm_endpoint)
+{
+    int result;
+    if (comm_endpoint->type == TPM_ENDPOINT_DEVICE)
+    {
+        if ((handle->dev_info.tpm_device = open(comm_endpoint->address, O_RDWR | O_NONBLOCK)) < 0)
+        {
+            LogError("Failure: opening %s: %d:%s.", comm_endpoint->address, errno, strerror(errno));
+            result = __FAILURE__;
+        }
+        else
+        {
+            handle->conn_info = TCI_SYS_DEV | (is_resource_manager_device(comm_endpoint->address) ? TCI_TRM : 0);
+            join_device_queue(handle, comm_endpoint->address);
+            result = 0;
+        }
+    }
+    else if (comm_endpoint->type == TPM_ENDPOINT_UNIX)
+    {
+        if ((handle->dev_info.socket_conn = tpm_socket_create(comm_endpoint->address, 0)) == NULL)
+        {
+            LogError("Failure: connecting to user mode TRM at %s", comm_endpoint->address);
+            result = __FAILURE__;
+        }
+        else
+        {
+            handle->conn_info = TCI_TRM;
+            result = 0;
+        }
+    }
+    else if (comm_endpoint->type == TPM_ENDPOINT_TCP)
+    {
+        const char* address = comm_endpoint->address[0] != '\0' ? comm_endpoint->address : TPM_UM_RM_ADDRESS;
+        unsigned short port = comm_endpoint->port != 0 ? comm_endpoint->port : TPM_UM_RM_PORT;
+        if ((handle->dev_info.socket_conn = tpm_socket_create(address, port)) == NULL)
+        {
+            LogError("Failure: connecting to user mode TRM at %s:%u", address, port);
+            result = __FAILURE__;
+        }
+        else
+        {
+            handle->conn_info = TCI_TRM;
+            result = 0;
+        }
     }
     else
     {
-        result = 0;
+        LogError("The TPM cannot be reached through the endpoint %s", comm_endpoint->address);
+        result = __FAILURE__;
     }
     return result;
 }
@@ -193,26 +489,22 @@ static int send_old_um_trm_data(TPM_COMM_HANDLE handle)
 TPM_COMM_HANDLE tpm_comm_create(const char* endpoint)
 {
     TPM_COMM_INFO* result;
-    (void)endpoint;
-    if ((result = malloc(sizeof(TPM_COMM_INFO))) == NULL)
+    TPM_ENDPOINT comm_endpoint;
+    if (tpm_endpoint_parse(endpoint, &comm_endpoint) != 0)
+    {
+        LogError("Invalid tpm endpoint %s", endpoint);
+        result = NULL;
+    }
+    else if ((result = malloc(sizeof(TPM_COMM_INFO))) == NULL)
     {
         LogError("Failure: malloc tpm communication info.");
     }
     else
     {
         memset(result, 0, sizeof(TPM_COMM_INFO));
-        // First check if kernel mode TPM Resource Manager is available
-        if ((result->dev_info.tpm_device = open(TPM_RM_DEVICE_NAME, O_RDWR)) >= 0)
-        {
-            result->conn_info = TCI_SYS_DEV | TCI_TRM;
-        }
-        // If not, connect to the raw TPM device
-        else if ((result->dev_info.tpm_device = open(TPM_DEVICE_NAME, O_RDWR)) >= 0)
-        {
-            result->conn_info = TCI_SYS_DEV;
-        }
-        // If the system TPM device is unavalable, try connecting to the user mode TPM resource manager
-        else if (tpm_usermode_resmgr_connect(result) != 0)
+        result->priority = TPM_COMM_PRIORITY_NORMAL;
+        result->timeout_value = TPM_COMM_DEFAULT_TIMEOUT_MS;
+        if ((comm_endpoint.type == TPM_ENDPOINT_DEFAULT ? connect_default(result) : connect_endpoint(result, &comm_endpoint)) != 0)
         {
             LogError("Failure: connecting to the TPM device");
             free(result);
@@ -226,6 +518,7 @@ void tpm_comm_destroy(TPM_COMM_HANDLE handle)
 {
     if (handle)
     {
+        leave_device_queue(handle);
         if (handle->conn_info & TCI_SYS_DEV)
         {
             (void)close(handle->dev_info.tpm_device);
@@ -245,27 +538,123 @@ TPM_COMM_TYPE tpm_comm_get_type(TPM_COMM_HANDLE handle)
     return TPM_COMM_TYPE_LINUX;
 }
 
-int tpm_comm_submit_command(TPM_COMM_HANDLE handle, const unsigned char* cmd_bytes, uint32_t bytes_len, unsigned char* response, uint32_t* resp_len)
+bool tpm_comm_needs_startup(TPM_COMM_HANDLE handle)
+{
+    (void)handle;
+    // The firmware or the resource manager has started the TPM
+    return false;
+}
+
+int tpm_comm_set_persistent_platform(bool enable)
+{
+    (void)enable;
+    return 0;
+}
+
+bool tpm_comm_is_resource_managed(TPM_COMM_HANDLE handle)
+{
+    bool result;
+    if (handle == NULL)
+    {
+        LogError("Invalid argument specified handle: NULL");
+        result = false;
+    }
+    else
+    {
+        result = (handle->conn_info & TCI_TRM) != 0;
+    }
+    return result;
+}
+
+int tpm_comm_set_priority(TPM_COMM_HANDLE handle, TPM_COMM_PRIORITY priority)
 {
     int result;
-    if (handle == NULL || cmd_bytes == NULL || response == NULL || resp_len == NULL)
+    if (handle == NULL || priority > TPM_COMM_PRIORITY_HIGH)
     {
-        LogError("Invalid argument specified handle: %p, cmd_bytes: %p, response: %p, resp_len: %p.", handle, cmd_bytes, response, resp_len);
+        LogError("Invalid argument specified handle: %p, priority: %d", handle, (int)priority);
         result = __FAILURE__;
     }
-    else if (handle->conn_info & TCI_SYS_DEV)
+    else if (handle->cmd_pending)
+    {
+        LogError("Failure: an asynchronous command is outstanding");
+        result = __FAILURE__;
+    }
+    else
+    {
+        handle->priority = priority;
+        result = 0;
+    }
+    return result;
+}
+
+static int send_trm_command(TPM_COMM_INFO* handle, const unsigned char* cmd_bytes, uint32_t bytes_len)
+{
+    int result;
+    unsigned char locality = 0;
+    // Old TRM versions expect the debugMsgLevel and commandSent bytes as well
+    unsigned char old_trm_data[2] = { 0, 1 };
+    uint32_t net_send_cmd = htonl(REMOTE_SEND_COMMAND);
+    uint32_t net_bytes_len = htonl(bytes_len);
+    TPM_SOCKET_BUFFER frame[5];
+    size_t frame_count = 0;
+
+    // The whole frame goes out in one send so it isn't split into small segments
+    frame[frame_count].bytes = (const unsigned char*)&net_send_cmd;
+    frame[frame_count++].length = sizeof(net_send_cmd);
+    frame[frame_count].bytes = &locality;
+    frame[frame_count++].length = 1;
+    if (handle->conn_info & TCI_OLD_UM_TRM)
+    {
+        frame[frame_count].bytes = old_trm_data;
+        frame[frame_count++].length = sizeof(old_trm_data);
+    }
+    frame[frame_count].bytes = (const unsigned char*)&net_bytes_len;
+    frame[frame_count++].length = sizeof(net_bytes_len);
+    frame[frame_count].bytes = cmd_bytes;
+    frame[frame_count++].length = bytes_len;
+
+    if (tpm_socket_send_gather(handle->dev_info.socket_conn, frame, frame_count) != 0)
+    {
+        LogError("Failure writing command to tpm");
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+static int read_trm_response(TPM_COMM_INFO* handle, unsigned char* response, uint32_t* resp_len)
+{
+    int result;
+    uint32_t length_byte;
+
+    if (read_sync_cmd(handle, &length_byte) != 0)
+    {
+        LogError("Failure reading length data from tpm");
+        result = __FAILURE__;
+    }
+    else if (length_byte > *resp_len)
     {
-        // Send to TPM 
-        if (write_data_to_tpm(handle, (const unsigned char*)cmd_bytes, bytes_len) != 0)
+        LogError("Bytes read are greater then bytes expected len_bytes:%u expected: %u", length_byte, *resp_len);
+        result = __FAILURE__;
+    }
+    else
+    {
+        *resp_len = length_byte;
+        if (read_sync_bytes(handle, response, &length_byte) != 0)
         {
-            LogError("Failure setting locality to TPM");
+            LogError("Failure reading bytes");
             result = __FAILURE__;
         }
         else
         {
-            if (read_data_from_tpm(handle, response, resp_len) != 0)
+            // check the Ack
+            uint32_t ack_cmd;
+            if (read_sync_cmd(handle, &ack_cmd) != 0 || ack_cmd != 0)
             {
-                LogError("Failure reading bytes from tpm");
+                LogError("Failure reading TRM ack");
                 result = __FAILURE__;
             }
             else
@@ -274,77 +663,361 @@ int tpm_comm_submit_command(TPM_COMM_HANDLE handle, const unsigned char* cmd_byt
             }
         }
     }
+    return result;
+}
+
+static int read_response(TPM_COMM_INFO* handle, unsigned char* response, uint32_t* resp_len)
+{
+    int result;
+    if (handle->conn_info & TCI_SYS_DEV)
+    {
+        result = read_data_from_tpm(handle, response, resp_len);
+    }
+    else
+    {
+        result = read_trm_response(handle, response, resp_len);
+    }
+    return result;
+}
+
+// The device waits in read_data_from_tpm, but reads from the TRM socket block,
+// so the timeout is applied before them
+static int wait_for_trm_response(TPM_COMM_INFO* handle)
+{
+    int result;
+    bool is_ready = false;
+    if ((handle->conn_info & TCI_SYS_DEV) || handle->timeout_value == 0)
+    {
+        result = 0;
+    }
+    else if (tpm_socket_wait_readable(handle->dev_info.socket_conn, handle->timeout_value, &is_ready) != 0)
+    {
+        LogError("Failure waiting for the TRM response");
+        result = __FAILURE__;
+    }
+    else if (!is_ready)
+    {
+        LogError("Timed out after %u ms waiting for the TRM", handle->timeout_value);
+        handle->response_owed = true;
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+// Reads the response of the command that timed out, waiting for it as long as
+// for any other response
+static int drop_late_response(TPM_COMM_INFO* handle)
+{
+    int result;
+    unsigned char late_response[LATE_RESPONSE_BUFFER_SIZE];
+    uint32_t late_len = sizeof(late_response);
+
+    handle->response_owed = false;
+    if (wait_for_trm_response(handle) != 0 || read_response(handle, late_response, &late_len) != 0)
+    {
+        if (!handle->response_owed)
+        {
+            LogError("Failure reading the late response, the tpm connection is out of step");
+            handle->broken = true;
+        }
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+static int send_command(TPM_COMM_INFO* handle, const unsigned char* cmd_bytes, uint32_t bytes_len)
+{
+    int result;
+    handle->wait_start = 0;
+    if (handle->broken)
+    {
+        LogError("The tpm connection is out of step and has to be recreated");
+        result = __FAILURE__;
+    }
+    else if (handle->response_owed && drop_late_response(handle) != 0)
+    {
+        LogError("The response of the command that timed out is still outstanding");
+        result = __FAILURE__;
+    }
+    else if (handle->conn_info & TCI_SYS_DEV)
+    {
+        // The wait for a late response does not count against this command
+        handle->wait_start = 0;
+        result = write_data_to_tpm(handle, cmd_bytes, bytes_len);
+    }
     else if (handle->conn_info & TCI_TRM)
     {
-        unsigned char locality = 0;
-        if (send_sync_cmd(handle, REMOTE_SEND_COMMAND) != 0)
+        result = send_trm_command(handle, cmd_bytes, bytes_len);
+    }
+    else
+    {
+        LogError("Submitting command to an uninitialized TPM_COMM_HANDLE");
+        result = __FAILURE__;
+    }
+    return result;
+}
+
+static int is_response_ready(TPM_COMM_INFO* handle, bool* is_ready)
+{
+    int result;
+    if (handle->conn_info & TCI_SYS_DEV)
+    {
+        struct pollfd poll_info;
+        int poll_res;
+
+        poll_info.fd = handle->dev_info.tpm_device;
+        poll_info.events = POLLIN;
+        poll_info.revents = 0;
+        if ((poll_res = poll(&poll_info, 1, 0)) < 0)
         {
-            LogError("Failure preparing sending Remote Command");
+            LogError("Failure polling tpm device: %d:%s.", errno, strerror(errno));
             result = __FAILURE__;
         }
-        else if (send_sync_bytes(handle, (const unsigned char*)&locality, 1) != 0)
+        else
+        {
+            *is_ready = poll_res > 0 && (poll_info.revents & POLLIN) != 0;
+            result = 0;
+        }
+    }
+    else
+    {
+        result = tpm_socket_wait_readable(handle->dev_info.socket_conn, 0, is_ready);
+    }
+    return result;
+}
+
+int tpm_comm_submit_command(TPM_COMM_HANDLE handle, const unsigned char* cmd_bytes, uint32_t bytes_len, unsigned char* response, uint32_t* resp_len)
+{
+    int result;
+    if (handle == NULL || cmd_bytes == NULL || response == NULL || resp_len == NULL)
+    {
+        LogError("Invalid argument specified handle: %p, cmd_bytes: %p, response: %p, resp_len: %p.", handle, cmd_bytes, response, resp_len);
+        result = __FAILURE__;
+    }
+    else if (handle->cmd_pending)
+    {
+        LogError("Failure: an asynchronous command is outstanding");
+        result = __FAILURE__;
+    }
+    else if (enter_queue(handle) != 0)
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        if (send_command(handle, cmd_bytes, bytes_len) != 0)
         {
-            LogError("Failure setting locality to TPM");
+            LogError("Failure sending command to tpm");
             result = __FAILURE__;
         }
-        else if (send_old_um_trm_data(handle) != 0)
+        else if (wait_for_trm_response(handle) != 0)
         {
-            LogError("Failure communicating with old user mode TPM");
             result = __FAILURE__;
         }
-        else if (send_sync_cmd(handle, bytes_len) != 0)
+        else if (read_response(handle, response, resp_len) != 0)
         {
-            LogError("Failure writing command bit to tpm");
+            LogError("Failure reading bytes from tpm");
             result = __FAILURE__;
         }
-        else if (send_sync_bytes(handle, cmd_bytes, bytes_len))
+        else
         {
-            LogError("Failure writing data to tpm");
+            result = 0;
+        }
+        leave_queue(handle);
+    }
+    return result;
+}
+
+int tpm_comm_submit_async(TPM_COMM_HANDLE handle, const unsigned char* cmd_bytes, uint32_t bytes_len)
+{
+    int result;
+    if (handle == NULL || cmd_bytes == NULL)
+    {
+        LogError("Invalid argument specified handle: %p, cmd_bytes: %p.", handle, cmd_bytes);
+        result = __FAILURE__;
+    }
+    else if (handle->cmd_pending)
+    {
+        LogError("Failure: an asynchronous command is already outstanding");
+        result = __FAILURE__;
+    }
+    else if (enter_queue(handle) != 0)
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        if (send_command(handle, cmd_bytes, bytes_len) != 0)
+        {
+            LogError("Failure sending command to tpm");
             result = __FAILURE__;
         }
         else
         {
-            uint32_t length_byte;
+            handle->cmd_pending = true;
+            result = 0;
+        }
+        // Holding the turn until the response is read would block the
+        // commands of the other handles of the thread
+        leave_queue(handle);
+    }
+    return result;
+}
+
+TPM_COMM_POLL_RESULT tpm_comm_poll_complete(TPM_COMM_HANDLE handle, unsigned char* response, uint32_t* resp_len)
+{
+    TPM_COMM_POLL_RESULT result;
+    bool is_ready = false;
+    if (handle == NULL || response == NULL || resp_len == NULL)
+    {
+        LogError("Invalid argument specified handle: %p, response: %p, resp_len: %p.", handle, response, resp_len);
+        result = TPM_COMM_POLL_ERROR;
+    }
+    else if (!handle->cmd_pending)
+    {
+        LogError("Failure: no asynchronous command is outstanding");
+        result = TPM_COMM_POLL_ERROR;
+    }
+    else if (is_response_ready(handle, &is_ready) != 0)
+    {
+        LogError("Failure checking for tpm response");
+        handle->cmd_pending = false;
+        result = TPM_COMM_POLL_ERROR;
+    }
+    else if (!is_ready)
+    {
+        result = TPM_COMM_POLL_PENDING;
+    }
+    else
+    {
+        // The device returns the whole response in one read, and the TRM
+        // writes it at once, so the read below does not wait for the TPM
+        handle->cmd_pending = false;
+        if (read_response(handle, response, resp_len) != 0)
+        {
+            LogError("Failure reading bytes from tpm");
+            result = TPM_COMM_POLL_ERROR;
+        }
+        else
+        {
+            result = TPM_COMM_POLL_COMPLETE;
+        }
+    }
+    return result;
+}
+
+int tpm_comm_get_wait_fd(TPM_COMM_HANDLE handle)
+{
+    int result;
+    if (handle == NULL)
+    {
+        LogError("Invalid argument specified handle: NULL");
+        result = -1;
+    }
+    else if (handle->conn_info & TCI_SYS_DEV)
+    {
+        result = handle->dev_info.tpm_device;
+    }
+    else
+    {
+        result = tpm_socket_get_fd(handle->dev_info.socket_conn);
+    }
+    return result;
+}
+
+int tpm_comm_set_timeout(TPM_COMM_HANDLE handle, uint32_t timeout_ms)
+{
+    int result;
+    if (handle == NULL)
+    {
+        LogError("Invalid argument specified handle: NULL");
+        result = __FAILURE__;
+    }
+    else
+    {
+        handle->timeout_value = timeout_ms;
+        result = 0;
+    }
+    return result;
+}
+
+int tpm_comm_wait_any(TPM_COMM_HANDLE* handles, size_t count, uint32_t timeout_ms, bool* ready)
+{
+    int result;
+    if (handles == NULL || ready == NULL || count == 0 || count > TPM_COMM_WAIT_MAX_HANDLES)
+    {
+        LogError("Invalid argument specified handles: %p, count: %zu, ready: %p", handles, count, ready);
+        result = -1;
+    }
+    else
+    {
+        struct pollfd poll_info[TPM_COMM_WAIT_MAX_HANDLES];
+        size_t poll_index[TPM_COMM_WAIT_MAX_HANDLES];
+        nfds_t poll_count = 0;
+        bool buffered = false;
+        size_t index;
 
-            if (read_sync_cmd(handle, &length_byte) != 0)
+        result = 0;
+        for (index = 0; index < count && result == 0; index++)
+        {
+            ready[index] = false;
+            if (handles[index] == NULL)
             {
-                LogError("Failure reading length data from tpm");
-                result = __FAILURE__;
+                LogError("Invalid handle at index %zu", index);
+                result = -1;
             }
-            else if (length_byte > *resp_len)
+            else if (handles[index]->cmd_pending)
             {
-                LogError("Bytes read are greater then bytes expected len_bytes:%u expected: %u", length_byte, *resp_len);
-                result = __FAILURE__;
+                // Bytes already received from a TRM socket make it ready
+                if (!(handles[index]->conn_info & TCI_SYS_DEV) &&
+                    tpm_socket_wait_readable(handles[index]->dev_info.socket_conn, 0, &ready[index]) == 0 && ready[index])
+                {
+                    buffered = true;
+                }
+                poll_info[poll_count].fd = tpm_comm_get_wait_fd(handles[index]);
+                poll_info[poll_count].events = POLLIN;
+                poll_info[poll_count].revents = 0;
+                poll_index[poll_count++] = index;
+            }
+        }
+
+        if (result == 0 && poll_count > 0)
+        {
+            uint64_t wait_start = 0;
+            // Only collect the other ready handles when one already is
+            if (buffered)
+            {
+                result = poll(poll_info, poll_count, 0);
             }
             else
             {
-                *resp_len = length_byte;
-                if (read_sync_bytes(handle, response, &length_byte) != 0)
-                {
-                    LogError("Failure reading bytes");
-                    result = __FAILURE__;
-                }
-                else
+                result = poll_with_timeout(poll_info, poll_count, timeout_ms, &wait_start);
+            }
+
+            if (result >= 0)
+            {
+                result = 0;
+                for (index = 0; index < poll_count; index++)
                 {
-                    // check the Ack
-                    uint32_t ack_cmd;
-                    if (read_sync_cmd(handle, &ack_cmd) != 0 || ack_cmd != 0)
+                    if (poll_info[index].revents != 0)
                     {
-                        LogError("Failure reading TRM ack");
-                        result = __FAILURE__;
+                        ready[poll_index[index]] = true;
                     }
-                    else
+                    if (ready[poll_index[index]])
                     {
-                        result = 0;
+                        result++;
                     }
                 }
             }
         }
     }
-    else
-    {
-        LogError("Submitting command to an uninitialized TPM_COMM_HANDLE");
-        result = __FAILURE__;
-    }
     return result;
 }
@@ -0,0 +1,349 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/threadapi.h"
+
+#include "azure_utpm_c/tpm_comm.h"
+#include "azure_utpm_c/tpm_comm_replay.h"
+#include "azure_utpm_c/tpm_endpoint.h"
+#include "azure_utpm_c/tpm_timer.h"
+#include "azure_utpm_c/tpm_transcript.h"
+#include "azure_utpm_c/Tpm.h"
+
+// Offset of the command code in a command: tag, size
+#define REPLAY_CMD_CODE_OFFSET      (sizeof(TPM_ST) + sizeof(UINT32))
+#define REPLAY_NS_PER_MS            1000000ULL
+
+typedef struct TPM_COMM_INFO_TAG
+{
+    TPM_TRANSCRIPT_HANDLE transcript;
+    bool recorded_latency;
+    bool cmd_pending;
+    TPM_TRANSCRIPT_ENTRY pending;
+    // Commands that only matched the recorded ones by their command code
+    uint32_t differing_cmds;
+} TPM_COMM_INFO;
+
+static bool get_command_code(const unsigned char* cmd_bytes, uint32_t bytes_len, uint32_t* cmd_code)
+{
+    bool result;
+    if (bytes_len < REPLAY_CMD_CODE_OFFSET + sizeof(UINT32))
+    {
+        result = false;
+    }
+    else
+    {
+        const unsigned char* pos = cmd_bytes + REPLAY_CMD_CODE_OFFSET;
+        *cmd_code = ((uint32_t)pos[0] << 24) | ((uint32_t)pos[1] << 16) | ((uint32_t)pos[2] << 8) | (uint32_t)pos[3];
+        result = true;
+    }
+    return result;
+}
+
+// Waits until 'latency_ns' passed since 'start_ns'. Whole milliseconds are
+// slept, the rest is spun so that short commands keep their timing.
+static void wait_latency(uint64_t start_ns, uint64_t latency_ns)
+{
+    uint64_t elapsed;
+    while ((elapsed = tpm_timer_get_ns() - start_ns) < latency_ns)
+    {
+        if (latency_ns - elapsed >= REPLAY_NS_PER_MS)
+        {
+            ThreadAPI_Sleep((unsigned int)((latency_ns - elapsed) / REPLAY_NS_PER_MS));
+        }
+    }
+}
+
+// Consumes the record of the command, which must have the command code of the
+// command being sent
+static int match_command(TPM_COMM_INFO* handle, const unsigned char* cmd_bytes, uint32_t bytes_len, TPM_TRANSCRIPT_ENTRY* entry)
+{
+    int result;
+    uint32_t cmd_code;
+    uint32_t recorded_code;
+    if (!get_command_code(cmd_bytes, bytes_len, &cmd_code))
+    {
+        LogError("Malformed command of %u bytes", bytes_len);
+        result = __FAILURE__;
+    }
+    else if (!tpm_transcript_next(handle->transcript, entry))
+    {
+        LogError("The transcript has no record left for command 0x%x", cmd_code);
+        result = __FAILURE__;
+    }
+    else if (!get_command_code(entry->cmd_bytes, entry->cmd_len, &recorded_code) || recorded_code != cmd_code)
+    {
+        LogError("Command 0x%x does not match the recorded command", cmd_code);
+        result = __FAILURE__;
+    }
+    else if (entry->resp_len == 0)
+    {
+        LogError("The transport failed for command 0x%x when it was recorded", cmd_code);
+        result = __FAILURE__;
+    }
+    else
+    {
+        if (entry->cmd_len != bytes_len || memcmp(entry->cmd_bytes, cmd_bytes, bytes_len) != 0)
+        {
+            handle->differing_cmds++;
+        }
+        result = 0;
+    }
+    return result;
+}
+
+static int copy_response(const TPM_TRANSCRIPT_ENTRY* entry, unsigned char* response, uint32_t* resp_len)
+{
+    int result;
+    if (*resp_len < entry->resp_len)
+    {
+        LogError("Response buffer too small %u, needed %u", *resp_len, entry->resp_len);
+        result = __FAILURE__;
+    }
+    else
+    {
+        memcpy(response, entry->resp_bytes, entry->resp_len);
+        *resp_len = entry->resp_len;
+        result = 0;
+    }
+    return result;
+}
+
+TPM_COMM_HANDLE tpm_comm_create(const char* endpoint)
+{
+    TPM_COMM_INFO* result;
+    TPM_ENDPOINT replay_endpoint;
+    if (tpm_endpoint_parse(endpoint, &replay_endpoint) != 0 || replay_endpoint.type != TPM_ENDPOINT_FILE)
+    {
+        LogError("Invalid replay endpoint %s, expected file:<path>", endpoint != NULL ? endpoint : "");
+        result = NULL;
+    }
+    else if ((result = malloc(sizeof(TPM_COMM_INFO))) == NULL)
+    {
+        LogError("Failure: malloc tpm_comm_info.");
+    }
+    else
+    {
+        memset(result, 0, sizeof(TPM_COMM_INFO));
+        if ((result->transcript = tpm_transcript_open(replay_endpoint.address)) == NULL)
+        {
+            LogError("Failure opening transcript %s", replay_endpoint.address);
+            free(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+void tpm_comm_destroy(TPM_COMM_HANDLE handle)
+{
+    if (handle)
+    {
+        if (handle->differing_cmds != 0)
+        {
+            LogInfo("%u commands differed from the recorded ones beyond their command code", handle->differing_cmds);
+        }
+        tpm_transcript_close(handle->transcript);
+        free(handle);
+    }
+}
+
+TPM_COMM_TYPE tpm_comm_get_type(TPM_COMM_HANDLE handle)
+{
+    (void)handle;
+    return TPM_COMM_TYPE_REPLAY;
+}
+
+bool tpm_comm_needs_startup(TPM_COMM_HANDLE handle)
+{
+    bool result;
+    TPM_TRANSCRIPT_ENTRY entry;
+    uint32_t cmd_code;
+
+    // Follows the recording, which started with TPM2_Startup if the TPM
+    // it was taken from had just been powered on
+    result = handle != NULL && tpm_transcript_peek(handle->transcript, &entry) &&
+        get_command_code(entry.cmd_bytes, entry.cmd_len, &cmd_code) && cmd_code == TPM_CC_Startup;
+    return result;
+}
+
+int tpm_comm_set_persistent_platform(bool enable)
+{
+    (void)enable;
+    return 0;
+}
+
+bool tpm_comm_is_resource_managed(TPM_COMM_HANDLE handle)
+{
+    (void)handle;
+    return false;
+}
+
+int tpm_comm_set_priority(TPM_COMM_HANDLE handle, TPM_COMM_PRIORITY priority)
+{
+    int result;
+    if (handle == NULL || priority > TPM_COMM_PRIORITY_HIGH)
+    {
+        LogError("Invalid argument specified handle: %p, priority: %d", handle, (int)priority);
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+int tpm_comm_replay_set_latency(TPM_COMM_HANDLE handle, bool recorded)
+{
+    int result;
+    if (handle == NULL)
+    {
+        LogError("Invalid argument specified handle: NULL");
+        result = __FAILURE__;
+    }
+    else
+    {
+        handle->recorded_latency = recorded;
+        result = 0;
+    }
+    return result;
+}
+
+int tpm_comm_submit_command(TPM_COMM_HANDLE handle, const unsigned char* cmd_bytes, uint32_t bytes_len, unsigned char* response, uint32_t* resp_len)
+{
+    int result;
+    TPM_TRANSCRIPT_ENTRY entry;
+    if (handle == NULL || cmd_bytes == NULL || response == NULL || resp_len == NULL)
+    {
+        LogError("Invalid argument specified handle: %p, cmd_bytes: %p, response: %p, resp_len: %p.", handle, cmd_bytes, response, resp_len);
+        result = __FAILURE__;
+    }
+    else if (handle->cmd_pending)
+    {
+        LogError("Failure: an asynchronous command is outstanding");
+        result = __FAILURE__;
+    }
+    else
+    {
+        uint64_t start_ns = handle->recorded_latency ? tpm_timer_get_ns() : 0;
+        if (match_command(handle, cmd_bytes, bytes_len, &entry) != 0)
+        {
+            result = __FAILURE__;
+        }
+        else
+        {
+            if (handle->recorded_latency)
+            {
+                wait_latency(start_ns, entry.latency_ns);
+            }
+            result = copy_response(&entry, response, resp_len);
+        }
+    }
+    return result;
+}
+
+int tpm_comm_submit_async(TPM_COMM_HANDLE handle, const unsigned char* cmd_bytes, uint32_t bytes_len)
+{
+    int result;
+    if (handle == NULL || cmd_bytes == NULL)
+    {
+        LogError("Invalid argument specified handle: %p, cmd_bytes: %p.", handle, cmd_bytes);
+        result = __FAILURE__;
+    }
+    else if (handle->cmd_pending)
+    {
+        LogError("Failure: an asynchronous command is already outstanding");
+        result = __FAILURE__;
+    }
+    else
+    {
+        uint64_t start_ns = handle->recorded_latency ? tpm_timer_get_ns() : 0;
+        if (match_command(handle, cmd_bytes, bytes_len, &handle->pending) != 0)
+        {
+            result = __FAILURE__;
+        }
+        else
+        {
+            // There is no descriptor to wait on, so the command completes here
+            if (handle->recorded_latency)
+            {
+                wait_latency(start_ns, handle->pending.latency_ns);
+            }
+            handle->cmd_pending = true;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+TPM_COMM_POLL_RESULT tpm_comm_poll_complete(TPM_COMM_HANDLE handle, unsigned char* response, uint32_t* resp_len)
+{
+    TPM_COMM_POLL_RESULT result;
+    if (handle == NULL || response == NULL || resp_len == NULL)
+    {
+        LogError("Invalid argument specified handle: %p, response: %p, resp_len: %p.", handle, response, resp_len);
+        result = TPM_COMM_POLL_ERROR;
+    }
+    else if (!handle->cmd_pending)
+    {
+        LogError("Failure: no asynchronous command is outstanding");
+        result = TPM_COMM_POLL_ERROR;
+    }
+    else
+    {
+        handle->cmd_pending = false;
+        result = copy_response(&handle->pending, response, resp_len) == 0 ? TPM_COMM_POLL_COMPLETE : TPM_COMM_POLL_ERROR;
+    }
+    return result;
+}
+
+int tpm_comm_get_wait_fd(TPM_COMM_HANDLE handle)
+{
+    (void)handle;
+    // Responses are ready once tpm_comm_submit_async returns
+    return -1;
+}
+
+int tpm_comm_set_timeout(TPM_COMM_HANDLE handle, uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+    return handle == NULL ? __FAILURE__ : 0;
+}
+
+int tpm_comm_wait_any(TPM_COMM_HANDLE* handles, size_t count, uint32_t timeout_ms, bool* ready)
+{
+    int result;
+    (void)timeout_ms;
+    if (handles == NULL || ready == NULL || count == 0 || count > TPM_COMM_WAIT_MAX_HANDLES)
+    {
+        LogError("Invalid argument specified handles: %p, count: %zu, ready: %p", handles, count, ready);
+        result = -1;
+    }
+    else
+    {
+        size_t index;
+        result = 0;
+        for (index = 0; index < count && result >= 0; index++)
+        {
+            if (handles[index] == NULL)
+            {
+                LogError("Invalid handle at index %zu", index);
+                result = -1;
+            }
+            else
+            {
+                ready[index] = handles[index]->cmd_pending;
+                result += ready[index] ? 1 : 0;
+            }
+        }
+    }
+    return result;
+}
@@ -0,0 +1,444 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "azure_utpm_c/tpm_comm.h"
+#include "azure_utpm_c/tpm_endpoint.h"
+#include "azure_utpm_c/tpm_shm_broker.h"
+#include "azure_utpm_c/tpm_shm_sys.h"
+#include "azure_utpm_c/tpm_timer.h"
+
+#define SHM_NS_PER_MS               1000000ULL
+
+// Longest wait for the response before checking that the broker is alive
+#define SHM_BROKER_CHECK_MS         100
+
+#define SHM_LOAD(source)            __atomic_load_n((source), __ATOMIC_ACQUIRE)
+#define SHM_STORE(target, value)    __atomic_store_n((target), (value), __ATOMIC_RELEASE)
+
+typedef struct TPM_COMM_INFO_TAG
+{
+    // Connection to the broker, which passed the segment over it
+    int socket;
+    TPM_SHM_SEGMENT* segment;
+    TPM_SHM_SLOT* slot;
+    // Milliseconds the command may wait to be answered, 0 for ever
+    uint32_t timeout_value;
+    bool needs_startup;
+    // When the last command was handed to the broker
+    uint64_t cmd_start_ns;
+    // The command sent by tpm_comm_submit_async has not been polled yet
+    bool cmd_pending;
+    // A command was abandoned, and its response may still be written to the slot
+    bool failed;
+} TPM_COMM_INFO;
+
+static bool is_broker_alive(const TPM_SHM_SEGMENT* segment)
+{
+    int32_t broker = SHM_LOAD(&segment->broker_pid);
+    return broker != 0 && tpm_shm_sys_is_alive(broker);
+}
+
+static int connect_broker(TPM_COMM_INFO* handle, const char* name)
+{
+    int result;
+
+    if (strchr(name, '/') != NULL || strlen(name) >= TPM_SHM_MAX_NAME - 1)
+    {
+        LogError("Invalid broker name %s", name);
+        result = __FAILURE__;
+    }
+    else if ((handle->socket = tpm_shm_sys_connect(name)) < 0)
+    {
+        LogError("Failure connecting to broker %s", name);
+        result = __FAILURE__;
+    }
+    else if ((handle->segment = tpm_shm_sys_receive_segment(handle->socket)) == NULL)
+    {
+        LogError("Failure receiving the segment of broker %s", name);
+        tpm_shm_sys_close(handle->socket);
+        result = __FAILURE__;
+    }
+    else if (handle->segment->magic != TPM_SHM_MAGIC || handle->segment->version != TPM_SHM_VERSION || !is_broker_alive(handle->segment))
+    {
+        LogError("The broker %s is not running, or has another version", name);
+        tpm_shm_sys_unmap(handle->segment);
+        tpm_shm_sys_close(handle->socket);
+        result = __FAILURE__;
+    }
+    else
+    {
+        handle->slot = &handle->segment->slot;
+        result = 0;
+    }
+    return result;
+}
+
+// Hands the command to the broker, which answers it in the slot
+static int send_command(TPM_COMM_INFO* handle, const unsigned char* cmd_bytes, uint32_t bytes_len)
+{
+    int result;
+    if (handle->failed)
+    {
+        LogError("Failure: the handle lost track of the broker after a previous command");
+        result = __FAILURE__;
+    }
+    else if (bytes_len == 0 || bytes_len > TPM_SHM_BUFFER_SIZE)
+    {
+        LogError("Invalid command size %u, the broker takes at most %u bytes", bytes_len, TPM_SHM_BUFFER_SIZE);
+        result = __FAILURE__;
+    }
+    else
+    {
+        TPM_SHM_SLOT* slot = handle->slot;
+
+        handle->cmd_start_ns = tpm_timer_get_ns();
+        memcpy(slot->cmd, cmd_bytes, bytes_len);
+        slot->cmd_len = bytes_len;
+        SHM_STORE(&slot->cmd_seq, slot->cmd_seq + 1);
+        if (tpm_shm_sys_ring(handle->socket) != 0)
+        {
+            LogError("Failure: the TPM broker is not reachable anymore");
+            handle->failed = true;
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    return result;
+}
+
+// Whether the broker has answered the last command, without waiting for it
+static TPM_COMM_POLL_RESULT check_response(TPM_COMM_INFO* handle)
+{
+    TPM_COMM_POLL_RESULT result;
+    TPM_SHM_SLOT* slot = handle->slot;
+    if (handle->failed)
+    {
+        LogError("Failure: the handle lost track of the broker");
+        result = TPM_COMM_POLL_ERROR;
+    }
+    else if (SHM_LOAD(&slot->resp_seq) == slot->cmd_seq)
+    {
+        if (slot->resp_len == 0)
+        {
+            LogError("Failure: the TPM broker could not execute the command");
+            result = TPM_COMM_POLL_ERROR;
+        }
+        else
+        {
+            result = TPM_COMM_POLL_COMPLETE;
+        }
+    }
+    else
+    {
+        uint64_t elapsed_ms = (tpm_timer_get_ns() - handle->cmd_start_ns) / SHM_NS_PER_MS;
+        if (!is_broker_alive(handle->segment))
+        {
+            LogError("Failure: the TPM broker has exited");
+            handle->failed = true;
+            result = TPM_COMM_POLL_ERROR;
+        }
+        else if (handle->timeout_value != 0 && elapsed_ms >= handle->timeout_value)
+        {
+            LogError("Failure: timeout waiting for the TPM broker");
+            handle->failed = true;
+            result = TPM_COMM_POLL_ERROR;
+        }
+        else
+        {
+            result = TPM_COMM_POLL_PENDING;
+        }
+    }
+    return result;
+}
+
+// Value of resp_seq until the broker answers the last command
+static uint32_t unanswered_seq(const TPM_SHM_SLOT* slot)
+{
+    return slot->cmd_seq - 1;
+}
+
+static TPM_COMM_POLL_RESULT wait_for_response(TPM_COMM_INFO* handle)
+{
+    TPM_COMM_POLL_RESULT result;
+    while ((result = check_response(handle)) == TPM_COMM_POLL_PENDING)
+    {
+        tpm_shm_sys_wait(&handle->slot->resp_seq, unanswered_seq(handle->slot), SHM_BROKER_CHECK_MS);
+    }
+    return result;
+}
+
+static int copy_response(const TPM_SHM_SLOT* slot, unsigned char* response, uint32_t* resp_len)
+{
+    int result;
+    uint32_t slot_len = slot->resp_len;
+    if (slot_len > TPM_SHM_BUFFER_SIZE || *resp_len < slot_len)
+    {
+        LogError("Response buffer too small %u, needed %u", *resp_len, slot_len);
+        result = __FAILURE__;
+    }
+    else
+    {
+        memcpy(response, slot->resp, slot_len);
+        *resp_len = slot_len;
+        result = 0;
+    }
+    return result;
+}
+
+TPM_COMM_HANDLE tpm_comm_create(const char* endpoint)
+{
+    TPM_COMM_INFO* result;
+    TPM_ENDPOINT shm_endpoint;
+    if (tpm_endpoint_parse(endpoint, &shm_endpoint) != 0 || shm_endpoint.type != TPM_ENDPOINT_SHM)
+    {
+        LogError("Invalid broker endpoint %s, expected shm:<name>", endpoint != NULL ? endpoint : "");
+        result = NULL;
+    }
+    else if ((result = malloc(sizeof(TPM_COMM_INFO))) == NULL)
+    {
+        LogError("Failure: malloc tpm_comm_info.");
+    }
+    else
+    {
+        memset(result, 0, sizeof(TPM_COMM_INFO));
+        result->timeout_value = TPM_COMM_DEFAULT_TIMEOUT_MS;
+        if (connect_broker(result, shm_endpoint.address) != 0)
+        {
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            result->needs_startup = result->segment->needs_startup != 0;
+        }
+    }
+    return result;
+}
+
+void tpm_comm_destroy(TPM_COMM_HANDLE handle)
+{
+    if (handle)
+    {
+        // The broker drops the segment once the connection is closed
+        tpm_shm_sys_unmap(handle->segment);
+        tpm_shm_sys_close(handle->socket);
+        free(handle);
+    }
+}
+
+TPM_COMM_TYPE tpm_comm_get_type(TPM_COMM_HANDLE handle)
+{
+    (void)handle;
+    return TPM_COMM_TYPE_BROKER;
+}
+
+bool tpm_comm_needs_startup(TPM_COMM_HANDLE handle)
+{
+    return handle != NULL && handle->needs_startup;
+}
+
+int tpm_comm_set_persistent_platform(bool enable)
+{
+    (void)enable;
+    // The broker keeps the TPM connection open
+    return 0;
+}
+
+bool tpm_comm_is_resource_managed(TPM_COMM_HANDLE handle)
+{
+    return handle != NULL && handle->segment->resource_managed != 0;
+}
+
+int tpm_comm_set_priority(TPM_COMM_HANDLE handle, TPM_COMM_PRIORITY priority)
+{
+    int result;
+    if (handle == NULL || priority > TPM_COMM_PRIORITY_HIGH)
+    {
+        LogError("Invalid argument specified handle: %p, priority: %d", handle, (int)priority);
+        result = __FAILURE__;
+    }
+    else
+    {
+        // Applied by the broker from the next command on
+        handle->slot->priority = (uint32_t)priority;
+        result = 0;
+    }
+    return result;
+}
+
+int tpm_comm_submit_command(TPM_COMM_HANDLE handle, const unsigned char* cmd_bytes, uint32_t bytes_len, unsigned char* response, uint32_t* resp_len)
+{
+    int result;
+    if (handle == NULL || cmd_bytes == NULL || response == NULL || resp_len == NULL)
+    {
+        LogError("Invalid argument specified handle: %p, cmd_bytes: %p, response: %p, resp_len: %p.", handle, cmd_bytes, response, resp_len);
+        result = __FAILURE__;
+    }
+    else if (handle->cmd_pending)
+    {
+        LogError("Failure: an asynchronous command is outstanding");
+        result = __FAILURE__;
+    }
+    else if (send_command(handle, cmd_bytes, bytes_len) != 0 || wait_for_response(handle) != TPM_COMM_POLL_COMPLETE)
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = copy_response(handle->slot, response, resp_len);
+    }
+    return result;
+}
+
+int tpm_comm_submit_async(TPM_COMM_HANDLE handle, const unsigned char* cmd_bytes, uint32_t bytes_len)
+{
+    int result;
+    if (handle == NULL || cmd_bytes == NULL)
+    {
+        LogError("Invalid argument specified handle: %p, cmd_bytes: %p.", handle, cmd_bytes);
+        result = __FAILURE__;
+    }
+    else if (handle->cmd_pending)
+    {
+        LogError("Failure: an asynchronous command is already outstanding");
+        result = __FAILURE__;
+    }
+    else if (send_command(handle, cmd_bytes, bytes_len) != 0)
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        handle->cmd_pending = true;
+        result = 0;
+    }
+    return result;
+}
+
+TPM_COMM_POLL_RESULT tpm_comm_poll_complete(TPM_COMM_HANDLE handle, unsigned char* response, uint32_t* resp_len)
+{
+    TPM_COMM_POLL_RESULT result;
+    if (handle == NULL || response == NULL || resp_len == NULL)
+    {
+        LogError("Invalid argument specified handle: %p, response: %p, resp_len: %p.", handle, response, resp_len);
+        result = TPM_COMM_POLL_ERROR;
+    }
+    else if (!handle->cmd_pending)
+    {
+        LogError("Failure: no asynchronous command is outstanding");
+        result = TPM_COMM_POLL_ERROR;
+    }
+    else if ((result = check_response(handle)) != TPM_COMM_POLL_PENDING)
+    {
+        // The response stays in the slot until the next command
+        handle->cmd_pending = false;
+        if (result == TPM_COMM_POLL_COMPLETE && copy_response(handle->slot, response, resp_len) != 0)
+        {
+            result = TPM_COMM_POLL_ERROR;
+        }
+    }
+    return result;
+}
+
+int tpm_comm_get_wait_fd(TPM_COMM_HANDLE handle)
+{
+    (void)handle;
+    // The broker answers through the futex of the slot, tpm_comm_wait_any waits on it
+    return -1;
+}
+
+int tpm_comm_set_timeout(TPM_COMM_HANDLE handle, uint32_t timeout_ms)
+{
+    int result;
+    if (handle == NULL)
+    {
+        LogError("Invalid argument specified handle: NULL");
+        result = __FAILURE__;
+    }
+    else
+    {
+        handle->timeout_value = timeout_ms;
+        result = 0;
+    }
+    return result;
+}
+
+int tpm_comm_wait_any(TPM_COMM_HANDLE* handles, size_t count, uint32_t timeout_ms, bool* ready)
+{
+    int result;
+    if (handles == NULL || ready == NULL || count == 0 || count > TPM_COMM_WAIT_MAX_HANDLES)
+    {
+        LogError("Invalid argument specified handles: %p, count: %zu, ready: %p", handles, count, ready);
+        result = -1;
+    }
+    else
+    {
+        TPM_SHM_WORD* wait_words[TPM_COMM_WAIT_MAX_HANDLES];
+        uint32_t wait_values[TPM_COMM_WAIT_MAX_HANDLES];
+        uint64_t start_ns = tpm_timer_get_ns();
+        size_t wait_count;
+        size_t index;
+
+        do
+        {
+            result = 0;
+            wait_count = 0;
+            for (index = 0; index < count && result >= 0; index++)
+            {
+                ready[index] = false;
+                if (handles[index] == NULL)
+                {
+                    LogError("Invalid handle at index %zu", index);
+                    result = -1;
+                }
+                else if (handles[index]->cmd_pending)
+                {
+                    // A failed command is ready as well, tpm_comm_poll_complete reports it
+                    if (check_response(handles[index]) != TPM_COMM_POLL_PENDING)
+                    {
+                        ready[index] = true;
+                        result++;
+                    }
+                    else
+                    {
+                        wait_words[wait_count] = &handles[index]->slot->resp_seq;
+                        wait_values[wait_count++] = unanswered_seq(handles[index]->slot);
+                    }
+                }
+            }
+
+            if (result == 0 && wait_count > 0)
+            {
+                // The outstanding commands are checked again at least every
+                // SHM_BROKER_CHECK_MS, to notice a broker that has exited
+                uint64_t elapsed_ms = (tpm_timer_get_ns() - start_ns) / SHM_NS_PER_MS;
+                if (timeout_ms != 0 && elapsed_ms >= timeout_ms)
+                {
+                    wait_count = 0;
+                }
+                else
+                {
+                    uint32_t wait_ms = SHM_BROKER_CHECK_MS;
+                    if (timeout_ms != 0 && timeout_ms - elapsed_ms < wait_ms)
+                    {
+                        wait_ms = (uint32_t)(timeout_ms - elapsed_ms);
+                    }
+                    tpm_shm_sys_wait_any(wait_words, wait_values, wait_count, wait_ms);
+                }
+            }
+        } while (result == 0 && wait_count > 0);
+    }
+    return result;
+}
@@ -4,17 +4,36 @@
 #include <winsock2.h>
 #include <windows.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include "azure_c_shared_utility/umock_c_prod.h"
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/buffer_.h"
 
 #include "azure_utpm_c/tpm_comm.h"
+#include "azure_utpm_c/tpm_endpoint.h"
+#include "azure_utpm_c/tpm_win32_sys.h"
 #include <Tbs.h>
 
+// Size of the largest response returned by the TBS
+#define MAX_TPM_RESPONSE_LENGTH     4096
+// Size of the largest command an asynchronous submission takes
+#define MAX_TPM_COMMAND_LENGTH      4096
+
 typedef struct TPM_COMM_INFO_TAG
 {
     TBS_HCONTEXT tbs_context;
+    TBS_COMMAND_PRIORITY priority;
+
+    // Tbsip_Submit_Command is synchronous, so an asynchronous command runs on a
+    // thread of the pool, which sets async_work.done once it has returned
+    bool cmd_pending;
+    TPM_WIN32_WORK async_work;
+    uint32_t async_cmd_len;
+    unsigned char async_command[MAX_TPM_COMMAND_LENGTH];
+    TBS_RESULT async_result;
+    uint32_t async_resp_len;
+    unsigned char async_response[MAX_TPM_RESPONSE_LENGTH];
 } TPM_COMM_INFO;
 
 static const char* get_tbsi_error_msg(TBS_RESULT tbs_res)
@@ -69,6 +88,16 @@ static const char* get_tbsi_error_msg(TBS_RESULT tbs_res)
 
 static void cleanup_memory(TPM_COMM_INFO* tpm_info)
 {
+    if (tpm_info->cmd_pending)
+    {
+        // The worker uses the context and the response buffer until it returns
+        bool done;
+        (void)tpm_win32_sys_wait_any(&tpm_info->async_work.done, 1, TPM_WIN32_WAIT_FOREVER, &done);
+    }
+    if (tpm_info->async_work.done != NULL)
+    {
+        tpm_win32_sys_close_event(tpm_info->async_work.done);
+    }
     if (tpm_info->tbs_context != NULL)
     {
         (void)Tbsip_Context_Close(tpm_info->tbs_context);
@@ -76,11 +105,26 @@ static void cleanup_memory(TPM_COMM_INFO* tpm_info)
     free(tpm_info);
 }
 
+static void run_async_command(void* context)
+{
+    TPM_COMM_INFO* tpm_info = (TPM_COMM_INFO*)context;
+
+    tpm_info->async_resp_len = sizeof(tpm_info->async_response);
+    tpm_info->async_result = Tbsip_Submit_Command(tpm_info->tbs_context, TBS_COMMAND_LOCALITY_ZERO, tpm_info->priority,
+        tpm_info->async_command, tpm_info->async_cmd_len, tpm_info->async_response, &tpm_info->async_resp_len);
+}
+
 TPM_COMM_HANDLE tpm_comm_create(const char* endpoint)
 {
     TPM_COMM_INFO* result;
-    (void)endpoint;
-    if ((result = malloc(sizeof(TPM_COMM_INFO))) == NULL)
+    TPM_ENDPOINT comm_endpoint;
+    // TBS gives access to the one TPM of the system
+    if (tpm_endpoint_parse(endpoint, &comm_endpoint) != 0 || comm_endpoint.type != TPM_ENDPOINT_DEFAULT)
+    {
+        LogError("Invalid tpm endpoint %s, TBS only serves the default endpoint", endpoint);
+        result = NULL;
+    }
+    else if ((result = malloc(sizeof(TPM_COMM_INFO))) == NULL)
     {
         LogError("Failure: malloc tpm communication info.");
     }
@@ -93,6 +137,7 @@ TPM_COMM_HANDLE tpm_comm_create(const char* endpoint)
         parms.includeTpm20 = TRUE;
 
         memset(result, 0, sizeof(TPM_COMM_INFO));
+        result->priority = TBS_COMMAND_PRIORITY_NORMAL;
         tbs_res = Tbsi_Context_Create((PCTBS_CONTEXT_PARAMS)&parms, &result->tbs_context);
         if (tbs_res != TBS_SUCCESS)
         {
@@ -115,6 +160,17 @@ TPM_COMM_HANDLE tpm_comm_create(const char* endpoint)
                 cleanup_memory(result);
                 result = NULL;
             }
+            else if ((result->async_work.done = tpm_win32_sys_create_event()) == NULL)
+            {
+                LogError("Failure creating the completion event.");
+                cleanup_memory(result);
+                result = NULL;
+            }
+            else
+            {
+                result->async_work.run = run_async_command;
+                result->async_work.context = result;
+            }
         }
     }
     return result;
@@ -134,6 +190,57 @@ TPM_COMM_TYPE tpm_comm_get_type(TPM_COMM_HANDLE handle)
     return TPM_COMM_TYPE_WINDOW;
 }
 
+bool tpm_comm_needs_startup(TPM_COMM_HANDLE handle)
+{
+    (void)handle;
+    // Windows starts the TPM during boot
+    return false;
+}
+
+int tpm_comm_set_persistent_platform(bool enable)
+{
+    (void)enable;
+    return 0;
+}
+
+bool tpm_comm_is_resource_managed(TPM_COMM_HANDLE handle)
+{
+    (void)handle;
+    // TBS virtualizes the handles of every context
+    return true;
+}
+
+int tpm_comm_set_priority(TPM_COMM_HANDLE handle, TPM_COMM_PRIORITY priority)
+{
+    int result;
+    if (handle == NULL)
+    {
+        LogError("Invalid argument specified handle: NULL");
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+        switch (priority)
+        {
+            case TPM_COMM_PRIORITY_LOW:
+                handle->priority = TBS_COMMAND_PRIORITY_LOW;
+                break;
+            case TPM_COMM_PRIORITY_NORMAL:
+                handle->priority = TBS_COMMAND_PRIORITY_NORMAL;
+                break;
+            case TPM_COMM_PRIORITY_HIGH:
+                handle->priority = TBS_COMMAND_PRIORITY_HIGH;
+                break;
+            default:
+                LogError("Invalid priority %d", (int)priority);
+                result = __FAILURE__;
+                break;
+        }
+    }
+    return result;
+}
+
 int tpm_comm_submit_command(TPM_COMM_HANDLE handle, const unsigned char* cmd_bytes, uint32_t bytes_len, unsigned char* response, uint32_t* resp_len)
 {
     int result;
@@ -142,10 +249,15 @@ int tpm_comm_submit_command(TPM_COMM_HANDLE handle, const unsigned char* cmd_byt
         LogError("Invalid argument specified handle: %p, cmd_bytes: %p, response: %p, resp_len: %p.", handle, cmd_bytes, response, resp_len);
         result = __FAILURE__;
     }
+    else if (handle->cmd_pending)
+    {
+        LogError("Failure: an asynchronous command is outstanding");
+        result = __FAILURE__;
+    }
     else
     {
         TBS_RESULT tbs_res;
-        tbs_res = Tbsip_Submit_Command(handle->tbs_context, TBS_COMMAND_LOCALITY_ZERO, TBS_COMMAND_PRIORITY_NORMAL,
+        tbs_res = Tbsip_Submit_Command(handle->tbs_context, TBS_COMMAND_LOCALITY_ZERO, handle->priority,
             cmd_bytes, bytes_len, response, resp_len);
         if (tbs_res != TBS_SUCCESS)
         {
@@ -159,3 +271,159 @@ int tpm_comm_submit_command(TPM_COMM_HANDLE handle, const unsigned char* cmd_byt
     }
     return result;
 }
+
+int tpm_comm_submit_async(TPM_COMM_HANDLE handle, const unsigned char* cmd_bytes, uint32_t bytes_len)
+{
+    int result;
+    if (handle == NULL || cmd_bytes == NULL)
+    {
+        LogError("Invalid argument specified handle: %p, cmd_bytes: %p.", handle, cmd_bytes);
+        result = __FAILURE__;
+    }
+    else if (handle->cmd_pending)
+    {
+        LogError("Failure: an asynchronous command is already outstanding");
+        result = __FAILURE__;
+    }
+    else if (bytes_len > sizeof(handle->async_command))
+    {
+        LogError("Command of %u bytes is too large for an asynchronous submission", bytes_len);
+        result = __FAILURE__;
+    }
+    else
+    {
+        // The caller may reuse its buffer as soon as the command is submitted
+        memcpy(handle->async_command, cmd_bytes, bytes_len);
+        handle->async_cmd_len = bytes_len;
+        tpm_win32_sys_reset_event(handle->async_work.done);
+        if (!tpm_win32_sys_queue_work(&handle->async_work))
+        {
+            LogError("Failure queuing the command to the thread pool.");
+            result = __FAILURE__;
+        }
+        else
+        {
+            handle->cmd_pending = true;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+TPM_COMM_POLL_RESULT tpm_comm_poll_complete(TPM_COMM_HANDLE handle, unsigned char* response, uint32_t* resp_len)
+{
+    TPM_COMM_POLL_RESULT result;
+    if (handle == NULL || response == NULL || resp_len == NULL)
+    {
+        LogError("Invalid argument specified handle: %p, response: %p, resp_len: %p.", handle, response, resp_len);
+        result = TPM_COMM_POLL_ERROR;
+    }
+    else if (!handle->cmd_pending)
+    {
+        LogError("Failure: no asynchronous command is outstanding");
+        result = TPM_COMM_POLL_ERROR;
+    }
+    else
+    {
+        bool done;
+        int wait_res = tpm_win32_sys_wait_any(&handle->async_work.done, 1, 0, &done);
+        if (wait_res == 0)
+        {
+            result = TPM_COMM_POLL_PENDING;
+        }
+        else if (wait_res < 0)
+        {
+            LogError("Failure checking the tpm command.");
+            result = TPM_COMM_POLL_ERROR;
+        }
+        else
+        {
+            handle->cmd_pending = false;
+            if (handle->async_result != TBS_SUCCESS)
+            {
+                LogError("Failure sending command to tpm %s.", get_tbsi_error_msg(handle->async_result));
+                result = TPM_COMM_POLL_ERROR;
+            }
+            else if (handle->async_resp_len > *resp_len)
+            {
+                LogError("Bytes read are greater then bytes expected len_bytes:%u expected: %u", handle->async_resp_len, *resp_len);
+                result = TPM_COMM_POLL_ERROR;
+            }
+            else
+            {
+                memcpy(response, handle->async_response, handle->async_resp_len);
+                *resp_len = handle->async_resp_len;
+                result = TPM_COMM_POLL_COMPLETE;
+            }
+        }
+    }
+    return result;
+}
+
+int tpm_comm_get_wait_fd(TPM_COMM_HANDLE handle)
+{
+    (void)handle;
+    // The TBS has no pollable descriptor, tpm_comm_wait_any waits for the workers
+    return -1;
+}
+
+int tpm_comm_set_timeout(TPM_COMM_HANDLE handle, uint32_t timeout_ms)
+{
+    int result;
+    if (handle == NULL)
+    {
+        LogError("Invalid argument specified handle: NULL");
+        result = __FAILURE__;
+    }
+    else
+    {
+        // The TBS applies its own per command timeouts
+        (void)timeout_ms;
+        result = 0;
+    }
+    return result;
+}
+
+int tpm_comm_wait_any(TPM_COMM_HANDLE* handles, size_t count, uint32_t timeout_ms, bool* ready)
+{
+    int result;
+    if (handles == NULL || ready == NULL || count == 0 || count > TPM_COMM_WAIT_MAX_HANDLES)
+    {
+        LogError("Invalid argument specified handles: %p, count: %zu, ready: %p", handles, count, ready);
+        result = -1;
+    }
+    else
+    {
+        HANDLE wait_events[TPM_COMM_WAIT_MAX_HANDLES];
+        bool signaled[TPM_COMM_WAIT_MAX_HANDLES];
+        size_t wait_index[TPM_COMM_WAIT_MAX_HANDLES];
+        size_t wait_count = 0;
+        size_t index;
+
+        result = 0;
+        for (index = 0; index < count && result == 0; index++)
+        {
+            ready[index] = false;
+            if (handles[index] == NULL)
+            {
+                LogError("Invalid handle at index %zu", index);
+                result = -1;
+            }
+            else if (handles[index]->cmd_pending)
+            {
+                wait_events[wait_count] = handles[index]->async_work.done;
+                wait_index[wait_count++] = index;
+            }
+        }
+
+        if (result == 0 && wait_count > 0)
+        {
+            result = tpm_win32_sys_wait_any(wait_events, wait_count, timeout_ms == 0 ? TPM_WIN32_WAIT_FOREVER : timeout_ms, signaled);
+            for (index = 0; index < wait_count && result > 0; index++)
+            {
+                ready[wait_index[index]] = signaled[index];
+            }
+        }
+    }
+    return result;
+}
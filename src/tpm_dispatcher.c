@@ -0,0 +1,364 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/lock.h"
+
+#include "azure_utpm_c/tpm_dispatcher.h"
+
+typedef struct DISPATCHER_DEVICE_TAG
+{
+    TSS_DEVICE device;
+    // Serializes the commands sent to the device
+    LOCK_HANDLE lock;
+    // Operations routed to the device and not finished yet
+    size_t outstanding;
+} DISPATCHER_DEVICE;
+
+typedef struct TSS_DISPATCHER_TAG
+{
+    // Protects the outstanding counters and next_device
+    LOCK_HANDLE lock;
+    // Copy of the endpoint list, split in place into the comms_endpoints
+    char* endpoints;
+    DISPATCHER_DEVICE devices[TSS_DISPATCHER_MAX_DEVICES];
+    size_t device_count;
+    // Where the search for the least loaded device starts, so that idle devices
+    // are used in turn
+    size_t next_device;
+} TSS_DISPATCHER;
+
+static void close_devices(TSS_DISPATCHER* dispatcher)
+{
+    size_t index;
+    for (index = 0; index < dispatcher->device_count; index++)
+    {
+        Deinit_TPM_Codec(&dispatcher->devices[index].device);
+        (void)Lock_Deinit(dispatcher->devices[index].lock);
+    }
+    dispatcher->device_count = 0;
+}
+
+static int split_endpoints(TSS_DISPATCHER* dispatcher, const char* endpoints)
+{
+    int result;
+    size_t length = strlen(endpoints);
+    if ((dispatcher->endpoints = (char*)malloc(length + 1)) == NULL)
+    {
+        LogError("Failure allocating endpoint list");
+        result = __FAILURE__;
+    }
+    else
+    {
+        char* current = dispatcher->endpoints;
+        memcpy(dispatcher->endpoints, endpoints, length + 1);
+
+        result = 0;
+        do
+        {
+            char* separator = strchr(current, TSS_DISPATCHER_ENDPOINT_SEPARATOR);
+            if (dispatcher->device_count == TSS_DISPATCHER_MAX_DEVICES)
+            {
+                LogError("More than %d endpoints in '%s'", TSS_DISPATCHER_MAX_DEVICES, endpoints);
+                result = __FAILURE__;
+                break;
+            }
+            if (separator != NULL)
+            {
+                *separator = '\0';
+            }
+            // An empty endpoint selects the default one of the transport
+            dispatcher->devices[dispatcher->device_count++].device.comms_endpoint = *current == '\0' ? NULL : current;
+            current = separator != NULL ? separator + 1 : NULL;
+        } while (current != NULL);
+
+        if (result != 0)
+        {
+            free(dispatcher->endpoints);
+            dispatcher->endpoints = NULL;
+        }
+    }
+    return result;
+}
+
+static int open_devices(TSS_DISPATCHER* dispatcher)
+{
+    int result = 0;
+    size_t count = dispatcher->device_count;
+    size_t index;
+
+    // device_count only covers the devices opened so far, for close_devices
+    dispatcher->device_count = 0;
+    for (index = 0; index < count; index++)
+    {
+        DISPATCHER_DEVICE* entry = &dispatcher->devices[index];
+        if ((entry->lock = Lock_Init()) == NULL)
+        {
+            LogError("Failure creating device lock");
+            result = __FAILURE__;
+            break;
+        }
+        else if (Initialize_TPM_Codec(&entry->device) != TPM_RC_SUCCESS)
+        {
+            LogError("Failure connecting to the TPM at '%s'", entry->device.comms_endpoint != NULL ? entry->device.comms_endpoint : "<default>");
+            (void)Lock_Deinit(entry->lock);
+            result = __FAILURE__;
+            break;
+        }
+        else
+        {
+            dispatcher->device_count++;
+        }
+    }
+
+    if (result != 0)
+    {
+        close_devices(dispatcher);
+    }
+    return result;
+}
+
+static DISPATCHER_DEVICE* acquire_device(TSS_DISPATCHER* dispatcher)
+{
+    DISPATCHER_DEVICE* result;
+    if (Lock(dispatcher->lock) != LOCK_OK)
+    {
+        LogError("Failure acquiring dispatcher lock");
+        result = NULL;
+    }
+    else
+    {
+        size_t index;
+        result = NULL;
+        for (index = 0; index < dispatcher->device_count; index++)
+        {
+            DISPATCHER_DEVICE* entry = &dispatcher->devices[(dispatcher->next_device + index) % dispatcher->device_count];
+            if (result == NULL || entry->outstanding < result->outstanding)
+            {
+                result = entry;
+            }
+        }
+        result->outstanding++;
+        dispatcher->next_device = (size_t)(result - dispatcher->devices + 1) % dispatcher->device_count;
+        (void)Unlock(dispatcher->lock);
+
+        if (Lock(result->lock) != LOCK_OK)
+        {
+            LogError("Failure acquiring device lock");
+            if (Lock(dispatcher->lock) == LOCK_OK)
+            {
+                result->outstanding--;
+                (void)Unlock(dispatcher->lock);
+            }
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+static void release_device(TSS_DISPATCHER* dispatcher, DISPATCHER_DEVICE* entry)
+{
+    (void)Unlock(entry->lock);
+    if (Lock(dispatcher->lock) != LOCK_OK)
+    {
+        LogError("Failure acquiring dispatcher lock");
+    }
+    else
+    {
+        entry->outstanding--;
+        (void)Unlock(dispatcher->lock);
+    }
+}
+
+TSS_DISPATCHER_HANDLE tpm_dispatcher_create(const char* endpoints)
+{
+    TSS_DISPATCHER* result;
+    if ((result = (TSS_DISPATCHER*)malloc(sizeof(TSS_DISPATCHER))) == NULL)
+    {
+        LogError("Failure allocating dispatcher");
+    }
+    else
+    {
+        memset(result, 0, sizeof(TSS_DISPATCHER));
+        if ((result->lock = Lock_Init()) == NULL)
+        {
+            LogError("Failure creating dispatcher lock");
+            free(result);
+            result = NULL;
+        }
+        else if (split_endpoints(result, endpoints != NULL ? endpoints : "") != 0)
+        {
+            (void)Lock_Deinit(result->lock);
+            free(result);
+            result = NULL;
+        }
+        else if (open_devices(result) != 0)
+        {
+            (void)Lock_Deinit(result->lock);
+            free(result->endpoints);
+            free(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+void tpm_dispatcher_destroy(TSS_DISPATCHER_HANDLE handle)
+{
+    if (handle != NULL)
+    {
+        close_devices(handle);
+        (void)Lock_Deinit(handle->lock);
+        free(handle->endpoints);
+        free(handle);
+    }
+}
+
+size_t tpm_dispatcher_get_device_count(TSS_DISPATCHER_HANDLE handle)
+{
+    size_t result;
+    if (handle == NULL)
+    {
+        LogError("Invalid parameter handle: NULL");
+        result = 0;
+    }
+    else
+    {
+        result = handle->device_count;
+    }
+    return result;
+}
+
+TSS_DEVICE* tpm_dispatcher_acquire_device(TSS_DISPATCHER_HANDLE handle)
+{
+    TSS_DEVICE* result;
+    DISPATCHER_DEVICE* entry;
+    if (handle == NULL)
+    {
+        LogError("Invalid parameter handle: NULL");
+        result = NULL;
+    }
+    else if ((entry = acquire_device(handle)) == NULL)
+    {
+        result = NULL;
+    }
+    else
+    {
+        result = &entry->device;
+    }
+    return result;
+}
+
+void tpm_dispatcher_release_device(TSS_DISPATCHER_HANDLE handle, TSS_DEVICE* device)
+{
+    if (handle == NULL || device == NULL)
+    {
+        LogError("Invalid parameter handle: %p, device: %p", handle, device);
+    }
+    else
+    {
+        // The device is the first member of its entry
+        release_device(handle, (DISPATCHER_DEVICE*)device);
+    }
+}
+
+TPM_RC tpm_dispatcher_get_random(TSS_DISPATCHER_HANDLE handle, BYTE* buffer, UINT32 size)
+{
+    TPM_RC result;
+    DISPATCHER_DEVICE* entry;
+    if (handle == NULL || buffer == NULL)
+    {
+        LogError("Invalid parameter handle: %p, buffer: %p", handle, buffer);
+        result = TPM_RC_FAILURE;
+    }
+    else if ((entry = acquire_device(handle)) == NULL)
+    {
+        result = TPM_RC_FAILURE;
+    }
+    else
+    {
+        UINT32 offset = 0;
+        result = TPM_RC_SUCCESS;
+        while (offset < size)
+        {
+            TPM2B_DIGEST random;
+            UINT32 remaining = size - offset;
+            if ((result = TPM2_GetRandom(&entry->device, (UINT16)(remaining < sizeof(random.t.buffer) ? remaining : sizeof(random.t.buffer)), &random)) != TPM_RC_SUCCESS)
+            {
+                LogError("Failure getting random bytes: 0x%x", result);
+                break;
+            }
+            else if (random.t.size == 0)
+            {
+                LogError("TPM returned no random bytes");
+                result = TPM_RC_FAILURE;
+                break;
+            }
+            else
+            {
+                UINT32 copied = random.t.size < remaining ? random.t.size : remaining;
+                memcpy(buffer + offset, random.t.buffer, copied);
+                offset += copied;
+            }
+        }
+        release_device(handle, entry);
+    }
+    return result;
+}
+
+TPM_RC tpm_dispatcher_hash(TSS_DISPATCHER_HANDLE handle, BYTE* data, UINT32 dataSize, TPMI_ALG_HASH hashAlg, TPM2B_DIGEST* outHash)
+{
+    TPM_RC result;
+    DISPATCHER_DEVICE* entry;
+    if (handle == NULL || outHash == NULL)
+    {
+        LogError("Invalid parameter handle: %p, outHash: %p", handle, outHash);
+        result = TPM_RC_FAILURE;
+    }
+    else if ((entry = acquire_device(handle)) == NULL)
+    {
+        result = TPM_RC_FAILURE;
+    }
+    else
+    {
+        result = TSS_Hash(&entry->device, data, dataSize, hashAlg, outHash);
+        release_device(handle, entry);
+    }
+    return result;
+}
+
+TPM_RC tpm_dispatcher_hmac(TSS_DISPATCHER_HANDLE handle, TSS_SESSION* session, TPMI_DH_OBJECT keyHandle, BYTE* data, UINT32 dataSize, TPM2B_DIGEST* outHMAC)
+{
+    TPM_RC result;
+    DISPATCHER_DEVICE* entry;
+    if (handle == NULL || session == NULL || outHMAC == NULL)
+    {
+        LogError("Invalid parameter handle: %p, session: %p, outHMAC: %p", handle, session, outHMAC);
+        result = TPM_RC_FAILURE;
+    }
+    else if (session->SessIn.sessionHandle != TPM_RS_PW)
+    {
+        LogError("Only password sessions can be dispatched");
+        result = TPM_RC_AUTH_TYPE;
+    }
+    else if ((keyHandle & HR_RANGE_MASK) != HR_PERSISTENT)
+    {
+        LogError("Key 0x%x is not persistent", keyHandle);
+        result = TPM_RC_HANDLE;
+    }
+    else if ((entry = acquire_device(handle)) == NULL)
+    {
+        result = TPM_RC_FAILURE;
+    }
+    else
+    {
+        result = TSS_HMAC(&entry->device, session, keyHandle, data, dataSize, outHMAC);
+        release_device(handle, entry);
+    }
+    return result;
+}
@@ -0,0 +1,138 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "azure_utpm_c/tpm_endpoint.h"
+#include "azure_utpm_c/tpm_socket_comm.h"
+
+#define DEVICE_PREFIX       "dev:"
+#define TCP_PREFIX          "tcp:"
+#define UNIX_PREFIX         "unix:"
+#define FILE_PREFIX         "file:"
+#define SHM_PREFIX          "shm:"
+
+static bool has_prefix(const char* value, const char* prefix, size_t prefix_len)
+{
+    return strncmp(value, prefix, prefix_len) == 0;
+}
+
+static int copy_address(TPM_ENDPOINT* parsed, const char* prefix, const char* value, size_t value_len)
+{
+    int result;
+    size_t prefix_len = strlen(prefix);
+    if (prefix_len + value_len >= TPM_ENDPOINT_MAX_ADDRESS)
+    {
+        LogError("Endpoint address is too long: %.*s", (int)value_len, value);
+        result = __FAILURE__;
+    }
+    else
+    {
+        memcpy(parsed->address, prefix, prefix_len);
+        memcpy(parsed->address + prefix_len, value, value_len);
+        parsed->address[prefix_len + value_len] = '\0';
+        result = 0;
+    }
+    return result;
+}
+
+static int parse_path(TPM_ENDPOINT* parsed, const char* prefix, const char* path)
+{
+    int result;
+    if (*path == '\0')
+    {
+        LogError("Endpoint path is empty");
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = copy_address(parsed, prefix, path, strlen(path));
+    }
+    return result;
+}
+
+static int parse_host_port(TPM_ENDPOINT* parsed, const char* host_port)
+{
+    int result;
+    const char* separator = strrchr(host_port, ':');
+    if (separator == NULL)
+    {
+        parsed->port = 0;
+        result = copy_address(parsed, "", host_port, strlen(host_port));
+    }
+    else
+    {
+        char* end;
+        unsigned long port = strtoul(separator + 1, &end, 10);
+        if (separator[1] == '\0' || *end != '\0' || port == 0 || port > 0xFFFF)
+        {
+            LogError("Invalid port in endpoint %s", host_port);
+            result = __FAILURE__;
+        }
+        else
+        {
+            parsed->port = (unsigned short)port;
+            result = copy_address(parsed, "", host_port, (size_t)(separator - host_port));
+        }
+    }
+    return result;
+}
+
+int tpm_endpoint_parse(const char* endpoint, TPM_ENDPOINT* parsed)
+{
+    int result;
+    if (parsed == NULL)
+    {
+        LogError("Invalid argument specified parsed: NULL");
+        result = __FAILURE__;
+    }
+    else
+    {
+        memset(parsed, 0, sizeof(TPM_ENDPOINT));
+        if (endpoint == NULL || *endpoint == '\0')
+        {
+            parsed->type = TPM_ENDPOINT_DEFAULT;
+            result = 0;
+        }
+        else if (has_prefix(endpoint, DEVICE_PREFIX, sizeof(DEVICE_PREFIX) - 1))
+        {
+            parsed->type = TPM_ENDPOINT_DEVICE;
+            result = parse_path(parsed, "", endpoint + sizeof(DEVICE_PREFIX) - 1);
+        }
+        else if (has_prefix(endpoint, TPM_SOCKET_UNIX_PREFIX, sizeof(TPM_SOCKET_UNIX_PREFIX) - 1))
+        {
+            parsed->type = TPM_ENDPOINT_UNIX;
+            result = parse_path(parsed, TPM_SOCKET_UNIX_PREFIX, endpoint + sizeof(TPM_SOCKET_UNIX_PREFIX) - 1);
+        }
+        else if (has_prefix(endpoint, UNIX_PREFIX, sizeof(UNIX_PREFIX) - 1))
+        {
+            parsed->type = TPM_ENDPOINT_UNIX;
+            result = parse_path(parsed, TPM_SOCKET_UNIX_PREFIX, endpoint + sizeof(UNIX_PREFIX) - 1);
+        }
+        else if (has_prefix(endpoint, FILE_PREFIX, sizeof(FILE_PREFIX) - 1))
+        {
+            parsed->type = TPM_ENDPOINT_FILE;
+            result = parse_path(parsed, "", endpoint + sizeof(FILE_PREFIX) - 1);
+        }
+        else if (has_prefix(endpoint, SHM_PREFIX, sizeof(SHM_PREFIX) - 1))
+        {
+            parsed->type = TPM_ENDPOINT_SHM;
+            result = parse_path(parsed, "", endpoint + sizeof(SHM_PREFIX) - 1);
+        }
+        else if (has_prefix(endpoint, TCP_PREFIX, sizeof(TCP_PREFIX) - 1))
+        {
+            parsed->type = TPM_ENDPOINT_TCP;
+            result = parse_host_port(parsed, endpoint + sizeof(TCP_PREFIX) - 1);
+        }
+        else
+        {
+            // The bare "address:port" form predates the prefixes
+            parsed->type = TPM_ENDPOINT_TCP;
+            result = parse_host_port(parsed, endpoint);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,114 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/sha.h"
+
+#include "azure_utpm_c/tpm_host_hash.h"
+
+// USHAInput takes the size as an unsigned int, so the data is fed in pieces
+// that fit it on every platform
+#define HOST_HASH_MAX_INPUT     0x10000
+
+static bool get_sha_version(TPMI_ALG_HASH hashAlg, SHAversion* version)
+{
+    bool result = true;
+    // Only the algorithms enabled in Implementation.h, whose digests fit into
+    // a TPM2B_DIGEST
+    switch (hashAlg)
+    {
+#ifdef TPM_ALG_SHA1
+        case TPM_ALG_SHA1:
+            *version = SHA1;
+            break;
+#endif
+#ifdef TPM_ALG_SHA256
+        case TPM_ALG_SHA256:
+            *version = SHA256;
+            break;
+#endif
+#ifdef TPM_ALG_SHA384
+        case TPM_ALG_SHA384:
+            *version = SHA384;
+            break;
+#endif
+#ifdef TPM_ALG_SHA512
+        case TPM_ALG_SHA512:
+            *version = SHA512;
+            break;
+#endif
+        default:
+            result = false;
+            break;
+    }
+    return result;
+}
+
+bool tpm_host_hash_is_supported(TPMI_ALG_HASH hashAlg)
+{
+    SHAversion version;
+    return get_sha_version(hashAlg, &version);
+}
+
+TPM_RC tpm_host_hash(TPMI_ALG_HASH hashAlg, const BYTE* data, UINT32 dataSize, TPM2B_DIGEST* outHash)
+{
+    TPM_RC result;
+    SHAversion version;
+    if ((data == NULL && dataSize != 0) || outHash == NULL)
+    {
+        LogError("Invalid parameter data: %p, outHash: %p", data, outHash);
+        result = TPM_RC_FAILURE;
+    }
+    else if (!get_sha_version(hashAlg, &version))
+    {
+        LogError("Hash algorithm 0x%x is not available on the host", hashAlg);
+        result = TPM_RC_HASH;
+    }
+    else
+    {
+        USHAContext context;
+        uint8_t digest[USHAMaxHashSize];
+
+        if (USHAReset(&context, version) != shaSuccess)
+        {
+            LogError("Failure initializing the hash context");
+            result = TPM_RC_FAILURE;
+        }
+        else
+        {
+            result = TPM_RC_SUCCESS;
+            while (dataSize > 0)
+            {
+                UINT32 chunk = dataSize < HOST_HASH_MAX_INPUT ? dataSize : HOST_HASH_MAX_INPUT;
+                if (USHAInput(&context, data, chunk) != shaSuccess)
+                {
+                    LogError("Failure hashing the data");
+                    result = TPM_RC_FAILURE;
+                    break;
+                }
+                data += chunk;
+                dataSize -= chunk;
+            }
+
+            if (result == TPM_RC_SUCCESS)
+            {
+                if (USHAResult(&context, digest) != shaSuccess)
+                {
+                    LogError("Failure computing the digest");
+                    result = TPM_RC_FAILURE;
+                }
+                else
+                {
+                    outHash->t.size = (UINT16)USHAHashSize(version);
+                    memcpy(outHash->t.buffer, digest, outHash->t.size);
+                }
+            }
+        }
+    }
+    return result;
+}
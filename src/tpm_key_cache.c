@@ -0,0 +1,411 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "azure_utpm_c/tpm_key_cache.h"
+#include "azure_utpm_c/Marshal_fp.h"
+
+// Same layout principle as the public cache file: a header followed by fixed
+// size slots, all marshaled in TPM representation.
+//
+//  header: magic, version, slot size, count
+//  slot:   key id, TPMS_CONTEXT, zero padding
+#define KEY_CACHE_MAGIC             0x75544b43      // 'uTKC'
+#define KEY_CACHE_VERSION           1
+#define KEY_CACHE_HEADER_SIZE       (4 * sizeof(UINT32))
+#define KEY_CACHE_SLOT_SIZE         (sizeof(UINT32) + sizeof(TPMS_CONTEXT))
+#define KEY_CACHE_MAX_FILE_SIZE     (KEY_CACHE_HEADER_SIZE + TSS_KEY_CACHE_SIZE * KEY_CACHE_SLOT_SIZE)
+
+static UINT32 get_loaded_limit(TSS_DEVICE* tpm)
+{
+    // Leave one transient slot to the caller for the objects it does not cache
+    UINT32 result = TSS_GetTpmProperty(tpm, TPM_PT_HR_TRANSIENT_MIN);
+    if (result == (UINT32)-1 || result < 2)
+    {
+        result = 1;
+    }
+    else if (--result > TSS_KEY_CACHE_SIZE)
+    {
+        result = TSS_KEY_CACHE_SIZE;
+    }
+    return result;
+}
+
+static TSS_KEY_CACHE_ENTRY* find_entry(TSS_KEY_CACHE* cache, UINT32 keyId)
+{
+    TSS_KEY_CACHE_ENTRY* result = NULL;
+    size_t index;
+    for (index = 0; index < TSS_KEY_CACHE_SIZE; index++)
+    {
+        if (cache->Entries[index].Used && cache->Entries[index].KeyId == keyId)
+        {
+            result = &cache->Entries[index];
+            break;
+        }
+    }
+    return result;
+}
+
+static void drop_entry(TSS_DEVICE* tpm, TSS_KEY_CACHE_ENTRY* entry)
+{
+    if (entry->Handle != 0)
+    {
+        (void)TPM2_FlushContext(tpm, entry->Handle);
+    }
+    entry->Used = FALSE;
+    entry->Handle = 0;
+    entry->Saved = FALSE;
+}
+
+// Makes sure the key can be loaded again later, and flushes it
+static void unload_entry(TSS_DEVICE* tpm, TSS_KEY_CACHE_ENTRY* entry)
+{
+    TPM_RC result;
+    if (!entry->Saved)
+    {
+        if ((result = TPM2_ContextSave(tpm, entry->Handle, &entry->Context)) != TPM_RC_SUCCESS)
+        {
+            LogError("Failure saving the context of key %u: 0x%x", entry->KeyId, result);
+        }
+        else
+        {
+            entry->Saved = TRUE;
+        }
+    }
+
+    (void)TPM2_FlushContext(tpm, entry->Handle);
+    entry->Handle = 0;
+    if (!entry->Saved)
+    {
+        entry->Used = FALSE;
+    }
+}
+
+// Unloads the least recently used keys until a key can be loaded without
+// going over the limit. 'keep' is never unloaded.
+static void make_room(TSS_DEVICE* tpm, TSS_KEY_CACHE* cache, TSS_KEY_CACHE_ENTRY* keep)
+{
+    TSS_KEY_CACHE_ENTRY* lru;
+    UINT32 loaded;
+    size_t index;
+
+    if (cache->Limit == 0)
+    {
+        cache->Limit = get_loaded_limit(tpm);
+    }
+
+    do
+    {
+        lru = NULL;
+        loaded = 0;
+        for (index = 0; index < TSS_KEY_CACHE_SIZE; index++)
+        {
+            TSS_KEY_CACHE_ENTRY* entry = &cache->Entries[index];
+            if (entry->Used && entry->Handle != 0 && entry != keep)
+            {
+                loaded++;
+                if (lru == NULL || (UINT32)(cache->Tick - entry->LastUse) > (UINT32)(cache->Tick - lru->LastUse))
+                {
+                    lru = entry;
+                }
+            }
+        }
+
+        if (loaded >= cache->Limit && lru != NULL)
+        {
+            unload_entry(tpm, lru);
+        }
+    } while (loaded > cache->Limit && lru != NULL);
+}
+
+// Returns a free slot, evicting the least recently used key if all are taken
+static TSS_KEY_CACHE_ENTRY* get_free_entry(TSS_DEVICE* tpm, TSS_KEY_CACHE* cache)
+{
+    TSS_KEY_CACHE_ENTRY* result = NULL;
+    size_t index;
+    for (index = 0; index < TSS_KEY_CACHE_SIZE; index++)
+    {
+        TSS_KEY_CACHE_ENTRY* entry = &cache->Entries[index];
+        if (!entry->Used)
+        {
+            result = entry;
+            break;
+        }
+        else if (result == NULL || (UINT32)(cache->Tick - entry->LastUse) > (UINT32)(cache->Tick - result->LastUse))
+        {
+            result = entry;
+        }
+    }
+
+    if (result->Used)
+    {
+        drop_entry(tpm, result);
+    }
+    return result;
+}
+
+TPM_RC tpm_key_cache_add(TSS_DEVICE* tpm, TSS_KEY_CACHE* cache, UINT32 keyId, TPM_HANDLE handle)
+{
+    TPM_RC result;
+    TSS_KEY_CACHE_ENTRY* entry;
+
+    if (tpm == NULL || cache == NULL || (handle >> HR_SHIFT) != TPM_HT_TRANSIENT)
+    {
+        LogError("Invalid parameter tpm: %p, cache: %p, handle: 0x%x", tpm, cache, handle);
+        result = TPM_RC_FAILURE;
+    }
+    else
+    {
+        if ((entry = find_entry(cache, keyId)) != NULL)
+        {
+            // Replaced by a new object
+            drop_entry(tpm, entry);
+        }
+
+        // The object is already loaded, so only the keys loaded before it
+        // count against the limit
+        make_room(tpm, cache, NULL);
+
+        entry = get_free_entry(tpm, cache);
+        entry->Used = TRUE;
+        entry->KeyId = keyId;
+        entry->Handle = handle;
+        entry->Saved = FALSE;
+        entry->LastUse = ++cache->Tick;
+        result = TPM_RC_SUCCESS;
+    }
+    return result;
+}
+
+TPM_RC tpm_key_cache_get(TSS_DEVICE* tpm, TSS_KEY_CACHE* cache, UINT32 keyId, TPM_HANDLE* handle)
+{
+    TPM_RC result;
+    TSS_KEY_CACHE_ENTRY* entry;
+
+    if (tpm == NULL || cache == NULL || handle == NULL)
+    {
+        LogError("Invalid parameter tpm: %p, cache: %p, handle: %p", tpm, cache, handle);
+        result = TPM_RC_FAILURE;
+    }
+    else if ((entry = find_entry(cache, keyId)) == NULL)
+    {
+        result = TPM_RC_HANDLE;
+    }
+    else
+    {
+        if (entry->Handle != 0)
+        {
+            result = TPM_RC_SUCCESS;
+        }
+        else
+        {
+            make_room(tpm, cache, entry);
+            if ((result = TPM2_ContextLoad(tpm, &entry->Context, &entry->Handle)) != TPM_RC_SUCCESS)
+            {
+                // E.g. the hierarchy was cleared, or the TPM was reset and the
+                // key was not preserved. The caller has to re-create it.
+                LogError("Failure loading the context of key %u: 0x%x", keyId, result);
+                entry->Handle = 0;
+                drop_entry(tpm, entry);
+                result = TPM_RC_HANDLE;
+            }
+        }
+
+        if (result == TPM_RC_SUCCESS)
+        {
+            entry->LastUse = ++cache->Tick;
+            *handle = entry->Handle;
+        }
+    }
+    return result;
+}
+
+void tpm_key_cache_remove(TSS_DEVICE* tpm, TSS_KEY_CACHE* cache, UINT32 keyId)
+{
+    TSS_KEY_CACHE_ENTRY* entry;
+    if (tpm == NULL || cache == NULL)
+    {
+        LogError("Invalid parameter tpm: %p, cache: %p", tpm, cache);
+    }
+    else if ((entry = find_entry(cache, keyId)) != NULL)
+    {
+        drop_entry(tpm, entry);
+    }
+}
+
+void tpm_key_cache_clear(TSS_DEVICE* tpm, TSS_KEY_CACHE* cache)
+{
+    size_t index;
+    if (tpm == NULL || cache == NULL)
+    {
+        LogError("Invalid parameter tpm: %p, cache: %p", tpm, cache);
+    }
+    else
+    {
+        for (index = 0; index < TSS_KEY_CACHE_SIZE; index++)
+        {
+            if (cache->Entries[index].Used)
+            {
+                drop_entry(tpm, &cache->Entries[index]);
+            }
+        }
+    }
+}
+
+int tpm_key_cache_load(TSS_KEY_CACHE* cache, const char* path)
+{
+    int result;
+    BYTE* buffer;
+    FILE* file;
+
+    if (cache == NULL || path == NULL)
+    {
+        LogError("Invalid parameter cache: %p, path: %p", cache, path);
+        result = __FAILURE__;
+    }
+    else if ((buffer = (BYTE*)malloc(KEY_CACHE_MAX_FILE_SIZE)) == NULL)
+    {
+        LogError("Failure allocating key cache file buffer");
+        result = __FAILURE__;
+    }
+    else
+    {
+        size_t size = 0;
+        UINT32 header[4];
+        BYTE* current = buffer;
+        INT32 remaining;
+        UINT32 index;
+
+        memset(cache, 0, sizeof(TSS_KEY_CACHE));
+        if ((file = fopen(path, "rb")) != NULL)
+        {
+            size = fread(buffer, 1, KEY_CACHE_MAX_FILE_SIZE, file);
+            if (ferror(file))
+            {
+                size = 0;
+            }
+            (void)fclose(file);
+        }
+
+        remaining = (INT32)size;
+        for (index = 0; index < 4; index++)
+        {
+            if (UINT32_Unmarshal(&header[index], &current, &remaining) != TPM_RC_SUCCESS)
+            {
+                break;
+            }
+        }
+
+        if (index < 4 || header[0] != KEY_CACHE_MAGIC || header[1] != KEY_CACHE_VERSION ||
+            header[2] != KEY_CACHE_SLOT_SIZE || header[3] > TSS_KEY_CACHE_SIZE ||
+            size != KEY_CACHE_HEADER_SIZE + header[3] * KEY_CACHE_SLOT_SIZE)
+        {
+            if (size != 0)
+            {
+                LogInfo("Ignoring malformed key cache file %s", path);
+            }
+        }
+        else
+        {
+            for (index = 0; index < header[3]; index++)
+            {
+                TSS_KEY_CACHE_ENTRY* entry = &cache->Entries[index];
+
+                current = buffer + KEY_CACHE_HEADER_SIZE + index * KEY_CACHE_SLOT_SIZE;
+                remaining = (INT32)KEY_CACHE_SLOT_SIZE;
+                if (UINT32_Unmarshal(&entry->KeyId, &current, &remaining) != TPM_RC_SUCCESS ||
+                    TPMS_CONTEXT_Unmarshal(&entry->Context, &current, &remaining) != TPM_RC_SUCCESS)
+                {
+                    LogInfo("Ignoring malformed key cache file %s", path);
+                    memset(cache, 0, sizeof(TSS_KEY_CACHE));
+                    break;
+                }
+                entry->Used = TRUE;
+                entry->Saved = TRUE;
+            }
+        }
+        free(buffer);
+        result = 0;
+    }
+    return result;
+}
+
+int tpm_key_cache_save(TSS_DEVICE* tpm, TSS_KEY_CACHE* cache, const char* path)
+{
+    int result;
+    BYTE* buffer;
+
+    if (tpm == NULL || cache == NULL || path == NULL)
+    {
+        LogError("Invalid parameter tpm: %p, cache: %p, path: %p", tpm, cache, path);
+        result = __FAILURE__;
+    }
+    else if ((buffer = (BYTE*)malloc(KEY_CACHE_MAX_FILE_SIZE)) == NULL)
+    {
+        LogError("Failure allocating key cache file buffer");
+        result = __FAILURE__;
+    }
+    else
+    {
+        UINT32 header[4] = { KEY_CACHE_MAGIC, KEY_CACHE_VERSION, KEY_CACHE_SLOT_SIZE, 0 };
+        BYTE* current;
+        INT32 remaining;
+        FILE* file;
+        size_t fileSize;
+        size_t index;
+
+        memset(buffer, 0, KEY_CACHE_MAX_FILE_SIZE);
+        for (index = 0; index < TSS_KEY_CACHE_SIZE; index++)
+        {
+            TSS_KEY_CACHE_ENTRY* entry = &cache->Entries[index];
+            if (entry->Used && !entry->Saved && TPM2_ContextSave(tpm, entry->Handle, &entry->Context) == TPM_RC_SUCCESS)
+            {
+                entry->Saved = TRUE;
+            }
+
+            if (entry->Used && entry->Saved)
+            {
+                current = buffer + KEY_CACHE_HEADER_SIZE + header[3] * KEY_CACHE_SLOT_SIZE;
+                remaining = (INT32)KEY_CACHE_SLOT_SIZE;
+                (void)UINT32_Marshal(&entry->KeyId, &current, &remaining);
+                (void)TPMS_CONTEXT_Marshal(&entry->Context, &current, &remaining);
+                header[3]++;
+            }
+        }
+
+        current = buffer;
+        remaining = (INT32)KEY_CACHE_HEADER_SIZE;
+        for (index = 0; index < 4; index++)
+        {
+            (void)UINT32_Marshal(&header[index], &current, &remaining);
+        }
+
+        fileSize = KEY_CACHE_HEADER_SIZE + header[3] * KEY_CACHE_SLOT_SIZE;
+        if ((file = fopen(path, "wb")) == NULL)
+        {
+            LogError("Failure opening key cache file %s", path);
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = fwrite(buffer, 1, fileSize, file) == fileSize ? 0 : __FAILURE__;
+            if (fclose(file) != 0)
+            {
+                result = __FAILURE__;
+            }
+            if (result != 0)
+            {
+                LogError("Failure writing key cache file %s", path);
+            }
+        }
+        free(buffer);
+    }
+    return result;
+}
@@ -0,0 +1,119 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#include "azure_utpm_c/tpm_mpsc_queue.h"
+
+// The producers link their node with one atomic exchange of the head, after
+// which the node of the previous head gets its next pointer. The consumer
+// walks the next pointers from the tail, with a stub node keeping the list
+// non empty (D. Vyukov's intrusive MPSC queue).
+#ifdef WIN32
+// Volatile accesses have acquire and release semantics with MSVC
+#define MPSC_EXCHANGE(target, value)    InterlockedExchangePointer((PVOID volatile*)(target), (value))
+#define MPSC_LOAD(source)               (*(source))
+#define MPSC_STORE(target, value)       (*(target) = (value))
+#define MPSC_INCREMENT(target)          InterlockedIncrement(target)
+#define MPSC_DECREMENT(target)          InterlockedDecrement(target)
+#else
+#define MPSC_EXCHANGE(target, value)    __atomic_exchange_n((target), (value), __ATOMIC_ACQ_REL)
+#define MPSC_LOAD(source)               __atomic_load_n((source), __ATOMIC_ACQUIRE)
+#define MPSC_STORE(target, value)       __atomic_store_n((target), (value), __ATOMIC_RELEASE)
+#define MPSC_INCREMENT(target)          __atomic_add_fetch((target), 1, __ATOMIC_ACQ_REL)
+#define MPSC_DECREMENT(target)          __atomic_sub_fetch((target), 1, __ATOMIC_ACQ_REL)
+#endif
+
+static void link_node(TSS_MPSC_QUEUE* queue, TSS_MPSC_NODE* node)
+{
+    TSS_MPSC_NODE* prev;
+
+    node->next = NULL;
+    prev = (TSS_MPSC_NODE*)MPSC_EXCHANGE(&queue->head, node);
+    // Until this store the consumer cannot reach the node
+    MPSC_STORE(&prev->next, node);
+}
+
+void tpm_mpsc_init(TSS_MPSC_QUEUE* queue)
+{
+    if (queue != NULL)
+    {
+        queue->stub.next = NULL;
+        queue->head = &queue->stub;
+        queue->tail = &queue->stub;
+        queue->count = 0;
+    }
+}
+
+bool tpm_mpsc_push(TSS_MPSC_QUEUE* queue, TSS_MPSC_NODE* node)
+{
+    bool result;
+    if (queue == NULL || node == NULL)
+    {
+        result = false;
+    }
+    else
+    {
+        // Counted first, so that a consumer going idle sees the node coming
+        result = MPSC_INCREMENT(&queue->count) == 1;
+        link_node(queue, node);
+    }
+    return result;
+}
+
+TSS_MPSC_NODE* tpm_mpsc_pop(TSS_MPSC_QUEUE* queue)
+{
+    TSS_MPSC_NODE* result = NULL;
+    if (queue != NULL)
+    {
+        TSS_MPSC_NODE* tail = queue->tail;
+        TSS_MPSC_NODE* next = (TSS_MPSC_NODE*)MPSC_LOAD(&tail->next);
+
+        if (tail == &queue->stub && next != NULL)
+        {
+            // Skip the stub
+            queue->tail = next;
+            tail = next;
+            next = (TSS_MPSC_NODE*)MPSC_LOAD(&tail->next);
+        }
+
+        if (tail == &queue->stub)
+        {
+            // Empty, or the first node is still being linked
+        }
+        else if (next != NULL)
+        {
+            queue->tail = next;
+            result = tail;
+        }
+        else if (tail == (TSS_MPSC_NODE*)MPSC_LOAD(&queue->head))
+        {
+            // The tail is the last node. The stub is pushed behind it so that
+            // it can be unlinked.
+            link_node(queue, &queue->stub);
+            next = (TSS_MPSC_NODE*)MPSC_LOAD(&tail->next);
+            if (next != NULL)
+            {
+                queue->tail = next;
+                result = tail;
+            }
+        }
+
+        if (result != NULL)
+        {
+            (void)MPSC_DECREMENT(&queue->count);
+        }
+    }
+    return result;
+}
+
+bool tpm_mpsc_is_empty(TSS_MPSC_QUEUE* queue)
+{
+    return queue == NULL || MPSC_LOAD(&queue->count) == 0;
+}
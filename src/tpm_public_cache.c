@@ -0,0 +1,260 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "azure_utpm_c/tpm_public_cache.h"
+#include "azure_utpm_c/Marshal_fp.h"
+
+// The file holds a header followed by Count fixed size slots, so that the
+// entry N always starts at PUBLIC_CACHE_HEADER_SIZE + N * PUBLIC_CACHE_SLOT_SIZE.
+// All the fields are marshaled in TPM (big endian) representation:
+//
+//  header: magic, version, slot size, identity[TSS_PUBLIC_CACHE_ID_SIZE], count
+//  slot:   handle, TPM2B_PUBLIC, TPM2B_NAME, zero padding
+#define PUBLIC_CACHE_MAGIC          0x75545043      // 'uTPC'
+#define PUBLIC_CACHE_VERSION        1
+#define PUBLIC_CACHE_HEADER_SIZE    ((4 + TSS_PUBLIC_CACHE_ID_SIZE) * sizeof(UINT32))
+#define PUBLIC_CACHE_SLOT_SIZE      (sizeof(UINT32) + sizeof(TPM2B_PUBLIC) + sizeof(TPM2B_NAME))
+#define PUBLIC_CACHE_MAX_FILE_SIZE  (PUBLIC_CACHE_HEADER_SIZE + TSS_PUBLIC_CACHE_MAX_ENTRIES * PUBLIC_CACHE_SLOT_SIZE)
+
+static const TPM_PT IDENTITY_PROPERTIES[TSS_PUBLIC_CACHE_ID_SIZE] =
+{
+    TPM_PT_MANUFACTURER,
+    TPM_PT_VENDOR_STRING_1,
+    TPM_PT_FIRMWARE_VERSION_1,
+    TPM_PT_FIRMWARE_VERSION_2
+};
+
+static int get_tpm_identity(TSS_DEVICE* tpm, UINT32* identity)
+{
+    int result = 0;
+    size_t index;
+
+    // Fixed properties are served from the property cache of the device
+    for (index = 0; index < TSS_PUBLIC_CACHE_ID_SIZE; index++)
+    {
+        identity[index] = TSS_GetTpmProperty(tpm, IDENTITY_PROPERTIES[index]);
+        if (identity[index] == (UINT32)-1)
+        {
+            LogError("Failure reading TPM property 0x%x", IDENTITY_PROPERTIES[index]);
+            result = __FAILURE__;
+            break;
+        }
+    }
+    return result;
+}
+
+static size_t read_cache_file(const char* path, BYTE* buffer, size_t capacity)
+{
+    size_t result;
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        result = 0;
+    }
+    else
+    {
+        result = fread(buffer, 1, capacity, file);
+        if (ferror(file))
+        {
+            result = 0;
+        }
+        else if (result == capacity && fgetc(file) != EOF)
+        {
+            // Larger than any valid cache file
+            result = 0;
+        }
+        (void)fclose(file);
+    }
+    return result;
+}
+
+// Unmarshals the entries of the file image in 'buffer' into 'cache'. Returns
+// zero if the image does not hold a cache matching 'identity'.
+static int parse_cache_file(TSS_DEVICE* tpm, TSS_PUBLIC_CACHE* cache, const UINT32* identity, BYTE* buffer, INT32 size)
+{
+    int result = 0;
+    UINT32 header[4 + TSS_PUBLIC_CACHE_ID_SIZE];
+    BYTE* current = buffer;
+    INT32 remaining = size;
+    UINT32 index;
+
+    for (index = 0; index < 4 + TSS_PUBLIC_CACHE_ID_SIZE; index++)
+    {
+        if (UINT32_Unmarshal(&header[index], &current, &remaining) != TPM_RC_SUCCESS)
+        {
+            result = __FAILURE__;
+            break;
+        }
+    }
+
+    if (result != 0 ||
+        header[0] != PUBLIC_CACHE_MAGIC || header[1] != PUBLIC_CACHE_VERSION ||
+        header[2] != PUBLIC_CACHE_SLOT_SIZE ||
+        memcmp(&header[3], identity, TSS_PUBLIC_CACHE_ID_SIZE * sizeof(UINT32)) != 0)
+    {
+        LogInfo("Public cache was written by a different TPM or library version");
+        result = __FAILURE__;
+    }
+    else if (header[3 + TSS_PUBLIC_CACHE_ID_SIZE] > TSS_PUBLIC_CACHE_MAX_ENTRIES ||
+        (size_t)size != PUBLIC_CACHE_HEADER_SIZE + header[3 + TSS_PUBLIC_CACHE_ID_SIZE] * PUBLIC_CACHE_SLOT_SIZE)
+    {
+        LogError("Public cache file is truncated");
+        result = __FAILURE__;
+    }
+    else
+    {
+        UINT32 count = header[3 + TSS_PUBLIC_CACHE_ID_SIZE];
+        for (index = 0; index < count; index++)
+        {
+            TSS_PUBLIC_CACHE_ENTRY* entry = &cache->Entries[cache->Count];
+            BOOL present;
+
+            current = buffer + PUBLIC_CACHE_HEADER_SIZE + index * PUBLIC_CACHE_SLOT_SIZE;
+            remaining = (INT32)PUBLIC_CACHE_SLOT_SIZE;
+            if (UINT32_Unmarshal(&entry->Handle, &current, &remaining) != TPM_RC_SUCCESS ||
+                (entry->Handle >> HR_SHIFT) != TPM_HT_PERSISTENT ||
+                TPM2B_PUBLIC_Unmarshal(&entry->Public, &current, &remaining, TRUE) != TPM_RC_SUCCESS ||
+                TPM2B_NAME_Unmarshal(&entry->Name, &current, &remaining) != TPM_RC_SUCCESS)
+            {
+                LogError("Public cache entry %u is malformed", index);
+                cache->Count = 0;
+                result = __FAILURE__;
+                break;
+            }
+            else if (TSS_IsPersistentHandlePresent(tpm, entry->Handle, &present) == TPM_RC_SUCCESS && !present)
+            {
+                // The object was evicted since the cache was saved
+                cache->Dirty = TRUE;
+            }
+            else
+            {
+                cache->Count++;
+            }
+        }
+    }
+    return result;
+}
+
+int tpm_public_cache_load(TSS_DEVICE* tpm, TSS_PUBLIC_CACHE* cache, const char* path)
+{
+    int result;
+    BYTE* buffer;
+
+    if (tpm == NULL || cache == NULL || path == NULL)
+    {
+        LogError("Invalid parameter tpm: %p, cache: %p, path: %p", tpm, cache, path);
+        result = __FAILURE__;
+    }
+    else
+    {
+        memset(cache, 0, sizeof(TSS_PUBLIC_CACHE));
+        if (get_tpm_identity(tpm, cache->Identity) != 0)
+        {
+            result = __FAILURE__;
+        }
+        else if ((buffer = (BYTE*)malloc(PUBLIC_CACHE_MAX_FILE_SIZE)) == NULL)
+        {
+            LogError("Failure allocating public cache file buffer");
+            result = __FAILURE__;
+        }
+        else
+        {
+            size_t size = read_cache_file(path, buffer, PUBLIC_CACHE_MAX_FILE_SIZE);
+            if (size == 0 || parse_cache_file(tpm, cache, cache->Identity, buffer, (INT32)size) != 0)
+            {
+                // Start over, the TPM is the source of truth
+                cache->Count = 0;
+                cache->Dirty = FALSE;
+            }
+            free(buffer);
+            result = 0;
+        }
+    }
+    return result;
+}
+
+int tpm_public_cache_save(TSS_PUBLIC_CACHE* cache, const char* path)
+{
+    int result;
+    BYTE* buffer;
+
+    if (cache == NULL || path == NULL)
+    {
+        LogError("Invalid parameter cache: %p, path: %p", cache, path);
+        result = __FAILURE__;
+    }
+    else if (!cache->Dirty)
+    {
+        result = 0;
+    }
+    else if ((buffer = (BYTE*)malloc(PUBLIC_CACHE_MAX_FILE_SIZE)) == NULL)
+    {
+        LogError("Failure allocating public cache file buffer");
+        result = __FAILURE__;
+    }
+    else
+    {
+        UINT32 header[4 + TSS_PUBLIC_CACHE_ID_SIZE];
+        size_t fileSize = PUBLIC_CACHE_HEADER_SIZE + cache->Count * PUBLIC_CACHE_SLOT_SIZE;
+        BYTE* current = buffer;
+        INT32 remaining = (INT32)PUBLIC_CACHE_HEADER_SIZE;
+        FILE* file;
+        UINT32 index;
+
+        header[0] = PUBLIC_CACHE_MAGIC;
+        header[1] = PUBLIC_CACHE_VERSION;
+        header[2] = PUBLIC_CACHE_SLOT_SIZE;
+        memcpy(&header[3], cache->Identity, TSS_PUBLIC_CACHE_ID_SIZE * sizeof(UINT32));
+        header[3 + TSS_PUBLIC_CACHE_ID_SIZE] = cache->Count;
+
+        memset(buffer, 0, fileSize);
+        for (index = 0; index < 4 + TSS_PUBLIC_CACHE_ID_SIZE; index++)
+        {
+            (void)UINT32_Marshal(&header[index], &current, &remaining);
+        }
+        for (index = 0; index < cache->Count; index++)
+        {
+            TSS_PUBLIC_CACHE_ENTRY* entry = &cache->Entries[index];
+
+            current = buffer + PUBLIC_CACHE_HEADER_SIZE + index * PUBLIC_CACHE_SLOT_SIZE;
+            remaining = (INT32)PUBLIC_CACHE_SLOT_SIZE;
+            (void)UINT32_Marshal(&entry->Handle, &current, &remaining);
+            (void)TPM2B_PUBLIC_Marshal(&entry->Public, &current, &remaining);
+            (void)TPM2B_NAME_Marshal(&entry->Name, &current, &remaining);
+        }
+
+        if ((file = fopen(path, "wb")) == NULL)
+        {
+            LogError("Failure opening public cache file %s", path);
+            result = __FAILURE__;
+        }
+        else
+        {
+            if (fwrite(buffer, 1, fileSize, file) != fileSize)
+            {
+                LogError("Failure writing public cache file %s", path);
+                result = __FAILURE__;
+            }
+            else
+            {
+                cache->Dirty = FALSE;
+                result = 0;
+            }
+            if (fclose(file) != 0 && result == 0)
+            {
+                LogError("Failure closing public cache file %s", path);
+                result = __FAILURE__;
+            }
+        }
+        free(buffer);
+    }
+    return result;
+}
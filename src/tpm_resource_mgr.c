@@ -0,0 +1,1144 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
+
+#include "azure_utpm_c/tpm_resource_mgr.h"
+#include "azure_utpm_c/tpm_comm.h"
+#include "azure_utpm_c/Memory_fp.h"
+
+// Size of the tag, size and command (response) code fields
+#define RM_HEADER_SIZE          10
+
+// Virtual handles are taken from the upper half of the transient range, which
+// the TPMs do not use for their own objects
+#define RM_VIRTUAL_HANDLE_FIRST (HR_TRANSIENT | 0x00800000)
+#define RM_VIRTUAL_HANDLE_MASK  0x007FFFFF
+
+// continueSession bit of the TPMA_SESSION of an authorization
+#define RM_CONTINUE_SESSION     0x01
+
+// Bounds the waits for a completion, in case its signal was lost
+#define RM_WAIT_INTERVAL_MS     100
+
+typedef struct RM_OBJECT_TAG
+{
+    bool in_use;
+    TSS_DEVICE* client;
+    TPM_HANDLE virtual_handle;
+
+    // Handle of the object while it is loaded in the TPM, or 0 while only its
+    // saved context is
+    TPM_HANDLE physical_handle;
+    TPMS_CONTEXT context;
+    UINT32 last_use;
+} RM_OBJECT;
+
+typedef struct RM_SESSION_TAG
+{
+    bool in_use;
+    TSS_DEVICE* client;
+
+    // Sessions keep their handle when they are saved and loaded again
+    TPM_HANDLE handle;
+    bool loaded;
+    TPMS_CONTEXT context;
+    UINT32 last_use;
+} RM_SESSION;
+
+typedef struct TSS_RESOURCE_MGR_TAG
+{
+    LOCK_HANDLE lock;
+
+    // Connection to the TPM, also used for the context management commands
+    TSS_DEVICE device;
+
+    // Incremented for every command. Objects and sessions referenced by the
+    // command being executed have last_use equal to it, and are not evicted.
+    UINT32 tick;
+    UINT32 next_virtual;
+
+    RM_OBJECT objects[TSS_RM_MAX_OBJECTS];
+    RM_SESSION sessions[TSS_RM_MAX_SESSIONS];
+
+    // Copy of the command of the client with the handles translated
+    BYTE cmd_buffer[MAX_COMMAND_BUFFER];
+
+    // Set once tpm_rm_start_worker started the worker thread, which sleeps on
+    // idle_cond while the queue is empty
+    THREAD_HANDLE worker;
+    TSS_MPSC_QUEUE queue;
+    LOCK_HANDLE idle_lock;
+    COND_HANDLE idle_cond;
+    volatile bool stopping;
+} TSS_RESOURCE_MGR;
+
+// Completion of the requests a client submits by tpm_rm_submit_command. A
+// client runs one command at a time, so its waiter is reused for all of them.
+typedef struct TSS_RM_WAITER_TAG
+{
+    LOCK_HANDLE lock;
+    COND_HANDLE cond;
+    volatile bool done;
+} RM_WAITER;
+
+static bool is_virtual_handle(TPM_HANDLE handle)
+{
+    return (handle & ~RM_VIRTUAL_HANDLE_MASK) == RM_VIRTUAL_HANDLE_FIRST;
+}
+
+static bool is_session_handle(TPM_HANDLE handle)
+{
+    return (handle >> HR_SHIFT) == TPM_HT_HMAC_SESSION || (handle >> HR_SHIFT) == TPM_HT_POLICY_SESSION;
+}
+
+// Commands returning a handle right after the response header
+static bool returns_handle(TPM_CC cmdCode)
+{
+    return cmdCode == TPM_CC_CreatePrimary
+        || cmdCode == TPM_CC_Load
+        || cmdCode == TPM_CC_HMAC_Start
+        || cmdCode == TPM_CC_ContextLoad
+        || cmdCode == TPM_CC_LoadExternal
+        || cmdCode == TPM_CC_StartAuthSession
+        || cmdCode == TPM_CC_HashSequenceStart
+        || cmdCode == TPM_CC_CreateLoaded;
+}
+
+static RM_OBJECT* find_object(TSS_RESOURCE_MGR* rm, TPM_HANDLE virtual_handle)
+{
+    RM_OBJECT* result = NULL;
+    size_t index;
+    for (index = 0; index < TSS_RM_MAX_OBJECTS; index++)
+    {
+        if (rm->objects[index].in_use && rm->objects[index].virtual_handle == virtual_handle)
+        {
+            result = &rm->objects[index];
+            break;
+        }
+    }
+    return result;
+}
+
+static RM_SESSION* find_session(TSS_RESOURCE_MGR* rm, TPM_HANDLE handle)
+{
+    RM_SESSION* result = NULL;
+    size_t index;
+    for (index = 0; index < TSS_RM_MAX_SESSIONS; index++)
+    {
+        if (rm->sessions[index].in_use && rm->sessions[index].handle == handle)
+        {
+            result = &rm->sessions[index];
+            break;
+        }
+    }
+    return result;
+}
+
+static RM_OBJECT* find_free_object(TSS_RESOURCE_MGR* rm)
+{
+    RM_OBJECT* result = NULL;
+    size_t index;
+    for (index = 0; index < TSS_RM_MAX_OBJECTS; index++)
+    {
+        if (!rm->objects[index].in_use)
+        {
+            result = &rm->objects[index];
+            break;
+        }
+    }
+    return result;
+}
+
+static RM_SESSION* find_free_session(TSS_RESOURCE_MGR* rm)
+{
+    RM_SESSION* result = NULL;
+    size_t index;
+    for (index = 0; index < TSS_RM_MAX_SESSIONS; index++)
+    {
+        if (!rm->sessions[index].in_use)
+        {
+            result = &rm->sessions[index];
+            break;
+        }
+    }
+    return result;
+}
+
+static void release_object(TSS_RESOURCE_MGR* rm, RM_OBJECT* object)
+{
+    if (object->physical_handle != 0)
+    {
+        (void)TPM2_FlushContext(&rm->device, object->physical_handle);
+    }
+    memset(object, 0, sizeof(RM_OBJECT));
+}
+
+static void release_session(TSS_RESOURCE_MGR* rm, RM_SESSION* session)
+{
+    // Saved sessions are flushed by their handle as well
+    (void)TPM2_FlushContext(&rm->device, session->handle);
+    memset(session, 0, sizeof(RM_SESSION));
+}
+
+// Saves and flushes the least recently used object (or session) not referenced
+// by the current command
+static TPM_RC evict_lru(TSS_RESOURCE_MGR* rm, bool session)
+{
+    TPM_RC result;
+    size_t index;
+
+    if (session)
+    {
+        RM_SESSION* lru = NULL;
+        for (index = 0; index < TSS_RM_MAX_SESSIONS; index++)
+        {
+            RM_SESSION* current = &rm->sessions[index];
+            if (current->in_use && current->loaded && current->last_use != rm->tick &&
+                (lru == NULL || current->last_use < lru->last_use))
+            {
+                lru = current;
+            }
+        }
+
+        if (lru == NULL)
+        {
+            result = TPM_RC_SESSION_MEMORY;
+        }
+        // Saving a session also removes it from the TPM memory
+        else if ((result = TPM2_ContextSave(&rm->device, lru->handle, &lru->context)) != TPM_RC_SUCCESS)
+        {
+            LogError("Failure saving session 0x%x: 0x%x", lru->handle, result);
+        }
+        else
+        {
+            lru->loaded = false;
+        }
+    }
+    else
+    {
+        RM_OBJECT* lru = NULL;
+        for (index = 0; index < TSS_RM_MAX_OBJECTS; index++)
+        {
+            RM_OBJECT* current = &rm->objects[index];
+            if (current->in_use && current->physical_handle != 0 && current->last_use != rm->tick &&
+                (lru == NULL || current->last_use < lru->last_use))
+            {
+                lru = current;
+            }
+        }
+
+        if (lru == NULL)
+        {
+            result = TPM_RC_OBJECT_MEMORY;
+        }
+        else if ((result = TPM2_ContextSave(&rm->device, lru->physical_handle, &lru->context)) != TPM_RC_SUCCESS)
+        {
+            LogError("Failure saving object 0x%x: 0x%x", lru->virtual_handle, result);
+        }
+        else
+        {
+            (void)TPM2_FlushContext(&rm->device, lru->physical_handle);
+            lru->physical_handle = 0;
+        }
+    }
+    return result;
+}
+
+// Loads a saved context, making room for it as long as there is something to
+// evict
+static TPM_RC load_context(TSS_RESOURCE_MGR* rm, TPMS_CONTEXT* context, TPM_HANDLE* loaded_handle)
+{
+    TPM_RC result;
+    do
+    {
+        result = TPM2_ContextLoad(&rm->device, context, loaded_handle);
+    } while ((result == TPM_RC_OBJECT_MEMORY || result == TPM_RC_SESSION_MEMORY) &&
+             evict_lru(rm, result == TPM_RC_SESSION_MEMORY) == TPM_RC_SUCCESS);
+    return result;
+}
+
+// Translates a handle of the command of 'client'. Returns the response code to
+// fail the command with, if any.
+static TPM_RC map_handle(TSS_RESOURCE_MGR* rm, TSS_DEVICE* client, TPM_HANDLE handle, TPM_HANDLE* physical_handle)
+{
+    TPM_RC result = TPM_RC_SUCCESS;
+
+    *physical_handle = handle;
+    if (is_virtual_handle(handle))
+    {
+        RM_OBJECT* object = find_object(rm, handle);
+        if (object == NULL || object->client != client)
+        {
+            LogError("Handle 0x%x is unknown or belongs to another client", handle);
+            result = TPM_RC_HANDLE;
+        }
+        else
+        {
+            object->last_use = rm->tick;
+            if (object->physical_handle == 0 &&
+                (result = load_context(rm, &object->context, &object->physical_handle)) != TPM_RC_SUCCESS)
+            {
+                LogError("Failure loading object 0x%x: 0x%x", handle, result);
+                object->physical_handle = 0;
+            }
+            *physical_handle = object->physical_handle;
+        }
+    }
+    else if ((handle >> HR_SHIFT) == TPM_HT_TRANSIENT)
+    {
+        // Objects of the other clients must not be reachable by their handle
+        LogError("Handle 0x%x is not a virtual handle", handle);
+        result = TPM_RC_HANDLE;
+    }
+    else if (is_session_handle(handle))
+    {
+        // Sessions not started through the manager are passed through
+        RM_SESSION* session = find_session(rm, handle);
+        if (session != NULL)
+        {
+            if (session->client != client)
+            {
+                LogError("Session 0x%x does not belong to the client", handle);
+                result = TPM_RC_HANDLE;
+            }
+            else
+            {
+                TPM_HANDLE loaded_handle;
+                session->last_use = rm->tick;
+                if (!session->loaded)
+                {
+                    if ((result = load_context(rm, &session->context, &loaded_handle)) != TPM_RC_SUCCESS)
+                    {
+                        LogError("Failure loading session 0x%x: 0x%x", handle, result);
+                    }
+                    else
+                    {
+                        session->loaded = true;
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
+
+// Locates the authorization area of the command copied into cmd_buffer, which
+// comes from the client and must not be trusted: 'current' is set to its first
+// authorization and 'end' right after its last one
+static TPM_RC get_auth_area(TSS_RESOURCE_MGR* rm, UINT32 numHandles, UINT32 cmdSize, BYTE** current, BYTE** end)
+{
+    TPM_RC result;
+    size_t offset = RM_HEADER_SIZE + (size_t)numHandles * sizeof(TPM_HANDLE);
+    if (cmdSize < offset + sizeof(UINT32))
+    {
+        LogError("Command of %u bytes has no room for its authorization size", cmdSize);
+        result = TPM_RC_AUTHSIZE;
+    }
+    else
+    {
+        UINT32 authSize = BYTE_ARRAY_TO_UINT32(rm->cmd_buffer + offset);
+        if (authSize > cmdSize - offset - sizeof(UINT32))
+        {
+            LogError("Authorization size %u exceeds the command of %u bytes", authSize, cmdSize);
+            result = TPM_RC_AUTHSIZE;
+        }
+        else
+        {
+            *current = rm->cmd_buffer + offset + sizeof(UINT32);
+            *end = *current + authSize;
+            result = TPM_RC_SUCCESS;
+        }
+    }
+    return result;
+}
+
+// Parses the authorization at 'current' (a handle, nonce, attributes and HMAC)
+// and moves 'current' past it. Every field is checked to lie before 'end'.
+static TPM_RC next_authorization(BYTE** current, const BYTE* end, BYTE** handle, BYTE** attributes)
+{
+    TPM_RC result;
+    BYTE* pos = *current;
+    UINT16 size;
+
+    if ((size_t)(end - pos) < sizeof(TPM_HANDLE) + sizeof(UINT16))
+    {
+        result = TPM_RC_AUTHSIZE;
+    }
+    else
+    {
+        *handle = pos;
+        pos += sizeof(TPM_HANDLE);
+        size = BYTE_ARRAY_TO_UINT16(pos);
+        pos += sizeof(UINT16);
+        if ((size_t)(end - pos) < (size_t)size + sizeof(BYTE) + sizeof(UINT16))
+        {
+            result = TPM_RC_SIZE;
+        }
+        else
+        {
+            pos += size;
+            *attributes = pos;
+            pos += sizeof(BYTE);
+            size = BYTE_ARRAY_TO_UINT16(pos);
+            pos += sizeof(UINT16);
+            if ((size_t)(end - pos) < size)
+            {
+                result = TPM_RC_SIZE;
+            }
+            else
+            {
+                *current = pos + size;
+                result = TPM_RC_SUCCESS;
+            }
+        }
+    }
+    return result;
+}
+
+// Translates the handles of the handle area and of the authorization area of
+// the command copied into cmd_buffer. Commands with a malformed authorization
+// area are rejected instead of being forwarded.
+static TPM_RC map_command_handles(TSS_RESOURCE_MGR* rm, TSS_DEVICE* client, UINT32 numHandles, UINT32 cmdSize)
+{
+    TPM_RC result = TPM_RC_SUCCESS;
+    BYTE* current = rm->cmd_buffer + RM_HEADER_SIZE;
+    UINT32 index;
+
+    for (index = 0; index < numHandles && result == TPM_RC_SUCCESS; index++, current += sizeof(TPM_HANDLE))
+    {
+        TPM_HANDLE physical_handle;
+        if ((result = map_handle(rm, client, BYTE_ARRAY_TO_UINT32(current), &physical_handle)) == TPM_RC_HANDLE)
+        {
+            result += TPM_RC_H + TPM_RC_1 * (index + 1);
+        }
+        else if (result == TPM_RC_SUCCESS)
+        {
+            UINT32_TO_BYTE_ARRAY(physical_handle, current);
+        }
+    }
+
+    if (result == TPM_RC_SUCCESS && BYTE_ARRAY_TO_UINT16(rm->cmd_buffer) == TPM_ST_SESSIONS)
+    {
+        BYTE* end;
+        if ((result = get_auth_area(rm, numHandles, cmdSize, &current, &end)) == TPM_RC_SUCCESS)
+        {
+            for (index = 0; current < end && result == TPM_RC_SUCCESS; index++)
+            {
+                BYTE* handle;
+                BYTE* attributes;
+                TPM_HANDLE physical_handle;
+                if ((result = next_authorization(&current, end, &handle, &attributes)) != TPM_RC_SUCCESS)
+                {
+                    LogError("Malformed authorization %u", index + 1);
+                }
+                else if ((result = map_handle(rm, client, BYTE_ARRAY_TO_UINT32(handle), &physical_handle)) == TPM_RC_HANDLE)
+                {
+                    result += TPM_RC_S + TPM_RC_1 * (index + 1);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+// Forgets the sessions the TPM flushed after the command, i.e. the ones used
+// without continueSession. The authorization area was validated by
+// map_command_handles.
+static void drop_ended_sessions(TSS_RESOURCE_MGR* rm, UINT32 numHandles, UINT32 cmdSize)
+{
+    BYTE* current;
+    BYTE* end;
+    if (BYTE_ARRAY_TO_UINT16(rm->cmd_buffer) == TPM_ST_SESSIONS &&
+        get_auth_area(rm, numHandles, cmdSize, &current, &end) == TPM_RC_SUCCESS)
+    {
+        BYTE* handle;
+        BYTE* attributes;
+        while (current < end && next_authorization(&current, end, &handle, &attributes) == TPM_RC_SUCCESS)
+        {
+            RM_SESSION* session = find_session(rm, BYTE_ARRAY_TO_UINT32(handle));
+            if (session != NULL && (*attributes & RM_CONTINUE_SESSION) == 0)
+            {
+                memset(session, 0, sizeof(RM_SESSION));
+            }
+        }
+    }
+}
+
+// Checks that the object or session the command returns can be tracked
+static bool has_room_for_result(TSS_RESOURCE_MGR* rm, TPM_CC cmdCode, UINT32 cmdSize)
+{
+    bool result;
+    if (cmdCode == TPM_CC_StartAuthSession)
+    {
+        result = find_free_session(rm) != NULL;
+    }
+    else if (cmdCode == TPM_CC_ContextLoad && cmdSize >= RM_HEADER_SIZE + sizeof(UINT64) + sizeof(TPM_HANDLE))
+    {
+        // The saved handle follows the sequence number of the context
+        TPM_HANDLE saved_handle = BYTE_ARRAY_TO_UINT32(rm->cmd_buffer + RM_HEADER_SIZE + sizeof(UINT64));
+        result = is_session_handle(saved_handle) ? find_free_session(rm) != NULL : find_free_object(rm) != NULL;
+    }
+    else if (returns_handle(cmdCode))
+    {
+        result = find_free_object(rm) != NULL;
+    }
+    else
+    {
+        result = true;
+    }
+    return result;
+}
+
+static void build_response(BYTE* respBuffer, UINT32* respSize, TPM_RC responseCode)
+{
+    UINT16_TO_BYTE_ARRAY(TPM_ST_NO_SESSIONS, respBuffer);
+    UINT32_TO_BYTE_ARRAY(RM_HEADER_SIZE, respBuffer + 2);
+    UINT32_TO_BYTE_ARRAY(responseCode, respBuffer + 6);
+    *respSize = RM_HEADER_SIZE;
+}
+
+// Sends the translated command, evicting objects or sessions and sending it
+// again for as long as the TPM reports it is out of memory
+static TSS_STATUS send_command(TSS_RESOURCE_MGR* rm, UINT32 cmdSize, BYTE* respBuffer, UINT32* respSize)
+{
+    TSS_STATUS result;
+    UINT32 capacity = *respSize;
+    TPM_RC response_code;
+
+    do
+    {
+        *respSize = capacity;
+        if (tpm_comm_submit_command(rm->device.tpm_comm_handle, rm->cmd_buffer, cmdSize, respBuffer, respSize) != 0)
+        {
+            LogError("Failure submitting command to the TPM");
+            result = TSS_E_TPM_TRANSACTION;
+            break;
+        }
+        else if (*respSize < RM_HEADER_SIZE)
+        {
+            LogError("Invalid response size %u", *respSize);
+            result = TSS_E_BAD_RESPONSE_LEN;
+            break;
+        }
+        result = TSS_SUCCESS;
+        response_code = BYTE_ARRAY_TO_UINT32(respBuffer + 6);
+    } while ((response_code == TPM_RC_OBJECT_MEMORY || response_code == TPM_RC_SESSION_MEMORY) &&
+             evict_lru(rm, response_code == TPM_RC_SESSION_MEMORY) == TPM_RC_SUCCESS);
+    return result;
+}
+
+// Registers the object or session the command of 'client' returned, and hands
+// the virtual handle of the objects to the client
+static void track_returned_handle(TSS_RESOURCE_MGR* rm, TSS_DEVICE* client, BYTE* respBuffer, UINT32* respSize)
+{
+    TPM_HANDLE handle;
+
+    if (*respSize >= RM_HEADER_SIZE + sizeof(TPM_HANDLE))
+    {
+        handle = BYTE_ARRAY_TO_UINT32(respBuffer + RM_HEADER_SIZE);
+        if (is_session_handle(handle))
+        {
+            RM_SESSION* session = find_session(rm, handle);
+            if (session == NULL && (session = find_free_session(rm)) != NULL)
+            {
+                session->in_use = true;
+                session->client = client;
+                session->handle = handle;
+            }
+            if (session != NULL)
+            {
+                session->loaded = true;
+                session->last_use = rm->tick;
+            }
+        }
+        else if ((handle >> HR_SHIFT) == TPM_HT_TRANSIENT)
+        {
+            // has_room_for_result made sure a slot is free
+            RM_OBJECT* object = find_free_object(rm);
+            if (object == NULL)
+            {
+                LogError("No room left to track object 0x%x", handle);
+                (void)TPM2_FlushContext(&rm->device, handle);
+                build_response(respBuffer, respSize, TPM_RC_OBJECT_MEMORY);
+            }
+            else
+            {
+                object->in_use = true;
+                object->client = client;
+                object->physical_handle = handle;
+                object->last_use = rm->tick;
+                do
+                {
+                    object->virtual_handle = RM_VIRTUAL_HANDLE_FIRST | (rm->next_virtual++ & RM_VIRTUAL_HANDLE_MASK);
+                } while (find_object(rm, object->virtual_handle) != object);
+                UINT32_TO_BYTE_ARRAY(object->virtual_handle, respBuffer + RM_HEADER_SIZE);
+            }
+        }
+    }
+}
+
+static TSS_STATUS execute_flush(TSS_RESOURCE_MGR* rm, TSS_DEVICE* client, UINT32 cmdSize, BYTE* respBuffer, UINT32* respSize)
+{
+    TSS_STATUS result;
+    TPM_HANDLE handle = BYTE_ARRAY_TO_UINT32(rm->cmd_buffer + RM_HEADER_SIZE);
+    RM_OBJECT* object = NULL;
+    RM_SESSION* session = NULL;
+
+    if (is_virtual_handle(handle) &&
+        ((object = find_object(rm, handle)) == NULL || object->client != client))
+    {
+        build_response(respBuffer, respSize, TPM_RC_HANDLE + TPM_RC_P + TPM_RC_1);
+        result = TSS_SUCCESS;
+    }
+    else if (is_session_handle(handle) &&
+        (session = find_session(rm, handle)) != NULL && session->client != client)
+    {
+        build_response(respBuffer, respSize, TPM_RC_HANDLE + TPM_RC_P + TPM_RC_1);
+        result = TSS_SUCCESS;
+    }
+    else if (object != NULL && object->physical_handle == 0)
+    {
+        // Only the saved context is left, nothing to flush in the TPM
+        memset(object, 0, sizeof(RM_OBJECT));
+        build_response(respBuffer, respSize, TPM_RC_SUCCESS);
+        result = TSS_SUCCESS;
+    }
+    else
+    {
+        if (object != NULL)
+        {
+            UINT32_TO_BYTE_ARRAY(object->physical_handle, rm->cmd_buffer + RM_HEADER_SIZE);
+        }
+        if ((result = send_command(rm, cmdSize, respBuffer, respSize)) == TSS_SUCCESS &&
+            BYTE_ARRAY_TO_UINT32(respBuffer + 6) == TPM_RC_SUCCESS)
+        {
+            if (object != NULL)
+            {
+                memset(object, 0, sizeof(RM_OBJECT));
+            }
+            else if (session != NULL)
+            {
+                memset(session, 0, sizeof(RM_SESSION));
+            }
+        }
+    }
+    return result;
+}
+
+static TSS_STATUS execute_command(TSS_RESOURCE_MGR* rm, TSS_DEVICE* client, UINT32 numHandles, UINT32 cmdSize, BYTE* respBuffer, UINT32* respSize)
+{
+    TSS_STATUS result;
+    TPM_CC cmdCode = BYTE_ARRAY_TO_UINT32(rm->cmd_buffer + 6);
+    TPM_HANDLE handles[2] = { 0 };
+    TPM_RC rc;
+    UINT32 index;
+
+    for (index = 0; index < numHandles && index < 2; index++)
+    {
+        handles[index] = BYTE_ARRAY_TO_UINT32(rm->cmd_buffer + RM_HEADER_SIZE + index * sizeof(TPM_HANDLE));
+    }
+
+    if (cmdCode == TPM_CC_FlushContext && cmdSize >= RM_HEADER_SIZE + sizeof(TPM_HANDLE))
+    {
+        // The handle to flush is a parameter, not in the handle area
+        result = execute_flush(rm, client, cmdSize, respBuffer, respSize);
+    }
+    else if ((rc = map_command_handles(rm, client, numHandles, cmdSize)) != TPM_RC_SUCCESS)
+    {
+        build_response(respBuffer, respSize, rc);
+        result = TSS_SUCCESS;
+    }
+    else if (!has_room_for_result(rm, cmdCode, cmdSize))
+    {
+        LogError("No room left to track the objects and sessions of the clients");
+        build_response(respBuffer, respSize, cmdCode == TPM_CC_StartAuthSession ? TPM_RC_SESSION_MEMORY : TPM_RC_OBJECT_MEMORY);
+        result = TSS_SUCCESS;
+    }
+    else if ((result = send_command(rm, cmdSize, respBuffer, respSize)) == TSS_SUCCESS &&
+        BYTE_ARRAY_TO_UINT32(respBuffer + 6) == TPM_RC_SUCCESS)
+    {
+        RM_OBJECT* object;
+        RM_SESSION* session;
+
+        if (returns_handle(cmdCode))
+        {
+            track_returned_handle(rm, client, respBuffer, respSize);
+        }
+        else if (cmdCode == TPM_CC_ContextSave && (session = find_session(rm, handles[0])) != NULL)
+        {
+            // The client manages the saved session itself until it loads it again
+            memset(session, 0, sizeof(RM_SESSION));
+        }
+        else if (cmdCode == TPM_CC_SequenceComplete && (object = find_object(rm, handles[0])) != NULL)
+        {
+            // The TPM flushes a sequence object when the sequence completes
+            memset(object, 0, sizeof(RM_OBJECT));
+        }
+        else if (cmdCode == TPM_CC_EventSequenceComplete && (object = find_object(rm, handles[1])) != NULL)
+        {
+            memset(object, 0, sizeof(RM_OBJECT));
+        }
+        drop_ended_sessions(rm, numHandles, cmdSize);
+    }
+    return result;
+}
+
+// Flushes the objects left loaded by previous runs. The raw device may only be
+// opened once, so nothing else can own them.
+static void flush_stale_objects(TSS_RESOURCE_MGR* rm)
+{
+    TPMI_YES_NO more;
+    TPMS_CAPABILITY_DATA capData;
+    UINT32 index;
+
+    if (TPM2_GetCapability(&rm->device, TPM_CAP_HANDLES, HR_TRANSIENT, MAX_CAP_HANDLES, &more, &capData) != TPM_RC_SUCCESS ||
+        capData.capability != TPM_CAP_HANDLES)
+    {
+        LogError("Unable to enumerate the loaded objects");
+    }
+    else
+    {
+        for (index = 0; index < capData.data.handles.count; index++)
+        {
+            (void)TPM2_FlushContext(&rm->device, capData.data.handles.handle[index]);
+        }
+    }
+}
+
+static bool is_valid_command(TSS_DEVICE* client, UINT32 numHandles, BYTE* cmdBuffer, UINT32 cmdSize, BYTE* respBuffer, UINT32* respSize)
+{
+    bool result;
+    if (client == NULL || cmdBuffer == NULL || respBuffer == NULL || respSize == NULL)
+    {
+        LogError("Invalid parameter client: %p, cmdBuffer: %p, respBuffer: %p, respSize: %p",
+            client, cmdBuffer, respBuffer, respSize);
+        result = false;
+    }
+    else if (cmdSize < RM_HEADER_SIZE + numHandles * sizeof(TPM_HANDLE) || cmdSize > MAX_COMMAND_BUFFER ||
+        *respSize < RM_HEADER_SIZE + sizeof(TPM_HANDLE))
+    {
+        LogError("Invalid command size %u or response capacity %u", cmdSize, *respSize);
+        result = false;
+    }
+    else
+    {
+        result = true;
+    }
+    return result;
+}
+
+static TSS_STATUS run_command(TSS_RESOURCE_MGR* rm, TSS_DEVICE* client, UINT32 numHandles, BYTE* cmdBuffer, UINT32 cmdSize, BYTE* respBuffer, UINT32* respSize)
+{
+    TSS_STATUS result;
+    if (Lock(rm->lock) != LOCK_OK)
+    {
+        LogError("Failure acquiring resource manager lock");
+        result = TSS_E_TPM_TRANSACTION;
+    }
+    else
+    {
+        rm->tick++;
+        memcpy(rm->cmd_buffer, cmdBuffer, cmdSize);
+        result = execute_command(rm, client, numHandles, cmdSize, respBuffer, respSize);
+        (void)Unlock(rm->lock);
+    }
+    return result;
+}
+
+static void wake_worker(TSS_RESOURCE_MGR* rm)
+{
+    if (Lock(rm->idle_lock) != LOCK_OK)
+    {
+        LogError("Failure acquiring resource manager idle lock");
+    }
+    else
+    {
+        (void)Condition_Post(rm->idle_cond);
+        (void)Unlock(rm->idle_lock);
+    }
+}
+
+static int worker_thread(void* context)
+{
+    TSS_RESOURCE_MGR* rm = (TSS_RESOURCE_MGR*)context;
+    bool stopping = false;
+
+    while (!stopping)
+    {
+        TSS_MPSC_NODE* node = tpm_mpsc_pop(&rm->queue);
+        if (node != NULL)
+        {
+            // The request may be freed by its owner once the callback was
+            // invoked, so it is not touched afterwards
+            TSS_RM_REQUEST* request = (TSS_RM_REQUEST*)node;
+            request->status = run_command(rm, request->client, request->numHandles, request->cmdBuffer,
+                                          request->cmdSize, request->respBuffer, request->respSize);
+            request->callback(request->context, request);
+        }
+        else if (!tpm_mpsc_is_empty(&rm->queue))
+        {
+            // A client is in the middle of queuing its request
+            ThreadAPI_Sleep(0);
+        }
+        else if (Lock(rm->idle_lock) != LOCK_OK)
+        {
+            LogError("Failure acquiring resource manager idle lock");
+            ThreadAPI_Sleep(RM_WAIT_INTERVAL_MS);
+        }
+        else
+        {
+            // The clients count their request before they post, so it cannot
+            // be missed between the check and the wait
+            while (tpm_mpsc_is_empty(&rm->queue) && !rm->stopping)
+            {
+                (void)Condition_Wait(rm->idle_cond, rm->idle_lock, 0);
+            }
+            stopping = rm->stopping && tpm_mpsc_is_empty(&rm->queue);
+            (void)Unlock(rm->idle_lock);
+        }
+    }
+    return 0;
+}
+
+static void stop_worker(TSS_RESOURCE_MGR* rm)
+{
+    int thread_result;
+
+    if (Lock(rm->idle_lock) != LOCK_OK)
+    {
+        LogError("Failure acquiring resource manager idle lock");
+        rm->stopping = true;
+    }
+    else
+    {
+        rm->stopping = true;
+        (void)Condition_Post(rm->idle_cond);
+        (void)Unlock(rm->idle_lock);
+    }
+    (void)ThreadAPI_Join(rm->worker, &thread_result);
+    rm->worker = NULL;
+    Condition_Deinit(rm->idle_cond);
+    (void)Lock_Deinit(rm->idle_lock);
+}
+
+static void on_request_done(void* context, TSS_RM_REQUEST* request)
+{
+    RM_WAITER* waiter = (RM_WAITER*)context;
+    (void)request;
+
+    if (Lock(waiter->lock) != LOCK_OK)
+    {
+        // Seen by the waiter at the end of its current wait interval
+        waiter->done = true;
+    }
+    else
+    {
+        waiter->done = true;
+        (void)Condition_Post(waiter->cond);
+        (void)Unlock(waiter->lock);
+    }
+}
+
+// Hands the command to the worker thread and waits for it to be executed
+static TSS_STATUS submit_and_wait(TSS_RESOURCE_MGR* rm, TSS_DEVICE* client, UINT32 numHandles, BYTE* cmdBuffer, UINT32 cmdSize, BYTE* respBuffer, UINT32* respSize)
+{
+    TSS_STATUS result;
+    RM_WAITER* waiter = client->RmWaiter;
+    TSS_RM_REQUEST request;
+
+    if (waiter == NULL)
+    {
+        LogError("The client is not attached to the resource manager");
+        result = TSS_E_INVALID_PARAM;
+    }
+    else if (Lock(waiter->lock) != LOCK_OK)
+    {
+        LogError("Failure acquiring request lock");
+        result = TSS_E_TPM_TRANSACTION;
+    }
+    else
+    {
+        memset(&request, 0, sizeof(TSS_RM_REQUEST));
+        request.client = client;
+        request.numHandles = numHandles;
+        request.cmdBuffer = cmdBuffer;
+        request.cmdSize = cmdSize;
+        request.respBuffer = respBuffer;
+        request.respSize = respSize;
+        request.callback = on_request_done;
+        request.context = waiter;
+
+        waiter->done = false;
+        if ((result = tpm_rm_submit_async(rm, &request)) == TSS_SUCCESS)
+        {
+            while (!waiter->done)
+            {
+                (void)Condition_Wait(waiter->cond, waiter->lock, RM_WAIT_INTERVAL_MS);
+            }
+            result = request.status;
+        }
+        (void)Unlock(waiter->lock);
+    }
+    return result;
+}
+
+static void release_client_resources(TSS_RESOURCE_MGR* rm, TSS_DEVICE* client)
+{
+    if (Lock(rm->lock) != LOCK_OK)
+    {
+        LogError("Failure acquiring resource manager lock");
+    }
+    else
+    {
+        size_t index;
+        for (index = 0; index < TSS_RM_MAX_OBJECTS; index++)
+        {
+            if (rm->objects[index].in_use && rm->objects[index].client == client)
+            {
+                release_object(rm, &rm->objects[index]);
+            }
+        }
+        for (index = 0; index < TSS_RM_MAX_SESSIONS; index++)
+        {
+            if (rm->sessions[index].in_use && rm->sessions[index].client == client)
+            {
+                release_session(rm, &rm->sessions[index]);
+            }
+        }
+        (void)Unlock(rm->lock);
+    }
+}
+
+static void destroy_waiter(RM_WAITER* waiter)
+{
+    Condition_Deinit(waiter->cond);
+    (void)Lock_Deinit(waiter->lock);
+    free(waiter);
+}
+
+TSS_RESOURCE_MGR_HANDLE tpm_rm_create(const char* endpoint)
+{
+    TSS_RESOURCE_MGR* result;
+    if ((result = (TSS_RESOURCE_MGR*)malloc(sizeof(TSS_RESOURCE_MGR))) == NULL)
+    {
+        LogError("Failure allocating resource manager");
+    }
+    else
+    {
+        memset(result, 0, sizeof(TSS_RESOURCE_MGR));
+        result->device.comms_endpoint = endpoint;
+        if ((result->lock = Lock_Init()) == NULL)
+        {
+            LogError("Failure creating resource manager lock");
+            free(result);
+            result = NULL;
+        }
+        else if (Initialize_TPM_Codec(&result->device) != TPM_RC_SUCCESS)
+        {
+            LogError("Failure connecting to the TPM");
+            (void)Lock_Deinit(result->lock);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            flush_stale_objects(result);
+        }
+    }
+    return result;
+}
+
+void tpm_rm_destroy(TSS_RESOURCE_MGR_HANDLE handle)
+{
+    if (handle != NULL)
+    {
+        size_t index;
+        if (handle->worker != NULL)
+        {
+            stop_worker(handle);
+        }
+        for (index = 0; index < TSS_RM_MAX_OBJECTS; index++)
+        {
+            if (handle->objects[index].in_use)
+            {
+                release_object(handle, &handle->objects[index]);
+            }
+        }
+        for (index = 0; index < TSS_RM_MAX_SESSIONS; index++)
+        {
+            if (handle->sessions[index].in_use)
+            {
+                release_session(handle, &handle->sessions[index]);
+            }
+        }
+        Deinit_TPM_Codec(&handle->device);
+        (void)Lock_Deinit(handle->lock);
+        free(handle);
+    }
+}
+
+int tpm_rm_start_worker(TSS_RESOURCE_MGR_HANDLE handle)
+{
+    int result;
+    if (handle == NULL)
+    {
+        LogError("Invalid parameter handle is NULL");
+        result = __FAILURE__;
+    }
+    else if (handle->worker != NULL)
+    {
+        LogError("The worker thread is already running");
+        result = __FAILURE__;
+    }
+    else if ((handle->idle_lock = Lock_Init()) == NULL)
+    {
+        LogError("Failure creating resource manager idle lock");
+        result = __FAILURE__;
+    }
+    else if ((handle->idle_cond = Condition_Init()) == NULL)
+    {
+        LogError("Failure creating resource manager idle condition");
+        (void)Lock_Deinit(handle->idle_lock);
+        result = __FAILURE__;
+    }
+    else
+    {
+        tpm_mpsc_init(&handle->queue);
+        handle->stopping = false;
+        if (ThreadAPI_Create(&handle->worker, worker_thread, handle) != THREADAPI_OK)
+        {
+            LogError("Failure starting the worker thread");
+            handle->worker = NULL;
+            Condition_Deinit(handle->idle_cond);
+            (void)Lock_Deinit(handle->idle_lock);
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    return result;
+}
+
+TSS_STATUS tpm_rm_submit_async(TSS_RESOURCE_MGR_HANDLE handle, TSS_RM_REQUEST* request)
+{
+    TSS_STATUS result;
+    if (handle == NULL || request == NULL || request->callback == NULL)
+    {
+        LogError("Invalid parameter handle: %p, request: %p", handle, request);
+        result = TSS_E_INVALID_PARAM;
+    }
+    else if (!is_valid_command(request->client, request->numHandles, request->cmdBuffer, request->cmdSize, request->respBuffer, request->respSize))
+    {
+        result = TSS_E_INVALID_PARAM;
+    }
+    else if (handle->worker == NULL)
+    {
+        LogError("The worker thread was not started");
+        result = TSS_E_INVALID_PARAM;
+    }
+    else
+    {
+        if (tpm_mpsc_push(&handle->queue, &request->node))
+        {
+            wake_worker(handle);
+        }
+        result = TSS_SUCCESS;
+    }
+    return result;
+}
+
+TSS_STATUS tpm_rm_submit_command(TSS_RESOURCE_MGR_HANDLE handle, TSS_DEVICE* client, UINT32 numHandles, BYTE* cmdBuffer, UINT32 cmdSize, BYTE* respBuffer, UINT32* respSize)
+{
+    TSS_STATUS result;
+    if (handle == NULL)
+    {
+        LogError("Invalid parameter handle is NULL");
+        result = TSS_E_INVALID_PARAM;
+    }
+    else if (!is_valid_command(client, numHandles, cmdBuffer, cmdSize, respBuffer, respSize))
+    {
+        result = TSS_E_INVALID_PARAM;
+    }
+    else if (handle->worker != NULL)
+    {
+        result = submit_and_wait(handle, client, numHandles, cmdBuffer, cmdSize, respBuffer, respSize);
+    }
+    else
+    {
+        result = run_command(handle, client, numHandles, cmdBuffer, cmdSize, respBuffer, respSize);
+    }
+    return result;
+}
+
+int tpm_rm_attach_client(TSS_RESOURCE_MGR_HANDLE handle, TSS_DEVICE* client)
+{
+    int result;
+    RM_WAITER* waiter;
+    if (handle == NULL || client == NULL)
+    {
+        LogError("Invalid parameter handle: %p, client: %p", handle, client);
+        result = __FAILURE__;
+    }
+    else if (client->RmWaiter != NULL)
+    {
+        // Initialize_TPM_Codec called again on the same device
+        result = 0;
+    }
+    else if ((waiter = (RM_WAITER*)malloc(sizeof(RM_WAITER))) == NULL)
+    {
+        LogError("Failure allocating client waiter");
+        result = __FAILURE__;
+    }
+    else
+    {
+        waiter->done = false;
+        if ((waiter->lock = Lock_Init()) == NULL)
+        {
+            LogError("Failure creating client lock");
+            free(waiter);
+            result = __FAILURE__;
+        }
+        else if ((waiter->cond = Condition_Init()) == NULL)
+        {
+            LogError("Failure creating client condition");
+            (void)Lock_Deinit(waiter->lock);
+            free(waiter);
+            result = __FAILURE__;
+        }
+        else
+        {
+            client->RmWaiter = waiter;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+void tpm_rm_release_client(TSS_RESOURCE_MGR_HANDLE handle, TSS_DEVICE* client)
+{
+    if (handle == NULL || client == NULL)
+    {
+        LogError("Invalid parameter handle: %p, client: %p", handle, client);
+    }
+    else
+    {
+        release_client_resources(handle, client);
+        if (client->RmWaiter != NULL)
+        {
+            destroy_waiter(client->RmWaiter);
+            client->RmWaiter = NULL;
+        }
+    }
+}
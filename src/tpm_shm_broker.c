@@ -0,0 +1,327 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "azure_utpm_c/tpm_shm_broker.h"
+#include "azure_utpm_c/tpm_shm_sys.h"
+#include "azure_utpm_c/tpm_comm.h"
+#include "azure_utpm_c/tpm_timer.h"
+
+#define BROKER_NS_PER_MS            1000000ULL
+
+#define SHM_LOAD(source)            __atomic_load_n((source), __ATOMIC_ACQUIRE)
+#define SHM_STORE(target, value)    __atomic_store_n((target), (value), __ATOMIC_RELEASE)
+
+typedef struct TPM_SHM_CLIENT_TAG
+{
+    // NULL if the entry is free
+    TPM_SHM_SEGMENT* segment;
+    // Connection of the client, on which it rings the doorbell
+    int socket;
+} TPM_SHM_CLIENT;
+
+typedef struct TPM_SHM_BROKER_TAG
+{
+    TPM_COMM_HANDLE tpm_comm_handle;
+    int listen_socket;
+    TPM_SHM_CREDENTIALS credentials;
+    // Reported to the first client only
+    bool needs_startup;
+    bool resource_managed;
+    TPM_SHM_CLIENT clients[TPM_SHM_MAX_CLIENTS];
+    // Client served last, after which the search for the next command starts
+    size_t last_client;
+} TPM_SHM_BROKER;
+
+static bool is_command_waiting(const TPM_SHM_SLOT* slot)
+{
+    return SHM_LOAD(&slot->cmd_seq) != slot->resp_seq;
+}
+
+// Returns the slot of the next command: the highest priority first, and in
+// turn after the last served client among the ones of the same priority
+static TPM_SHM_SLOT* find_next_command(TPM_SHM_BROKER* broker)
+{
+    TPM_SHM_SLOT* result = NULL;
+    uint32_t result_priority = 0;
+    size_t offset;
+    for (offset = 1; offset <= TPM_SHM_MAX_CLIENTS; offset++)
+    {
+        size_t index = (broker->last_client + offset) % TPM_SHM_MAX_CLIENTS;
+        TPM_SHM_CLIENT* client = &broker->clients[index];
+        if (client->segment != NULL && is_command_waiting(&client->segment->slot))
+        {
+            uint32_t priority = client->segment->slot.priority;
+            if (result == NULL || priority > result_priority)
+            {
+                result = &client->segment->slot;
+                result_priority = priority;
+                broker->last_client = index;
+            }
+        }
+    }
+    return result;
+}
+
+static void execute_command(TPM_SHM_BROKER* broker, TPM_SHM_SLOT* slot)
+{
+    uint32_t cmd_seq = SHM_LOAD(&slot->cmd_seq);
+    uint32_t cmd_len = slot->cmd_len;
+    uint32_t resp_len = TPM_SHM_BUFFER_SIZE;
+
+    // The slot is written by the client, so nothing in it is trusted
+    if (cmd_len == 0 || cmd_len > TPM_SHM_BUFFER_SIZE)
+    {
+        LogError("Invalid command size %u in a client slot", cmd_len);
+        resp_len = 0;
+    }
+    else if (tpm_comm_submit_command(broker->tpm_comm_handle, slot->cmd, cmd_len, slot->resp, &resp_len) != 0)
+    {
+        LogError("Failure submitting a client command to the TPM");
+        resp_len = 0;
+    }
+    slot->resp_len = resp_len;
+    SHM_STORE(&slot->resp_seq, cmd_seq);
+    tpm_shm_sys_wake(&slot->resp_seq);
+}
+
+// The clients run as the user or in the group of the broker, as for the
+// device nodes of the TPM, or as root
+static bool is_client_allowed(const TPM_SHM_BROKER* broker, const TPM_SHM_CREDENTIALS* peer)
+{
+    return peer->uid == 0 || peer->uid == broker->credentials.uid || peer->gid == broker->credentials.gid;
+}
+
+static TPM_SHM_CLIENT* find_free_client(TPM_SHM_BROKER* broker)
+{
+    TPM_SHM_CLIENT* result = NULL;
+    size_t index;
+    for (index = 0; index < TPM_SHM_MAX_CLIENTS && result == NULL; index++)
+    {
+        if (broker->clients[index].segment == NULL)
+        {
+            result = &broker->clients[index];
+        }
+    }
+    return result;
+}
+
+// Creates the segment of a client that connected, and passes it to the client
+static void accept_client(TPM_SHM_BROKER* broker)
+{
+    TPM_SHM_CREDENTIALS peer;
+    int client_socket;
+
+    if ((client_socket = tpm_shm_sys_accept(broker->listen_socket, &peer)) < 0)
+    {
+        LogError("Failure accepting a client");
+    }
+    else
+    {
+        TPM_SHM_CLIENT* client;
+        int segment_fd;
+
+        if (!is_client_allowed(broker, &peer))
+        {
+            LogError("Refusing client %d of user %u and group %u, which is neither the user nor in the group of the broker", (int)peer.pid, peer.uid, peer.gid);
+            tpm_shm_sys_close(client_socket);
+        }
+        else if ((client = find_free_client(broker)) == NULL)
+        {
+            LogError("Refusing client %d, all the %d client entries are in use", (int)peer.pid, TPM_SHM_MAX_CLIENTS);
+            tpm_shm_sys_close(client_socket);
+        }
+        else if ((client->segment = tpm_shm_sys_create(&segment_fd)) == NULL)
+        {
+            LogError("Failure creating the segment of client %d", (int)peer.pid);
+            tpm_shm_sys_close(client_socket);
+        }
+        else
+        {
+            // The new segment is zero filled, i.e. no command is waiting
+            client->segment->magic = TPM_SHM_MAGIC;
+            client->segment->version = TPM_SHM_VERSION;
+            client->segment->needs_startup = broker->needs_startup ? 1 : 0;
+            client->segment->resource_managed = broker->resource_managed ? 1 : 0;
+            client->segment->slot.priority = TPM_COMM_PRIORITY_NORMAL;
+            SHM_STORE(&client->segment->broker_pid, broker->credentials.pid);
+
+            if (tpm_shm_sys_send_segment(client_socket, segment_fd) != 0)
+            {
+                LogError("Failure passing the segment to client %d", (int)peer.pid);
+                tpm_shm_sys_unmap(client->segment);
+                client->segment = NULL;
+                tpm_shm_sys_close(client_socket);
+            }
+            else
+            {
+                client->socket = client_socket;
+                broker->needs_startup = false;
+            }
+            tpm_shm_sys_close(segment_fd);
+        }
+    }
+}
+
+static void drop_client(TPM_SHM_CLIENT* client)
+{
+    tpm_shm_sys_unmap(client->segment);
+    tpm_shm_sys_close(client->socket);
+    client->segment = NULL;
+}
+
+// Waits for a doorbell, a client connecting, or a client disconnecting
+static int wait_for_clients(TPM_SHM_BROKER* broker, uint32_t timeout_ms)
+{
+    int result;
+    int sockets[TPM_SHM_MAX_CLIENTS + 1];
+    TPM_SHM_CLIENT* polled[TPM_SHM_MAX_CLIENTS + 1];
+    bool readable[TPM_SHM_MAX_CLIENTS + 1];
+    size_t count = 1;
+    size_t index;
+
+    sockets[0] = broker->listen_socket;
+    polled[0] = NULL;
+    for (index = 0; index < TPM_SHM_MAX_CLIENTS; index++)
+    {
+        if (broker->clients[index].segment != NULL)
+        {
+            sockets[count] = broker->clients[index].socket;
+            polled[count++] = &broker->clients[index];
+        }
+    }
+
+    if (tpm_shm_sys_poll(sockets, count, timeout_ms, readable) < 0)
+    {
+        LogError("Failure waiting for the clients");
+        result = __FAILURE__;
+    }
+    else
+    {
+        // The doorbells are read before the slots are looked at again, so
+        // that the next wait returns at once for a command written after that
+        for (index = 1; index < count; index++)
+        {
+            if (readable[index] && tpm_shm_sys_drain(sockets[index]) != 0)
+            {
+                LogInfo("Client disconnected");
+                drop_client(polled[index]);
+            }
+        }
+        if (readable[0])
+        {
+            accept_client(broker);
+        }
+        result = 0;
+    }
+    return result;
+}
+
+TPM_SHM_BROKER_HANDLE tpm_shm_broker_create(const char* name, const char* endpoint)
+{
+    TPM_SHM_BROKER* result;
+    if (name == NULL || *name == '\0' || strchr(name, '/') != NULL || strlen(name) >= TPM_SHM_MAX_NAME - 1)
+    {
+        LogError("Invalid broker name %s", name != NULL ? name : "NULL");
+        result = NULL;
+    }
+    else if ((result = (TPM_SHM_BROKER*)malloc(sizeof(TPM_SHM_BROKER))) == NULL)
+    {
+        LogError("Failure allocating the broker");
+    }
+    else
+    {
+        memset(result, 0, sizeof(TPM_SHM_BROKER));
+        if ((result->tpm_comm_handle = tpm_comm_create(endpoint)) == NULL)
+        {
+            LogError("Failure connecting to the TPM");
+            free(result);
+            result = NULL;
+        }
+        else if ((result->listen_socket = tpm_shm_sys_listen(name)) < 0)
+        {
+            LogError("Failure listening for the clients of broker %s", name);
+            tpm_comm_destroy(result->tpm_comm_handle);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            tpm_shm_sys_get_credentials(&result->credentials);
+            result->needs_startup = tpm_comm_needs_startup(result->tpm_comm_handle);
+            result->resource_managed = tpm_comm_is_resource_managed(result->tpm_comm_handle);
+        }
+    }
+    return result;
+}
+
+void tpm_shm_broker_destroy(TPM_SHM_BROKER_HANDLE handle)
+{
+    if (handle != NULL)
+    {
+        size_t index;
+
+        for (index = 0; index < TPM_SHM_MAX_CLIENTS; index++)
+        {
+            TPM_SHM_CLIENT* client = &handle->clients[index];
+            if (client->segment != NULL)
+            {
+                // A waiting client notices that the broker is gone once woken
+                SHM_STORE(&client->segment->broker_pid, 0);
+                tpm_shm_sys_wake(&client->segment->slot.resp_seq);
+                drop_client(client);
+            }
+        }
+        tpm_shm_sys_close(handle->listen_socket);
+        tpm_comm_destroy(handle->tpm_comm_handle);
+        free(handle);
+    }
+}
+
+int tpm_shm_broker_serve(TPM_SHM_BROKER_HANDLE handle, uint32_t timeout_ms)
+{
+    int result;
+    if (handle == NULL)
+    {
+        LogError("Invalid argument specified handle: NULL");
+        result = -1;
+    }
+    else
+    {
+        uint64_t start_ns = tpm_timer_get_ns();
+        result = 0;
+        while (result == 0)
+        {
+            TPM_SHM_SLOT* slot;
+
+            // Bounded, so that the caller regains control under load
+            while (result < TPM_SHM_MAX_CLIENTS && (slot = find_next_command(handle)) != NULL)
+            {
+                execute_command(handle, slot);
+                result++;
+            }
+
+            if (result == 0)
+            {
+                uint64_t elapsed_ms = (tpm_timer_get_ns() - start_ns) / BROKER_NS_PER_MS;
+                if (timeout_ms != 0 && elapsed_ms >= timeout_ms)
+                {
+                    break;
+                }
+                if (wait_for_clients(handle, timeout_ms == 0 ? 0 : (uint32_t)(timeout_ms - elapsed_ms)) != 0)
+                {
+                    result = -1;
+                }
+            }
+        }
+    }
+    return result;
+}
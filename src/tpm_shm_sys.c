@@ -0,0 +1,422 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <linux/futex.h>
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "azure_utpm_c/tpm_comm.h"
+#include "azure_utpm_c/tpm_shm_sys.h"
+
+// Abstract socket of a broker, followed by its name: there is no file to
+// secure or to remove, the broker checks the credentials of its peers instead
+#define SHM_SOCKET_PREFIX       "utpm_shm/"
+
+// Longest wait on the first word only, when the kernel has no futex_waitv
+#define SHM_WAIT_FALLBACK_MS    1
+
+// The client of a segment must not shrink it under the broker
+#define SHM_SEGMENT_SEALS       (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+static socklen_t make_address(struct sockaddr_un* address, const char* name)
+{
+    size_t name_len = strnlen(name, TPM_SHM_MAX_NAME - 1);
+
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    // sun_path[0] stays 0, the address is abstract
+    memcpy(address->sun_path + 1, SHM_SOCKET_PREFIX, sizeof(SHM_SOCKET_PREFIX) - 1);
+    memcpy(address->sun_path + sizeof(SHM_SOCKET_PREFIX), name, name_len);
+    return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + sizeof(SHM_SOCKET_PREFIX) + name_len);
+}
+
+int tpm_shm_sys_listen(const char* name)
+{
+    int result;
+    struct sockaddr_un address;
+    socklen_t address_len = make_address(&address, name);
+
+    if ((result = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+    {
+        LogError("Failure creating the broker socket, errno: %d", errno);
+    }
+    else if (bind(result, (struct sockaddr*)&address, address_len) != 0)
+    {
+        LogError("Failure binding the socket of broker %s, errno: %d%s", name, errno, errno == EADDRINUSE ? " (another broker serves it)" : "");
+        (void)close(result);
+        result = -1;
+    }
+    else if (listen(result, TPM_SHM_MAX_CLIENTS) != 0)
+    {
+        LogError("Failure listening on the socket of broker %s, errno: %d", name, errno);
+        (void)close(result);
+        result = -1;
+    }
+    return result;
+}
+
+int tpm_shm_sys_accept(int listen_socket, TPM_SHM_CREDENTIALS* peer)
+{
+    int result;
+    struct ucred credentials;
+    socklen_t credentials_len = sizeof(credentials);
+
+    // Non blocking, so that draining the doorbells never waits
+    if ((result = accept4(listen_socket, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK)) < 0)
+    {
+        LogError("Failure accepting a client connection, errno: %d", errno);
+    }
+    else if (getsockopt(result, SOL_SOCKET, SO_PEERCRED, &credentials, &credentials_len) != 0)
+    {
+        LogError("Failure getting the credentials of a client, errno: %d", errno);
+        (void)close(result);
+        result = -1;
+    }
+    else
+    {
+        peer->pid = (int32_t)credentials.pid;
+        peer->uid = (uint32_t)credentials.uid;
+        peer->gid = (uint32_t)credentials.gid;
+    }
+    return result;
+}
+
+int tpm_shm_sys_connect(const char* name)
+{
+    int result;
+    struct sockaddr_un address;
+    socklen_t address_len = make_address(&address, name);
+    // The broker answers between the commands it executes
+    struct timeval receive_timeout = { TPM_COMM_DEFAULT_TIMEOUT_MS / 1000, 0 };
+
+    if ((result = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+    {
+        LogError("Failure creating the broker socket, errno: %d", errno);
+    }
+    else if (connect(result, (struct sockaddr*)&address, address_len) != 0)
+    {
+        LogError("Failure connecting to broker %s, errno: %d", name, errno);
+        (void)close(result);
+        result = -1;
+    }
+    else if (setsockopt(result, SOL_SOCKET, SO_RCVTIMEO, &receive_timeout, sizeof(receive_timeout)) != 0)
+    {
+        LogError("Failure setting the timeout of the broker socket, errno: %d", errno);
+        (void)close(result);
+        result = -1;
+    }
+    return result;
+}
+
+TPM_SHM_SEGMENT* tpm_shm_sys_create(int* fd)
+{
+    TPM_SHM_SEGMENT* result;
+
+    if ((*fd = memfd_create("utpm_shm", MFD_CLOEXEC | MFD_ALLOW_SEALING)) < 0)
+    {
+        LogError("Failure creating shared memory segment, errno: %d", errno);
+        result = NULL;
+    }
+    else
+    {
+        void* segment;
+        if (ftruncate(*fd, sizeof(TPM_SHM_SEGMENT)) != 0 || fcntl(*fd, F_ADD_SEALS, SHM_SEGMENT_SEALS) != 0)
+        {
+            LogError("Failure sizing shared memory segment, errno: %d", errno);
+            result = NULL;
+        }
+        else if ((segment = mmap(NULL, sizeof(TPM_SHM_SEGMENT), PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0)) == MAP_FAILED)
+        {
+            LogError("Failure mapping shared memory segment, errno: %d", errno);
+            result = NULL;
+        }
+        else
+        {
+            result = (TPM_SHM_SEGMENT*)segment;
+        }
+
+        if (result == NULL)
+        {
+            (void)close(*fd);
+            *fd = -1;
+        }
+    }
+    return result;
+}
+
+int tpm_shm_sys_send_segment(int s, int fd)
+{
+    int result;
+    unsigned char data = 0;
+    struct iovec data_vec = { &data, sizeof(data) };
+    union
+    {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr message;
+    struct cmsghdr* header;
+
+    memset(&control, 0, sizeof(control));
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &data_vec;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+    header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), &fd, sizeof(int));
+
+    if (sendmsg(s, &message, MSG_NOSIGNAL) != (ssize_t)sizeof(data))
+    {
+        LogError("Failure passing the segment to the client, errno: %d", errno);
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+TPM_SHM_SEGMENT* tpm_shm_sys_receive_segment(int s)
+{
+    TPM_SHM_SEGMENT* result = NULL;
+    unsigned char data;
+    struct iovec data_vec = { &data, sizeof(data) };
+    union
+    {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr message;
+    struct cmsghdr* header;
+    ssize_t received;
+
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &data_vec;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    while ((received = recvmsg(s, &message, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR)
+    {
+    }
+
+    if (received <= 0)
+    {
+        LogError("The broker refused the connection, errno: %d", received < 0 ? errno : 0);
+    }
+    else if ((header = CMSG_FIRSTHDR(&message)) == NULL || header->cmsg_level != SOL_SOCKET ||
+        header->cmsg_type != SCM_RIGHTS || header->cmsg_len != CMSG_LEN(sizeof(int)))
+    {
+        LogError("The broker did not pass a segment");
+    }
+    else
+    {
+        int fd;
+        struct stat segment_stat;
+        void* segment;
+
+        memcpy(&fd, CMSG_DATA(header), sizeof(int));
+        if (fstat(fd, &segment_stat) != 0 || segment_stat.st_size != (off_t)sizeof(TPM_SHM_SEGMENT))
+        {
+            LogError("The shared memory segment does not have the expected size");
+        }
+        else if ((segment = mmap(NULL, sizeof(TPM_SHM_SEGMENT), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+        {
+            LogError("Failure mapping shared memory segment, errno: %d", errno);
+        }
+        else
+        {
+            result = (TPM_SHM_SEGMENT*)segment;
+        }
+        (void)close(fd);
+    }
+    return result;
+}
+
+void tpm_shm_sys_unmap(TPM_SHM_SEGMENT* segment)
+{
+    (void)munmap(segment, sizeof(TPM_SHM_SEGMENT));
+}
+
+int tpm_shm_sys_ring(int s)
+{
+    int result;
+    unsigned char doorbell = 1;
+    ssize_t sent;
+
+    while ((sent = send(s, &doorbell, sizeof(doorbell), MSG_DONTWAIT | MSG_NOSIGNAL)) < 0 && errno == EINTR)
+    {
+    }
+
+    // A full socket holds doorbells the broker has not read yet
+    if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+        LogError("Failure ringing the broker, errno: %d", errno);
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+int tpm_shm_sys_drain(int s)
+{
+    int result = 0;
+    unsigned char doorbells[64];
+    ssize_t received;
+
+    while ((received = recv(s, doorbells, sizeof(doorbells), MSG_DONTWAIT)) > 0 || (received < 0 && errno == EINTR))
+    {
+    }
+
+    if (received == 0)
+    {
+        // Closed by the peer
+        result = __FAILURE__;
+    }
+    else if (errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+        LogError("Failure reading the client doorbells, errno: %d", errno);
+        result = __FAILURE__;
+    }
+    return result;
+}
+
+int tpm_shm_sys_poll(int* sockets, size_t count, uint32_t timeout_ms, bool* readable)
+{
+    int result;
+    struct pollfd poll_info[TPM_SHM_MAX_CLIENTS + 1];
+
+    if (count > TPM_SHM_MAX_CLIENTS + 1)
+    {
+        LogError("Invalid socket count %zu", count);
+        result = -1;
+    }
+    else
+    {
+        size_t index;
+        for (index = 0; index < count; index++)
+        {
+            poll_info[index].fd = sockets[index];
+            poll_info[index].events = POLLIN;
+            poll_info[index].revents = 0;
+        }
+
+        result = poll(poll_info, (nfds_t)count, timeout_ms == 0 ? -1 : (timeout_ms > INT_MAX ? INT_MAX : (int)timeout_ms));
+        if (result < 0 && errno == EINTR)
+        {
+            result = 0;
+        }
+        else if (result < 0)
+        {
+            LogError("Failure polling the client sockets, errno: %d", errno);
+        }
+
+        for (index = 0; index < count; index++)
+        {
+            readable[index] = result > 0 && poll_info[index].revents != 0;
+        }
+    }
+    return result;
+}
+
+void tpm_shm_sys_close(int fd)
+{
+    (void)close(fd);
+}
+
+void tpm_shm_sys_wait(TPM_SHM_WORD* word, uint32_t value, uint32_t timeout_ms)
+{
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+    (void)syscall(SYS_futex, word, FUTEX_WAIT, value, timeout_ms != 0 ? &timeout : NULL, NULL, 0);
+}
+
+void tpm_shm_sys_wait_any(TPM_SHM_WORD** words, const uint32_t* values, size_t count, uint32_t timeout_ms)
+{
+    bool waited = false;
+#if defined(SYS_futex_waitv) && defined(FUTEX_WAITV_MAX)
+    if (count > 1 && count <= FUTEX_WAITV_MAX)
+    {
+        struct futex_waitv waiters[FUTEX_WAITV_MAX];
+        struct timespec deadline;
+        size_t index;
+
+        memset(waiters, 0, sizeof(waiters[0]) * count);
+        for (index = 0; index < count; index++)
+        {
+            waiters[index].val = values[index];
+            waiters[index].uaddr = (uintptr_t)words[index];
+            waiters[index].flags = FUTEX_32;
+        }
+        // futex_waitv takes an absolute timeout
+        if (timeout_ms != 0)
+        {
+            (void)clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += timeout_ms / 1000;
+            deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L)
+            {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+        }
+        waited = syscall(SYS_futex_waitv, waiters, (unsigned int)count, 0, timeout_ms != 0 ? &deadline : NULL, CLOCK_MONOTONIC) >= 0 || errno != ENOSYS;
+    }
+#endif
+    if (!waited)
+    {
+        // The caller checks the other words when this returns
+        tpm_shm_sys_wait(words[0], values[0], count == 1 ? timeout_ms : SHM_WAIT_FALLBACK_MS);
+    }
+}
+
+void tpm_shm_sys_wake(TPM_SHM_WORD* word)
+{
+    (void)syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+bool tpm_shm_sys_is_alive(int32_t pid)
+{
+    // EPERM: the process runs as another user
+    return kill((pid_t)pid, 0) == 0 || errno == EPERM;
+}
+
+void tpm_shm_sys_get_credentials(TPM_SHM_CREDENTIALS* credentials)
+{
+    credentials->pid = (int32_t)getpid();
+    credentials->uid = (uint32_t)geteuid();
+    credentials->gid = (uint32_t)getegid();
+}
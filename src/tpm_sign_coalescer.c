@@ -0,0 +1,447 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+
+#include "azure_utpm_c/tpm_sign_coalescer.h"
+#include "azure_utpm_c/tpm_host_hash.h"
+#include "azure_utpm_c/tpm_timer.h"
+
+#define COALESCER_NS_PER_MS     1000000ULL
+// Waiters check whether the leader is done at least this often
+#define COALESCER_WAIT_SLICE_MS 100
+
+// Fixed TPM properties telling the TPMs apart, the same as the public cache's
+static const TPM_PT IDENTITY_PROPERTIES[TSS_PUBLIC_CACHE_ID_SIZE] =
+{
+    TPM_PT_MANUFACTURER,
+    TPM_PT_VENDOR_STRING_1,
+    TPM_PT_FIRMWARE_VERSION_1,
+    TPM_PT_FIRMWARE_VERSION_2
+};
+
+// What a signature depends on, and who may have it. Compared with memcmp, so
+// always built on a zeroed structure.
+typedef struct SIGN_KEY_TAG
+{
+    // TPM holding the key: its identity, and the connection to it
+    UINT32 tpm_identity[TSS_PUBLIC_CACHE_ID_SIZE];
+    TSS_RESOURCE_MGR_HANDLE resource_mgr;
+    BYTE endpoint[SHA256_DIGEST_SIZE];
+
+    TPM_HANDLE key_handle;
+
+    // Authorization of the key. Requests of different devices only share a
+    // signature when they use the password session with the same password;
+    // any other session is only shared by the requests using it.
+    TPMI_SH_AUTH_SESSION session_handle;
+    TPM2B_AUTH auth;
+    const TSS_DEVICE* device;
+    const TSS_SESSION* session;
+
+    UINT32 data_size;
+    BYTE digest[SHA256_DIGEST_SIZE];
+} SIGN_KEY;
+
+// Signature of one payload, computed by the first request for it (the leader)
+typedef struct SIGN_FLIGHT_TAG
+{
+    bool used;
+    // The leader is waiting for the TPM
+    bool in_flight;
+    // The signature may be handed to later requests until completed_ns + ttl
+    bool cached;
+    // tpm_sign_coalescer_clear was called while the leader was signing
+    bool cleared;
+
+    SIGN_KEY key;
+
+    // Requests waiting for the leader. The slot is not reused while there are
+    // any, so that they all read the same result.
+    uint32_t waiters;
+    COND_HANDLE done;
+
+    UINT32 sig_size;
+    TPM_RC raw_response;
+    BYTE signature[SHA256_DIGEST_SIZE];
+    uint64_t completed_ns;
+} SIGN_FLIGHT;
+
+typedef struct TSS_SIGN_COALESCER_TAG
+{
+    // Protects the flights and the stats. Never held while the TPM is used.
+    LOCK_HANDLE lock;
+    uint64_t ttl_ns;
+    SIGN_FLIGHT flights[TSS_SIGN_COALESCER_SIZE];
+    TSS_SIGN_COALESCER_STATS stats;
+} TSS_SIGN_COALESCER;
+
+static void deinit_conditions(TSS_SIGN_COALESCER* coalescer, size_t count)
+{
+    size_t index;
+    for (index = 0; index < count; index++)
+    {
+        Condition_Deinit(coalescer->flights[index].done);
+    }
+}
+
+static int build_key(TSS_DEVICE* tpm, TSS_SESSION* sess, BYTE* tokenData, UINT32 tokenSize, SIGN_KEY* key)
+{
+    int result = 0;
+    TPM2B_DIGEST digest;
+    size_t index;
+
+    memset(key, 0, sizeof(SIGN_KEY));
+    if (tpm_host_hash(TPM_ALG_SHA256, tokenData, tokenSize, &digest) != TPM_RC_SUCCESS)
+    {
+        LogError("Failure hashing the token data");
+        result = __FAILURE__;
+    }
+    else
+    {
+        key->data_size = tokenSize;
+        memcpy(key->digest, digest.t.buffer, SHA256_DIGEST_SIZE);
+
+        // Fixed properties are served from the property cache of the device
+        for (index = 0; index < TSS_PUBLIC_CACHE_ID_SIZE && result == 0; index++)
+        {
+            key->tpm_identity[index] = TSS_GetTpmProperty(tpm, IDENTITY_PROPERTIES[index]);
+            if (key->tpm_identity[index] == (UINT32)-1)
+            {
+                LogError("Failure reading TPM property 0x%x", IDENTITY_PROPERTIES[index]);
+                result = __FAILURE__;
+            }
+        }
+    }
+
+    if (result != 0)
+    {
+        // Already logged
+    }
+    else if (tpm->comms_endpoint != NULL &&
+        tpm_host_hash(TPM_ALG_SHA256, (const BYTE*)tpm->comms_endpoint, (UINT32)strlen(tpm->comms_endpoint), &digest) != TPM_RC_SUCCESS)
+    {
+        LogError("Failure hashing the TPM endpoint");
+        result = __FAILURE__;
+    }
+    else if (sess != NULL && sess->SessIn.sessionHandle == TPM_RS_PW && sess->SessIn.hmac.t.size > sizeof(key->auth.t.buffer))
+    {
+        LogError("Invalid password size %u", sess->SessIn.hmac.t.size);
+        result = __FAILURE__;
+    }
+    else
+    {
+        if (tpm->comms_endpoint != NULL)
+        {
+            memcpy(key->endpoint, digest.t.buffer, SHA256_DIGEST_SIZE);
+        }
+        key->resource_mgr = tpm->ResourceMgr;
+        key->key_handle = DPS_ID_KEY_HANDLE;
+        if (sess != NULL && sess->SessIn.sessionHandle == TPM_RS_PW)
+        {
+            key->session_handle = TPM_RS_PW;
+            key->auth.t.size = sess->SessIn.hmac.t.size;
+            memcpy(key->auth.t.buffer, sess->SessIn.hmac.t.buffer, sess->SessIn.hmac.t.size);
+        }
+        else
+        {
+            key->session_handle = sess != NULL ? sess->SessIn.sessionHandle : TPM_RH_NULL;
+            key->device = tpm;
+            key->session = sess;
+        }
+    }
+    return result;
+}
+
+static SIGN_FLIGHT* find_flight(TSS_SIGN_COALESCER* coalescer, const SIGN_KEY* key)
+{
+    SIGN_FLIGHT* result = NULL;
+    size_t index;
+    for (index = 0; index < TSS_SIGN_COALESCER_SIZE && result == NULL; index++)
+    {
+        SIGN_FLIGHT* flight = &coalescer->flights[index];
+        if (flight->used && memcmp(&flight->key, key, sizeof(SIGN_KEY)) == 0)
+        {
+            result = flight;
+        }
+    }
+    return result;
+}
+
+// Returns a free slot, or else the idle one completed the longest time ago, or
+// NULL if all of them are busy
+static SIGN_FLIGHT* claim_flight(TSS_SIGN_COALESCER* coalescer)
+{
+    SIGN_FLIGHT* result = NULL;
+    size_t index;
+    for (index = 0; index < TSS_SIGN_COALESCER_SIZE; index++)
+    {
+        SIGN_FLIGHT* flight = &coalescer->flights[index];
+        if (!flight->used)
+        {
+            result = flight;
+            break;
+        }
+        else if (!flight->in_flight && flight->waiters == 0 &&
+            (result == NULL || flight->completed_ns < result->completed_ns))
+        {
+            result = flight;
+        }
+    }
+    return result;
+}
+
+static bool is_fresh(TSS_SIGN_COALESCER* coalescer, const SIGN_FLIGHT* flight)
+{
+    return flight->cached && tpm_timer_get_ns() - flight->completed_ns < coalescer->ttl_ns;
+}
+
+static UINT32 copy_result(const SIGN_FLIGHT* flight, TSS_DEVICE* tpm, BYTE* signatureBuffer)
+{
+    if (flight->sig_size == SHA256_DIGEST_SIZE)
+    {
+        memcpy(signatureBuffer, flight->signature, SHA256_DIGEST_SIZE);
+    }
+    tpm->LastRawResponse = flight->raw_response;
+    return flight->sig_size;
+}
+
+// Called with the lock held, which Condition_Wait releases while waiting. The
+// wait is sliced, so that a result published without the lock (see
+// complete_flight) is seen even if its post was missed.
+static UINT32 wait_for_leader(TSS_SIGN_COALESCER* coalescer, SIGN_FLIGHT* flight, TSS_DEVICE* tpm, BYTE* signatureBuffer)
+{
+    UINT32 result;
+    flight->waiters++;
+    while (flight->in_flight)
+    {
+        (void)Condition_Wait(flight->done, coalescer->lock, COALESCER_WAIT_SLICE_MS);
+    }
+    flight->waiters--;
+    // A post wakes a single waiter, which passes it on to the next one
+    if (flight->waiters != 0)
+    {
+        (void)Condition_Post(flight->done);
+    }
+    result = copy_result(flight, tpm, signatureBuffer);
+    return result;
+}
+
+static void publish_result(TSS_SIGN_COALESCER* coalescer, SIGN_FLIGHT* flight, TSS_DEVICE* tpm, UINT32 sigSize, const BYTE* signatureBuffer)
+{
+    flight->sig_size = sigSize;
+    flight->raw_response = tpm->LastRawResponse;
+    if (sigSize == SHA256_DIGEST_SIZE)
+    {
+        memcpy(flight->signature, signatureBuffer, SHA256_DIGEST_SIZE);
+    }
+    // Failures are only handed to the requests that waited for them
+    flight->cached = sigSize == SHA256_DIGEST_SIZE && coalescer->ttl_ns != 0 && !flight->cleared;
+    flight->completed_ns = flight->cached ? tpm_timer_get_ns() : 0;
+    flight->in_flight = false;
+    if (flight->waiters != 0)
+    {
+        (void)Condition_Post(flight->done);
+    }
+}
+
+static void complete_flight(TSS_SIGN_COALESCER* coalescer, SIGN_FLIGHT* flight, TSS_DEVICE* tpm, UINT32 sigSize, const BYTE* signatureBuffer)
+{
+    if (Lock(coalescer->lock) != LOCK_OK)
+    {
+        // The waiters would never be released otherwise
+        LogError("Failure acquiring coalescer lock, publishing the signature without it");
+        publish_result(coalescer, flight, tpm, sigSize, signatureBuffer);
+    }
+    else
+    {
+        publish_result(coalescer, flight, tpm, sigSize, signatureBuffer);
+        (void)Unlock(coalescer->lock);
+    }
+}
+
+TSS_SIGN_COALESCER_HANDLE tpm_sign_coalescer_create(uint32_t ttl_ms)
+{
+    TSS_SIGN_COALESCER* result;
+    if ((result = (TSS_SIGN_COALESCER*)malloc(sizeof(TSS_SIGN_COALESCER))) == NULL)
+    {
+        LogError("Failure allocating sign coalescer");
+    }
+    else
+    {
+        size_t index;
+        memset(result, 0, sizeof(TSS_SIGN_COALESCER));
+        result->ttl_ns = (uint64_t)ttl_ms * COALESCER_NS_PER_MS;
+        if ((result->lock = Lock_Init()) == NULL)
+        {
+            LogError("Failure creating coalescer lock");
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            for (index = 0; index < TSS_SIGN_COALESCER_SIZE; index++)
+            {
+                if ((result->flights[index].done = Condition_Init()) == NULL)
+                {
+                    LogError("Failure creating coalescer condition");
+                    break;
+                }
+            }
+
+            if (index < TSS_SIGN_COALESCER_SIZE)
+            {
+                deinit_conditions(result, index);
+                (void)Lock_Deinit(result->lock);
+                free(result);
+                result = NULL;
+            }
+        }
+    }
+    return result;
+}
+
+void tpm_sign_coalescer_destroy(TSS_SIGN_COALESCER_HANDLE handle)
+{
+    if (handle != NULL)
+    {
+        deinit_conditions(handle, TSS_SIGN_COALESCER_SIZE);
+        (void)Lock_Deinit(handle->lock);
+        free(handle);
+    }
+}
+
+UINT32 tpm_sign_coalescer_sign(TSS_SIGN_COALESCER_HANDLE handle, TSS_DEVICE* tpm, TSS_SESSION* sess, BYTE* tokenData, UINT32 tokenSize, BYTE* signatureBuffer, UINT32 sigBufSize)
+{
+    UINT32 result;
+    SIGN_KEY key;
+
+    if (handle == NULL || tpm == NULL || tokenData == NULL || signatureBuffer == NULL)
+    {
+        LogError("Invalid parameter specified handle: %p, tpm: %p, tokenData: %p, signatureBuffer: %p", handle, tpm, tokenData, signatureBuffer);
+        result = 0;
+    }
+    else if (sigBufSize < SHA256_DIGEST_SIZE)
+    {
+        LogError("Signature buffer size (%u) is less than required size (%u)", sigBufSize, SHA256_DIGEST_SIZE);
+        result = SHA256_DIGEST_SIZE;
+    }
+    else if (build_key(tpm, sess, tokenData, tokenSize, &key) != 0)
+    {
+        LogError("Failure identifying the signature, signing it without coalescing");
+        result = SignData(tpm, sess, tokenData, tokenSize, signatureBuffer, sigBufSize);
+    }
+    else if (Lock(handle->lock) != LOCK_OK)
+    {
+        LogError("Failure acquiring coalescer lock, signing without coalescing");
+        result = SignData(tpm, sess, tokenData, tokenSize, signatureBuffer, sigBufSize);
+    }
+    else
+    {
+        SIGN_FLIGHT* flight = find_flight(handle, &key);
+        if (flight != NULL && flight->in_flight)
+        {
+            handle->stats.Coalesced++;
+            result = wait_for_leader(handle, flight, tpm, signatureBuffer);
+            (void)Unlock(handle->lock);
+        }
+        else if (flight != NULL && is_fresh(handle, flight))
+        {
+            handle->stats.Cached++;
+            result = copy_result(flight, tpm, signatureBuffer);
+            (void)Unlock(handle->lock);
+        }
+        else
+        {
+            // A stale slot of the same signature still read by its waiters is
+            // left alone
+            if (flight == NULL)
+            {
+                flight = claim_flight(handle);
+            }
+            else if (flight->waiters != 0)
+            {
+                flight = NULL;
+            }
+
+            handle->stats.Signed++;
+            if (flight != NULL)
+            {
+                flight->used = true;
+                flight->in_flight = true;
+                flight->cached = false;
+                flight->cleared = false;
+                memcpy(&flight->key, &key, sizeof(SIGN_KEY));
+            }
+            (void)Unlock(handle->lock);
+
+            result = SignData(tpm, sess, tokenData, tokenSize, signatureBuffer, sigBufSize);
+            if (flight != NULL)
+            {
+                complete_flight(handle, flight, tpm, result, signatureBuffer);
+            }
+        }
+    }
+    return result;
+}
+
+void tpm_sign_coalescer_clear(TSS_SIGN_COALESCER_HANDLE handle)
+{
+    if (handle == NULL)
+    {
+        LogError("Invalid parameter handle: NULL");
+    }
+    else if (Lock(handle->lock) != LOCK_OK)
+    {
+        LogError("Failure acquiring coalescer lock");
+    }
+    else
+    {
+        size_t index;
+        for (index = 0; index < TSS_SIGN_COALESCER_SIZE; index++)
+        {
+            SIGN_FLIGHT* flight = &handle->flights[index];
+            flight->cached = false;
+            if (flight->in_flight)
+            {
+                flight->cleared = true;
+            }
+            else if (flight->waiters == 0)
+            {
+                flight->used = false;
+            }
+        }
+        (void)Unlock(handle->lock);
+    }
+}
+
+int tpm_sign_coalescer_get_stats(TSS_SIGN_COALESCER_HANDLE handle, TSS_SIGN_COALESCER_STATS* stats)
+{
+    int result;
+    if (handle == NULL || stats == NULL)
+    {
+        LogError("Invalid parameter handle: %p, stats: %p", handle, stats);
+        result = __FAILURE__;
+    }
+    else if (Lock(handle->lock) != LOCK_OK)
+    {
+        LogError("Failure acquiring coalescer lock");
+        result = __FAILURE__;
+    }
+    else
+    {
+        *stats = handle->stats;
+        (void)Unlock(handle->lock);
+        result = 0;
+    }
+    return result;
+}
@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
+#include <limits.h>
 #include "azure_c_shared_utility/umock_c_prod.h"
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/xlogging.h"
@@ -17,8 +19,12 @@
 #else
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <poll.h>
 #include <unistd.h>
 
 #define SOCKET              int
@@ -26,12 +32,27 @@
 #define SOCKET_ERROR        -1
 #endif
 
+// poll takes any descriptor, while select cannot watch the ones at or above
+// FD_SETSIZE on POSIX
+#ifdef WIN32
+typedef WSAPOLLFD SOCKET_POLL_INFO;
+#define poll_sockets(info, count, timeout)  WSAPoll(info, (ULONG)(count), timeout)
+#else
+typedef struct pollfd SOCKET_POLL_INFO;
+#define poll_sockets(info, count, timeout)  poll(info, (nfds_t)(count), timeout)
+#endif
+
 #define MAX_DATA_RECV                   1024
+#define MAX_GATHER_BUFFERS              8
 
 typedef struct TPM_SOCKET_INFO_TAG
 {
     SOCKET socket_conn;
-    unsigned char* recv_bytes;
+
+    // Bytes received but not yet handed out by tpm_socket_read. They start at
+    // recv_offset, and the buffer is only refilled once it has been drained.
+    unsigned char recv_bytes[MAX_DATA_RECV];
+    size_t recv_offset;
     size_t recv_length;
 } TPM_SOCKET_INFO;
 
@@ -47,50 +68,19 @@ enum TpmSimCommands
     Remote_Stop = 21,
 };
 
-static int add_to_buffer(TPM_SOCKET_INFO* socket_info, const unsigned char* bytes, size_t length)
+static size_t take_from_buffer(TPM_SOCKET_INFO* socket_info, unsigned char* bytes, size_t length)
 {
-    int result;
-    unsigned char* new_buff;
-    if (socket_info->recv_bytes == NULL)
+    size_t result = socket_info->recv_length < length ? socket_info->recv_length : length;
+    memcpy(bytes, socket_info->recv_bytes + socket_info->recv_offset, result);
+    socket_info->recv_offset += result;
+    socket_info->recv_length -= result;
+    if (socket_info->recv_length == 0)
     {
-        new_buff = (unsigned char*)malloc(length);
-    }
-    else
-    {
-        new_buff = (unsigned char*)realloc(socket_info->recv_bytes, socket_info->recv_length + length);
-}
-    if (new_buff == NULL)
-    {
-        result = __FAILURE__;
-    }
-    else
-    {
-        socket_info->recv_bytes = new_buff;
-        memcpy(socket_info->recv_bytes + socket_info->recv_length, bytes, length);
-        socket_info->recv_length += length;
-        result = 0;
+        socket_info->recv_offset = 0;
     }
     return result;
 }
 
-static void remove_from_buffer(TPM_SOCKET_INFO* socket_info, size_t length)
-{
-    if (socket_info->recv_length == length)
-    {
-        free(socket_info->recv_bytes);
-        socket_info->recv_bytes = NULL;
-        socket_info->recv_length = 0;
-    }
-    else
-    {
-        unsigned char* new_buff = (unsigned char*)malloc(socket_info->recv_length - length);
-        memcpy(new_buff, &socket_info->recv_bytes[length], socket_info->recv_length - length);
-        free(socket_info->recv_bytes);
-        socket_info->recv_bytes = new_buff;
-        socket_info->recv_length -= length;
-    }
-}
-
 static int send_socket_bytes(TPM_SOCKET_INFO* socket_info, const unsigned char* cmd_val, size_t byte_len)
 {
     int result;
@@ -129,59 +119,198 @@ static int send_socket_bytes(TPM_SOCKET_INFO* socket_info, const unsigned char*
     return result;
 }
 
+static int send_socket_gather(TPM_SOCKET_INFO* socket_info, const TPM_SOCKET_BUFFER* buffers, size_t count)
+{
+    int result;
+    size_t index;
+    int sent_bytes;
+#ifdef WIN32
+    WSABUF send_bufs[MAX_GATHER_BUFFERS];
+    DWORD wsa_sent = 0;
+
+    for (index = 0; index < count; index++)
+    {
+        send_bufs[index].buf = (CHAR*)buffers[index].bytes;
+        send_bufs[index].len = buffers[index].length;
+    }
+    sent_bytes = WSASend(socket_info->socket_conn, send_bufs, (DWORD)count, &wsa_sent, 0, NULL, NULL) == 0 ? (int)wsa_sent : -1;
+#else
+    struct iovec send_bufs[MAX_GATHER_BUFFERS];
+    struct msghdr send_msg;
+
+    for (index = 0; index < count; index++)
+    {
+        send_bufs[index].iov_base = (void*)buffers[index].bytes;
+        send_bufs[index].iov_len = buffers[index].length;
+    }
+    memset(&send_msg, 0, sizeof(send_msg));
+    send_msg.msg_iov = send_bufs;
+    send_msg.msg_iovlen = count;
+    sent_bytes = (int)sendmsg(socket_info->socket_conn, &send_msg, 0);
+#endif
+    if (sent_bytes < 0)
+    {
+        LogError("Failure sending packet.");
+        result = __FAILURE__;
+    }
+    else
+    {
+        // A short send is unusual for these small frames, finish it piecewise
+        size_t skip_len = (size_t)sent_bytes;
+        result = 0;
+        for (index = 0; index < count && result == 0; index++)
+        {
+            if (skip_len >= buffers[index].length)
+            {
+                skip_len -= buffers[index].length;
+            }
+            else
+            {
+                result = send_socket_bytes(socket_info, buffers[index].bytes + skip_len, buffers[index].length - skip_len);
+                skip_len = 0;
+            }
+        }
+    }
+    return result;
+}
+
 static int read_socket_bytes(TPM_SOCKET_INFO* socket_info)
 {
     int result;
-    char read_data[MAX_DATA_RECV];
-    int data_len = recv(socket_info->socket_conn, read_data, MAX_DATA_RECV, 0);
+    // Only called once the buffer is drained, so the whole buffer is free
+    int data_len = recv(socket_info->socket_conn, (char*)socket_info->recv_bytes, MAX_DATA_RECV, 0);
     if (data_len == -1)
     {
         LogError("Failure received bytes timed out.");
         result = __FAILURE__;
     }
+    else if (data_len == 0)
+    {
+        LogError("Failure: connection closed by the remote end.");
+        result = __FAILURE__;
+    }
     else
     {
 #if SHOW_TRACE
         printf("-> ");
-        for (size_t index = 0; index < size; index++)
+        for (int index = 0; index < data_len; index++)
         {
-            printf("%x", buffer[index]);
+            printf("%x", socket_info->recv_bytes[index]);
         }
         printf("\r\n");
 #endif
-        if (add_to_buffer(socket_info, (const unsigned char*)read_data, data_len) != 0)
+        socket_info->recv_offset = 0;
+        socket_info->recv_length = (size_t)data_len;
+        result = 0;
+    }
+    return result;
+}
+
+static void close_socket(SOCKET socket_obj)
+{
+#ifdef WIN32
+    closesocket(socket_obj);
+#else
+    (void)shutdown(socket_obj, SHUT_RDWR);
+    close(socket_obj);
+#endif
+}
+
+
+static int connect_inet_socket(TPM_SOCKET_INFO* socket_info, const char* address, unsigned short port)
+{
+    int result;
+    if ((socket_info->socket_conn = socket(AF_INET, SOCK_STREAM, 0)) == INVALID_SOCKET)
+    {
+        LogError("Failure: connecting to tpm simulator.");
+        result = __FAILURE__;
+    }
+    else
+    {
+        struct sockaddr_in SockAddr;
+        memset(&SockAddr, 0, sizeof(SockAddr));
+        SockAddr.sin_family = AF_INET;
+        SockAddr.sin_port = htons(port);
+        SockAddr.sin_addr.s_addr = inet_addr(address);
+
+        if (connect(socket_info->socket_conn, (struct sockaddr*)&SockAddr, sizeof(SockAddr)) < 0)
         {
-            LogError("Failure: adding bytes to buffer.");
+            LogError("Failure: connecting to tpm simulator.");
+            close_socket(socket_info->socket_conn);
             result = __FAILURE__;
         }
         else
         {
+            // Commands are small request/response exchanges, so don't let
+            // Nagle's algorithm hold them back waiting for a delayed ACK
+            int no_delay = 1;
+            if (setsockopt(socket_info->socket_conn, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay)) != 0)
+            {
+                LogInfo("Unable to set TCP_NODELAY on the tpm socket.");
+            }
             result = 0;
         }
     }
     return result;
 }
 
-static void close_socket(SOCKET socket_obj)
+static int connect_unix_socket(TPM_SOCKET_INFO* socket_info, const char* path)
 {
+    int result;
 #ifdef WIN32
-    closesocket(socket_obj);
+    (void)socket_info;
+    LogError("Failure: unix domain sockets are not supported, path: %s", path);
+    result = __FAILURE__;
 #else
-    (void)shutdown(socket_obj, SHUT_RDWR);
-    close(socket_obj);
+    struct sockaddr_un SockAddr;
+    size_t path_len = strlen(path);
+
+    if (path_len == 0 || path_len >= sizeof(SockAddr.sun_path))
+    {
+        LogError("Invalid unix socket path: %s", path);
+        result = __FAILURE__;
+    }
+    else if ((socket_info->socket_conn = socket(AF_UNIX, SOCK_STREAM, 0)) == INVALID_SOCKET)
+    {
+        LogError("Failure: creating unix socket.");
+        result = __FAILURE__;
+    }
+    else
+    {
+        memset(&SockAddr, 0, sizeof(SockAddr));
+        SockAddr.sun_family = AF_UNIX;
+        memcpy(SockAddr.sun_path, path, path_len);
+
+        if (connect(socket_info->socket_conn, (struct sockaddr*)&SockAddr, sizeof(SockAddr)) < 0)
+        {
+            LogError("Failure: connecting to %s.", path);
+            close_socket(socket_info->socket_conn);
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
 #endif
+    return result;
 }
 
-
 TPM_SOCKET_HANDLE tpm_socket_create(const char* address, unsigned short port)
 {
     TPM_SOCKET_INFO* result;
-    if ((result = malloc(sizeof(TPM_SOCKET_INFO))) == NULL)
+    if (address == NULL)
+    {
+        LogError("Invalid argument specified address: NULL");
+        result = NULL;
+    }
+    else if ((result = malloc(sizeof(TPM_SOCKET_INFO))) == NULL)
     {
         LogError("Failure: malloc socket communication info.");
     }
     else
     {
+        int connect_res;
 #ifdef WIN32
         WSADATA wsaData;
         WSAStartup(MAKEWORD(2, 0), &wsaData);
@@ -189,27 +318,20 @@ TPM_SOCKET_HANDLE tpm_socket_create(const char* address, unsigned short port)
 
         memset(result, 0, sizeof(TPM_SOCKET_INFO));
 
-        if ((result->socket_conn = socket(AF_INET, SOCK_STREAM, 0)) == INVALID_SOCKET)
+        // A local peer is reached without going through the loopback TCP stack
+        if (strncmp(address, TPM_SOCKET_UNIX_PREFIX, sizeof(TPM_SOCKET_UNIX_PREFIX) - 1) == 0)
         {
-            LogError("Failure: connecting to tpm simulator.");
-            free(result);
-            result = NULL;
+            connect_res = connect_unix_socket(result, address + sizeof(TPM_SOCKET_UNIX_PREFIX) - 1);
         }
         else
         {
-            struct sockaddr_in SockAddr;
-            memset(&SockAddr, 0, sizeof(SockAddr));
-            SockAddr.sin_family = AF_INET;
-            SockAddr.sin_port = htons(port);
-            SockAddr.sin_addr.s_addr = inet_addr(address);
+            connect_res = connect_inet_socket(result, address, port);
+        }
 
-            if (connect(result->socket_conn, (struct sockaddr*)&SockAddr, sizeof(SockAddr)) < 0)
-            {
-                LogError("Failure: connecting to tpm simulator.");
-                close_socket(result->socket_conn);
-                free(result);
-                result = NULL;
-            }
+        if (connect_res != 0)
+        {
+            free(result);
+            result = NULL;
         }
     }
     return result;
@@ -220,7 +342,6 @@ void tpm_socket_destroy(TPM_SOCKET_HANDLE handle)
     if (handle)
     {
         close_socket(handle->socket_conn);
-        free(handle->recv_bytes);
         free(handle);
     }
 }
@@ -235,26 +356,17 @@ int tpm_socket_read(TPM_SOCKET_HANDLE handle, unsigned char* tpm_bytes, uint32_t
     }
     else
     {
-        // Do we have enough bytes cached
-        result = __FAILURE__;
-        for (size_t index = 0; index < 2; index++)
+        size_t bytes_read = take_from_buffer(handle, tpm_bytes, bytes_len);
+        result = 0;
+        while (bytes_read < bytes_len)
         {
-            if (handle->recv_length >= bytes_len)
+            if (read_socket_bytes(handle) != 0)
             {
-                memcpy(tpm_bytes, handle->recv_bytes, bytes_len);
-                remove_from_buffer(handle, bytes_len);
-                result = 0;
+                LogError("Failure reading socket bytes.");
+                result = __FAILURE__;
                 break;
             }
-            else
-            {
-                if (read_socket_bytes(handle))
-                {
-                    LogError("Failure reading socket bytes.");
-                    result = __FAILURE__;
-                    break;
-                }
-            }
+            bytes_read += take_from_buffer(handle, tpm_bytes + bytes_read, bytes_len - bytes_read);
         }
     }
     return result;
@@ -274,3 +386,125 @@ int tpm_socket_send(TPM_SOCKET_HANDLE handle, const unsigned char* tpm_bytes, ui
     }
     return result;
 }
+
+int tpm_socket_send_gather(TPM_SOCKET_HANDLE handle, const TPM_SOCKET_BUFFER* buffers, size_t count)
+{
+    int result;
+    if (handle == NULL || buffers == NULL || count == 0 || count > MAX_GATHER_BUFFERS)
+    {
+        LogError("Invalid argument specified handle: %p, buffers: %p, count: %d", handle, buffers, (int)count);
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = send_socket_gather(handle, buffers, count);
+    }
+    return result;
+}
+
+int tpm_socket_wait_readable(TPM_SOCKET_HANDLE handle, uint32_t timeout_ms, bool* is_readable)
+{
+    int result;
+    if (handle == NULL || is_readable == NULL)
+    {
+        LogError("Invalid argument specified handle: %p, is_readable: %p", handle, is_readable);
+        result = __FAILURE__;
+    }
+    else if (tpm_socket_wait_any(&handle, 1, timeout_ms, is_readable) < 0)
+    {
+        LogError("Failure waiting for socket data.");
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+int tpm_socket_wait_any(TPM_SOCKET_HANDLE* handles, size_t count, uint32_t timeout_ms, bool* readable)
+{
+    int result;
+    if (handles == NULL || readable == NULL || count == 0 || count > TPM_SOCKET_WAIT_MAX_HANDLES)
+    {
+        LogError("Invalid argument specified handles: %p, count: %d, readable: %p", handles, (int)count, readable);
+        result = -1;
+    }
+    else
+    {
+        SOCKET_POLL_INFO poll_info[TPM_SOCKET_WAIT_MAX_HANDLES];
+        bool buffered = false;
+        int poll_timeout;
+        int poll_res;
+        size_t index;
+
+        result = 0;
+        for (index = 0; index < count && result == 0; index++)
+        {
+            readable[index] = false;
+            if (handles[index] == NULL)
+            {
+                LogError("Invalid socket at index %d", (int)index);
+                result = -1;
+            }
+            else
+            {
+                // Bytes left over from a previous recv are already available
+                buffered = buffered || handles[index]->recv_length > 0;
+                poll_info[index].fd = handles[index]->socket_conn;
+                poll_info[index].events = POLLIN;
+                poll_info[index].revents = 0;
+            }
+        }
+
+        if (result == 0)
+        {
+            // Only collect the other readable sockets when one already is
+            if (buffered)
+            {
+                poll_timeout = 0;
+            }
+            else if (timeout_ms == TPM_SOCKET_WAIT_FOREVER)
+            {
+                poll_timeout = -1;
+            }
+            else
+            {
+                poll_timeout = timeout_ms > INT_MAX ? INT_MAX : (int)timeout_ms;
+            }
+
+            if ((poll_res = poll_sockets(poll_info, count, poll_timeout)) < 0)
+            {
+                LogError("Failure waiting for socket data.");
+                result = -1;
+            }
+            else
+            {
+                for (index = 0; index < count; index++)
+                {
+                    // A closed or failed socket is reported as readable, so
+                    // that the read reports the error
+                    readable[index] = handles[index]->recv_length > 0 ||
+                        (poll_res > 0 && (poll_info[index].revents & (POLLIN | POLLHUP | POLLERR)) != 0);
+                    result += readable[index] ? 1 : 0;
+                }
+            }
+        }
+    }
+    return result;
+}
+
+int tpm_socket_get_fd(TPM_SOCKET_HANDLE handle)
+{
+    int result;
+    if (handle == NULL)
+    {
+        LogError("Invalid argument specified handle: NULL");
+        result = -1;
+    }
+    else
+    {
+        result = (int)handle->socket_conn;
+    }
+    return result;
+}
@@ -0,0 +1,42 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#define _POSIX_C_SOURCE 200112L
+#include <time.h>
+#endif
+#include <stdint.h>
+
+#include "azure_utpm_c/tpm_timer.h"
+
+#define NS_PER_SEC  1000000000ULL
+
+uint64_t tpm_timer_get_ns(void)
+{
+    uint64_t result;
+#ifdef WIN32
+    static LARGE_INTEGER frequency = { 0 };
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0)
+    {
+        (void)QueryPerformanceFrequency(&frequency);
+    }
+    (void)QueryPerformanceCounter(&counter);
+    // Split the conversion so that it does not overflow for long uptimes
+    result = (uint64_t)(counter.QuadPart / frequency.QuadPart) * NS_PER_SEC
+        + (uint64_t)(counter.QuadPart % frequency.QuadPart) * NS_PER_SEC / (uint64_t)frequency.QuadPart;
+#else
+    struct timespec now;
+    if (clock_gettime(CLOCK_MONOTONIC, &now) != 0)
+    {
+        result = 0;
+    }
+    else
+    {
+        result = (uint64_t)now.tv_sec * NS_PER_SEC + (uint64_t)now.tv_nsec;
+    }
+#endif
+    return result;
+}
@@ -0,0 +1,338 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "azure_utpm_c/tpm_transcript.h"
+
+#define TRANSCRIPT_MAGIC            "UTPMTRC1"
+#define TRANSCRIPT_MAGIC_SIZE       (sizeof(TRANSCRIPT_MAGIC) - 1)
+#define TRANSCRIPT_CMD_HEADER       4
+#define TRANSCRIPT_RESP_HEADER      (4 + 8)
+
+typedef struct TPM_TRANSCRIPT_TAG
+{
+    // Set while recording
+    FILE* file;
+    // A command was written and waits for its response
+    bool cmd_written;
+
+    // Set while playing back, the whole file
+    unsigned char* image;
+    size_t image_size;
+    size_t position;
+} TPM_TRANSCRIPT;
+
+static void put_uint32(unsigned char* pos, uint32_t value)
+{
+    pos[0] = (unsigned char)(value >> 24);
+    pos[1] = (unsigned char)(value >> 16);
+    pos[2] = (unsigned char)(value >> 8);
+    pos[3] = (unsigned char)value;
+}
+
+static uint32_t get_uint32(const unsigned char* pos)
+{
+    return ((uint32_t)pos[0] << 24) | ((uint32_t)pos[1] << 16) | ((uint32_t)pos[2] << 8) | (uint32_t)pos[3];
+}
+
+static int write_bytes(TPM_TRANSCRIPT* transcript, const unsigned char* bytes, size_t length)
+{
+    int result;
+    if (length > 0 && fwrite(bytes, 1, length, transcript->file) != length)
+    {
+        LogError("Failure writing %lu bytes to the transcript", (unsigned long)length);
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+// Parses the record at 'position' of the image, returning the position of the
+// next record, or 0 if the record is malformed
+static size_t parse_record(const TPM_TRANSCRIPT* transcript, size_t position, TPM_TRANSCRIPT_ENTRY* entry)
+{
+    size_t result = 0;
+    size_t remaining = transcript->image_size - position;
+    const unsigned char* pos = transcript->image + position;
+
+    if (remaining >= TRANSCRIPT_CMD_HEADER)
+    {
+        entry->cmd_len = get_uint32(pos);
+        entry->cmd_bytes = pos + TRANSCRIPT_CMD_HEADER;
+        if (entry->cmd_len <= TPM_TRANSCRIPT_MAX_MESSAGE &&
+            remaining - TRANSCRIPT_CMD_HEADER >= entry->cmd_len + TRANSCRIPT_RESP_HEADER)
+        {
+            pos = entry->cmd_bytes + entry->cmd_len;
+            remaining -= TRANSCRIPT_CMD_HEADER + entry->cmd_len + TRANSCRIPT_RESP_HEADER;
+            entry->resp_len = get_uint32(pos);
+            entry->latency_ns = ((uint64_t)get_uint32(pos + 4) << 32) | get_uint32(pos + 8);
+            entry->resp_bytes = pos + TRANSCRIPT_RESP_HEADER;
+            if (entry->resp_len <= TPM_TRANSCRIPT_MAX_MESSAGE && remaining >= entry->resp_len)
+            {
+                result = (size_t)(entry->resp_bytes + entry->resp_len - transcript->image);
+            }
+        }
+    }
+    return result;
+}
+
+static unsigned char* read_transcript_file(const char* path, size_t* size)
+{
+    unsigned char* result;
+    long file_size;
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        LogError("Failure opening transcript %s", path);
+        result = NULL;
+    }
+    else
+    {
+        if (fseek(file, 0, SEEK_END) != 0 || (file_size = ftell(file)) < (long)TRANSCRIPT_MAGIC_SIZE || fseek(file, 0, SEEK_SET) != 0)
+        {
+            LogError("Transcript %s is not readable or too short", path);
+            result = NULL;
+        }
+        else if ((result = (unsigned char*)malloc((size_t)file_size)) == NULL)
+        {
+            LogError("Failure allocating %ld bytes for transcript %s", file_size, path);
+        }
+        else if (fread(result, 1, (size_t)file_size, file) != (size_t)file_size)
+        {
+            LogError("Failure reading transcript %s", path);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            *size = (size_t)file_size;
+        }
+        (void)fclose(file);
+    }
+    return result;
+}
+
+TPM_TRANSCRIPT_HANDLE tpm_transcript_create(const char* path)
+{
+    TPM_TRANSCRIPT* result;
+    if (path == NULL)
+    {
+        LogError("Invalid parameter path is NULL");
+        result = NULL;
+    }
+    else if ((result = (TPM_TRANSCRIPT*)malloc(sizeof(TPM_TRANSCRIPT))) == NULL)
+    {
+        LogError("Failure allocating transcript");
+    }
+    else
+    {
+        memset(result, 0, sizeof(TPM_TRANSCRIPT));
+        if ((result->file = fopen(path, "wb")) == NULL)
+        {
+            LogError("Failure creating transcript %s", path);
+            free(result);
+            result = NULL;
+        }
+        else if (write_bytes(result, (const unsigned char*)TRANSCRIPT_MAGIC, TRANSCRIPT_MAGIC_SIZE) != 0)
+        {
+            (void)fclose(result->file);
+            free(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+TPM_TRANSCRIPT_HANDLE tpm_transcript_open(const char* path)
+{
+    TPM_TRANSCRIPT* result;
+    if (path == NULL)
+    {
+        LogError("Invalid parameter path is NULL");
+        result = NULL;
+    }
+    else if ((result = (TPM_TRANSCRIPT*)malloc(sizeof(TPM_TRANSCRIPT))) == NULL)
+    {
+        LogError("Failure allocating transcript");
+    }
+    else
+    {
+        memset(result, 0, sizeof(TPM_TRANSCRIPT));
+        if ((result->image = read_transcript_file(path, &result->image_size)) == NULL)
+        {
+            free(result);
+            result = NULL;
+        }
+        else if (memcmp(result->image, TRANSCRIPT_MAGIC, TRANSCRIPT_MAGIC_SIZE) != 0)
+        {
+            LogError("%s is not a TPM transcript", path);
+            free(result->image);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            // Validate every record once, so that the playback cannot fail
+            TPM_TRANSCRIPT_ENTRY entry;
+            size_t position = TRANSCRIPT_MAGIC_SIZE;
+            while (position != 0 && position < result->image_size)
+            {
+                position = parse_record(result, position, &entry);
+            }
+
+            if (position == 0)
+            {
+                LogError("Transcript %s is truncated or malformed", path);
+                free(result->image);
+                free(result);
+                result = NULL;
+            }
+            else
+            {
+                result->position = TRANSCRIPT_MAGIC_SIZE;
+            }
+        }
+    }
+    return result;
+}
+
+void tpm_transcript_close(TPM_TRANSCRIPT_HANDLE handle)
+{
+    if (handle != NULL)
+    {
+        if (handle->file != NULL)
+        {
+            if (handle->cmd_written)
+            {
+                LogInfo("Transcript closed before the response of the last command");
+            }
+            if (fclose(handle->file) != 0)
+            {
+                LogError("Failure closing transcript");
+            }
+        }
+        free(handle->image);
+        free(handle);
+    }
+}
+
+int tpm_transcript_write_command(TPM_TRANSCRIPT_HANDLE handle, const unsigned char* cmd_bytes, uint32_t cmd_len)
+{
+    int result;
+    if (handle == NULL || handle->file == NULL || cmd_bytes == NULL || cmd_len > TPM_TRANSCRIPT_MAX_MESSAGE)
+    {
+        LogError("Invalid parameter handle: %p, cmd_bytes: %p, cmd_len: %u", handle, cmd_bytes, cmd_len);
+        result = __FAILURE__;
+    }
+    else if (handle->cmd_written)
+    {
+        LogError("The response of the previous command was not written");
+        result = __FAILURE__;
+    }
+    else
+    {
+        unsigned char header[TRANSCRIPT_CMD_HEADER];
+        put_uint32(header, cmd_len);
+        if (write_bytes(handle, header, sizeof(header)) != 0 ||
+            write_bytes(handle, cmd_bytes, cmd_len) != 0)
+        {
+            result = __FAILURE__;
+        }
+        else
+        {
+            handle->cmd_written = true;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+int tpm_transcript_write_response(TPM_TRANSCRIPT_HANDLE handle, const unsigned char* resp_bytes, uint32_t resp_len, uint64_t latency_ns)
+{
+    int result;
+    if (handle == NULL || handle->file == NULL || (resp_bytes == NULL && resp_len > 0) || resp_len > TPM_TRANSCRIPT_MAX_MESSAGE)
+    {
+        LogError("Invalid parameter handle: %p, resp_bytes: %p, resp_len: %u", handle, resp_bytes, resp_len);
+        result = __FAILURE__;
+    }
+    else if (!handle->cmd_written)
+    {
+        LogError("No command is waiting for its response");
+        result = __FAILURE__;
+    }
+    else
+    {
+        unsigned char header[TRANSCRIPT_RESP_HEADER];
+        put_uint32(header, resp_len);
+        put_uint32(header + 4, (uint32_t)(latency_ns >> 32));
+        put_uint32(header + 8, (uint32_t)latency_ns);
+
+        // The record is complete (or the file broken) either way
+        handle->cmd_written = false;
+        if (write_bytes(handle, header, sizeof(header)) != 0 ||
+            write_bytes(handle, resp_bytes, resp_len) != 0)
+        {
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    return result;
+}
+
+bool tpm_transcript_peek(TPM_TRANSCRIPT_HANDLE handle, TPM_TRANSCRIPT_ENTRY* entry)
+{
+    bool result;
+    if (handle == NULL || handle->image == NULL || entry == NULL)
+    {
+        LogError("Invalid parameter handle: %p, entry: %p", handle, entry);
+        result = false;
+    }
+    else if (handle->position >= handle->image_size)
+    {
+        result = false;
+    }
+    else
+    {
+        // Validated by tpm_transcript_open
+        (void)parse_record(handle, handle->position, entry);
+        result = true;
+    }
+    return result;
+}
+
+bool tpm_transcript_next(TPM_TRANSCRIPT_HANDLE handle, TPM_TRANSCRIPT_ENTRY* entry)
+{
+    bool result = tpm_transcript_peek(handle, entry);
+    if (result)
+    {
+        handle->position = (size_t)(entry->resp_bytes + entry->resp_len - handle->image);
+    }
+    return result;
+}
+
+void tpm_transcript_rewind(TPM_TRANSCRIPT_HANDLE handle)
+{
+    if (handle == NULL || handle->image == NULL)
+    {
+        LogError("Invalid parameter handle: %p", handle);
+    }
+    else
+    {
+        handle->position = TRANSCRIPT_MAGIC_SIZE;
+    }
+}
@@ -0,0 +1,102 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <winsock2.h>
+#include <windows.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "azure_utpm_c/tpm_win32_sys.h"
+
+static VOID CALLBACK run_work(PTP_CALLBACK_INSTANCE instance, PVOID context)
+{
+    TPM_WIN32_WORK* work = (TPM_WIN32_WORK*)context;
+    work->run(work->context);
+    // Set once the callback has returned, so that the waiter may free 'work'
+    SetEventWhenCallbackReturns(instance, work->done);
+}
+
+HANDLE tpm_win32_sys_create_event(void)
+{
+    HANDLE result;
+    if ((result = CreateEventA(NULL, TRUE, FALSE, NULL)) == NULL)
+    {
+        LogError("Failure creating event %lu", GetLastError());
+    }
+    return result;
+}
+
+void tpm_win32_sys_close_event(HANDLE event)
+{
+    (void)CloseHandle(event);
+}
+
+void tpm_win32_sys_reset_event(HANDLE event)
+{
+    (void)ResetEvent(event);
+}
+
+bool tpm_win32_sys_queue_work(TPM_WIN32_WORK* work)
+{
+    bool result;
+    if (!TrySubmitThreadpoolCallback(run_work, work, NULL))
+    {
+        LogError("Failure queuing work to the thread pool %lu", GetLastError());
+        result = false;
+    }
+    else
+    {
+        result = true;
+    }
+    return result;
+}
+
+int tpm_win32_sys_wait_any(HANDLE* events, size_t count, uint32_t timeout_ms, bool* signaled)
+{
+    int result;
+    if (events == NULL || signaled == NULL || count == 0 || count > MAXIMUM_WAIT_OBJECTS)
+    {
+        LogError("Invalid argument specified events: %p, count: %zu, signaled: %p", events, count, signaled);
+        result = -1;
+    }
+    else
+    {
+        DWORD wait_res;
+        size_t index;
+
+        for (index = 0; index < count; index++)
+        {
+            signaled[index] = false;
+        }
+
+        wait_res = WaitForMultipleObjects((DWORD)count, events, FALSE, timeout_ms == TPM_WIN32_WAIT_FOREVER ? INFINITE : timeout_ms);
+        if (wait_res == WAIT_TIMEOUT)
+        {
+            result = 0;
+        }
+        else if (wait_res >= WAIT_OBJECT_0 + count)
+        {
+            LogError("Failure waiting for the events %lu", GetLastError());
+            result = -1;
+        }
+        else
+        {
+            // Reports the lowest set event only, collect the others
+            signaled[wait_res - WAIT_OBJECT_0] = true;
+            result = 1;
+            for (index = wait_res - WAIT_OBJECT_0 + 1; index < count; index++)
+            {
+                if (WaitForSingleObject(events[index], 0) == WAIT_OBJECT_0)
+                {
+                    signaled[index] = true;
+                    result++;
+                }
+            }
+        }
+    }
+    return result;
+}
@@ -5,10 +5,14 @@
 #include <cstdlib>
 #include <cstdint>
 #include <cstddef>
+#include <cstdio>
+#include <cstring>
 #else
 #include <stdlib.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <string.h>
 #endif
 
 #include "testrunnerswitcher.h"
@@ -31,6 +35,7 @@ static void* my_gballoc_realloc(void* ptr, size_t size)
 #include "umock_c.h"
 #include "umocktypes_charptr.h"
 #include "umocktypes_stdint.h"
+#include "umocktypes_bool.h"
 #include "umock_c_negative_tests.h"
 #include "azure_c_shared_utility/macro_utils.h"
 
@@ -38,14 +43,22 @@ static void* my_gballoc_realloc(void* ptr, size_t size)
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/umock_c_prod.h"
 #include "azure_c_shared_utility/buffer_.h"
+#include "azure_c_shared_utility/threadapi.h"
 #include "azure_utpm_c/tpm_comm.h"
+#include "azure_utpm_c/tpm_timer.h"
 #include "azure_utpm_c/TpmTypes.h"
 #include "azure_utpm_c/Memory_fp.h"
 #include "azure_utpm_c/Marshal_fp.h"
+#include "azure_utpm_c/tpm_host_hash.h"
+#include "azure_utpm_c/tpm_transcript.h"
 #undef ENABLE_MOCKS
 
 #include "azure_utpm_c/tpm_codec.h"
 
+#define ENABLE_MOCKS
+#include "azure_utpm_c/tpm_resource_mgr.h"
+#undef ENABLE_MOCKS
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -56,6 +69,7 @@ extern "C"
 
 #define TEST_COMM_HANDLE        (TPM_COMM_HANDLE)0x123456
 #define TEST_TPMI_DH_OBJECT     (TPMI_DH_OBJECT)0x223456
+#define TEST_TRANSCRIPT         (TPM_TRANSCRIPT_HANDLE)0x323456
 
 static const UINT32 TPM_20_HANDLE = HR_PERSISTENT | 0x00010001;
 
@@ -76,6 +90,16 @@ static TPM2B_PUBLIC tpm_public_value = { 0,   // size will be computed during ma
 
 DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
 
+static size_t g_trace_call_count;
+static TSS_CMD_TRACE g_last_trace;
+
+static void on_cmd_trace(void* context, const TSS_CMD_TRACE* trace)
+{
+    (void)context;
+    g_trace_call_count++;
+    g_last_trace = *trace;
+}
+
 static TPM_COMM_HANDLE my_tpm_comm_create(const char* endpoint)
 {
     (void)endpoint;
@@ -113,11 +137,19 @@ BEGIN_TEST_SUITE(tpm_codec_ut)
         ASSERT_ARE_EQUAL(int, 0, result);
         result = umocktypes_stdint_register_types();
         ASSERT_ARE_EQUAL(int, 0, result);
+        result = umocktypes_bool_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
 
         REGISTER_UMOCK_ALIAS_TYPE(TPM_COMM_HANDLE, void*);
+        REGISTER_UMOCK_ALIAS_TYPE(TPM_TRANSCRIPT_HANDLE, void*);
+        REGISTER_UMOCK_ALIAS_TYPE(TSS_RESOURCE_MGR_HANDLE, void*);
         REGISTER_UMOCK_ALIAS_TYPE(TPM_COMM_TYPE, int);
+        REGISTER_UMOCK_ALIAS_TYPE(TPM_COMM_PRIORITY, int);
         REGISTER_UMOCK_ALIAS_TYPE(BOOL, int);
+        REGISTER_UMOCK_ALIAS_TYPE(INT32, int32_t);
         REGISTER_UMOCK_ALIAS_TYPE(TPM_RC, uint32_t);
+        REGISTER_UMOCK_ALIAS_TYPE(TPMI_ALG_HASH, uint16_t);
+        REGISTER_UMOCK_ALIAS_TYPE(UINT32, uint32_t);
 
         REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
         REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
@@ -148,6 +180,7 @@ BEGIN_TEST_SUITE(tpm_codec_ut)
             ASSERT_FAIL("Could not acquire test serialization mutex.");
         }
         umock_c_reset_all_calls();
+        g_trace_call_count = 0;
     }
 
     TEST_FUNCTION_CLEANUP(method_cleanup)
@@ -174,18 +207,18 @@ BEGIN_TEST_SUITE(tpm_codec_ut)
         uint32_t expected_size = 4096;
         uint32_t raw_resp = 4096;
 
-        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPMS_AUTH_COMMAND_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
 
-        STRICT_EXPECTED_CALL(TPMS_AUTH_COMMAND_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(tpm_comm_submit_command(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
@@ -203,16 +236,16 @@ BEGIN_TEST_SUITE(tpm_codec_ut)
         uint32_t expected_size = 4096;
         uint32_t raw_resp = 4096;
 
-        STRICT_EXPECTED_CALL(TPM2B_DIGEST_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT8_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(TPMT_SYM_DEF_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPM2B_DIGEST_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT8_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPMT_SYM_DEF_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(tpm_comm_submit_command(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(TPMI_ST_COMMAND_TAG_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
@@ -237,6 +270,20 @@ BEGIN_TEST_SUITE(tpm_codec_ut)
             .CopyOutArgumentBuffer_target(&raw_resp, sizeof(raw_resp));
     }
 
+    static void setup_get_capability_mocks(void)
+    {
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        setup_dispatch_cmd_mocks();
+        STRICT_EXPECTED_CALL(TPMI_YES_NO_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPMS_CAPABILITY_DATA_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    }
+
     TEST_FUNCTION(TSS_CreatePwAuthSession_auth_value_NULL_fail)
     {
         //arrange
@@ -311,36 +358,12 @@ BEGIN_TEST_SUITE(tpm_codec_ut)
         uint32_t raw_resp = 4096;
 
         STRICT_EXPECTED_CALL(tpm_comm_create(IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(tpm_comm_get_type(IGNORED_PTR_ARG)).SetReturn(TPM_COMM_TYPE_EMULATOR);
-        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(tpm_comm_submit_command(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(TPMI_ST_COMMAND_TAG_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .CopyOutArgumentBuffer_target(&expected_size, sizeof(expected_size));
-        STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .CopyOutArgumentBuffer_target(&raw_resp, sizeof(raw_resp));
-
+        STRICT_EXPECTED_CALL(tpm_comm_needs_startup(IGNORED_PTR_ARG)).SetReturn(true);
         STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(tpm_comm_submit_command(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(TPMI_ST_COMMAND_TAG_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .CopyOutArgumentBuffer_target(&expected_size, sizeof(expected_size));
-        STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .CopyOutArgumentBuffer_target(&raw_resp, sizeof(raw_resp));
-
         STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(tpm_comm_submit_command(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(TPMI_ST_COMMAND_TAG_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
@@ -348,18 +371,11 @@ BEGIN_TEST_SUITE(tpm_codec_ut)
         STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
             .CopyOutArgumentBuffer_target(&raw_resp, sizeof(raw_resp));
 
-        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(tpm_comm_submit_command(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(TPMI_ST_COMMAND_TAG_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .CopyOutArgumentBuffer_target(&expected_size, sizeof(expected_size));
-        STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .CopyOutArgumentBuffer_target(&raw_resp, sizeof(raw_resp));
+        setup_get_capability_mocks();
 
+        // Loaded session and persistent handle enumeration
+        setup_get_capability_mocks();
+        setup_get_capability_mocks();
 
         //act
         TPM_RC result = Initialize_TPM_Codec(&tpm_device);
@@ -372,102 +388,72 @@ BEGIN_TEST_SUITE(tpm_codec_ut)
         Deinit_TPM_Codec(&tpm_device);
     }
 
-    TEST_FUNCTION(Deinit_TPM_Codec_succeed)
+    TEST_FUNCTION(Initialize_TPM_Codec_deferred_succeed)
     {
         //arrange
         TSS_DEVICE tpm_device = { 0 };
-        uint32_t expected_size = 4096;
-        uint32_t raw_resp = 4096;
-
-        STRICT_EXPECTED_CALL(tpm_comm_create(IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(tpm_comm_get_type(IGNORED_PTR_ARG)).SetReturn(TPM_COMM_TYPE_EMULATOR);
-        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(tpm_comm_submit_command(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(TPMI_ST_COMMAND_TAG_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .CopyOutArgumentBuffer_target(&expected_size, sizeof(expected_size));
-        STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .CopyOutArgumentBuffer_target(&raw_resp, sizeof(raw_resp));
-        (void)Initialize_TPM_Codec(&tpm_device);
-        umock_c_reset_all_calls();
-
-        STRICT_EXPECTED_CALL(tpm_comm_destroy(IGNORED_PTR_ARG));
+        tpm_device.DeferStartup = TRUE;
 
         //act
-        Deinit_TPM_Codec(&tpm_device);
+        TPM_RC result = Initialize_TPM_Codec(&tpm_device);
 
         //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_IS_TRUE(tpm_device.StartupPending);
+        ASSERT_IS_NULL(tpm_device.tpm_comm_handle);
         ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
         //cleanup
+        Deinit_TPM_Codec(&tpm_device);
     }
 
-    TEST_FUNCTION(Deinit_TPM_Codec_TPM_device_NULL)
+    TEST_FUNCTION(Initialize_TPM_Codec_resource_mgr_attach_fail)
     {
         //arrange
+        TSS_DEVICE tpm_device = { 0 };
+        tpm_device.ResourceMgr = (TSS_RESOURCE_MGR_HANDLE)0x6543;
+        tpm_device.DeferStartup = TRUE;
+
+        STRICT_EXPECTED_CALL(tpm_rm_attach_client(tpm_device.ResourceMgr, &tpm_device)).SetReturn(__LINE__);
 
         //act
-        Deinit_TPM_Codec(NULL);
+        TPM_RC result = Initialize_TPM_Codec(&tpm_device);
 
         //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_IS_FALSE(tpm_device.StartupPending);
         ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
         //cleanup
     }
 
-    TEST_FUNCTION(TSS_create_persistent_key_success)
+    TEST_FUNCTION(Initialize_TPM_Codec_resource_mgr_deferred_succeed)
     {
         //arrange
-        TSS_SESSION session = { 0 };
-        TSS_DEVICE tss_dev = { 0 };
-        TPM_HANDLE request_handle = TPM_20_HANDLE;
-        TPMI_DH_OBJECT hierarchy = TPM_RH_ENDORSEMENT;
-        TPM2B_PUBLIC inPub = tpm_public_value;
-        TPM2B_PUBLIC outPub;
-
-        (void)Initialize_TPM_Codec(&tss_dev);
-        umock_c_reset_all_calls();
-
-        uint32_t expected_size = 4096;
-        uint32_t raw_resp = 4096;
+        TSS_DEVICE tpm_device = { 0 };
+        tpm_device.ResourceMgr = (TSS_RESOURCE_MGR_HANDLE)0x6543;
+        tpm_device.DeferStartup = TRUE;
 
-        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(tpm_comm_submit_command(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(TPMI_ST_COMMAND_TAG_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .CopyOutArgumentBuffer_target(&expected_size, sizeof(expected_size));
-        STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .CopyOutArgumentBuffer_target(&raw_resp, sizeof(raw_resp));
-        STRICT_EXPECTED_CALL(TPM2B_PUBLIC_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-        STRICT_EXPECTED_CALL(TPM2B_NAME_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(TPM2B_NAME_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_rm_attach_client(tpm_device.ResourceMgr, &tpm_device));
 
         //act
-        TPM_HANDLE handle = TSS_CreatePersistentKey(&tss_dev, request_handle, &session, hierarchy, &inPub, &outPub);
+        TPM_RC result = Initialize_TPM_Codec(&tpm_device);
 
         //assert
-        ASSERT_ARE_NOT_EQUAL(uint32_t, 0, handle);
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_IS_TRUE(tpm_device.StartupPending);
         ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
         //cleanup
+        Deinit_TPM_Codec(&tpm_device);
     }
 
-    TEST_FUNCTION(TSS_StartAuthSession_tss_device_NULL_fail)
+    TEST_FUNCTION(TSS_CompleteStartup_tss_device_NULL_fail)
     {
         //arrange
-        TPMA_SESSION sess_attrib = { 1 };
-        TSS_SESSION session;
 
         //act
-        TPM_RC result = TSS_StartAuthSession(NULL, TPM_SE_POLICY, TPM_ALG_SHA256, sess_attrib, &session);
+        TPM_RC result = TSS_CompleteStartup(NULL);
 
         //assert
         ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
@@ -476,36 +462,41 @@ BEGIN_TEST_SUITE(tpm_codec_ut)
         //cleanup
     }
 
-    TEST_FUNCTION(TSS_StartAuthSession_tss_session_NULL_fail)
+    TEST_FUNCTION(TSS_CompleteStartup_succeed)
     {
         //arrange
-        TSS_DEVICE tss_dev = { 0 };
-        TPMA_SESSION sess_attrib = { 1 };
+        TSS_DEVICE tpm_device = { 0 };
+        tpm_device.DeferStartup = TRUE;
+        (void)Initialize_TPM_Codec(&tpm_device);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(tpm_comm_create(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_comm_needs_startup(IGNORED_PTR_ARG)).SetReturn(false);
+        // Property cache, loaded session and persistent handle enumeration
+        setup_get_capability_mocks();
+        setup_get_capability_mocks();
+        setup_get_capability_mocks();
 
         //act
-        TPM_RC result = TSS_StartAuthSession(&tss_dev, TPM_SE_POLICY, TPM_ALG_SHA256, sess_attrib, NULL);
+        TPM_RC result = TSS_CompleteStartup(&tpm_device);
 
         //assert
-        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_IS_FALSE(tpm_device.StartupPending);
         ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
         //cleanup
+        Deinit_TPM_Codec(&tpm_device);
     }
 
-    TEST_FUNCTION(TSS_StartAuthSession_succeed)
+    TEST_FUNCTION(TSS_CompleteStartup_started_succeed)
     {
         //arrange
-        TSS_DEVICE tss_dev = { 0 };
-        TPMA_SESSION sess_attrib = { 1 };
-        TSS_SESSION session;
-
-        (void)Initialize_TPM_Codec(&tss_dev);
-        umock_c_reset_all_calls();
-
-        setup_tss_start_auth_session_mocks();
+        TSS_DEVICE tpm_device = { 0 };
+        tpm_device.tpm_comm_handle = TEST_COMM_HANDLE;
 
         //act
-        TPM_RC result = TSS_StartAuthSession(&tss_dev, TPM_SE_POLICY, TPM_ALG_SHA256, sess_attrib, &session);
+        TPM_RC result = TSS_CompleteStartup(&tpm_device);
 
         //assert
         ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
@@ -514,30 +505,34 @@ BEGIN_TEST_SUITE(tpm_codec_ut)
         //cleanup
     }
 
-    TEST_FUNCTION(TSS_PolicySecret_tss_sesssion_NULL_fail)
+    TEST_FUNCTION(TSS_CompleteStartup_connection_fail)
     {
         //arrange
-        TSS_DEVICE tss_dev = { 0 };
-        TSS_SESSION session;
+        TSS_DEVICE tpm_device = { 0 };
+        tpm_device.DeferStartup = TRUE;
+        (void)Initialize_TPM_Codec(&tpm_device);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(tpm_comm_create(IGNORED_PTR_ARG)).SetReturn(NULL);
 
         //act
-        TPM_RC result = TSS_PolicySecret(&tss_dev, NULL, TPM_RH_ENDORSEMENT, &session, NULL, 0);
+        TPM_RC result = TSS_CompleteStartup(&tpm_device);
 
         //assert
         ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        // Retried by the next command
+        ASSERT_IS_TRUE(tpm_device.StartupPending);
         ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
         //cleanup
     }
 
-    TEST_FUNCTION(TSS_PolicySecret_policy_sesssion_NULL_fail)
+    TEST_FUNCTION(TSS_RefreshPropertyCache_tss_device_NULL_fail)
     {
         //arrange
-        TSS_DEVICE tss_dev = { 0 };
-        TSS_SESSION session;
 
         //act
-        TPM_RC result = TSS_PolicySecret(&tss_dev, &session, TPM_RH_ENDORSEMENT, NULL, NULL, 0);
+        TPM_RC result = TSS_RefreshPropertyCache(NULL);
 
         //assert
         ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
@@ -546,146 +541,1448 @@ BEGIN_TEST_SUITE(tpm_codec_ut)
         //cleanup
     }
 
-    TEST_FUNCTION(TSS_PolicySecret_succeed)
+    TEST_FUNCTION(TSS_RefreshPropertyCache_get_capability_fail)
     {
         //arrange
         TSS_DEVICE tss_dev = { 0 };
-        TSS_SESSION session = { 0 };
-
-        (void)Initialize_TPM_Codec(&tss_dev);
-        umock_c_reset_all_calls();
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+        tss_dev.PropCache.Valid = TRUE;
 
-        setup_tss_policy_secret_mocks();
+        setup_get_capability_mocks();
 
         //act
-        TPM_RC result = TSS_PolicySecret(&tss_dev, &session, TPM_RH_ENDORSEMENT, &session, NULL, 0);
+        TPM_RC result = TSS_RefreshPropertyCache(&tss_dev);
 
         //assert
-        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_IS_FALSE(tss_dev.PropCache.Valid);
         ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
         //cleanup
     }
 
-    TEST_FUNCTION(TPM2_ReadPublic_tss_device_NULL_fail)
+    TEST_FUNCTION(TSS_GetTpmProperty_cached_succeed)
     {
         //arrange
-        TPM_HANDLE request_handle = HR_PERSISTENT;
-        TPM2B_PUBLIC tpm_public;
-        TPM2B_NAME tpm_name;
-        TPM2B_NAME qualified_name;
+        TSS_DEVICE tss_dev = { 0 };
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+        tss_dev.PropCache.Valid = TRUE;
+        tss_dev.PropCache.Present = (UINT64)1 << (TPM_PT_INPUT_BUFFER - PT_FIXED);
+        tss_dev.PropCache.Value[TPM_PT_INPUT_BUFFER - PT_FIXED] = 1024;
 
         //act
-        TPM_RC result = TPM2_ReadPublic(NULL, request_handle, &tpm_public, &tpm_name, &qualified_name);
+        UINT32 result = TSS_GetTpmProperty(&tss_dev, TPM_PT_INPUT_BUFFER);
 
         //assert
-        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, 1024, result);
         ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
         //cleanup
     }
 
-    TEST_FUNCTION(TPM2_ReadPublic_tpm_public_NULL_fail)
+    TEST_FUNCTION(TSS_InvalidatePropertyCache_succeed)
     {
         //arrange
         TSS_DEVICE tss_dev = { 0 };
-        TPM_HANDLE request_handle = HR_PERSISTENT;
-        TPM2B_NAME tpm_name;
-        TPM2B_NAME qualified_name;
+        tss_dev.PropCache.Valid = TRUE;
+        tss_dev.PropCache.Present = (UINT64)1 << (TPM_PT_INPUT_BUFFER - PT_FIXED);
 
         //act
-        TPM_RC result = TPM2_ReadPublic(&tss_dev, request_handle, NULL, &tpm_name, &qualified_name);
+        TSS_InvalidatePropertyCache(&tss_dev);
 
         //assert
-        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_IS_FALSE(tss_dev.PropCache.Valid);
         ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
         //cleanup
     }
 
-    TEST_FUNCTION(TPM2_ReadPublic_succeed)
+    TEST_FUNCTION(Deinit_TPM_Codec_succeed)
     {
         //arrange
-        TSS_DEVICE tss_dev = { 0 };
-        TPM_HANDLE request_handle = HR_PERSISTENT;
-        TPM2B_PUBLIC tpm_public;
-        TPM2B_NAME tpm_name;
-        TPM2B_NAME qualified_name;
-
-        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+        TSS_DEVICE tpm_device = { 0 };
+        uint32_t expected_size = 4096;
+        uint32_t raw_resp = 4096;
 
+        STRICT_EXPECTED_CALL(tpm_comm_create(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_comm_needs_startup(IGNORED_PTR_ARG)).SetReturn(true);
         STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        setup_dispatch_cmd_mocks();
-        STRICT_EXPECTED_CALL(TPM2B_PUBLIC_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-        STRICT_EXPECTED_CALL(TPM2B_NAME_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(TPM2B_NAME_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_comm_submit_command(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPMI_ST_COMMAND_TAG_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_target(&expected_size, sizeof(expected_size));
+        STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_target(&raw_resp, sizeof(raw_resp));
+        (void)Initialize_TPM_Codec(&tpm_device);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(tpm_comm_destroy(IGNORED_PTR_ARG));
 
         //act
-        TPM_RC result = TPM2_ReadPublic(&tss_dev, request_handle, &tpm_public, &tpm_name, &qualified_name);
+        Deinit_TPM_Codec(&tpm_device);
 
         //assert
-        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
         ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
         //cleanup
     }
 
-    TEST_FUNCTION(TSS_HMAC_tss_device_NULL_Fail)
+    TEST_FUNCTION(Deinit_TPM_Codec_TPM_device_NULL)
     {
         //arrange
-        TSS_SESSION session;
-        TPMI_DH_OBJECT handle = TEST_TPMI_DH_OBJECT;
-        BYTE bt_data[10];
-        UINT32 data_len = 10;
-        TPM2B_DIGEST hmac;
-
 
         //act
-        TPM_RC result = TSS_HMAC(NULL, &session, handle, bt_data, data_len, &hmac);
+        Deinit_TPM_Codec(NULL);
 
         //assert
-        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
         ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
         //cleanup
     }
 
-    TEST_FUNCTION(TSS_HMAC_tss_session_NULL_Fail)
+    TEST_FUNCTION(TSS_SetCommandPriority_succeed)
     {
         //arrange
         TSS_DEVICE tss_dev = { 0 };
-        TPMI_DH_OBJECT handle = TEST_TPMI_DH_OBJECT;
-        BYTE bt_data[10];
-        UINT32 data_len = 10;
-        TPM2B_DIGEST hmac;
+        tss_dev.tpm_comm_handle = my_tpm_comm_create(NULL);
+
+        STRICT_EXPECTED_CALL(tpm_comm_set_priority(tss_dev.tpm_comm_handle, TPM_COMM_PRIORITY_HIGH)).SetReturn(0);
 
         //act
-        TPM_RC result = TSS_HMAC(&tss_dev, NULL, handle, bt_data, data_len, &hmac);
+        TPM_RC result = TSS_SetCommandPriority(&tss_dev, TPM_COMM_PRIORITY_HIGH);
 
         //assert
-        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
         ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
         //cleanup
+        my_tpm_comm_destroy(tss_dev.tpm_comm_handle);
     }
 
-    TEST_FUNCTION(TSS_HMAC_data_byte_NULL_Fail)
+    TEST_FUNCTION(TSS_SetCommandPriority_no_connection_fail)
     {
         //arrange
         TSS_DEVICE tss_dev = { 0 };
-        TSS_SESSION session;
-        TPMI_DH_OBJECT handle = TEST_TPMI_DH_OBJECT;
-        UINT32 data_len = 10;
-        TPM2B_DIGEST hmac;
 
+        //act
+        TPM_RC result = TSS_SetCommandPriority(&tss_dev, TPM_COMM_PRIORITY_HIGH);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_SetRetryPolicy_tpm_NULL_fail)
+    {
+        //arrange
+        TSS_RETRY_POLICY policy = { 3, 10, 40 };
+
+        //act
+        TPM_RC result = TSS_SetRetryPolicy(NULL, &policy);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_SetRetryPolicy_initial_delay_above_max_fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_RETRY_POLICY policy = { 3, 50, 40 };
+
+        //act
+        TPM_RC result = TSS_SetRetryPolicy(&tss_dev, &policy);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, 0, tss_dev.RetryPolicy.MaxRetries);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_SetRetryPolicy_NULL_disables_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_RETRY_POLICY policy = { 3, 10, 40 };
+        (void)TSS_SetRetryPolicy(&tss_dev, &policy);
+
+        //act
+        TPM_RC result = TSS_SetRetryPolicy(&tss_dev, NULL);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, 0, tss_dev.RetryPolicy.MaxRetries);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_create_persistent_key_success)
+    {
+        //arrange
+        TSS_SESSION session = { 0 };
+        TSS_DEVICE tss_dev = { 0 };
+        TPM_HANDLE request_handle = TPM_20_HANDLE;
+        TPMI_DH_OBJECT hierarchy = TPM_RH_ENDORSEMENT;
+        TPM2B_PUBLIC inPub = tpm_public_value;
+        TPM2B_PUBLIC outPub;
+
+        (void)Initialize_TPM_Codec(&tss_dev);
+        umock_c_reset_all_calls();
+
+        uint32_t expected_size = 4096;
+        uint32_t raw_resp = 4096;
+
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_comm_submit_command(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPMI_ST_COMMAND_TAG_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_target(&expected_size, sizeof(expected_size));
+        STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_target(&raw_resp, sizeof(raw_resp));
+        STRICT_EXPECTED_CALL(TPM2B_PUBLIC_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(TPM2B_NAME_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPM2B_NAME_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+        //act
+        TPM_HANDLE handle = TSS_CreatePersistentKey(&tss_dev, request_handle, &session, hierarchy, &inPub, &outPub);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, 0, handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_ProvisionIdentityKey_tss_device_NULL_fail)
+    {
+        //arrange
+        TSS_SESSION session = { 0 };
+        TSS_PROVISION_PARAMS params = { 0 };
+
+        //act
+        TPM_RC result = TSS_ProvisionIdentityKey(NULL, &session, &params);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_ProvisionIdentityKey_credential_NULL_fail)
+    {
+        //arrange
+        TSS_SESSION session = { 0 };
+        TSS_DEVICE tss_dev = { 0 };
+        TPM2B_PUBLIC idKeyPublic = tpm_public_value;
+        TPM2B_PRIVATE duplicate = { 0 };
+        TPM2B_ENCRYPTED_SECRET secret = { 0 };
+        TSS_PROVISION_PARAMS params = { 0 };
+        params.EncryptedSecret = &secret;
+        params.IdKeyPublic = &idKeyPublic;
+        params.DuplicateBlob = &duplicate;
+        params.EncryptedSeed = &secret;
+
+        //act
+        TPM_RC result = TSS_ProvisionIdentityKey(&tss_dev, &session, &params);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_ComputeObjectName_public_area_NULL_fail)
+    {
+        //arrange
+        TPM2B_NAME name;
+
+        //act
+        TPM_RC result = TSS_ComputeObjectName(NULL, &name);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_ComputeObjectName_name_alg_not_on_host_fail)
+    {
+        //arrange
+        TPM2B_PUBLIC inPub = tpm_public_value;
+        TPM2B_NAME name;
+        inPub.publicArea.nameAlg = TPM_ALG_SHA256;
+
+        STRICT_EXPECTED_CALL(tpm_host_hash_is_supported(TPM_ALG_SHA256)).SetReturn(false);
+
+        //act
+        TPM_RC result = TSS_ComputeObjectName(&inPub, &name);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_HASH, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_ComputeObjectName_succeed)
+    {
+        //arrange
+        TPM2B_PUBLIC inPub = tpm_public_value;
+        TPM2B_NAME name;
+        TPM2B_DIGEST digest = { 0 };
+        inPub.publicArea.nameAlg = TPM_ALG_SHA256;
+        digest.t.size = SHA256_DIGEST_SIZE;
+
+        STRICT_EXPECTED_CALL(tpm_host_hash_is_supported(TPM_ALG_SHA256)).SetReturn(true);
+        STRICT_EXPECTED_CALL(TPMT_PUBLIC_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(64);
+        STRICT_EXPECTED_CALL(tpm_host_hash(TPM_ALG_SHA256, IGNORED_PTR_ARG, 64, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_outHash(&digest, sizeof(digest))
+            .SetReturn(TPM_RC_SUCCESS);
+        STRICT_EXPECTED_CALL(MemoryCopy(IGNORED_PTR_ARG, IGNORED_PTR_ARG, SHA256_DIGEST_SIZE));
+
+        //act
+        TPM_RC result = TSS_ComputeObjectName(&inPub, &name);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, 2 + SHA256_DIGEST_SIZE, name.t.size);
+        ASSERT_ARE_EQUAL(int, 0x00, name.t.name[0]);
+        ASSERT_ARE_EQUAL(int, 0x0B, name.t.name[1]);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_StartAuthSession_tss_device_NULL_fail)
+    {
+        //arrange
+        TPMA_SESSION sess_attrib = { 1 };
+        TSS_SESSION session;
+
+        //act
+        TPM_RC result = TSS_StartAuthSession(NULL, TPM_SE_POLICY, TPM_ALG_SHA256, sess_attrib, &session);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_StartAuthSession_tss_session_NULL_fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TPMA_SESSION sess_attrib = { 1 };
+
+        //act
+        TPM_RC result = TSS_StartAuthSession(&tss_dev, TPM_SE_POLICY, TPM_ALG_SHA256, sess_attrib, NULL);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_StartAuthSession_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TPMA_SESSION sess_attrib = { 1 };
+        TSS_SESSION session;
+
+        (void)Initialize_TPM_Codec(&tss_dev);
+        tss_dev.EntropyPool.Available = TSS_ENTROPY_POOL_SIZE;
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(MemoryCopy(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(MemorySet(IGNORED_PTR_ARG, 0, IGNORED_NUM_ARG));
+        setup_tss_start_auth_session_mocks();
+
+        //act
+        TPM_RC result = TSS_StartAuthSession(&tss_dev, TPM_SE_POLICY, TPM_ALG_SHA256, sess_attrib, &session);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_GetRandomBytes_tss_device_NULL_fail)
+    {
+        //arrange
+        BYTE buffer[16];
+
+        //act
+        TPM_RC result = TSS_GetRandomBytes(NULL, buffer, sizeof(buffer));
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_GetRandomBytes_from_pool_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        BYTE buffer[16];
+        tss_dev.EntropyPool.Available = TSS_ENTROPY_POOL_SIZE;
+
+        STRICT_EXPECTED_CALL(MemoryCopy(buffer, tss_dev.EntropyPool.Bytes + TSS_ENTROPY_POOL_SIZE - sizeof(buffer), sizeof(buffer)));
+        STRICT_EXPECTED_CALL(MemorySet(tss_dev.EntropyPool.Bytes + TSS_ENTROPY_POOL_SIZE - sizeof(buffer), 0, sizeof(buffer)));
+
+        //act
+        TPM_RC result = TSS_GetRandomBytes(&tss_dev, buffer, sizeof(buffer));
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, TSS_ENTROPY_POOL_SIZE - sizeof(buffer), tss_dev.EntropyPool.Available);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_RefillEntropyPool_above_low_water_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        tss_dev.EntropyPool.Available = TSS_ENTROPY_POOL_LOW_WATER;
+
+        //act
+        TPM_RC result = TSS_RefillEntropyPool(&tss_dev);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, TSS_ENTROPY_POOL_LOW_WATER, tss_dev.EntropyPool.Available);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_Hash_large_data_on_host_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        BYTE data[MAX_DIGEST_BUFFER + 1] = { 0 };
+        TPM2B_DIGEST digest;
+
+        STRICT_EXPECTED_CALL(tpm_host_hash_is_supported(TPM_ALG_SHA256)).SetReturn(true);
+        STRICT_EXPECTED_CALL(tpm_host_hash(TPM_ALG_SHA256, data, sizeof(data), &digest)).SetReturn(TPM_RC_SUCCESS);
+
+        //act
+        TPM_RC result = TSS_Hash(&tss_dev, data, sizeof(data), TPM_ALG_SHA256, &digest);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_Hash_large_data_tpm_policy_fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        BYTE data[MAX_DIGEST_BUFFER + 1] = { 0 };
+        TPM2B_DIGEST digest;
+        tss_dev.HashPolicy = TSS_HASH_TPM;
+
+        //act
+        TPM_RC result = TSS_Hash(&tss_dev, data, sizeof(data), TPM_ALG_SHA256, &digest);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SIZE, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_PolicySecret_tss_sesssion_NULL_fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_SESSION session;
+
+        //act
+        TPM_RC result = TSS_PolicySecret(&tss_dev, NULL, TPM_RH_ENDORSEMENT, &session, NULL, 0);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_PolicySecret_policy_sesssion_NULL_fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_SESSION session;
+
+        //act
+        TPM_RC result = TSS_PolicySecret(&tss_dev, &session, TPM_RH_ENDORSEMENT, NULL, NULL, 0);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_PolicySecret_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_SESSION session = { 0 };
+
+        (void)Initialize_TPM_Codec(&tss_dev);
+        umock_c_reset_all_calls();
+
+        setup_tss_policy_secret_mocks();
+
+        //act
+        TPM_RC result = TSS_PolicySecret(&tss_dev, &session, TPM_RH_ENDORSEMENT, &session, NULL, 0);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TPM2_ReadPublic_tss_device_NULL_fail)
+    {
+        //arrange
+        TPM_HANDLE request_handle = HR_PERSISTENT;
+        TPM2B_PUBLIC tpm_public;
+        TPM2B_NAME tpm_name;
+        TPM2B_NAME qualified_name;
+
+        //act
+        TPM_RC result = TPM2_ReadPublic(NULL, request_handle, &tpm_public, &tpm_name, &qualified_name);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TPM2_ReadPublic_tpm_public_NULL_fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TPM_HANDLE request_handle = HR_PERSISTENT;
+        TPM2B_NAME tpm_name;
+        TPM2B_NAME qualified_name;
+
+        //act
+        TPM_RC result = TPM2_ReadPublic(&tss_dev, request_handle, NULL, &tpm_name, &qualified_name);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TPM2_ReadPublic_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TPM_HANDLE request_handle = HR_PERSISTENT;
+        TPM2B_PUBLIC tpm_public;
+        TPM2B_NAME tpm_name;
+        TPM2B_NAME qualified_name;
+
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        setup_dispatch_cmd_mocks();
+        STRICT_EXPECTED_CALL(TPM2B_PUBLIC_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(TPM2B_NAME_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPM2B_NAME_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+        //act
+        TPM_RC result = TPM2_ReadPublic(&tss_dev, request_handle, &tpm_public, &tpm_name, &qualified_name);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TPM2_ReadPublic_uses_device_command_context_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_DEVICE other_dev = { 0 };
+        TPM_HANDLE request_handle = HR_PERSISTENT;
+        TPM2B_PUBLIC tpm_public;
+        TPM2B_NAME tpm_name;
+        TPM2B_NAME qualified_name;
+
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+        other_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        setup_dispatch_cmd_mocks();
+        STRICT_EXPECTED_CALL(TPM2B_PUBLIC_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(TPM2B_NAME_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPM2B_NAME_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+        //act
+        TPM_RC result = TPM2_ReadPublic(&tss_dev, request_handle, &tpm_public, &tpm_name, &qualified_name);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, sizeof(tss_dev.CmdCtx.RespBuffer), tss_dev.CmdCtx.RespSize);
+        ASSERT_ARE_EQUAL(uint32_t, 0, other_dev.CmdCtx.RespSize);
+        ASSERT_IS_NULL(other_dev.CmdCtx.RespBufPtr);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TPM2_ReadPublic_View_name_NULL_fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_2B_VIEW pub_view;
+        TSS_2B_VIEW qualified_name;
+
+        //act
+        TPM_RC result = TPM2_ReadPublic_View(&tss_dev, HR_PERSISTENT, &pub_view, NULL, &qualified_name);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TPM2_ReadPublic_View_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        UINT16 pub_size = 90;
+        UINT16 name_size = 34;
+        TSS_2B_VIEW pub_view;
+        TSS_2B_VIEW name;
+        TSS_2B_VIEW qualified_name;
+
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        setup_dispatch_cmd_mocks();
+        STRICT_EXPECTED_CALL(UINT16_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_target(&pub_size, sizeof(pub_size));
+        STRICT_EXPECTED_CALL(UINT16_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_target(&name_size, sizeof(name_size));
+        STRICT_EXPECTED_CALL(UINT16_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_target(&name_size, sizeof(name_size));
+
+        //act
+        TPM_RC result = TPM2_ReadPublic_View(&tss_dev, HR_PERSISTENT, &pub_view, &name, &qualified_name);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, 90, pub_view.Size);
+        ASSERT_ARE_EQUAL(uint32_t, 34, name.Size);
+        ASSERT_ARE_EQUAL(uint32_t, 34, qualified_name.Size);
+        ASSERT_IS_TRUE(name.Buffer == pub_view.Buffer + pub_view.Size + sizeof(UINT16));
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_HMAC_tss_device_NULL_Fail)
+    {
+        //arrange
+        TSS_SESSION session;
+        TPMI_DH_OBJECT handle = TEST_TPMI_DH_OBJECT;
+        BYTE bt_data[10];
+        UINT32 data_len = 10;
+        TPM2B_DIGEST hmac;
+
+
+        //act
+        TPM_RC result = TSS_HMAC(NULL, &session, handle, bt_data, data_len, &hmac);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_HMAC_exceeds_cached_input_buffer_fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_SESSION session;
+        TPMI_DH_OBJECT handle = TEST_TPMI_DH_OBJECT;
+        BYTE bt_data[10];
+        UINT32 data_len = 10;
+        TPM2B_DIGEST hmac;
+
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+        tss_dev.PropCache.Valid = TRUE;
+        tss_dev.PropCache.Present = (UINT64)1 << (TPM_PT_INPUT_BUFFER - PT_FIXED);
+        tss_dev.PropCache.Value[TPM_PT_INPUT_BUFFER - PT_FIXED] = 8;
+
+        //act
+        TPM_RC result = TSS_HMAC(&tss_dev, &session, handle, bt_data, data_len, &hmac);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SIZE, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_HMAC_tss_session_NULL_Fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TPMI_DH_OBJECT handle = TEST_TPMI_DH_OBJECT;
+        BYTE bt_data[10];
+        UINT32 data_len = 10;
+        TPM2B_DIGEST hmac;
+
+        //act
+        TPM_RC result = TSS_HMAC(&tss_dev, NULL, handle, bt_data, data_len, &hmac);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_HMAC_data_byte_NULL_Fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_SESSION session;
+        TPMI_DH_OBJECT handle = TEST_TPMI_DH_OBJECT;
+        UINT32 data_len = 10;
+        TPM2B_DIGEST hmac;
+
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+
+        //act
+        TPM_RC result = TSS_HMAC(&tss_dev, &session, handle, NULL, data_len, &hmac);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_HMAC_outHMAC_NULL_Fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_SESSION session;
+        TPMI_DH_OBJECT handle = TEST_TPMI_DH_OBJECT;
+        BYTE bt_data[10];
+        UINT32 data_len = 10;
+
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+
+        //act
+        TPM_RC result = TSS_HMAC(&tss_dev, &session, handle, bt_data, data_len, NULL);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_HMAC_byte_len_too_big_Fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_SESSION session;
+        TPMI_DH_OBJECT handle = TEST_TPMI_DH_OBJECT;
+        BYTE bt_data[10];
+        UINT32 data_len = MAX_DIGEST_BUFFER + 1;
+        TPM2B_DIGEST hmac;
+
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+
+        //act
+        TPM_RC result = TSS_HMAC(&tss_dev, &session, handle, bt_data, data_len, &hmac);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_HMAC_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_SESSION session;
+        TPMI_DH_OBJECT handle = TEST_TPMI_DH_OBJECT;
+        BYTE bt_data[10];
+        UINT32 data_len = 10;
+        TPM2B_DIGEST hmac;
+
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPMS_AUTH_COMMAND_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+        // data is marshaled straight from the caller's buffer
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(BYTE_Array_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        setup_dispatch_cmd_mocks();
+        STRICT_EXPECTED_CALL(UINT16_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(MemoryCopy(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+
+        //act
+        TPM_RC result = TSS_HMAC(&tss_dev, &session, handle, bt_data, data_len, &hmac);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_HMAC_View_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_SESSION session;
+        TPMI_DH_OBJECT handle = TEST_TPMI_DH_OBJECT;
+        BYTE bt_data[10];
+        UINT16 hmac_size = 32;
+        TSS_2B_VIEW hmac;
+
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPMS_AUTH_COMMAND_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(BYTE_Array_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        setup_dispatch_cmd_mocks();
+        STRICT_EXPECTED_CALL(UINT16_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_target(&hmac_size, sizeof(hmac_size));
+
+        //act
+        TPM_RC result = TSS_HMAC_View(&tss_dev, &session, handle, bt_data, sizeof(bt_data), &hmac);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, 32, hmac.Size);
+        ASSERT_IS_TRUE(hmac.Buffer >= tss_dev.CmdCtx.RespBuffer);
+        ASSERT_IS_TRUE(hmac.Buffer + hmac.Size <= tss_dev.CmdCtx.RespBuffer + sizeof(tss_dev.CmdCtx.RespBuffer));
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_HMAC_View_size_too_big_fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_SESSION session;
+        TPMI_DH_OBJECT handle = TEST_TPMI_DH_OBJECT;
+        BYTE bt_data[10];
+        UINT16 hmac_size = sizeof(TPMU_HA) + 1;
+        TSS_2B_VIEW hmac;
+
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPMS_AUTH_COMMAND_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(BYTE_Array_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        setup_dispatch_cmd_mocks();
+        STRICT_EXPECTED_CALL(UINT16_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_target(&hmac_size, sizeof(hmac_size));
+
+        //act
+        TPM_RC result = TSS_HMAC_View(&tss_dev, &session, handle, bt_data, sizeof(bt_data), &hmac);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    static void setup_sign_data_hmac_mocks(void)
+    {
+        UINT16 hmac_size = 32;
+
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPMS_AUTH_COMMAND_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(BYTE_Array_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        setup_dispatch_cmd_mocks();
+        STRICT_EXPECTED_CALL(UINT16_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_target(&hmac_size, sizeof(hmac_size));
+        STRICT_EXPECTED_CALL(MemoryCopy(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    }
+
+    TEST_FUNCTION(SignDataBatch_tss_device_NULL_fail)
+    {
+        //arrange
+        TSS_SESSION session;
+        BYTE bt_data[10];
+        BYTE signature[32];
+        TSS_SIGN_DATA_ITEM item = { bt_data, sizeof(bt_data), signature, sizeof(signature), 0, 0 };
+
+        //act
+        UINT32 result = SignDataBatch(NULL, &session, &item, 1);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(SignDataBatch_signature_buffer_too_small_fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_SESSION session;
+        BYTE bt_data[10];
+        BYTE signature[16];
+        TSS_SIGN_DATA_ITEM item = { bt_data, sizeof(bt_data), signature, sizeof(signature), 0, 0 };
+
+        session.SessIn.sessionHandle = HMAC_SESSION_FIRST;
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+        tss_dev.PropCache.Valid = TRUE;
+        tss_dev.PropCache.Present = (UINT64)1 << (TPM_PT_INPUT_BUFFER - PT_FIXED);
+        tss_dev.PropCache.Value[TPM_PT_INPUT_BUFFER - PT_FIXED] = 1024;
+
+        //act
+        UINT32 result = SignDataBatch(&tss_dev, &session, &item, 1);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, 0, result);
+        ASSERT_ARE_EQUAL(uint32_t, 32, item.SignatureSize);
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SIZE, item.RawResponse);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(SignDataBatch_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_SESSION session;
+        BYTE bt_data[10];
+        BYTE signature1[32];
+        BYTE signature2[32];
+        TSS_SIGN_DATA_ITEM items[2] =
+        {
+            { bt_data, sizeof(bt_data), signature1, sizeof(signature1), 0, 0 },
+            { bt_data, sizeof(bt_data), signature2, sizeof(signature2), 0, 0 }
+        };
+
+        session.SessIn.sessionHandle = HMAC_SESSION_FIRST;
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+        tss_dev.PropCache.Valid = TRUE;
+        tss_dev.PropCache.Present = (UINT64)1 << (TPM_PT_INPUT_BUFFER - PT_FIXED);
+        tss_dev.PropCache.Value[TPM_PT_INPUT_BUFFER - PT_FIXED] = 1024;
+
+        setup_sign_data_hmac_mocks();
+        setup_sign_data_hmac_mocks();
+
+        //act
+        UINT32 result = SignDataBatch(&tss_dev, &session, items, 2);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, 2, result);
+        ASSERT_ARE_EQUAL(uint32_t, 32, items[0].SignatureSize);
+        ASSERT_ARE_EQUAL(uint32_t, 32, items[1].SignatureSize);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(SignData_steady_state_no_allocation_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_SESSION session;
+        BYTE bt_data[10];
+        BYTE signature[32];
+        size_t index;
+
+        session.SessIn.sessionHandle = HMAC_SESSION_FIRST;
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+        tss_dev.PropCache.Valid = TRUE;
+        tss_dev.PropCache.Present = (UINT64)1 << (TPM_PT_INPUT_BUFFER - PT_FIXED);
+        tss_dev.PropCache.Value[TPM_PT_INPUT_BUFFER - PT_FIXED] = 1024;
+
+        for (index = 0; index < 3; index++)
+        {
+            setup_sign_data_hmac_mocks();
+        }
+
+        //act
+        for (index = 0; index < 3; index++)
+        {
+            ASSERT_ARE_EQUAL(uint32_t, 32, SignData(&tss_dev, &session, bt_data, sizeof(bt_data), signature, sizeof(signature)));
+        }
+
+        //assert
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_IS_NULL(strstr(umock_c_get_actual_calls(), "gballoc_"));
+
+        //cleanup
+    }
+
+    static void setup_session_command_header_mocks(void)
+    {
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPMS_AUTH_COMMAND_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    }
+
+    static void setup_compiled_hmac_mocks(void)
+    {
+        UINT16 hmac_size = 32;
+
+        // header and data copies, then only the command size is marshaled
+        STRICT_EXPECTED_CALL(MemoryCopy(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(MemoryCopy(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        setup_dispatch_cmd_mocks();
+        STRICT_EXPECTED_CALL(UINT16_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_target(&hmac_size, sizeof(hmac_size));
+    }
+
+    TEST_FUNCTION(TSS_CompileCommand_template_NULL_fail)
+    {
+        //arrange
+        TSS_SESSION session;
+        TSS_SESSION* sessions[1] = { &session };
+        TPM_HANDLE handle = TEST_TPMI_DH_OBJECT;
+
+        session.SessIn.sessionHandle = TPM_RS_PW;
+
+        //act
+        TPM_RC result = TSS_CompileCommand(TPM_CC_HMAC, &handle, 1, sessions, 1, NULL);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_FAILURE, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_CompileCommand_hmac_session_fail)
+    {
+        //arrange
+        TSS_SESSION session;
+        TSS_SESSION* sessions[1] = { &session };
+        TPM_HANDLE handle = TEST_TPMI_DH_OBJECT;
+        TSS_CMD_TEMPLATE cmd_template;
+
+        session.SessIn.sessionHandle = HMAC_SESSION_FIRST;
+
+        //act
+        TPM_RC result = TSS_CompileCommand(TPM_CC_HMAC, &handle, 1, sessions, 1, &cmd_template);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_AUTH_TYPE, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_CompileCommand_succeed)
+    {
+        //arrange
+        TSS_SESSION session;
+        TSS_SESSION* sessions[1] = { &session };
+        TPM_HANDLE handle = TEST_TPMI_DH_OBJECT;
+        TSS_CMD_TEMPLATE cmd_template;
+
+        session.SessIn.sessionHandle = TPM_RS_PW;
+
+        setup_session_command_header_mocks();
+
+        //act
+        TPM_RC result = TSS_CompileCommand(TPM_CC_HMAC, &handle, 1, sessions, 1, &cmd_template);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, TPM_CC_HMAC, cmd_template.CmdCode);
+        ASSERT_ARE_EQUAL(uint32_t, 1, cmd_template.NumHandles);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_HMAC_Compiled_wrong_command_fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_CMD_TEMPLATE cmd_template = { 0 };
+        BYTE bt_data[10];
+        TSS_2B_VIEW hmac;
+
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+        cmd_template.CmdCode = TPM_CC_Hash;
+        cmd_template.NumHandles = 1;
+
+        //act
+        TPM_RC result = TSS_HMAC_Compiled(&tss_dev, &cmd_template, bt_data, sizeof(bt_data), &hmac);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_FAILURE, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_HMAC_Compiled_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_CMD_TEMPLATE cmd_template = { 0 };
+        BYTE bt_data[10];
+        TSS_2B_VIEW hmac;
+
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+        cmd_template.CmdCode = TPM_CC_HMAC;
+        cmd_template.NumHandles = 1;
+
+        setup_compiled_hmac_mocks();
+
+        //act
+        TPM_RC result = TSS_HMAC_Compiled(&tss_dev, &cmd_template, bt_data, sizeof(bt_data), &hmac);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, 32, hmac.Size);
+        ASSERT_ARE_EQUAL(uint32_t, sizeof(UINT16) + sizeof(bt_data) + sizeof(TPMI_ALG_HASH), tss_dev.CmdCtx.ParamSize);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_DispatchCompiled_params_too_big_fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_CMD_TEMPLATE cmd_template = { 0 };
+        BYTE bt_data[10];
+
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+        cmd_template.CmdCode = TPM_CC_HMAC;
+        cmd_template.HeaderSize = 32;
+
+        //act
+        TPM_RC result = TSS_DispatchCompiled(&tss_dev, &cmd_template, bt_data, MAX_COMMAND_BUFFER);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SIZE, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(SignDataBatch_password_session_compiles_once_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_SESSION session;
+        BYTE bt_data[10];
+        BYTE signature1[32];
+        BYTE signature2[32];
+        TSS_SIGN_DATA_ITEM items[2] =
+        {
+            { bt_data, sizeof(bt_data), signature1, sizeof(signature1), 0, 0 },
+            { bt_data, sizeof(bt_data), signature2, sizeof(signature2), 0, 0 }
+        };
+
+        session.SessIn.sessionHandle = TPM_RS_PW;
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+        tss_dev.PropCache.Valid = TRUE;
+        tss_dev.PropCache.Present = (UINT64)1 << (TPM_PT_INPUT_BUFFER - PT_FIXED);
+        tss_dev.PropCache.Value[TPM_PT_INPUT_BUFFER - PT_FIXED] = 1024;
+
+        setup_session_command_header_mocks();
+        setup_compiled_hmac_mocks();
+        STRICT_EXPECTED_CALL(MemoryCopy(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        setup_compiled_hmac_mocks();
+        STRICT_EXPECTED_CALL(MemoryCopy(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+
+        //act
+        UINT32 result = SignDataBatch(&tss_dev, &session, items, 2);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, 2, result);
+        ASSERT_ARE_EQUAL(uint32_t, 32, items[0].SignatureSize);
+        ASSERT_ARE_EQUAL(uint32_t, 32, items[1].SignatureSize);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_HmacSequence_tss_device_NULL_fail)
+    {
+        //arrange
+        TSS_SESSION session;
+        BYTE bt_data[10];
+        TPM2B_DIGEST hmac;
+
+        //act
+        TPM_RC result = TSS_HmacSequence(NULL, &session, TEST_TPMI_DH_OBJECT, TPM_ALG_SHA256, bt_data, sizeof(bt_data), &hmac);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_HmacSequence_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_SESSION session;
+        BYTE bt_data[10];
+        TPM2B_DIGEST hmac;
+
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+        tss_dev.PropCache.Valid = TRUE;
+        tss_dev.PropCache.Present = (UINT64)1 << (TPM_PT_INPUT_BUFFER - PT_FIXED);
+        tss_dev.PropCache.Value[TPM_PT_INPUT_BUFFER - PT_FIXED] = 1024;
+
+        // TPM2_HMAC_Start
+        setup_session_command_header_mocks();
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        setup_dispatch_cmd_mocks();
+
+        // SequenceComplete, marshaled straight from the caller's buffer
+        setup_session_command_header_mocks();
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(BYTE_Array_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        setup_dispatch_cmd_mocks();
+        STRICT_EXPECTED_CALL(TPM2B_DIGEST_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPMT_TK_HASHCHECK_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+        //act
+        TPM_RC result = TSS_HmacSequence(&tss_dev, &session, TEST_TPMI_DH_OBJECT, TPM_ALG_SHA256, bt_data, sizeof(bt_data), &hmac);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TPM2_HMAC_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_SESSION session;
+        TPMI_DH_OBJECT handle = TEST_TPMI_DH_OBJECT;
+        BYTE bt_data[10];
+        TPM2B_MAX_BUFFER dataBuf;
+        dataBuf.b.size = 10;
+        MemoryCopy(dataBuf.t.buffer, bt_data, 10);
+        TPM2B_DIGEST hmac;
+        umock_c_reset_all_calls();
+
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPMS_AUTH_COMMAND_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+        STRICT_EXPECTED_CALL(TPM2B_MAX_BUFFER_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        setup_dispatch_cmd_mocks();
+        STRICT_EXPECTED_CALL(TPM2B_DIGEST_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+        //act
+        TPM_RC result = TPM2_HMAC(&tss_dev, &session, handle, &dataBuf, TPM_ALG_NULL, &hmac);
+
+        //assert
+        //ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        (void)result;
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TPM2_HMAC_deferred_startup_on_first_command_succeed)
+    {
+        //arrange
+        TSS_DEVICE tpm_device = { 0 };
+        TSS_SESSION session;
+        TPMI_DH_OBJECT handle = TEST_TPMI_DH_OBJECT;
+        TPM2B_MAX_BUFFER dataBuf;
+        TPM2B_DIGEST hmac;
+
+        dataBuf.b.size = 10;
+        memset(dataBuf.t.buffer, 0, dataBuf.b.size);
+        session.SessIn.sessionHandle = HMAC_SESSION_FIRST;
+        tpm_device.DeferStartup = TRUE;
+        (void)Initialize_TPM_Codec(&tpm_device);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(tpm_comm_create(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_comm_needs_startup(IGNORED_PTR_ARG)).SetReturn(false);
+        // Only the loaded sessions are enumerated, the properties and the
+        // persistent handles are left to be read on demand
+        setup_get_capability_mocks();
+        setup_session_command_header_mocks();
+        STRICT_EXPECTED_CALL(TPM2B_MAX_BUFFER_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        setup_dispatch_cmd_mocks();
+        STRICT_EXPECTED_CALL(TPM2B_DIGEST_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+        //act
+        (void)TPM2_HMAC(&tpm_device, &session, handle, &dataBuf, TPM_ALG_NULL, &hmac);
+
+        //assert
+        ASSERT_IS_FALSE(tpm_device.StartupPending);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        Deinit_TPM_Codec(&tpm_device);
+    }
+
+    TEST_FUNCTION(TPM2_HMAC_steady_state_no_allocation_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_SESSION session;
+        TPMI_DH_OBJECT handle = TEST_TPMI_DH_OBJECT;
+        TPM2B_MAX_BUFFER dataBuf;
+        TPM2B_DIGEST hmac;
+        size_t index;
+
+        dataBuf.b.size = 10;
+        memset(dataBuf.t.buffer, 0, dataBuf.b.size);
+        session.SessIn.sessionHandle = HMAC_SESSION_FIRST;
         tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
 
+        for (index = 0; index < 3; index++)
+        {
+            setup_session_command_header_mocks();
+            STRICT_EXPECTED_CALL(TPM2B_MAX_BUFFER_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+            STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+            STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+            setup_dispatch_cmd_mocks();
+            STRICT_EXPECTED_CALL(TPM2B_DIGEST_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        }
+
+        //act
+        for (index = 0; index < 3; index++)
+        {
+            (void)TPM2_HMAC(&tss_dev, &session, handle, &dataBuf, TPM_ALG_NULL, &hmac);
+        }
+
+        //assert
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_IS_NULL(strstr(umock_c_get_actual_calls(), "gballoc_"));
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_AcquireSession_tpm_NULL_fail)
+    {
+        //arrange
+        TSS_SESSION* session;
+
         //act
-        TPM_RC result = TSS_HMAC(&tss_dev, &session, handle, NULL, data_len, &hmac);
+        TPM_RC result = TSS_AcquireSession(NULL, TPM_SE_POLICY, TPM_ALG_SHA256, &session);
 
         //assert
         ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
@@ -694,41 +1991,79 @@ BEGIN_TEST_SUITE(tpm_codec_ut)
         //cleanup
     }
 
-    TEST_FUNCTION(TSS_HMAC_outHMAC_NULL_Fail)
+    TEST_FUNCTION(TSS_AcquireSession_reuse_idle_session_succeed)
     {
         //arrange
         TSS_DEVICE tss_dev = { 0 };
-        TSS_SESSION session;
-        TPMI_DH_OBJECT handle = TEST_TPMI_DH_OBJECT;
-        BYTE bt_data[10];
-        UINT32 data_len = 10;
+        TSS_SESSION* session = NULL;
+        tss_dev.SessionPool.Limit = 1;
+        tss_dev.SessionPool.Sessions[0].Loaded = TRUE;
+        tss_dev.SessionPool.Sessions[0].SessionType = TPM_SE_HMAC;
+        tss_dev.SessionPool.Sessions[0].AuthHash = TPM_ALG_SHA256;
 
-        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+        //act
+        TPM_RC result = TSS_AcquireSession(&tss_dev, TPM_SE_HMAC, TPM_ALG_SHA256, &session);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_IS_TRUE(session == &tss_dev.SessionPool.Sessions[0].Session);
+        ASSERT_IS_TRUE(tss_dev.SessionPool.Sessions[0].InUse);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_AcquireSession_pool_exhausted_fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_SESSION* session = NULL;
+        tss_dev.SessionPool.Limit = 1;
+        tss_dev.SessionPool.Sessions[0].Loaded = TRUE;
+        tss_dev.SessionPool.Sessions[0].InUse = TRUE;
+        tss_dev.SessionPool.Sessions[0].SessionType = TPM_SE_HMAC;
+        tss_dev.SessionPool.Sessions[0].AuthHash = TPM_ALG_SHA256;
 
         //act
-        TPM_RC result = TSS_HMAC(&tss_dev, &session, handle, bt_data, data_len, NULL);
+        TPM_RC result = TSS_AcquireSession(&tss_dev, TPM_SE_HMAC, TPM_ALG_SHA256, &session);
 
         //assert
-        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SESSION_MEMORY, result);
+        ASSERT_IS_NULL(session);
         ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
         //cleanup
     }
 
-    TEST_FUNCTION(TSS_HMAC_byte_len_too_big_Fail)
+    TEST_FUNCTION(TSS_ReleaseSession_session_lost_succeed)
     {
         //arrange
         TSS_DEVICE tss_dev = { 0 };
-        TSS_SESSION session;
-        TPMI_DH_OBJECT handle = TEST_TPMI_DH_OBJECT;
-        BYTE bt_data[10];
-        UINT32 data_len = MAX_DIGEST_BUFFER + 1;
-        TPM2B_DIGEST hmac;
+        tss_dev.SessionPool.Limit = 1;
+        tss_dev.SessionPool.Sessions[0].Loaded = TRUE;
+        tss_dev.SessionPool.Sessions[0].InUse = TRUE;
+        tss_dev.SessionPool.Sessions[0].Session.SessIn.sessionAttributes.continueSession = SET;
 
-        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+        //act
+        TSS_ReleaseSession(&tss_dev, &tss_dev.SessionPool.Sessions[0].Session, TPM_RC_REFERENCE_S0);
+
+        //assert
+        ASSERT_IS_FALSE(tss_dev.SessionPool.Sessions[0].InUse);
+        ASSERT_IS_TRUE(tss_dev.SessionPool.Sessions[0].Loaded);
+        ASSERT_IS_TRUE(tss_dev.SessionPool.Sessions[0].Stale);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_IsPersistentHandlePresent_not_valid_fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        BOOL present = TRUE;
 
         //act
-        TPM_RC result = TSS_HMAC(&tss_dev, &session, handle, bt_data, data_len, &hmac);
+        TPM_RC result = TSS_IsPersistentHandlePresent(&tss_dev, TPM_20_HANDLE, &present);
 
         //assert
         ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
@@ -737,83 +2072,352 @@ BEGIN_TEST_SUITE(tpm_codec_ut)
         //cleanup
     }
 
-    TEST_FUNCTION(TSS_HMAC_succeed)
+    TEST_FUNCTION(TSS_IsPersistentHandlePresent_succeed)
     {
         //arrange
         TSS_DEVICE tss_dev = { 0 };
-        TSS_SESSION session;
-        TPMI_DH_OBJECT handle = TEST_TPMI_DH_OBJECT;
-        BYTE bt_data[10];
-        UINT32 data_len = 10;
-        TPM2B_DIGEST hmac;
+        BOOL present = FALSE;
+        BOOL absent = TRUE;
+        tss_dev.PersistentHandles.Valid = TRUE;
+        tss_dev.PersistentHandles.Count = 1;
+        tss_dev.PersistentHandles.Handles[0] = TPM_20_HANDLE;
 
-        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+        //act
+        TPM_RC result = TSS_IsPersistentHandlePresent(&tss_dev, TPM_20_HANDLE, &present);
+        TPM_RC result2 = TSS_IsPersistentHandlePresent(&tss_dev, TPM_20_HANDLE + 1, &absent);
 
-        STRICT_EXPECTED_CALL(MemoryCopy(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result2);
+        ASSERT_IS_TRUE(present);
+        ASSERT_IS_FALSE(absent);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
-        // TSS_MARSHAL_OPT2B
-        STRICT_EXPECTED_CALL(TPM2B_MAX_BUFFER_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        //cleanup
+    }
 
-        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    TEST_FUNCTION(TSS_GetCommandStats_cmd_code_invalid_fail)
+    {
+        //arrange
+        TSS_CMD_STATS cmd_stats = { 0 };
+
+        //act
+        const TSS_CMD_STATS_ENTRY* result = TSS_GetCommandStats(&cmd_stats, TSS_CMD_CODE_LAST + 1);
+
+        //assert
+        ASSERT_IS_NULL(result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_SetCommandStats_records_command_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_CMD_STATS cmd_stats = { 0 };
+        TPM_HANDLE request_handle = HR_PERSISTENT;
+        TPM2B_PUBLIC tpm_public;
+        TPM2B_NAME tpm_name;
+        TPM2B_NAME qualified_name;
+        uint32_t expected_size = 4096;
+        uint32_t raw_resp = TPM_RC_SUCCESS;
+
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+        TSS_SetCommandStats(&tss_dev, &cmd_stats);
+        TSS_SetTraceCallback(&tss_dev, on_cmd_trace, NULL);
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns()).SetReturn(100);
         STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns()).SetReturn(400);
+        STRICT_EXPECTED_CALL(tpm_comm_submit_command(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns()).SetReturn(1400);
+        STRICT_EXPECTED_CALL(TPMI_ST_COMMAND_TAG_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_target(&expected_size, sizeof(expected_size));
+        STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_target(&raw_resp, sizeof(raw_resp));
+        STRICT_EXPECTED_CALL(TPM2B_PUBLIC_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(TPM2B_NAME_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPM2B_NAME_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
 
-        STRICT_EXPECTED_CALL(TPMS_AUTH_COMMAND_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        //act
+        TPM_RC result = TPM2_ReadPublic(&tss_dev, request_handle, &tpm_public, &tpm_name, &qualified_name);
+        const TSS_CMD_STATS_ENTRY* entry = TSS_GetCommandStats(&cmd_stats, TPM_CC_ReadPublic);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(size_t, 1, g_trace_call_count);
+        ASSERT_ARE_EQUAL(uint32_t, TPM_CC_ReadPublic, g_last_trace.CmdCode);
+        ASSERT_ARE_EQUAL(int, TSS_RC_CLASS_SUCCESS, g_last_trace.ResponseClass);
+        ASSERT_ARE_EQUAL(uint64_t, 300, g_last_trace.MarshalTime);
+        ASSERT_ARE_EQUAL(uint64_t, 1000, g_last_trace.TransportTime);
+        ASSERT_IS_NOT_NULL(entry);
+        ASSERT_ARE_EQUAL(uint64_t, 1, entry->Count);
+        ASSERT_ARE_EQUAL(uint64_t, 4096, entry->BytesIn);
+        ASSERT_ARE_EQUAL(uint64_t, 1000, entry->TransportTime);
+        ASSERT_ARE_EQUAL(uint64_t, 1, entry->ResponseClasses[TSS_RC_CLASS_SUCCESS]);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_SetTranscript_records_command_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TPM_HANDLE request_handle = HR_PERSISTENT;
+        TPM2B_PUBLIC tpm_public;
+        TPM2B_NAME tpm_name;
+        TPM2B_NAME qualified_name;
+        uint32_t expected_size = 4096;
+        uint32_t raw_resp = TPM_RC_SUCCESS;
+
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+        TSS_SetTranscript(&tss_dev, TEST_TRANSCRIPT);
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        setup_dispatch_cmd_mocks();
-        STRICT_EXPECTED_CALL(TPM2B_DIGEST_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_transcript_write_command(TEST_TRANSCRIPT, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns()).SetReturn(400);
+        STRICT_EXPECTED_CALL(tpm_comm_submit_command(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns()).SetReturn(1400);
+        STRICT_EXPECTED_CALL(tpm_transcript_write_response(TEST_TRANSCRIPT, IGNORED_PTR_ARG, IGNORED_NUM_ARG, 1000));
+        STRICT_EXPECTED_CALL(TPMI_ST_COMMAND_TAG_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_target(&expected_size, sizeof(expected_size));
+        STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_target(&raw_resp, sizeof(raw_resp));
+        STRICT_EXPECTED_CALL(TPM2B_PUBLIC_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(TPM2B_NAME_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPM2B_NAME_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
 
         //act
-        TPM_RC result = TSS_HMAC(&tss_dev, &session, handle, bt_data, data_len, &hmac);
+        TPM_RC result = TPM2_ReadPublic(&tss_dev, request_handle, &tpm_public, &tpm_name, &qualified_name);
 
         //assert
         ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
         ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(void_ptr, TEST_TRANSCRIPT, tss_dev.Transcript);
 
         //cleanup
     }
 
-    TEST_FUNCTION(TPM2_HMAC_succeed)
+    TEST_FUNCTION(TSS_SetTranscript_write_fail_detaches)
     {
         //arrange
         TSS_DEVICE tss_dev = { 0 };
-        TSS_SESSION session;
-        TPMI_DH_OBJECT handle = TEST_TPMI_DH_OBJECT;
-        BYTE bt_data[10];
-        TPM2B_MAX_BUFFER dataBuf;
-        dataBuf.b.size = 10;
-        MemoryCopy(dataBuf.t.buffer, bt_data, 10);
-        TPM2B_DIGEST hmac;
-        umock_c_reset_all_calls();
+        TPM_HANDLE request_handle = HR_PERSISTENT;
+        TPM2B_PUBLIC tpm_public;
+        TPM2B_NAME tpm_name;
+        TPM2B_NAME qualified_name;
 
         tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+        TSS_SetTranscript(&tss_dev, TEST_TRANSCRIPT);
 
-        STRICT_EXPECTED_CALL(TPM2B_MAX_BUFFER_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_transcript_write_command(TEST_TRANSCRIPT, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+            .SetReturn(__LINE__);
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_comm_submit_command(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .SetReturn(__LINE__);
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+
+        //act
+        TPM_RC result = TPM2_ReadPublic(&tss_dev, request_handle, &tpm_public, &tpm_name, &qualified_name);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_IS_NULL(tss_dev.Transcript);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TSS_SetCommandStats_transport_failure_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_CMD_STATS cmd_stats = { 0 };
+        TPM_HANDLE request_handle = HR_PERSISTENT;
+        TPM2B_PUBLIC tpm_public;
+        TPM2B_NAME tpm_name;
+        TPM2B_NAME qualified_name;
+
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+        TSS_SetCommandStats(&tss_dev, &cmd_stats);
 
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
         STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_comm_submit_command(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .SetReturn(__LINE__);
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+
+        //act
+        TPM_RC result = TPM2_ReadPublic(&tss_dev, request_handle, &tpm_public, &tpm_name, &qualified_name);
+        const TSS_CMD_STATS_ENTRY* entry = TSS_GetCommandStats(&cmd_stats, TPM_CC_ReadPublic);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(size_t, 0, g_trace_call_count);
+        ASSERT_ARE_EQUAL(uint64_t, 1, entry->Count);
+        ASSERT_ARE_EQUAL(uint64_t, 0, entry->BytesIn);
+        ASSERT_ARE_EQUAL(uint64_t, 1, entry->ResponseClasses[TSS_RC_CLASS_TRANSPORT]);
+
+        //cleanup
+    }
+
+#ifndef SMALL_FOOTPRINT
+    TEST_FUNCTION(TPM2_ReadPublic_resends_on_retry_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_CMD_STATS cmd_stats = { 0 };
+        TSS_RETRY_POLICY policy = { 3, 10, 40 };
+        TPM_HANDLE request_handle = HR_PERSISTENT;
+        TPM2B_PUBLIC tpm_public;
+        TPM2B_NAME tpm_name;
+        TPM2B_NAME qualified_name;
+        // TPM_ST_NO_SESSIONS, size 10, TPM_RC_RETRY
+        unsigned char retry_resp[] = { 0x80, 0x01, 0x00, 0x00, 0x00, 0x0a, 0x00, 0x00, 0x09, 0x22 };
+        uint32_t retry_resp_len = sizeof(retry_resp);
+        unsigned char success_resp[] = { 0x80, 0x01, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00 };
+        uint32_t expected_size = 4096;
+        uint32_t raw_resp = TPM_RC_SUCCESS;
+
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, TSS_SetRetryPolicy(&tss_dev, &policy));
+        TSS_SetCommandStats(&tss_dev, &cmd_stats);
+        TSS_SetTraceCallback(&tss_dev, on_cmd_trace, NULL);
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns()).SetReturn(100);
         STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns()).SetReturn(400);
+        STRICT_EXPECTED_CALL(tpm_comm_submit_command(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_response(retry_resp, sizeof(retry_resp))
+            .CopyOutArgumentBuffer_resp_len(&retry_resp_len, sizeof(retry_resp_len));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns()).SetReturn(900);
+        // Jitter: 10 ms / 2 + 3 % 6
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns()).SetReturn(3);
+        STRICT_EXPECTED_CALL(ThreadAPI_Sleep(8));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns()).SetReturn(9000);
+        STRICT_EXPECTED_CALL(tpm_comm_submit_command(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_response(success_resp, sizeof(success_resp));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns()).SetReturn(10400);
+        STRICT_EXPECTED_CALL(TPMI_ST_COMMAND_TAG_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_target(&expected_size, sizeof(expected_size));
+        STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_target(&raw_resp, sizeof(raw_resp));
+        STRICT_EXPECTED_CALL(TPM2B_PUBLIC_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(TPM2B_NAME_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPM2B_NAME_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
 
-        STRICT_EXPECTED_CALL(TPMS_AUTH_COMMAND_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        //act
+        TPM_RC result = TPM2_ReadPublic(&tss_dev, request_handle, &tpm_public, &tpm_name, &qualified_name);
+        const TSS_CMD_STATS_ENTRY* entry = TSS_GetCommandStats(&cmd_stats, TPM_CC_ReadPublic);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(size_t, 1, g_trace_call_count);
+        ASSERT_ARE_EQUAL(uint32_t, 1, g_last_trace.Retries);
+        ASSERT_ARE_EQUAL(uint64_t, 300, g_last_trace.MarshalTime);
+        ASSERT_ARE_EQUAL(uint64_t, 10000, g_last_trace.TransportTime);
+        ASSERT_ARE_EQUAL(uint64_t, 1, entry->Count);
+        ASSERT_ARE_EQUAL(uint64_t, 1, entry->Retries);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TPM2_ReadPublic_retries_exhausted_fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_RETRY_POLICY policy = { 1, 0, 0 };
+        TPM_HANDLE request_handle = HR_PERSISTENT;
+        TPM2B_PUBLIC tpm_public;
+        TPM2B_NAME tpm_name;
+        TPM2B_NAME qualified_name;
+        unsigned char retry_resp[] = { 0x80, 0x01, 0x00, 0x00, 0x00, 0x0a, 0x00, 0x00, 0x09, 0x22 };
+        uint32_t retry_resp_len = sizeof(retry_resp);
+        uint32_t expected_size = sizeof(retry_resp);
+        uint32_t raw_resp = TPM_RC_RETRY;
+
+        tss_dev.tpm_comm_handle = TEST_COMM_HANDLE;
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, TSS_SetRetryPolicy(&tss_dev, &policy));
+
+        STRICT_EXPECTED_CALL(UINT16_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        setup_dispatch_cmd_mocks();
-        STRICT_EXPECTED_CALL(TPM2B_DIGEST_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Marshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_comm_submit_command(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_response(retry_resp, sizeof(retry_resp))
+            .CopyOutArgumentBuffer_resp_len(&retry_resp_len, sizeof(retry_resp_len));
+        STRICT_EXPECTED_CALL(ThreadAPI_Sleep(0));
+        STRICT_EXPECTED_CALL(tpm_comm_submit_command(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_response(retry_resp, sizeof(retry_resp))
+            .CopyOutArgumentBuffer_resp_len(&retry_resp_len, sizeof(retry_resp_len));
+        STRICT_EXPECTED_CALL(TPMI_ST_COMMAND_TAG_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_target(&expected_size, sizeof(expected_size));
+        STRICT_EXPECTED_CALL(UINT32_Unmarshal(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_target(&raw_resp, sizeof(raw_resp));
 
         //act
-        TPM_RC result = TPM2_HMAC(&tss_dev, &session, handle, &dataBuf, TPM_ALG_NULL, &hmac);
+        TPM_RC result = TPM2_ReadPublic(&tss_dev, request_handle, &tpm_public, &tpm_name, &qualified_name);
 
         //assert
-        //ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
-        (void)result;
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_RETRY, result);
         ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(uint32_t, 1, tss_dev.CmdCtx.Retries);
+
+        //cleanup
+    }
+#endif // SMALL_FOOTPRINT
+
+    TEST_FUNCTION(TSS_DEVICE_ram_usage)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+
+        //act
+        (void)printf("RAM use: TSS_DEVICE %u, TSS_CMD_CONTEXT %u, TPMS_CAPABILITY_DATA %u, TPM2B_MAX_BUFFER %u bytes\r\n",
+            (unsigned)sizeof(TSS_DEVICE), (unsigned)sizeof(TSS_CMD_CONTEXT),
+            (unsigned)sizeof(TPMS_CAPABILITY_DATA), (unsigned)sizeof(TPM2B_MAX_BUFFER));
+
+        //assert
+        ASSERT_IS_TRUE(sizeof(TPMS_CAPABILITY_DATA) <= MAX_CAP_BUFFER);
+#ifdef SMALL_FOOTPRINT
+        ASSERT_IS_TRUE((void*)tss_dev.CmdCtx.CmdBuffer == (void*)tss_dev.CmdCtx.RespBuffer);
+        ASSERT_IS_TRUE(sizeof(TSS_CMD_CONTEXT) < MAX_COMMAND_BUFFER + 128);
+#else
+        ASSERT_IS_TRUE(sizeof(TSS_CMD_CONTEXT) >= MAX_COMMAND_BUFFER + MAX_RESPONSE_BUFFER);
+#endif // SMALL_FOOTPRINT
 
         //cleanup
     }
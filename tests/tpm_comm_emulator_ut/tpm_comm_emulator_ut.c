@@ -5,10 +5,12 @@
 #include <cstdlib>
 #include <cstdint>
 #include <cstddef>
+#include <cstring>
 #else
 #include <stdlib.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
 #endif
 
 #include "testrunnerswitcher.h"
@@ -50,12 +52,15 @@ static void* my_gballoc_realloc(void* ptr, size_t size)
 #include "azure_c_shared_utility/socketio.h"
 #include "azure_utpm_c/tpm_socket_comm.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/threadapi.h"
 #undef ENABLE_MOCKS
 
 #include "azure_utpm_c/tpm_comm.h"
 
 static htonl_type g_htonl_value = 1;
 static const char* const TEST_SOCKET_ENDPOINT = "127.0.0.1";
+static const char* const TEST_SOCKET_PORT_ENDPOINT = "127.0.0.1:2421";
+static const char* const TEST_SOCKET_UNIX_ENDPOINT = "unix:///run/tpm/sim.sock";
 
 #ifdef WIN32
 MOCK_FUNCTION_WITH_CODE(WSAAPI, htonl_type, htonl, htonl_type, hostlong)
@@ -90,6 +95,7 @@ DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
 
 TEST_DEFINE_ENUM_TYPE(TPM_COMM_TYPE, TPM_COMM_TYPE_VALUES);
 IMPLEMENT_UMOCK_C_ENUM_TYPE(TPM_COMM_TYPE, TPM_COMM_TYPE_VALUES);
+TEST_DEFINE_ENUM_TYPE(TPM_COMM_POLL_RESULT, TPM_COMM_POLL_RESULT_VALUES);
 
 static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
 {
@@ -159,6 +165,12 @@ BEGIN_TEST_SUITE(tpm_comm_emulator_ut)
         REGISTER_GLOBAL_MOCK_FAIL_RETURN(tpm_socket_read, __LINE__);
         REGISTER_GLOBAL_MOCK_RETURN(tpm_socket_send, 0);
         REGISTER_GLOBAL_MOCK_FAIL_RETURN(tpm_socket_send, __LINE__);
+        REGISTER_GLOBAL_MOCK_RETURN(tpm_socket_send_gather, 0);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(tpm_socket_send_gather, __LINE__);
+        REGISTER_GLOBAL_MOCK_RETURN(tpm_socket_wait_readable, 0);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(tpm_socket_wait_readable, __LINE__);
+        REGISTER_GLOBAL_MOCK_RETURN(tpm_socket_wait_any, 0);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(tpm_socket_wait_any, -1);
 }
 
     TEST_SUITE_CLEANUP(suite_cleanup)
@@ -211,24 +223,23 @@ BEGIN_TEST_SUITE(tpm_comm_emulator_ut)
         STRICT_EXPECTED_CALL(htonl(IGNORED_NUM_ARG));
     }
 
-    static void setup_comm_create_mocks(void)
+    static void setup_comm_handshake_mocks(void)
     {
         htonl_type client_ver = 1;
         htonl_type unused = 0;
 
-        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
-
-        STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(tpm_socket_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
         setup_socket_send_mocks();
         setup_socket_send_mocks();
 
         setup_socket_read_mocks(&client_ver);
         setup_socket_read_mocks(&unused);
         setup_socket_read_mocks(&unused);
+    }
+
+    static void setup_power_on_mocks(void)
+    {
+        htonl_type unused = 0;
 
-        // Power on simulator
-        STRICT_EXPECTED_CALL(tpm_socket_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
         STRICT_EXPECTED_CALL(htonl(IGNORED_NUM_ARG));
         STRICT_EXPECTED_CALL(htonl(IGNORED_NUM_ARG));
 
@@ -238,22 +249,43 @@ BEGIN_TEST_SUITE(tpm_comm_emulator_ut)
         STRICT_EXPECTED_CALL(tpm_socket_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
 
         setup_socket_read_mocks(&unused);
+    }
+
+    static void setup_comm_create_mocks(void)
+    {
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+
+        STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_socket_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        setup_comm_handshake_mocks();
+
+        // Power on simulator
+        STRICT_EXPECTED_CALL(tpm_socket_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        setup_power_on_mocks();
         STRICT_EXPECTED_CALL(tpm_socket_destroy(IGNORED_PTR_ARG));
     }
 
-    static void setup_tpm_comm_submit_command_mocks(void)
+    static void setup_tpm_comm_send_command_mocks(void)
+    {
+        STRICT_EXPECTED_CALL(htonl(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(htonl(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(tpm_socket_send_gather(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 4));
+    }
+
+    static void setup_tpm_comm_read_response_mocks(void)
     {
         htonl_type resp_len = RECV_DATA_LEN;
         htonl_type ack_cmd = 0;
 
-        setup_socket_send_mocks();
-        STRICT_EXPECTED_CALL(tpm_socket_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-        setup_socket_send_mocks();
-        STRICT_EXPECTED_CALL(tpm_socket_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
         setup_socket_read_mocks(&resp_len);
         STRICT_EXPECTED_CALL(tpm_socket_read(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
         setup_socket_read_mocks(&ack_cmd);
+    }
 
+    static void setup_tpm_comm_submit_command_mocks(void)
+    {
+        setup_tpm_comm_send_command_mocks();
+        setup_tpm_comm_read_response_mocks();
     }
 
     TEST_FUNCTION(tpm_comm_create_succeed)
@@ -309,6 +341,209 @@ BEGIN_TEST_SUITE(tpm_comm_emulator_ut)
         umock_c_negative_tests_deinit();
     }
 
+    TEST_FUNCTION(tpm_comm_needs_startup_succeed)
+    {
+        //arrange
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(TEST_SOCKET_ENDPOINT);
+        umock_c_reset_all_calls();
+
+        //act
+        bool needs_startup = tpm_comm_needs_startup(tpm_handle);
+
+        //assert
+        ASSERT_IS_TRUE(needs_startup);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_create_persistent_platform_skips_power_on_succeed)
+    {
+        //arrange
+        (void)tpm_comm_set_persistent_platform(true);
+        TPM_COMM_HANDLE first_handle = tpm_comm_create(TEST_SOCKET_ENDPOINT);
+        tpm_comm_destroy(first_handle);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_socket_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        setup_comm_handshake_mocks();
+        STRICT_EXPECTED_CALL(tpm_socket_wait_readable(IGNORED_PTR_ARG, 0, IGNORED_PTR_ARG));
+
+        //act
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(TEST_SOCKET_ENDPOINT);
+
+        //assert
+        ASSERT_IS_NOT_NULL(tpm_handle);
+        ASSERT_IS_FALSE(tpm_comm_needs_startup(tpm_handle));
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+        (void)tpm_comm_set_persistent_platform(false);
+    }
+
+    TEST_FUNCTION(tpm_comm_create_persistent_platform_closed_powers_on_succeed)
+    {
+        //arrange
+        bool is_readable = true;
+        (void)tpm_comm_set_persistent_platform(true);
+        TPM_COMM_HANDLE first_handle = tpm_comm_create(TEST_SOCKET_ENDPOINT);
+        tpm_comm_destroy(first_handle);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_socket_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        setup_comm_handshake_mocks();
+        // The simulator has been restarted
+        STRICT_EXPECTED_CALL(tpm_socket_wait_readable(IGNORED_PTR_ARG, 0, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_is_readable(&is_readable, sizeof(is_readable));
+        STRICT_EXPECTED_CALL(tpm_socket_destroy(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_socket_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        setup_power_on_mocks();
+        STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+        //act
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(TEST_SOCKET_ENDPOINT);
+
+        //assert
+        ASSERT_IS_NOT_NULL(tpm_handle);
+        ASSERT_IS_TRUE(tpm_comm_needs_startup(tpm_handle));
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+        (void)tpm_comm_set_persistent_platform(false);
+    }
+
+    TEST_FUNCTION(tpm_comm_create_persistent_platform_retries_connect_succeed)
+    {
+        //arrange
+        (void)tpm_comm_set_persistent_platform(true);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_socket_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(NULL);
+        STRICT_EXPECTED_CALL(ThreadAPI_Sleep(10));
+        STRICT_EXPECTED_CALL(tpm_socket_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(NULL);
+        STRICT_EXPECTED_CALL(ThreadAPI_Sleep(20));
+        STRICT_EXPECTED_CALL(tpm_socket_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        setup_comm_handshake_mocks();
+        STRICT_EXPECTED_CALL(tpm_socket_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        setup_power_on_mocks();
+        STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+        //act
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(TEST_SOCKET_ENDPOINT);
+
+        //assert
+        ASSERT_IS_NOT_NULL(tpm_handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+        (void)tpm_comm_set_persistent_platform(false);
+    }
+
+    TEST_FUNCTION(tpm_comm_create_endpoint_port_succeed)
+    {
+        //arrange
+        setup_comm_create_mocks();
+
+        //act
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(TEST_SOCKET_PORT_ENDPOINT);
+
+        //assert
+        ASSERT_IS_NOT_NULL(tpm_handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_create_unix_endpoint_succeed)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_SOCKET_UNIX_ENDPOINT));
+        STRICT_EXPECTED_CALL(tpm_socket_create(TEST_SOCKET_UNIX_ENDPOINT, 0));
+        setup_comm_handshake_mocks();
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(tpm_socket_create("unix:///run/tpm/sim.sock.platform", 0));
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+        setup_power_on_mocks();
+        STRICT_EXPECTED_CALL(tpm_socket_destroy(IGNORED_PTR_ARG));
+
+        //act
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(TEST_SOCKET_UNIX_ENDPOINT);
+
+        //assert
+        ASSERT_IS_NOT_NULL(tpm_handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_create_endpoint_invalid_port_fail)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+        //act
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create("127.0.0.1:port");
+
+        //assert
+        ASSERT_IS_NULL(tpm_handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_comm_create_tcp_endpoint_succeed)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, "10.0.0.2"));
+        STRICT_EXPECTED_CALL(tpm_socket_create("10.0.0.2", 2421));
+        setup_comm_handshake_mocks();
+        STRICT_EXPECTED_CALL(tpm_socket_create("10.0.0.2", 2422));
+        setup_power_on_mocks();
+        STRICT_EXPECTED_CALL(tpm_socket_destroy(IGNORED_PTR_ARG));
+
+        //act
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create("tcp:10.0.0.2:2421");
+
+        //assert
+        ASSERT_IS_NOT_NULL(tpm_handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_create_device_endpoint_fail)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+        //act
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create("dev:/dev/tpmrm0");
+
+        //assert
+        ASSERT_IS_NULL(tpm_handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
     TEST_FUNCTION(tpm_comm_destroy_succeed)
     {
         //arrange
@@ -383,6 +618,36 @@ BEGIN_TEST_SUITE(tpm_comm_emulator_ut)
         tpm_comm_destroy(tpm_handle);
     }
 
+    TEST_FUNCTION(tpm_comm_submit_command_steady_state_no_allocation_succeed)
+    {
+        int result;
+
+        TPM_COMM_HANDLE tpm_handle;
+        unsigned char response[RECV_DATA_LEN];
+        uint32_t length = RECV_DATA_LEN;
+
+        //arrange
+        setup_comm_create_mocks();
+        tpm_handle = tpm_comm_create(TEST_SOCKET_ENDPOINT);
+        setup_tpm_comm_submit_command_mocks();
+        (void)tpm_comm_submit_command(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH, response, &length);
+        umock_c_reset_all_calls();
+
+        setup_tpm_comm_submit_command_mocks();
+
+        //act
+        length = RECV_DATA_LEN;
+        result = tpm_comm_submit_command(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH, response, &length);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_IS_NULL(strstr(umock_c_get_actual_calls(), "gballoc_"));
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
     TEST_FUNCTION(tpm_comm_submit_command_fail)
     {
         int result;
@@ -403,7 +668,7 @@ BEGIN_TEST_SUITE(tpm_comm_emulator_ut)
 
         umock_c_negative_tests_snapshot();
 
-        size_t calls_cannot_fail[] = { 0, 3, 7, 10 };
+        size_t calls_cannot_fail[] = { 0, 1, 4, 7 };
 
         //act
         size_t count = umock_c_negative_tests_call_count();
@@ -431,5 +696,274 @@ BEGIN_TEST_SUITE(tpm_comm_emulator_ut)
         umock_c_negative_tests_deinit();
     }
 
+    static void time_out_command(TPM_COMM_HANDLE tpm_handle)
+    {
+        unsigned char response[RECV_DATA_LEN];
+        uint32_t length = RECV_DATA_LEN;
+        bool is_readable = false;
+
+        (void)tpm_comm_set_timeout(tpm_handle, 10);
+        setup_tpm_comm_send_command_mocks();
+        STRICT_EXPECTED_CALL(tpm_socket_wait_readable(IGNORED_PTR_ARG, 10, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_is_readable(&is_readable, sizeof(is_readable));
+        (void)tpm_comm_submit_command(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH, response, &length);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_after_timeout_drops_late_response_succeed)
+    {
+        int result;
+        TPM_COMM_HANDLE tpm_handle;
+        unsigned char response[RECV_DATA_LEN];
+        uint32_t length = RECV_DATA_LEN;
+        bool is_readable = true;
+
+        //arrange
+        setup_comm_create_mocks();
+        tpm_handle = tpm_comm_create(TEST_SOCKET_ENDPOINT);
+        time_out_command(tpm_handle);
+        umock_c_reset_all_calls();
+
+        // The late response is read before the command is sent
+        STRICT_EXPECTED_CALL(tpm_socket_wait_readable(IGNORED_PTR_ARG, 10, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_is_readable(&is_readable, sizeof(is_readable));
+        setup_tpm_comm_read_response_mocks();
+        setup_tpm_comm_send_command_mocks();
+        STRICT_EXPECTED_CALL(tpm_socket_wait_readable(IGNORED_PTR_ARG, 10, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_is_readable(&is_readable, sizeof(is_readable));
+        setup_tpm_comm_read_response_mocks();
+
+        //act
+        result = tpm_comm_submit_command(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH, response, &length);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_after_timeout_late_response_outstanding_fail)
+    {
+        int result;
+        TPM_COMM_HANDLE tpm_handle;
+        unsigned char response[RECV_DATA_LEN];
+        uint32_t length = RECV_DATA_LEN;
+        bool is_readable = false;
+
+        //arrange
+        setup_comm_create_mocks();
+        tpm_handle = tpm_comm_create(TEST_SOCKET_ENDPOINT);
+        time_out_command(tpm_handle);
+        umock_c_reset_all_calls();
+
+        // Nothing is sent while the simulator still owes the previous response
+        STRICT_EXPECTED_CALL(tpm_socket_wait_readable(IGNORED_PTR_ARG, 10, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_is_readable(&is_readable, sizeof(is_readable));
+
+        //act
+        result = tpm_comm_submit_command(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH, response, &length);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_async_succeed)
+    {
+        int result;
+        TPM_COMM_HANDLE tpm_handle;
+
+        //arrange
+        setup_comm_create_mocks();
+        tpm_handle = tpm_comm_create(TEST_SOCKET_ENDPOINT);
+        umock_c_reset_all_calls();
+
+        setup_tpm_comm_send_command_mocks();
+
+        //act
+        result = tpm_comm_submit_async(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_async_pending_fail)
+    {
+        int result;
+        TPM_COMM_HANDLE tpm_handle;
+        unsigned char response[RECV_DATA_LEN];
+        uint32_t length = RECV_DATA_LEN;
+
+        //arrange
+        setup_comm_create_mocks();
+        tpm_handle = tpm_comm_create(TEST_SOCKET_ENDPOINT);
+        (void)tpm_comm_submit_async(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH);
+        umock_c_reset_all_calls();
+
+        //act
+        result = tpm_comm_submit_command(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH, response, &length);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_poll_complete_pending_succeed)
+    {
+        TPM_COMM_POLL_RESULT result;
+        TPM_COMM_HANDLE tpm_handle;
+        unsigned char response[RECV_DATA_LEN];
+        uint32_t length = RECV_DATA_LEN;
+        bool is_readable = false;
+
+        //arrange
+        setup_comm_create_mocks();
+        tpm_handle = tpm_comm_create(TEST_SOCKET_ENDPOINT);
+        (void)tpm_comm_submit_async(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(tpm_socket_wait_readable(IGNORED_PTR_ARG, 0, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_is_readable(&is_readable, sizeof(is_readable));
+
+        //act
+        result = tpm_comm_poll_complete(tpm_handle, response, &length);
+
+        //assert
+        ASSERT_ARE_EQUAL(TPM_COMM_POLL_RESULT, TPM_COMM_POLL_PENDING, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_poll_complete_succeed)
+    {
+        TPM_COMM_POLL_RESULT result;
+        TPM_COMM_HANDLE tpm_handle;
+        unsigned char response[RECV_DATA_LEN];
+        uint32_t length = RECV_DATA_LEN;
+        bool is_readable = true;
+
+        //arrange
+        setup_comm_create_mocks();
+        tpm_handle = tpm_comm_create(TEST_SOCKET_ENDPOINT);
+        (void)tpm_comm_submit_async(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(tpm_socket_wait_readable(IGNORED_PTR_ARG, 0, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_is_readable(&is_readable, sizeof(is_readable));
+        setup_tpm_comm_read_response_mocks();
+
+        //act
+        result = tpm_comm_poll_complete(tpm_handle, response, &length);
+
+        //assert
+        ASSERT_ARE_EQUAL(TPM_COMM_POLL_RESULT, TPM_COMM_POLL_COMPLETE, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_poll_complete_not_submitted_fail)
+    {
+        TPM_COMM_POLL_RESULT result;
+        TPM_COMM_HANDLE tpm_handle;
+        unsigned char response[RECV_DATA_LEN];
+        uint32_t length = RECV_DATA_LEN;
+
+        //arrange
+        setup_comm_create_mocks();
+        tpm_handle = tpm_comm_create(TEST_SOCKET_ENDPOINT);
+        umock_c_reset_all_calls();
+
+        //act
+        result = tpm_comm_poll_complete(tpm_handle, response, &length);
+
+        //assert
+        ASSERT_ARE_EQUAL(TPM_COMM_POLL_RESULT, TPM_COMM_POLL_ERROR, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_wait_any_two_pending_succeed)
+    {
+        int result;
+        TPM_COMM_HANDLE tpm_handles[2];
+        bool readable[2] = { false, true };
+        bool ready[2];
+
+        //arrange
+        setup_comm_create_mocks();
+        tpm_handles[0] = tpm_comm_create(TEST_SOCKET_ENDPOINT);
+        setup_comm_create_mocks();
+        tpm_handles[1] = tpm_comm_create(TEST_SOCKET_ENDPOINT);
+        (void)tpm_comm_submit_async(tpm_handles[0], TEMP_TPM_COMMAND, TEMP_CMD_LENGTH);
+        (void)tpm_comm_submit_async(tpm_handles[1], TEMP_TPM_COMMAND, TEMP_CMD_LENGTH);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(tpm_socket_wait_any(IGNORED_PTR_ARG, 2, TPM_SOCKET_WAIT_FOREVER, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_readable(readable, sizeof(readable))
+            .SetReturn(1);
+
+        //act
+        result = tpm_comm_wait_any(tpm_handles, 2, 0, ready);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 1, result);
+        ASSERT_IS_FALSE(ready[0]);
+        ASSERT_IS_TRUE(ready[1]);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handles[0]);
+        tpm_comm_destroy(tpm_handles[1]);
+    }
+
+    TEST_FUNCTION(tpm_comm_wait_any_skips_idle_handle_succeed)
+    {
+        int result;
+        TPM_COMM_HANDLE tpm_handles[2];
+        bool readable = true;
+        bool ready[2];
+
+        //arrange
+        setup_comm_create_mocks();
+        tpm_handles[0] = tpm_comm_create(TEST_SOCKET_ENDPOINT);
+        setup_comm_create_mocks();
+        tpm_handles[1] = tpm_comm_create(TEST_SOCKET_ENDPOINT);
+        (void)tpm_comm_submit_async(tpm_handles[1], TEMP_TPM_COMMAND, TEMP_CMD_LENGTH);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(tpm_socket_wait_any(IGNORED_PTR_ARG, 1, 50, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_readable(&readable, sizeof(readable))
+            .SetReturn(1);
+
+        //act
+        result = tpm_comm_wait_any(tpm_handles, 2, 50, ready);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 1, result);
+        ASSERT_IS_FALSE(ready[0]);
+        ASSERT_IS_TRUE(ready[1]);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handles[0]);
+        tpm_comm_destroy(tpm_handles[1]);
+    }
 
 END_TEST_SUITE(tpm_comm_emulator_ut)
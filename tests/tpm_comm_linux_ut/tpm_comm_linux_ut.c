@@ -5,10 +5,14 @@
 #include <cstdlib>
 #include <cstdint>
 #include <cstddef>
+#include <cstring>
+#include <cerrno>
 #else
 #include <stdlib.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
+#include <errno.h>
 #endif
 
 static void* my_gballoc_malloc(size_t size)
@@ -33,6 +37,7 @@ static void my_gballoc_free(void* ptr)
 #include "azure_utpm_c/gbfiledescript.h"
 #include "azure_c_shared_utility/umock_c_prod.h"
 #include "azure_utpm_c/tpm_socket_comm.h"
+#include "azure_utpm_c/tpm_timer.h"
 #undef ENABLE_MOCKS
 
 #include "azure_utpm_c/tpm_comm.h"
@@ -48,9 +53,12 @@ extern "C"
 static const unsigned char* TEMP_TPM_COMMAND = (const unsigned char*)0x00012345;
 #define TEMP_CMD_LENGTH         128
 static int TEST_FD_VALUE = 11;
+static const char* const TEST_UNIX_ENDPOINT = "unix:///run/tpm/trm.sock";
 
 DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
 
+TEST_DEFINE_ENUM_TYPE(TPM_COMM_POLL_RESULT, TPM_COMM_POLL_RESULT_VALUES);
+
 static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
 {
     char temp_str[256];
@@ -70,6 +78,35 @@ static void my_tpm_socket_destroy(TPM_SOCKET_HANDLE handle)
     my_gballoc_free(handle);
 }
 
+static int my_gbfiledesc_poll(struct pollfd* fds, nfds_t nfds, int timeout)
+{
+    (void)nfds;
+    (void)timeout;
+    fds->revents = POLLIN;
+    return 1;
+}
+
+static size_t g_read_would_block;
+
+static ssize_t my_gbfiledesc_read(int fd, void* buf, size_t count)
+{
+    ssize_t result;
+    (void)fd;
+    (void)buf;
+    (void)count;
+    if (g_read_would_block > 0)
+    {
+        g_read_would_block--;
+        errno = EAGAIN;
+        result = -1;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
 static TEST_MUTEX_HANDLE g_testByTest;
 static TEST_MUTEX_HANDLE g_dllByDll;
 
@@ -93,6 +130,8 @@ BEGIN_TEST_SUITE(tpm_comm_linux_ut)
         REGISTER_UMOCK_ALIAS_TYPE(TPM_COMM_HANDLE, void*);
         REGISTER_UMOCK_ALIAS_TYPE(TPM_SOCKET_HANDLE, void*);
         REGISTER_UMOCK_ALIAS_TYPE(ssize_t, unsigned int);
+        REGISTER_UMOCK_ALIAS_TYPE(nfds_t, unsigned long);
+        REGISTER_UMOCK_ALIAS_TYPE(struct pollfd*, void*);
 
         REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
         REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
@@ -102,7 +141,8 @@ BEGIN_TEST_SUITE(tpm_comm_linux_ut)
         REGISTER_GLOBAL_MOCK_RETURN(gbfiledesc_close, 0);
         REGISTER_GLOBAL_MOCK_RETURN(gbfiledesc_access, 0);
         REGISTER_GLOBAL_MOCK_RETURN(gbfiledesc_write, 0);
-        REGISTER_GLOBAL_MOCK_RETURN(gbfiledesc_read, 0);
+        REGISTER_GLOBAL_MOCK_HOOK(gbfiledesc_read, my_gbfiledesc_read);
+        REGISTER_GLOBAL_MOCK_HOOK(gbfiledesc_poll, my_gbfiledesc_poll);
 
         REGISTER_GLOBAL_MOCK_HOOK(tpm_socket_create, my_tpm_socket_create);
         REGISTER_GLOBAL_MOCK_FAIL_RETURN(tpm_socket_create, NULL);
@@ -111,6 +151,8 @@ BEGIN_TEST_SUITE(tpm_comm_linux_ut)
         REGISTER_GLOBAL_MOCK_FAIL_RETURN(tpm_socket_read, __LINE__);
         REGISTER_GLOBAL_MOCK_RETURN(tpm_socket_send, 0);
         REGISTER_GLOBAL_MOCK_FAIL_RETURN(tpm_socket_send, __LINE__);
+        REGISTER_GLOBAL_MOCK_RETURN(tpm_socket_send_gather, 0);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(tpm_socket_send_gather, __LINE__);
     }
 
     TEST_SUITE_CLEANUP(suite_cleanup)
@@ -166,6 +208,107 @@ BEGIN_TEST_SUITE(tpm_comm_linux_ut)
         tpm_comm_destroy(tpm_handle);
     }
 
+    TEST_FUNCTION(tpm_comm_create_unix_endpoint_succeed)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(tpm_socket_create(TEST_UNIX_ENDPOINT, 0));
+
+        //act
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(TEST_UNIX_ENDPOINT);
+
+        //assert
+        ASSERT_IS_NOT_NULL(tpm_handle);
+        ASSERT_IS_TRUE(tpm_comm_is_resource_managed(tpm_handle));
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_create_unix_endpoint_fail)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(tpm_socket_create(TEST_UNIX_ENDPOINT, 0)).SetReturn(NULL);
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+        //act
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(TEST_UNIX_ENDPOINT);
+
+        //assert
+        ASSERT_IS_NULL(tpm_handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_comm_create_device_endpoint_succeed)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(gbfiledesc_open("/dev/tpmrm1", IGNORED_NUM_ARG));
+
+        //act
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create("dev:/dev/tpmrm1");
+
+        //assert
+        ASSERT_IS_NOT_NULL(tpm_handle);
+        ASSERT_IS_TRUE(tpm_comm_is_resource_managed(tpm_handle));
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_create_device_endpoint_fail)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(gbfiledesc_open("/dev/tpm1", IGNORED_NUM_ARG)).SetReturn(-1);
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+        //act
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create("dev:/dev/tpm1");
+
+        //assert
+        ASSERT_IS_NULL(tpm_handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_comm_create_tcp_endpoint_succeed)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(tpm_socket_create("10.0.0.2", 2424));
+
+        //act
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create("tcp:10.0.0.2:2424");
+
+        //assert
+        ASSERT_IS_NOT_NULL(tpm_handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_create_invalid_endpoint_fail)
+    {
+        //arrange
+
+        //act
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create("tcp:10.0.0.2:port");
+
+        //assert
+        ASSERT_IS_NULL(tpm_handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
     TEST_FUNCTION(tpm_comm_create_raw_tpm_succeed)
     {
         //arrange
@@ -334,6 +477,93 @@ BEGIN_TEST_SUITE(tpm_comm_linux_ut)
         //cleanup
     }
 
+    TEST_FUNCTION(tpm_comm_is_resource_managed_tpm_res_mgr_succeed)
+    {
+        //arrange
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        umock_c_reset_all_calls();
+
+        //act
+        bool result = tpm_comm_is_resource_managed(tpm_handle);
+
+        //assert
+        ASSERT_IS_TRUE(result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_is_resource_managed_raw_tpm_succeed)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(gbfiledesc_open(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(-1);
+        STRICT_EXPECTED_CALL(gbfiledesc_open(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        umock_c_reset_all_calls();
+
+        //act
+        bool result = tpm_comm_is_resource_managed(tpm_handle);
+
+        //assert
+        ASSERT_IS_FALSE(result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_set_priority_handle_NULL_fail)
+    {
+        //arrange
+
+        //act
+        int result = tpm_comm_set_priority(NULL, TPM_COMM_PRIORITY_HIGH);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_comm_set_priority_succeed)
+    {
+        //arrange
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        umock_c_reset_all_calls();
+
+        //act
+        int result = tpm_comm_set_priority(tpm_handle, TPM_COMM_PRIORITY_HIGH);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_set_priority_async_pending_fail)
+    {
+        //arrange
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        STRICT_EXPECTED_CALL(gbfiledesc_write(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+        (void)tpm_comm_submit_async(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH);
+        umock_c_reset_all_calls();
+
+        //act
+        int result = tpm_comm_set_priority(tpm_handle, TPM_COMM_PRIORITY_LOW);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
     TEST_FUNCTION(tpm_comm_submit_command_handle_NULL_fail)
     {
         //arrange
@@ -391,6 +621,456 @@ BEGIN_TEST_SUITE(tpm_comm_linux_ut)
         tpm_comm_destroy(tpm_handle);
     }
 
+    TEST_FUNCTION(tpm_comm_submit_command_steady_state_no_allocation_succeed)
+    {
+        //arrange
+        unsigned char response[TEMP_CMD_LENGTH];
+        uint32_t resp_len = TEMP_CMD_LENGTH;
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        STRICT_EXPECTED_CALL(gbfiledesc_write(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+        STRICT_EXPECTED_CALL(gbfiledesc_read(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+        (void)tpm_comm_submit_command(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH, response, &resp_len);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(gbfiledesc_write(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+        STRICT_EXPECTED_CALL(gbfiledesc_read(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+
+        //act
+        resp_len = TEMP_CMD_LENGTH;
+        int tpm_result = tpm_comm_submit_command(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH, response, &resp_len);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, tpm_result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_IS_NULL(strstr(umock_c_get_actual_calls(), "gballoc_"));
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_after_abandoned_async_succeed)
+    {
+        //arrange
+        unsigned char response[TEMP_CMD_LENGTH];
+        uint32_t resp_len = TEMP_CMD_LENGTH;
+        TPM_COMM_HANDLE async_handle = tpm_comm_create(NULL);
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        STRICT_EXPECTED_CALL(gbfiledesc_write(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+        (void)tpm_comm_submit_async(async_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH);
+        tpm_comm_destroy(async_handle);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(gbfiledesc_write(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+        STRICT_EXPECTED_CALL(gbfiledesc_read(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+
+        //act
+        int tpm_result = tpm_comm_submit_command(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH, response, &resp_len);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, tpm_result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_waits_for_response_succeed)
+    {
+        //arrange
+        unsigned char response[TEMP_CMD_LENGTH];
+        uint32_t resp_len = TEMP_CMD_LENGTH;
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        umock_c_reset_all_calls();
+        g_read_would_block = 1;
+
+        STRICT_EXPECTED_CALL(gbfiledesc_write(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+        STRICT_EXPECTED_CALL(gbfiledesc_read(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(gbfiledesc_poll(IGNORED_PTR_ARG, 1, IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(gbfiledesc_read(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+
+        //act
+        int tpm_result = tpm_comm_submit_command(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH, response, &resp_len);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, tpm_result);
+        ASSERT_ARE_EQUAL(uint32_t, TEMP_CMD_LENGTH, resp_len);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_timeout_fail)
+    {
+        //arrange
+        unsigned char response[TEMP_CMD_LENGTH];
+        uint32_t resp_len = TEMP_CMD_LENGTH;
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        (void)tpm_comm_set_timeout(tpm_handle, 10);
+        umock_c_reset_all_calls();
+        g_read_would_block = 1;
+
+        STRICT_EXPECTED_CALL(gbfiledesc_write(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+        STRICT_EXPECTED_CALL(gbfiledesc_read(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(gbfiledesc_poll(IGNORED_PTR_ARG, 1, 10)).SetReturn(0);
+
+        //act
+        int tpm_result = tpm_comm_submit_command(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH, response, &resp_len);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, tpm_result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        g_read_would_block = 0;
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    static void time_out_command(TPM_COMM_HANDLE tpm_handle)
+    {
+        unsigned char response[TEMP_CMD_LENGTH];
+        uint32_t resp_len = TEMP_CMD_LENGTH;
+        g_read_would_block = 1;
+        STRICT_EXPECTED_CALL(gbfiledesc_write(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+        STRICT_EXPECTED_CALL(gbfiledesc_poll(IGNORED_PTR_ARG, 1, 10)).SetReturn(0);
+        (void)tpm_comm_submit_command(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH, response, &resp_len);
+        g_read_would_block = 0;
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_after_timeout_drops_late_response_succeed)
+    {
+        //arrange
+        unsigned char response[TEMP_CMD_LENGTH];
+        uint32_t resp_len = TEMP_CMD_LENGTH;
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        (void)tpm_comm_set_timeout(tpm_handle, 10);
+        time_out_command(tpm_handle);
+        umock_c_reset_all_calls();
+
+        // The late response is read before the command is written
+        STRICT_EXPECTED_CALL(gbfiledesc_read(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+        STRICT_EXPECTED_CALL(gbfiledesc_write(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+        STRICT_EXPECTED_CALL(gbfiledesc_read(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH / 2);
+
+        //act
+        int tpm_result = tpm_comm_submit_command(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH, response, &resp_len);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, tpm_result);
+        ASSERT_ARE_EQUAL(uint32_t, TEMP_CMD_LENGTH / 2, resp_len);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_after_timeout_late_response_outstanding_fail)
+    {
+        //arrange
+        unsigned char response[TEMP_CMD_LENGTH];
+        uint32_t resp_len = TEMP_CMD_LENGTH;
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        (void)tpm_comm_set_timeout(tpm_handle, 10);
+        time_out_command(tpm_handle);
+        umock_c_reset_all_calls();
+        g_read_would_block = 1;
+
+        // Nothing is written while the TPM still owes the previous response
+        STRICT_EXPECTED_CALL(gbfiledesc_read(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(gbfiledesc_poll(IGNORED_PTR_ARG, 1, 10)).SetReturn(0);
+
+        //act
+        int tpm_result = tpm_comm_submit_command(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH, response, &resp_len);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, tpm_result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        g_read_would_block = 0;
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_after_failed_late_response_fail)
+    {
+        //arrange
+        unsigned char response[TEMP_CMD_LENGTH];
+        uint32_t resp_len = TEMP_CMD_LENGTH;
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        (void)tpm_comm_set_timeout(tpm_handle, 10);
+        time_out_command(tpm_handle);
+        STRICT_EXPECTED_CALL(gbfiledesc_read(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(-1);
+        (void)tpm_comm_submit_command(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH, response, &resp_len);
+        umock_c_reset_all_calls();
+
+        //act
+        int tpm_result = tpm_comm_submit_command(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH, response, &resp_len);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, tpm_result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_set_timeout_handle_NULL_fail)
+    {
+        //arrange
+
+        //act
+        int tpm_result = tpm_comm_set_timeout(NULL, 10);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, tpm_result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_async_handle_NULL_fail)
+    {
+        //arrange
+
+        //act
+        int tpm_result = tpm_comm_submit_async(NULL, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, tpm_result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_async_already_pending_fail)
+    {
+        //arrange
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        STRICT_EXPECTED_CALL(gbfiledesc_write(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+        (void)tpm_comm_submit_async(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH);
+        umock_c_reset_all_calls();
+
+        //act
+        int tpm_result = tpm_comm_submit_async(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, tpm_result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_async_succeed)
+    {
+        //arrange
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(gbfiledesc_write(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+
+        //act
+        int tpm_result = tpm_comm_submit_async(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, tpm_result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_poll_complete_not_submitted_fail)
+    {
+        //arrange
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        umock_c_reset_all_calls();
+
+        //act
+        unsigned char response[TEMP_CMD_LENGTH];
+        uint32_t resp_len = TEMP_CMD_LENGTH;
+        TPM_COMM_POLL_RESULT poll_result = tpm_comm_poll_complete(tpm_handle, response, &resp_len);
+
+        //assert
+        ASSERT_ARE_EQUAL(TPM_COMM_POLL_RESULT, TPM_COMM_POLL_ERROR, poll_result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_poll_complete_pending_succeed)
+    {
+        //arrange
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        STRICT_EXPECTED_CALL(gbfiledesc_write(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+        (void)tpm_comm_submit_async(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(gbfiledesc_poll(IGNORED_PTR_ARG, 1, 0)).SetReturn(0);
+
+        //act
+        unsigned char response[TEMP_CMD_LENGTH];
+        uint32_t resp_len = TEMP_CMD_LENGTH;
+        TPM_COMM_POLL_RESULT poll_result = tpm_comm_poll_complete(tpm_handle, response, &resp_len);
+
+        //assert
+        ASSERT_ARE_EQUAL(TPM_COMM_POLL_RESULT, TPM_COMM_POLL_PENDING, poll_result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_poll_complete_succeed)
+    {
+        //arrange
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        STRICT_EXPECTED_CALL(gbfiledesc_write(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+        (void)tpm_comm_submit_async(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(gbfiledesc_poll(IGNORED_PTR_ARG, 1, 0));
+        STRICT_EXPECTED_CALL(gbfiledesc_read(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+
+        //act
+        unsigned char response[TEMP_CMD_LENGTH];
+        uint32_t resp_len = TEMP_CMD_LENGTH;
+        TPM_COMM_POLL_RESULT poll_result = tpm_comm_poll_complete(tpm_handle, response, &resp_len);
+
+        //assert
+        ASSERT_ARE_EQUAL(TPM_COMM_POLL_RESULT, TPM_COMM_POLL_COMPLETE, poll_result);
+        ASSERT_ARE_EQUAL(uint32_t, TEMP_CMD_LENGTH, resp_len);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_get_wait_fd_succeed)
+    {
+        //arrange
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        umock_c_reset_all_calls();
+
+        //act
+        int wait_fd = tpm_comm_get_wait_fd(tpm_handle);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TEST_FD_VALUE, wait_fd);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_wait_any_handles_NULL_fail)
+    {
+        //arrange
+        bool ready[1];
+
+        //act
+        int wait_result = tpm_comm_wait_any(NULL, 1, 0, ready);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, -1, wait_result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_comm_wait_any_succeed)
+    {
+        //arrange
+        bool ready[2];
+        TPM_COMM_HANDLE tpm_handles[2];
+        tpm_handles[0] = tpm_comm_create(NULL);
+        tpm_handles[1] = tpm_comm_create(NULL);
+        STRICT_EXPECTED_CALL(gbfiledesc_write(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+        (void)tpm_comm_submit_async(tpm_handles[1], TEMP_TPM_COMMAND, TEMP_CMD_LENGTH);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(gbfiledesc_poll(IGNORED_PTR_ARG, 1, -1));
+
+        //act
+        int wait_result = tpm_comm_wait_any(tpm_handles, 2, 0, ready);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 1, wait_result);
+        ASSERT_IS_FALSE(ready[0]);
+        ASSERT_IS_TRUE(ready[1]);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handles[0]);
+        tpm_comm_destroy(tpm_handles[1]);
+    }
+
+    TEST_FUNCTION(tpm_comm_wait_any_two_pending_succeed)
+    {
+        //arrange
+        bool ready[2];
+        int submit_result[2];
+        TPM_COMM_HANDLE tpm_handles[2];
+        tpm_handles[0] = tpm_comm_create(NULL);
+        tpm_handles[1] = tpm_comm_create(NULL);
+        STRICT_EXPECTED_CALL(gbfiledesc_write(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+        STRICT_EXPECTED_CALL(gbfiledesc_write(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+        // Both commands are outstanding on the same device from one thread
+        submit_result[0] = tpm_comm_submit_async(tpm_handles[0], TEMP_TPM_COMMAND, TEMP_CMD_LENGTH);
+        submit_result[1] = tpm_comm_submit_async(tpm_handles[1], TEMP_TPM_COMMAND, TEMP_CMD_LENGTH);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(gbfiledesc_poll(IGNORED_PTR_ARG, 2, -1));
+
+        //act
+        int wait_result = tpm_comm_wait_any(tpm_handles, 2, 0, ready);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, submit_result[0]);
+        ASSERT_ARE_EQUAL(int, 0, submit_result[1]);
+        ASSERT_ARE_EQUAL(int, 1, wait_result);
+        ASSERT_IS_TRUE(ready[0]);
+        ASSERT_IS_FALSE(ready[1]);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handles[0]);
+        tpm_comm_destroy(tpm_handles[1]);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_with_async_outstanding_on_other_handle_succeed)
+    {
+        //arrange
+        unsigned char response[TEMP_CMD_LENGTH];
+        uint32_t resp_len = TEMP_CMD_LENGTH;
+        TPM_COMM_HANDLE async_handle = tpm_comm_create(NULL);
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        STRICT_EXPECTED_CALL(gbfiledesc_write(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+        (void)tpm_comm_submit_async(async_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(gbfiledesc_write(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+        STRICT_EXPECTED_CALL(gbfiledesc_read(IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEMP_CMD_LENGTH);
+
+        //act
+        int tpm_result = tpm_comm_submit_command(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH, response, &resp_len);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, tpm_result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(async_handle);
+        tpm_comm_destroy(tpm_handle);
+    }
+
     /*TEST_FUNCTION(tpm_comm_submit_command_succees)
     {
         //arrange
@@ -0,0 +1,646 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#else
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+#include "umocktypes_bool.h"
+#include "azure_c_shared_utility/macro_utils.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_utpm_c/tpm_timer.h"
+#include "azure_utpm_c/tpm_transcript.h"
+#undef ENABLE_MOCKS
+
+#include "azure_utpm_c/tpm_comm.h"
+#include "azure_utpm_c/tpm_comm_replay.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+#define TEST_REPLAY_ENDPOINT        "file:tpm_comm_replay_ut.trc"
+#define TEST_TRANSCRIPT_HANDLE      (TPM_TRANSCRIPT_HANDLE)0x5678
+#define TEST_RESPONSE_CAPACITY      64
+
+// TPM2_Startup(TPM_SU_CLEAR)
+static const unsigned char TEST_STARTUP_CMD[] = { 0x80, 0x01, 0x00, 0x00, 0x00, 0x0c, 0x00, 0x00, 0x01, 0x44, 0x00, 0x00 };
+// TPM2_GetRandom of 8 and of 16 bytes
+static const unsigned char TEST_GET_RANDOM_CMD[] = { 0x80, 0x01, 0x00, 0x00, 0x00, 0x0c, 0x00, 0x00, 0x01, 0x7b, 0x00, 0x08 };
+static const unsigned char TEST_GET_RANDOM_16_CMD[] = { 0x80, 0x01, 0x00, 0x00, 0x00, 0x0c, 0x00, 0x00, 0x01, 0x7b, 0x00, 0x10 };
+// TPM2_FlushContext of a session
+static const unsigned char TEST_FLUSH_CMD[] = { 0x80, 0x01, 0x00, 0x00, 0x00, 0x0e, 0x00, 0x00, 0x01, 0x65, 0x03, 0x00, 0x00, 0x00 };
+static const unsigned char TEST_RESPONSE[] = { 0x80, 0x01, 0x00, 0x00, 0x00, 0x0a, 0x00, 0x00, 0x00, 0x00 };
+
+// Playback of the transcript given to set_transcript
+static const TPM_TRANSCRIPT_ENTRY* g_entries;
+static size_t g_entry_count;
+static size_t g_entry_index;
+
+// Time of the fake clock, moved forward by every reading and by the sleeps
+static uint64_t g_now_ns;
+#define TEST_TIMER_STEP_NS          100000
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+TEST_DEFINE_ENUM_TYPE(TPM_COMM_TYPE, TPM_COMM_TYPE_VALUES);
+TEST_DEFINE_ENUM_TYPE(TPM_COMM_POLL_RESULT, TPM_COMM_POLL_RESULT_VALUES);
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+static bool my_tpm_transcript_next(TPM_TRANSCRIPT_HANDLE handle, TPM_TRANSCRIPT_ENTRY* entry)
+{
+    bool result;
+    (void)handle;
+    if (g_entry_index < g_entry_count)
+    {
+        *entry = g_entries[g_entry_index++];
+        result = true;
+    }
+    else
+    {
+        result = false;
+    }
+    return result;
+}
+
+static bool my_tpm_transcript_peek(TPM_TRANSCRIPT_HANDLE handle, TPM_TRANSCRIPT_ENTRY* entry)
+{
+    bool result;
+    (void)handle;
+    if (g_entry_index < g_entry_count)
+    {
+        *entry = g_entries[g_entry_index];
+        result = true;
+    }
+    else
+    {
+        result = false;
+    }
+    return result;
+}
+
+static uint64_t my_tpm_timer_get_ns(void)
+{
+    g_now_ns += TEST_TIMER_STEP_NS;
+    return g_now_ns;
+}
+
+static void my_ThreadAPI_Sleep(unsigned int milliseconds)
+{
+    g_now_ns += (uint64_t)milliseconds * 1000000;
+}
+
+static void set_transcript(const TPM_TRANSCRIPT_ENTRY* entries, size_t count)
+{
+    g_entries = entries;
+    g_entry_count = count;
+    g_entry_index = 0;
+}
+
+static TPM_TRANSCRIPT_ENTRY make_entry(const unsigned char* cmd, uint32_t cmd_len, uint32_t resp_len, uint64_t latency_ns)
+{
+    TPM_TRANSCRIPT_ENTRY result;
+    result.cmd_bytes = cmd;
+    result.cmd_len = cmd_len;
+    result.resp_bytes = TEST_RESPONSE;
+    result.resp_len = resp_len;
+    result.latency_ns = latency_ns;
+    return result;
+}
+
+static TPM_COMM_HANDLE create_replay_handle(void)
+{
+    TPM_COMM_HANDLE result = tpm_comm_create(TEST_REPLAY_ENDPOINT);
+    ASSERT_IS_NOT_NULL(result);
+    umock_c_reset_all_calls();
+    return result;
+}
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+BEGIN_TEST_SUITE(tpm_comm_replay_ut)
+
+    TEST_SUITE_INITIALIZE(suite_init)
+    {
+        int result;
+
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = TEST_MUTEX_CREATE();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+
+        (void)umock_c_init(on_umock_c_error);
+
+        result = umocktypes_charptr_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+        result = umocktypes_stdint_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+        result = umocktypes_bool_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+
+        REGISTER_UMOCK_ALIAS_TYPE(TPM_TRANSCRIPT_HANDLE, void*);
+        REGISTER_UMOCK_ALIAS_TYPE(TPM_TRANSCRIPT_ENTRY*, void*);
+
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+        REGISTER_GLOBAL_MOCK_RETURN(tpm_transcript_open, TEST_TRANSCRIPT_HANDLE);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(tpm_transcript_open, NULL);
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_transcript_next, my_tpm_transcript_next);
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_transcript_peek, my_tpm_transcript_peek);
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_timer_get_ns, my_tpm_timer_get_ns);
+        REGISTER_GLOBAL_MOCK_HOOK(ThreadAPI_Sleep, my_ThreadAPI_Sleep);
+    }
+
+    TEST_SUITE_CLEANUP(suite_cleanup)
+    {
+        umock_c_deinit();
+
+        TEST_MUTEX_DESTROY(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(method_init)
+    {
+        if (TEST_MUTEX_ACQUIRE(g_testByTest))
+        {
+            ASSERT_FAIL("Could not acquire test serialization mutex.");
+        }
+        umock_c_reset_all_calls();
+        set_transcript(NULL, 0);
+        g_now_ns = 0;
+    }
+
+    TEST_FUNCTION_CLEANUP(method_cleanup)
+    {
+        TEST_MUTEX_RELEASE(g_testByTest);
+    }
+
+    TEST_FUNCTION(tpm_comm_create_succeed)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(tpm_transcript_open("tpm_comm_replay_ut.trc"));
+
+        //act
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(TEST_REPLAY_ENDPOINT);
+
+        //assert
+        ASSERT_IS_NOT_NULL(tpm_handle);
+        ASSERT_ARE_EQUAL(TPM_COMM_TYPE, TPM_COMM_TYPE_REPLAY, tpm_comm_get_type(tpm_handle));
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_create_not_a_file_endpoint_fail)
+    {
+        //arrange
+
+        //act
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create("unix:///run/tpm/trm.sock");
+
+        //assert
+        ASSERT_IS_NULL(tpm_handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_comm_create_open_fail)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(tpm_transcript_open(IGNORED_PTR_ARG)).SetReturn(NULL);
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+        //act
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(TEST_REPLAY_ENDPOINT);
+
+        //assert
+        ASSERT_IS_NULL(tpm_handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_comm_destroy_succeed)
+    {
+        //arrange
+        TPM_COMM_HANDLE tpm_handle = create_replay_handle();
+
+        STRICT_EXPECTED_CALL(tpm_transcript_close(TEST_TRANSCRIPT_HANDLE));
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+        //act
+        tpm_comm_destroy(tpm_handle);
+
+        //assert
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_matching_succeed)
+    {
+        //arrange
+        TPM_TRANSCRIPT_ENTRY entries[1];
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(response);
+        TPM_COMM_HANDLE tpm_handle = create_replay_handle();
+
+        entries[0] = make_entry(TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), sizeof(TEST_RESPONSE), 0);
+        set_transcript(entries, 1);
+        STRICT_EXPECTED_CALL(tpm_transcript_next(TEST_TRANSCRIPT_HANDLE, IGNORED_PTR_ARG));
+
+        //act
+        int result = tpm_comm_submit_command(tpm_handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), response, &resp_len);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(uint32_t, sizeof(TEST_RESPONSE), resp_len);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(TEST_RESPONSE, response, sizeof(TEST_RESPONSE)));
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_differing_parameters_succeed)
+    {
+        //arrange
+        TPM_TRANSCRIPT_ENTRY entries[1];
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(response);
+        TPM_COMM_HANDLE tpm_handle = create_replay_handle();
+
+        // Only the command code has to match
+        entries[0] = make_entry(TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), sizeof(TEST_RESPONSE), 0);
+        set_transcript(entries, 1);
+        STRICT_EXPECTED_CALL(tpm_transcript_next(TEST_TRANSCRIPT_HANDLE, IGNORED_PTR_ARG));
+
+        //act
+        int result = tpm_comm_submit_command(tpm_handle, TEST_GET_RANDOM_16_CMD, sizeof(TEST_GET_RANDOM_16_CMD), response, &resp_len);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(uint32_t, sizeof(TEST_RESPONSE), resp_len);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_mismatched_command_fail)
+    {
+        //arrange
+        TPM_TRANSCRIPT_ENTRY entries[1];
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(response);
+        TPM_COMM_HANDLE tpm_handle = create_replay_handle();
+
+        entries[0] = make_entry(TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), sizeof(TEST_RESPONSE), 0);
+        set_transcript(entries, 1);
+        STRICT_EXPECTED_CALL(tpm_transcript_next(TEST_TRANSCRIPT_HANDLE, IGNORED_PTR_ARG));
+
+        //act
+        int result = tpm_comm_submit_command(tpm_handle, TEST_FLUSH_CMD, sizeof(TEST_FLUSH_CMD), response, &resp_len);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_malformed_command_fail)
+    {
+        //arrange
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(response);
+        TPM_COMM_HANDLE tpm_handle = create_replay_handle();
+
+        //act
+        int result = tpm_comm_submit_command(tpm_handle, TEST_GET_RANDOM_CMD, 6, response, &resp_len);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_past_end_of_transcript_fail)
+    {
+        //arrange
+        TPM_TRANSCRIPT_ENTRY entries[1];
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(response);
+        TPM_COMM_HANDLE tpm_handle = create_replay_handle();
+
+        entries[0] = make_entry(TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), sizeof(TEST_RESPONSE), 0);
+        set_transcript(entries, 1);
+        (void)tpm_comm_submit_command(tpm_handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), response, &resp_len);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(tpm_transcript_next(TEST_TRANSCRIPT_HANDLE, IGNORED_PTR_ARG));
+
+        //act
+        resp_len = sizeof(response);
+        int result = tpm_comm_submit_command(tpm_handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), response, &resp_len);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_recorded_transport_failure_fail)
+    {
+        //arrange
+        TPM_TRANSCRIPT_ENTRY entries[1];
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(response);
+        TPM_COMM_HANDLE tpm_handle = create_replay_handle();
+
+        entries[0] = make_entry(TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), 0, 0);
+        set_transcript(entries, 1);
+        STRICT_EXPECTED_CALL(tpm_transcript_next(TEST_TRANSCRIPT_HANDLE, IGNORED_PTR_ARG));
+
+        //act
+        int result = tpm_comm_submit_command(tpm_handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), response, &resp_len);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_response_buffer_too_small_fail)
+    {
+        //arrange
+        TPM_TRANSCRIPT_ENTRY entries[1];
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(TEST_RESPONSE) - 1;
+        TPM_COMM_HANDLE tpm_handle = create_replay_handle();
+
+        entries[0] = make_entry(TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), sizeof(TEST_RESPONSE), 0);
+        set_transcript(entries, 1);
+        STRICT_EXPECTED_CALL(tpm_transcript_next(TEST_TRANSCRIPT_HANDLE, IGNORED_PTR_ARG));
+
+        //act
+        int result = tpm_comm_submit_command(tpm_handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), response, &resp_len);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_no_latency_by_default_succeed)
+    {
+        //arrange
+        TPM_TRANSCRIPT_ENTRY entries[1];
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(response);
+        TPM_COMM_HANDLE tpm_handle = create_replay_handle();
+
+        entries[0] = make_entry(TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), sizeof(TEST_RESPONSE), 5000000);
+        set_transcript(entries, 1);
+        // Neither the clock nor a sleep
+        STRICT_EXPECTED_CALL(tpm_transcript_next(TEST_TRANSCRIPT_HANDLE, IGNORED_PTR_ARG));
+
+        //act
+        int result = tpm_comm_submit_command(tpm_handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), response, &resp_len);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_recorded_latency_succeed)
+    {
+        //arrange
+        TPM_TRANSCRIPT_ENTRY entries[1];
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(response);
+        uint64_t latency_ns = 2500000;
+        uint64_t start_ns;
+        TPM_COMM_HANDLE tpm_handle = create_replay_handle();
+
+        entries[0] = make_entry(TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), sizeof(TEST_RESPONSE), latency_ns);
+        set_transcript(entries, 1);
+        ASSERT_ARE_EQUAL(int, 0, tpm_comm_replay_set_latency(tpm_handle, true));
+        umock_c_reset_all_calls();
+        start_ns = g_now_ns;
+
+        //act
+        int result = tpm_comm_submit_command(tpm_handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), response, &resp_len);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        // Whole milliseconds are slept, and the rest is spun on the clock
+        ASSERT_IS_NOT_NULL(strstr(umock_c_get_actual_calls(), "ThreadAPI_Sleep(2)"));
+        ASSERT_IS_TRUE(g_now_ns - start_ns >= latency_ns);
+        ASSERT_IS_TRUE(g_now_ns - start_ns < latency_ns + 2 * TEST_TIMER_STEP_NS);
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_replay_set_latency_handle_NULL_fail)
+    {
+        //arrange
+
+        //act
+        int result = tpm_comm_replay_set_latency(NULL, true);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_async_poll_complete_succeed)
+    {
+        //arrange
+        TPM_TRANSCRIPT_ENTRY entries[1];
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(response);
+        bool ready = false;
+        TPM_COMM_HANDLE tpm_handle = create_replay_handle();
+
+        entries[0] = make_entry(TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), sizeof(TEST_RESPONSE), 0);
+        set_transcript(entries, 1);
+
+        //act
+        int result = tpm_comm_submit_async(tpm_handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD));
+        int ready_count = tpm_comm_wait_any(&tpm_handle, 1, 0, &ready);
+        TPM_COMM_POLL_RESULT poll_result = tpm_comm_poll_complete(tpm_handle, response, &resp_len);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(int, 1, ready_count);
+        ASSERT_IS_TRUE(ready);
+        ASSERT_ARE_EQUAL(TPM_COMM_POLL_RESULT, TPM_COMM_POLL_COMPLETE, poll_result);
+        ASSERT_ARE_EQUAL(uint32_t, sizeof(TEST_RESPONSE), resp_len);
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_async_pending_fail)
+    {
+        //arrange
+        TPM_TRANSCRIPT_ENTRY entries[2];
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(response);
+        TPM_COMM_HANDLE tpm_handle = create_replay_handle();
+
+        entries[0] = make_entry(TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), sizeof(TEST_RESPONSE), 0);
+        entries[1] = entries[0];
+        set_transcript(entries, 2);
+        (void)tpm_comm_submit_async(tpm_handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD));
+        umock_c_reset_all_calls();
+
+        //act
+        int result = tpm_comm_submit_command(tpm_handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), response, &resp_len);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_needs_startup_recorded_startup_succeed)
+    {
+        //arrange
+        TPM_TRANSCRIPT_ENTRY entries[1];
+        TPM_COMM_HANDLE tpm_handle = create_replay_handle();
+
+        entries[0] = make_entry(TEST_STARTUP_CMD, sizeof(TEST_STARTUP_CMD), sizeof(TEST_RESPONSE), 0);
+        set_transcript(entries, 1);
+        STRICT_EXPECTED_CALL(tpm_transcript_peek(TEST_TRANSCRIPT_HANDLE, IGNORED_PTR_ARG));
+
+        //act
+        bool result = tpm_comm_needs_startup(tpm_handle);
+
+        //assert
+        ASSERT_IS_TRUE(result);
+        // The record is left for the TPM2_Startup command
+        ASSERT_ARE_EQUAL(size_t, 0, g_entry_index);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_needs_startup_other_command_succeed)
+    {
+        //arrange
+        TPM_TRANSCRIPT_ENTRY entries[1];
+        TPM_COMM_HANDLE tpm_handle = create_replay_handle();
+
+        entries[0] = make_entry(TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), sizeof(TEST_RESPONSE), 0);
+        set_transcript(entries, 1);
+        STRICT_EXPECTED_CALL(tpm_transcript_peek(TEST_TRANSCRIPT_HANDLE, IGNORED_PTR_ARG));
+
+        //act
+        bool result = tpm_comm_needs_startup(tpm_handle);
+
+        //assert
+        ASSERT_IS_FALSE(result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_needs_startup_empty_transcript_succeed)
+    {
+        //arrange
+        TPM_COMM_HANDLE tpm_handle = create_replay_handle();
+
+        STRICT_EXPECTED_CALL(tpm_transcript_peek(TEST_TRANSCRIPT_HANDLE, IGNORED_PTR_ARG));
+
+        //act
+        bool result = tpm_comm_needs_startup(tpm_handle);
+
+        //assert
+        ASSERT_IS_FALSE(result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_needs_startup_handle_NULL_fail)
+    {
+        //arrange
+
+        //act
+        bool result = tpm_comm_needs_startup(NULL);
+
+        //assert
+        ASSERT_IS_FALSE(result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+END_TEST_SUITE(tpm_comm_replay_ut)
@@ -0,0 +1,834 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#else
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+#include "umocktypes_bool.h"
+#include "azure_c_shared_utility/macro_utils.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_utpm_c/tpm_timer.h"
+#undef ENABLE_MOCKS
+
+// Included by tpm_shm_sys.h, whose functions only are mocked
+#include "azure_utpm_c/tpm_comm.h"
+#include "azure_utpm_c/tpm_shm_broker.h"
+
+#define ENABLE_MOCKS
+#include "azure_utpm_c/tpm_shm_sys.h"
+#undef ENABLE_MOCKS
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+#define TEST_SHM_ENDPOINT           "shm:utpmtest"
+#define TEST_BROKER_NAME            "utpmtest"
+#define TEST_SOCKET                 7
+#define TEST_BROKER_PID             4321
+#define TEST_RESPONSE_CAPACITY      64
+#define TEST_TIMER_STEP_NS          1000000
+
+// TPM2_GetRandom of 8 bytes
+static const unsigned char TEST_GET_RANDOM_CMD[] = { 0x80, 0x01, 0x00, 0x00, 0x00, 0x0c, 0x00, 0x00, 0x01, 0x7b, 0x00, 0x08 };
+static const unsigned char TEST_RESPONSE[] = { 0x80, 0x01, 0x00, 0x00, 0x00, 0x0a, 0x00, 0x00, 0x00, 0x00 };
+
+// When the fake broker answers the commands written to the slots
+#define BROKER_ON_DOORBELL          0
+#define BROKER_ON_WAIT              1
+#define BROKER_NEVER                2
+
+// Segments passed by the fake broker to the first and the second handle
+static TPM_SHM_SEGMENT g_segment;
+static TPM_SHM_SEGMENT g_other_segment;
+static size_t g_received_count;
+static int g_broker_answers;
+// resp_len the fake broker writes to the slot
+static uint32_t g_broker_resp_len;
+static bool g_broker_alive;
+static uint64_t g_now_ns;
+
+// Larger than any command taken by the broker
+static unsigned char g_large_cmd[TPM_SHM_BUFFER_SIZE + 1];
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+TEST_DEFINE_ENUM_TYPE(TPM_COMM_TYPE, TPM_COMM_TYPE_VALUES);
+TEST_DEFINE_ENUM_TYPE(TPM_COMM_POLL_RESULT, TPM_COMM_POLL_RESULT_VALUES);
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+static void answer_command(TPM_SHM_SLOT* slot)
+{
+    if (slot->cmd_seq != slot->resp_seq)
+    {
+        memcpy(slot->resp, TEST_RESPONSE, sizeof(TEST_RESPONSE));
+        slot->resp_len = g_broker_resp_len;
+        slot->resp_seq = slot->cmd_seq;
+    }
+}
+
+static void answer_commands(void)
+{
+    answer_command(&g_segment.slot);
+    answer_command(&g_other_segment.slot);
+}
+
+static TPM_SHM_SEGMENT* my_tpm_shm_sys_receive_segment(int s)
+{
+    (void)s;
+    return g_received_count++ == 0 ? &g_segment : &g_other_segment;
+}
+
+static int my_tpm_shm_sys_ring(int s)
+{
+    (void)s;
+    if (g_broker_answers == BROKER_ON_DOORBELL)
+    {
+        answer_commands();
+    }
+    return 0;
+}
+
+static void my_tpm_shm_sys_wait(TPM_SHM_WORD* word, uint32_t value, uint32_t timeout_ms)
+{
+    (void)word;
+    (void)value;
+    (void)timeout_ms;
+    if (g_broker_answers == BROKER_ON_WAIT)
+    {
+        answer_commands();
+    }
+}
+
+static void my_tpm_shm_sys_wait_any(TPM_SHM_WORD** words, const uint32_t* values, size_t count, uint32_t timeout_ms)
+{
+    (void)words;
+    (void)values;
+    (void)count;
+    (void)timeout_ms;
+    if (g_broker_answers == BROKER_ON_WAIT)
+    {
+        answer_commands();
+    }
+}
+
+static bool my_tpm_shm_sys_is_alive(int32_t pid)
+{
+    (void)pid;
+    return g_broker_alive;
+}
+
+static uint64_t my_tpm_timer_get_ns(void)
+{
+    g_now_ns += TEST_TIMER_STEP_NS;
+    return g_now_ns;
+}
+
+static TPM_COMM_HANDLE create_shm_handle(void)
+{
+    TPM_COMM_HANDLE result = tpm_comm_create(TEST_SHM_ENDPOINT);
+    ASSERT_IS_NOT_NULL(result);
+    umock_c_reset_all_calls();
+    return result;
+}
+
+static void setup_create_mocks(void)
+{
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(tpm_shm_sys_connect(TEST_BROKER_NAME));
+    STRICT_EXPECTED_CALL(tpm_shm_sys_receive_segment(TEST_SOCKET));
+    STRICT_EXPECTED_CALL(tpm_shm_sys_is_alive(TEST_BROKER_PID));
+}
+
+static void init_segment(TPM_SHM_SEGMENT* segment)
+{
+    memset(segment, 0, sizeof(TPM_SHM_SEGMENT));
+    segment->magic = TPM_SHM_MAGIC;
+    segment->version = TPM_SHM_VERSION;
+    segment->broker_pid = TEST_BROKER_PID;
+    segment->slot.priority = TPM_COMM_PRIORITY_NORMAL;
+}
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+BEGIN_TEST_SUITE(tpm_comm_shm_ut)
+
+    TEST_SUITE_INITIALIZE(suite_init)
+    {
+        int result;
+
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = TEST_MUTEX_CREATE();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+
+        (void)umock_c_init(on_umock_c_error);
+
+        result = umocktypes_charptr_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+        result = umocktypes_stdint_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+        result = umocktypes_bool_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+
+        REGISTER_UMOCK_ALIAS_TYPE(TPM_SHM_SEGMENT*, void*);
+        REGISTER_UMOCK_ALIAS_TYPE(TPM_SHM_WORD*, void*);
+        REGISTER_UMOCK_ALIAS_TYPE(TPM_SHM_WORD**, void*);
+        REGISTER_UMOCK_ALIAS_TYPE(const uint32_t*, void*);
+
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+        REGISTER_GLOBAL_MOCK_RETURN(tpm_shm_sys_connect, TEST_SOCKET);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(tpm_shm_sys_connect, -1);
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_shm_sys_receive_segment, my_tpm_shm_sys_receive_segment);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(tpm_shm_sys_receive_segment, NULL);
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_shm_sys_ring, my_tpm_shm_sys_ring);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(tpm_shm_sys_ring, __LINE__);
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_shm_sys_wait, my_tpm_shm_sys_wait);
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_shm_sys_wait_any, my_tpm_shm_sys_wait_any);
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_shm_sys_is_alive, my_tpm_shm_sys_is_alive);
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_timer_get_ns, my_tpm_timer_get_ns);
+    }
+
+    TEST_SUITE_CLEANUP(suite_cleanup)
+    {
+        umock_c_deinit();
+
+        TEST_MUTEX_DESTROY(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(method_init)
+    {
+        if (TEST_MUTEX_ACQUIRE(g_testByTest))
+        {
+            ASSERT_FAIL("Could not acquire test serialization mutex.");
+        }
+        umock_c_reset_all_calls();
+
+        init_segment(&g_segment);
+        init_segment(&g_other_segment);
+        g_received_count = 0;
+        g_broker_answers = BROKER_ON_DOORBELL;
+        g_broker_resp_len = sizeof(TEST_RESPONSE);
+        g_broker_alive = true;
+        g_now_ns = 0;
+    }
+
+    TEST_FUNCTION_CLEANUP(method_cleanup)
+    {
+        TEST_MUTEX_RELEASE(g_testByTest);
+    }
+
+    TEST_FUNCTION(tpm_comm_create_receives_segment_succeed)
+    {
+        //arrange
+        setup_create_mocks();
+
+        //act
+        TPM_COMM_HANDLE handle = tpm_comm_create(TEST_SHM_ENDPOINT);
+
+        //assert
+        ASSERT_IS_NOT_NULL(handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(TPM_COMM_TYPE, TPM_COMM_TYPE_BROKER, tpm_comm_get_type(handle));
+        ASSERT_IS_FALSE(tpm_comm_needs_startup(handle));
+
+        //cleanup
+        tpm_comm_destroy(handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_create_broker_refused_fail)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_connect(TEST_BROKER_NAME));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_receive_segment(TEST_SOCKET)).SetReturn(NULL);
+        STRICT_EXPECTED_CALL(tpm_shm_sys_close(TEST_SOCKET));
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+        //act
+        TPM_COMM_HANDLE handle = tpm_comm_create(TEST_SHM_ENDPOINT);
+
+        //assert
+        ASSERT_IS_NULL(handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_comm_create_broker_not_running_fail)
+    {
+        //arrange
+        g_broker_alive = false;
+
+        setup_create_mocks();
+        STRICT_EXPECTED_CALL(tpm_shm_sys_unmap(&g_segment));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_close(TEST_SOCKET));
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+        //act
+        TPM_COMM_HANDLE handle = tpm_comm_create(TEST_SHM_ENDPOINT);
+
+        //assert
+        ASSERT_IS_NULL(handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_comm_create_other_version_fail)
+    {
+        //arrange
+        g_segment.version = TPM_SHM_VERSION + 1;
+
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_connect(TEST_BROKER_NAME));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_receive_segment(TEST_SOCKET));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_unmap(&g_segment));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_close(TEST_SOCKET));
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+        //act
+        TPM_COMM_HANDLE handle = tpm_comm_create(TEST_SHM_ENDPOINT);
+
+        //assert
+        ASSERT_IS_NULL(handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_comm_create_no_broker_fail)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_connect(TEST_BROKER_NAME)).SetReturn(-1);
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+        //act
+        TPM_COMM_HANDLE handle = tpm_comm_create(TEST_SHM_ENDPOINT);
+
+        //assert
+        ASSERT_IS_NULL(handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_comm_create_not_a_broker_endpoint_fail)
+    {
+        //arrange
+
+        //act
+        TPM_COMM_HANDLE handle = tpm_comm_create("dev:/dev/tpmrm0");
+
+        //assert
+        ASSERT_IS_NULL(handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_comm_destroy_closes_connection_succeed)
+    {
+        //arrange
+        TPM_COMM_HANDLE handle = create_shm_handle();
+
+        STRICT_EXPECTED_CALL(tpm_shm_sys_unmap(&g_segment));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_close(TEST_SOCKET));
+        STRICT_EXPECTED_CALL(gballoc_free(handle));
+
+        //act
+        tpm_comm_destroy(handle);
+
+        //assert
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_round_trip_succeed)
+    {
+        //arrange
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(response);
+        TPM_COMM_HANDLE handle = create_shm_handle();
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_shm_sys_ring(TEST_SOCKET));
+
+        //act
+        int result = tpm_comm_submit_command(handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), response, &resp_len);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(uint32_t, sizeof(TEST_RESPONSE), resp_len);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(response, TEST_RESPONSE, sizeof(TEST_RESPONSE)));
+        ASSERT_ARE_EQUAL(uint32_t, sizeof(TEST_GET_RANDOM_CMD), g_segment.slot.cmd_len);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(g_segment.slot.cmd, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD)));
+        ASSERT_ARE_EQUAL(uint32_t, 1, g_segment.slot.cmd_seq);
+
+        //cleanup
+        tpm_comm_destroy(handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_waits_for_response_succeed)
+    {
+        //arrange
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(response);
+        TPM_COMM_HANDLE handle = create_shm_handle();
+        g_broker_answers = BROKER_ON_WAIT;
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_shm_sys_ring(TEST_SOCKET));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_shm_sys_is_alive(TEST_BROKER_PID));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_wait(&g_segment.slot.resp_seq, 0, 100));
+
+        //act
+        int result = tpm_comm_submit_command(handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), response, &resp_len);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(uint32_t, sizeof(TEST_RESPONSE), resp_len);
+
+        //cleanup
+        tpm_comm_destroy(handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_response_bigger_than_slot_fail)
+    {
+        //arrange
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(response);
+        TPM_COMM_HANDLE handle = create_shm_handle();
+        g_broker_resp_len = TPM_SHM_BUFFER_SIZE + 1;
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_shm_sys_ring(TEST_SOCKET));
+
+        //act
+        int result = tpm_comm_submit_command(handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), response, &resp_len);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_response_bigger_than_buffer_fail)
+    {
+        //arrange
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(TEST_RESPONSE) - 1;
+        TPM_COMM_HANDLE handle = create_shm_handle();
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_shm_sys_ring(TEST_SOCKET));
+
+        //act
+        int result = tpm_comm_submit_command(handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), response, &resp_len);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_command_bigger_than_slot_fail)
+    {
+        //arrange
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(response);
+        TPM_COMM_HANDLE handle = create_shm_handle();
+
+        //act
+        int result = tpm_comm_submit_command(handle, g_large_cmd, sizeof(g_large_cmd), response, &resp_len);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(uint32_t, 0, g_segment.slot.cmd_seq);
+
+        //cleanup
+        tpm_comm_destroy(handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_broker_failure_fail)
+    {
+        //arrange
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(response);
+        TPM_COMM_HANDLE handle = create_shm_handle();
+        g_broker_resp_len = 0;
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_shm_sys_ring(TEST_SOCKET));
+
+        //act
+        int result = tpm_comm_submit_command(handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), response, &resp_len);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_broker_exits_mid_command_fail)
+    {
+        //arrange
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(response);
+        TPM_COMM_HANDLE handle = create_shm_handle();
+        g_broker_answers = BROKER_NEVER;
+        g_broker_alive = false;
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_shm_sys_ring(TEST_SOCKET));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_shm_sys_is_alive(TEST_BROKER_PID));
+
+        //act
+        int result = tpm_comm_submit_command(handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), response, &resp_len);
+        int next = tpm_comm_submit_command(handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), response, &resp_len);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_NOT_EQUAL(int, 0, next);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_timeout_fail)
+    {
+        //arrange
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(response);
+        TPM_COMM_HANDLE handle = create_shm_handle();
+        (void)tpm_comm_set_timeout(handle, 1);
+        g_broker_answers = BROKER_NEVER;
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_shm_sys_ring(TEST_SOCKET));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_shm_sys_is_alive(TEST_BROKER_PID));
+
+        //act
+        int result = tpm_comm_submit_command(handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), response, &resp_len);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_broker_unreachable_fail)
+    {
+        //arrange
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(response);
+        TPM_COMM_HANDLE handle = create_shm_handle();
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_shm_sys_ring(TEST_SOCKET)).SetReturn(__LINE__);
+
+        //act
+        int result = tpm_comm_submit_command(handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), response, &resp_len);
+        int next = tpm_comm_submit_async(handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD));
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_NOT_EQUAL(int, 0, next);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_async_poll_complete_succeed)
+    {
+        //arrange
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(response);
+        bool ready = false;
+        TPM_COMM_HANDLE handle = create_shm_handle();
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_shm_sys_ring(TEST_SOCKET));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+
+        //act
+        int result = tpm_comm_submit_async(handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD));
+        int ready_count = tpm_comm_wait_any(&handle, 1, 0, &ready);
+        TPM_COMM_POLL_RESULT poll_result = tpm_comm_poll_complete(handle, response, &resp_len);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(int, 1, ready_count);
+        ASSERT_IS_TRUE(ready);
+        ASSERT_ARE_EQUAL(TPM_COMM_POLL_RESULT, TPM_COMM_POLL_COMPLETE, poll_result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(uint32_t, sizeof(TEST_RESPONSE), resp_len);
+
+        //cleanup
+        tpm_comm_destroy(handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_async_returns_before_response_succeed)
+    {
+        //arrange
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(response);
+        TPM_COMM_HANDLE handle = create_shm_handle();
+        g_broker_answers = BROKER_NEVER;
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_shm_sys_ring(TEST_SOCKET));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_shm_sys_is_alive(TEST_BROKER_PID));
+
+        //act
+        int result = tpm_comm_submit_async(handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD));
+        TPM_COMM_POLL_RESULT poll_result = tpm_comm_poll_complete(handle, response, &resp_len);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(TPM_COMM_POLL_RESULT, TPM_COMM_POLL_PENDING, poll_result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(uint32_t, 1, g_segment.slot.cmd_seq);
+        ASSERT_ARE_EQUAL(uint32_t, 0, g_segment.slot.resp_seq);
+
+        //cleanup
+        tpm_comm_destroy(handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_poll_complete_broker_exits_fail)
+    {
+        //arrange
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(response);
+        TPM_COMM_HANDLE handle = create_shm_handle();
+        g_broker_answers = BROKER_NEVER;
+        (void)tpm_comm_submit_async(handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD));
+        g_broker_alive = false;
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_shm_sys_is_alive(TEST_BROKER_PID));
+
+        //act
+        TPM_COMM_POLL_RESULT poll_result = tpm_comm_poll_complete(handle, response, &resp_len);
+        int next = tpm_comm_submit_async(handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD));
+
+        //assert
+        ASSERT_ARE_EQUAL(TPM_COMM_POLL_RESULT, TPM_COMM_POLL_ERROR, poll_result);
+        ASSERT_ARE_NOT_EQUAL(int, 0, next);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_wait_any_two_pending_succeed)
+    {
+        //arrange
+        TPM_COMM_HANDLE handles[2];
+        bool ready[2];
+        handles[0] = create_shm_handle();
+        handles[1] = create_shm_handle();
+        g_broker_answers = BROKER_NEVER;
+        (void)tpm_comm_submit_async(handles[0], TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD));
+        (void)tpm_comm_submit_async(handles[1], TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD));
+        g_broker_answers = BROKER_ON_WAIT;
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_shm_sys_is_alive(TEST_BROKER_PID));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_shm_sys_is_alive(TEST_BROKER_PID));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_shm_sys_wait_any(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 2, 100));
+
+        //act
+        int result = tpm_comm_wait_any(handles, 2, 0, ready);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 2, result);
+        ASSERT_IS_TRUE(ready[0]);
+        ASSERT_IS_TRUE(ready[1]);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(handles[1]);
+        tpm_comm_destroy(handles[0]);
+    }
+
+    TEST_FUNCTION(tpm_comm_wait_any_other_answered_succeed)
+    {
+        //arrange
+        TPM_COMM_HANDLE handles[2];
+        bool ready[2];
+        handles[0] = create_shm_handle();
+        handles[1] = create_shm_handle();
+        g_broker_answers = BROKER_NEVER;
+        (void)tpm_comm_submit_async(handles[0], TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD));
+        (void)tpm_comm_submit_async(handles[1], TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD));
+        g_other_segment.slot.resp_len = g_broker_resp_len;
+        g_other_segment.slot.resp_seq = g_other_segment.slot.cmd_seq;
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_shm_sys_is_alive(TEST_BROKER_PID));
+
+        //act
+        int result = tpm_comm_wait_any(handles, 2, 0, ready);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 1, result);
+        ASSERT_IS_FALSE(ready[0]);
+        ASSERT_IS_TRUE(ready[1]);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(handles[1]);
+        tpm_comm_destroy(handles[0]);
+    }
+
+    TEST_FUNCTION(tpm_comm_wait_any_timeout_succeed)
+    {
+        //arrange
+        TPM_COMM_HANDLE handle = create_shm_handle();
+        bool ready = true;
+        g_broker_answers = BROKER_NEVER;
+        (void)tpm_comm_submit_async(handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD));
+        umock_c_reset_all_calls();
+
+        //act
+        int result = tpm_comm_wait_any(&handle, 1, 5, &ready);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_IS_FALSE(ready);
+        ASSERT_ARE_EQUAL(uint32_t, 0, g_segment.slot.resp_seq);
+
+        //cleanup
+        tpm_comm_destroy(handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_async_outstanding_fail)
+    {
+        //arrange
+        unsigned char response[TEST_RESPONSE_CAPACITY];
+        uint32_t resp_len = sizeof(response);
+        TPM_COMM_HANDLE handle = create_shm_handle();
+        (void)tpm_comm_submit_async(handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD));
+        umock_c_reset_all_calls();
+
+        //act
+        int result = tpm_comm_submit_command(handle, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD), response, &resp_len);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_needs_startup_first_handle_only_succeed)
+    {
+        //arrange
+        TPM_COMM_HANDLE first;
+        TPM_COMM_HANDLE second;
+        // Set by the broker in the segment of its first client only
+        g_segment.needs_startup = 1;
+        first = create_shm_handle();
+        second = create_shm_handle();
+
+        //act
+        bool first_result = tpm_comm_needs_startup(first);
+        bool second_result = tpm_comm_needs_startup(second);
+
+        //assert
+        ASSERT_IS_TRUE(first_result);
+        ASSERT_IS_FALSE(second_result);
+
+        //cleanup
+        tpm_comm_destroy(second);
+        tpm_comm_destroy(first);
+    }
+
+    TEST_FUNCTION(tpm_comm_set_priority_succeed)
+    {
+        //arrange
+        TPM_COMM_HANDLE handle = create_shm_handle();
+
+        //act
+        int result = tpm_comm_set_priority(handle, TPM_COMM_PRIORITY_HIGH);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(uint32_t, TPM_COMM_PRIORITY_HIGH, g_segment.slot.priority);
+
+        //cleanup
+        tpm_comm_destroy(handle);
+    }
+
+END_TEST_SUITE(tpm_comm_shm_ut)
@@ -5,10 +5,12 @@
 #include <cstdlib>
 #include <cstdint>
 #include <cstddef>
+#include <cstring>
 #else
 #include <stdlib.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
 #endif
 
 static void* my_gballoc_malloc(size_t size)
@@ -25,6 +27,7 @@ static void my_gballoc_free(void* ptr)
 #include "umock_c.h"
 #include "umocktypes_charptr.h"
 #include "umocktypes_stdint.h"
+#include "umocktypes_bool.h"
 #include "umock_c_negative_tests.h"
 #include "azure_c_shared_utility/macro_utils.h"
 
@@ -33,6 +36,7 @@ static void my_gballoc_free(void* ptr)
 #include <windows.h>
 #include <tbs.h>
 #include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_utpm_c/tpm_win32_sys.h"
 
 MOCKABLE_FUNCTION(WINAPI, TBS_RESULT, Tbsi_Context_Create, PCTBS_CONTEXT_PARAMS, pContextParams, PTBS_HCONTEXT, phContext);
 MOCKABLE_FUNCTION(WINAPI, TBS_RESULT, Tbsi_GetDeviceInfo, uint32_t, size, PVOID, info);
@@ -56,6 +60,14 @@ static const unsigned char* TEMP_TPM_COMMAND = (const unsigned char*)0x00012345;
 #define TEMP_CMD_LENGTH         128
 static UINT32 g_tpm_version = TPM_VERSION_20;
 
+// Work queued to the thread pool, run by the tests with run_queued_work
+static TPM_WIN32_WORK* g_queued_work;
+#define MAX_SET_EVENTS          4
+static HANDLE g_set_events[MAX_SET_EVENTS];
+static size_t g_set_event_count;
+
+TEST_DEFINE_ENUM_TYPE(TPM_COMM_POLL_RESULT, TPM_COMM_POLL_RESULT_VALUES);
+
 static TBS_RESULT my_Tbsi_GetDeviceInfo(UINT32 size, PVOID info)
 {
     (void)size;
@@ -77,6 +89,66 @@ static TBS_RESULT my_Tbsip_Context_Close(TBS_HCONTEXT hContext)
     return TBS_SUCCESS;
 }
 
+static bool is_event_set(HANDLE event)
+{
+    bool result = false;
+    for (size_t index = 0; index < g_set_event_count; index++)
+    {
+        if (g_set_events[index] == event)
+        {
+            result = true;
+        }
+    }
+    return result;
+}
+
+static HANDLE my_tpm_win32_sys_create_event(void)
+{
+    return (HANDLE)my_gballoc_malloc(1);
+}
+
+static void my_tpm_win32_sys_close_event(HANDLE event)
+{
+    my_gballoc_free(event);
+}
+
+static void my_tpm_win32_sys_reset_event(HANDLE event)
+{
+    for (size_t index = 0; index < g_set_event_count; index++)
+    {
+        if (g_set_events[index] == event)
+        {
+            g_set_events[index] = g_set_events[--g_set_event_count];
+            break;
+        }
+    }
+}
+
+static bool my_tpm_win32_sys_queue_work(TPM_WIN32_WORK* work)
+{
+    g_queued_work = work;
+    return true;
+}
+
+static int my_tpm_win32_sys_wait_any(HANDLE* events, size_t count, uint32_t timeout_ms, bool* signaled)
+{
+    int result = 0;
+    (void)timeout_ms;
+    for (size_t index = 0; index < count; index++)
+    {
+        signaled[index] = is_event_set(events[index]);
+        result += signaled[index] ? 1 : 0;
+    }
+    return result;
+}
+
+static void run_queued_work(void)
+{
+    g_queued_work->run(g_queued_work->context);
+    g_set_events[g_set_event_count++] = g_queued_work->done;
+    g_queued_work = NULL;
+}
+
 TEST_DEFINE_ENUM_TYPE(TPM_COMM_TYPE, TPM_COMM_TYPE_VALUES);
 IMPLEMENT_UMOCK_C_ENUM_TYPE(TPM_COMM_TYPE, TPM_COMM_TYPE_VALUES);
 
@@ -108,6 +180,8 @@ BEGIN_TEST_SUITE(tpm_comm_win32_ut)
         ASSERT_ARE_EQUAL(int, 0, result);
         result = umocktypes_stdint_register_types();
         ASSERT_ARE_EQUAL(int, 0, result);
+        result = umocktypes_bool_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
 
         REGISTER_UMOCK_ALIAS_TYPE(PCTBS_CONTEXT_PARAMS, void*);
         REGISTER_UMOCK_ALIAS_TYPE(TPM_COMM_HANDLE, void*);
@@ -120,6 +194,9 @@ BEGIN_TEST_SUITE(tpm_comm_win32_ut)
         REGISTER_UMOCK_ALIAS_TYPE(PBYTE, void*);
         REGISTER_UMOCK_ALIAS_TYPE(UINT32, unsigned int);
         REGISTER_UMOCK_ALIAS_TYPE(TBS_RESULT, unsigned int);
+        REGISTER_UMOCK_ALIAS_TYPE(HANDLE, void*);
+        REGISTER_UMOCK_ALIAS_TYPE(HANDLE*, void*);
+        REGISTER_UMOCK_ALIAS_TYPE(TPM_WIN32_WORK*, void*);
 
         REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
         REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
@@ -131,6 +208,15 @@ BEGIN_TEST_SUITE(tpm_comm_win32_ut)
         REGISTER_GLOBAL_MOCK_FAIL_RETURN(Tbsi_GetDeviceInfo, (TBS_RESULT)TBS_E_INVALID_CONTEXT);
         REGISTER_GLOBAL_MOCK_HOOK(Tbsip_Context_Close, my_Tbsip_Context_Close);
         REGISTER_GLOBAL_MOCK_FAIL_RETURN(Tbsip_Context_Close, (TBS_RESULT)TBS_E_TPM_NOT_FOUND);
+
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_win32_sys_create_event, my_tpm_win32_sys_create_event);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(tpm_win32_sys_create_event, NULL);
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_win32_sys_close_event, my_tpm_win32_sys_close_event);
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_win32_sys_reset_event, my_tpm_win32_sys_reset_event);
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_win32_sys_queue_work, my_tpm_win32_sys_queue_work);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(tpm_win32_sys_queue_work, false);
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_win32_sys_wait_any, my_tpm_win32_sys_wait_any);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(tpm_win32_sys_wait_any, -1);
     }
 
     TEST_SUITE_CLEANUP(suite_cleanup)
@@ -149,6 +235,8 @@ BEGIN_TEST_SUITE(tpm_comm_win32_ut)
         }
         umock_c_reset_all_calls();
         g_tpm_version = TPM_VERSION_20;
+        g_queued_work = NULL;
+        g_set_event_count = 0;
     }
 
     TEST_FUNCTION_CLEANUP(method_cleanup)
@@ -161,6 +249,7 @@ BEGIN_TEST_SUITE(tpm_comm_win32_ut)
         STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
         STRICT_EXPECTED_CALL(Tbsi_Context_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(Tbsi_GetDeviceInfo(IGNORED_NUM_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_win32_sys_create_event());
     }
 
     static int should_skip_index(size_t current_index, const size_t skip_array[], size_t length)
@@ -196,7 +285,9 @@ BEGIN_TEST_SUITE(tpm_comm_win32_ut)
     TEST_FUNCTION(tpm_comm_create_invalid_version_fail)
     {
         //arrange
-        setup_comm_create_mocks();
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(Tbsi_Context_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(Tbsi_GetDeviceInfo(IGNORED_NUM_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(Tbsip_Context_Close(IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
@@ -245,6 +336,7 @@ BEGIN_TEST_SUITE(tpm_comm_win32_ut)
         TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
         umock_c_reset_all_calls();
 
+        STRICT_EXPECTED_CALL(tpm_win32_sys_close_event(IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(Tbsip_Context_Close(IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
@@ -387,4 +479,270 @@ BEGIN_TEST_SUITE(tpm_comm_win32_ut)
         tpm_comm_destroy(tpm_handle);
     }
 
+    TEST_FUNCTION(tpm_comm_submit_command_steady_state_no_allocation_succeed)
+    {
+        unsigned char response[TEMP_CMD_LENGTH];
+        uint32_t resp_len = TEMP_CMD_LENGTH;
+
+        //arrange
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        STRICT_EXPECTED_CALL(Tbsip_Submit_Command(IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH, response, IGNORED_PTR_ARG));
+        (void)tpm_comm_submit_command(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH, response, &resp_len);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Tbsip_Submit_Command(IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH, response, IGNORED_PTR_ARG));
+
+        //act
+        resp_len = TEMP_CMD_LENGTH;
+        int tpm_result = tpm_comm_submit_command(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH, response, &resp_len);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, tpm_result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_IS_NULL(strstr(umock_c_get_actual_calls(), "gballoc_"));
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_command_high_priority_succees)
+    {
+        unsigned char response[TEMP_CMD_LENGTH];
+        uint32_t resp_len = TEMP_CMD_LENGTH;
+
+        //arrange
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        ASSERT_ARE_EQUAL(int, 0, tpm_comm_set_priority(tpm_handle, TPM_COMM_PRIORITY_HIGH));
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Tbsip_Submit_Command(IGNORED_PTR_ARG, IGNORED_NUM_ARG, TBS_COMMAND_PRIORITY_HIGH, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH, response, IGNORED_PTR_ARG));
+
+        //act
+        int tpm_result = tpm_comm_submit_command(tpm_handle, TEMP_TPM_COMMAND, TEMP_CMD_LENGTH, response, &resp_len);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, tpm_result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_async_returns_before_command_runs_succeed)
+    {
+        unsigned char command[TEMP_CMD_LENGTH] = { 0 };
+
+        //arrange
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(tpm_win32_sys_reset_event(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_win32_sys_queue_work(IGNORED_PTR_ARG));
+
+        //act
+        int tpm_result = tpm_comm_submit_async(tpm_handle, command, TEMP_CMD_LENGTH);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, tpm_result);
+        ASSERT_IS_NOT_NULL(g_queued_work);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        run_queued_work();
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_submit_async_queue_fail)
+    {
+        unsigned char command[TEMP_CMD_LENGTH] = { 0 };
+        unsigned char response[TEMP_CMD_LENGTH];
+        uint32_t resp_len = TEMP_CMD_LENGTH;
+
+        //arrange
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(tpm_win32_sys_reset_event(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_win32_sys_queue_work(IGNORED_PTR_ARG)).SetReturn(false);
+
+        //act
+        int tpm_result = tpm_comm_submit_async(tpm_handle, command, TEMP_CMD_LENGTH);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, tpm_result);
+        ASSERT_ARE_EQUAL(TPM_COMM_POLL_RESULT, TPM_COMM_POLL_ERROR, tpm_comm_poll_complete(tpm_handle, response, &resp_len));
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_poll_complete_command_running_pending_succeed)
+    {
+        unsigned char command[TEMP_CMD_LENGTH] = { 0 };
+        unsigned char response[TEMP_CMD_LENGTH];
+        uint32_t resp_len = TEMP_CMD_LENGTH;
+
+        //arrange
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        (void)tpm_comm_submit_async(tpm_handle, command, TEMP_CMD_LENGTH);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(tpm_win32_sys_wait_any(IGNORED_PTR_ARG, 1, 0, IGNORED_PTR_ARG));
+
+        //act
+        TPM_COMM_POLL_RESULT poll_result = tpm_comm_poll_complete(tpm_handle, response, &resp_len);
+
+        //assert
+        ASSERT_ARE_EQUAL(TPM_COMM_POLL_RESULT, TPM_COMM_POLL_PENDING, poll_result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        run_queued_work();
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_poll_complete_after_submit_async_succeed)
+    {
+        unsigned char command[TEMP_CMD_LENGTH] = { 0 };
+        unsigned char response[TEMP_CMD_LENGTH];
+        uint32_t resp_len = TEMP_CMD_LENGTH;
+        UINT32 tbs_resp_len = 10;
+
+        //arrange
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        (void)tpm_comm_submit_async(tpm_handle, command, TEMP_CMD_LENGTH);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Tbsip_Submit_Command(IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, TEMP_CMD_LENGTH, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_pcbResult(&tbs_resp_len, sizeof(tbs_resp_len));
+        STRICT_EXPECTED_CALL(tpm_win32_sys_wait_any(IGNORED_PTR_ARG, 1, 0, IGNORED_PTR_ARG));
+
+        //act
+        run_queued_work();
+        TPM_COMM_POLL_RESULT poll_result = tpm_comm_poll_complete(tpm_handle, response, &resp_len);
+
+        //assert
+        ASSERT_ARE_EQUAL(TPM_COMM_POLL_RESULT, TPM_COMM_POLL_COMPLETE, poll_result);
+        ASSERT_ARE_EQUAL(uint32_t, 10, resp_len);
+        ASSERT_ARE_EQUAL(int, -1, tpm_comm_get_wait_fd(tpm_handle));
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_poll_complete_command_fail)
+    {
+        unsigned char command[TEMP_CMD_LENGTH] = { 0 };
+        unsigned char response[TEMP_CMD_LENGTH];
+        uint32_t resp_len = TEMP_CMD_LENGTH;
+
+        //arrange
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        (void)tpm_comm_submit_async(tpm_handle, command, TEMP_CMD_LENGTH);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Tbsip_Submit_Command(IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, TEMP_CMD_LENGTH, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .SetReturn((TBS_RESULT)TBS_E_IOERROR);
+        STRICT_EXPECTED_CALL(tpm_win32_sys_wait_any(IGNORED_PTR_ARG, 1, 0, IGNORED_PTR_ARG));
+
+        //act
+        run_queued_work();
+        TPM_COMM_POLL_RESULT poll_result = tpm_comm_poll_complete(tpm_handle, response, &resp_len);
+
+        //assert
+        ASSERT_ARE_EQUAL(TPM_COMM_POLL_RESULT, TPM_COMM_POLL_ERROR, poll_result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_comm_destroy(tpm_handle);
+    }
+
+    TEST_FUNCTION(tpm_comm_destroy_waits_for_running_command_succeed)
+    {
+        unsigned char command[TEMP_CMD_LENGTH] = { 0 };
+
+        //arrange
+        TPM_COMM_HANDLE tpm_handle = tpm_comm_create(NULL);
+        (void)tpm_comm_submit_async(tpm_handle, command, TEMP_CMD_LENGTH);
+        run_queued_work();
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(tpm_win32_sys_wait_any(IGNORED_PTR_ARG, 1, TPM_WIN32_WAIT_FOREVER, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_win32_sys_close_event(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(Tbsip_Context_Close(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+        //act
+        tpm_comm_destroy(tpm_handle);
+
+        //assert
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_comm_wait_any_two_pending_succeed)
+    {
+        unsigned char command[TEMP_CMD_LENGTH] = { 0 };
+        TPM_COMM_HANDLE tpm_handles[2];
+        bool ready[2];
+
+        //arrange
+        tpm_handles[0] = tpm_comm_create(NULL);
+        tpm_handles[1] = tpm_comm_create(NULL);
+        (void)tpm_comm_submit_async(tpm_handles[0], command, TEMP_CMD_LENGTH);
+        TPM_WIN32_WORK* first_work = g_queued_work;
+        (void)tpm_comm_submit_async(tpm_handles[1], command, TEMP_CMD_LENGTH);
+        run_queued_work();
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(tpm_win32_sys_wait_any(IGNORED_PTR_ARG, 2, TPM_WIN32_WAIT_FOREVER, IGNORED_PTR_ARG));
+
+        //act
+        int result = tpm_comm_wait_any(tpm_handles, 2, 0, ready);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 1, result);
+        ASSERT_IS_FALSE(ready[0]);
+        ASSERT_IS_TRUE(ready[1]);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        g_queued_work = first_work;
+        run_queued_work();
+        tpm_comm_destroy(tpm_handles[0]);
+        tpm_comm_destroy(tpm_handles[1]);
+    }
+
+    TEST_FUNCTION(tpm_comm_wait_any_timeout_succeed)
+    {
+        unsigned char command[TEMP_CMD_LENGTH] = { 0 };
+        TPM_COMM_HANDLE tpm_handles[2];
+        bool ready[2];
+
+        //arrange
+        tpm_handles[0] = tpm_comm_create(NULL);
+        tpm_handles[1] = tpm_comm_create(NULL);
+        (void)tpm_comm_submit_async(tpm_handles[1], command, TEMP_CMD_LENGTH);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(tpm_win32_sys_wait_any(IGNORED_PTR_ARG, 1, 50, IGNORED_PTR_ARG));
+
+        //act
+        int result = tpm_comm_wait_any(tpm_handles, 2, 50, ready);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_IS_FALSE(ready[0]);
+        ASSERT_IS_FALSE(ready[1]);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        run_queued_work();
+        tpm_comm_destroy(tpm_handles[0]);
+        tpm_comm_destroy(tpm_handles[1]);
+    }
+
 END_TEST_SUITE(tpm_comm_win32_ut)
@@ -0,0 +1,387 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#else
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+#include "azure_c_shared_utility/macro_utils.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_utpm_c/tpm_codec.h"
+#undef ENABLE_MOCKS
+
+#include "azure_utpm_c/tpm_dispatcher.h"
+
+#define TEST_LOCK_HANDLE        (LOCK_HANDLE)0x4321
+#define TEST_ENDPOINTS          "127.0.0.1:2321,127.0.0.1:2421"
+#define TEST_RANDOM_CHUNK       8
+#define TEST_PERSISTENT_KEY     (TPMI_DH_OBJECT)0x81000100
+
+static TPM_RC my_TPM2_GetRandom(TSS_DEVICE* tpm, UINT16 bytesRequested, TPM2B_DIGEST* randomBytes)
+{
+    (void)tpm;
+    randomBytes->t.size = bytesRequested < TEST_RANDOM_CHUNK ? bytesRequested : TEST_RANDOM_CHUNK;
+    memset(randomBytes->t.buffer, 0x5A, randomBytes->t.size);
+    return TPM_RC_SUCCESS;
+}
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+BEGIN_TEST_SUITE(tpm_dispatcher_ut)
+
+    TEST_SUITE_INITIALIZE(suite_init)
+    {
+        int result;
+
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = TEST_MUTEX_CREATE();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+
+        (void)umock_c_init(on_umock_c_error);
+
+        result = umocktypes_charptr_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+        result = umocktypes_stdint_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+
+        REGISTER_UMOCK_ALIAS_TYPE(BOOL, int);
+        REGISTER_UMOCK_ALIAS_TYPE(INT32, int32_t);
+        REGISTER_UMOCK_ALIAS_TYPE(UINT16, uint16_t);
+        REGISTER_UMOCK_ALIAS_TYPE(UINT32, uint32_t);
+        REGISTER_UMOCK_ALIAS_TYPE(TPM_RC, uint32_t);
+        REGISTER_UMOCK_ALIAS_TYPE(TPMI_DH_OBJECT, uint32_t);
+        REGISTER_UMOCK_ALIAS_TYPE(TPMI_ALG_HASH, uint16_t);
+        REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
+        REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
+
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+        REGISTER_GLOBAL_MOCK_RETURN(Lock_Init, TEST_LOCK_HANDLE);
+        REGISTER_GLOBAL_MOCK_RETURN(Lock, LOCK_OK);
+        REGISTER_GLOBAL_MOCK_RETURN(Unlock, LOCK_OK);
+        REGISTER_GLOBAL_MOCK_RETURN(Lock_Deinit, LOCK_OK);
+
+        REGISTER_GLOBAL_MOCK_RETURN(Initialize_TPM_Codec, TPM_RC_SUCCESS);
+        REGISTER_GLOBAL_MOCK_HOOK(TPM2_GetRandom, my_TPM2_GetRandom);
+        REGISTER_GLOBAL_MOCK_RETURN(TSS_Hash, TPM_RC_SUCCESS);
+        REGISTER_GLOBAL_MOCK_RETURN(TSS_HMAC, TPM_RC_SUCCESS);
+    }
+
+    TEST_SUITE_CLEANUP(suite_cleanup)
+    {
+        umock_c_deinit();
+
+        TEST_MUTEX_DESTROY(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(method_init)
+    {
+        if (TEST_MUTEX_ACQUIRE(g_testByTest))
+        {
+            ASSERT_FAIL("Could not acquire test serialization mutex.");
+        }
+        umock_c_reset_all_calls();
+    }
+
+    TEST_FUNCTION_CLEANUP(method_cleanup)
+    {
+        TEST_MUTEX_RELEASE(g_testByTest);
+    }
+
+    TEST_FUNCTION(tpm_dispatcher_create_succeed)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(Lock_Init());
+        STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(TEST_ENDPOINTS)));
+        STRICT_EXPECTED_CALL(Lock_Init());
+        STRICT_EXPECTED_CALL(Initialize_TPM_Codec(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(Lock_Init());
+        STRICT_EXPECTED_CALL(Initialize_TPM_Codec(IGNORED_PTR_ARG));
+
+        //act
+        TSS_DISPATCHER_HANDLE dispatcher = tpm_dispatcher_create(TEST_ENDPOINTS);
+
+        //assert
+        ASSERT_IS_NOT_NULL(dispatcher);
+        ASSERT_ARE_EQUAL(size_t, 2, tpm_dispatcher_get_device_count(dispatcher));
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_dispatcher_destroy(dispatcher);
+    }
+
+    TEST_FUNCTION(tpm_dispatcher_create_default_endpoint_succeed)
+    {
+        //arrange
+        TSS_DEVICE* device;
+        TSS_DISPATCHER_HANDLE dispatcher = tpm_dispatcher_create(NULL);
+        ASSERT_IS_NOT_NULL(dispatcher);
+
+        //act
+        device = tpm_dispatcher_acquire_device(dispatcher);
+
+        //assert
+        ASSERT_ARE_EQUAL(size_t, 1, tpm_dispatcher_get_device_count(dispatcher));
+        ASSERT_IS_NOT_NULL(device);
+        ASSERT_IS_NULL(device->comms_endpoint);
+
+        //cleanup
+        tpm_dispatcher_release_device(dispatcher, device);
+        tpm_dispatcher_destroy(dispatcher);
+    }
+
+    TEST_FUNCTION(tpm_dispatcher_create_device_fail)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(Lock_Init());
+        STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(TEST_ENDPOINTS)));
+        STRICT_EXPECTED_CALL(Lock_Init());
+        STRICT_EXPECTED_CALL(Initialize_TPM_Codec(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(Lock_Init());
+        STRICT_EXPECTED_CALL(Initialize_TPM_Codec(IGNORED_PTR_ARG)).SetReturn(TPM_RC_FAILURE);
+        STRICT_EXPECTED_CALL(Lock_Deinit(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Deinit_TPM_Codec(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(Lock_Deinit(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Lock_Deinit(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+        //act
+        TSS_DISPATCHER_HANDLE dispatcher = tpm_dispatcher_create(TEST_ENDPOINTS);
+
+        //assert
+        ASSERT_IS_NULL(dispatcher);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_dispatcher_create_too_many_endpoints_fail)
+    {
+        //arrange
+        char endpoints[4 * TSS_DISPATCHER_MAX_DEVICES + 4] = { 0 };
+        size_t index;
+        for (index = 0; index <= TSS_DISPATCHER_MAX_DEVICES; index++)
+        {
+            strcat(endpoints, index == 0 ? "a" : ",a");
+        }
+
+        //act
+        TSS_DISPATCHER_HANDLE dispatcher = tpm_dispatcher_create(endpoints);
+
+        //assert
+        ASSERT_IS_NULL(dispatcher);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_dispatcher_acquire_device_least_outstanding_succeed)
+    {
+        //arrange
+        TSS_DEVICE* first;
+        TSS_DEVICE* second;
+        TSS_DEVICE* third;
+        TSS_DISPATCHER_HANDLE dispatcher = tpm_dispatcher_create(TEST_ENDPOINTS);
+        ASSERT_IS_NOT_NULL(dispatcher);
+
+        //act
+        first = tpm_dispatcher_acquire_device(dispatcher);
+        second = tpm_dispatcher_acquire_device(dispatcher);
+        tpm_dispatcher_release_device(dispatcher, first);
+        third = tpm_dispatcher_acquire_device(dispatcher);
+
+        //assert
+        ASSERT_IS_NOT_NULL(first);
+        ASSERT_IS_NOT_NULL(second);
+        ASSERT_ARE_NOT_EQUAL(void_ptr, first, second);
+        ASSERT_ARE_EQUAL(void_ptr, first, third);
+
+        //cleanup
+        tpm_dispatcher_release_device(dispatcher, second);
+        tpm_dispatcher_release_device(dispatcher, third);
+        tpm_dispatcher_destroy(dispatcher);
+    }
+
+    TEST_FUNCTION(tpm_dispatcher_get_random_succeed)
+    {
+        //arrange
+        BYTE buffer[TEST_RANDOM_CHUNK * 2 + 3];
+        TSS_DISPATCHER_HANDLE dispatcher = tpm_dispatcher_create(TEST_ENDPOINTS);
+        ASSERT_IS_NOT_NULL(dispatcher);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(TPM2_GetRandom(IGNORED_PTR_ARG, sizeof(buffer), IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPM2_GetRandom(IGNORED_PTR_ARG, sizeof(buffer) - TEST_RANDOM_CHUNK, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPM2_GetRandom(IGNORED_PTR_ARG, 3, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+        //act
+        TPM_RC result = tpm_dispatcher_get_random(dispatcher, buffer, sizeof(buffer));
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(int, 0x5A, buffer[sizeof(buffer) - 1]);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_dispatcher_destroy(dispatcher);
+    }
+
+    TEST_FUNCTION(tpm_dispatcher_get_random_no_bytes_fail)
+    {
+        //arrange
+        BYTE buffer[TEST_RANDOM_CHUNK];
+        TPM2B_DIGEST no_bytes = { 0 };
+        TSS_DISPATCHER_HANDLE dispatcher = tpm_dispatcher_create(TEST_ENDPOINTS);
+        ASSERT_IS_NOT_NULL(dispatcher);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(TPM2_GetRandom(IGNORED_PTR_ARG, sizeof(buffer), IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer_randomBytes(&no_bytes, sizeof(no_bytes))
+            .SetReturn(TPM_RC_SUCCESS);
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+        //act
+        TPM_RC result = tpm_dispatcher_get_random(dispatcher, buffer, sizeof(buffer));
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_FAILURE, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_dispatcher_destroy(dispatcher);
+    }
+
+    TEST_FUNCTION(tpm_dispatcher_hash_succeed)
+    {
+        //arrange
+        BYTE data[] = { 0x01, 0x02, 0x03 };
+        TPM2B_DIGEST digest;
+        TSS_DISPATCHER_HANDLE dispatcher = tpm_dispatcher_create(TEST_ENDPOINTS);
+        ASSERT_IS_NOT_NULL(dispatcher);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(TSS_Hash(IGNORED_PTR_ARG, data, sizeof(data), TPM_ALG_SHA256, &digest));
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+        //act
+        TPM_RC result = tpm_dispatcher_hash(dispatcher, data, sizeof(data), TPM_ALG_SHA256, &digest);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_dispatcher_destroy(dispatcher);
+    }
+
+    TEST_FUNCTION(tpm_dispatcher_hmac_policy_session_fail)
+    {
+        //arrange
+        BYTE data[] = { 0x01, 0x02, 0x03 };
+        TPM2B_DIGEST digest;
+        TSS_SESSION session = { 0 };
+        TSS_DISPATCHER_HANDLE dispatcher = tpm_dispatcher_create(TEST_ENDPOINTS);
+        ASSERT_IS_NOT_NULL(dispatcher);
+        session.SessIn.sessionHandle = HR_POLICY_SESSION;
+        umock_c_reset_all_calls();
+
+        //act
+        TPM_RC result = tpm_dispatcher_hmac(dispatcher, &session, TEST_PERSISTENT_KEY, data, sizeof(data), &digest);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_AUTH_TYPE, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_dispatcher_destroy(dispatcher);
+    }
+
+    TEST_FUNCTION(tpm_dispatcher_hmac_succeed)
+    {
+        //arrange
+        BYTE data[] = { 0x01, 0x02, 0x03 };
+        TPM2B_DIGEST digest;
+        TSS_SESSION session = { 0 };
+        TSS_DISPATCHER_HANDLE dispatcher = tpm_dispatcher_create(TEST_ENDPOINTS);
+        ASSERT_IS_NOT_NULL(dispatcher);
+        session.SessIn.sessionHandle = TPM_RS_PW;
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(TSS_HMAC(IGNORED_PTR_ARG, &session, TEST_PERSISTENT_KEY, data, sizeof(data), &digest));
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+        //act
+        TPM_RC result = tpm_dispatcher_hmac(dispatcher, &session, TEST_PERSISTENT_KEY, data, sizeof(data), &digest);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_dispatcher_destroy(dispatcher);
+    }
+
+END_TEST_SUITE(tpm_dispatcher_ut)
@@ -0,0 +1,363 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#else
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+#include "azure_c_shared_utility/macro_utils.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+#undef ENABLE_MOCKS
+
+#include "azure_utpm_c/tpm_endpoint.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+TEST_DEFINE_ENUM_TYPE(TPM_ENDPOINT_TYPE, TPM_ENDPOINT_TYPE_VALUES);
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+BEGIN_TEST_SUITE(tpm_endpoint_ut)
+
+    TEST_SUITE_INITIALIZE(suite_init)
+    {
+        int result;
+
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = TEST_MUTEX_CREATE();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+
+        (void)umock_c_init(on_umock_c_error);
+
+        result = umocktypes_charptr_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+        result = umocktypes_stdint_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+    }
+
+    TEST_SUITE_CLEANUP(suite_cleanup)
+    {
+        umock_c_deinit();
+
+        TEST_MUTEX_DESTROY(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(method_init)
+    {
+        if (TEST_MUTEX_ACQUIRE(g_testByTest))
+        {
+            ASSERT_FAIL("Could not acquire test serialization mutex.");
+        }
+        umock_c_reset_all_calls();
+    }
+
+    TEST_FUNCTION_CLEANUP(method_cleanup)
+    {
+        TEST_MUTEX_RELEASE(g_testByTest);
+    }
+
+    TEST_FUNCTION(tpm_endpoint_parse_parsed_NULL_fail)
+    {
+        //arrange
+
+        //act
+        int result = tpm_endpoint_parse("dev:/dev/tpmrm0", NULL);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_endpoint_parse_NULL_default_succeed)
+    {
+        //arrange
+        TPM_ENDPOINT parsed;
+
+        //act
+        int result = tpm_endpoint_parse(NULL, &parsed);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(TPM_ENDPOINT_TYPE, TPM_ENDPOINT_DEFAULT, parsed.type);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_endpoint_parse_empty_default_succeed)
+    {
+        //arrange
+        TPM_ENDPOINT parsed;
+
+        //act
+        int result = tpm_endpoint_parse("", &parsed);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(TPM_ENDPOINT_TYPE, TPM_ENDPOINT_DEFAULT, parsed.type);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_endpoint_parse_device_succeed)
+    {
+        //arrange
+        TPM_ENDPOINT parsed;
+
+        //act
+        int result = tpm_endpoint_parse("dev:/dev/tpmrm1", &parsed);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(TPM_ENDPOINT_TYPE, TPM_ENDPOINT_DEVICE, parsed.type);
+        ASSERT_ARE_EQUAL(char_ptr, "/dev/tpmrm1", parsed.address);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_endpoint_parse_device_empty_fail)
+    {
+        //arrange
+        TPM_ENDPOINT parsed;
+
+        //act
+        int result = tpm_endpoint_parse("dev:", &parsed);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_endpoint_parse_tcp_port_succeed)
+    {
+        //arrange
+        TPM_ENDPOINT parsed;
+
+        //act
+        int result = tpm_endpoint_parse("tcp:10.0.0.2:2421", &parsed);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(TPM_ENDPOINT_TYPE, TPM_ENDPOINT_TCP, parsed.type);
+        ASSERT_ARE_EQUAL(char_ptr, "10.0.0.2", parsed.address);
+        ASSERT_ARE_EQUAL(int, 2421, (int)parsed.port);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_endpoint_parse_tcp_no_port_succeed)
+    {
+        //arrange
+        TPM_ENDPOINT parsed;
+
+        //act
+        int result = tpm_endpoint_parse("tcp:10.0.0.2", &parsed);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(TPM_ENDPOINT_TYPE, TPM_ENDPOINT_TCP, parsed.type);
+        ASSERT_ARE_EQUAL(char_ptr, "10.0.0.2", parsed.address);
+        ASSERT_ARE_EQUAL(int, 0, (int)parsed.port);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_endpoint_parse_tcp_no_host_succeed)
+    {
+        //arrange
+        TPM_ENDPOINT parsed;
+
+        //act
+        int result = tpm_endpoint_parse("tcp::2521", &parsed);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(TPM_ENDPOINT_TYPE, TPM_ENDPOINT_TCP, parsed.type);
+        ASSERT_ARE_EQUAL(char_ptr, "", parsed.address);
+        ASSERT_ARE_EQUAL(int, 2521, (int)parsed.port);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_endpoint_parse_bare_host_port_succeed)
+    {
+        //arrange
+        TPM_ENDPOINT parsed;
+
+        //act
+        int result = tpm_endpoint_parse("127.0.0.1:2421", &parsed);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(TPM_ENDPOINT_TYPE, TPM_ENDPOINT_TCP, parsed.type);
+        ASSERT_ARE_EQUAL(char_ptr, "127.0.0.1", parsed.address);
+        ASSERT_ARE_EQUAL(int, 2421, (int)parsed.port);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_endpoint_parse_invalid_port_fail)
+    {
+        //arrange
+        TPM_ENDPOINT parsed;
+        const char* invalid_endpoints[] = { "tcp:10.0.0.2:", "tcp:10.0.0.2:port", "tcp:10.0.0.2:0", "tcp:10.0.0.2:65536", "127.0.0.1:24x" };
+
+        for (size_t index = 0; index < sizeof(invalid_endpoints) / sizeof(invalid_endpoints[0]); index++)
+        {
+            //act
+            int result = tpm_endpoint_parse(invalid_endpoints[index], &parsed);
+
+            //assert
+            ASSERT_ARE_NOT_EQUAL_WITH_MSG(int, 0, result, invalid_endpoints[index]);
+        }
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_endpoint_parse_unix_succeed)
+    {
+        //arrange
+        TPM_ENDPOINT parsed;
+
+        //act
+        int result = tpm_endpoint_parse("unix:/run/tpm/sim.sock", &parsed);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(TPM_ENDPOINT_TYPE, TPM_ENDPOINT_UNIX, parsed.type);
+        ASSERT_ARE_EQUAL(char_ptr, "unix:///run/tpm/sim.sock", parsed.address);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_endpoint_parse_unix_url_succeed)
+    {
+        //arrange
+        TPM_ENDPOINT parsed;
+
+        //act
+        int result = tpm_endpoint_parse("unix:///run/tpm/sim.sock", &parsed);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(TPM_ENDPOINT_TYPE, TPM_ENDPOINT_UNIX, parsed.type);
+        ASSERT_ARE_EQUAL(char_ptr, "unix:///run/tpm/sim.sock", parsed.address);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_endpoint_parse_file_succeed)
+    {
+        //arrange
+        TPM_ENDPOINT parsed;
+
+        //act
+        int result = tpm_endpoint_parse("file:utpm_sample.trc", &parsed);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(TPM_ENDPOINT_TYPE, TPM_ENDPOINT_FILE, parsed.type);
+        ASSERT_ARE_EQUAL(char_ptr, "utpm_sample.trc", parsed.address);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_endpoint_parse_file_empty_fail)
+    {
+        //arrange
+        TPM_ENDPOINT parsed;
+
+        //act
+        int result = tpm_endpoint_parse("file:", &parsed);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_endpoint_parse_shm_succeed)
+    {
+        //arrange
+        TPM_ENDPOINT parsed;
+
+        //act
+        int result = tpm_endpoint_parse("shm:utpm_broker", &parsed);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(TPM_ENDPOINT_TYPE, TPM_ENDPOINT_SHM, parsed.type);
+        ASSERT_ARE_EQUAL(char_ptr, "utpm_broker", parsed.address);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_endpoint_parse_address_too_long_fail)
+    {
+        //arrange
+        TPM_ENDPOINT parsed;
+        char endpoint[TPM_ENDPOINT_MAX_ADDRESS + 8];
+        strcpy(endpoint, "dev:");
+        memset(endpoint + 4, 'a', TPM_ENDPOINT_MAX_ADDRESS);
+        endpoint[4 + TPM_ENDPOINT_MAX_ADDRESS] = '\0';
+
+        //act
+        int result = tpm_endpoint_parse(endpoint, &parsed);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+        //cleanup
+    }
+
+END_TEST_SUITE(tpm_endpoint_ut)
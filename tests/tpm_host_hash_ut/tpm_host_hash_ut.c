@@ -0,0 +1,175 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#else
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#endif
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "azure_c_shared_utility/macro_utils.h"
+
+#include "azure_utpm_c/tpm_host_hash.h"
+
+// FIPS 180-2 test vectors for "abc"
+static const BYTE TEST_DATA[] = { 'a', 'b', 'c' };
+static const BYTE TEST_SHA1_DIGEST[] =
+{
+    0xa9, 0x99, 0x3e, 0x36, 0x47, 0x06, 0x81, 0x6a, 0xba, 0x3e, 0x25, 0x71, 0x78, 0x50, 0xc2, 0x6c,
+    0x9c, 0xd0, 0xd8, 0x9d
+};
+static const BYTE TEST_SHA256_DIGEST[] =
+{
+    0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+    0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad
+};
+static const BYTE TEST_SHA256_EMPTY_DIGEST[] =
+{
+    0xe3, 0xb0, 0xc4, 0x42, 0x98, 0xfc, 0x1c, 0x14, 0x9a, 0xfb, 0xf4, 0xc8, 0x99, 0x6f, 0xb9, 0x24,
+    0x27, 0xae, 0x41, 0xe4, 0x64, 0x9b, 0x93, 0x4c, 0xa4, 0x95, 0x99, 0x1b, 0x78, 0x52, 0xb8, 0x55
+};
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+BEGIN_TEST_SUITE(tpm_host_hash_ut)
+
+    TEST_SUITE_INITIALIZE(suite_init)
+    {
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = TEST_MUTEX_CREATE();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+    }
+
+    TEST_SUITE_CLEANUP(suite_cleanup)
+    {
+        TEST_MUTEX_DESTROY(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(method_init)
+    {
+        if (TEST_MUTEX_ACQUIRE(g_testByTest))
+        {
+            ASSERT_FAIL("Could not acquire test serialization mutex.");
+        }
+    }
+
+    TEST_FUNCTION_CLEANUP(method_cleanup)
+    {
+        TEST_MUTEX_RELEASE(g_testByTest);
+    }
+
+    TEST_FUNCTION(tpm_host_hash_is_supported_succeed)
+    {
+        //arrange
+
+        //act
+        bool sha256 = tpm_host_hash_is_supported(TPM_ALG_SHA256);
+        bool null_alg = tpm_host_hash_is_supported(TPM_ALG_NULL);
+
+        //assert
+        ASSERT_IS_TRUE(sha256);
+        ASSERT_IS_FALSE(null_alg);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_host_hash_sha256_succeed)
+    {
+        //arrange
+        TPM2B_DIGEST digest;
+
+        //act
+        TPM_RC result = tpm_host_hash(TPM_ALG_SHA256, TEST_DATA, sizeof(TEST_DATA), &digest);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(int, sizeof(TEST_SHA256_DIGEST), digest.t.size);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(TEST_SHA256_DIGEST, digest.t.buffer, sizeof(TEST_SHA256_DIGEST)));
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_host_hash_sha1_succeed)
+    {
+        //arrange
+        TPM2B_DIGEST digest;
+
+        //act
+        TPM_RC result = tpm_host_hash(TPM_ALG_SHA1, TEST_DATA, sizeof(TEST_DATA), &digest);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(int, sizeof(TEST_SHA1_DIGEST), digest.t.size);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(TEST_SHA1_DIGEST, digest.t.buffer, sizeof(TEST_SHA1_DIGEST)));
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_host_hash_empty_data_succeed)
+    {
+        //arrange
+        TPM2B_DIGEST digest;
+
+        //act
+        TPM_RC result = tpm_host_hash(TPM_ALG_SHA256, NULL, 0, &digest);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(int, sizeof(TEST_SHA256_EMPTY_DIGEST), digest.t.size);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(TEST_SHA256_EMPTY_DIGEST, digest.t.buffer, sizeof(TEST_SHA256_EMPTY_DIGEST)));
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_host_hash_unsupported_alg_fail)
+    {
+        //arrange
+        TPM2B_DIGEST digest;
+
+        //act
+        TPM_RC result = tpm_host_hash(TPM_ALG_NULL, TEST_DATA, sizeof(TEST_DATA), &digest);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TPM_RC_HASH, result);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_host_hash_outHash_NULL_fail)
+    {
+        //arrange
+
+        //act
+        TPM_RC result = tpm_host_hash(TPM_ALG_SHA256, TEST_DATA, sizeof(TEST_DATA), NULL);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TPM_RC_FAILURE, result);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_host_hash_data_NULL_fail)
+    {
+        //arrange
+        TPM2B_DIGEST digest;
+
+        //act
+        TPM_RC result = tpm_host_hash(TPM_ALG_SHA256, NULL, sizeof(TEST_DATA), &digest);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TPM_RC_FAILURE, result);
+
+        //cleanup
+    }
+
+    END_TEST_SUITE(tpm_host_hash_ut)
@@ -0,0 +1,269 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#else
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+#include "azure_c_shared_utility/macro_utils.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_utpm_c/tpm_codec.h"
+#include "azure_utpm_c/Marshal_fp.h"
+#undef ENABLE_MOCKS
+
+#include "azure_utpm_c/tpm_key_cache.h"
+
+#define TEST_KEY_ID_1           1
+#define TEST_KEY_ID_2           2
+#define TEST_KEY_HANDLE_1       (TPM_HANDLE)0x80000001
+#define TEST_KEY_HANDLE_2       (TPM_HANDLE)0x80000002
+#define TEST_LOADED_HANDLE      (TPM_HANDLE)0x80000005
+
+static TPM_RC my_TPM2_ContextLoad(TSS_DEVICE* tpm, TPMS_CONTEXT* context, TPMI_DH_CONTEXT* loadedHandle)
+{
+    (void)tpm;
+    (void)context;
+    *loadedHandle = TEST_LOADED_HANDLE;
+    return TPM_RC_SUCCESS;
+}
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+BEGIN_TEST_SUITE(tpm_key_cache_ut)
+
+    TEST_SUITE_INITIALIZE(suite_init)
+    {
+        int result;
+
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = TEST_MUTEX_CREATE();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+
+        (void)umock_c_init(on_umock_c_error);
+
+        result = umocktypes_charptr_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+        result = umocktypes_stdint_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+
+        REGISTER_UMOCK_ALIAS_TYPE(BOOL, int);
+        REGISTER_UMOCK_ALIAS_TYPE(INT32, int32_t);
+        REGISTER_UMOCK_ALIAS_TYPE(TPM_RC, uint32_t);
+        REGISTER_UMOCK_ALIAS_TYPE(TPM_PT, uint32_t);
+        REGISTER_UMOCK_ALIAS_TYPE(TPMI_DH_CONTEXT, uint32_t);
+
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+        REGISTER_GLOBAL_MOCK_RETURN(TPM2_ContextSave, TPM_RC_SUCCESS);
+        REGISTER_GLOBAL_MOCK_RETURN(TPM2_FlushContext, TPM_RC_SUCCESS);
+        REGISTER_GLOBAL_MOCK_HOOK(TPM2_ContextLoad, my_TPM2_ContextLoad);
+    }
+
+    TEST_SUITE_CLEANUP(suite_cleanup)
+    {
+        umock_c_deinit();
+
+        TEST_MUTEX_DESTROY(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(method_init)
+    {
+        if (TEST_MUTEX_ACQUIRE(g_testByTest))
+        {
+            ASSERT_FAIL("Could not acquire test serialization mutex.");
+        }
+        umock_c_reset_all_calls();
+    }
+
+    TEST_FUNCTION_CLEANUP(method_cleanup)
+    {
+        TEST_MUTEX_RELEASE(g_testByTest);
+    }
+
+    TEST_FUNCTION(tpm_key_cache_add_handle_not_transient_fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_KEY_CACHE cache = { 0 };
+
+        //act
+        TPM_RC result = tpm_key_cache_add(&tss_dev, &cache, TEST_KEY_ID_1, HR_PERSISTENT | 1);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_key_cache_get_loaded_key_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_KEY_CACHE cache = { 0 };
+        TPM_HANDLE handle = 0;
+        cache.Limit = 2;
+        (void)tpm_key_cache_add(&tss_dev, &cache, TEST_KEY_ID_1, TEST_KEY_HANDLE_1);
+        umock_c_reset_all_calls();
+
+        //act
+        TPM_RC result = tpm_key_cache_get(&tss_dev, &cache, TEST_KEY_ID_1, &handle);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, TEST_KEY_HANDLE_1, handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_key_cache_get_unknown_key_fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_KEY_CACHE cache = { 0 };
+        TPM_HANDLE handle = 0;
+
+        //act
+        TPM_RC result = tpm_key_cache_get(&tss_dev, &cache, TEST_KEY_ID_1, &handle);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_HANDLE, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_key_cache_add_evicts_lru_key_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_KEY_CACHE cache = { 0 };
+        cache.Limit = 1;
+        (void)tpm_key_cache_add(&tss_dev, &cache, TEST_KEY_ID_1, TEST_KEY_HANDLE_1);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(TPM2_ContextSave(&tss_dev, TEST_KEY_HANDLE_1, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPM2_FlushContext(&tss_dev, TEST_KEY_HANDLE_1));
+
+        //act
+        TPM_RC result = tpm_key_cache_add(&tss_dev, &cache, TEST_KEY_ID_2, TEST_KEY_HANDLE_2);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_key_cache_get_saved_key_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_KEY_CACHE cache = { 0 };
+        TPM_HANDLE handle = 0;
+        cache.Limit = 1;
+        (void)tpm_key_cache_add(&tss_dev, &cache, TEST_KEY_ID_1, TEST_KEY_HANDLE_1);
+        (void)tpm_key_cache_add(&tss_dev, &cache, TEST_KEY_ID_2, TEST_KEY_HANDLE_2);
+        umock_c_reset_all_calls();
+
+        // Key 2 makes room for key 1, which is loaded from its saved context
+        STRICT_EXPECTED_CALL(TPM2_ContextSave(&tss_dev, TEST_KEY_HANDLE_2, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPM2_FlushContext(&tss_dev, TEST_KEY_HANDLE_2));
+        STRICT_EXPECTED_CALL(TPM2_ContextLoad(&tss_dev, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+        //act
+        TPM_RC result = tpm_key_cache_get(&tss_dev, &cache, TEST_KEY_ID_1, &handle);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, TEST_LOADED_HANDLE, handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_key_cache_get_context_rejected_fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_KEY_CACHE cache = { 0 };
+        TPM_HANDLE handle = 0;
+        cache.Limit = 1;
+        cache.Entries[0].Used = TRUE;
+        cache.Entries[0].KeyId = TEST_KEY_ID_1;
+        cache.Entries[0].Saved = TRUE;
+
+        STRICT_EXPECTED_CALL(TPM2_ContextLoad(&tss_dev, IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(TPM_RC_INTEGRITY);
+
+        //act
+        TPM_RC result = tpm_key_cache_get(&tss_dev, &cache, TEST_KEY_ID_1, &handle);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_HANDLE, result);
+        ASSERT_IS_FALSE(cache.Entries[0].Used);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_key_cache_remove_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_KEY_CACHE cache = { 0 };
+        TPM_HANDLE handle;
+        cache.Limit = 2;
+        (void)tpm_key_cache_add(&tss_dev, &cache, TEST_KEY_ID_1, TEST_KEY_HANDLE_1);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(TPM2_FlushContext(&tss_dev, TEST_KEY_HANDLE_1));
+
+        //act
+        tpm_key_cache_remove(&tss_dev, &cache, TEST_KEY_ID_1);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_HANDLE, tpm_key_cache_get(&tss_dev, &cache, TEST_KEY_ID_1, &handle));
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+END_TEST_SUITE(tpm_key_cache_ut)
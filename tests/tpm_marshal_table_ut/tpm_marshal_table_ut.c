@@ -0,0 +1,372 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#else
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#endif
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "azure_c_shared_utility/macro_utils.h"
+
+#include "azure_utpm_c/Tpm.h"
+#include "azure_utpm_c/Marshal_fp.h"
+#include "azure_utpm_c/MarshalTable_fp.h"
+
+#define TEST_BUFFER_SIZE        4096
+
+typedef TPM_RC(*TEST_UNMARSHAL)(void* target, BYTE** buffer, INT32* size);
+typedef UINT16(*TEST_MARSHAL)(void* source, BYTE** buffer, INT32* size);
+
+static BYTE g_generated[TEST_BUFFER_SIZE];
+static BYTE g_table[TEST_BUFFER_SIZE];
+static BYTE g_generated_value[TEST_BUFFER_SIZE];
+static BYTE g_table_value[TEST_BUFFER_SIZE];
+
+// Marshals 'source' with the generated code and the table, then unmarshals
+// every prefix of the result with both, and expects the same outcome
+static void compare_with_generated(const TSS_MARSHAL_DESC* desc, void* source, TEST_UNMARSHAL unmarshal, TEST_MARSHAL marshal, size_t structSize)
+{
+    BYTE* generated = g_generated;
+    BYTE* table = g_table;
+    INT32 generatedSize = TEST_BUFFER_SIZE;
+    INT32 tableSize = TEST_BUFFER_SIZE;
+    UINT16 generatedLength = marshal(source, &generated, &generatedSize);
+    UINT16 tableLength = TableMarshal(desc, source, &table, &tableSize);
+    INT32 length;
+
+    ASSERT_ARE_EQUAL(int, generatedLength, tableLength);
+    ASSERT_ARE_EQUAL(int, generatedSize, tableSize);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(g_generated, g_table, generatedLength));
+    ASSERT_ARE_EQUAL(int, generatedLength, TableMarshal(desc, source, NULL, NULL));
+
+    for (length = 0; length <= generatedLength; length++)
+    {
+        BYTE* generatedBuffer = g_generated;
+        BYTE* tableBuffer = g_generated;
+        INT32 generatedRemaining = length;
+        INT32 tableRemaining = length;
+        TPM_RC generatedResult;
+        TPM_RC tableResult;
+
+        memset(g_generated_value, 0xEE, structSize);
+        memset(g_table_value, 0xEE, structSize);
+        generatedResult = unmarshal(g_generated_value, &generatedBuffer, &generatedRemaining);
+        tableResult = TableUnmarshal(desc, g_table_value, &tableBuffer, &tableRemaining);
+
+        ASSERT_ARE_EQUAL(int, length == generatedLength ? TPM_RC_SUCCESS : TPM_RC_INSUFFICIENT, tableResult);
+        ASSERT_ARE_EQUAL(int, generatedResult == TPM_RC_SUCCESS, tableResult == TPM_RC_SUCCESS);
+        if (tableResult == TPM_RC_SUCCESS)
+        {
+            ASSERT_ARE_EQUAL(int, 0, memcmp(g_generated_value, g_table_value, structSize));
+            ASSERT_ARE_EQUAL(int, 0, tableRemaining);
+            ASSERT_IS_TRUE(generatedBuffer == tableBuffer);
+        }
+    }
+}
+
+#define COMPARE_WITH_GENERATED(type, value) \
+    compare_with_generated(&TSS_MD_##type, &(value), (TEST_UNMARSHAL)type##_Unmarshal, (TEST_MARSHAL)type##_Marshal, sizeof(type))
+
+static void fill_buffer(BYTE* buffer, UINT16 size)
+{
+    UINT16 index;
+    for (index = 0; index < size; index++)
+    {
+        buffer[index] = (BYTE)(index * 7 + 1);
+    }
+}
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+BEGIN_TEST_SUITE(tpm_marshal_table_ut)
+
+    TEST_SUITE_INITIALIZE(suite_init)
+    {
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = TEST_MUTEX_CREATE();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+    }
+
+    TEST_SUITE_CLEANUP(suite_cleanup)
+    {
+        TEST_MUTEX_DESTROY(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(method_init)
+    {
+        if (TEST_MUTEX_ACQUIRE(g_testByTest))
+        {
+            ASSERT_FAIL("Could not acquire test serialization mutex.");
+        }
+    }
+
+    TEST_FUNCTION_CLEANUP(method_cleanup)
+    {
+        TEST_MUTEX_RELEASE(g_testByTest);
+    }
+
+    TEST_FUNCTION(TableMarshal_TPM2B_match_generated_succeed)
+    {
+        //arrange
+        TPM2B_DIGEST digest;
+        TPM2B_DIGEST empty;
+        TPM2B_NAME name;
+        TPM2B_ENCRYPTED_SECRET secret;
+        TPM2B_MAX_BUFFER data;
+
+        memset(&digest, 0, sizeof(digest));
+        memset(&empty, 0, sizeof(empty));
+        memset(&name, 0, sizeof(name));
+        memset(&secret, 0, sizeof(secret));
+        memset(&data, 0, sizeof(data));
+        digest.t.size = 32;
+        fill_buffer(digest.t.buffer, digest.t.size);
+        name.t.size = 34;
+        fill_buffer(name.t.name, name.t.size);
+        secret.t.size = 256;
+        fill_buffer(secret.t.secret, secret.t.size);
+        data.t.size = MAX_DIGEST_BUFFER;
+        fill_buffer(data.t.buffer, data.t.size);
+
+        //act
+        COMPARE_WITH_GENERATED(TPM2B_DIGEST, digest);
+        COMPARE_WITH_GENERATED(TPM2B_DIGEST, empty);
+        COMPARE_WITH_GENERATED(TPM2B_NAME, name);
+        COMPARE_WITH_GENERATED(TPM2B_ENCRYPTED_SECRET, secret);
+        COMPARE_WITH_GENERATED(TPM2B_MAX_BUFFER, data);
+
+        //assert
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TableMarshal_tickets_match_generated_succeed)
+    {
+        //arrange
+        TPMT_TK_CREATION creation;
+        TPMT_TK_AUTH auth;
+        TPMT_TK_HASHCHECK hashcheck;
+
+        memset(&creation, 0, sizeof(creation));
+        memset(&auth, 0, sizeof(auth));
+        memset(&hashcheck, 0, sizeof(hashcheck));
+        creation.tag = TPM_ST_CREATION;
+        creation.hierarchy = TPM_RH_OWNER;
+        creation.digest.t.size = 32;
+        fill_buffer(creation.digest.t.buffer, creation.digest.t.size);
+        auth.tag = TPM_ST_AUTH_SECRET;
+        auth.hierarchy = TPM_RH_NULL;
+        auth.digest.t.size = 20;
+        fill_buffer(auth.digest.t.buffer, auth.digest.t.size);
+        hashcheck.tag = TPM_ST_HASHCHECK;
+        hashcheck.hierarchy = TPM_RH_ENDORSEMENT;
+
+        //act
+        COMPARE_WITH_GENERATED(TPMT_TK_CREATION, creation);
+        COMPARE_WITH_GENERATED(TPMT_TK_AUTH, auth);
+        COMPARE_WITH_GENERATED(TPMT_TK_HASHCHECK, hashcheck);
+
+        //assert
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TableMarshal_structures_match_generated_succeed)
+    {
+        //arrange
+        TPMS_TIME_INFO timeInfo;
+        TPMS_CONTEXT context;
+
+        memset(&timeInfo, 0, sizeof(timeInfo));
+        memset(&context, 0, sizeof(context));
+        timeInfo.time = 0x1122334455667788;
+        timeInfo.clockInfo.clock = 0x0102030405060708;
+        timeInfo.clockInfo.resetCount = 5;
+        timeInfo.clockInfo.restartCount = 0xA0B0C0D0;
+        timeInfo.clockInfo.safe = YES;
+        context.sequence = 9;
+        context.savedHandle = TRANSIENT_FIRST;
+        context.hierarchy = TPM_RH_OWNER;
+        context.contextBlob.t.size = 80;
+        fill_buffer(context.contextBlob.t.buffer, context.contextBlob.t.size);
+
+        //act
+        COMPARE_WITH_GENERATED(TPMS_CLOCK_INFO, timeInfo.clockInfo);
+        COMPARE_WITH_GENERATED(TPMS_TIME_INFO, timeInfo);
+        COMPARE_WITH_GENERATED(TPMS_CONTEXT, context);
+
+        //assert
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TableMarshal_lists_match_generated_succeed)
+    {
+        //arrange
+        TPML_CC commands;
+        TPML_HANDLE handles;
+        TPML_HANDLE noHandles;
+        TPML_ALG_PROPERTY algorithms;
+        TPML_TAGGED_TPM_PROPERTY properties;
+        UINT32 index;
+
+        memset(&commands, 0, sizeof(commands));
+        memset(&handles, 0, sizeof(handles));
+        memset(&noHandles, 0, sizeof(noHandles));
+        memset(&algorithms, 0, sizeof(algorithms));
+        memset(&properties, 0, sizeof(properties));
+        commands.count = 5;
+        for (index = 0; index < commands.count; index++)
+        {
+            commands.commandCodes[index] = TPM_CC_Startup + index;
+        }
+        handles.count = 7;
+        for (index = 0; index < handles.count; index++)
+        {
+            handles.handle[index] = PERSISTENT_FIRST + index;
+        }
+        algorithms.count = 4;
+        for (index = 0; index < algorithms.count; index++)
+        {
+            algorithms.algProperties[index].alg = (TPM_ALG_ID)(index + 1);
+        }
+        properties.count = 6;
+        for (index = 0; index < properties.count; index++)
+        {
+            properties.tpmProperty[index].property = PT_FIXED + index;
+            properties.tpmProperty[index].value = index * 1000;
+        }
+
+        //act
+        COMPARE_WITH_GENERATED(TPML_CC, commands);
+        COMPARE_WITH_GENERATED(TPML_HANDLE, handles);
+        COMPARE_WITH_GENERATED(TPML_HANDLE, noHandles);
+        COMPARE_WITH_GENERATED(TPML_ALG_PROPERTY, algorithms);
+        COMPARE_WITH_GENERATED(TPML_TAGGED_TPM_PROPERTY, properties);
+
+        //assert
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TableUnmarshal_wrong_tag_fail)
+    {
+        //arrange
+        BYTE data[] = { 0x80, 0x14, 0x40, 0x00, 0x00, 0x01, 0x00, 0x00 };
+        BYTE* buffer = data;
+        INT32 size = sizeof(data);
+        TPMT_TK_CREATION ticket;
+
+        //act
+        TPM_RC result = TableUnmarshal(&TSS_MD_TPMT_TK_CREATION, &ticket, &buffer, &size);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TPM_RC_TAG, result);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TableUnmarshal_count_too_large_fail)
+    {
+        //arrange
+        BYTE data[] = { 0x00, 0x00, 0x10, 0x00 };
+        BYTE* buffer = data;
+        INT32 size = sizeof(data);
+        TPML_HANDLE handles;
+
+        //act
+        TPM_RC result = TableUnmarshal(&TSS_MD_TPML_HANDLE, &handles, &buffer, &size);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TPM_RC_SIZE, result);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TableUnmarshal_TPM2B_too_large_fail)
+    {
+        //arrange
+        BYTE data[] = { 0x10, 0x00 };
+        BYTE* buffer = data;
+        INT32 size = sizeof(data);
+        TPM2B_DIGEST digest;
+
+        //act
+        TPM_RC result = TableUnmarshal(&TSS_MD_TPM2B_DIGEST, &digest, &buffer, &size);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TPM_RC_SIZE, result);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TableUnmarshal_checked_member_fail)
+    {
+        //arrange
+        BYTE data[17] = { 0 };
+        BYTE* buffer = data;
+        INT32 size = sizeof(data);
+        TPMS_CLOCK_INFO clockInfo;
+        BYTE* generatedBuffer = data;
+        INT32 generatedSize = sizeof(data);
+        TPMS_CLOCK_INFO generatedClockInfo;
+        data[16] = 7;
+
+        //act
+        TPM_RC result = TableUnmarshal(&TSS_MD_TPMS_CLOCK_INFO, &clockInfo, &buffer, &size);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, TPM_RC_SUCCESS, result);
+        ASSERT_ARE_EQUAL(int, TPMS_CLOCK_INFO_Unmarshal(&generatedClockInfo, &generatedBuffer, &generatedSize), result);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TableMarshal_short_buffer_succeed)
+    {
+        //arrange
+        TPMS_CLOCK_INFO clockInfo;
+        BYTE data[8];
+        BYTE* buffer = data;
+        INT32 size = sizeof(data);
+        memset(&clockInfo, 0, sizeof(clockInfo));
+
+        //act
+        UINT16 result = TableMarshal(&TSS_MD_TPMS_CLOCK_INFO, &clockInfo, &buffer, &size);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 17, result);
+        ASSERT_IS_TRUE(size < 0);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(TableUnmarshal_desc_NULL_fail)
+    {
+        //arrange
+        BYTE data[4] = { 0 };
+        BYTE* buffer = data;
+        INT32 size = sizeof(data);
+        TPML_HANDLE handles;
+
+        //act
+        TPM_RC result = TableUnmarshal(NULL, &handles, &buffer, &size);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, TPM_RC_SUCCESS, result);
+
+        //cleanup
+    }
+
+    END_TEST_SUITE(tpm_marshal_table_ut)
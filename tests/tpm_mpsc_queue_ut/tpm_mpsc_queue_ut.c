@@ -0,0 +1,217 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#else
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+#include "azure_c_shared_utility/macro_utils.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+#undef ENABLE_MOCKS
+
+#include "azure_utpm_c/tpm_mpsc_queue.h"
+
+typedef struct TEST_ITEM_TAG
+{
+    TSS_MPSC_NODE node;
+    int value;
+} TEST_ITEM;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+BEGIN_TEST_SUITE(tpm_mpsc_queue_ut)
+
+    TEST_SUITE_INITIALIZE(suite_init)
+    {
+        int result;
+
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = TEST_MUTEX_CREATE();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+
+        (void)umock_c_init(on_umock_c_error);
+
+        result = umocktypes_charptr_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+        result = umocktypes_stdint_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+    }
+
+    TEST_SUITE_CLEANUP(suite_cleanup)
+    {
+        umock_c_deinit();
+
+        TEST_MUTEX_DESTROY(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(method_init)
+    {
+        if (TEST_MUTEX_ACQUIRE(g_testByTest))
+        {
+            ASSERT_FAIL("Could not acquire test serialization mutex.");
+        }
+        umock_c_reset_all_calls();
+    }
+
+    TEST_FUNCTION_CLEANUP(method_cleanup)
+    {
+        TEST_MUTEX_RELEASE(g_testByTest);
+    }
+
+    TEST_FUNCTION(tpm_mpsc_pop_empty_succeed)
+    {
+        //arrange
+        TSS_MPSC_QUEUE queue;
+        tpm_mpsc_init(&queue);
+
+        //act
+        TSS_MPSC_NODE* result = tpm_mpsc_pop(&queue);
+
+        //assert
+        ASSERT_IS_NULL(result);
+        ASSERT_IS_TRUE(tpm_mpsc_is_empty(&queue));
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_mpsc_push_NULL_fail)
+    {
+        //arrange
+        TSS_MPSC_QUEUE queue;
+        tpm_mpsc_init(&queue);
+
+        //act
+        bool result = tpm_mpsc_push(&queue, NULL);
+
+        //assert
+        ASSERT_IS_FALSE(result);
+        ASSERT_IS_TRUE(tpm_mpsc_is_empty(&queue));
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_mpsc_push_reports_empty_queue_succeed)
+    {
+        //arrange
+        TSS_MPSC_QUEUE queue;
+        TEST_ITEM first;
+        TEST_ITEM second;
+        tpm_mpsc_init(&queue);
+
+        //act
+        bool first_was_empty = tpm_mpsc_push(&queue, &first.node);
+        bool second_was_empty = tpm_mpsc_push(&queue, &second.node);
+
+        //assert
+        ASSERT_IS_TRUE(first_was_empty);
+        ASSERT_IS_FALSE(second_was_empty);
+        ASSERT_IS_FALSE(tpm_mpsc_is_empty(&queue));
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_mpsc_pop_fifo_order_succeed)
+    {
+        //arrange
+        TSS_MPSC_QUEUE queue;
+        TEST_ITEM items[4];
+        TEST_ITEM* popped;
+        int index;
+        tpm_mpsc_init(&queue);
+        for (index = 0; index < 4; index++)
+        {
+            items[index].value = index;
+            (void)tpm_mpsc_push(&queue, &items[index].node);
+        }
+
+        //act
+        for (index = 0; index < 4; index++)
+        {
+            popped = (TEST_ITEM*)tpm_mpsc_pop(&queue);
+
+            //assert
+            ASSERT_IS_NOT_NULL(popped);
+            ASSERT_ARE_EQUAL(int, index, popped->value);
+        }
+        ASSERT_IS_NULL(tpm_mpsc_pop(&queue));
+        ASSERT_IS_TRUE(tpm_mpsc_is_empty(&queue));
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_mpsc_push_after_drain_succeed)
+    {
+        //arrange
+        TSS_MPSC_QUEUE queue;
+        TEST_ITEM first;
+        TEST_ITEM second;
+        tpm_mpsc_init(&queue);
+        first.value = 1;
+        second.value = 2;
+        (void)tpm_mpsc_push(&queue, &first.node);
+        ASSERT_ARE_EQUAL(void_ptr, &first.node, tpm_mpsc_pop(&queue));
+
+        //act
+        bool was_empty = tpm_mpsc_push(&queue, &second.node);
+        TEST_ITEM* popped = (TEST_ITEM*)tpm_mpsc_pop(&queue);
+
+        //assert
+        ASSERT_IS_TRUE(was_empty);
+        ASSERT_IS_NOT_NULL(popped);
+        ASSERT_ARE_EQUAL(int, 2, popped->value);
+        ASSERT_IS_NULL(tpm_mpsc_pop(&queue));
+
+        //cleanup
+    }
+
+END_TEST_SUITE(tpm_mpsc_queue_ut)
@@ -0,0 +1,211 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#else
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+#include "azure_c_shared_utility/macro_utils.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_utpm_c/tpm_codec.h"
+#include "azure_utpm_c/Marshal_fp.h"
+#undef ENABLE_MOCKS
+
+#include "azure_utpm_c/tpm_public_cache.h"
+
+#define TEST_CACHE_PATH         "tpm_public_cache_ut_missing.bin"
+#define TEST_TPM_PROPERTY       0x49424d00
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+BEGIN_TEST_SUITE(tpm_public_cache_ut)
+
+    TEST_SUITE_INITIALIZE(suite_init)
+    {
+        int result;
+
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = TEST_MUTEX_CREATE();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+
+        (void)umock_c_init(on_umock_c_error);
+
+        result = umocktypes_charptr_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+        result = umocktypes_stdint_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+
+        REGISTER_UMOCK_ALIAS_TYPE(BOOL, int);
+        REGISTER_UMOCK_ALIAS_TYPE(INT32, int32_t);
+        REGISTER_UMOCK_ALIAS_TYPE(TPM_RC, uint32_t);
+        REGISTER_UMOCK_ALIAS_TYPE(TPM_PT, uint32_t);
+        REGISTER_UMOCK_ALIAS_TYPE(TPM_HANDLE, uint32_t);
+
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+        REGISTER_GLOBAL_MOCK_RETURN(TSS_GetTpmProperty, TEST_TPM_PROPERTY);
+    }
+
+    TEST_SUITE_CLEANUP(suite_cleanup)
+    {
+        umock_c_deinit();
+
+        TEST_MUTEX_DESTROY(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(method_init)
+    {
+        if (TEST_MUTEX_ACQUIRE(g_testByTest))
+        {
+            ASSERT_FAIL("Could not acquire test serialization mutex.");
+        }
+        umock_c_reset_all_calls();
+    }
+
+    TEST_FUNCTION_CLEANUP(method_cleanup)
+    {
+        TEST_MUTEX_RELEASE(g_testByTest);
+    }
+
+    TEST_FUNCTION(tpm_public_cache_load_tpm_NULL_fail)
+    {
+        //arrange
+        TSS_PUBLIC_CACHE cache;
+
+        //act
+        int result = tpm_public_cache_load(NULL, &cache, TEST_CACHE_PATH);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_public_cache_load_path_NULL_fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_PUBLIC_CACHE cache;
+
+        //act
+        int result = tpm_public_cache_load(&tss_dev, &cache, NULL);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_public_cache_load_identity_fail)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_PUBLIC_CACHE cache;
+
+        STRICT_EXPECTED_CALL(TSS_GetTpmProperty(&tss_dev, TPM_PT_MANUFACTURER)).SetReturn((UINT32)-1);
+
+        //act
+        int result = tpm_public_cache_load(&tss_dev, &cache, TEST_CACHE_PATH);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_public_cache_load_no_file_succeed)
+    {
+        //arrange
+        TSS_DEVICE tss_dev = { 0 };
+        TSS_PUBLIC_CACHE cache;
+
+        STRICT_EXPECTED_CALL(TSS_GetTpmProperty(&tss_dev, TPM_PT_MANUFACTURER));
+        STRICT_EXPECTED_CALL(TSS_GetTpmProperty(&tss_dev, TPM_PT_VENDOR_STRING_1));
+        STRICT_EXPECTED_CALL(TSS_GetTpmProperty(&tss_dev, TPM_PT_FIRMWARE_VERSION_1));
+        STRICT_EXPECTED_CALL(TSS_GetTpmProperty(&tss_dev, TPM_PT_FIRMWARE_VERSION_2));
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+        //act
+        int result = tpm_public_cache_load(&tss_dev, &cache, TEST_CACHE_PATH);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(uint32_t, 0, cache.Count);
+        ASSERT_IS_FALSE(cache.Dirty);
+        ASSERT_ARE_EQUAL(uint32_t, TEST_TPM_PROPERTY, cache.Identity[0]);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_public_cache_save_cache_NULL_fail)
+    {
+        //arrange
+
+        //act
+        int result = tpm_public_cache_save(NULL, TEST_CACHE_PATH);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_public_cache_save_not_dirty_succeed)
+    {
+        //arrange
+        TSS_PUBLIC_CACHE cache = { { 0 } };
+
+        //act
+        int result = tpm_public_cache_save(&cache, TEST_CACHE_PATH);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+END_TEST_SUITE(tpm_public_cache_ut)
@@ -0,0 +1,848 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#else
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+#include "umocktypes_bool.h"
+#include "azure_c_shared_utility/macro_utils.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_utpm_c/tpm_comm.h"
+#include "azure_utpm_c/tpm_codec.h"
+#include "azure_utpm_c/tpm_mpsc_queue.h"
+#undef ENABLE_MOCKS
+
+#include "azure_utpm_c/tpm_resource_mgr.h"
+
+#define TEST_LOCK_HANDLE        (LOCK_HANDLE)0x4321
+#define TEST_COND_HANDLE        (COND_HANDLE)0x4322
+#define TEST_PHYSICAL_HANDLE_1  (TPM_HANDLE)0x80000001
+#define TEST_PHYSICAL_HANDLE_2  (TPM_HANDLE)0x80000002
+#define TEST_CMD_SIZE           14
+#define TEST_RESP_CAPACITY      64
+
+// Responses returned by the next calls to tpm_comm_submit_command
+static TPM_RC g_response_codes[4];
+static TPM_HANDLE g_response_handle;
+static size_t g_response_index;
+
+static void set_uint32(BYTE* buffer, UINT32 value)
+{
+    buffer[0] = (BYTE)(value >> 24);
+    buffer[1] = (BYTE)(value >> 16);
+    buffer[2] = (BYTE)(value >> 8);
+    buffer[3] = (BYTE)value;
+}
+
+static UINT32 get_uint32(const BYTE* buffer)
+{
+    return ((UINT32)buffer[0] << 24) | ((UINT32)buffer[1] << 16) | ((UINT32)buffer[2] << 8) | buffer[3];
+}
+
+static int my_tpm_comm_submit_command(TPM_COMM_HANDLE handle, const unsigned char* cmd_bytes, uint32_t bytes_len, unsigned char* response, uint32_t* resp_len)
+{
+    TPM_RC response_code = g_response_codes[g_response_index++];
+    (void)handle;
+    (void)bytes_len;
+
+    response[0] = 0x80;
+    response[1] = 0x01;
+    set_uint32(response + 6, response_code);
+    if (response_code == TPM_RC_SUCCESS && get_uint32(cmd_bytes + 6) == TPM_CC_CreatePrimary)
+    {
+        set_uint32(response + 10, g_response_handle);
+        *resp_len = 14;
+    }
+    else
+    {
+        *resp_len = 10;
+    }
+    set_uint32(response + 2, *resp_len);
+    return 0;
+}
+
+static TPM_RC my_TPM2_GetCapability(TSS_DEVICE* tpm, TPM_CAP capability, UINT32 property, UINT32 propertyCount, TPMI_YES_NO* moreData, TPMS_CAPABILITY_DATA* capabilityData)
+{
+    (void)tpm;
+    (void)property;
+    (void)propertyCount;
+    *moreData = NO;
+    capabilityData->capability = capability;
+    capabilityData->data.handles.count = 0;
+    return TPM_RC_SUCCESS;
+}
+
+// Builds a command with a single handle in its handle area
+static void build_command(BYTE* cmd, TPM_CC cmdCode, TPM_HANDLE handle)
+{
+    memset(cmd, 0, TEST_CMD_SIZE);
+    cmd[0] = 0x80;
+    cmd[1] = 0x01;
+    set_uint32(cmd + 2, TEST_CMD_SIZE);
+    set_uint32(cmd + 6, cmdCode);
+    set_uint32(cmd + 10, handle);
+}
+
+// Size of a command with one handle and a password authorization with an
+// empty nonce and HMAC
+#define TEST_SESSION_CMD_SIZE   27
+#define TEST_AUTH_SIZE_OFFSET   14
+#define TEST_NONCE_SIZE_OFFSET  22
+#define TEST_HMAC_SIZE_OFFSET   25
+
+static void set_uint16(BYTE* buffer, UINT16 value)
+{
+    buffer[0] = (BYTE)(value >> 8);
+    buffer[1] = (BYTE)value;
+}
+
+// Builds a command with a single handle and a password authorization
+static void build_session_command(BYTE* cmd, TPM_CC cmdCode, TPM_HANDLE handle)
+{
+    memset(cmd, 0, TEST_SESSION_CMD_SIZE);
+    set_uint16(cmd, TPM_ST_SESSIONS);
+    set_uint32(cmd + 2, TEST_SESSION_CMD_SIZE);
+    set_uint32(cmd + 6, cmdCode);
+    set_uint32(cmd + 10, handle);
+    set_uint32(cmd + TEST_AUTH_SIZE_OFFSET, 9);
+    set_uint32(cmd + 18, TPM_RS_PW);
+    cmd[24] = 0x01;
+}
+
+// Creates an object for 'client' and returns its virtual handle
+static TPM_HANDLE create_object(TSS_RESOURCE_MGR_HANDLE rm, TSS_DEVICE* client, TPM_HANDLE physical_handle)
+{
+    BYTE cmd[TEST_CMD_SIZE];
+    BYTE resp[TEST_RESP_CAPACITY];
+    UINT32 resp_size = sizeof(resp);
+
+    g_response_index = 0;
+    g_response_codes[0] = TPM_RC_SUCCESS;
+    g_response_handle = physical_handle;
+    build_command(cmd, TPM_CC_CreatePrimary, TPM_RH_OWNER);
+    (void)tpm_rm_submit_command(rm, client, 1, cmd, TEST_CMD_SIZE, resp, &resp_size);
+    return get_uint32(resp + 10);
+}
+
+static void on_request_complete(void* context, TSS_RM_REQUEST* request)
+{
+    (void)context;
+    (void)request;
+}
+
+// Plays the worker thread: the request is completed as soon as it is queued
+static bool my_tpm_mpsc_push(TSS_MPSC_QUEUE* queue, TSS_MPSC_NODE* node)
+{
+    TSS_RM_REQUEST* request = (TSS_RM_REQUEST*)node;
+    (void)queue;
+    request->status = TSS_SUCCESS;
+    request->callback(request->context, request);
+    // The queue was not empty, so the worker is not woken up
+    return false;
+}
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+BEGIN_TEST_SUITE(tpm_resource_mgr_ut)
+
+    TEST_SUITE_INITIALIZE(suite_init)
+    {
+        int result;
+
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = TEST_MUTEX_CREATE();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+
+        (void)umock_c_init(on_umock_c_error);
+
+        result = umocktypes_charptr_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+        result = umocktypes_stdint_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+        result = umocktypes_bool_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+
+        REGISTER_UMOCK_ALIAS_TYPE(BOOL, int);
+        REGISTER_UMOCK_ALIAS_TYPE(INT32, int32_t);
+        REGISTER_UMOCK_ALIAS_TYPE(TPM_RC, uint32_t);
+        REGISTER_UMOCK_ALIAS_TYPE(TPM_CAP, uint32_t);
+        REGISTER_UMOCK_ALIAS_TYPE(TPMI_DH_CONTEXT, uint32_t);
+        REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
+        REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
+        REGISTER_UMOCK_ALIAS_TYPE(COND_HANDLE, void*);
+        REGISTER_UMOCK_ALIAS_TYPE(COND_RESULT, int);
+        REGISTER_UMOCK_ALIAS_TYPE(THREAD_HANDLE, void*);
+        REGISTER_UMOCK_ALIAS_TYPE(THREAD_START_FUNC, void*);
+        REGISTER_UMOCK_ALIAS_TYPE(THREADAPI_RESULT, int);
+        REGISTER_UMOCK_ALIAS_TYPE(TPM_COMM_HANDLE, void*);
+
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+        REGISTER_GLOBAL_MOCK_RETURN(Lock_Init, TEST_LOCK_HANDLE);
+        REGISTER_GLOBAL_MOCK_RETURN(Lock, LOCK_OK);
+        REGISTER_GLOBAL_MOCK_RETURN(Unlock, LOCK_OK);
+        REGISTER_GLOBAL_MOCK_RETURN(Lock_Deinit, LOCK_OK);
+        REGISTER_GLOBAL_MOCK_RETURN(Condition_Init, TEST_COND_HANDLE);
+
+        REGISTER_GLOBAL_MOCK_RETURN(Initialize_TPM_Codec, TPM_RC_SUCCESS);
+        REGISTER_GLOBAL_MOCK_HOOK(TPM2_GetCapability, my_TPM2_GetCapability);
+        REGISTER_GLOBAL_MOCK_RETURN(TPM2_ContextSave, TPM_RC_SUCCESS);
+        REGISTER_GLOBAL_MOCK_RETURN(TPM2_FlushContext, TPM_RC_SUCCESS);
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_comm_submit_command, my_tpm_comm_submit_command);
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_mpsc_push, my_tpm_mpsc_push);
+    }
+
+    TEST_SUITE_CLEANUP(suite_cleanup)
+    {
+        umock_c_deinit();
+
+        TEST_MUTEX_DESTROY(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(method_init)
+    {
+        if (TEST_MUTEX_ACQUIRE(g_testByTest))
+        {
+            ASSERT_FAIL("Could not acquire test serialization mutex.");
+        }
+        umock_c_reset_all_calls();
+        memset(g_response_codes, 0, sizeof(g_response_codes));
+        g_response_index = 0;
+    }
+
+    TEST_FUNCTION_CLEANUP(method_cleanup)
+    {
+        TEST_MUTEX_RELEASE(g_testByTest);
+    }
+
+    TEST_FUNCTION(tpm_rm_create_succeed)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(Lock_Init());
+        STRICT_EXPECTED_CALL(Initialize_TPM_Codec(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPM2_GetCapability(IGNORED_PTR_ARG, TPM_CAP_HANDLES, HR_TRANSIENT, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+        //act
+        TSS_RESOURCE_MGR_HANDLE rm = tpm_rm_create(NULL);
+
+        //assert
+        ASSERT_IS_NOT_NULL(rm);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_rm_destroy(rm);
+    }
+
+    TEST_FUNCTION(tpm_rm_create_initialize_fail)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(Lock_Init());
+        STRICT_EXPECTED_CALL(Initialize_TPM_Codec(IGNORED_PTR_ARG)).SetReturn(TPM_RC_FAILURE);
+        STRICT_EXPECTED_CALL(Lock_Deinit(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+        //act
+        TSS_RESOURCE_MGR_HANDLE rm = tpm_rm_create(NULL);
+
+        //assert
+        ASSERT_IS_NULL(rm);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_rm_submit_command_handle_NULL_fail)
+    {
+        //arrange
+        TSS_DEVICE client = { 0 };
+        BYTE cmd[TEST_CMD_SIZE];
+        BYTE resp[TEST_RESP_CAPACITY];
+        UINT32 resp_size = sizeof(resp);
+        build_command(cmd, TPM_CC_ReadPublic, TPM_RH_OWNER);
+
+        //act
+        TSS_STATUS result = tpm_rm_submit_command(NULL, &client, 1, cmd, TEST_CMD_SIZE, resp, &resp_size);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TSS_E_INVALID_PARAM, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_rm_submit_command_returns_virtual_handle_succeed)
+    {
+        //arrange
+        TSS_DEVICE client = { 0 };
+        TSS_RESOURCE_MGR_HANDLE rm = tpm_rm_create(NULL);
+        BYTE cmd[TEST_CMD_SIZE];
+        BYTE resp[TEST_RESP_CAPACITY];
+        UINT32 resp_size = sizeof(resp);
+        g_response_handle = TEST_PHYSICAL_HANDLE_1;
+        build_command(cmd, TPM_CC_CreatePrimary, TPM_RH_OWNER);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(tpm_comm_submit_command(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_CMD_SIZE, resp, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+        //act
+        TSS_STATUS result = tpm_rm_submit_command(rm, &client, 1, cmd, TEST_CMD_SIZE, resp, &resp_size);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TSS_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, 14, resp_size);
+        ASSERT_ARE_NOT_EQUAL(uint32_t, TEST_PHYSICAL_HANDLE_1, get_uint32(resp + 10));
+        ASSERT_ARE_EQUAL(uint32_t, TPM_HT_TRANSIENT, get_uint32(resp + 10) >> HR_SHIFT);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_rm_destroy(rm);
+    }
+
+    TEST_FUNCTION(tpm_rm_submit_command_object_memory_evicts_lru_succeed)
+    {
+        //arrange
+        TSS_DEVICE client = { 0 };
+        TSS_RESOURCE_MGR_HANDLE rm = tpm_rm_create(NULL);
+        BYTE cmd[TEST_CMD_SIZE];
+        BYTE resp[TEST_RESP_CAPACITY];
+        UINT32 resp_size = sizeof(resp);
+        (void)create_object(rm, &client, TEST_PHYSICAL_HANDLE_1);
+        TPM_HANDLE second = create_object(rm, &client, TEST_PHYSICAL_HANDLE_2);
+        build_command(cmd, TPM_CC_ReadPublic, second);
+        g_response_index = 0;
+        g_response_codes[0] = TPM_RC_OBJECT_MEMORY;
+        g_response_codes[1] = TPM_RC_SUCCESS;
+        umock_c_reset_all_calls();
+
+        // The first object is the least recently used one
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(tpm_comm_submit_command(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_CMD_SIZE, resp, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPM2_ContextSave(IGNORED_PTR_ARG, TEST_PHYSICAL_HANDLE_1, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TPM2_FlushContext(IGNORED_PTR_ARG, TEST_PHYSICAL_HANDLE_1));
+        STRICT_EXPECTED_CALL(tpm_comm_submit_command(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_CMD_SIZE, resp, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+        //act
+        TSS_STATUS result = tpm_rm_submit_command(rm, &client, 1, cmd, TEST_CMD_SIZE, resp, &resp_size);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TSS_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, get_uint32(resp + 6));
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_rm_destroy(rm);
+    }
+
+    TEST_FUNCTION(tpm_rm_submit_command_other_client_handle_fail)
+    {
+        //arrange
+        TSS_DEVICE owner = { 0 };
+        TSS_DEVICE client = { 0 };
+        TSS_RESOURCE_MGR_HANDLE rm = tpm_rm_create(NULL);
+        BYTE cmd[TEST_CMD_SIZE];
+        BYTE resp[TEST_RESP_CAPACITY];
+        UINT32 resp_size = sizeof(resp);
+        build_command(cmd, TPM_CC_ReadPublic, create_object(rm, &owner, TEST_PHYSICAL_HANDLE_1));
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+        //act
+        TSS_STATUS result = tpm_rm_submit_command(rm, &client, 1, cmd, TEST_CMD_SIZE, resp, &resp_size);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TSS_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_HANDLE + TPM_RC_H + TPM_RC_1, get_uint32(resp + 6));
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_rm_destroy(rm);
+    }
+
+    TEST_FUNCTION(tpm_rm_submit_command_password_session_succeed)
+    {
+        //arrange
+        TSS_DEVICE client = { 0 };
+        TSS_RESOURCE_MGR_HANDLE rm = tpm_rm_create(NULL);
+        BYTE cmd[TEST_SESSION_CMD_SIZE];
+        BYTE resp[TEST_RESP_CAPACITY];
+        UINT32 resp_size = sizeof(resp);
+        build_session_command(cmd, TPM_CC_ReadPublic, TPM_RH_OWNER);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(tpm_comm_submit_command(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_SESSION_CMD_SIZE, resp, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+        //act
+        TSS_STATUS result = tpm_rm_submit_command(rm, &client, 1, cmd, TEST_SESSION_CMD_SIZE, resp, &resp_size);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TSS_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SUCCESS, get_uint32(resp + 6));
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_rm_destroy(rm);
+    }
+
+    TEST_FUNCTION(tpm_rm_submit_command_auth_size_past_command_fail)
+    {
+        //arrange
+        TSS_DEVICE client = { 0 };
+        TSS_RESOURCE_MGR_HANDLE rm = tpm_rm_create(NULL);
+        BYTE cmd[TEST_SESSION_CMD_SIZE];
+        BYTE resp[TEST_RESP_CAPACITY];
+        UINT32 resp_size = sizeof(resp);
+        build_session_command(cmd, TPM_CC_ReadPublic, TPM_RH_OWNER);
+        set_uint32(cmd + TEST_AUTH_SIZE_OFFSET, 10);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        // Rejected without reaching the TPM
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+        //act
+        TSS_STATUS result = tpm_rm_submit_command(rm, &client, 1, cmd, TEST_SESSION_CMD_SIZE, resp, &resp_size);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TSS_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_AUTHSIZE, get_uint32(resp + 6));
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_rm_destroy(rm);
+    }
+
+    TEST_FUNCTION(tpm_rm_submit_command_auth_size_huge_fail)
+    {
+        //arrange
+        TSS_DEVICE client = { 0 };
+        TSS_RESOURCE_MGR_HANDLE rm = tpm_rm_create(NULL);
+        BYTE cmd[TEST_SESSION_CMD_SIZE];
+        BYTE resp[TEST_RESP_CAPACITY];
+        UINT32 resp_size = sizeof(resp);
+        build_session_command(cmd, TPM_CC_ReadPublic, TPM_RH_OWNER);
+        set_uint32(cmd + TEST_AUTH_SIZE_OFFSET, 0xFFFFFFF0);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        // Rejected without reaching the TPM
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+        //act
+        TSS_STATUS result = tpm_rm_submit_command(rm, &client, 1, cmd, TEST_SESSION_CMD_SIZE, resp, &resp_size);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TSS_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_AUTHSIZE, get_uint32(resp + 6));
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_rm_destroy(rm);
+    }
+
+    TEST_FUNCTION(tpm_rm_submit_command_truncated_authorization_fail)
+    {
+        //arrange
+        TSS_DEVICE client = { 0 };
+        TSS_RESOURCE_MGR_HANDLE rm = tpm_rm_create(NULL);
+        BYTE cmd[TEST_SESSION_CMD_SIZE];
+        BYTE resp[TEST_RESP_CAPACITY];
+        UINT32 resp_size = sizeof(resp);
+        build_session_command(cmd, TPM_CC_ReadPublic, TPM_RH_OWNER);
+        set_uint32(cmd + TEST_AUTH_SIZE_OFFSET, 5);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        // Rejected without reaching the TPM
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+        //act
+        TSS_STATUS result = tpm_rm_submit_command(rm, &client, 1, cmd, TEST_SESSION_CMD_SIZE, resp, &resp_size);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TSS_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_AUTHSIZE, get_uint32(resp + 6));
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_rm_destroy(rm);
+    }
+
+    TEST_FUNCTION(tpm_rm_submit_command_nonce_size_past_auth_area_fail)
+    {
+        //arrange
+        TSS_DEVICE client = { 0 };
+        TSS_RESOURCE_MGR_HANDLE rm = tpm_rm_create(NULL);
+        BYTE cmd[TEST_SESSION_CMD_SIZE];
+        BYTE resp[TEST_RESP_CAPACITY];
+        UINT32 resp_size = sizeof(resp);
+        build_session_command(cmd, TPM_CC_ReadPublic, TPM_RH_OWNER);
+        set_uint16(cmd + TEST_NONCE_SIZE_OFFSET, 0xFFFF);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        // Rejected without reaching the TPM
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+        //act
+        TSS_STATUS result = tpm_rm_submit_command(rm, &client, 1, cmd, TEST_SESSION_CMD_SIZE, resp, &resp_size);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TSS_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SIZE, get_uint32(resp + 6));
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_rm_destroy(rm);
+    }
+
+    TEST_FUNCTION(tpm_rm_submit_command_hmac_size_past_auth_area_fail)
+    {
+        //arrange
+        TSS_DEVICE client = { 0 };
+        TSS_RESOURCE_MGR_HANDLE rm = tpm_rm_create(NULL);
+        BYTE cmd[TEST_SESSION_CMD_SIZE];
+        BYTE resp[TEST_RESP_CAPACITY];
+        UINT32 resp_size = sizeof(resp);
+        build_session_command(cmd, TPM_CC_ReadPublic, TPM_RH_OWNER);
+        set_uint16(cmd + TEST_HMAC_SIZE_OFFSET, 1);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        // Rejected without reaching the TPM
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+        //act
+        TSS_STATUS result = tpm_rm_submit_command(rm, &client, 1, cmd, TEST_SESSION_CMD_SIZE, resp, &resp_size);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TSS_SUCCESS, result);
+        ASSERT_ARE_EQUAL(uint32_t, TPM_RC_SIZE, get_uint32(resp + 6));
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_rm_destroy(rm);
+    }
+
+    TEST_FUNCTION(tpm_rm_start_worker_handle_NULL_fail)
+    {
+        //arrange
+
+        //act
+        int result = tpm_rm_start_worker(NULL);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_rm_start_worker_thread_fail)
+    {
+        //arrange
+        TSS_RESOURCE_MGR_HANDLE rm = tpm_rm_create(NULL);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Lock_Init());
+        STRICT_EXPECTED_CALL(Condition_Init());
+        STRICT_EXPECTED_CALL(tpm_mpsc_init(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, rm)).SetReturn(THREADAPI_ERROR);
+        STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
+        STRICT_EXPECTED_CALL(Lock_Deinit(TEST_LOCK_HANDLE));
+
+        //act
+        int result = tpm_rm_start_worker(rm);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_rm_destroy(rm);
+    }
+
+    TEST_FUNCTION(tpm_rm_start_worker_condition_fail)
+    {
+        //arrange
+        TSS_RESOURCE_MGR_HANDLE rm = tpm_rm_create(NULL);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Lock_Init());
+        STRICT_EXPECTED_CALL(Condition_Init()).SetReturn(NULL);
+        STRICT_EXPECTED_CALL(Lock_Deinit(TEST_LOCK_HANDLE));
+
+        //act
+        int result = tpm_rm_start_worker(rm);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_rm_destroy(rm);
+    }
+
+    TEST_FUNCTION(tpm_rm_submit_async_no_worker_fail)
+    {
+        //arrange
+        TSS_DEVICE client = { 0 };
+        TSS_RESOURCE_MGR_HANDLE rm = tpm_rm_create(NULL);
+        BYTE cmd[TEST_CMD_SIZE];
+        BYTE resp[TEST_RESP_CAPACITY];
+        UINT32 resp_size = sizeof(resp);
+        TSS_RM_REQUEST request;
+        build_command(cmd, TPM_CC_ReadPublic, TPM_RH_OWNER);
+        memset(&request, 0, sizeof(request));
+        request.client = &client;
+        request.numHandles = 1;
+        request.cmdBuffer = cmd;
+        request.cmdSize = TEST_CMD_SIZE;
+        request.respBuffer = resp;
+        request.respSize = &resp_size;
+        request.callback = on_request_complete;
+        umock_c_reset_all_calls();
+
+        //act
+        TSS_STATUS result = tpm_rm_submit_async(rm, &request);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TSS_E_INVALID_PARAM, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_rm_destroy(rm);
+    }
+
+    TEST_FUNCTION(tpm_rm_submit_async_callback_NULL_fail)
+    {
+        //arrange
+        TSS_RESOURCE_MGR_HANDLE rm = tpm_rm_create(NULL);
+        TSS_RM_REQUEST request;
+        memset(&request, 0, sizeof(request));
+        umock_c_reset_all_calls();
+
+        //act
+        TSS_STATUS result = tpm_rm_submit_async(rm, &request);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TSS_E_INVALID_PARAM, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_rm_destroy(rm);
+    }
+
+    TEST_FUNCTION(tpm_rm_release_client_succeed)
+    {
+        //arrange
+        TSS_DEVICE owner = { 0 };
+        TSS_DEVICE client = { 0 };
+        TSS_RESOURCE_MGR_HANDLE rm = tpm_rm_create(NULL);
+        (void)create_object(rm, &owner, TEST_PHYSICAL_HANDLE_1);
+        (void)create_object(rm, &client, TEST_PHYSICAL_HANDLE_2);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(TPM2_FlushContext(IGNORED_PTR_ARG, TEST_PHYSICAL_HANDLE_2));
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+        //act
+        tpm_rm_release_client(rm, &client);
+
+        //assert
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_rm_destroy(rm);
+    }
+
+    TEST_FUNCTION(tpm_rm_attach_client_succeed)
+    {
+        //arrange
+        TSS_DEVICE client = { 0 };
+        TSS_RESOURCE_MGR_HANDLE rm = tpm_rm_create(NULL);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(Lock_Init());
+        STRICT_EXPECTED_CALL(Condition_Init());
+
+        //act
+        int result = tpm_rm_attach_client(rm, &client);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_IS_NOT_NULL(client.RmWaiter);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_rm_release_client(rm, &client);
+        tpm_rm_destroy(rm);
+    }
+
+    TEST_FUNCTION(tpm_rm_attach_client_condition_fail)
+    {
+        //arrange
+        TSS_DEVICE client = { 0 };
+        TSS_RESOURCE_MGR_HANDLE rm = tpm_rm_create(NULL);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(Lock_Init());
+        STRICT_EXPECTED_CALL(Condition_Init()).SetReturn(NULL);
+        STRICT_EXPECTED_CALL(Lock_Deinit(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+        //act
+        int result = tpm_rm_attach_client(rm, &client);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_IS_NULL(client.RmWaiter);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_rm_destroy(rm);
+    }
+
+    TEST_FUNCTION(tpm_rm_submit_command_worker_reuses_client_waiter_succeed)
+    {
+        //arrange
+        TSS_DEVICE client = { 0 };
+        TSS_RESOURCE_MGR_HANDLE rm = tpm_rm_create(NULL);
+        BYTE cmd[TEST_CMD_SIZE];
+        BYTE resp[TEST_RESP_CAPACITY];
+        UINT32 resp_size = sizeof(resp);
+        TSS_STATUS result[2];
+        size_t index;
+        (void)tpm_rm_start_worker(rm);
+        (void)tpm_rm_attach_client(rm, &client);
+        build_command(cmd, TPM_CC_ReadPublic, TPM_RH_OWNER);
+        umock_c_reset_all_calls();
+
+        // No lock or condition is created per command
+        for (index = 0; index < 2; index++)
+        {
+            STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+            STRICT_EXPECTED_CALL(tpm_mpsc_push(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+            STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+            STRICT_EXPECTED_CALL(Condition_Post(TEST_COND_HANDLE));
+            STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+            STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+        }
+
+        //act
+        result[0] = tpm_rm_submit_command(rm, &client, 1, cmd, TEST_CMD_SIZE, resp, &resp_size);
+        result[1] = tpm_rm_submit_command(rm, &client, 1, cmd, TEST_CMD_SIZE, resp, &resp_size);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TSS_SUCCESS, result[0]);
+        ASSERT_ARE_EQUAL(int, TSS_SUCCESS, result[1]);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_rm_release_client(rm, &client);
+        tpm_rm_destroy(rm);
+    }
+
+    TEST_FUNCTION(tpm_rm_submit_command_worker_client_not_attached_fail)
+    {
+        //arrange
+        TSS_DEVICE client = { 0 };
+        TSS_RESOURCE_MGR_HANDLE rm = tpm_rm_create(NULL);
+        BYTE cmd[TEST_CMD_SIZE];
+        BYTE resp[TEST_RESP_CAPACITY];
+        UINT32 resp_size = sizeof(resp);
+        (void)tpm_rm_start_worker(rm);
+        build_command(cmd, TPM_CC_ReadPublic, TPM_RH_OWNER);
+        umock_c_reset_all_calls();
+
+        //act
+        TSS_STATUS result = tpm_rm_submit_command(rm, &client, 1, cmd, TEST_CMD_SIZE, resp, &resp_size);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, TSS_E_INVALID_PARAM, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_rm_destroy(rm);
+    }
+
+    TEST_FUNCTION(tpm_rm_release_client_frees_waiter_succeed)
+    {
+        //arrange
+        TSS_DEVICE client = { 0 };
+        TSS_RESOURCE_MGR_HANDLE rm = tpm_rm_create(NULL);
+        (void)tpm_rm_attach_client(rm, &client);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
+        STRICT_EXPECTED_CALL(Lock_Deinit(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+        //act
+        tpm_rm_release_client(rm, &client);
+
+        //assert
+        ASSERT_IS_NULL(client.RmWaiter);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_rm_destroy(rm);
+    }
+
+END_TEST_SUITE(tpm_resource_mgr_ut)
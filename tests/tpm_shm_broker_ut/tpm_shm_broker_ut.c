@@ -0,0 +1,771 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#else
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+#include "umocktypes_bool.h"
+#include "azure_c_shared_utility/macro_utils.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_utpm_c/tpm_comm.h"
+#include "azure_utpm_c/tpm_timer.h"
+#undef ENABLE_MOCKS
+
+// Included by tpm_shm_sys.h, whose functions only are mocked
+#include "azure_utpm_c/tpm_shm_broker.h"
+
+#define ENABLE_MOCKS
+#include "azure_utpm_c/tpm_shm_sys.h"
+#undef ENABLE_MOCKS
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+#define TEST_BROKER_NAME            "utpmtest"
+#define TEST_COMM_HANDLE            (TPM_COMM_HANDLE)0x4444
+#define TEST_LISTEN_SOCKET          5
+#define TEST_SEGMENT_FD             9
+// Sockets of the accepted clients are numbered from there
+#define TEST_CLIENT_SOCKET          100
+#define TEST_BROKER_PID             4321
+#define TEST_BROKER_UID             1000
+#define TEST_BROKER_GID             1000
+#define TEST_CLIENT_PID             1234
+#define TEST_OTHER_ID               2000
+#define TEST_TIMER_STEP_NS          1000000
+
+// TPM2_GetRandom of 8 bytes
+static const unsigned char TEST_GET_RANDOM_CMD[] = { 0x80, 0x01, 0x00, 0x00, 0x00, 0x0c, 0x00, 0x00, 0x01, 0x7b, 0x00, 0x08 };
+static const unsigned char TEST_RESPONSE[] = { 0x80, 0x01, 0x00, 0x00, 0x00, 0x0a, 0x00, 0x00, 0x00, 0x00 };
+
+// Segments handed to the broker by tpm_shm_sys_create, one per client
+static TPM_SHM_SEGMENT g_segments[TPM_SHM_MAX_CLIENTS];
+static size_t g_created_count;
+static size_t g_accepted_count;
+// Credentials of the next client accepted
+static TPM_SHM_CREDENTIALS g_peer;
+// Size of the response of the fake TPM, which fails the commands whose
+// response buffer is smaller
+static uint32_t g_tpm_resp_len;
+// Size of the response buffer given to the fake TPM by the last command
+static uint32_t g_resp_capacity;
+// Socket reported readable by the next tpm_shm_sys_poll, -1 for none
+static int g_readable_socket;
+// A command is written to this slot while the broker waits for the clients
+static TPM_SHM_SLOT* g_slot_on_poll;
+static uint64_t g_now_ns;
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+// Writes a command to the slot the way tpm_comm_shm does
+static void write_command(TPM_SHM_SLOT* slot, TPM_COMM_PRIORITY priority, uint32_t cmd_len)
+{
+    slot->priority = (uint32_t)priority;
+    memcpy(slot->cmd, TEST_GET_RANDOM_CMD, sizeof(TEST_GET_RANDOM_CMD));
+    slot->cmd_len = cmd_len;
+    slot->cmd_seq++;
+}
+
+static int my_tpm_shm_sys_accept(int listen_socket, TPM_SHM_CREDENTIALS* peer)
+{
+    (void)listen_socket;
+    *peer = g_peer;
+    return TEST_CLIENT_SOCKET + (int)g_accepted_count++;
+}
+
+static TPM_SHM_SEGMENT* my_tpm_shm_sys_create(int* fd)
+{
+    TPM_SHM_SEGMENT* result = &g_segments[g_created_count++];
+    memset(result, 0, sizeof(TPM_SHM_SEGMENT));
+    *fd = TEST_SEGMENT_FD;
+    return result;
+}
+
+static int my_tpm_shm_sys_poll(int* sockets, size_t count, uint32_t timeout_ms, bool* readable)
+{
+    int result = 0;
+    size_t index;
+    (void)timeout_ms;
+    if (g_slot_on_poll != NULL)
+    {
+        write_command(g_slot_on_poll, TPM_COMM_PRIORITY_NORMAL, sizeof(TEST_GET_RANDOM_CMD));
+        g_slot_on_poll = NULL;
+    }
+    for (index = 0; index < count; index++)
+    {
+        readable[index] = sockets[index] == g_readable_socket;
+        if (readable[index])
+        {
+            result++;
+        }
+    }
+    g_readable_socket = -1;
+    return result;
+}
+
+static void my_tpm_shm_sys_get_credentials(TPM_SHM_CREDENTIALS* credentials)
+{
+    credentials->pid = TEST_BROKER_PID;
+    credentials->uid = TEST_BROKER_UID;
+    credentials->gid = TEST_BROKER_GID;
+}
+
+static int my_tpm_comm_submit_command(TPM_COMM_HANDLE handle, const unsigned char* cmd_bytes, uint32_t bytes_len, unsigned char* response, uint32_t* resp_len)
+{
+    int result;
+    (void)handle;
+    (void)cmd_bytes;
+    (void)bytes_len;
+    g_resp_capacity = *resp_len;
+    if (g_tpm_resp_len > *resp_len)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        memcpy(response, TEST_RESPONSE, sizeof(TEST_RESPONSE));
+        *resp_len = g_tpm_resp_len;
+        result = 0;
+    }
+    return result;
+}
+
+static uint64_t my_tpm_timer_get_ns(void)
+{
+    g_now_ns += TEST_TIMER_STEP_NS;
+    return g_now_ns;
+}
+
+static TPM_SHM_BROKER_HANDLE create_broker(void)
+{
+    TPM_SHM_BROKER_HANDLE result = tpm_shm_broker_create(TEST_BROKER_NAME, NULL);
+    ASSERT_IS_NOT_NULL(result);
+    umock_c_reset_all_calls();
+    return result;
+}
+
+// Has the broker accept 'count' clients, which get g_segments[0] onwards
+static void connect_clients(TPM_SHM_BROKER_HANDLE broker, size_t count)
+{
+    size_t index;
+    for (index = 0; index < count; index++)
+    {
+        g_readable_socket = TEST_LISTEN_SOCKET;
+        ASSERT_ARE_EQUAL(int, 0, tpm_shm_broker_serve(broker, 2));
+    }
+    umock_c_reset_all_calls();
+}
+
+// Calls of a tpm_shm_broker_serve(broker, 2) accepting a client
+static void setup_accept_mocks(void)
+{
+    STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+    STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+    STRICT_EXPECTED_CALL(tpm_shm_sys_poll(IGNORED_PTR_ARG, IGNORED_NUM_ARG, 1, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tpm_shm_sys_accept(TEST_LISTEN_SOCKET, IGNORED_PTR_ARG));
+}
+
+static void setup_execute_mocks(TPM_SHM_SLOT* slot, uint32_t cmd_len)
+{
+    STRICT_EXPECTED_CALL(tpm_comm_submit_command(TEST_COMM_HANDLE, slot->cmd, cmd_len, slot->resp, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tpm_shm_sys_wake(&slot->resp_seq));
+}
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+BEGIN_TEST_SUITE(tpm_shm_broker_ut)
+
+    TEST_SUITE_INITIALIZE(suite_init)
+    {
+        int result;
+
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = TEST_MUTEX_CREATE();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+
+        (void)umock_c_init(on_umock_c_error);
+
+        result = umocktypes_charptr_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+        result = umocktypes_stdint_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+        result = umocktypes_bool_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+
+        REGISTER_UMOCK_ALIAS_TYPE(TPM_COMM_HANDLE, void*);
+        REGISTER_UMOCK_ALIAS_TYPE(TPM_SHM_SEGMENT*, void*);
+        REGISTER_UMOCK_ALIAS_TYPE(TPM_SHM_WORD*, void*);
+        REGISTER_UMOCK_ALIAS_TYPE(TPM_SHM_CREDENTIALS*, void*);
+        REGISTER_UMOCK_ALIAS_TYPE(int*, void*);
+        REGISTER_UMOCK_ALIAS_TYPE(bool*, void*);
+
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+        REGISTER_GLOBAL_MOCK_RETURN(tpm_comm_create, TEST_COMM_HANDLE);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(tpm_comm_create, NULL);
+        REGISTER_GLOBAL_MOCK_RETURN(tpm_comm_needs_startup, true);
+        REGISTER_GLOBAL_MOCK_RETURN(tpm_comm_is_resource_managed, false);
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_comm_submit_command, my_tpm_comm_submit_command);
+
+        REGISTER_GLOBAL_MOCK_RETURN(tpm_shm_sys_listen, TEST_LISTEN_SOCKET);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(tpm_shm_sys_listen, -1);
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_shm_sys_accept, my_tpm_shm_sys_accept);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(tpm_shm_sys_accept, -1);
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_shm_sys_create, my_tpm_shm_sys_create);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(tpm_shm_sys_create, NULL);
+        REGISTER_GLOBAL_MOCK_RETURN(tpm_shm_sys_send_segment, 0);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(tpm_shm_sys_send_segment, __LINE__);
+        REGISTER_GLOBAL_MOCK_RETURN(tpm_shm_sys_drain, 0);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(tpm_shm_sys_drain, __LINE__);
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_shm_sys_poll, my_tpm_shm_sys_poll);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(tpm_shm_sys_poll, -1);
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_shm_sys_get_credentials, my_tpm_shm_sys_get_credentials);
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_timer_get_ns, my_tpm_timer_get_ns);
+    }
+
+    TEST_SUITE_CLEANUP(suite_cleanup)
+    {
+        umock_c_deinit();
+
+        TEST_MUTEX_DESTROY(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(method_init)
+    {
+        if (TEST_MUTEX_ACQUIRE(g_testByTest))
+        {
+            ASSERT_FAIL("Could not acquire test serialization mutex.");
+        }
+        umock_c_reset_all_calls();
+
+        g_created_count = 0;
+        g_accepted_count = 0;
+        g_peer.pid = TEST_CLIENT_PID;
+        g_peer.uid = TEST_BROKER_UID;
+        g_peer.gid = TEST_BROKER_GID;
+        g_tpm_resp_len = sizeof(TEST_RESPONSE);
+        g_resp_capacity = 0;
+        g_readable_socket = -1;
+        g_slot_on_poll = NULL;
+        g_now_ns = 0;
+    }
+
+    TEST_FUNCTION_CLEANUP(method_cleanup)
+    {
+        TEST_MUTEX_RELEASE(g_testByTest);
+    }
+
+    TEST_FUNCTION(tpm_shm_broker_create_succeed)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(tpm_comm_create(NULL));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_listen(TEST_BROKER_NAME));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_get_credentials(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_comm_needs_startup(TEST_COMM_HANDLE));
+        STRICT_EXPECTED_CALL(tpm_comm_is_resource_managed(TEST_COMM_HANDLE));
+
+        //act
+        TPM_SHM_BROKER_HANDLE broker = tpm_shm_broker_create(TEST_BROKER_NAME, NULL);
+
+        //assert
+        ASSERT_IS_NOT_NULL(broker);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(size_t, 0, g_created_count);
+
+        //cleanup
+        tpm_shm_broker_destroy(broker);
+    }
+
+    TEST_FUNCTION(tpm_shm_broker_create_invalid_name_fail)
+    {
+        //arrange
+
+        //act
+        TPM_SHM_BROKER_HANDLE broker = tpm_shm_broker_create("utpm/test", NULL);
+
+        //assert
+        ASSERT_IS_NULL(broker);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_shm_broker_create_tpm_fail)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(tpm_comm_create(NULL)).SetReturn(NULL);
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+        //act
+        TPM_SHM_BROKER_HANDLE broker = tpm_shm_broker_create(TEST_BROKER_NAME, NULL);
+
+        //assert
+        ASSERT_IS_NULL(broker);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_shm_broker_create_listen_fail)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(tpm_comm_create(NULL));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_listen(TEST_BROKER_NAME)).SetReturn(-1);
+        STRICT_EXPECTED_CALL(tpm_comm_destroy(TEST_COMM_HANDLE));
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+        //act
+        TPM_SHM_BROKER_HANDLE broker = tpm_shm_broker_create(TEST_BROKER_NAME, NULL);
+
+        //assert
+        ASSERT_IS_NULL(broker);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_shm_broker_destroy_wakes_clients_succeed)
+    {
+        //arrange
+        TPM_SHM_BROKER_HANDLE broker = create_broker();
+        connect_clients(broker, 2);
+
+        STRICT_EXPECTED_CALL(tpm_shm_sys_wake(&g_segments[0].slot.resp_seq));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_unmap(&g_segments[0]));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_close(TEST_CLIENT_SOCKET));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_wake(&g_segments[1].slot.resp_seq));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_unmap(&g_segments[1]));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_close(TEST_CLIENT_SOCKET + 1));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_close(TEST_LISTEN_SOCKET));
+        STRICT_EXPECTED_CALL(tpm_comm_destroy(TEST_COMM_HANDLE));
+        STRICT_EXPECTED_CALL(gballoc_free(broker));
+
+        //act
+        tpm_shm_broker_destroy(broker);
+
+        //assert
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(int32_t, 0, g_segments[0].broker_pid);
+        ASSERT_ARE_EQUAL(int32_t, 0, g_segments[1].broker_pid);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_shm_broker_serve_handle_NULL_fail)
+    {
+        //arrange
+
+        //act
+        int result = tpm_shm_broker_serve(NULL, 0);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, -1, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_shm_broker_serve_accepts_client_succeed)
+    {
+        //arrange
+        TPM_SHM_BROKER_HANDLE broker = create_broker();
+        g_readable_socket = TEST_LISTEN_SOCKET;
+
+        setup_accept_mocks();
+        STRICT_EXPECTED_CALL(tpm_shm_sys_create(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_send_segment(TEST_CLIENT_SOCKET, TEST_SEGMENT_FD));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_close(TEST_SEGMENT_FD));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+
+        //act
+        int result = tpm_shm_broker_serve(broker, 2);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(uint32_t, TPM_SHM_MAGIC, g_segments[0].magic);
+        ASSERT_ARE_EQUAL(uint32_t, TPM_SHM_VERSION, g_segments[0].version);
+        ASSERT_ARE_EQUAL(int32_t, TEST_BROKER_PID, g_segments[0].broker_pid);
+        ASSERT_ARE_EQUAL(uint32_t, 1, g_segments[0].needs_startup);
+        ASSERT_ARE_EQUAL(uint32_t, 0, g_segments[0].resource_managed);
+        ASSERT_ARE_EQUAL(uint32_t, TPM_COMM_PRIORITY_NORMAL, g_segments[0].slot.priority);
+
+        //cleanup
+        tpm_shm_broker_destroy(broker);
+    }
+
+    TEST_FUNCTION(tpm_shm_broker_serve_needs_startup_first_client_only_succeed)
+    {
+        //arrange
+        TPM_SHM_BROKER_HANDLE broker = create_broker();
+
+        //act
+        connect_clients(broker, 2);
+
+        //assert
+        ASSERT_ARE_EQUAL(size_t, 2, g_created_count);
+        ASSERT_ARE_EQUAL(uint32_t, 1, g_segments[0].needs_startup);
+        ASSERT_ARE_EQUAL(uint32_t, 0, g_segments[1].needs_startup);
+
+        //cleanup
+        tpm_shm_broker_destroy(broker);
+    }
+
+    TEST_FUNCTION(tpm_shm_broker_serve_accepts_group_member_succeed)
+    {
+        //arrange
+        TPM_SHM_BROKER_HANDLE broker = create_broker();
+        g_peer.uid = TEST_OTHER_ID;
+        g_readable_socket = TEST_LISTEN_SOCKET;
+
+        setup_accept_mocks();
+        STRICT_EXPECTED_CALL(tpm_shm_sys_create(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_send_segment(TEST_CLIENT_SOCKET, TEST_SEGMENT_FD));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_close(TEST_SEGMENT_FD));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+
+        //act
+        int result = tpm_shm_broker_serve(broker, 2);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(size_t, 1, g_created_count);
+
+        //cleanup
+        tpm_shm_broker_destroy(broker);
+    }
+
+    TEST_FUNCTION(tpm_shm_broker_serve_refuses_other_user_succeed)
+    {
+        //arrange
+        TPM_SHM_BROKER_HANDLE broker = create_broker();
+        g_peer.uid = TEST_OTHER_ID;
+        g_peer.gid = TEST_OTHER_ID;
+        g_readable_socket = TEST_LISTEN_SOCKET;
+
+        setup_accept_mocks();
+        STRICT_EXPECTED_CALL(tpm_shm_sys_close(TEST_CLIENT_SOCKET));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+
+        //act
+        int result = tpm_shm_broker_serve(broker, 2);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(size_t, 0, g_created_count);
+
+        //cleanup
+        tpm_shm_broker_destroy(broker);
+    }
+
+    TEST_FUNCTION(tpm_shm_broker_serve_accepts_root_succeed)
+    {
+        //arrange
+        TPM_SHM_BROKER_HANDLE broker = create_broker();
+        g_peer.uid = 0;
+        g_peer.gid = TEST_OTHER_ID;
+
+        //act
+        connect_clients(broker, 1);
+
+        //assert
+        ASSERT_ARE_EQUAL(size_t, 1, g_created_count);
+
+        //cleanup
+        tpm_shm_broker_destroy(broker);
+    }
+
+    TEST_FUNCTION(tpm_shm_broker_serve_refuses_client_when_full_succeed)
+    {
+        //arrange
+        TPM_SHM_BROKER_HANDLE broker = create_broker();
+        connect_clients(broker, TPM_SHM_MAX_CLIENTS);
+        g_readable_socket = TEST_LISTEN_SOCKET;
+
+        setup_accept_mocks();
+        STRICT_EXPECTED_CALL(tpm_shm_sys_close(TEST_CLIENT_SOCKET + TPM_SHM_MAX_CLIENTS));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+
+        //act
+        int result = tpm_shm_broker_serve(broker, 2);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(size_t, TPM_SHM_MAX_CLIENTS, g_created_count);
+
+        //cleanup
+        tpm_shm_broker_destroy(broker);
+    }
+
+    TEST_FUNCTION(tpm_shm_broker_serve_send_segment_fail)
+    {
+        //arrange
+        TPM_SHM_BROKER_HANDLE broker = create_broker();
+        g_readable_socket = TEST_LISTEN_SOCKET;
+
+        setup_accept_mocks();
+        STRICT_EXPECTED_CALL(tpm_shm_sys_create(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_send_segment(TEST_CLIENT_SOCKET, TEST_SEGMENT_FD)).SetReturn(__LINE__);
+        STRICT_EXPECTED_CALL(tpm_shm_sys_unmap(&g_segments[0]));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_close(TEST_CLIENT_SOCKET));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_close(TEST_SEGMENT_FD));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+
+        //act
+        int result = tpm_shm_broker_serve(broker, 2);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_shm_broker_destroy(broker);
+    }
+
+    TEST_FUNCTION(tpm_shm_broker_serve_client_hung_up_dropped_succeed)
+    {
+        //arrange
+        TPM_SHM_BROKER_HANDLE broker = create_broker();
+        connect_clients(broker, 1);
+        // Written before the client exited, and not executed anymore
+        g_slot_on_poll = &g_segments[0].slot;
+        g_readable_socket = TEST_CLIENT_SOCKET;
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_shm_sys_poll(IGNORED_PTR_ARG, 2, 1, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_drain(TEST_CLIENT_SOCKET)).SetReturn(1);
+        STRICT_EXPECTED_CALL(tpm_shm_sys_unmap(&g_segments[0]));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_close(TEST_CLIENT_SOCKET));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+
+        //act
+        int result = tpm_shm_broker_serve(broker, 2);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_shm_broker_destroy(broker);
+    }
+
+    TEST_FUNCTION(tpm_shm_broker_serve_poll_fail)
+    {
+        //arrange
+        TPM_SHM_BROKER_HANDLE broker = create_broker();
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_shm_sys_poll(IGNORED_PTR_ARG, 1, 9, IGNORED_PTR_ARG)).SetReturn(-1);
+
+        //act
+        int result = tpm_shm_broker_serve(broker, 10);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, -1, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_shm_broker_destroy(broker);
+    }
+
+    TEST_FUNCTION(tpm_shm_broker_serve_round_trip_succeed)
+    {
+        //arrange
+        TPM_SHM_BROKER_HANDLE broker = create_broker();
+        TPM_SHM_SLOT* slot = &g_segments[0].slot;
+        connect_clients(broker, 1);
+        write_command(slot, TPM_COMM_PRIORITY_NORMAL, sizeof(TEST_GET_RANDOM_CMD));
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        setup_execute_mocks(slot, sizeof(TEST_GET_RANDOM_CMD));
+
+        //act
+        int result = tpm_shm_broker_serve(broker, 0);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 1, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(uint32_t, 1, slot->resp_seq);
+        ASSERT_ARE_EQUAL(uint32_t, sizeof(TEST_RESPONSE), slot->resp_len);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(slot->resp, TEST_RESPONSE, sizeof(TEST_RESPONSE)));
+        ASSERT_ARE_EQUAL(uint32_t, TPM_SHM_BUFFER_SIZE, g_resp_capacity);
+
+        //cleanup
+        tpm_shm_broker_destroy(broker);
+    }
+
+    TEST_FUNCTION(tpm_shm_broker_serve_waits_for_doorbell_succeed)
+    {
+        //arrange
+        TPM_SHM_BROKER_HANDLE broker = create_broker();
+        TPM_SHM_SLOT* slot = &g_segments[2].slot;
+        connect_clients(broker, 3);
+        g_slot_on_poll = slot;
+        g_readable_socket = TEST_CLIENT_SOCKET + 2;
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_shm_sys_poll(IGNORED_PTR_ARG, 4, 9, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tpm_shm_sys_drain(TEST_CLIENT_SOCKET + 2));
+        setup_execute_mocks(slot, sizeof(TEST_GET_RANDOM_CMD));
+
+        //act
+        int result = tpm_shm_broker_serve(broker, 10);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 1, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(uint32_t, 1, slot->resp_seq);
+
+        //cleanup
+        tpm_shm_broker_destroy(broker);
+    }
+
+    TEST_FUNCTION(tpm_shm_broker_serve_timeout_succeed)
+    {
+        //arrange
+        TPM_SHM_BROKER_HANDLE broker = create_broker();
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+
+        //act
+        int result = tpm_shm_broker_serve(broker, 1);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_shm_broker_destroy(broker);
+    }
+
+    TEST_FUNCTION(tpm_shm_broker_serve_high_priority_first_succeed)
+    {
+        //arrange
+        TPM_SHM_BROKER_HANDLE broker = create_broker();
+        TPM_SHM_SLOT* normal = &g_segments[1].slot;
+        TPM_SHM_SLOT* high = &g_segments[3].slot;
+        connect_clients(broker, 4);
+        write_command(normal, TPM_COMM_PRIORITY_NORMAL, sizeof(TEST_GET_RANDOM_CMD));
+        write_command(high, TPM_COMM_PRIORITY_HIGH, sizeof(TEST_GET_RANDOM_CMD));
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        setup_execute_mocks(high, sizeof(TEST_GET_RANDOM_CMD));
+        setup_execute_mocks(normal, sizeof(TEST_GET_RANDOM_CMD));
+
+        //act
+        int result = tpm_shm_broker_serve(broker, 0);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 2, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_shm_broker_destroy(broker);
+    }
+
+    TEST_FUNCTION(tpm_shm_broker_serve_response_bigger_than_slot_fail)
+    {
+        //arrange
+        TPM_SHM_BROKER_HANDLE broker = create_broker();
+        TPM_SHM_SLOT* slot = &g_segments[0].slot;
+        connect_clients(broker, 1);
+        write_command(slot, TPM_COMM_PRIORITY_NORMAL, sizeof(TEST_GET_RANDOM_CMD));
+        g_tpm_resp_len = TPM_SHM_BUFFER_SIZE + 1;
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        setup_execute_mocks(slot, sizeof(TEST_GET_RANDOM_CMD));
+
+        //act
+        int result = tpm_shm_broker_serve(broker, 0);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 1, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(uint32_t, TPM_SHM_BUFFER_SIZE, g_resp_capacity);
+        ASSERT_ARE_EQUAL(uint32_t, 1, slot->resp_seq);
+        ASSERT_ARE_EQUAL(uint32_t, 0, slot->resp_len);
+
+        //cleanup
+        tpm_shm_broker_destroy(broker);
+    }
+
+    TEST_FUNCTION(tpm_shm_broker_serve_command_bigger_than_slot_fail)
+    {
+        //arrange
+        TPM_SHM_BROKER_HANDLE broker = create_broker();
+        TPM_SHM_SLOT* slot = &g_segments[0].slot;
+        connect_clients(broker, 1);
+        write_command(slot, TPM_COMM_PRIORITY_NORMAL, TPM_SHM_BUFFER_SIZE + 1);
+
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(tpm_shm_sys_wake(&slot->resp_seq));
+
+        //act
+        int result = tpm_shm_broker_serve(broker, 0);
+
+        //assert
+        ASSERT_ARE_EQUAL(int, 1, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(uint32_t, 1, slot->resp_seq);
+        ASSERT_ARE_EQUAL(uint32_t, 0, slot->resp_len);
+
+        //cleanup
+        tpm_shm_broker_destroy(broker);
+    }
+
+END_TEST_SUITE(tpm_shm_broker_ut)
@@ -0,0 +1,657 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#else
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+#include "azure_c_shared_utility/macro_utils.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_utpm_c/tpm_codec.h"
+#include "azure_utpm_c/tpm_host_hash.h"
+#include "azure_utpm_c/tpm_timer.h"
+#undef ENABLE_MOCKS
+
+#include "azure_utpm_c/tpm_sign_coalescer.h"
+
+#define TEST_LOCK_HANDLE        (LOCK_HANDLE)0x4321
+#define TEST_COND_HANDLE        (COND_HANDLE)0x4322
+#define TEST_TTL_MS             100
+#define TEST_SIG_SIZE           32
+#define TEST_NS_PER_MS          1000000ULL
+
+static BYTE TEST_TOKEN[] = "sr=myhub.azure-devices.net%2fdevices%2fmydevice&se=1500000000";
+
+static uint64_t g_now_ns;
+
+static TPM_RC my_tpm_host_hash(TPMI_ALG_HASH hashAlg, const BYTE* data, UINT32 dataSize, TPM2B_DIGEST* outHash)
+{
+    UINT32 index;
+    (void)hashAlg;
+    memset(outHash, 0, sizeof(TPM2B_DIGEST));
+    outHash->t.size = TEST_SIG_SIZE;
+    for (index = 0; index < dataSize; index++)
+    {
+        outHash->t.buffer[index % TEST_SIG_SIZE] ^= data[index];
+    }
+    return TPM_RC_SUCCESS;
+}
+
+static UINT32 my_SignData(TSS_DEVICE* tpm, TSS_SESSION* sess, BYTE* tokenData, UINT32 tokenSize, BYTE* signatureBuffer, UINT32 sigBufSize)
+{
+    (void)sess;
+    (void)tokenData;
+    (void)tokenSize;
+    (void)sigBufSize;
+    memset(signatureBuffer, 0xA5, TEST_SIG_SIZE);
+    tpm->LastRawResponse = TPM_RC_SUCCESS;
+    return TEST_SIG_SIZE;
+}
+
+static uint64_t my_tpm_timer_get_ns(void)
+{
+    return g_now_ns;
+}
+
+static UINT32 my_TSS_GetTpmProperty(TSS_DEVICE* tpm, TPM_PT prop)
+{
+    (void)tpm;
+    return prop;
+}
+
+static void set_password_session(TSS_SESSION* sess, BYTE password)
+{
+    memset(sess, 0, sizeof(TSS_SESSION));
+    sess->SessIn.sessionHandle = TPM_RS_PW;
+    sess->SessIn.hmac.t.size = 1;
+    sess->SessIn.hmac.t.buffer[0] = password;
+}
+
+// Expected calls identifying the signature of TEST_TOKEN
+static void setup_sign_key_mocks(void)
+{
+    STRICT_EXPECTED_CALL(tpm_host_hash(TPM_ALG_SHA256, IGNORED_PTR_ARG, sizeof(TEST_TOKEN), IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(TSS_GetTpmProperty(IGNORED_PTR_ARG, TPM_PT_MANUFACTURER));
+    STRICT_EXPECTED_CALL(TSS_GetTpmProperty(IGNORED_PTR_ARG, TPM_PT_VENDOR_STRING_1));
+    STRICT_EXPECTED_CALL(TSS_GetTpmProperty(IGNORED_PTR_ARG, TPM_PT_FIRMWARE_VERSION_1));
+    STRICT_EXPECTED_CALL(TSS_GetTpmProperty(IGNORED_PTR_ARG, TPM_PT_FIRMWARE_VERSION_2));
+}
+
+// Expected calls of a request that issues the HMAC itself
+static void setup_sign_leader_mocks(bool keep)
+{
+    setup_sign_key_mocks();
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(SignData(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_TOKEN, sizeof(TEST_TOKEN), IGNORED_PTR_ARG, TEST_SIG_SIZE));
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    if (keep)
+    {
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+    }
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+}
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+BEGIN_TEST_SUITE(tpm_sign_coalescer_ut)
+
+    TEST_SUITE_INITIALIZE(suite_init)
+    {
+        int result;
+
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = TEST_MUTEX_CREATE();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+
+        (void)umock_c_init(on_umock_c_error);
+
+        result = umocktypes_charptr_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+        result = umocktypes_stdint_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+
+        REGISTER_UMOCK_ALIAS_TYPE(BOOL, int);
+        REGISTER_UMOCK_ALIAS_TYPE(UINT32, uint32_t);
+        REGISTER_UMOCK_ALIAS_TYPE(TPM_RC, uint32_t);
+        REGISTER_UMOCK_ALIAS_TYPE(TPMI_ALG_HASH, uint16_t);
+        REGISTER_UMOCK_ALIAS_TYPE(TPM_PT, uint32_t);
+        REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
+        REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
+        REGISTER_UMOCK_ALIAS_TYPE(COND_HANDLE, void*);
+        REGISTER_UMOCK_ALIAS_TYPE(COND_RESULT, int);
+
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+        REGISTER_GLOBAL_MOCK_RETURN(Lock_Init, TEST_LOCK_HANDLE);
+        REGISTER_GLOBAL_MOCK_RETURN(Lock, LOCK_OK);
+        REGISTER_GLOBAL_MOCK_RETURN(Unlock, LOCK_OK);
+        REGISTER_GLOBAL_MOCK_RETURN(Lock_Deinit, LOCK_OK);
+        REGISTER_GLOBAL_MOCK_RETURN(Condition_Init, TEST_COND_HANDLE);
+
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_host_hash, my_tpm_host_hash);
+        REGISTER_GLOBAL_MOCK_HOOK(SignData, my_SignData);
+        REGISTER_GLOBAL_MOCK_HOOK(tpm_timer_get_ns, my_tpm_timer_get_ns);
+        REGISTER_GLOBAL_MOCK_HOOK(TSS_GetTpmProperty, my_TSS_GetTpmProperty);
+    }
+
+    TEST_SUITE_CLEANUP(suite_cleanup)
+    {
+        umock_c_deinit();
+
+        TEST_MUTEX_DESTROY(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(method_init)
+    {
+        if (TEST_MUTEX_ACQUIRE(g_testByTest))
+        {
+            ASSERT_FAIL("Could not acquire test serialization mutex.");
+        }
+        umock_c_reset_all_calls();
+        g_now_ns = 1000 * TEST_NS_PER_MS;
+    }
+
+    TEST_FUNCTION_CLEANUP(method_cleanup)
+    {
+        TEST_MUTEX_RELEASE(g_testByTest);
+    }
+
+    TEST_FUNCTION(tpm_sign_coalescer_create_succeed)
+    {
+        //arrange
+        size_t index;
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(Lock_Init());
+        for (index = 0; index < TSS_SIGN_COALESCER_SIZE; index++)
+        {
+            STRICT_EXPECTED_CALL(Condition_Init());
+        }
+
+        //act
+        TSS_SIGN_COALESCER_HANDLE coalescer = tpm_sign_coalescer_create(TEST_TTL_MS);
+
+        //assert
+        ASSERT_IS_NOT_NULL(coalescer);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_sign_coalescer_destroy(coalescer);
+    }
+
+    TEST_FUNCTION(tpm_sign_coalescer_create_condition_fail)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(Lock_Init());
+        STRICT_EXPECTED_CALL(Condition_Init());
+        STRICT_EXPECTED_CALL(Condition_Init()).SetReturn(NULL);
+        STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
+        STRICT_EXPECTED_CALL(Lock_Deinit(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+        //act
+        TSS_SIGN_COALESCER_HANDLE coalescer = tpm_sign_coalescer_create(TEST_TTL_MS);
+
+        //assert
+        ASSERT_IS_NULL(coalescer);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_sign_coalescer_sign_handle_NULL_fail)
+    {
+        //arrange
+        TSS_DEVICE tpm = { 0 };
+        BYTE signature[TEST_SIG_SIZE];
+
+        //act
+        UINT32 result = tpm_sign_coalescer_sign(NULL, &tpm, NULL, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_sign_coalescer_sign_buffer_too_small_fail)
+    {
+        //arrange
+        TSS_DEVICE tpm = { 0 };
+        BYTE signature[TEST_SIG_SIZE];
+        TSS_SIGN_COALESCER_HANDLE coalescer = tpm_sign_coalescer_create(TEST_TTL_MS);
+        umock_c_reset_all_calls();
+
+        //act
+        UINT32 result = tpm_sign_coalescer_sign(coalescer, &tpm, NULL, TEST_TOKEN, sizeof(TEST_TOKEN), signature, TEST_SIG_SIZE - 1);
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TEST_SIG_SIZE, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_sign_coalescer_destroy(coalescer);
+    }
+
+    TEST_FUNCTION(tpm_sign_coalescer_sign_first_request_signs_succeed)
+    {
+        //arrange
+        TSS_DEVICE tpm = { 0 };
+        BYTE signature[TEST_SIG_SIZE] = { 0 };
+        TSS_SIGN_COALESCER_HANDLE coalescer = tpm_sign_coalescer_create(TEST_TTL_MS);
+        umock_c_reset_all_calls();
+
+        setup_sign_leader_mocks(true);
+
+        //act
+        UINT32 result = tpm_sign_coalescer_sign(coalescer, &tpm, NULL, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TEST_SIG_SIZE, result);
+        ASSERT_ARE_EQUAL(int, 0xA5, signature[TEST_SIG_SIZE - 1]);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_sign_coalescer_destroy(coalescer);
+    }
+
+    TEST_FUNCTION(tpm_sign_coalescer_sign_kept_signature_succeed)
+    {
+        //arrange
+        TSS_DEVICE tpm = { 0 };
+        BYTE signature[TEST_SIG_SIZE];
+        TSS_SIGN_COALESCER_STATS stats;
+        TSS_SIGN_COALESCER_HANDLE coalescer = tpm_sign_coalescer_create(TEST_TTL_MS);
+        (void)tpm_sign_coalescer_sign(coalescer, &tpm, NULL, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+        memset(signature, 0, sizeof(signature));
+        g_now_ns += (TEST_TTL_MS - 1) * TEST_NS_PER_MS;
+        umock_c_reset_all_calls();
+
+        setup_sign_key_mocks();
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+        //act
+        UINT32 result = tpm_sign_coalescer_sign(coalescer, &tpm, NULL, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TEST_SIG_SIZE, result);
+        ASSERT_ARE_EQUAL(int, 0xA5, signature[0]);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(int, 0, tpm_sign_coalescer_get_stats(coalescer, &stats));
+        ASSERT_ARE_EQUAL(uint64_t, 1, stats.Signed);
+        ASSERT_ARE_EQUAL(uint64_t, 1, stats.Cached);
+
+        //cleanup
+        tpm_sign_coalescer_destroy(coalescer);
+    }
+
+    TEST_FUNCTION(tpm_sign_coalescer_sign_expired_signature_signs_succeed)
+    {
+        //arrange
+        TSS_DEVICE tpm = { 0 };
+        BYTE signature[TEST_SIG_SIZE];
+        TSS_SIGN_COALESCER_HANDLE coalescer = tpm_sign_coalescer_create(TEST_TTL_MS);
+        (void)tpm_sign_coalescer_sign(coalescer, &tpm, NULL, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+        g_now_ns += TEST_TTL_MS * TEST_NS_PER_MS;
+        umock_c_reset_all_calls();
+
+        setup_sign_key_mocks();
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(SignData(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_TOKEN, sizeof(TEST_TOKEN), IGNORED_PTR_ARG, TEST_SIG_SIZE));
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+        //act
+        UINT32 result = tpm_sign_coalescer_sign(coalescer, &tpm, NULL, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TEST_SIG_SIZE, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_sign_coalescer_destroy(coalescer);
+    }
+
+    TEST_FUNCTION(tpm_sign_coalescer_sign_no_ttl_signs_again_succeed)
+    {
+        //arrange
+        TSS_DEVICE tpm = { 0 };
+        BYTE signature[TEST_SIG_SIZE];
+        TSS_SIGN_COALESCER_HANDLE coalescer = tpm_sign_coalescer_create(0);
+        (void)tpm_sign_coalescer_sign(coalescer, &tpm, NULL, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+        umock_c_reset_all_calls();
+
+        setup_sign_leader_mocks(false);
+
+        //act
+        UINT32 result = tpm_sign_coalescer_sign(coalescer, &tpm, NULL, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TEST_SIG_SIZE, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_sign_coalescer_destroy(coalescer);
+    }
+
+    TEST_FUNCTION(tpm_sign_coalescer_sign_failure_not_kept_succeed)
+    {
+        //arrange
+        TSS_DEVICE tpm = { 0 };
+        BYTE signature[TEST_SIG_SIZE];
+        TSS_SIGN_COALESCER_HANDLE coalescer = tpm_sign_coalescer_create(TEST_TTL_MS);
+        umock_c_reset_all_calls();
+
+        setup_sign_key_mocks();
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(SignData(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_TOKEN, sizeof(TEST_TOKEN), IGNORED_PTR_ARG, TEST_SIG_SIZE)).SetReturn(0);
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+        setup_sign_leader_mocks(true);
+
+        //act
+        UINT32 result = tpm_sign_coalescer_sign(coalescer, &tpm, NULL, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+        UINT32 retry = tpm_sign_coalescer_sign(coalescer, &tpm, NULL, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, 0, result);
+        ASSERT_ARE_EQUAL(uint32_t, TEST_SIG_SIZE, retry);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_sign_coalescer_destroy(coalescer);
+    }
+
+    TEST_FUNCTION(tpm_sign_coalescer_sign_hash_fail_signs_uncoalesced_succeed)
+    {
+        //arrange
+        TSS_DEVICE tpm = { 0 };
+        BYTE signature[TEST_SIG_SIZE];
+        TSS_SIGN_COALESCER_HANDLE coalescer = tpm_sign_coalescer_create(TEST_TTL_MS);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(tpm_host_hash(TPM_ALG_SHA256, IGNORED_PTR_ARG, sizeof(TEST_TOKEN), IGNORED_PTR_ARG)).SetReturn(TPM_RC_HASH);
+        STRICT_EXPECTED_CALL(SignData(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_TOKEN, sizeof(TEST_TOKEN), IGNORED_PTR_ARG, TEST_SIG_SIZE));
+
+        //act
+        UINT32 result = tpm_sign_coalescer_sign(coalescer, &tpm, NULL, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TEST_SIG_SIZE, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_sign_coalescer_destroy(coalescer);
+    }
+
+    TEST_FUNCTION(tpm_sign_coalescer_sign_property_fail_signs_uncoalesced_succeed)
+    {
+        //arrange
+        TSS_DEVICE tpm = { 0 };
+        BYTE signature[TEST_SIG_SIZE];
+        TSS_SIGN_COALESCER_HANDLE coalescer = tpm_sign_coalescer_create(TEST_TTL_MS);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(tpm_host_hash(TPM_ALG_SHA256, IGNORED_PTR_ARG, sizeof(TEST_TOKEN), IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(TSS_GetTpmProperty(IGNORED_PTR_ARG, TPM_PT_MANUFACTURER)).SetReturn((UINT32)-1);
+        STRICT_EXPECTED_CALL(SignData(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_TOKEN, sizeof(TEST_TOKEN), IGNORED_PTR_ARG, TEST_SIG_SIZE));
+
+        //act
+        UINT32 result = tpm_sign_coalescer_sign(coalescer, &tpm, NULL, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TEST_SIG_SIZE, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_sign_coalescer_destroy(coalescer);
+    }
+
+    TEST_FUNCTION(tpm_sign_coalescer_sign_same_password_other_device_kept_succeed)
+    {
+        //arrange
+        TSS_DEVICE tpm1 = { 0 };
+        TSS_DEVICE tpm2 = { 0 };
+        TSS_SESSION sess1;
+        TSS_SESSION sess2;
+        BYTE signature[TEST_SIG_SIZE];
+        TSS_SIGN_COALESCER_STATS stats;
+        TSS_SIGN_COALESCER_HANDLE coalescer = tpm_sign_coalescer_create(TEST_TTL_MS);
+        set_password_session(&sess1, 0x11);
+        set_password_session(&sess2, 0x11);
+        (void)tpm_sign_coalescer_sign(coalescer, &tpm1, &sess1, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+        umock_c_reset_all_calls();
+
+        setup_sign_key_mocks();
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+        //act
+        UINT32 result = tpm_sign_coalescer_sign(coalescer, &tpm2, &sess2, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TEST_SIG_SIZE, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(int, 0, tpm_sign_coalescer_get_stats(coalescer, &stats));
+        ASSERT_ARE_EQUAL(uint64_t, 1, stats.Cached);
+
+        //cleanup
+        tpm_sign_coalescer_destroy(coalescer);
+    }
+
+    TEST_FUNCTION(tpm_sign_coalescer_sign_other_password_signs_succeed)
+    {
+        //arrange
+        TSS_DEVICE tpm = { 0 };
+        TSS_SESSION sess1;
+        TSS_SESSION sess2;
+        BYTE signature[TEST_SIG_SIZE];
+        TSS_SIGN_COALESCER_STATS stats;
+        TSS_SIGN_COALESCER_HANDLE coalescer = tpm_sign_coalescer_create(TEST_TTL_MS);
+        set_password_session(&sess1, 0x11);
+        set_password_session(&sess2, 0x22);
+        (void)tpm_sign_coalescer_sign(coalescer, &tpm, &sess1, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+        umock_c_reset_all_calls();
+
+        setup_sign_leader_mocks(true);
+
+        //act
+        UINT32 result = tpm_sign_coalescer_sign(coalescer, &tpm, &sess2, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TEST_SIG_SIZE, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(int, 0, tpm_sign_coalescer_get_stats(coalescer, &stats));
+        ASSERT_ARE_EQUAL(uint64_t, 2, stats.Signed);
+        ASSERT_ARE_EQUAL(uint64_t, 0, stats.Cached);
+
+        //cleanup
+        tpm_sign_coalescer_destroy(coalescer);
+    }
+
+    TEST_FUNCTION(tpm_sign_coalescer_sign_other_endpoint_signs_succeed)
+    {
+        //arrange
+        TSS_DEVICE tpm1 = { 0 };
+        TSS_DEVICE tpm2 = { 0 };
+        TSS_SESSION sess;
+        BYTE signature[TEST_SIG_SIZE];
+        TSS_SIGN_COALESCER_HANDLE coalescer = tpm_sign_coalescer_create(TEST_TTL_MS);
+        set_password_session(&sess, 0x11);
+        tpm2.comms_endpoint = "mssim:localhost:2321";
+        (void)tpm_sign_coalescer_sign(coalescer, &tpm1, &sess, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+        umock_c_reset_all_calls();
+
+        setup_sign_key_mocks();
+        STRICT_EXPECTED_CALL(tpm_host_hash(TPM_ALG_SHA256, IGNORED_PTR_ARG, (UINT32)strlen(tpm2.comms_endpoint), IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(SignData(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_TOKEN, sizeof(TEST_TOKEN), IGNORED_PTR_ARG, TEST_SIG_SIZE));
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+        //act
+        UINT32 result = tpm_sign_coalescer_sign(coalescer, &tpm2, &sess, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TEST_SIG_SIZE, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_sign_coalescer_destroy(coalescer);
+    }
+
+    TEST_FUNCTION(tpm_sign_coalescer_sign_session_of_other_device_signs_succeed)
+    {
+        //arrange
+        TSS_DEVICE tpm1 = { 0 };
+        TSS_DEVICE tpm2 = { 0 };
+        TSS_SESSION sess1;
+        TSS_SESSION sess2;
+        BYTE signature[TEST_SIG_SIZE];
+        TSS_SIGN_COALESCER_HANDLE coalescer = tpm_sign_coalescer_create(TEST_TTL_MS);
+        memset(&sess1, 0, sizeof(sess1));
+        sess1.SessIn.sessionHandle = HMAC_SESSION_FIRST;
+        sess2 = sess1;
+        (void)tpm_sign_coalescer_sign(coalescer, &tpm1, &sess1, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+        umock_c_reset_all_calls();
+
+        setup_sign_leader_mocks(true);
+
+        //act
+        UINT32 result = tpm_sign_coalescer_sign(coalescer, &tpm2, &sess2, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TEST_SIG_SIZE, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_sign_coalescer_destroy(coalescer);
+    }
+
+    TEST_FUNCTION(tpm_sign_coalescer_sign_lock_fail_on_completion_publishes_succeed)
+    {
+        //arrange
+        TSS_DEVICE tpm = { 0 };
+        BYTE signature[TEST_SIG_SIZE];
+        TSS_SIGN_COALESCER_HANDLE coalescer = tpm_sign_coalescer_create(TEST_TTL_MS);
+        umock_c_reset_all_calls();
+
+        setup_sign_key_mocks();
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(SignData(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_TOKEN, sizeof(TEST_TOKEN), IGNORED_PTR_ARG, TEST_SIG_SIZE));
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE)).SetReturn(LOCK_ERROR);
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        setup_sign_key_mocks();
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(tpm_timer_get_ns());
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+        //act
+        UINT32 result = tpm_sign_coalescer_sign(coalescer, &tpm, NULL, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+        memset(signature, 0, sizeof(signature));
+        UINT32 kept = tpm_sign_coalescer_sign(coalescer, &tpm, NULL, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TEST_SIG_SIZE, result);
+        ASSERT_ARE_EQUAL(uint32_t, TEST_SIG_SIZE, kept);
+        ASSERT_ARE_EQUAL(int, 0xA5, signature[0]);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_sign_coalescer_destroy(coalescer);
+    }
+
+    TEST_FUNCTION(tpm_sign_coalescer_clear_forgets_signatures_succeed)
+    {
+        //arrange
+        TSS_DEVICE tpm = { 0 };
+        BYTE signature[TEST_SIG_SIZE];
+        TSS_SIGN_COALESCER_HANDLE coalescer = tpm_sign_coalescer_create(TEST_TTL_MS);
+        (void)tpm_sign_coalescer_sign(coalescer, &tpm, NULL, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+        setup_sign_leader_mocks(true);
+
+        //act
+        tpm_sign_coalescer_clear(coalescer);
+        UINT32 result = tpm_sign_coalescer_sign(coalescer, &tpm, NULL, TEST_TOKEN, sizeof(TEST_TOKEN), signature, sizeof(signature));
+
+        //assert
+        ASSERT_ARE_EQUAL(uint32_t, TEST_SIG_SIZE, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+        tpm_sign_coalescer_destroy(coalescer);
+    }
+
+    TEST_FUNCTION(tpm_sign_coalescer_get_stats_handle_NULL_fail)
+    {
+        //arrange
+        TSS_SIGN_COALESCER_STATS stats;
+
+        //act
+        int result = tpm_sign_coalescer_get_stats(NULL, &stats);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+END_TEST_SUITE(tpm_sign_coalescer_ut)
@@ -0,0 +1,349 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#else
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+#include "umocktypes_bool.h"
+#include "azure_c_shared_utility/macro_utils.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+#undef ENABLE_MOCKS
+
+#include "azure_utpm_c/tpm_transcript.h"
+
+#define TEST_TRANSCRIPT_PATH    "tpm_transcript_ut.trc"
+#define TEST_MISSING_PATH       "tpm_transcript_ut_missing.trc"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+static const unsigned char TEST_COMMAND[] = { 0x80, 0x01, 0x00, 0x00, 0x00, 0x0c, 0x00, 0x00, 0x01, 0x44, 0x00, 0x00 };
+static const unsigned char TEST_RESPONSE[] = { 0x80, 0x01, 0x00, 0x00, 0x00, 0x0a, 0x00, 0x00, 0x00, 0x00 };
+
+static void write_test_file(const char* path, const unsigned char* bytes, size_t length)
+{
+    FILE* file = fopen(path, "wb");
+    ASSERT_IS_NOT_NULL(file);
+    ASSERT_ARE_EQUAL(size_t, length, fwrite(bytes, 1, length, file));
+    (void)fclose(file);
+}
+
+static void record_test_transcript(void)
+{
+    TPM_TRANSCRIPT_HANDLE handle = tpm_transcript_create(TEST_TRANSCRIPT_PATH);
+    ASSERT_IS_NOT_NULL(handle);
+    ASSERT_ARE_EQUAL(int, 0, tpm_transcript_write_command(handle, TEST_COMMAND, sizeof(TEST_COMMAND)));
+    ASSERT_ARE_EQUAL(int, 0, tpm_transcript_write_response(handle, TEST_RESPONSE, sizeof(TEST_RESPONSE), 0x123456789ULL));
+    ASSERT_ARE_EQUAL(int, 0, tpm_transcript_write_command(handle, TEST_COMMAND, sizeof(TEST_COMMAND)));
+    ASSERT_ARE_EQUAL(int, 0, tpm_transcript_write_response(handle, NULL, 0, 42));
+    tpm_transcript_close(handle);
+}
+
+BEGIN_TEST_SUITE(tpm_transcript_ut)
+
+    TEST_SUITE_INITIALIZE(suite_init)
+    {
+        int result;
+
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = TEST_MUTEX_CREATE();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+
+        (void)umock_c_init(on_umock_c_error);
+
+        result = umocktypes_charptr_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+        result = umocktypes_stdint_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+        result = umocktypes_bool_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+        REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+    }
+
+    TEST_SUITE_CLEANUP(suite_cleanup)
+    {
+        umock_c_deinit();
+
+        (void)remove(TEST_TRANSCRIPT_PATH);
+        TEST_MUTEX_DESTROY(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(method_init)
+    {
+        if (TEST_MUTEX_ACQUIRE(g_testByTest))
+        {
+            ASSERT_FAIL("Could not acquire test serialization mutex.");
+        }
+        umock_c_reset_all_calls();
+    }
+
+    TEST_FUNCTION_CLEANUP(method_cleanup)
+    {
+        TEST_MUTEX_RELEASE(g_testByTest);
+    }
+
+    TEST_FUNCTION(tpm_transcript_create_path_NULL_fail)
+    {
+        //arrange
+
+        //act
+        TPM_TRANSCRIPT_HANDLE handle = tpm_transcript_create(NULL);
+
+        //assert
+        ASSERT_IS_NULL(handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_transcript_create_malloc_fail)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG)).SetReturn(NULL);
+
+        //act
+        TPM_TRANSCRIPT_HANDLE handle = tpm_transcript_create(TEST_TRANSCRIPT_PATH);
+
+        //assert
+        ASSERT_IS_NULL(handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_transcript_write_response_without_command_fail)
+    {
+        //arrange
+        TPM_TRANSCRIPT_HANDLE handle = tpm_transcript_create(TEST_TRANSCRIPT_PATH);
+        ASSERT_IS_NOT_NULL(handle);
+
+        //act
+        int result = tpm_transcript_write_response(handle, TEST_RESPONSE, sizeof(TEST_RESPONSE), 0);
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+        //cleanup
+        tpm_transcript_close(handle);
+    }
+
+    TEST_FUNCTION(tpm_transcript_write_command_twice_fail)
+    {
+        //arrange
+        TPM_TRANSCRIPT_HANDLE handle = tpm_transcript_create(TEST_TRANSCRIPT_PATH);
+        ASSERT_IS_NOT_NULL(handle);
+        ASSERT_ARE_EQUAL(int, 0, tpm_transcript_write_command(handle, TEST_COMMAND, sizeof(TEST_COMMAND)));
+
+        //act
+        int result = tpm_transcript_write_command(handle, TEST_COMMAND, sizeof(TEST_COMMAND));
+
+        //assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+        //cleanup
+        tpm_transcript_close(handle);
+    }
+
+    TEST_FUNCTION(tpm_transcript_open_missing_fail)
+    {
+        //arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+        //act
+        TPM_TRANSCRIPT_HANDLE handle = tpm_transcript_open(TEST_MISSING_PATH);
+
+        //assert
+        ASSERT_IS_NULL(handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_transcript_open_bad_magic_fail)
+    {
+        //arrange
+        static const unsigned char not_transcript[] = "UTPMTRC0";
+        write_test_file(TEST_TRANSCRIPT_PATH, not_transcript, sizeof(not_transcript) - 1);
+
+        //act
+        TPM_TRANSCRIPT_HANDLE handle = tpm_transcript_open(TEST_TRANSCRIPT_PATH);
+
+        //assert
+        ASSERT_IS_NULL(handle);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_transcript_open_truncated_fail)
+    {
+        //arrange
+        static const unsigned char truncated[] = { 'U', 'T', 'P', 'M', 'T', 'R', 'C', '1', 0x00, 0x00, 0x00, 0x0c, 0x80, 0x01 };
+        write_test_file(TEST_TRANSCRIPT_PATH, truncated, sizeof(truncated));
+
+        //act
+        TPM_TRANSCRIPT_HANDLE handle = tpm_transcript_open(TEST_TRANSCRIPT_PATH);
+
+        //assert
+        ASSERT_IS_NULL(handle);
+
+        //cleanup
+    }
+
+    TEST_FUNCTION(tpm_transcript_open_empty_succeed)
+    {
+        //arrange
+        TPM_TRANSCRIPT_ENTRY entry;
+        TPM_TRANSCRIPT_HANDLE handle = tpm_transcript_create(TEST_TRANSCRIPT_PATH);
+        ASSERT_IS_NOT_NULL(handle);
+        tpm_transcript_close(handle);
+
+        //act
+        handle = tpm_transcript_open(TEST_TRANSCRIPT_PATH);
+
+        //assert
+        ASSERT_IS_NOT_NULL(handle);
+        ASSERT_IS_FALSE(tpm_transcript_next(handle, &entry));
+
+        //cleanup
+        tpm_transcript_close(handle);
+    }
+
+    TEST_FUNCTION(tpm_transcript_next_round_trip_succeed)
+    {
+        //arrange
+        TPM_TRANSCRIPT_ENTRY entry;
+        TPM_TRANSCRIPT_HANDLE handle;
+        record_test_transcript();
+        handle = tpm_transcript_open(TEST_TRANSCRIPT_PATH);
+        ASSERT_IS_NOT_NULL(handle);
+
+        //act
+        bool first = tpm_transcript_next(handle, &entry);
+
+        //assert
+        ASSERT_IS_TRUE(first);
+        ASSERT_ARE_EQUAL(uint32_t, sizeof(TEST_COMMAND), entry.cmd_len);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(TEST_COMMAND, entry.cmd_bytes, sizeof(TEST_COMMAND)));
+        ASSERT_ARE_EQUAL(uint32_t, sizeof(TEST_RESPONSE), entry.resp_len);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(TEST_RESPONSE, entry.resp_bytes, sizeof(TEST_RESPONSE)));
+        ASSERT_ARE_EQUAL(uint64_t, 0x123456789ULL, entry.latency_ns);
+
+        ASSERT_IS_TRUE(tpm_transcript_next(handle, &entry));
+        ASSERT_ARE_EQUAL(uint32_t, 0, entry.resp_len);
+        ASSERT_ARE_EQUAL(uint64_t, 42, entry.latency_ns);
+        ASSERT_IS_FALSE(tpm_transcript_next(handle, &entry));
+
+        //cleanup
+        tpm_transcript_close(handle);
+    }
+
+    TEST_FUNCTION(tpm_transcript_peek_does_not_consume_succeed)
+    {
+        //arrange
+        TPM_TRANSCRIPT_ENTRY peeked;
+        TPM_TRANSCRIPT_ENTRY entry;
+        TPM_TRANSCRIPT_HANDLE handle;
+        record_test_transcript();
+        handle = tpm_transcript_open(TEST_TRANSCRIPT_PATH);
+        ASSERT_IS_NOT_NULL(handle);
+
+        //act
+        bool result = tpm_transcript_peek(handle, &peeked);
+
+        //assert
+        ASSERT_IS_TRUE(result);
+        ASSERT_IS_TRUE(tpm_transcript_next(handle, &entry));
+        ASSERT_ARE_EQUAL(void_ptr, peeked.cmd_bytes, entry.cmd_bytes);
+
+        //cleanup
+        tpm_transcript_close(handle);
+    }
+
+    TEST_FUNCTION(tpm_transcript_rewind_succeed)
+    {
+        //arrange
+        TPM_TRANSCRIPT_ENTRY first;
+        TPM_TRANSCRIPT_ENTRY entry;
+        TPM_TRANSCRIPT_HANDLE handle;
+        record_test_transcript();
+        handle = tpm_transcript_open(TEST_TRANSCRIPT_PATH);
+        ASSERT_IS_NOT_NULL(handle);
+        ASSERT_IS_TRUE(tpm_transcript_next(handle, &first));
+        ASSERT_IS_TRUE(tpm_transcript_next(handle, &entry));
+
+        //act
+        tpm_transcript_rewind(handle);
+
+        //assert
+        ASSERT_IS_TRUE(tpm_transcript_next(handle, &entry));
+        ASSERT_ARE_EQUAL(void_ptr, first.cmd_bytes, entry.cmd_bytes);
+
+        //cleanup
+        tpm_transcript_close(handle);
+    }
+
+    TEST_FUNCTION(tpm_transcript_close_NULL_succeed)
+    {
+        //arrange
+
+        //act
+        tpm_transcript_close(NULL);
+
+        //assert
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        //cleanup
+    }
+
+END_TEST_SUITE(tpm_transcript_ut)